@@ -0,0 +1,1334 @@
+/* aggr_union.c
+
+   This program computes the union of all geometries in a table, and writes
+   the result into another table.
+
+   Chapter 14 shows that a single SDO_AGGR_UNION over a large table is slow,
+   and that grouping the rows (on MOD(ROWNUM, n)) and computing unions of
+   unions is much faster (listings 14-10 to 14-12). This program takes that
+   idea further: it performs a cascaded union driven from the client.
+
+   - The rows are first sorted along a Hilbert curve, using the center of
+     their MBR. Consecutive rows are then close to each other in space.
+   - The sorted rows are cut into groups of group_size rows. The union of
+     each group is computed with SDO_AGGR_UNION.
+   - The unions of neighbouring groups are then combined two by two with
+     SDO_GEOM.SDO_UNION, level after level, until one geometry remains.
+
+   Because neighbouring geometries are combined first, shared boundaries
+   disappear early and the intermediate results stay small, unlike with
+   ROWNUM groups, which mix geometries from all over the table.
+
+   The unions are computed by a pool of threads, each with its own database
+   session. Each thread has a queue of tasks. It starts with a block of
+   neighbouring groups, and queues the union of two results as soon as both
+   are ready. A thread that has nothing left to do takes the oldest task from
+   the queue of another thread (work stealing).
+
+   It illustrates the following concepts:
+   - using OCI from several threads, with one session per thread
+   - passing geometry objects as bind variables
+   - binding a collection (a list of rowids) to a query
+   - spatial ordering with a Hilbert curve
+
+   The program takes the following command line arguments:
+
+     aggr_union username password database tablename geo_column result_table [tolerance] [group_size] [threads] [mode]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - tablename = the table that contains the geometries
+   - geo_column = the geometry column
+   - result_table = the table to write the union into. It must have a
+     geometry column with the same name as in the input table
+   - tolerance = tolerance for the union operations (default is 0.5)
+   - group_size = number of rows per SDO_AGGR_UNION group, up to 1000 (default is 50)
+   - threads = number of threads and database sessions (default is 4)
+   - mode = how the union is computed
+     CLIENT = cascaded union driven by the program (default)
+     SERVER = the pipelined aggregate union of listing 14-12, for comparison
+
+   Notes:
+
+   The overlay operations themselves are done by the database (SDO_AGGR_UNION
+   and SDO_GEOM.SDO_UNION): the program only decides which geometries to
+   combine, in which order, and in which session. The intermediate results
+   stay in the object cache as fetched, and are bound as they are to the
+   next union: the program never decodes them into C structures, nor builds
+   them again element by element.
+
+   The rows of a group are passed as a bound list of rowids (a
+   SYS.ODCIVARCHAR2LIST), not as literals in an IN list, so the query of a
+   group is parsed once per session rather than once per group.
+
+   Run the program in both modes on the same table and compare the elapsed
+   times. For example, on the US_COUNTIES table:
+
+     aggr_union scott tiger orcl us_counties geom us_union 0.5 50 4 CLIENT
+     aggr_union scott tiger orcl us_counties geom us_union 0.5 50 4 SERVER
+
+   The program must be linked with spatial_util.c. It uses POSIX threads.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <oci.h>
+#include "sdo_geometry.h"
+#include "spatial_util.h"
+
+#define ARRAY_SIZE 1000               /* Rows per fetch when reading the MBRs */
+#define MAX_GROUP_SIZE 1000           /* Rows per SDO_AGGR_UNION group */
+#define MAX_THREADS 64
+#define MAX_LEVELS 64
+#define HILBERT_ORDER 16              /* Bits per axis of the Hilbert grid */
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle, shared by all threads */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A geometry object in the object cache of the environment. Results are kept
+   there as fetched, and bound as they are to the next statement. All sessions
+   share the cache, so a result fetched by one thread can be bound by another */
+struct geometry
+{
+    SDO_GEOMETRY      *obj;
+    SDO_GEOMETRY_ind  *ind;
+};
+typedef struct geometry geometry_struct;
+
+/* A database session, used by one thread only */
+struct session
+{
+    OCIError          *errhp;         /* Error handle */
+    OCISvcCtx         *svchp;         /* Service context handle */
+    OCIType           *geometry_type_desc;
+    OCIType           *rowid_list_type_desc;
+    OCIStmt           *union_stmthp;  /* SDO_GEOM.SDO_UNION of two geometries */
+    OCIStmt           *group_stmthp;  /* SDO_AGGR_UNION of a list of rowids */
+    SDO_GEOMETRY      *input_obj[2];  /* Geometries passed to the database */
+    SDO_GEOMETRY_ind  *input_ind[2];
+    SDO_GEOMETRY      *result_obj;    /* Geometry returned by the database */
+    SDO_GEOMETRY_ind  *result_ind;
+    OCIArray          *rowid_list;    /* Rowids passed to the database */
+    OCIString         *rowid_string;
+    double            tolerance;
+};
+typedef struct session session_struct;
+
+/* A row of the input table, with its position on the Hilbert curve */
+struct row_key
+{
+    char          row_id[19];
+    double        x, y;               /* Center of the MBR */
+    uint64_t      hilbert;
+};
+typedef struct row_key row_key_struct;
+
+/* A node of the union tree: a group of rows (level 0) or the union of two
+   nodes of the level below */
+struct union_node
+{
+    int             level;
+    int             index;
+    int             children_done;
+    geometry_struct *geometry;
+};
+typedef struct union_node union_node_struct;
+
+/* Tasks queued by a thread: the nodes ready to be computed */
+struct task_queue
+{
+    int             *tasks;
+    int             top;              /* Oldest task: taken by other threads */
+    int             bottom;           /* Newest task: taken by the owner */
+    pthread_mutex_t lock;
+};
+typedef struct task_queue task_queue_struct;
+
+/* The whole computation */
+struct union_tree
+{
+    char              *tablename;
+    char              *geo_column;
+    row_key_struct    *rows;
+    int               n_rows;
+    int               group_size;
+    int               n_levels;
+    int               level_size[MAX_LEVELS];
+    int               level_start[MAX_LEVELS];
+    union_node_struct *nodes;
+    int               n_threads;
+    task_queue_struct queues[MAX_THREADS];
+    pthread_mutex_t   lock;           /* Protects the fields below */
+    pthread_cond_t    work_queued;
+    int               n_queued;       /* Tasks waiting in the queues */
+    int               finished;
+};
+typedef struct union_tree union_tree_struct;
+
+/* A worker thread */
+struct worker
+{
+    int               id;
+    union_tree_struct *tree;
+    session_struct    session;
+    pthread_t         thread;
+    int               n_tasks;        /* Tasks done */
+    int               n_stolen;       /* Tasks taken from other threads */
+};
+typedef struct worker worker_struct;
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = -1;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                  /* (in)  Error handle */
+    (ub4)1,                          /* (in)  Number of error record */
+    (text *)NULL,                    /* (out) SQLSTATE (no longer used) */
+    &errcode,                        /* (out) Error code */
+    errbuf,                          /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),             /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "ERROR %d: %s\n", errcode, errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context. The environment is shared by all
+**              threads, so it is created in threaded mode.
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_THREADED+OCI_OBJECT),  /* (in)  Mode: threads, handles objects */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     BindGeometry
+**
+** Description: Bind a geometry object to a placeholder of a statement
+*******************************************************************************/
+void BindGeometry (
+  session_struct    *session,
+  OCIStmt           *stmthp,
+  char              *placeholder,
+  SDO_GEOMETRY      **geometry_obj,
+  SDO_GEOMETRY_ind  **geometry_ind)
+{
+  OCIBind *geometry_hp = NULL;
+  sword   status;
+
+  status = OCIBindByName(
+    stmthp,                          /* (in)  Statement Handle */
+    &geometry_hp,                    /* (out) Bind Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *) placeholder,            /* (in)  Placeholder */
+    strlen(placeholder),             /* (in)  Placeholder length */
+    (ub1 *) 0,                       /* (in)  Value Pointer (NOT USED) */
+    0,                               /* (in)  Value Size (NOT USED) */
+    SQLT_NTY,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIBindObject(
+    geometry_hp,                     /* (in)  Bind handle */
+    session->errhp,                  /* (in)  Error handle */
+    session->geometry_type_desc,     /* (in)  Geometry type descriptor */
+    (dvoid **) geometry_obj,         /* (in)  Value Pointer */
+    (ub4 *)0,                        /* (in)  Value Size (NOT USED) */
+    (dvoid **) geometry_ind,         /* (in)  Indicator Pointer */
+    (ub4 *)0                         /* (in)  Indicator Size */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     DefineGeometry
+**
+** Description: Define the geometry object returned by a query
+*******************************************************************************/
+void DefineGeometry (
+  session_struct    *session,
+  OCIStmt           *stmthp)
+{
+  OCIDefine *geometry_hp = NULL;
+  sword     status;
+
+  status = OCIDefineByPos(
+    stmthp,                          /* (in)  Statement Handle */
+    &geometry_hp,                    /* (out) Define Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Column position */
+    (dvoid *)0,                      /* (in)  Value Pointer (NOT USED) */
+    0,                               /* (in)  Value Size (NOT USED) */
+    SQLT_NTY,                        /* (in)  Data Type */
+    (dvoid *)0,                      /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIDefineObject(
+    geometry_hp,                     /* (in)  Define handle */
+    session->errhp,                  /* (in)  Error handle */
+    session->geometry_type_desc,     /* (in)  Geometry type descriptor */
+    (dvoid **) &session->result_obj, /* (in)  Value Pointer */
+    (ub4 *)0,                        /* (in)  Value Size (NOT USED) */
+    (dvoid **) &session->result_ind, /* (in)  Indicator Pointer */
+    (ub4 *)0                         /* (in)  Indicator Size */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     OpenSession
+**
+** Description: Connect to the database and prepare the union statement
+*******************************************************************************/
+void OpenSession(
+  session_struct *session,
+  char           *username,
+  char           *password,
+  char           *database,
+  double         tolerance)
+{
+  char   union_statement[] = "SELECT SDO_GEOM.SDO_UNION(:g1, :g2, :tolerance) FROM DUAL";
+  OCIBind *tolerance_hp = NULL;
+  sword  status;
+
+  memset (session, 0, sizeof(session_struct));
+  session->tolerance = tolerance;
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->errhp,       /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (session->errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      session->errhp,                /* (in)  Error Handle */
+      &session->svchp,               /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Get type descriptor for geometry object type */
+  status = OCITypeByName (
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    session->svchp,                  /* (in)  Service Context Handle */
+    "MDSYS",                         /* (in)  Type owner name */
+    strlen("MDSYS"),                 /* (in)  (length) */
+    "SDO_GEOMETRY",                  /* (in)  Type name */
+    strlen("SDO_GEOMETRY"),          /* (in)  (length) */
+    0,                               /* (in)  Version name (NOT USED) */
+    0,                               /* (in)  (length) */
+    OCI_DURATION_SESSION,            /* (in)  Pin duration */
+    OCI_TYPEGET_HEADER ,             /* (in)  Get option */
+    &session->geometry_type_desc);   /* (out) Type descriptor */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Get type descriptor for the list of rowids */
+  status = OCITypeByName (
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    session->svchp,                  /* (in)  Service Context Handle */
+    "SYS",                           /* (in)  Type owner name */
+    strlen("SYS"),                   /* (in)  (length) */
+    "ODCIVARCHAR2LIST",              /* (in)  Type name */
+    strlen("ODCIVARCHAR2LIST"),      /* (in)  (length) */
+    0,                               /* (in)  Version name (NOT USED) */
+    0,                               /* (in)  (length) */
+    OCI_DURATION_SESSION,            /* (in)  Pin duration */
+    OCI_TYPEGET_HEADER ,             /* (in)  Get option */
+    &session->rowid_list_type_desc); /* (out) Type descriptor */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Allocate the list of rowids: it is refilled for each group */
+  status = OCIObjectNew(
+    envhp,                           /* (in)  Environment Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    session->svchp,                  /* (in)  Service Context Handle */
+    OCI_TYPECODE_VARRAY,             /* (in)  Type code */
+    session->rowid_list_type_desc,   /* (in)  Type descriptor */
+    (dvoid *) 0,                     /* (in)  Table (NOT USED: transient object) */
+    OCI_DURATION_SESSION,            /* (in)  Duration */
+    TRUE,                            /* (in)  Value (NOT USED for collections) */
+    (dvoid **) &session->rowid_list);/* (out) Object */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Prepare the union statement once: it is executed for each pair. The
+     geometries are bound through input_obj, which points to the two results
+     to combine when the statement is executed */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->union_stmthp,/* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    session->union_stmthp,           /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)union_statement,         /* (in)  SQL statement */
+    (ub4)strlen(union_statement),    /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  BindGeometry (session, session->union_stmthp, ":G1", &session->input_obj[0], &session->input_ind[0]);
+  BindGeometry (session, session->union_stmthp, ":G2", &session->input_obj[1], &session->input_ind[1]);
+
+  status = OCIBindByName(
+    session->union_stmthp,           /* (in)  Statement Handle */
+    &tolerance_hp,                   /* (out) Bind Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *) ":TOLERANCE",           /* (in)  Placeholder */
+    strlen(":TOLERANCE"),            /* (in)  Placeholder length */
+    (ub1 *) &session->tolerance,     /* (in)  Value Pointer */
+    sizeof(session->tolerance),      /* (in)  Value Size */
+    SQLT_FLT,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  DefineGeometry (session, session->union_stmthp);
+}
+
+/*******************************************************************************
+** Routine:     PrepareGroupUnion
+**
+** Description: Prepare the union of a group of rows. The rowids are bound as
+**              a collection, so the statement is parsed once per session and
+**              not once per group.
+*******************************************************************************/
+void PrepareGroupUnion(
+  session_struct *session,
+  char           *tablename,
+  char           *geo_column)
+{
+  char    group_statement[1024];
+  OCIBind *tolerance_hp = NULL;
+  OCIBind *rowid_list_hp = NULL;
+  sword   status;
+
+  if (snprintf (group_statement, sizeof(group_statement),
+        "SELECT SDO_AGGR_UNION(SDOAGGRTYPE(%s, :tolerance)) FROM %s "
+        "WHERE ROWID IN (SELECT CHARTOROWID(COLUMN_VALUE) FROM TABLE(:ids))",
+        geo_column, tablename) >= (int) sizeof(group_statement)) {
+    printf ("Table or column name too long\n");
+    exit (1);
+  }
+
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->group_stmthp,/* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    session->group_stmthp,           /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)group_statement,         /* (in)  SQL statement */
+    (ub4)strlen(group_statement),    /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIBindByName(
+    session->group_stmthp,           /* (in)  Statement Handle */
+    &tolerance_hp,                   /* (out) Bind Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *) ":TOLERANCE",           /* (in)  Placeholder */
+    strlen(":TOLERANCE"),            /* (in)  Placeholder length */
+    (ub1 *) &session->tolerance,     /* (in)  Value Pointer */
+    sizeof(session->tolerance),      /* (in)  Value Size */
+    SQLT_FLT,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIBindByName(
+    session->group_stmthp,           /* (in)  Statement Handle */
+    &rowid_list_hp,                  /* (out) Bind Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *) ":IDS",                 /* (in)  Placeholder */
+    strlen(":IDS"),                  /* (in)  Placeholder length */
+    (ub1 *) 0,                       /* (in)  Value Pointer (NOT USED) */
+    0,                               /* (in)  Value Size (NOT USED) */
+    SQLT_NTY,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIBindObject(
+    rowid_list_hp,                   /* (in)  Bind handle */
+    session->errhp,                  /* (in)  Error handle */
+    session->rowid_list_type_desc,   /* (in)  Collection type descriptor */
+    (dvoid **) &session->rowid_list, /* (in)  Value Pointer */
+    (ub4 *)0,                        /* (in)  Value Size (NOT USED) */
+    (dvoid **)0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub4 *)0                         /* (in)  Indicator Size */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  DefineGeometry (session, session->group_stmthp);
+}
+
+/*******************************************************************************
+** Routine:     CloseSession
+**
+** Description: Disconnect from Oracle and release the session handles
+*******************************************************************************/
+void CloseSession(session_struct *session)
+{
+  sword status;
+
+  OCIObjectFree(envhp, session->errhp, (dvoid *) session->rowid_list, (ub2)OCI_OBJECTFREE_FORCE);
+  if (session->rowid_string != NULL)
+    OCIStringResize(envhp, session->errhp, 0, &session->rowid_string);
+  OCIHandleFree((dvoid *)session->union_stmthp, (ub4)OCI_HTYPE_STMT);
+  if (session->group_stmthp != NULL)
+    OCIHandleFree((dvoid *)session->group_stmthp, (ub4)OCI_HTYPE_STMT);
+
+  status = OCILogoff(session->svchp, session->errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)session->errhp,         /* (in)  Error Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+/*******************************************************************************
+** Routine:     FreeGeometry
+**
+** Description: Release a geometry object and its structure
+*******************************************************************************/
+void FreeGeometry (
+  session_struct  *session,
+  geometry_struct *geometry)
+{
+  if (geometry != NULL) {
+    OCIObjectFree(envhp, session->errhp, (dvoid *) geometry->obj, (ub2)OCI_OBJECTFREE_FORCE);
+    free (geometry);
+  }
+}
+
+/*******************************************************************************
+** Routine:     FetchResult
+**
+** Description: Take the geometry object returned by an executed statement.
+**              The object is not copied: the next execution allocates a new
+**              one. Returns NULL if the result is NULL.
+*******************************************************************************/
+geometry_struct *FetchResult (
+  session_struct *session,
+  sword          status)
+{
+  geometry_struct *geometry = NULL;
+
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(session->errhp);
+  if (session->result_obj == NULL)
+    return NULL;
+  if (status == OCI_SUCCESS && session->result_ind->_atomic == OCI_IND_NOTNULL) {
+    geometry = malloc (sizeof(geometry_struct));
+    geometry->obj = session->result_obj;
+    geometry->ind = session->result_ind;
+  }
+  else
+    OCIObjectFree(envhp, session->errhp, (dvoid *) session->result_obj, (ub2)OCI_OBJECTFREE_FORCE);
+  session->result_obj = NULL;
+  session->result_ind = NULL;
+  return geometry;
+}
+
+/*******************************************************************************
+** Routine:     SelectGeometry
+**
+** Description: Execute a query that returns one geometry
+*******************************************************************************/
+geometry_struct *SelectGeometry (
+  session_struct *session,
+  char           *select_statement)
+{
+  OCIStmt         *stmthp;
+  geometry_struct *geometry;
+  sword           status;
+
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&stmthp,               /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    stmthp,                          /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)select_statement,        /* (in)  SQL statement */
+    (ub4)strlen(select_statement),   /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  DefineGeometry (session, stmthp);
+
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    stmthp,                          /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  geometry = FetchResult (session, status);
+
+  OCIHandleFree((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT);
+  return geometry;
+}
+
+/*******************************************************************************
+** Routine:     UnionGroup
+**
+** Description: Compute the union of a group of rows with SDO_AGGR_UNION
+*******************************************************************************/
+geometry_struct *UnionGroup (
+  session_struct *session,
+  row_key_struct *rows,
+  int            n_rows)
+{
+  OCIError *errhp = session->errhp;
+  sb4      size;
+  sword    status;
+  int      i;
+
+  /* Refill the bound list of rowids */
+  OCICollSize (envhp, errhp, (OCIColl *) session->rowid_list, &size);
+  if (size > 0)
+    OCICollTrim (envhp, errhp, size, (OCIColl *) session->rowid_list);
+  for (i=0; i<n_rows; i++) {
+    status = OCIStringAssignText (envhp, errhp, (text *) rows[i].row_id,
+      (ub4) strlen(rows[i].row_id), &session->rowid_string);
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+    status = OCICollAppend (envhp, errhp, (dvoid *) session->rowid_string, (dvoid *) 0,
+      (OCIColl *) session->rowid_list);
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    session->group_stmthp,           /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  return FetchResult (session, status);
+}
+
+/*******************************************************************************
+** Routine:     UnionPair
+**
+** Description: Compute the union of two geometries with SDO_GEOM.SDO_UNION.
+**              The two geometry objects are bound as they are, and released.
+*******************************************************************************/
+geometry_struct *UnionPair (
+  session_struct  *session,
+  geometry_struct *geometry_1,
+  geometry_struct *geometry_2)
+{
+  sword status;
+
+  if (geometry_1 == NULL)
+    return geometry_2;
+  if (geometry_2 == NULL)
+    return geometry_1;
+
+  session->input_obj[0] = geometry_1->obj;
+  session->input_ind[0] = geometry_1->ind;
+  session->input_obj[1] = geometry_2->obj;
+  session->input_ind[1] = geometry_2->ind;
+
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    session->union_stmthp,           /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+
+  session->input_obj[0] = session->input_obj[1] = NULL;
+  session->input_ind[0] = session->input_ind[1] = NULL;
+  FreeGeometry (session, geometry_1);
+  FreeGeometry (session, geometry_2);
+  return FetchResult (session, status);
+}
+
+int CompareRows (const void *a, const void *b)
+{
+  uint64_t ha = ((const row_key_struct *)a)->hilbert;
+  uint64_t hb = ((const row_key_struct *)b)->hilbert;
+  return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     ReadRowKeys
+**
+** Description: Read the rowid and MBR center of all geometries in the table,
+**              and sort them along a Hilbert curve. Returns the number of rows.
+*******************************************************************************/
+int ReadRowKeys (
+  session_struct *session,
+  char           *tablename,
+  char           *geo_column,
+  row_key_struct **rows)
+{
+  char      select_statement[1024];
+  OCIStmt   *stmthp;
+  OCIDefine *define_hp;
+  sword     status;
+  boolean   has_more_data;
+  int       rows_in_batch = 0;
+  int       n_rows = 0;
+  int       max_rows = ARRAY_SIZE;
+  int       i;
+  double    min_x, min_y, max_x, max_y, cell;
+
+  /* Host variables */
+  char      row_id[ARRAY_SIZE][19];
+  double    center_x[ARRAY_SIZE];
+  double    center_y[ARRAY_SIZE];
+
+  sprintf (select_statement,
+    "SELECT ROWIDTOCHAR(ROWID), "
+    "(SDO_GEOM.SDO_MIN_MBR_ORDINATE(%s,1) + SDO_GEOM.SDO_MAX_MBR_ORDINATE(%s,1)) / 2, "
+    "(SDO_GEOM.SDO_MIN_MBR_ORDINATE(%s,2) + SDO_GEOM.SDO_MAX_MBR_ORDINATE(%s,2)) / 2 "
+    "FROM %s WHERE %s IS NOT NULL",
+    geo_column, geo_column, geo_column, geo_column, tablename, geo_column);
+
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&stmthp,               /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    stmthp,                          /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)select_statement,        /* (in)  SQL statement */
+    (ub4)strlen(select_statement),   /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Variable 1 = rowid (string) */
+  status = OCIDefineByPos(stmthp, &define_hp, session->errhp, (ub4)1,
+    (dvoid *)row_id, sizeof(row_id[0]), SQLT_STR,
+    (dvoid *)0, (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Variables 2 and 3 = center of the MBR (double) */
+  status = OCIDefineByPos(stmthp, &define_hp, session->errhp, (ub4)2,
+    (dvoid *)center_x, sizeof(double), SQLT_FLT,
+    (dvoid *)0, (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  status = OCIDefineByPos(stmthp, &define_hp, session->errhp, (ub4)3,
+    (dvoid *)center_y, sizeof(double), SQLT_FLT,
+    (dvoid *)0, (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtExecute(session->svchp, stmthp, session->errhp, (ub4)ARRAY_SIZE, (ub4)0,
+    (OCISnapshot *)NULL, (OCISnapshot *)NULL, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(session->errhp);
+
+  *rows = malloc (sizeof(row_key_struct) * max_rows);
+  has_more_data = TRUE;
+  do
+  {
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    OCIAttrGet((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&rows_in_batch, (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED, session->errhp);
+
+    if (n_rows + rows_in_batch > max_rows) {
+      max_rows = max_rows * 2 + rows_in_batch;
+      *rows = realloc (*rows, sizeof(row_key_struct) * max_rows);
+    }
+    for (i=0; i<rows_in_batch; i++) {
+      strcpy ((*rows)[n_rows].row_id, row_id[i]);
+      (*rows)[n_rows].x = center_x[i];
+      (*rows)[n_rows].y = center_y[i];
+      n_rows++;
+    }
+
+    if (has_more_data) {
+      status = OCIStmtFetch(stmthp, session->errhp, (ub4)ARRAY_SIZE,
+        (ub2)OCI_FETCH_NEXT, (ub4)OCI_DEFAULT);
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(session->errhp);
+    }
+  }
+  while (has_more_data);
+  OCIHandleFree((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT);
+
+  if (n_rows == 0)
+    return 0;
+
+  /* Place the centers on a grid over their extent, and sort the rows along
+     the Hilbert curve that runs through that grid */
+  min_x = max_x = (*rows)[0].x;
+  min_y = max_y = (*rows)[0].y;
+  for (i=1; i<n_rows; i++) {
+    min_x = (*rows)[i].x < min_x ? (*rows)[i].x : min_x;
+    max_x = (*rows)[i].x > max_x ? (*rows)[i].x : max_x;
+    min_y = (*rows)[i].y < min_y ? (*rows)[i].y : min_y;
+    max_y = (*rows)[i].y > max_y ? (*rows)[i].y : max_y;
+  }
+  cell = (max_x - min_x > max_y - min_y ? max_x - min_x : max_y - min_y)
+       / ((1UL << HILBERT_ORDER) - 1);
+  if (cell == 0)
+    cell = 1;
+  for (i=0; i<n_rows; i++)
+    (*rows)[i].hilbert = HilbertKey (1L << HILBERT_ORDER,
+      (long) (((*rows)[i].x - min_x) / cell),
+      (long) (((*rows)[i].y - min_y) / cell));
+  qsort (*rows, n_rows, sizeof(row_key_struct), CompareRows);
+
+  return n_rows;
+}
+
+/*******************************************************************************
+** Routine:     PushTask
+**
+** Description: Queue a task at the bottom of the queue of a thread
+*******************************************************************************/
+void PushTask (
+  union_tree_struct *tree,
+  int               thread,
+  int               node)
+{
+  task_queue_struct *queue = &tree->queues[thread];
+
+  /* Count the task first, so that the count never goes below zero when
+     another thread takes it right away */
+  pthread_mutex_lock (&tree->lock);
+  tree->n_queued++;
+  pthread_mutex_unlock (&tree->lock);
+
+  pthread_mutex_lock (&queue->lock);
+  queue->tasks[queue->bottom++] = node;
+  pthread_mutex_unlock (&queue->lock);
+
+  pthread_mutex_lock (&tree->lock);
+  pthread_cond_signal (&tree->work_queued);
+  pthread_mutex_unlock (&tree->lock);
+}
+
+/*******************************************************************************
+** Routine:     TakeTask
+**
+** Description: Take the newest task of the own queue of a thread or, if it is
+**              empty, the oldest task of another thread. Waits until a task is
+**              queued. Returns -1 when the union is complete.
+*******************************************************************************/
+int TakeTask (worker_struct *worker)
+{
+  union_tree_struct *tree = worker->tree;
+  task_queue_struct *queue;
+  int node = -1;
+  int i;
+
+  for (;;) {
+    /* Own queue: newest task first */
+    queue = &tree->queues[worker->id];
+    pthread_mutex_lock (&queue->lock);
+    if (queue->bottom > queue->top)
+      node = queue->tasks[--queue->bottom];
+    pthread_mutex_unlock (&queue->lock);
+
+    /* Other queues: oldest task first */
+    for (i=1; i<tree->n_threads && node < 0; i++) {
+      queue = &tree->queues[(worker->id + i) % tree->n_threads];
+      pthread_mutex_lock (&queue->lock);
+      if (queue->bottom > queue->top)
+        node = queue->tasks[queue->top++];
+      pthread_mutex_unlock (&queue->lock);
+      if (node >= 0)
+        worker->n_stolen++;
+    }
+
+    pthread_mutex_lock (&tree->lock);
+    if (node >= 0) {
+      tree->n_queued--;
+      pthread_mutex_unlock (&tree->lock);
+      return node;
+    }
+    while (tree->n_queued == 0 && !tree->finished)
+      pthread_cond_wait (&tree->work_queued, &tree->lock);
+    if (tree->finished) {
+      pthread_mutex_unlock (&tree->lock);
+      return -1;
+    }
+    pthread_mutex_unlock (&tree->lock);
+  }
+}
+
+/*******************************************************************************
+** Routine:     RunTask
+**
+** Description: Compute a node of the union tree, then queue its parent if its
+**              other child is also done
+*******************************************************************************/
+void RunTask (
+  worker_struct *worker,
+  int           node)
+{
+  union_tree_struct *tree = worker->tree;
+  union_node_struct *current = &tree->nodes[node];
+  union_node_struct *child;
+  int               level = current->level;
+  int               index = current->index;
+  int               first, n_rows, parent, n_children, done;
+
+  if (level == 0) {
+    /* Union of a group of rows */
+    first = index * tree->group_size;
+    n_rows = tree->n_rows - first < tree->group_size ? tree->n_rows - first : tree->group_size;
+    current->geometry = UnionGroup (&worker->session, tree->rows + first, n_rows);
+  }
+  else {
+    /* Union of the two children (or the only child) */
+    child = &tree->nodes[tree->level_start[level-1] + index*2];
+    if (index*2 + 1 < tree->level_size[level-1])
+      current->geometry = UnionPair (&worker->session, child[0].geometry, child[1].geometry);
+    else
+      current->geometry = child[0].geometry;
+    child[0].geometry = NULL;
+    if (index*2 + 1 < tree->level_size[level-1])
+      child[1].geometry = NULL;
+  }
+  worker->n_tasks++;
+
+  /* The root is done: wake up all threads so that they stop */
+  if (level == tree->n_levels - 1) {
+    pthread_mutex_lock (&tree->lock);
+    tree->finished = 1;
+    pthread_cond_broadcast (&tree->work_queued);
+    pthread_mutex_unlock (&tree->lock);
+    return;
+  }
+
+  parent = tree->level_start[level+1] + index/2;
+  n_children = (index/2)*2 + 1 < tree->level_size[level] ? 2 : 1;
+  pthread_mutex_lock (&tree->lock);
+  done = ++tree->nodes[parent].children_done;
+  pthread_mutex_unlock (&tree->lock);
+  if (done == n_children)
+    PushTask (tree, worker->id, parent);
+}
+
+/*******************************************************************************
+** Routine:     WorkerThread
+**
+** Description: Run tasks until the union is complete
+*******************************************************************************/
+void *WorkerThread (void *argument)
+{
+  worker_struct *worker = (worker_struct *) argument;
+  int node;
+
+  while ((node = TakeTask (worker)) >= 0)
+    RunTask (worker, node);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     CascadedUnion
+**
+** Description: Compute the union of all geometries of the table with a pool
+**              of threads, as a tree of unions over Hilbert-ordered groups
+*******************************************************************************/
+geometry_struct *CascadedUnion (
+  worker_struct  *workers,
+  int            n_threads,
+  char           *tablename,
+  char           *geo_column,
+  int            group_size)
+{
+  union_tree_struct tree;
+  geometry_struct   *result;
+  double            start_time;
+  int               n_nodes, level, i, t, first, last;
+
+  memset (&tree, 0, sizeof(union_tree_struct));
+  tree.tablename = tablename;
+  tree.geo_column = geo_column;
+  tree.group_size = group_size;
+  tree.n_threads = n_threads;
+
+  /* Sort the rows along the Hilbert curve */
+  start_time = ElapsedSeconds ();
+  tree.n_rows = ReadRowKeys (&workers[0].session, tablename, geo_column, &tree.rows);
+  printf ("%d rows read and sorted in %.3f seconds\n", tree.n_rows, ElapsedSeconds () - start_time);
+  if (tree.n_rows == 0)
+    return NULL;
+
+  /* Size the levels of the tree: groups, then unions of two nodes */
+  tree.level_size[0] = (tree.n_rows + group_size - 1) / group_size;
+  n_nodes = tree.level_size[0];
+  for (level=1; tree.level_size[level-1] > 1; level++) {
+    tree.level_size[level] = (tree.level_size[level-1] + 1) / 2;
+    tree.level_start[level] = n_nodes;
+    n_nodes += tree.level_size[level];
+  }
+  tree.n_levels = level;
+  tree.nodes = calloc (n_nodes, sizeof(union_node_struct));
+  for (level=0; level<tree.n_levels; level++)
+    for (i=0; i<tree.level_size[level]; i++) {
+      tree.nodes[tree.level_start[level] + i].level = level;
+      tree.nodes[tree.level_start[level] + i].index = i;
+    }
+  printf ("%d groups of %d rows, %d levels of unions\n", tree.level_size[0], group_size, tree.n_levels);
+
+  pthread_mutex_init (&tree.lock, NULL);
+  pthread_cond_init (&tree.work_queued, NULL);
+  for (t=0; t<n_threads; t++) {
+    tree.queues[t].tasks = malloc (sizeof(int) * n_nodes);
+    pthread_mutex_init (&tree.queues[t].lock, NULL);
+  }
+
+  /* Give each thread a block of neighbouring groups. They are queued last
+     first, so that the owner starts with the first one */
+  for (t=0; t<n_threads; t++) {
+    first = (int) ((long) tree.level_size[0] * t / n_threads);
+    last = (int) ((long) tree.level_size[0] * (t+1) / n_threads);
+    for (i=last-1; i>=first; i--)
+      PushTask (&tree, t, i);
+  }
+
+  /* Run the threads: the calling thread is worker 0 */
+  for (t=0; t<n_threads; t++) {
+    PrepareGroupUnion (&workers[t].session, tablename, geo_column);
+    workers[t].id = t;
+    workers[t].tree = &tree;
+    workers[t].n_tasks = 0;
+    workers[t].n_stolen = 0;
+  }
+  for (t=1; t<n_threads; t++)
+    if (pthread_create (&workers[t].thread, NULL, WorkerThread, &workers[t]) != 0) {
+      printf ("Could not start thread %d\n", t);
+      exit (1);
+    }
+  WorkerThread (&workers[0]);
+  for (t=1; t<n_threads; t++)
+    pthread_join (workers[t].thread, NULL);
+
+  for (t=0; t<n_threads; t++)
+    printf ("Thread %d: %d unions, %d taken from other threads\n",
+      t, workers[t].n_tasks, workers[t].n_stolen);
+
+  result = tree.nodes[n_nodes-1].geometry;
+
+  for (t=0; t<n_threads; t++) {
+    free (tree.queues[t].tasks);
+    pthread_mutex_destroy (&tree.queues[t].lock);
+  }
+  pthread_cond_destroy (&tree.work_queued);
+  pthread_mutex_destroy (&tree.lock);
+  free (tree.nodes);
+  free (tree.rows);
+  return result;
+}
+
+/*******************************************************************************
+** Routine:     ServerUnion
+**
+** Description: Compute the union of all geometries of the table in the
+**              database, as in listing 14-12
+*******************************************************************************/
+geometry_struct *ServerUnion (
+  session_struct *session,
+  char           *tablename,
+  char           *geo_column)
+{
+  char select_statement[2048];
+  double t = session->tolerance;
+
+  sprintf (select_statement,
+    "SELECT SDO_AGGR_UNION(SDOAGGRTYPE(ugeom,%.17g)) ugeom FROM ("
+    " SELECT SDO_AGGR_UNION(SDOAGGRTYPE(ugeom,%.17g)) ugeom FROM ("
+    "  SELECT SDO_AGGR_UNION(SDOAGGRTYPE(ugeom,%.17g)) ugeom FROM ("
+    "   SELECT SDO_AGGR_UNION(SDOAGGRTYPE(%s,%.17g)) ugeom FROM %s"
+    "   GROUP BY MOD (ROWNUM, 1000))"
+    "  GROUP BY MOD (ROWNUM, 100))"
+    " GROUP BY MOD (ROWNUM, 10))",
+    t, t, t, geo_column, t, tablename);
+  printf ("Executing query:\nSQL> %s\n\n", select_statement);
+  return SelectGeometry (session, select_statement);
+}
+
+/*******************************************************************************
+** Routine:     WriteResult
+**
+** Description: Insert the union into the result table
+*******************************************************************************/
+void WriteResult (
+  session_struct  *session,
+  char            *result_table,
+  char            *geo_column,
+  geometry_struct *geometry)
+{
+  char    insert_statement[1024];
+  OCIStmt *stmthp;
+  sb4     n_elem_info, n_ordinates;
+  sword   status;
+
+  sprintf (insert_statement, "INSERT INTO %s (%s) VALUES (:geometry)", result_table, geo_column);
+
+  status = OCIHandleAlloc((dvoid *)envhp, (dvoid **)&stmthp, (ub4)OCI_HTYPE_STMT,
+    (size_t)0, (dvoid **)0);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  status = OCIStmtPrepare(stmthp, session->errhp, (text *)insert_statement,
+    (ub4)strlen(insert_statement), (ub4)OCI_NTV_SYNTAX, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  session->input_obj[0] = geometry->obj;
+  session->input_ind[0] = geometry->ind;
+  BindGeometry (session, stmthp, ":GEOMETRY", &session->input_obj[0], &session->input_ind[0]);
+
+  status = OCIStmtExecute(session->svchp, stmthp, session->errhp, (ub4)1, (ub4)0,
+    (OCISnapshot *)NULL, (OCISnapshot *)NULL, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  status = OCITransCommit(session->svchp, session->errhp, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  OCIHandleFree((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT);
+  session->input_obj[0] = NULL;
+  session->input_ind[0] = NULL;
+
+  n_elem_info = n_ordinates = 0;
+  if (geometry->ind->SDO_ELEM_INFO == OCI_IND_NOTNULL)
+    OCICollSize (envhp, session->errhp, (OCIColl *)(geometry->obj->SDO_ELEM_INFO), &n_elem_info);
+  if (geometry->ind->SDO_ORDINATES == OCI_IND_NOTNULL)
+    OCICollSize (envhp, session->errhp, (OCIColl *)(geometry->obj->SDO_ORDINATES), &n_ordinates);
+  printf ("Union written to %s: %d elements, %d ordinates\n",
+    result_table, (int) n_elem_info / 3, (int) n_ordinates);
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *username, *password, *database, *tablename, *geo_column, *result_table, *mode;
+    double tolerance;
+    int    group_size, n_threads, t;
+    double start_time;
+    worker_struct   *workers;
+    geometry_struct *result;
+
+    if( argc < 7 || argc > 11) {
+      printf("USAGE: %s <username> <password> <database> <tablename> <geo_column> <result_table> [<tolerance>] [<group_size>] [<threads>] [CLIENT|SERVER]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      tablename = argv[4];
+      geo_column = argv[5];
+      result_table = argv[6];
+      tolerance = argc > 7 ? atof(argv[7]) : 0.5;
+      group_size = argc > 8 ? atoi(argv[8]) : 50;
+      n_threads = argc > 9 ? atoi(argv[9]) : 4;
+      mode = argc > 10 ? argv[10] : "CLIENT";
+      if (tolerance <= 0) {
+        printf ("Invalid tolerance: must be positive\n");
+        exit( 1 );
+      }
+      if (group_size <= 0 || group_size > MAX_GROUP_SIZE) {
+        printf ("Invalid group size: must be between 1 and %d\n", MAX_GROUP_SIZE);
+        exit( 1 );
+      }
+      if (n_threads <= 0 || n_threads > MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", MAX_THREADS);
+        exit( 1 );
+      }
+      if (strcmp (mode, "CLIENT") != 0 && strcmp (mode, "SERVER") != 0) {
+        printf ("Invalid mode: must be CLIENT or SERVER\n");
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Open one session per thread (only one on the server side) */
+    if (strcmp (mode, "SERVER") == 0)
+      n_threads = 1;
+    workers = calloc (n_threads, sizeof(worker_struct));
+    for (t=0; t<n_threads; t++)
+      OpenSession (&workers[t].session, username, password, database, tolerance);
+    printf ("Connected to: %s (%d sessions)\n\n", database, n_threads);
+
+    /* Compute the union */
+    start_time = ElapsedSeconds ();
+    if (strcmp (mode, "SERVER") == 0)
+      result = ServerUnion (&workers[0].session, tablename, geo_column);
+    else
+      result = CascadedUnion (workers, n_threads, tablename, geo_column, group_size);
+    printf ("Union computed in %.3f seconds\n", ElapsedSeconds () - start_time);
+
+    /* Write it back */
+    if (result != NULL) {
+      WriteResult (&workers[0].session, result_table, geo_column, result);
+      FreeGeometry (&workers[0].session, result);
+    }
+    else
+      printf ("The table contains no geometries\n");
+
+    /* Disconnect from database */
+    for (t=0; t<n_threads; t++)
+      CloseSession (&workers[t].session);
+    free (workers);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+    return 0;
+}
@@ -0,0 +1,287 @@
+/* build_hierarchy.c
+
+   This program loads an SDO_NET network (see chapter 10) into memory,
+   contracts it into a contraction hierarchy, and writes the hierarchy to a
+   file.
+
+   Shortest path queries on a large network with Dijkstra's algorithm (as in
+   shortest_path.c) settle a good part of the network for each path. The
+   contraction hierarchy (see contraction_hierarchy.h) is computed once, in
+   parallel, and saved to a file that hierarchy_route.c maps in memory: its
+   queries then settle a few hundred nodes, and start without reading the
+   database or preprocessing anything.
+
+   The network is read with the same statements as shortest_path.c (see
+   sdo_net.h).
+
+   It illustrates the following concepts:
+   - reading numeric columns with array fetches
+   - reading the metadata of a network
+
+   The program takes the following command line arguments:
+
+     build_hierarchy username password database network output [threads] [array_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - network = name of the network
+   - output = name of the hierarchy file to write
+   - threads = number of contraction threads (default is one per processor)
+   - array_size = number of rows to read per fetch (default is 1000 rows)
+
+   Notes:
+
+   The program must be linked with contraction_hierarchy.c, sdo_net.c,
+   road_network.c and spatial_util.c. On Linux and other POSIX systems it
+   also needs the POSIX threads library.
+
+   The hierarchy holds a copy of the network as it was read: it must be
+   built again when the network changes. Links that are not active are not
+   part of it.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <oci.h>
+#include "sdo_net.h"
+#include "contraction_hierarchy.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle*/
+OCIError     *errhp;  /* Error handle */
+OCISvcCtx    *svchp;  /* Service Context handle*/
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_DEFAULT),              /* (in)  Mode: default */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&errhp,                /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ConnectDatabase
+**
+** Description: Connects to the oracle database
+*******************************************************************************/
+void ConnectDatabase(
+        char *username,
+        char *password,
+        char *database)
+{
+  int status;
+  char verbuf[512];
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      errhp,                         /* (in)  Error Handle */
+      &svchp,                        /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get database version */
+  OCIServerVersion(
+    svchp,                             /* (in)  Service Context Handle */
+    errhp,                             /* (in)  Error Handle */
+    verbuf,                            /* (out) Buffer to receive version message */
+    sizeof(verbuf),                    /* (in)  Size of message buffer */
+    OCI_HTYPE_SVCCTX);                 /* (in)  Type of handle (service context) */
+
+  printf("Connected to: %s\n", database);
+  printf("%s\n\n", verbuf);
+}
+
+/*******************************************************************************
+** Routine:     DisconnectDatabase
+**
+** Description: Disconnect from Oracle
+*******************************************************************************/
+void DisconnectDatabase(void)
+{
+  int status;
+
+  status = OCILogoff(svchp, errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)errhp,                  /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char *username, *password, *database, *network_name, *output;
+    int  array_size, n_threads;
+    road_network_struct          *network;
+    contraction_hierarchy_struct hierarchy;
+    hierarchy_stats_struct       stats;
+    double start_time;
+
+    if( argc < 6 || argc > 8) {
+      printf("USAGE: %s <username> <password> <database> <network> <output> [<threads>] [<array_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      network_name = argv[4];
+      output = argv[5];
+      if (argc > 6)
+        n_threads = atoi(argv[6]);
+      else
+        n_threads = ProcessorThreads(HIERARCHY_MAX_THREADS);
+      if (n_threads <= 0 || n_threads > HIERARCHY_MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", HIERARCHY_MAX_THREADS);
+        exit( 1 );
+      }
+      if (argc > 7)
+        array_size = atoi(argv[7]);
+      else
+        array_size = 1000;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Connect to database */
+    ConnectDatabase(username, password, database);
+
+    /* Load the network */
+    start_time = ElapsedSeconds ();
+    network = LoadSdoNetwork (envhp, errhp, svchp, network_name, array_size);
+    if (network == NULL) {
+      printf ("The network has no nodes\n");
+      exit( 1 );
+    }
+    printf ("Network of %ld nodes and %ld arcs loaded in %.3f seconds\n\n",
+      network->n_nodes, network->n_arcs, ElapsedSeconds () - start_time);
+
+    /* disconnect from database */
+    DisconnectDatabase();
+
+    /* Contract it */
+    start_time = ElapsedSeconds ();
+    BuildHierarchy (network, n_threads, &hierarchy, &stats);
+    printf ("Hierarchy built in %.3f seconds with %d threads: %ld rounds, %ld shortcuts\n",
+      ElapsedSeconds () - start_time, stats.n_threads, stats.n_rounds, stats.n_shortcuts);
+    printf ("%ld upward arcs, %ld downward arcs\n", (long) hierarchy.n_up, (long) hierarchy.n_down);
+    FreeRoadNetwork (network);
+
+    /* Save it */
+    if (WriteHierarchy (&hierarchy, output) != 0)
+      exit( 1 );
+    printf ("Hierarchy written to %s\n", output);
+    CloseHierarchy (&hierarchy);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
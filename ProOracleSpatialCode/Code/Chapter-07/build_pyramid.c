@@ -0,0 +1,1242 @@
+/* build_pyramid.c
+
+   This program generates the pyramid levels of a GeoRaster object on the
+   client, and writes their blocks to the raster data table.
+
+   It is the client-side counterpart of SDO_GEOR.GENERATEPYRAMID (listing
+   D-8):
+
+     SDO_GEOR.GENERATEPYRAMID (geor, 'rlevel=4, resampling=AVERAGE4');
+
+   which reads and reduces the whole raster in a single server process after
+   each import. This program reads the blocks of level 0 from the raster
+   data table, reduces them with raster_pyramid.c, and inserts the blocks of
+   the new levels with array inserts: the database only stores bytes.
+
+   Each block of a level is made from four blocks of the level below (see
+   raster_pyramid.h), so the blocks of level 0 under one block of a coarse
+   level give all the levels in between, without any other block. The work
+   is cut into such squares, at the coarsest level that still gives four
+   squares per thread. Each thread takes squares one after the other, with
+   its own database session, and builds the levels of a square depth first:
+   it reads the blocks of level 0 in groups of up to 4 x 4 blocks, one query
+   per group, and only keeps a few blocks of each level in memory. The
+   levels above the squares are built at the end, from the blocks of the
+   squares.
+
+   The raster is described with the following block, run once:
+
+     DECLARE
+       g SDO_GEORASTER;
+     BEGIN
+       SELECT geo_column INTO g FROM tablename WHERE id_column = :id;
+       :rows := SDO_GEOR.getSpatialDimSizes(g)(1);
+       ...
+     END;
+
+   It illustrates the following concepts:
+   - reading BLOBs with array fetches and LOB prefetching
+   - inserting BLOBs with array binds
+   - using OCI from several threads, with one session per thread
+   - reading the metadata of a GeoRaster object with PL/SQL output binds
+
+   The program takes the following command line arguments:
+
+     build_pyramid username password database tablename id_column geo_column id levels [threads] [resampling] [array_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - tablename, id_column, geo_column = the table of the GeoRaster object,
+     its numeric id column and its SDO_GEORASTER column (for instance
+     BRANCHES, ID, GEORASTER)
+   - id = the id of the row that holds the GeoRaster object
+   - levels = number of pyramid levels to build (as rlevel)
+   - threads = number of threads and database sessions (default is 4)
+   - resampling = AVERAGE (the average of each 2 x 2 cells, as AVERAGE4)
+     or NEAREST (as NN). The default is AVERAGE.
+   - array_size = number of blocks to insert per execution (default is 16)
+
+   Notes:
+
+   The program must be linked with raster_pyramid.c. It uses POSIX threads.
+
+   The existing pyramid levels of the raster are deleted first, in the same
+   transaction that removes the pyramid from the metadata of the object.
+   The blocks of the new levels are committed as they are written, and the
+   metadata describes them only once all of them are committed. If the
+   program stops in between, the raster is left without a pyramid (type
+   NONE), and the blocks already written are ignored: run the program again,
+   which deletes them first, or delete them with
+
+     DELETE FROM <raster data table> WHERE rasterid = <raster id> AND pyramidlevel > 0
+
+   The raster must be uncompressed, with 8-bit cells, and blocks of an even
+   number of rows and columns, with the upper left cell at (0, 0). Each
+   level has half the rows and columns of the level below, rounded down,
+   and the same blocking.
+
+   Run listing D-8 on a copy of the raster to compare the times.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <oci.h>
+#include "raster_pyramid.h"
+
+#define MAX_THREADS 64
+#define MAX_LEVELS 24
+#define MAX_READ_LEVEL 2              /* Level 0 is read in squares of 4 x 4 blocks */
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle, shared by all threads */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* The raster, as described by its metadata */
+struct raster_info
+{
+    char rdt[129];                    /* Raster data table */
+    long raster_id;
+    long rows;
+    long columns;
+    int  bands;
+    int  block_rows;
+    int  block_columns;
+    int  block_bands;
+    int  cell_depth;                  /* Bits per cell */
+    char interleaving[8];
+    char compression[32];
+};
+typedef struct raster_info raster_info_struct;
+
+/* The pyramid being built, shared by all threads */
+struct pyramid
+{
+    raster_info_struct         raster;
+    raster_block_layout_struct layout;
+    size_t            block_size;     /* Bytes per block */
+    int               method;
+    int               n_levels;       /* Highest level to build */
+    int               n_band_blocks;
+    long              row_blocks[MAX_LEVELS+1];    /* Blocks of each level */
+    long              column_blocks[MAX_LEVELS+1];
+    /* The squares, one per block of square_level and band block */
+    int               square_level;
+    int               read_level;     /* Level of the groups of blocks read */
+    long              n_squares;
+    long              next_square;
+    pthread_mutex_t   lock;           /* Protects next_square */
+    unsigned char     **top;          /* Blocks of square_level, if higher levels are built */
+};
+typedef struct pyramid pyramid_struct;
+
+/* A database session, used by one thread only, with its arrays */
+struct session
+{
+    OCIError          *errhp;         /* Error handle */
+    OCISvcCtx         *svchp;         /* Service Context handle */
+    OCIStmt           *read_stmthp;   /* Blocks of level 0 */
+    OCIStmt           *insert_stmthp; /* Blocks of the pyramid */
+    /* Read: bind variables and fetch arrays */
+    int               band_block;
+    int               first_row, last_row;
+    int               first_column, last_column;
+    int               read_size;
+    int               *read_row;
+    int               *read_column;
+    OCILobLocator     **read_lob;
+    sb2               *read_ind;
+    /* The group of blocks of level 0 read last */
+    unsigned char     *base;
+    int               *base_present;
+    int               base_side;      /* Blocks per side of the group */
+    long              base_row, base_column;
+    /* Blocks being built, 4 per level */
+    unsigned char     *work[MAX_LEVELS+1][4];
+    unsigned char     *square_block;
+    /* Insert: bind arrays */
+    int               insert_size;
+    int               n_inserts;
+    int               *level;
+    int               *band;
+    int               *row;
+    int               *column;
+    int               *min_row;
+    int               *min_column;
+    int               *max_row;
+    int               *max_column;
+    unsigned char     *blocks;
+    /* Statistics */
+    long              n_read;
+    long              n_written;
+    double            read_seconds;
+    double            reduce_seconds;
+    double            write_seconds;
+};
+typedef struct session session_struct;
+
+/* A worker thread */
+struct worker
+{
+    int            id;
+    pyramid_struct *pyramid;
+    session_struct session;
+    pthread_t      thread;
+};
+typedef struct worker worker_struct;
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = -1;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                  /* (in)  Error handle */
+    (ub4)1,                          /* (in)  Number of error record */
+    (text *)NULL,                    /* (out) SQLSTATE (no longer used) */
+    &errcode,                        /* (out) Error code */
+    errbuf,                          /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),             /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "ERROR %d: %s\n", errcode, errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context. The environment is shared by all
+**              threads, so it is created in threaded mode.
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_THREADED),             /* (in)  Mode: threads */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     OpenSession
+**
+** Description: Connect to the database
+*******************************************************************************/
+void OpenSession(
+  session_struct *session,
+  char           *username,
+  char           *password,
+  char           *database)
+{
+  sword  status;
+
+  memset (session, 0, sizeof(session_struct));
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->errhp,       /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (session->errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      session->errhp,                /* (in)  Error Handle */
+      &session->svchp,               /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     PrepareStatement
+**
+** Description: Allocate a statement handle and prepare a statement
+*******************************************************************************/
+OCIStmt *PrepareStatement(
+  session_struct *session,
+  char           *sql)
+{
+  OCIStmt *stmthp;
+  sword   status;
+
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&stmthp,               /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    stmthp,                          /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)sql,                     /* (in)  SQL statement */
+    (ub4)strlen(sql),                /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  return stmthp;
+}
+
+/*******************************************************************************
+** Routine:     BindVariable
+**
+** Description: Bind a variable, or an array of values for array DML, to a
+**              placeholder
+*******************************************************************************/
+void BindVariable(
+  session_struct *session,
+  OCIStmt        *stmthp,
+  char           *placeholder,
+  dvoid          *value,
+  sb4            value_size,
+  ub2            type)
+{
+  OCIBind *bind_hp = NULL;
+  sword   status;
+
+  status = OCIBindByName(
+    stmthp,                          /* (in)  Statement Handle */
+    &bind_hp,                        /* (out) Bind Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *) placeholder,            /* (in)  Placeholder */
+    strlen(placeholder),             /* (in)  Placeholder length */
+    value,                           /* (in)  Value Pointer (first element) */
+    value_size,                      /* (in)  Value Size (of one element) */
+    type,                            /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     DefineColumn
+**
+** Description: Define the array that receives a column
+*******************************************************************************/
+void DefineColumn(
+  session_struct *session,
+  OCIStmt        *stmthp,
+  int            position,
+  dvoid          *values,
+  sb4            value_size,
+  ub2            type,
+  sb2            *indicators)
+{
+  OCIDefine *define_hp = NULL;
+  sword     status;
+
+  status = OCIDefineByPos(
+    stmthp,                          /* (in)  Statement Handle */
+    &define_hp,                      /* (out) Define Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)position,                   /* (in)  Bind variable position */
+    values,                          /* (in)  Value Pointer (first element) */
+    value_size,                      /* (in)  Value Size (of one element) */
+    type,                            /* (in)  Data Type */
+    (dvoid *) indicators,            /* (in)  Indicator Pointer (first element) */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     ExecuteStatement
+**
+** Description: Execute a statement iters times (once per element of the
+**              bound arrays)
+*******************************************************************************/
+void ExecuteStatement(
+  session_struct *session,
+  OCIStmt        *stmthp,
+  int            iters)
+{
+  sword status;
+
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    stmthp,                          /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)iters,                      /* (in)  Number of executions */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     Commit
+**
+** Description: Commit the transaction of a session
+*******************************************************************************/
+void Commit(session_struct *session)
+{
+  sword status;
+
+  status = OCITransCommit(session->svchp, session->errhp, (ub4)0);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     ValidName
+**
+** Description: Check that a table name returned by the database can go in
+**              the text of a statement
+*******************************************************************************/
+int ValidName (char *name)
+{
+  char *c;
+
+  if (*name == '\0')
+    return 0;
+  for (c=name; *c != '\0'; c++)
+    if (!isalnum ((unsigned char) *c) && *c != '_' && *c != '$' && *c != '#' && *c != '.')
+      return 0;
+  return 1;
+}
+
+/*******************************************************************************
+** Routine:     ReadRasterInfo
+**
+** Description: Read the dimensions, blocking, cell depth, interleaving,
+**              compression and raster data table of a GeoRaster object
+*******************************************************************************/
+void ReadRasterInfo(
+  session_struct     *session,
+  char               *tablename,
+  char               *idcolumn,
+  char               *geocolumn,
+  long               id,
+  raster_info_struct *raster)
+{
+  char    info_block[2048];
+  OCIStmt *stmthp;
+
+  sprintf (info_block,
+    "DECLARE "
+    "  g SDO_GEORASTER; "
+    "  dims SDO_NUMBER_ARRAY; "
+    "  blocking SDO_NUMBER_ARRAY; "
+    "BEGIN "
+    "  SELECT %s INTO g FROM %s WHERE %s = :id; "
+    "  dims := SDO_GEOR.getSpatialDimSizes(g); "
+    "  blocking := SDO_GEOR.getBlockSize(g); "
+    "  :rows := dims(1); "
+    "  :columns := dims(2); "
+    "  :block_rows := blocking(1); "
+    "  :block_columns := blocking(2); "
+    "  IF blocking.COUNT > 2 THEN "
+    "    :block_bands := blocking(3); "
+    "  ELSE "
+    "    :block_bands := 1; "
+    "  END IF; "
+    "  :bands := SDO_GEOR.getBandDimSize(g); "
+    "  :cell_depth := SDO_GEOR.getCellDepth(g); "
+    "  :interleaving := SDO_GEOR.getInterleavingType(g); "
+    "  :compression := SDO_GEOR.getCompressionType(g); "
+    "  :rdt := g.rasterDataTable; "
+    "  :raster_id := g.rasterID; "
+    "END;",
+    geocolumn, tablename, idcolumn);
+  printf ("Reading the metadata of the raster:\nSQL> %s\n\n", info_block);
+
+  memset (raster, 0, sizeof(raster_info_struct));
+  stmthp = PrepareStatement (session, info_block);
+  BindVariable (session, stmthp, ":ID", &id, sizeof(long), SQLT_INT);
+  BindVariable (session, stmthp, ":ROWS", &raster->rows, sizeof(long), SQLT_INT);
+  BindVariable (session, stmthp, ":COLUMNS", &raster->columns, sizeof(long), SQLT_INT);
+  BindVariable (session, stmthp, ":BLOCK_ROWS", &raster->block_rows, sizeof(int), SQLT_INT);
+  BindVariable (session, stmthp, ":BLOCK_COLUMNS", &raster->block_columns, sizeof(int), SQLT_INT);
+  BindVariable (session, stmthp, ":BLOCK_BANDS", &raster->block_bands, sizeof(int), SQLT_INT);
+  BindVariable (session, stmthp, ":BANDS", &raster->bands, sizeof(int), SQLT_INT);
+  BindVariable (session, stmthp, ":CELL_DEPTH", &raster->cell_depth, sizeof(int), SQLT_INT);
+  BindVariable (session, stmthp, ":INTERLEAVING", raster->interleaving, sizeof(raster->interleaving), SQLT_STR);
+  BindVariable (session, stmthp, ":COMPRESSION", raster->compression, sizeof(raster->compression), SQLT_STR);
+  BindVariable (session, stmthp, ":RDT", raster->rdt, sizeof(raster->rdt), SQLT_STR);
+  BindVariable (session, stmthp, ":RASTER_ID", &raster->raster_id, sizeof(long), SQLT_INT);
+  ExecuteStatement (session, stmthp, 1);
+  OCIHandleFree((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT);
+}
+
+/*******************************************************************************
+** Routine:     PrepareSession
+**
+** Description: Prepare the read and insert statements of a session, and
+**              allocate its arrays and blocks
+*******************************************************************************/
+void PrepareSession(
+  session_struct *session,
+  pyramid_struct *pyramid,
+  int            insert_size)
+{
+  char       sql[2048];
+  OCISession *session_hp;
+  ub4        prefetch_size = (ub4) pyramid->block_size;
+  ub4        prefetch_rows;
+  size_t     block_size = pyramid->block_size;
+  sword      status;
+  int        i, level;
+
+  session->base_side = 1 << pyramid->read_level;
+  session->read_size = session->base_side * session->base_side;
+  session->read_row = malloc (sizeof(int) * session->read_size);
+  session->read_column = malloc (sizeof(int) * session->read_size);
+  session->read_lob = malloc (sizeof(OCILobLocator *) * session->read_size);
+  session->read_ind = malloc (sizeof(sb2) * session->read_size);
+  session->base = malloc (block_size * session->read_size);
+  session->base_present = malloc (sizeof(int) * session->read_size);
+  for (level=1; level<pyramid->square_level; level++)
+    for (i=0; i<4; i++)
+      session->work[level][i] = malloc (block_size);
+  session->square_block = malloc (block_size);
+
+  session->insert_size = insert_size;
+  session->level = malloc (sizeof(int) * insert_size);
+  session->band = malloc (sizeof(int) * insert_size);
+  session->row = malloc (sizeof(int) * insert_size);
+  session->column = malloc (sizeof(int) * insert_size);
+  session->min_row = malloc (sizeof(int) * insert_size);
+  session->min_column = malloc (sizeof(int) * insert_size);
+  session->max_row = malloc (sizeof(int) * insert_size);
+  session->max_column = malloc (sizeof(int) * insert_size);
+  session->blocks = malloc (block_size * insert_size);
+
+  /* Read: a square group of blocks of level 0 */
+  sprintf (sql,
+    "SELECT rowblocknumber, columnblocknumber, rasterblock FROM %s "
+    "WHERE rasterid = %ld AND pyramidlevel = 0 AND bandblocknumber = :band_block "
+    "AND rowblocknumber BETWEEN :first_row AND :last_row "
+    "AND columnblocknumber BETWEEN :first_column AND :last_column",
+    pyramid->raster.rdt, pyramid->raster.raster_id);
+  session->read_stmthp = PrepareStatement (session, sql);
+  BindVariable (session, session->read_stmthp, ":BAND_BLOCK", &session->band_block, sizeof(int), SQLT_INT);
+  BindVariable (session, session->read_stmthp, ":FIRST_ROW", &session->first_row, sizeof(int), SQLT_INT);
+  BindVariable (session, session->read_stmthp, ":LAST_ROW", &session->last_row, sizeof(int), SQLT_INT);
+  BindVariable (session, session->read_stmthp, ":FIRST_COLUMN", &session->first_column, sizeof(int), SQLT_INT);
+  BindVariable (session, session->read_stmthp, ":LAST_COLUMN", &session->last_column, sizeof(int), SQLT_INT);
+  for (i=0; i<session->read_size; i++) {
+    status = OCIDescriptorAlloc(
+      (dvoid *)envhp,                /* (in)  Environment Handle */
+      (dvoid **)&session->read_lob[i], /* (out) LOB locator */
+      (ub4)OCI_DTYPE_LOB,            /* (in)  Descriptor type */
+      (size_t)0,                     /* (in)  Size of extra user memory (NOT USED) */
+      (dvoid **)0);                  /* (out) Pointer to user memory (NOT USED) */
+    if (status != OCI_SUCCESS)
+      ReportError(session->errhp);
+  }
+  DefineColumn (session, session->read_stmthp, 1, session->read_row, sizeof(int), SQLT_INT, NULL);
+  DefineColumn (session, session->read_stmthp, 2, session->read_column, sizeof(int), SQLT_INT, NULL);
+  DefineColumn (session, session->read_stmthp, 3, session->read_lob, sizeof(OCILobLocator *),
+    SQLT_BLOB, session->read_ind);
+
+  /* The whole group comes in one round trip, with its blocks */
+  prefetch_rows = (ub4) session->read_size;
+  status = OCIAttrSet(
+    (dvoid *)session->read_stmthp,   /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    (dvoid *)&prefetch_rows,         /* (in)  Number of rows to prefetch */
+    (ub4)0,                          /* (in)  Size (NOT USED) */
+    (ub4)OCI_ATTR_PREFETCH_ROWS,     /* (in)  Attribute: row prefetch */
+    session->errhp);                 /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  status = OCIAttrGet(
+    (dvoid *)session->svchp,         /* (in)  Service Context Handle */
+    (ub4)OCI_HTYPE_SVCCTX,           /* (in)  Handle type */
+    (dvoid *)&session_hp,            /* (out) Session Handle */
+    (ub4 *)0,                        /* (out) Size (NOT USED) */
+    (ub4)OCI_ATTR_SESSION,           /* (in)  Attribute: session */
+    session->errhp);                 /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  status = OCIAttrSet(
+    (dvoid *)session_hp,             /* (in)  Session Handle */
+    (ub4)OCI_HTYPE_SESSION,          /* (in)  Handle type */
+    (dvoid *)&prefetch_size,         /* (in)  Number of bytes to prefetch */
+    (ub4)0,                          /* (in)  Size (NOT USED) */
+    (ub4)OCI_ATTR_DEFAULT_LOBPREFETCH_SIZE, /* (in)  Attribute: LOB prefetch size */
+    session->errhp);                 /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Insert: the blocks are bound as raw bytes, not as LOB locators */
+  sprintf (sql,
+    "INSERT INTO %s (rasterid, pyramidlevel, bandblocknumber, rowblocknumber, "
+    "columnblocknumber, blockmbr, rasterblock) "
+    "VALUES (%ld, :pyramid_level, :band_block, :row_block, :column_block, "
+    "SDO_GEOMETRY(2003, NULL, NULL, SDO_ELEM_INFO_ARRAY(1, 1003, 3), "
+    "SDO_ORDINATE_ARRAY(:min_row, :min_column, :max_row, :max_column)), :block)",
+    pyramid->raster.rdt, pyramid->raster.raster_id);
+  session->insert_stmthp = PrepareStatement (session, sql);
+  BindVariable (session, session->insert_stmthp, ":PYRAMID_LEVEL", session->level, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":BAND_BLOCK", session->band, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":ROW_BLOCK", session->row, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":COLUMN_BLOCK", session->column, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":MIN_ROW", session->min_row, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":MIN_COLUMN", session->min_column, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":MAX_ROW", session->max_row, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":MAX_COLUMN", session->max_column, sizeof(int), SQLT_INT);
+  BindVariable (session, session->insert_stmthp, ":BLOCK", session->blocks, (sb4) block_size, SQLT_LBI);
+}
+
+/*******************************************************************************
+** Routine:     CloseSession
+**
+** Description: Disconnect from Oracle and release the session handles and
+**              arrays
+*******************************************************************************/
+void CloseSession(session_struct *session)
+{
+  sword status;
+  int   i, level;
+
+  if (session->read_stmthp != NULL)
+    OCIHandleFree((dvoid *)session->read_stmthp, (ub4)OCI_HTYPE_STMT);
+  if (session->insert_stmthp != NULL)
+    OCIHandleFree((dvoid *)session->insert_stmthp, (ub4)OCI_HTYPE_STMT);
+  for (i=0; i<session->read_size; i++)
+    OCIDescriptorFree((dvoid *)session->read_lob[i], (ub4)OCI_DTYPE_LOB);
+
+  status = OCILogoff(session->svchp, session->errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)session->errhp,         /* (in)  Error Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  free (session->read_row);
+  free (session->read_column);
+  free (session->read_lob);
+  free (session->read_ind);
+  free (session->base);
+  free (session->base_present);
+  for (level=0; level<=MAX_LEVELS; level++)
+    for (i=0; i<4; i++)
+      free (session->work[level][i]);
+  free (session->square_block);
+  free (session->level);
+  free (session->band);
+  free (session->row);
+  free (session->column);
+  free (session->min_row);
+  free (session->min_column);
+  free (session->max_row);
+  free (session->max_column);
+  free (session->blocks);
+}
+
+/*******************************************************************************
+** Routine:     ReadBaseBlocks
+**
+** Description: Read the blocks of level 0 under a block of the read level
+*******************************************************************************/
+void ReadBaseBlocks(
+  session_struct *session,
+  pyramid_struct *pyramid,
+  int            band_block,
+  long           row,
+  long           column)
+{
+  boolean has_more_data;
+  oraub8  lob_length, byte_amount;
+  int     rows_in_batch = 0, side = session->base_side, i, slot;
+  sword   status;
+  double  start_time = ElapsedSeconds ();
+
+  session->base_row = row * side;
+  session->base_column = column * side;
+  session->band_block = band_block;
+  session->first_row = (int) session->base_row;
+  session->last_row = (int) session->base_row + side - 1;
+  session->first_column = (int) session->base_column;
+  session->last_column = (int) session->base_column + side - 1;
+  memset (session->base_present, 0, sizeof(int) * session->read_size);
+
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    session->read_stmthp,            /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)session->read_size,         /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(session->errhp);
+
+  has_more_data = TRUE;
+  do
+  {
+    /* The last batch comes with OCI_NO_DATA: it still needs to be processed */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)session->read_stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      session->errhp);
+
+    /* Copy the blocks just fetched: they came with the rows */
+    for (i=0; i<rows_in_batch; i++) {
+      if (session->read_ind[i] == OCI_IND_NULL)
+        continue;
+      slot = (int) ((session->read_row[i] - session->base_row) * side
+        + session->read_column[i] - session->base_column);
+      status = OCILobGetLength2(session->svchp, session->errhp, session->read_lob[i], &lob_length);
+      if (status != OCI_SUCCESS)
+        ReportError(session->errhp);
+      if (lob_length != pyramid->block_size) {
+        printf ("Block (%d, %d, %d) has %ld bytes instead of %ld\n", band_block,
+          session->read_row[i], session->read_column[i], (long) lob_length,
+          (long) pyramid->block_size);
+        exit (1);
+      }
+      byte_amount = lob_length;
+      status = OCILobRead2(
+        session->svchp,              /* (in)  Service Context Handle */
+        session->errhp,              /* (in)  Error Handle */
+        session->read_lob[i],        /* (in)  LOB locator */
+        &byte_amount,                /* (i/o) Number of bytes to read / read */
+        (oraub8 *)0,                 /* (i/o) Number of characters (NOT USED) */
+        (oraub8)1,                   /* (in)  Offset of first byte (1-based) */
+        (dvoid *)(session->base + slot * pyramid->block_size), /* (in)  Buffer */
+        lob_length,                  /* (in)  Buffer size */
+        OCI_ONE_PIECE,               /* (in)  Piece: all in one go */
+        (dvoid *)0,                  /* (in)  Callback context (NOT USED) */
+        0,                           /* (in)  Callback function (NOT USED) */
+        (ub2)0,                      /* (in)  Character set (NOT USED) */
+        (ub1)SQLCS_IMPLICIT);        /* (in)  Character set form */
+      if (status != OCI_SUCCESS)
+        ReportError(session->errhp);
+      session->base_present[slot] = 1;
+      session->n_read++;
+    }
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        session->read_stmthp,          /* (in)  Statement Handle */
+        session->errhp,                /* (in)  Error Handle */
+        (ub4)session->read_size,       /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(session->errhp);
+    }
+  }
+  while (has_more_data);
+
+  session->read_seconds += ElapsedSeconds () - start_time;
+}
+
+/*******************************************************************************
+** Routine:     FlushInserts
+**
+** Description: Insert the blocks queued by a session, and commit
+*******************************************************************************/
+void FlushInserts(session_struct *session)
+{
+  double start_time = ElapsedSeconds ();
+
+  if (session->n_inserts == 0)
+    return;
+  ExecuteStatement (session, session->insert_stmthp, session->n_inserts);
+  Commit (session);
+  session->n_written += session->n_inserts;
+  session->n_inserts = 0;
+  session->write_seconds += ElapsedSeconds () - start_time;
+}
+
+/*******************************************************************************
+** Routine:     QueueInsert
+**
+** Description: Queue a block of the pyramid for insertion
+*******************************************************************************/
+void QueueInsert(
+  session_struct      *session,
+  pyramid_struct      *pyramid,
+  int                 level,
+  int                 band_block,
+  long                row,
+  long                column,
+  const unsigned char *block)
+{
+  int n = session->n_inserts;
+
+  session->level[n] = level;
+  session->band[n] = band_block;
+  session->row[n] = (int) row;
+  session->column[n] = (int) column;
+  session->min_row[n] = (int) (row * pyramid->raster.block_rows);
+  session->min_column[n] = (int) (column * pyramid->raster.block_columns);
+  session->max_row[n] = session->min_row[n] + pyramid->raster.block_rows - 1;
+  session->max_column[n] = session->min_column[n] + pyramid->raster.block_columns - 1;
+  memcpy (session->blocks + n * pyramid->block_size, block, pyramid->block_size);
+  session->n_inserts++;
+  if (session->n_inserts == session->insert_size)
+    FlushInserts (session);
+}
+
+/*******************************************************************************
+** Routine:     BuildBlock
+**
+** Description: Build a block of a pyramid level from the blocks of level 0
+**              under it, and queue it and the blocks of the levels in
+**              between for insertion
+*******************************************************************************/
+void BuildBlock(
+  session_struct *session,
+  pyramid_struct *pyramid,
+  int            level,
+  int            band_block,
+  long           row,
+  long           column,
+  unsigned char  *block)
+{
+  const unsigned char *children[4];
+  long   child_row, child_column;
+  int    q, slot;
+  double start_time;
+
+  if (level == pyramid->read_level)
+    ReadBaseBlocks (session, pyramid, band_block, row, column);
+
+  for (q=0; q<4; q++) {
+    child_row = 2 * row + q / 2;
+    child_column = 2 * column + q % 2;
+    children[q] = NULL;
+    if (child_row >= pyramid->row_blocks[level-1] || child_column >= pyramid->column_blocks[level-1])
+      continue;
+    if (level == 1) {
+      slot = (int) ((child_row - session->base_row) * session->base_side
+        + child_column - session->base_column);
+      if (session->base_present[slot])
+        children[q] = session->base + slot * pyramid->block_size;
+    }
+    else {
+      BuildBlock (session, pyramid, level - 1, band_block, child_row, child_column,
+        session->work[level-1][q]);
+      children[q] = session->work[level-1][q];
+    }
+  }
+
+  start_time = ElapsedSeconds ();
+  ReduceBlock (&pyramid->layout, children, block, pyramid->method);
+  session->reduce_seconds += ElapsedSeconds () - start_time;
+  QueueInsert (session, pyramid, level, band_block, row, column, block);
+}
+
+/*******************************************************************************
+** Routine:     WorkerThread
+**
+** Description: Thread routine: build squares until there are none left
+*******************************************************************************/
+void *WorkerThread (void *argument)
+{
+  worker_struct  *worker = (worker_struct *) argument;
+  pyramid_struct *pyramid = worker->pyramid;
+  session_struct *session = &worker->session;
+  long square, row, column, per_band;
+  int  band_block, level = pyramid->square_level;
+
+  per_band = pyramid->row_blocks[level] * pyramid->column_blocks[level];
+  for (;;) {
+    pthread_mutex_lock (&pyramid->lock);
+    square = pyramid->next_square < pyramid->n_squares ? pyramid->next_square++ : -1;
+    pthread_mutex_unlock (&pyramid->lock);
+    if (square < 0)
+      break;
+
+    band_block = (int) (square / per_band);
+    row = square % per_band / pyramid->column_blocks[level];
+    column = square % pyramid->column_blocks[level];
+    BuildBlock (session, pyramid, level, band_block, row, column, session->square_block);
+
+    /* Keep the block for the levels above */
+    if (pyramid->top != NULL) {
+      pyramid->top[square] = malloc (pyramid->block_size);
+      memcpy (pyramid->top[square], session->square_block, pyramid->block_size);
+    }
+  }
+  FlushInserts (session);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     BuildTopLevels
+**
+** Description: Build the levels above the squares from the blocks of the
+**              squares
+*******************************************************************************/
+void BuildTopLevels(
+  session_struct *session,
+  pyramid_struct *pyramid)
+{
+  unsigned char       **below = pyramid->top, **above;
+  const unsigned char *children[4];
+  long   row, column, child_row, child_column;
+  int    level, band_block, q;
+  double start_time;
+
+  for (level=pyramid->square_level+1; level<=pyramid->n_levels; level++) {
+    above = malloc (sizeof(unsigned char *) * pyramid->n_band_blocks
+      * pyramid->row_blocks[level] * pyramid->column_blocks[level]);
+    for (band_block=0; band_block<pyramid->n_band_blocks; band_block++)
+      for (row=0; row<pyramid->row_blocks[level]; row++)
+        for (column=0; column<pyramid->column_blocks[level]; column++) {
+          for (q=0; q<4; q++) {
+            child_row = 2 * row + q / 2;
+            child_column = 2 * column + q % 2;
+            children[q] = NULL;
+            if (child_row < pyramid->row_blocks[level-1] && child_column < pyramid->column_blocks[level-1])
+              children[q] = below[(band_block * pyramid->row_blocks[level-1] + child_row)
+                * pyramid->column_blocks[level-1] + child_column];
+          }
+          start_time = ElapsedSeconds ();
+          q = (int) ((band_block * pyramid->row_blocks[level] + row) * pyramid->column_blocks[level] + column);
+          above[q] = malloc (pyramid->block_size);
+          ReduceBlock (&pyramid->layout, children, above[q], pyramid->method);
+          session->reduce_seconds += ElapsedSeconds () - start_time;
+          QueueInsert (session, pyramid, level, band_block, row, column, above[q]);
+        }
+
+    /* The level below is no longer needed */
+    for (q=0; q<pyramid->n_band_blocks * pyramid->row_blocks[level-1] * pyramid->column_blocks[level-1]; q++)
+      free (below[q]);
+    free (below);
+    below = above;
+  }
+  FlushInserts (session);
+
+  for (q=0; q<pyramid->n_band_blocks * pyramid->row_blocks[pyramid->n_levels]
+       * pyramid->column_blocks[pyramid->n_levels]; q++)
+    free (below[q]);
+  free (below);
+  pyramid->top = NULL;
+}
+
+/*******************************************************************************
+** Routine:     UpdateMetadata
+**
+** Description: Replace the pyramid element of the metadata of the object,
+**              without committing. A max_level of 0 means no pyramid.
+*******************************************************************************/
+void UpdateMetadata(
+  session_struct *session,
+  pyramid_struct *pyramid,
+  char           *tablename,
+  char           *idcolumn,
+  char           *geocolumn,
+  long           id,
+  int            max_level)
+{
+  char    sql[2048];
+  char    element[256];
+  OCIStmt *stmthp;
+
+  if (max_level > 0)
+    sprintf (element, "<type>DECREASE</type><resampling>%s</resampling><maxLevel>%d</maxLevel>",
+      pyramid->method == RASTER_NEAREST ? "NN" : "AVERAGE4", max_level);
+  else
+    sprintf (element, "<type>NONE</type>");
+  sprintf (sql,
+    "UPDATE %s t SET t.%s.metadata = updateXML(t.%s.metadata, "
+    "'/georasterMetadata/rasterInfo/pyramid', "
+    "XMLType('<pyramid xmlns=\"http://xmlns.oracle.com/spatial/georaster\">%s</pyramid>'), "
+    "'xmlns=\"http://xmlns.oracle.com/spatial/georaster\"') "
+    "WHERE t.%s = :id",
+    tablename, geocolumn, geocolumn, element, idcolumn);
+  printf ("SQL> %s\n", sql);
+  stmthp = PrepareStatement (session, sql);
+  BindVariable (session, stmthp, ":ID", &id, sizeof(long), SQLT_INT);
+  ExecuteStatement (session, stmthp, 1);
+  OCIHandleFree((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT);
+}
+
+/*******************************************************************************
+** Routine:     DeletePyramid
+**
+** Description: Delete the existing pyramid levels of the raster, and remove
+**              the pyramid from its metadata in the same transaction, so that
+**              the metadata never describes levels that are not there
+*******************************************************************************/
+void DeletePyramid(
+  session_struct *session,
+  pyramid_struct *pyramid,
+  char           *tablename,
+  char           *idcolumn,
+  char           *geocolumn,
+  long           id)
+{
+  char    sql[512];
+  OCIStmt *stmthp;
+
+  sprintf (sql, "DELETE FROM %s WHERE rasterid = %ld AND pyramidlevel > 0",
+    pyramid->raster.rdt, pyramid->raster.raster_id);
+  printf ("SQL> %s\n", sql);
+  stmthp = PrepareStatement (session, sql);
+  ExecuteStatement (session, stmthp, 1);
+  OCIHandleFree((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT);
+
+  UpdateMetadata (session, pyramid, tablename, idcolumn, geocolumn, id, 0);
+  Commit (session);
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *username, *password, *database, *tablename, *idcolumn, *geocolumn;
+    long   id, rows, columns, n_read = 0, n_written = 0;
+    int    n_levels, n_threads, method, array_size, level, t;
+    double start_time, elapsed, read_seconds = 0, reduce_seconds = 0, write_seconds = 0;
+    pyramid_struct pyramid;
+    raster_info_struct *raster = &pyramid.raster;
+    worker_struct  workers[MAX_THREADS];
+
+    if( argc < 9 || argc > 12) {
+      printf("USAGE: %s <username> <password> <database> <tablename> <id_column> <geo_column> <id> <levels> [<threads>] [<resampling>] [<array_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      tablename = argv[4];
+      idcolumn = argv[5];
+      geocolumn = argv[6];
+      id = atol(argv[7]);
+      n_levels = atoi(argv[8]);
+      if (n_levels <= 0 || n_levels > MAX_LEVELS) {
+        printf ("Invalid number of levels: must be between 1 and %d\n", MAX_LEVELS);
+        exit( 1 );
+      }
+      if (argc > 9)
+        n_threads = atoi(argv[9]);
+      else
+        n_threads = 4;
+      if (n_threads <= 0 || n_threads > MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", MAX_THREADS);
+        exit( 1 );
+      }
+      method = RASTER_AVERAGE;
+      if (argc > 10) {
+        if (strcmp (argv[10], "NEAREST") == 0)
+          method = RASTER_NEAREST;
+        else if (strcmp (argv[10], "AVERAGE") != 0) {
+          printf ("Invalid resampling: must be AVERAGE or NEAREST\n");
+          exit( 1 );
+        }
+      }
+      if (argc > 11)
+        array_size = atoi(argv[11]);
+      else
+        array_size = 16;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Open the sessions */
+    for (t=0; t<n_threads; t++)
+      OpenSession (&workers[t].session, username, password, database);
+    printf ("Connected to: %s, %d sessions\n\n", database, n_threads);
+
+    /* Describe the raster, and check that it can be reduced */
+    memset (&pyramid, 0, sizeof(pyramid));
+    ReadRasterInfo (&workers[0].session, tablename, idcolumn, geocolumn, id, raster);
+    printf ("Raster %ld in %s: %ld x %ld cells, %d bands, blocks of %d x %d x %d\n",
+      raster->raster_id, raster->rdt, raster->rows, raster->columns, raster->bands,
+      raster->block_rows, raster->block_columns, raster->block_bands);
+    printf ("%d-bit cells, %s interleaving, %s compression\n\n",
+      raster->cell_depth, raster->interleaving, raster->compression);
+    if (!ValidName (raster->rdt)) {
+      printf ("Invalid raster data table name: %s\n", raster->rdt);
+      exit (1);
+    }
+    if (raster->cell_depth != 8 || strcmp (raster->compression, "NONE") != 0) {
+      printf ("Only uncompressed rasters with 8-bit cells are supported\n");
+      exit (1);
+    }
+    if (raster->block_rows <= 0 || raster->block_columns <= 0 || raster->block_bands <= 0
+        || raster->block_rows % 2 != 0 || raster->block_columns % 2 != 0) {
+      printf ("The blocks must have an even number of rows and columns\n");
+      exit (1);
+    }
+    if (strcmp (raster->interleaving, "BSQ") == 0)
+      pyramid.layout.interleaving = RASTER_BSQ;
+    else if (strcmp (raster->interleaving, "BIL") == 0)
+      pyramid.layout.interleaving = RASTER_BIL;
+    else if (strcmp (raster->interleaving, "BIP") == 0)
+      pyramid.layout.interleaving = RASTER_BIP;
+    else {
+      printf ("Unknown interleaving: %s\n", raster->interleaving);
+      exit (1);
+    }
+    pyramid.layout.rows = raster->block_rows;
+    pyramid.layout.columns = raster->block_columns;
+    pyramid.layout.bands = raster->block_bands;
+    pyramid.block_size = (size_t) raster->block_rows * raster->block_columns * raster->block_bands;
+    pyramid.method = method;
+    pyramid.n_levels = n_levels;
+    pyramid.n_band_blocks = (raster->bands + raster->block_bands - 1) / raster->block_bands;
+
+    /* The size of each level, in blocks */
+    rows = raster->rows;
+    columns = raster->columns;
+    for (level=0; level<=n_levels; level++) {
+      if (rows < 1 || columns < 1) {
+        printf ("The raster is too small for %d levels\n", n_levels);
+        exit (1);
+      }
+      pyramid.row_blocks[level] = (rows + raster->block_rows - 1) / raster->block_rows;
+      pyramid.column_blocks[level] = (columns + raster->block_columns - 1) / raster->block_columns;
+      rows /= 2;
+      columns /= 2;
+    }
+
+    /* Cut the work into squares: four per thread at least, if possible */
+    pyramid.square_level = n_levels;
+    while (pyramid.square_level > 1 && pyramid.n_band_blocks * pyramid.row_blocks[pyramid.square_level]
+           * pyramid.column_blocks[pyramid.square_level] < 4 * n_threads)
+      pyramid.square_level--;
+    pyramid.read_level = pyramid.square_level < MAX_READ_LEVEL ? pyramid.square_level : MAX_READ_LEVEL;
+    pyramid.n_squares = pyramid.n_band_blocks * pyramid.row_blocks[pyramid.square_level]
+      * pyramid.column_blocks[pyramid.square_level];
+    if (pyramid.square_level < n_levels)
+      pyramid.top = calloc (pyramid.n_squares, sizeof(unsigned char *));
+    pthread_mutex_init (&pyramid.lock, NULL);
+    printf ("%ld squares of level %d, level 0 read in groups of %d x %d blocks\n\n",
+      pyramid.n_squares, pyramid.square_level, 1 << pyramid.read_level, 1 << pyramid.read_level);
+
+    /* Remove the old pyramid */
+    DeletePyramid (&workers[0].session, &pyramid, tablename, idcolumn, geocolumn, id);
+
+    /* Build the squares: the calling thread is worker 0 */
+    start_time = ElapsedSeconds ();
+    for (t=0; t<n_threads; t++) {
+      workers[t].id = t;
+      workers[t].pyramid = &pyramid;
+      PrepareSession (&workers[t].session, &pyramid, array_size);
+    }
+    for (t=1; t<n_threads; t++)
+      if (pthread_create (&workers[t].thread, NULL, WorkerThread, &workers[t]) != 0) {
+        printf ("Could not start thread %d\n", t);
+        exit (1);
+      }
+    WorkerThread (&workers[0]);
+    for (t=1; t<n_threads; t++)
+      pthread_join (workers[t].thread, NULL);
+
+    /* Then the levels above them */
+    if (pyramid.top != NULL)
+      BuildTopLevels (&workers[0].session, &pyramid);
+    elapsed = ElapsedSeconds () - start_time;
+
+    /* All blocks are committed (each thread commits its last inserts before
+       it stops): only now can the metadata describe the new levels */
+    UpdateMetadata (&workers[0].session, &pyramid, tablename, idcolumn, geocolumn, id, n_levels);
+    Commit (&workers[0].session);
+
+    for (t=0; t<n_threads; t++) {
+      n_read += workers[t].session.n_read;
+      n_written += workers[t].session.n_written;
+      read_seconds += workers[t].session.read_seconds;
+      reduce_seconds += workers[t].session.reduce_seconds;
+      write_seconds += workers[t].session.write_seconds;
+      CloseSession (&workers[t].session);
+    }
+    pthread_mutex_destroy (&pyramid.lock);
+
+    printf ("\n%d levels built with %d threads in %.3f seconds\n", n_levels, n_threads, elapsed);
+    for (level=1; level<=n_levels; level++)
+      printf ("Level %d: %ld x %ld blocks\n", level, pyramid.row_blocks[level], pyramid.column_blocks[level]);
+    printf ("%ld blocks of level 0 read (%.1f MB, %.1f MB per second)\n", n_read,
+      n_read * (double) pyramid.block_size / 1048576,
+      n_read * (double) pyramid.block_size / 1048576 / (elapsed > 0 ? elapsed : 1e-9));
+    printf ("%ld blocks written (%.1f MB)\n", n_written, n_written * (double) pyramid.block_size / 1048576);
+    printf ("Thread time: %.3f s reading, %.3f s reducing, %.3f s writing\n",
+      read_seconds, reduce_seconds, write_seconds);
+
+    /* Teardown  OCI environment */
+    OCITerminate (OCI_DEFAULT);
+
+    return 0;
+}
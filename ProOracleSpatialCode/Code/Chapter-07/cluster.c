@@ -0,0 +1,1106 @@
+/* cluster.c
+
+   Clustering of points with k-means and DBSCAN, and convex hulls of the
+   clusters. See cluster.h for a description of the methods.
+
+   The work is split between threads by ranges of points (or of cells, or of
+   clusters). Each thread accumulates its results in its own arrays, which are
+   combined by the calling thread, so that no locking is needed.
+
+   The distance computations are written as simple loops over contiguous
+   arrays of X and Y values, without branches, so that the compiler can
+   vectorize them.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "cluster.h"
+#include "spatial_util.h"
+
+#define KMEANS_BLOCK 1024             /* Points assigned at a time */
+#define KMEANS_SEED_SAMPLE 100000     /* Sample size for k-means++ seeding */
+#define KMEANS_CONVERGED 10000        /* Stop when fewer than 1/10000 points move */
+#define DBSCAN_NEIGHBOURS 21          /* Cells within eps of a cell, including itself */
+#define DBSCAN_MAX_CELL 2000000000L   /* Limit of cell coordinates */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* The share of a k-means iteration done by one thread */
+struct kmeans_job
+{
+    const double *x;                  /* Points to assign */
+    const double *y;
+    long         first, last;         /* Range of points */
+    int          k;
+    const double *center_x;
+    const double *center_y;
+    int          *cluster;            /* (out) Cluster of each point (from 1) */
+    double       *sum_x;              /* (out) Per cluster: sums of coordinates */
+    double       *sum_y;
+    long         *count;              /* (out) Per cluster: number of points */
+    long         n_changed;           /* (out) Points that changed cluster */
+    double       *nearest;            /* Work arrays of KMEANS_BLOCK values */
+    double       *distance;
+};
+typedef struct kmeans_job kmeans_job_struct;
+
+/* A point and its cell, as sorted for DBSCAN */
+struct cell_point
+{
+    uint64_t key;                     /* Cell column and row */
+    long     index;                   /* Point number */
+};
+typedef struct cell_point cell_point_struct;
+
+/* The grid shared by all DBSCAN threads */
+struct dbscan_grid
+{
+    double   eps2;                    /* Square of eps */
+    int      min_points;
+    long     n_points;
+    double   *x;                      /* Points sorted by cell */
+    double   *y;
+    long     *index;                  /* Point number of each sorted point */
+    char     *core;                   /* 1 for core points */
+    long     n_cells;
+    uint64_t *cell_key;               /* Key of each cell, in increasing order */
+    long     *cell_start;             /* First point of each cell (n_cells + 1) */
+    char     *cell_core;              /* 1 for cells with a core point */
+    long     *cell_root;              /* Union-find parent of each cell */
+    int      *cell_cluster;           /* Cluster number of each core cell */
+    int      *cluster;                /* (out) Cluster of each sorted point */
+};
+typedef struct dbscan_grid dbscan_grid_struct;
+
+/* The share of a DBSCAN phase done by one thread */
+struct dbscan_job
+{
+    dbscan_grid_struct *grid;
+    long               first, last;   /* Range of cells */
+    long               *edges;        /* (out) Pairs of linked cells */
+    long               n_edges;
+    long               size_edges;
+};
+typedef struct dbscan_job dbscan_job_struct;
+
+/* The share of the sorting of the DBSCAN points done by one thread */
+struct sort_job
+{
+    cell_point_struct *points;
+    long              n_points;
+};
+typedef struct sort_job sort_job_struct;
+
+/* The clusters whose hull is computed by one thread */
+struct hull_job
+{
+    const double        *x;
+    const double        *y;
+    const long          *members;     /* Points, grouped by cluster */
+    const long          *start;       /* First member of each cluster */
+    cluster_hull_struct *hulls;
+    int                 n_clusters;
+    int                 thread;
+    int                 n_threads;
+};
+typedef struct hull_job hull_job_struct;
+
+/* The neighbour cells of a cell of side eps / sqrt(2): the 5 x 5 block
+   around it without its corners */
+static const int neighbour_dx[DBSCAN_NEIGHBOURS] =
+  {  0, -1,  0,  1, -1,  1, -1,  0,  1, -2, -2, -2,  2,  2,  2, -1,  0,  1, -1,  0,  1 };
+static const int neighbour_dy[DBSCAN_NEIGHBOURS] =
+  {  0, -1, -1, -1,  0,  0,  1,  1,  1, -1,  0,  1, -1,  0,  1, -2, -2, -2,  2,  2,  2 };
+
+/*******************************************************************************
+** Routine:     CheckThreads
+**
+** Description: Limit a number of threads to the supported range
+*******************************************************************************/
+static int CheckThreads (int n_threads)
+{
+#ifdef _WIN32
+  n_threads = 1;
+#endif
+  if (n_threads < 1)
+    return 1;
+  if (n_threads > CLUSTER_MAX_THREADS)
+    return CLUSTER_MAX_THREADS;
+  return n_threads;
+}
+
+/*******************************************************************************
+** Routine:     NextRandom
+**
+** Description: Pseudo-random number generator (xorshift64*): returns a number
+**              between 0 and n-1
+*******************************************************************************/
+static long NextRandom (uint64_t *state, long n)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return (long) (((*state * 2685821657736338717ULL) >> 11) % (uint64_t) n);
+}
+
+/*******************************************************************************
+** Routine:     NearestCenters
+**
+** Description: Find the nearest center of each point of a block. The loop
+**              runs over the points for each center, so that it vectorizes.
+**              The center numbers are kept as doubles: the compiler does not
+**              vectorize a loop that mixes double and int selections.
+*******************************************************************************/
+static void NearestCenters (
+  const double *x,
+  const double *y,
+  int          n_points,
+  const double *center_x,
+  const double *center_y,
+  int          k,
+  double       *nearest,
+  double       *distance)
+{
+  double cx, cy, dx, dy, d, center;
+  int    i, c;
+
+  for (i=0; i<n_points; i++) {
+    distance[i] = HUGE_VAL;
+    nearest[i] = 0;
+  }
+  for (c=0; c<k; c++) {
+    cx = center_x[c];
+    cy = center_y[c];
+    center = c;
+    for (i=0; i<n_points; i++) {
+      dx = x[i] - cx;
+      dy = y[i] - cy;
+      d = dx*dx + dy*dy;
+      nearest[i] = d < distance[i] ? center : nearest[i];
+      distance[i] = d < distance[i] ? d : distance[i];
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     AssignPoints
+**
+** Description: Assign the points of a k-means job to their nearest center,
+**              and sum the coordinates of the points of each cluster
+*******************************************************************************/
+static void *AssignPoints (void *argument)
+{
+  kmeans_job_struct *job = (kmeans_job_struct *) argument;
+  const double *x = job->x, *y = job->y;
+  int    *cluster = job->cluster;
+  double *sum_x = job->sum_x, *sum_y = job->sum_y;
+  long   *count = job->count;
+  double *nearest = job->nearest;
+  double *distance = job->distance;
+  long   i, n_changed = 0;
+  int    j, n, c;
+
+  memset (sum_x, 0, job->k * sizeof(double));
+  memset (sum_y, 0, job->k * sizeof(double));
+  memset (count, 0, job->k * sizeof(long));
+
+  for (i=job->first; i<job->last; i+=KMEANS_BLOCK) {
+    n = job->last - i < KMEANS_BLOCK ? (int) (job->last - i) : KMEANS_BLOCK;
+    NearestCenters (x + i, y + i, n, job->center_x, job->center_y, job->k,
+      nearest, distance);
+    for (j=0; j<n; j++) {
+      c = (int) nearest[j];
+      n_changed += cluster[i+j] != c + 1;
+      cluster[i+j] = c + 1;
+      sum_x[c] += x[i+j];
+      sum_y[c] += y[i+j];
+      count[c]++;
+    }
+  }
+  job->n_changed = n_changed;
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     AssignAll
+**
+** Description: Assign a set of points to their nearest center with several
+**              threads. Returns the number of points that changed cluster.
+**              The sums of the coordinates of each cluster are left in the
+**              job of the first thread.
+*******************************************************************************/
+static long AssignAll (
+  kmeans_job_struct *jobs,
+  int               n_threads,
+  const double      *x,
+  const double      *y,
+  long              n_points,
+  int               *cluster)
+{
+  long n_changed = 0;
+  int  t, c;
+
+  if (n_threads > n_points / KMEANS_BLOCK + 1)
+    n_threads = (int) (n_points / KMEANS_BLOCK) + 1;
+  for (t=0; t<n_threads; t++) {
+    jobs[t].x = x;
+    jobs[t].y = y;
+    jobs[t].first = n_points * t / n_threads;
+    jobs[t].last = n_points * (t+1) / n_threads;
+    jobs[t].cluster = cluster;
+  }
+  RunJobs (AssignPoints, jobs, sizeof(kmeans_job_struct), n_threads);
+
+  for (t=0; t<n_threads; t++) {
+    n_changed += jobs[t].n_changed;
+    if (t > 0)
+      for (c=0; c<jobs[0].k; c++) {
+        jobs[0].sum_x[c] += jobs[t].sum_x[c];
+        jobs[0].sum_y[c] += jobs[t].sum_y[c];
+        jobs[0].count[c] += jobs[t].count[c];
+      }
+  }
+  return n_changed;
+}
+
+/*******************************************************************************
+** Routine:     SeedCenters
+**
+** Description: Choose the initial centers with k-means++ on a sample of the
+**              points: each center is drawn with a probability proportional
+**              to the square of its distance to the nearest center already
+**              chosen
+*******************************************************************************/
+static void SeedCenters (
+  const double *x,
+  const double *y,
+  long         n_points,
+  int          k,
+  double       *center_x,
+  double       *center_y,
+  uint64_t     *random_state)
+{
+  long   n_sample = n_points < KMEANS_SEED_SAMPLE ? n_points : KMEANS_SEED_SAMPLE;
+  double *sx = malloc (n_sample * sizeof(double));
+  double *sy = malloc (n_sample * sizeof(double));
+  double *d2 = malloc (n_sample * sizeof(double));
+  double total, target, dx, dy, d;
+  long   i, j;
+  int    c;
+
+  /* Sample the points (all of them if there are few) */
+  for (i=0; i<n_sample; i++) {
+    j = n_sample == n_points ? i : NextRandom (random_state, n_points);
+    sx[i] = x[j];
+    sy[i] = y[j];
+  }
+
+  j = NextRandom (random_state, n_sample);
+  center_x[0] = sx[j];
+  center_y[0] = sy[j];
+  for (i=0; i<n_sample; i++)
+    d2[i] = HUGE_VAL;
+
+  for (c=1; c<k; c++) {
+    /* Distance of each point to its nearest center */
+    total = 0;
+    for (i=0; i<n_sample; i++) {
+      dx = sx[i] - center_x[c-1];
+      dy = sy[i] - center_y[c-1];
+      d = dx*dx + dy*dy;
+      d2[i] = d < d2[i] ? d : d2[i];
+      total += d2[i];
+    }
+
+    /* Draw the next center */
+    target = total * ((double) NextRandom (random_state, 1L << 30) / (1L << 30));
+    for (i=0; i<n_sample-1 && target >= d2[i]; i++)
+      target -= d2[i];
+    center_x[c] = sx[i];
+    center_y[c] = sy[i];
+  }
+
+  free (sx);
+  free (sy);
+  free (d2);
+}
+
+/*******************************************************************************
+** Routine:     KMeansClusters
+**
+** Description: Partition the points into k clusters. Sets the cluster number
+**              (1 to k) of each point, and the center of each cluster.
+**              Lloyd iterations stop when fewer than 1/KMEANS_CONVERGED of
+**              the points change cluster. With a mini-batch size, exactly
+**              max_iterations mini-batches are used. Returns the number of
+**              iterations done.
+*******************************************************************************/
+int KMeansClusters (
+  const double *x,
+  const double *y,
+  long         n_points,
+  int          k,
+  int          max_iterations,
+  int          mini_batch_size,
+  int          n_threads,
+  int          *cluster,
+  double       *center_x,
+  double       *center_y)
+{
+  kmeans_job_struct jobs[CLUSTER_MAX_THREADS];
+  uint64_t random_state = 0x9E3779B97F4A7C15ULL;
+  double   *batch_x = NULL, *batch_y = NULL;
+  int      *batch_cluster = NULL;
+  long     *seen = NULL;
+  long     i, j, n_changed;
+  double   eta;
+  int      iteration, t, c;
+
+  if (k < 1 || k > n_points) {
+    printf ("Invalid number of clusters: must be between 1 and %ld\n", n_points);
+    exit (1);
+  }
+  n_threads = CheckThreads (n_threads);
+  for (t=0; t<n_threads; t++) {
+    jobs[t].k = k;
+    jobs[t].center_x = center_x;
+    jobs[t].center_y = center_y;
+    jobs[t].sum_x = malloc (k * sizeof(double));
+    jobs[t].sum_y = malloc (k * sizeof(double));
+    jobs[t].count = malloc (k * sizeof(long));
+    /* On the heap: gcc does not vectorize NearestCenters on stack arrays */
+    jobs[t].nearest = malloc (KMEANS_BLOCK * sizeof(double));
+    jobs[t].distance = malloc (KMEANS_BLOCK * sizeof(double));
+  }
+  for (i=0; i<n_points; i++)
+    cluster[i] = 0;
+
+  SeedCenters (x, y, n_points, k, center_x, center_y, &random_state);
+
+  if (mini_batch_size > 0) {
+    /* Mini-batch k-means: move each center towards the sampled points that
+       are nearest to it, with a step that decreases as it sees more points */
+    batch_x = malloc (mini_batch_size * sizeof(double));
+    batch_y = malloc (mini_batch_size * sizeof(double));
+    batch_cluster = calloc (mini_batch_size, sizeof(int));
+    seen = calloc (k, sizeof(long));
+    for (iteration=0; iteration<max_iterations; iteration++) {
+      for (i=0; i<mini_batch_size; i++) {
+        j = NextRandom (&random_state, n_points);
+        batch_x[i] = x[j];
+        batch_y[i] = y[j];
+      }
+      AssignAll (jobs, n_threads, batch_x, batch_y, mini_batch_size, batch_cluster);
+      for (i=0; i<mini_batch_size; i++) {
+        c = batch_cluster[i] - 1;
+        seen[c]++;
+        eta = 1.0 / seen[c];
+        center_x[c] += eta * (batch_x[i] - center_x[c]);
+        center_y[c] += eta * (batch_y[i] - center_y[c]);
+      }
+    }
+    free (batch_x);
+    free (batch_y);
+    free (batch_cluster);
+    free (seen);
+
+    /* Assign all points to the final centers */
+    AssignAll (jobs, n_threads, x, y, n_points, cluster);
+  }
+  else {
+    /* Lloyd: assign all points, then move each center to the mean of its points */
+    for (iteration=0; iteration<max_iterations; ) {
+      n_changed = AssignAll (jobs, n_threads, x, y, n_points, cluster);
+      iteration++;
+      if (n_changed <= n_points / KMEANS_CONVERGED)
+        break;
+      /* A center that has lost all its points stays where it is */
+      for (c=0; c<k; c++)
+        if (jobs[0].count[c] > 0) {
+          center_x[c] = jobs[0].sum_x[c] / jobs[0].count[c];
+          center_y[c] = jobs[0].sum_y[c] / jobs[0].count[c];
+        }
+    }
+  }
+
+  for (t=0; t<n_threads; t++) {
+    free (jobs[t].sum_x);
+    free (jobs[t].sum_y);
+    free (jobs[t].count);
+    free (jobs[t].nearest);
+    free (jobs[t].distance);
+  }
+  return iteration;
+}
+
+/*******************************************************************************
+** Routine:     ComparePoints
+**
+** Description: Order points by cell, then by point number
+*******************************************************************************/
+static int ComparePoints (const void *a, const void *b)
+{
+  const cell_point_struct *pa = (const cell_point_struct *) a;
+  const cell_point_struct *pb = (const cell_point_struct *) b;
+
+  if (pa->key != pb->key)
+    return pa->key < pb->key ? -1 : 1;
+  return pa->index < pb->index ? -1 : (pa->index > pb->index ? 1 : 0);
+}
+
+static void *SortPoints (void *argument)
+{
+  sort_job_struct *job = (sort_job_struct *) argument;
+  qsort (job->points, job->n_points, sizeof(cell_point_struct), ComparePoints);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     SortByCell
+**
+** Description: Sort the points by cell: each thread sorts a share, and the
+**              shares are then merged
+*******************************************************************************/
+static cell_point_struct *SortByCell (
+  cell_point_struct *points,
+  long              n_points,
+  int               n_threads)
+{
+  sort_job_struct   jobs[CLUSTER_MAX_THREADS];
+  long              next[CLUSTER_MAX_THREADS];
+  cell_point_struct *sorted;
+  long              i;
+  int               t, best;
+
+  if (n_threads > n_points / 1024 + 1)
+    n_threads = (int) (n_points / 1024) + 1;
+  if (n_threads < 1)
+    n_threads = 1;
+  for (t=0; t<n_threads; t++) {
+    jobs[t].points = points + n_points * t / n_threads;
+    jobs[t].n_points = n_points * (t+1) / n_threads - n_points * t / n_threads;
+  }
+  RunJobs (SortPoints, jobs, sizeof(sort_job_struct), n_threads);
+  if (n_threads == 1)
+    return points;
+
+  sorted = malloc (n_points * sizeof(cell_point_struct));
+  for (t=0; t<n_threads; t++)
+    next[t] = 0;
+  for (i=0; i<n_points; i++) {
+    best = -1;
+    for (t=0; t<n_threads; t++)
+      if (next[t] < jobs[t].n_points
+          && (best < 0 || ComparePoints (&jobs[t].points[next[t]], &jobs[best].points[next[best]]) < 0))
+        best = t;
+    sorted[i] = jobs[best].points[next[best]++];
+  }
+  free (points);
+  return sorted;
+}
+
+/*******************************************************************************
+** Routine:     FindCell
+**
+** Description: Find a cell by its key. Returns -1 if the cell has no points.
+*******************************************************************************/
+static long FindCell (
+  dbscan_grid_struct *grid,
+  uint64_t           key)
+{
+  long low = 0, high = grid->n_cells - 1, middle;
+
+  while (low <= high) {
+    middle = (low + high) / 2;
+    if (grid->cell_key[middle] == key)
+      return middle;
+    if (grid->cell_key[middle] < key)
+      low = middle + 1;
+    else
+      high = middle - 1;
+  }
+  return -1;
+}
+
+/*******************************************************************************
+** Routine:     NeighbourCell
+**
+** Description: Find the j-th neighbour cell of a cell (-1 if it is empty)
+*******************************************************************************/
+static long NeighbourCell (
+  dbscan_grid_struct *grid,
+  long               cell,
+  int                j)
+{
+  long column = (long) (grid->cell_key[cell] >> 32) + neighbour_dx[j];
+  long row = (long) (grid->cell_key[cell] & 0xFFFFFFFFUL) + neighbour_dy[j];
+
+  if (j == 0)
+    return cell;
+  if (column < 0 || row < 0)
+    return -1;
+  return FindCell (grid, (uint64_t) column << 32 | (uint64_t) row);
+}
+
+/*******************************************************************************
+** Routine:     CountWithin
+**
+** Description: Count the points of a range that are within eps of a point
+*******************************************************************************/
+static long CountWithin (
+  const double *x,
+  const double *y,
+  long         first,
+  long         last,
+  double       px,
+  double       py,
+  double       eps2)
+{
+  double dx, dy;
+  double count = 0;                  /* A double, so that the loop vectorizes */
+  long   i;
+
+  for (i=first; i<last; i++) {
+    dx = x[i] - px;
+    dy = y[i] - py;
+    count += dx*dx + dy*dy <= eps2 ? 1.0 : 0.0;
+  }
+  return (long) count;
+}
+
+/*******************************************************************************
+** Routine:     FindCorePoints
+**
+** Description: Mark the core points of a range of cells
+*******************************************************************************/
+static void *FindCorePoints (void *argument)
+{
+  dbscan_job_struct  *job = (dbscan_job_struct *) argument;
+  dbscan_grid_struct *grid = job->grid;
+  long cell, neighbour, p, count, first, last;
+  int  j;
+
+  for (cell=job->first; cell<job->last; cell++) {
+    first = grid->cell_start[cell];
+    last = grid->cell_start[cell+1];
+
+    /* All points of a cell are within eps of each other */
+    if (last - first >= grid->min_points) {
+      memset (grid->core + first, 1, last - first);
+      grid->cell_core[cell] = 1;
+      continue;
+    }
+
+    for (p=first; p<last; p++) {
+      count = last - first;
+      for (j=1; j<DBSCAN_NEIGHBOURS && count < grid->min_points; j++) {
+        neighbour = NeighbourCell (grid, cell, j);
+        if (neighbour >= 0)
+          count += CountWithin (grid->x, grid->y,
+            grid->cell_start[neighbour], grid->cell_start[neighbour+1],
+            grid->x[p], grid->y[p], grid->eps2);
+      }
+      grid->core[p] = count >= grid->min_points;
+      if (grid->core[p])
+        grid->cell_core[cell] = 1;
+    }
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     CellsLinked
+**
+** Description: Tell if a core point of a cell is within eps of a core point
+**              of another cell
+*******************************************************************************/
+static int CellsLinked (
+  dbscan_grid_struct *grid,
+  long               cell_1,
+  long               cell_2)
+{
+  long p, q;
+  double dx, dy;
+
+  for (p=grid->cell_start[cell_1]; p<grid->cell_start[cell_1+1]; p++) {
+    if (!grid->core[p])
+      continue;
+    for (q=grid->cell_start[cell_2]; q<grid->cell_start[cell_2+1]; q++) {
+      dx = grid->x[q] - grid->x[p];
+      dy = grid->y[q] - grid->y[p];
+      if (grid->core[q] && dx*dx + dy*dy <= grid->eps2)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     LinkCells
+**
+** Description: List the pairs of core cells of a range of cells that belong
+**              to the same cluster. Each pair is listed once, from the cell
+**              with the lowest number.
+*******************************************************************************/
+static void *LinkCells (void *argument)
+{
+  dbscan_job_struct  *job = (dbscan_job_struct *) argument;
+  dbscan_grid_struct *grid = job->grid;
+  long cell, neighbour;
+  int  j;
+
+  job->n_edges = 0;
+  for (cell=job->first; cell<job->last; cell++) {
+    if (!grid->cell_core[cell])
+      continue;
+    for (j=1; j<DBSCAN_NEIGHBOURS; j++) {
+      neighbour = NeighbourCell (grid, cell, j);
+      if (neighbour <= cell || !grid->cell_core[neighbour])
+        continue;
+      if (CellsLinked (grid, cell, neighbour)) {
+        if (job->n_edges + 2 > job->size_edges) {
+          job->size_edges = job->size_edges * 2 + 1024;
+          job->edges = realloc (job->edges, job->size_edges * sizeof(long));
+        }
+        job->edges[job->n_edges++] = cell;
+        job->edges[job->n_edges++] = neighbour;
+      }
+    }
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     FindRoot
+**
+** Description: Find the representative cell of the cluster of a cell, and
+**              shorten the path to it
+*******************************************************************************/
+static long FindRoot (long *parent, long cell)
+{
+  long root = cell, next;
+
+  while (parent[root] != root)
+    root = parent[root];
+  while (parent[cell] != root) {
+    next = parent[cell];
+    parent[cell] = root;
+    cell = next;
+  }
+  return root;
+}
+
+/*******************************************************************************
+** Routine:     LabelPoints
+**
+** Description: Set the cluster of the points of a range of cells. Points that
+**              are not core points go to the cluster of the first core point
+**              found within eps, or are noise.
+*******************************************************************************/
+static void *LabelPoints (void *argument)
+{
+  dbscan_job_struct  *job = (dbscan_job_struct *) argument;
+  dbscan_grid_struct *grid = job->grid;
+  long   cell, neighbour, p, q;
+  double dx, dy;
+  int    j, label;
+
+  for (cell=job->first; cell<job->last; cell++) {
+    for (p=grid->cell_start[cell]; p<grid->cell_start[cell+1]; p++) {
+      /* A core cell is within eps of all its points */
+      if (grid->cell_core[cell]) {
+        grid->cluster[p] = grid->cell_cluster[cell];
+        continue;
+      }
+      label = 0;
+      for (j=1; j<DBSCAN_NEIGHBOURS && label == 0; j++) {
+        neighbour = NeighbourCell (grid, cell, j);
+        if (neighbour < 0 || !grid->cell_core[neighbour])
+          continue;
+        for (q=grid->cell_start[neighbour]; q<grid->cell_start[neighbour+1]; q++) {
+          dx = grid->x[q] - grid->x[p];
+          dy = grid->y[q] - grid->y[p];
+          if (grid->core[q] && dx*dx + dy*dy <= grid->eps2) {
+            label = grid->cell_cluster[neighbour];
+            break;
+          }
+        }
+      }
+      grid->cluster[p] = label;
+    }
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     RunOnCells
+**
+** Description: Run a DBSCAN phase on all cells with several threads
+*******************************************************************************/
+static void RunOnCells (
+  void               *(*routine) (void *),
+  dbscan_job_struct  *jobs,
+  int                n_threads,
+  dbscan_grid_struct *grid)
+{
+  int t;
+
+  for (t=0; t<n_threads; t++) {
+    jobs[t].grid = grid;
+    jobs[t].first = grid->n_cells * t / n_threads;
+    jobs[t].last = grid->n_cells * (t+1) / n_threads;
+  }
+  RunJobs (routine, jobs, sizeof(dbscan_job_struct), n_threads);
+}
+
+/*******************************************************************************
+** Routine:     DbscanClusters
+**
+** Description: Group the points into density-based clusters. Sets the
+**              cluster number of each point (0 for noise). Returns the
+**              number of clusters.
+*******************************************************************************/
+int DbscanClusters (
+  const double *x,
+  const double *y,
+  long         n_points,
+  double       eps,
+  int          min_points,
+  int          n_threads,
+  int          *cluster)
+{
+  dbscan_job_struct  jobs[CLUSTER_MAX_THREADS];
+  dbscan_grid_struct grid;
+  cell_point_struct  *points;
+  double min_x, min_y, max_x, max_y, side;
+  long   i, cell, root, column, row;
+  int    n_clusters = 0;
+  int    t;
+
+  if (!(eps > 0) || min_points < 1) {
+    printf ("Invalid DBSCAN parameters: eps and min_points must be positive\n");
+    exit (1);
+  }
+  n_threads = CheckThreads (n_threads);
+  if (n_points == 0)
+    return 0;
+
+  /* Size the grid on the extent of the points */
+  min_x = max_x = x[0];
+  min_y = max_y = y[0];
+  for (i=1; i<n_points; i++) {
+    min_x = x[i] < min_x ? x[i] : min_x;
+    max_x = x[i] > max_x ? x[i] : max_x;
+    min_y = y[i] < min_y ? y[i] : min_y;
+    max_y = y[i] > max_y ? y[i] : max_y;
+  }
+  side = eps / sqrt (2.0);
+  if ((max_x - min_x) / side > DBSCAN_MAX_CELL || (max_y - min_y) / side > DBSCAN_MAX_CELL) {
+    printf ("Invalid DBSCAN parameters: eps is too small for the extent of the points\n");
+    exit (1);
+  }
+
+  /* Sort the points by cell */
+  points = malloc (n_points * sizeof(cell_point_struct));
+  for (i=0; i<n_points; i++) {
+    column = (long) ((x[i] - min_x) / side);
+    row = (long) ((y[i] - min_y) / side);
+    points[i].key = (uint64_t) column << 32 | (uint64_t) row;
+    points[i].index = i;
+  }
+  points = SortByCell (points, n_points, n_threads);
+
+  memset (&grid, 0, sizeof(grid));
+  grid.eps2 = eps * eps;
+  grid.min_points = min_points;
+  grid.n_points = n_points;
+  grid.x = malloc (n_points * sizeof(double));
+  grid.y = malloc (n_points * sizeof(double));
+  grid.index = malloc (n_points * sizeof(long));
+  grid.core = calloc (n_points, 1);
+  grid.cluster = malloc (n_points * sizeof(int));
+  grid.cell_key = malloc (n_points * sizeof(uint64_t));
+  grid.cell_start = malloc ((n_points + 1) * sizeof(long));
+  for (i=0; i<n_points; i++) {
+    grid.x[i] = x[points[i].index];
+    grid.y[i] = y[points[i].index];
+    grid.index[i] = points[i].index;
+    if (i == 0 || points[i].key != points[i-1].key) {
+      grid.cell_key[grid.n_cells] = points[i].key;
+      grid.cell_start[grid.n_cells++] = i;
+    }
+  }
+  grid.cell_start[grid.n_cells] = n_points;
+  free (points);
+  grid.cell_core = calloc (grid.n_cells, 1);
+  grid.cell_root = malloc (grid.n_cells * sizeof(long));
+  grid.cell_cluster = calloc (grid.n_cells, sizeof(int));
+  if (n_threads > grid.n_cells)
+    n_threads = (int) grid.n_cells;
+
+  /* Find the core points */
+  RunOnCells (FindCorePoints, jobs, n_threads, &grid);
+
+  /* Link the core cells that have core points within eps of each other */
+  for (t=0; t<n_threads; t++) {
+    jobs[t].edges = NULL;
+    jobs[t].size_edges = 0;
+  }
+  RunOnCells (LinkCells, jobs, n_threads, &grid);
+  for (cell=0; cell<grid.n_cells; cell++)
+    grid.cell_root[cell] = cell;
+  for (t=0; t<n_threads; t++) {
+    for (i=0; i<jobs[t].n_edges; i+=2) {
+      root = FindRoot (grid.cell_root, jobs[t].edges[i]);
+      grid.cell_root[FindRoot (grid.cell_root, jobs[t].edges[i+1])] = root;
+    }
+    free (jobs[t].edges);
+  }
+
+  /* Number the clusters in the order of their first cell */
+  for (cell=0; cell<grid.n_cells; cell++)
+    if (grid.cell_core[cell]) {
+      root = FindRoot (grid.cell_root, cell);
+      if (grid.cell_cluster[root] == 0)
+        grid.cell_cluster[root] = ++n_clusters;
+      grid.cell_cluster[cell] = grid.cell_cluster[root];
+    }
+
+  /* Label all points */
+  RunOnCells (LabelPoints, jobs, n_threads, &grid);
+  for (i=0; i<n_points; i++)
+    cluster[grid.index[i]] = grid.cluster[i];
+
+  free (grid.x);
+  free (grid.y);
+  free (grid.index);
+  free (grid.core);
+  free (grid.cluster);
+  free (grid.cell_key);
+  free (grid.cell_start);
+  free (grid.cell_core);
+  free (grid.cell_root);
+  free (grid.cell_cluster);
+  return n_clusters;
+}
+
+/*******************************************************************************
+** Routine:     CompareXY
+**
+** Description: Order points by X, then by Y
+*******************************************************************************/
+static int CompareXY (const void *a, const void *b)
+{
+  const double *pa = (const double *) a;
+  const double *pb = (const double *) b;
+
+  if (pa[0] != pb[0])
+    return pa[0] < pb[0] ? -1 : 1;
+  return pa[1] < pb[1] ? -1 : (pa[1] > pb[1] ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     Cross
+**
+** Description: Cross product of (b - a) and (c - a): positive if a, b, c turn
+**              counterclockwise
+*******************************************************************************/
+static double Cross (const double *a, const double *b, const double *c)
+{
+  return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+/*******************************************************************************
+** Routine:     ConvexHull
+**
+** Description: Compute the convex hull of a cluster (monotone chain). Points
+**              inside the quadrilateral formed by the extreme points cannot
+**              be on the hull, and are discarded before sorting.
+*******************************************************************************/
+static void ConvexHull (
+  const double        *x,
+  const double        *y,
+  const long          *members,
+  long                n_members,
+  cluster_hull_struct *hull)
+{
+  double *points, *chain;
+  double quad[4][2];
+  long   i, n, m, lower;
+  long   extreme[4] = {0, 0, 0, 0};   /* Min X, min Y, max X, max Y */
+  int    j, inside;
+
+  /* Extreme points, counterclockwise */
+  for (i=1; i<n_members; i++) {
+    if (x[members[i]] < x[members[extreme[0]]]) extreme[0] = i;
+    if (y[members[i]] < y[members[extreme[1]]]) extreme[1] = i;
+    if (x[members[i]] > x[members[extreme[2]]]) extreme[2] = i;
+    if (y[members[i]] > y[members[extreme[3]]]) extreme[3] = i;
+  }
+  for (j=0; j<4; j++) {
+    quad[j][0] = x[members[extreme[j]]];
+    quad[j][1] = y[members[extreme[j]]];
+  }
+
+  /* Keep the points on or outside the quadrilateral */
+  points = malloc (n_members * 2 * sizeof(double));
+  n = 0;
+  for (i=0; i<n_members; i++) {
+    double p[2];
+    p[0] = x[members[i]];
+    p[1] = y[members[i]];
+    inside = 1;
+    for (j=0; j<4; j++)
+      inside = inside && Cross (quad[j], quad[(j+1)%4], p) > 0;
+    if (!inside) {
+      points[2*n] = p[0];
+      points[2*n+1] = p[1];
+      n++;
+    }
+  }
+  qsort (points, n, 2 * sizeof(double), CompareXY);
+
+  /* Remove duplicates */
+  m = 0;
+  for (i=0; i<n; i++)
+    if (m == 0 || points[2*i] != points[2*(m-1)] || points[2*i+1] != points[2*(m-1)+1]) {
+      points[2*m] = points[2*i];
+      points[2*m+1] = points[2*i+1];
+      m++;
+    }
+  n = m;
+
+  /* Lower chain from left to right, then upper chain from right to left */
+  chain = malloc ((2*n + 1) * 2 * sizeof(double));
+  m = 0;
+  for (i=0; i<n; i++) {
+    while (m >= 2 && Cross (chain + 2*(m-2), chain + 2*(m-1), points + 2*i) <= 0)
+      m--;
+    chain[2*m] = points[2*i];
+    chain[2*m+1] = points[2*i+1];
+    m++;
+  }
+  lower = m + 1;
+  for (i=n-2; i>=0; i--) {
+    while (m >= lower && Cross (chain + 2*(m-2), chain + 2*(m-1), points + 2*i) <= 0)
+      m--;
+    chain[2*m] = points[2*i];
+    chain[2*m+1] = points[2*i+1];
+    m++;
+  }
+  /* A single point is not repeated. For collinear points, the upper chain
+     comes back to the start: keep only the segment */
+  if (n == 1)
+    m = 1;
+  else if (m == 3)
+    m = 2;
+
+  hull->n_points = (int) m;
+  hull->x = malloc (m * sizeof(double));
+  hull->y = malloc (m * sizeof(double));
+  for (i=0; i<m; i++) {
+    hull->x[i] = chain[2*i];
+    hull->y[i] = chain[2*i+1];
+  }
+  free (points);
+  free (chain);
+}
+
+static void *ComputeHulls (void *argument)
+{
+  hull_job_struct *job = (hull_job_struct *) argument;
+  int c;
+
+  /* Clusters are dealt out in turn, to balance large and small ones */
+  for (c=job->thread; c<job->n_clusters; c+=job->n_threads) {
+    job->hulls[c].cluster = c + 1;
+    job->hulls[c].n_members = job->start[c+1] - job->start[c];
+    job->hulls[c].n_points = 0;
+    job->hulls[c].x = job->hulls[c].y = NULL;
+    if (job->hulls[c].n_members > 0)
+      ConvexHull (job->x, job->y, job->members + job->start[c],
+        job->hulls[c].n_members, &job->hulls[c]);
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     ClusterHulls
+**
+** Description: Compute the convex hull of each cluster (1 to n_clusters).
+**              Noise points are ignored.
+*******************************************************************************/
+cluster_hull_struct *ClusterHulls (
+  const double *x,
+  const double *y,
+  long         n_points,
+  const int    *cluster,
+  int          n_clusters,
+  int          n_threads)
+{
+  hull_job_struct     jobs[CLUSTER_MAX_THREADS];
+  cluster_hull_struct *hulls;
+  long                *members, *start, *next;
+  long                i;
+  int                 c, t;
+
+  n_threads = CheckThreads (n_threads);
+  if (n_threads > n_clusters)
+    n_threads = n_clusters > 0 ? n_clusters : 1;
+
+  /* Group the points by cluster */
+  start = calloc (n_clusters + 2, sizeof(long));
+  next = malloc ((n_clusters + 1) * sizeof(long));
+  members = malloc ((n_points > 0 ? n_points : 1) * sizeof(long));
+  for (i=0; i<n_points; i++)
+    if (cluster[i] > 0)
+      start[cluster[i]]++;
+  for (c=0; c<n_clusters; c++)
+    start[c+1] += start[c];
+  for (c=0; c<=n_clusters; c++)
+    next[c] = start[c];
+  for (i=0; i<n_points; i++)
+    if (cluster[i] > 0)
+      members[next[cluster[i]-1]++] = i;
+
+  hulls = calloc (n_clusters > 0 ? n_clusters : 1, sizeof(cluster_hull_struct));
+  for (t=0; t<n_threads; t++) {
+    jobs[t].x = x;
+    jobs[t].y = y;
+    jobs[t].members = members;
+    jobs[t].start = start;
+    jobs[t].hulls = hulls;
+    jobs[t].n_clusters = n_clusters;
+    jobs[t].thread = t;
+    jobs[t].n_threads = n_threads;
+  }
+  RunJobs (ComputeHulls, jobs, sizeof(hull_job_struct), n_threads);
+
+  free (start);
+  free (next);
+  free (members);
+  return hulls;
+}
+
+/*******************************************************************************
+** Routine:     FreeClusterHulls
+**
+** Description: Free the hulls returned by ClusterHulls
+*******************************************************************************/
+void FreeClusterHulls (
+  cluster_hull_struct *hulls,
+  int                 n_clusters)
+{
+  int c;
+
+  for (c=0; c<n_clusters; c++) {
+    free (hulls[c].x);
+    free (hulls[c].y);
+  }
+  free (hulls);
+}
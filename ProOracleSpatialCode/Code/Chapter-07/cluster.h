@@ -0,0 +1,60 @@
+/* cluster.h
+
+   Client-side clustering of points.
+
+   This is the client-side counterpart of SDO_SAM.SPATIAL_CLUSTERS (see
+   appendix A). It works on the X and Y arrays of a set of points held in
+   memory, typically a point dump written by read_points_array.c, and assigns
+   a cluster number to each point. Two methods are available:
+
+   - KMeansClusters partitions the points into k clusters around k centers
+     (k-means). The centers are seeded with k-means++ on a sample of the
+     points. Each iteration then either assigns all points to their nearest
+     center and moves the centers to the mean of their points (Lloyd), or, if
+     a mini-batch size is given, moves the centers towards a random sample of
+     that many points (mini-batch k-means, much faster on large sets at the
+     cost of slightly less compact clusters).
+
+   - DbscanClusters groups the points that have at least min_points points
+     within distance eps (core points) with the points within eps of them
+     (DBSCAN). Points that are not within eps of any core point are noise.
+     The points are bucketed in a grid of cells of side eps / sqrt(2), so
+     that all points of a cell are within eps of each other: a cell with
+     min_points points only contains core points, and the clusters are
+     formed by linking cells rather than points.
+
+   Cluster numbers start at 1. Noise points get cluster number 0.
+
+   ClusterHulls computes the convex hull of each cluster.
+
+   All three use the given number of threads.
+
+*/
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#define CLUSTER_MAX_THREADS 64
+
+/* The convex hull of a cluster, counterclockwise and closed (the first point
+   is repeated at the end). Hulls of one or two distinct points, or of
+   collinear points, are not closed: they are a point or a segment. */
+struct cluster_hull
+{
+    int    cluster;
+    long   n_members;                 /* Points in the cluster */
+    int    n_points;                  /* Points of the hull */
+    double *x;
+    double *y;
+};
+typedef struct cluster_hull cluster_hull_struct;
+
+int  KMeansClusters (const double *x, const double *y, long n_points, int k,
+                     int max_iterations, int mini_batch_size, int n_threads,
+                     int *cluster, double *center_x, double *center_y);
+int  DbscanClusters (const double *x, const double *y, long n_points, double eps,
+                     int min_points, int n_threads, int *cluster);
+cluster_hull_struct *ClusterHulls (const double *x, const double *y, long n_points,
+                                   const int *cluster, int n_clusters, int n_threads);
+void FreeClusterHulls (cluster_hull_struct *hulls, int n_clusters);
+
+#endif
@@ -0,0 +1,1539 @@
+/* contraction_hierarchy.c
+
+   Building, storing and querying contraction hierarchies. See
+   contraction_hierarchy.h for a description of the method and of the file
+   format.
+
+   During the contraction the remaining network is held as a list of
+   incoming and outgoing arcs per node, which grow as shortcuts are added.
+   When a node is contracted, its arcs are removed from the lists of its
+   neighbours but kept in its own lists: they then hold exactly its arcs to
+   the nodes contracted later, and are packed into the upward and downward
+   arcs of the hierarchy at the end.
+
+   Each round of the contraction has three parallel phases (priorities of
+   the nodes whose neighbourhood changed, selection of the nodes to
+   contract, shortcuts of the selected nodes), then the shortcuts are added
+   by the calling thread. The selected nodes are never neighbours, and the
+   witness searches avoid them all, so that the shortcuts found for each of
+   them stay valid when they are contracted together.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "contraction_hierarchy.h"
+#include "spatial_util.h"
+
+#define HIERARCHY_WITNESS_LIMIT 500   /* Nodes settled by a witness search */
+#define HIERARCHY_ESTIMATE_LIMIT 10   /* Same, when estimating priorities */
+#define HIERARCHY_CHUNK_SIZE 256      /* Nodes handed to a thread at a time */
+#define HIERARCHY_N_ARRAYS 15
+#define CONVERT_BUFFER_SIZE 1024
+
+#define PHASE_PRIORITIES 1
+#define PHASE_SELECT 2
+#define PHASE_SHORTCUTS 3
+#define PHASE_BACKWARD 4
+#define PHASE_FORWARD 5
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* An arc or shortcut of the remaining network */
+struct hierarchy_arc
+{
+    long   other;                     /* Node at the other end */
+    double cost;
+    long   middle;                    /* Node bypassed by a shortcut, or -1 */
+    long   link;                      /* Id of the link of an arc, or -1 */
+};
+typedef struct hierarchy_arc hierarchy_arc_struct;
+
+/* The incoming or outgoing arcs of a node */
+struct arc_list
+{
+    int                  n;
+    int                  size;
+    hierarchy_arc_struct *arcs;
+};
+typedef struct arc_list arc_list_struct;
+
+/* A shortcut found by a thread, added after the round */
+struct shortcut
+{
+    long   tail;
+    long   head;
+    double cost;
+    long   middle;
+};
+typedef struct shortcut shortcut_struct;
+
+/* Work space of the witness searches of a thread */
+struct witness_search
+{
+    unsigned int       round;
+    unsigned int       *stamp;
+    double             *cost;
+    unsigned int       *target;       /* Stamp of the nodes to reach */
+    route_queue_struct queue;
+};
+typedef struct witness_search witness_search_struct;
+
+/* State of a contraction, shared by all threads */
+struct contraction
+{
+    long            n_nodes;
+    arc_list_struct *out;
+    arc_list_struct *in;
+    char            *state;           /* 0 remaining, 1 contracted this round, 2 contracted */
+    char            *dirty;           /* Priority must be computed again */
+    long            *priority;
+    long            *level;           /* Depth in the hierarchy */
+    long            *deleted;         /* Neighbours already contracted */
+    long            *remaining;       /* Nodes not contracted yet */
+    long            n_remaining;
+    char            *selected;        /* Selected for this round (by position in remaining) */
+};
+typedef struct contraction contraction_struct;
+
+/* The work of one thread during a contraction */
+struct contraction_job
+{
+    contraction_struct    *contraction;
+    int                   thread;
+    int                   n_threads;
+    int                   phase;
+    witness_search_struct witness;
+    long                  n_shortcuts;
+    long                  size;
+    shortcut_struct       *shortcuts;
+};
+typedef struct contraction_job contraction_job_struct;
+
+/* The nodes settled by a search */
+struct settled_list
+{
+    long n;
+    long size;
+    long *node;
+};
+typedef struct settled_list settled_list_struct;
+
+/* A cost from a node to a target, left by a backward search */
+struct bucket_entry
+{
+    long   node;
+    long   target;
+    double cost;
+};
+typedef struct bucket_entry bucket_entry_struct;
+
+/* The work of one thread during a distance matrix computation */
+struct matrix_job
+{
+    const contraction_hierarchy_struct *hierarchy;
+    int                 thread;
+    int                 n_threads;
+    int                 phase;
+    const long          *nodes;       /* Sources or targets */
+    long                n_nodes;
+    long                n_targets;
+    const long          *bucket_first;
+    const long          *bucket_target;
+    const double        *bucket_cost;
+    double              *matrix;
+    long                n_entries;    /* Entries left by the backward searches */
+    long                size;
+    bucket_entry_struct *entries;
+};
+typedef struct matrix_job matrix_job_struct;
+
+/* A path being expanded */
+struct path_builder
+{
+    long n;
+    long size;
+    long *node_id;
+    long *link_id;                    /* Link leading to each node */
+};
+typedef struct path_builder path_builder_struct;
+
+/*******************************************************************************
+** Routine:     HostIsLittleEndian
+**
+** Description: Tell if the host stores numbers in little-endian byte order
+*******************************************************************************/
+static int HostIsLittleEndian (void)
+{
+  unsigned int one = 1;
+  return *(unsigned char *)&one == 1;
+}
+
+/*******************************************************************************
+** Routine:     PutUInt64 / GetUInt64
+**
+** Description: Store and load a 64-bit value in little-endian byte order
+*******************************************************************************/
+static void PutUInt64 (unsigned char *p, uint64_t value)
+{
+  int i;
+  for (i=0; i<8; i++)
+    p[i] = (unsigned char) (value >> (8*i));
+}
+
+static uint64_t GetUInt64 (const unsigned char *p)
+{
+  uint64_t value = 0;
+  int i;
+  for (i=7; i>=0; i--)
+    value = (value << 8) | p[i];
+  return value;
+}
+
+static void PutUInt32 (unsigned char *p, uint32_t value)
+{
+  int i;
+  for (i=0; i<4; i++)
+    p[i] = (unsigned char) (value >> (8*i));
+}
+
+static uint32_t GetUInt32 (const unsigned char *p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/*******************************************************************************
+** Routine:     WriteValues
+**
+** Description: Write an array of 64-bit values in little-endian byte order
+*******************************************************************************/
+static void WriteValues (FILE *file, const void *values, int64_t n_values)
+{
+  unsigned char buffer[CONVERT_BUFFER_SIZE * 8];
+  uint64_t      bits;
+  int64_t       i, n;
+
+  if (HostIsLittleEndian ()) {
+    fwrite (values, 8, (size_t) n_values, file);
+    return;
+  }
+  while (n_values > 0) {
+    n = n_values < CONVERT_BUFFER_SIZE ? n_values : CONVERT_BUFFER_SIZE;
+    for (i=0; i<n; i++) {
+      memcpy (&bits, (const unsigned char *)values + 8*i, 8);
+      PutUInt64 (buffer + 8*i, bits);
+    }
+    fwrite (buffer, 8, (size_t) n, file);
+    values = (const unsigned char *)values + 8*n;
+    n_values -= n;
+  }
+}
+
+/*******************************************************************************
+** Routine:     QueuePush
+**
+** Description: Add a node to a queue. A node may be in the queue several
+**              times: the entries with an outdated key are skipped when they
+**              come out.
+*******************************************************************************/
+static void QueuePush (route_queue_struct *queue, double key, long node)
+{
+  long i, parent;
+
+  if (queue->n == queue->size) {
+    queue->size *= 2;
+    queue->key = realloc (queue->key, queue->size * sizeof(double));
+    queue->node = realloc (queue->node, queue->size * sizeof(long));
+  }
+  for (i=queue->n++; i>0; i=parent) {
+    parent = (i - 1) / 2;
+    if (queue->key[parent] <= key)
+      break;
+    queue->key[i] = queue->key[parent];
+    queue->node[i] = queue->node[parent];
+  }
+  queue->key[i] = key;
+  queue->node[i] = node;
+}
+
+/*******************************************************************************
+** Routine:     QueuePop
+**
+** Description: Remove the node with the lowest key from a queue
+*******************************************************************************/
+static long QueuePop (route_queue_struct *queue)
+{
+  long   node = queue->node[0], i, child, n, last_node;
+  double last_key;
+
+  n = --queue->n;
+  last_key = queue->key[n];
+  last_node = queue->node[n];
+  for (i=0; (child = 2*i + 1) < n; i=child) {
+    if (child + 1 < n && queue->key[child+1] < queue->key[child])
+      child++;
+    if (queue->key[child] >= last_key)
+      break;
+    queue->key[i] = queue->key[child];
+    queue->node[i] = queue->node[child];
+  }
+  queue->key[i] = last_key;
+  queue->node[i] = last_node;
+  return node;
+}
+
+/*******************************************************************************
+** Routine:     InitQueue / FreeQueue
+**
+** Description: Allocate and free the arrays of a queue
+*******************************************************************************/
+static void InitQueue (route_queue_struct *queue)
+{
+  queue->n = 0;
+  queue->size = 1024;
+  queue->key = malloc (queue->size * sizeof(double));
+  queue->node = malloc (queue->size * sizeof(long));
+}
+
+static void FreeQueue (route_queue_struct *queue)
+{
+  free (queue->key);
+  free (queue->node);
+}
+
+/*******************************************************************************
+** Routine:     AddArc
+**
+** Description: Add an arc to a list. If the list already has an arc to the
+**              same node, only the cheaper of the two is kept.
+*******************************************************************************/
+static void AddArc (arc_list_struct *list, long other, double cost, long middle, long link)
+{
+  hierarchy_arc_struct *arc;
+  int i;
+
+  for (i=0; i<list->n; i++)
+    if (list->arcs[i].other == other) {
+      if (cost < list->arcs[i].cost) {
+        list->arcs[i].cost = cost;
+        list->arcs[i].middle = middle;
+        list->arcs[i].link = link;
+      }
+      return;
+    }
+  if (list->n == list->size) {
+    list->size = list->size > 0 ? 2 * list->size : 4;
+    list->arcs = realloc (list->arcs, list->size * sizeof(hierarchy_arc_struct));
+  }
+  arc = &list->arcs[list->n++];
+  arc->other = other;
+  arc->cost = cost;
+  arc->middle = middle;
+  arc->link = link;
+}
+
+/*******************************************************************************
+** Routine:     RemoveArc
+**
+** Description: Remove the arc to a node from a list
+*******************************************************************************/
+static void RemoveArc (arc_list_struct *list, long other)
+{
+  int i;
+
+  for (i=0; i<list->n; i++)
+    if (list->arcs[i].other == other) {
+      list->arcs[i] = list->arcs[--list->n];
+      return;
+    }
+}
+
+/*******************************************************************************
+** Routine:     WitnessCost
+**
+** Description: Cost of a node in the last witness search
+*******************************************************************************/
+static double WitnessCost (const witness_search_struct *witness, long node)
+{
+  return witness->stamp[node] == witness->round ? witness->cost[node] : HUGE_VAL;
+}
+
+/*******************************************************************************
+** Routine:     WitnessSearch
+**
+** Description: Dijkstra's algorithm from a node through the remaining
+**              network, avoiding a node and the nodes contracted this round.
+**              It stops when the targets are settled, or beyond a cost or a
+**              number of settled nodes.
+*******************************************************************************/
+static void WitnessSearch (
+  const contraction_struct *contraction,
+  witness_search_struct    *witness,
+  long                     source,
+  long                     excluded,
+  int                      n_targets,
+  double                   max_cost,
+  long                     limit)
+{
+  const arc_list_struct *list;
+  double key, cost;
+  long   u, v, n_settled = 0;
+  int    i;
+
+  witness->queue.n = 0;
+  witness->stamp[source] = witness->round;
+  witness->cost[source] = 0;
+  QueuePush (&witness->queue, 0, source);
+
+  while (witness->queue.n > 0 && n_targets > 0) {
+    key = witness->queue.key[0];
+    if (key > max_cost)
+      break;
+    u = QueuePop (&witness->queue);
+    if (key > witness->cost[u])
+      continue;
+    if (witness->target[u] == witness->round)
+      n_targets--;
+    if (++n_settled > limit)
+      break;
+    list = &contraction->out[u];
+    for (i=0; i<list->n; i++) {
+      v = list->arcs[i].other;
+      if (v == excluded || contraction->state[v] != 0)
+        continue;
+      cost = key + list->arcs[i].cost;
+      if (cost < WitnessCost (witness, v)) {
+        witness->stamp[v] = witness->round;
+        witness->cost[v] = cost;
+        QueuePush (&witness->queue, cost, v);
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     ContractNode
+**
+** Description: Find the shortcuts needed to contract a node. They are added
+**              to the job if shortcuts is not 0, and only counted otherwise.
+*******************************************************************************/
+static long ContractNode (
+  contraction_job_struct *job,
+  long                   node,
+  long                   limit,
+  int                    shortcuts)
+{
+  const contraction_struct *contraction = job->contraction;
+  const arc_list_struct    *in = &contraction->in[node];
+  const arc_list_struct    *out = &contraction->out[node];
+  shortcut_struct          *shortcut;
+  double max_cost, cost;
+  long   x, y, n = 0;
+  int    i, j, n_targets;
+
+  for (i=0; i<in->n; i++) {
+    x = in->arcs[i].other;
+
+    /* Start a new search: the labels and targets of the last one expire */
+    if (++job->witness.round == 0) {
+      memset (job->witness.stamp, 0, contraction->n_nodes * sizeof(unsigned int));
+      memset (job->witness.target, 0, contraction->n_nodes * sizeof(unsigned int));
+      job->witness.round = 1;
+    }
+
+    /* Longest path through the node from x, and the nodes it reaches */
+    max_cost = -1;
+    n_targets = 0;
+    for (j=0; j<out->n; j++)
+      if (out->arcs[j].other != x) {
+        job->witness.target[out->arcs[j].other] = job->witness.round;
+        n_targets++;
+        if (in->arcs[i].cost + out->arcs[j].cost > max_cost)
+          max_cost = in->arcs[i].cost + out->arcs[j].cost;
+      }
+    if (n_targets == 0)
+      continue;
+
+    /* Add a shortcut for each path without a witness */
+    WitnessSearch (contraction, &job->witness, x, node, n_targets, max_cost, limit);
+    for (j=0; j<out->n; j++) {
+      y = out->arcs[j].other;
+      cost = in->arcs[i].cost + out->arcs[j].cost;
+      if (y == x || WitnessCost (&job->witness, y) <= cost)
+        continue;
+      n++;
+      if (shortcuts) {
+        if (job->n_shortcuts == job->size) {
+          job->size = job->size > 0 ? 2 * job->size : 1024;
+          job->shortcuts = realloc (job->shortcuts, job->size * sizeof(shortcut_struct));
+        }
+        shortcut = &job->shortcuts[job->n_shortcuts++];
+        shortcut->tail = x;
+        shortcut->head = y;
+        shortcut->cost = cost;
+        shortcut->middle = node;
+      }
+    }
+  }
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     ComesFirst
+**
+** Description: Tell if a node is to be contracted before another: lower
+**              priority first, ties broken by a hash of the node numbers so
+**              that neighbouring nodes do not depend on each other in chains
+*******************************************************************************/
+static int ComesFirst (const contraction_struct *contraction, long a, long b)
+{
+  unsigned long ha, hb;
+
+  if (contraction->priority[a] != contraction->priority[b])
+    return contraction->priority[a] < contraction->priority[b];
+  ha = ((unsigned long) a * 2654435761UL) & 0xffffffffUL;
+  hb = ((unsigned long) b * 2654435761UL) & 0xffffffffUL;
+  return ha != hb ? ha < hb : a < b;
+}
+
+/*******************************************************************************
+** Routine:     ContractionWorker
+**
+** Description: Thread routine: run one phase of a round on the chunks of the
+**              remaining nodes assigned to the thread
+*******************************************************************************/
+static void *ContractionWorker (void *argument)
+{
+  contraction_job_struct *job = (contraction_job_struct *) argument;
+  contraction_struct     *contraction = job->contraction;
+  const arc_list_struct  *list;
+  long   chunk, i, end, u, n_shortcuts;
+  int    j, d, first;
+
+  for (chunk=(long)job->thread*HIERARCHY_CHUNK_SIZE; chunk<contraction->n_remaining;
+       chunk+=(long)job->n_threads*HIERARCHY_CHUNK_SIZE) {
+    end = chunk + HIERARCHY_CHUNK_SIZE < contraction->n_remaining ?
+      chunk + HIERARCHY_CHUNK_SIZE : contraction->n_remaining;
+    for (i=chunk; i<end; i++) {
+      u = contraction->remaining[i];
+      switch (job->phase) {
+
+        case PHASE_PRIORITIES:
+          if (!contraction->dirty[u])
+            break;
+          n_shortcuts = ContractNode (job, u, HIERARCHY_ESTIMATE_LIMIT, 0);
+          contraction->priority[u] = 2 * (n_shortcuts - contraction->in[u].n - contraction->out[u].n)
+            + contraction->deleted[u] + contraction->level[u];
+          contraction->dirty[u] = 0;
+          break;
+
+        case PHASE_SELECT:
+          first = 1;
+          for (d=0; d<2 && first; d++) {
+            list = d == 0 ? &contraction->out[u] : &contraction->in[u];
+            for (j=0; j<list->n && first; j++)
+              first = ComesFirst (contraction, u, list->arcs[j].other);
+          }
+          contraction->selected[i] = (char) first;
+          break;
+
+        case PHASE_SHORTCUTS:
+          if (contraction->selected[i])
+            ContractNode (job, u, HIERARCHY_WITNESS_LIMIT, 1);
+          break;
+      }
+    }
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     ApplyRound
+**
+** Description: Add the shortcuts found by all threads, and remove the
+**              selected nodes from the remaining network
+*******************************************************************************/
+static long ApplyRound (
+  contraction_struct     *contraction,
+  contraction_job_struct *jobs,
+  int                    n_threads)
+{
+  shortcut_struct *shortcut;
+  arc_list_struct *list;
+  long   i, u, v, n_remaining, n_shortcuts = 0;
+  int    t, j, d;
+
+  for (t=0; t<n_threads; t++) {
+    for (i=0; i<jobs[t].n_shortcuts; i++) {
+      shortcut = &jobs[t].shortcuts[i];
+      AddArc (&contraction->out[shortcut->tail], shortcut->head, shortcut->cost, shortcut->middle, -1);
+      AddArc (&contraction->in[shortcut->head], shortcut->tail, shortcut->cost, shortcut->middle, -1);
+    }
+    n_shortcuts += jobs[t].n_shortcuts;
+    jobs[t].n_shortcuts = 0;
+  }
+
+  n_remaining = 0;
+  for (i=0; i<contraction->n_remaining; i++) {
+    u = contraction->remaining[i];
+    if (!contraction->selected[i]) {
+      contraction->remaining[n_remaining++] = u;
+      continue;
+    }
+    contraction->state[u] = 2;
+    for (d=0; d<2; d++) {
+      list = d == 0 ? &contraction->out[u] : &contraction->in[u];
+      for (j=0; j<list->n; j++) {
+        v = list->arcs[j].other;
+        RemoveArc (d == 0 ? &contraction->in[v] : &contraction->out[v], u);
+        contraction->dirty[v] = 1;
+        contraction->deleted[v]++;
+        if (contraction->level[v] < contraction->level[u] + 1)
+          contraction->level[v] = contraction->level[u] + 1;
+      }
+    }
+  }
+  contraction->n_remaining = n_remaining;
+  return n_shortcuts;
+}
+
+/*******************************************************************************
+** Routine:     PackArcs
+**
+** Description: Copy the final arc lists of the nodes into the upward or
+**              downward arrays of the hierarchy
+*******************************************************************************/
+static void PackArcs (
+  const contraction_struct *contraction,
+  int                      d,
+  int64_t                  **first,
+  int64_t                  **other,
+  double                   **cost,
+  int64_t                  **middle,
+  int64_t                  **link)
+{
+  const arc_list_struct *list;
+  long   n = contraction->n_nodes, u, a;
+  int    j;
+
+  *first = malloc ((n + 1) * sizeof(int64_t));
+  (*first)[0] = 0;
+  for (u=0; u<n; u++)
+    (*first)[u+1] = (*first)[u] + (d == 0 ? contraction->out[u].n : contraction->in[u].n);
+  a = (long) (*first)[n];
+  *other = malloc ((a > 0 ? a : 1) * sizeof(int64_t));
+  *cost = malloc ((a > 0 ? a : 1) * sizeof(double));
+  *middle = malloc ((a > 0 ? a : 1) * sizeof(int64_t));
+  *link = malloc ((a > 0 ? a : 1) * sizeof(int64_t));
+  for (u=0; u<n; u++) {
+    list = d == 0 ? &contraction->out[u] : &contraction->in[u];
+    a = (long) (*first)[u];
+    for (j=0; j<list->n; j++, a++) {
+      (*other)[a] = list->arcs[j].other;
+      (*cost)[a] = list->arcs[j].cost;
+      (*middle)[a] = list->arcs[j].middle;
+      (*link)[a] = list->arcs[j].link;
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     BuildHierarchy
+**
+** Description: Contract a network into a hierarchy, with n_threads threads
+*******************************************************************************/
+void BuildHierarchy (
+  const road_network_struct    *network,
+  int                          n_threads,
+  contraction_hierarchy_struct *hierarchy,
+  hierarchy_stats_struct       *stats)
+{
+  contraction_struct     contraction;
+  contraction_job_struct jobs[HIERARCHY_MAX_THREADS];
+  int64_t *node_id, *sorted_id, *sorted_node;
+  int64_t *first_up, *up_head, *up_middle, *up_link;
+  int64_t *first_down, *down_tail, *down_middle, *down_link;
+  double  *x, *y, *up_cost, *down_cost;
+  long    n = network->n_nodes, u, a, i;
+  int     t, phase;
+
+  memset (hierarchy, 0, sizeof(contraction_hierarchy_struct));
+  stats->n_rounds = 0;
+  stats->n_shortcuts = 0;
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > HIERARCHY_MAX_THREADS)
+    n_threads = HIERARCHY_MAX_THREADS;
+  stats->n_threads = n_threads;
+
+  /* Copy the arcs of the network, keeping the cheapest of parallel arcs */
+  contraction.n_nodes = n;
+  contraction.out = calloc (n, sizeof(arc_list_struct));
+  contraction.in = calloc (n, sizeof(arc_list_struct));
+  for (u=0; u<n; u++)
+    for (a=network->first_out[u]; a<network->first_out[u+1]; a++)
+      if (network->out_head[a] != u) {
+        AddArc (&contraction.out[u], network->out_head[a], network->out_cost[a], -1, network->out_link[a]);
+        AddArc (&contraction.in[network->out_head[a]], u, network->out_cost[a], -1, network->out_link[a]);
+      }
+  contraction.state = calloc (n, 1);
+  contraction.dirty = malloc (n);
+  memset (contraction.dirty, 1, n);
+  contraction.priority = calloc (n, sizeof(long));
+  contraction.level = calloc (n, sizeof(long));
+  contraction.deleted = calloc (n, sizeof(long));
+  contraction.remaining = malloc (n * sizeof(long));
+  contraction.selected = malloc (n);
+  for (u=0; u<n; u++)
+    contraction.remaining[u] = u;
+  contraction.n_remaining = n;
+
+  for (t=0; t<n_threads; t++) {
+    jobs[t].contraction = &contraction;
+    jobs[t].thread = t;
+    jobs[t].n_threads = n_threads;
+    jobs[t].witness.round = 0;
+    jobs[t].witness.stamp = calloc (n, sizeof(unsigned int));
+    jobs[t].witness.cost = malloc (n * sizeof(double));
+    jobs[t].witness.target = calloc (n, sizeof(unsigned int));
+    InitQueue (&jobs[t].witness.queue);
+    jobs[t].n_shortcuts = 0;
+    jobs[t].size = 0;
+    jobs[t].shortcuts = NULL;
+  }
+
+  /* Contract the nodes, round after round */
+  while (contraction.n_remaining > 0) {
+    for (phase=PHASE_PRIORITIES; phase<=PHASE_SHORTCUTS; phase++) {
+      for (t=0; t<n_threads; t++)
+        jobs[t].phase = phase;
+      RunJobs (ContractionWorker, jobs, sizeof(contraction_job_struct), n_threads);
+
+      /* The witness searches of the shortcut phase avoid all selected nodes */
+      if (phase == PHASE_SELECT)
+        for (i=0; i<contraction.n_remaining; i++)
+          if (contraction.selected[i])
+            contraction.state[contraction.remaining[i]] = 1;
+    }
+    stats->n_shortcuts += ApplyRound (&contraction, jobs, n_threads);
+    stats->n_rounds++;
+  }
+
+  /* Pack the arcs of each node to the nodes contracted after it */
+  PackArcs (&contraction, 0, &first_up, &up_head, &up_cost, &up_middle, &up_link);
+  PackArcs (&contraction, 1, &first_down, &down_tail, &down_cost, &down_middle, &down_link);
+
+  node_id = malloc (n * sizeof(int64_t));
+  sorted_id = malloc (n * sizeof(int64_t));
+  sorted_node = malloc (n * sizeof(int64_t));
+  x = malloc (n * sizeof(double));
+  y = malloc (n * sizeof(double));
+  for (u=0; u<n; u++) {
+    node_id[u] = network->node_id[u];
+    sorted_id[u] = network->sorted_id[u];
+    sorted_node[u] = network->sorted_node[u];
+    x[u] = network->x[u];
+    y[u] = network->y[u];
+  }
+
+  hierarchy->n_nodes = n;
+  hierarchy->n_up = first_up[n];
+  hierarchy->n_down = first_down[n];
+  hierarchy->n_shortcuts = stats->n_shortcuts;
+  hierarchy->geodetic = network->geodetic;
+  hierarchy->node_id = node_id;
+  hierarchy->x = x;
+  hierarchy->y = y;
+  hierarchy->sorted_id = sorted_id;
+  hierarchy->sorted_node = sorted_node;
+  hierarchy->first_up = first_up;
+  hierarchy->up_head = up_head;
+  hierarchy->up_cost = up_cost;
+  hierarchy->up_middle = up_middle;
+  hierarchy->up_link = up_link;
+  hierarchy->first_down = first_down;
+  hierarchy->down_tail = down_tail;
+  hierarchy->down_cost = down_cost;
+  hierarchy->down_middle = down_middle;
+  hierarchy->down_link = down_link;
+
+  for (t=0; t<n_threads; t++) {
+    free (jobs[t].witness.stamp);
+    free (jobs[t].witness.cost);
+    free (jobs[t].witness.target);
+    FreeQueue (&jobs[t].witness.queue);
+    free (jobs[t].shortcuts);
+  }
+  for (u=0; u<n; u++) {
+    free (contraction.out[u].arcs);
+    free (contraction.in[u].arcs);
+  }
+  free (contraction.out);
+  free (contraction.in);
+  free (contraction.state);
+  free (contraction.dirty);
+  free (contraction.priority);
+  free (contraction.level);
+  free (contraction.deleted);
+  free (contraction.remaining);
+  free (contraction.selected);
+}
+
+/*******************************************************************************
+** Routine:     HierarchyArrays
+**
+** Description: The arrays of a hierarchy, in the order of the file, with
+**              their number of values
+*******************************************************************************/
+static void HierarchyArrays (
+  const contraction_hierarchy_struct *hierarchy,
+  const void                         **arrays,
+  int64_t                            *lengths)
+{
+  int64_t n = hierarchy->n_nodes;
+  int     i;
+
+  arrays[0] = hierarchy->node_id;
+  arrays[1] = hierarchy->x;
+  arrays[2] = hierarchy->y;
+  arrays[3] = hierarchy->sorted_id;
+  arrays[4] = hierarchy->sorted_node;
+  arrays[5] = hierarchy->first_up;
+  arrays[6] = hierarchy->up_head;
+  arrays[7] = hierarchy->up_cost;
+  arrays[8] = hierarchy->up_middle;
+  arrays[9] = hierarchy->up_link;
+  arrays[10] = hierarchy->first_down;
+  arrays[11] = hierarchy->down_tail;
+  arrays[12] = hierarchy->down_cost;
+  arrays[13] = hierarchy->down_middle;
+  arrays[14] = hierarchy->down_link;
+  for (i=0; i<5; i++)
+    lengths[i] = n;
+  lengths[5] = lengths[10] = n + 1;
+  for (i=6; i<10; i++)
+    lengths[i] = hierarchy->n_up;
+  for (i=11; i<15; i++)
+    lengths[i] = hierarchy->n_down;
+}
+
+/*******************************************************************************
+** Routine:     WriteHierarchy
+**
+** Description: Write a hierarchy to a file. Returns 0 on success, -1 if the
+**              file cannot be written.
+*******************************************************************************/
+int WriteHierarchy (
+  const contraction_hierarchy_struct *hierarchy,
+  const char                         *filename)
+{
+  unsigned char header[HIERARCHY_HEADER_SIZE];
+  const void    *arrays[HIERARCHY_N_ARRAYS];
+  int64_t       lengths[HIERARCHY_N_ARRAYS];
+  uint64_t      offset;
+  FILE          *file;
+  int           i;
+
+  HierarchyArrays (hierarchy, arrays, lengths);
+  memset (header, 0, sizeof(header));
+  memcpy (header, HIERARCHY_MAGIC, 8);
+  PutUInt32 (header + 8, HIERARCHY_VERSION);
+  PutUInt32 (header + 12, hierarchy->geodetic ? HIERARCHY_GEODETIC : 0);
+  PutUInt64 (header + 16, (uint64_t) hierarchy->n_nodes);
+  PutUInt64 (header + 24, (uint64_t) hierarchy->n_up);
+  PutUInt64 (header + 32, (uint64_t) hierarchy->n_down);
+  PutUInt64 (header + 40, (uint64_t) hierarchy->n_shortcuts);
+  offset = HIERARCHY_HEADER_SIZE;
+  for (i=0; i<HIERARCHY_N_ARRAYS; i++) {
+    PutUInt64 (header + 64 + 8*i, offset);
+    offset += 8 * (uint64_t) lengths[i];
+  }
+
+  file = fopen (filename, "wb");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    return -1;
+  }
+  fwrite (header, 1, sizeof(header), file);
+  for (i=0; i<HIERARCHY_N_ARRAYS; i++)
+    WriteValues (file, arrays[i], lengths[i]);
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     OpenHierarchy
+**
+** Description: Map a hierarchy file in memory. Returns 0 on success, -1 if
+**              the file cannot be read or is not a valid hierarchy.
+*******************************************************************************/
+int OpenHierarchy (
+  const char                   *filename,
+  contraction_hierarchy_struct *hierarchy)
+{
+  unsigned char *header;
+  const void    *arrays[HIERARCHY_N_ARRAYS];
+  int64_t       lengths[HIERARCHY_N_ARRAYS];
+  uint64_t      offsets[HIERARCHY_N_ARRAYS];
+  int           i;
+
+  memset (hierarchy, 0, sizeof(contraction_hierarchy_struct));
+
+  /* The arrays are used in place: they must be in the host byte order */
+  if (!HostIsLittleEndian ()) {
+    printf ("Hierarchy files can only be mapped on little-endian hosts\n");
+    return -1;
+  }
+
+#ifdef _WIN32
+  {
+    /* No mmap: read the file into memory */
+    FILE *file = fopen (filename, "rb");
+    long size;
+    if (file == NULL) {
+      printf ("Could not open hierarchy %s\n", filename);
+      return -1;
+    }
+    fseek (file, 0, SEEK_END);
+    size = ftell (file);
+    rewind (file);
+    hierarchy->size = (size_t) size;
+    hierarchy->base = malloc (hierarchy->size > 0 ? hierarchy->size : 1);
+    if (fread (hierarchy->base, 1, hierarchy->size, file) != hierarchy->size) {
+      printf ("Could not read hierarchy %s\n", filename);
+      fclose (file);
+      CloseHierarchy (hierarchy);
+      return -1;
+    }
+    fclose (file);
+  }
+#else
+  {
+    struct stat file_status;
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0 || fstat (fd, &file_status) != 0) {
+      printf ("Could not open hierarchy %s\n", filename);
+      if (fd >= 0)
+        close (fd);
+      return -1;
+    }
+    hierarchy->size = (size_t) file_status.st_size;
+    if (hierarchy->size < HIERARCHY_HEADER_SIZE) {
+      printf ("%s is not a hierarchy file\n", filename);
+      close (fd);
+      return -1;
+    }
+    hierarchy->base = mmap (NULL, hierarchy->size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (hierarchy->base == MAP_FAILED) {
+      printf ("Could not map hierarchy %s\n", filename);
+      hierarchy->base = NULL;
+      return -1;
+    }
+  }
+#endif
+
+  /* Check and decode the header */
+  header = (unsigned char *) hierarchy->base;
+  if (hierarchy->size < HIERARCHY_HEADER_SIZE
+      || memcmp (header, HIERARCHY_MAGIC, 8) != 0
+      || GetUInt32 (header + 8) != HIERARCHY_VERSION) {
+    printf ("%s is not a hierarchy file\n", filename);
+    CloseHierarchy (hierarchy);
+    return -1;
+  }
+  hierarchy->geodetic = (GetUInt32 (header + 12) & HIERARCHY_GEODETIC) != 0;
+  hierarchy->n_nodes = (int64_t) GetUInt64 (header + 16);
+  hierarchy->n_up = (int64_t) GetUInt64 (header + 24);
+  hierarchy->n_down = (int64_t) GetUInt64 (header + 32);
+  hierarchy->n_shortcuts = (int64_t) GetUInt64 (header + 40);
+  HierarchyArrays (hierarchy, arrays, lengths);
+  for (i=0; i<HIERARCHY_N_ARRAYS; i++) {
+    offsets[i] = GetUInt64 (header + 64 + 8*i);
+    if (lengths[i] < 0 || (uint64_t) lengths[i] > hierarchy->size / 8
+        || offsets[i] % 8 != 0 || offsets[i] + 8 * (uint64_t) lengths[i] > hierarchy->size) {
+      printf ("Hierarchy %s is truncated or damaged\n", filename);
+      CloseHierarchy (hierarchy);
+      return -1;
+    }
+  }
+
+  hierarchy->node_id = (const int64_t *) (header + offsets[0]);
+  hierarchy->x = (const double *) (header + offsets[1]);
+  hierarchy->y = (const double *) (header + offsets[2]);
+  hierarchy->sorted_id = (const int64_t *) (header + offsets[3]);
+  hierarchy->sorted_node = (const int64_t *) (header + offsets[4]);
+  hierarchy->first_up = (const int64_t *) (header + offsets[5]);
+  hierarchy->up_head = (const int64_t *) (header + offsets[6]);
+  hierarchy->up_cost = (const double *) (header + offsets[7]);
+  hierarchy->up_middle = (const int64_t *) (header + offsets[8]);
+  hierarchy->up_link = (const int64_t *) (header + offsets[9]);
+  hierarchy->first_down = (const int64_t *) (header + offsets[10]);
+  hierarchy->down_tail = (const int64_t *) (header + offsets[11]);
+  hierarchy->down_cost = (const double *) (header + offsets[12]);
+  hierarchy->down_middle = (const int64_t *) (header + offsets[13]);
+  hierarchy->down_link = (const int64_t *) (header + offsets[14]);
+  if (hierarchy->first_up[hierarchy->n_nodes] != hierarchy->n_up
+      || hierarchy->first_down[hierarchy->n_nodes] != hierarchy->n_down) {
+    printf ("Hierarchy %s is truncated or damaged\n", filename);
+    CloseHierarchy (hierarchy);
+    return -1;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     CloseHierarchy
+**
+** Description: Release a hierarchy, mapped by OpenHierarchy or built by
+**              BuildHierarchy
+*******************************************************************************/
+void CloseHierarchy (
+  contraction_hierarchy_struct *hierarchy)
+{
+  const void *arrays[HIERARCHY_N_ARRAYS];
+  int64_t    lengths[HIERARCHY_N_ARRAYS];
+  int        i;
+
+  if (hierarchy->base != NULL) {
+#ifdef _WIN32
+    free (hierarchy->base);
+#else
+    munmap (hierarchy->base, hierarchy->size);
+#endif
+  }
+  else {
+    HierarchyArrays (hierarchy, arrays, lengths);
+    for (i=0; i<HIERARCHY_N_ARRAYS; i++)
+      free ((void *) arrays[i]);
+  }
+  memset (hierarchy, 0, sizeof(contraction_hierarchy_struct));
+}
+
+/*******************************************************************************
+** Routine:     FindHierarchyNode
+**
+** Description: Node number of a node id, or -1 if there is no such node
+*******************************************************************************/
+long FindHierarchyNode (const contraction_hierarchy_struct *hierarchy, long node_id)
+{
+  long low = 0, high = (long) hierarchy->n_nodes - 1, middle;
+
+  while (low <= high) {
+    middle = low + (high - low) / 2;
+    if (hierarchy->sorted_id[middle] < node_id)
+      low = middle + 1;
+    else if (hierarchy->sorted_id[middle] > node_id)
+      high = middle - 1;
+    else
+      return (long) hierarchy->sorted_node[middle];
+  }
+  return -1;
+}
+
+/*******************************************************************************
+** Routine:     CreateHierarchySearch
+**
+** Description: Allocate the work space of queries on a hierarchy
+*******************************************************************************/
+hierarchy_search_struct *CreateHierarchySearch (const contraction_hierarchy_struct *hierarchy)
+{
+  hierarchy_search_struct *search = malloc (sizeof(hierarchy_search_struct));
+  long n = hierarchy->n_nodes > 0 ? (long) hierarchy->n_nodes : 1;
+  int  d;
+
+  search->n_nodes = n;
+  search->round = 0;
+  for (d=0; d<2; d++) {
+    search->stamp[d] = calloc (n, sizeof(unsigned int));
+    search->cost[d] = malloc (n * sizeof(double));
+    search->parent[d] = malloc (n * sizeof(long));
+    search->parent_arc[d] = malloc (n * sizeof(long));
+    InitQueue (&search->queue[d]);
+  }
+  search->n_settled = 0;
+  return search;
+}
+
+/*******************************************************************************
+** Routine:     FreeHierarchySearch
+**
+** Description: Free the work space of queries
+*******************************************************************************/
+void FreeHierarchySearch (hierarchy_search_struct *search)
+{
+  int d;
+
+  for (d=0; d<2; d++) {
+    free (search->stamp[d]);
+    free (search->cost[d]);
+    free (search->parent[d]);
+    free (search->parent_arc[d]);
+    FreeQueue (&search->queue[d]);
+  }
+  free (search);
+}
+
+/*******************************************************************************
+** Routine:     StartRound
+**
+** Description: Invalidate the labels of the previous query
+*******************************************************************************/
+static void StartRound (hierarchy_search_struct *search)
+{
+  int d;
+
+  if (++search->round == 0) {
+    for (d=0; d<2; d++)
+      memset (search->stamp[d], 0, search->n_nodes * sizeof(unsigned int));
+    search->round = 1;
+  }
+  search->queue[0].n = search->queue[1].n = 0;
+  search->n_settled = 0;
+}
+
+/*******************************************************************************
+** Routine:     Label
+**
+** Description: Cost of a node in one direction of the current query
+*******************************************************************************/
+static double Label (const hierarchy_search_struct *search, int d, long node)
+{
+  return search->stamp[d][node] == search->round ? search->cost[d][node] : HUGE_VAL;
+}
+
+/*******************************************************************************
+** Routine:     Relax
+**
+** Description: Lower the cost of a node if it is reached more cheaply
+*******************************************************************************/
+static void Relax (hierarchy_search_struct *search, int d, long node, double cost,
+                   long parent, long parent_arc)
+{
+  if (cost < Label (search, d, node)) {
+    search->stamp[d][node] = search->round;
+    search->cost[d][node] = cost;
+    search->parent[d][node] = parent;
+    search->parent_arc[d][node] = parent_arc;
+    QueuePush (&search->queue[d], cost, node);
+  }
+}
+
+/*******************************************************************************
+** Routine:     SettleNode
+**
+** Description: Take the next node out of the queue of one direction, and
+**              relax its arcs up the hierarchy. Returns the node, or -1 if
+**              the entry was outdated. Stalled is set if the node is reached
+**              more cheaply from a higher node: its cost is then not final
+**              and its arcs are not relaxed ("stall on demand").
+*******************************************************************************/
+static long SettleNode (
+  const contraction_hierarchy_struct *hierarchy,
+  hierarchy_search_struct            *search,
+  int                                d,
+  int                                *stalled)
+{
+  double key = search->queue[d].key[0], cost;
+  long   u = QueuePop (&search->queue[d]);
+  long   a;
+
+  *stalled = 0;
+  if (key > search->cost[d][u])
+    return -1;
+  search->n_settled++;
+
+  if (d == 0) {
+    for (a=(long)hierarchy->first_down[u]; a<hierarchy->first_down[u+1]; a++)
+      if (Label (search, 0, (long) hierarchy->down_tail[a]) + hierarchy->down_cost[a] < key) {
+        *stalled = 1;
+        return u;
+      }
+    for (a=(long)hierarchy->first_up[u]; a<hierarchy->first_up[u+1]; a++) {
+      cost = key + hierarchy->up_cost[a];
+      Relax (search, 0, (long) hierarchy->up_head[a], cost, u, a);
+    }
+  }
+  else {
+    for (a=(long)hierarchy->first_up[u]; a<hierarchy->first_up[u+1]; a++)
+      if (Label (search, 1, (long) hierarchy->up_head[a]) + hierarchy->up_cost[a] < key) {
+        *stalled = 1;
+        return u;
+      }
+    for (a=(long)hierarchy->first_down[u]; a<hierarchy->first_down[u+1]; a++) {
+      cost = key + hierarchy->down_cost[a];
+      Relax (search, 1, (long) hierarchy->down_tail[a], cost, u, a);
+    }
+  }
+  return u;
+}
+
+/*******************************************************************************
+** Routine:     MeetSearch
+**
+** Description: Search up the hierarchy from both ends. Returns the node
+**              where the searches meet on the path of least cost, or -1 if
+**              the end node cannot be reached.
+*******************************************************************************/
+static long MeetSearch (
+  const contraction_hierarchy_struct *hierarchy,
+  hierarchy_search_struct            *search,
+  long                               start_node,
+  long                               end_node,
+  double                             *best)
+{
+  route_queue_struct *queue = search->queue;
+  double total;
+  long   u, meet = -1;
+  int    d, stalled;
+
+  *best = HUGE_VAL;
+  StartRound (search);
+  Relax (search, 0, start_node, 0, -1, -1);
+  Relax (search, 1, end_node, 0, -1, -1);
+
+  /* A direction stops when its next node costs more than the best path:
+     unlike with plain Dijkstra, the sum of both directions is no bound */
+  for (;;) {
+    d = -1;
+    if (queue[0].n > 0 && queue[0].key[0] < *best)
+      d = 0;
+    if (queue[1].n > 0 && queue[1].key[0] < *best && (d < 0 || queue[1].key[0] < queue[0].key[0]))
+      d = 1;
+    if (d < 0)
+      break;
+    u = SettleNode (hierarchy, search, d, &stalled);
+    if (u < 0)
+      continue;
+    total = search->cost[d][u] + Label (search, 1 - d, u);
+    if (total < *best) {
+      *best = total;
+      meet = u;
+    }
+  }
+  return meet;
+}
+
+/*******************************************************************************
+** Routine:     HierarchyDistance
+**
+** Description: Cost of the path of least cost between two nodes (numbers
+**              returned by FindHierarchyNode), or HUGE_VAL if the end node
+**              cannot be reached
+*******************************************************************************/
+double HierarchyDistance (
+  const contraction_hierarchy_struct *hierarchy,
+  hierarchy_search_struct            *search,
+  long                               start_node,
+  long                               end_node)
+{
+  double best;
+
+  MeetSearch (hierarchy, search, start_node, end_node, &best);
+  return best;
+}
+
+/*******************************************************************************
+** Routine:     AppendNode
+**
+** Description: Add a node to a path, with the link that leads to it
+*******************************************************************************/
+static void AppendNode (path_builder_struct *path, long node_id, long link_id)
+{
+  if (path->n == path->size) {
+    path->size = path->size > 0 ? 2 * path->size : 64;
+    path->node_id = realloc (path->node_id, path->size * sizeof(long));
+    path->link_id = realloc (path->link_id, path->size * sizeof(long));
+  }
+  path->node_id[path->n] = node_id;
+  path->link_id[path->n] = link_id;
+  path->n++;
+}
+
+/*******************************************************************************
+** Routine:     UnpackArc
+**
+** Description: Add the links of an arc or shortcut to a path. A shortcut
+**              from tail to head bypasses a middle node that is lower than
+**              both: its two halves are the downward arc from tail and the
+**              upward arc to head of the middle node.
+*******************************************************************************/
+static void UnpackArc (
+  const contraction_hierarchy_struct *hierarchy,
+  long                               tail,
+  long                               head,
+  long                               middle,
+  long                               link,
+  path_builder_struct                *path)
+{
+  long a;
+
+  if (middle < 0) {
+    AppendNode (path, (long) hierarchy->node_id[head], link);
+    return;
+  }
+  for (a=(long)hierarchy->first_down[middle]; a<hierarchy->first_down[middle+1]; a++)
+    if (hierarchy->down_tail[a] == tail) {
+      UnpackArc (hierarchy, tail, middle, (long) hierarchy->down_middle[a],
+        (long) hierarchy->down_link[a], path);
+      break;
+    }
+  for (a=(long)hierarchy->first_up[middle]; a<hierarchy->first_up[middle+1]; a++)
+    if (hierarchy->up_head[a] == head) {
+      UnpackArc (hierarchy, middle, head, (long) hierarchy->up_middle[a],
+        (long) hierarchy->up_link[a], path);
+      break;
+    }
+}
+
+/*******************************************************************************
+** Routine:     HierarchyRoute
+**
+** Description: Find the path of least cost between two nodes, with the nodes
+**              and links of the network. Returns 0 and fills the route if a
+**              path is found, or -1 if the end node cannot be reached.
+*******************************************************************************/
+int HierarchyRoute (
+  const contraction_hierarchy_struct *hierarchy,
+  hierarchy_search_struct            *search,
+  long                               start_node,
+  long                               end_node,
+  route_struct                       *route)
+{
+  path_builder_struct path;
+  long   meet, node, next, a, n_up, i;
+  long   *up_arcs;
+  double best;
+
+  route->cost = 0;
+  route->n_nodes = 0;
+  route->node_id = NULL;
+  route->link_id = NULL;
+
+  meet = MeetSearch (hierarchy, search, start_node, end_node, &best);
+  if (meet < 0)
+    return -1;
+
+  /* Arcs of the forward search, from the meeting node back to the start */
+  n_up = 0;
+  for (node=meet; node!=start_node; node=search->parent[0][node])
+    n_up++;
+  up_arcs = malloc ((n_up > 0 ? n_up : 1) * sizeof(long));
+  i = n_up;
+  for (node=meet; node!=start_node; node=search->parent[0][node])
+    up_arcs[--i] = search->parent_arc[0][node];
+
+  path.n = path.size = 0;
+  path.node_id = path.link_id = NULL;
+  AppendNode (&path, (long) hierarchy->node_id[start_node], -1);
+  node = start_node;
+  for (i=0; i<n_up; i++) {
+    a = up_arcs[i];
+    next = (long) hierarchy->up_head[a];
+    UnpackArc (hierarchy, node, next, (long) hierarchy->up_middle[a], (long) hierarchy->up_link[a], &path);
+    node = next;
+  }
+  free (up_arcs);
+
+  /* Arcs of the backward search, from the meeting node on to the end */
+  for (node=meet; node!=end_node; node=next) {
+    next = search->parent[1][node];
+    a = search->parent_arc[1][node];
+    UnpackArc (hierarchy, node, next, (long) hierarchy->down_middle[a], (long) hierarchy->down_link[a], &path);
+  }
+
+  /* The link leading to each node is that of the previous arc */
+  route->cost = best;
+  route->n_nodes = (int) path.n;
+  route->node_id = path.node_id;
+  route->link_id = path.link_id;
+  for (i=0; i<path.n-1; i++)
+    route->link_id[i] = route->link_id[i+1];
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     UpwardSearch
+**
+** Description: Search up the hierarchy from a node in one direction, until
+**              the queue is empty, and list the nodes settled and not stalled
+*******************************************************************************/
+static void UpwardSearch (
+  const contraction_hierarchy_struct *hierarchy,
+  hierarchy_search_struct            *search,
+  int                                d,
+  long                               node,
+  settled_list_struct                *settled)
+{
+  long u;
+  int  stalled;
+
+  StartRound (search);
+  settled->n = 0;
+  Relax (search, d, node, 0, -1, -1);
+  while (search->queue[d].n > 0) {
+    u = SettleNode (hierarchy, search, d, &stalled);
+    if (u < 0 || stalled)
+      continue;
+    if (settled->n == settled->size) {
+      settled->size = settled->size > 0 ? 2 * settled->size : 1024;
+      settled->node = realloc (settled->node, settled->size * sizeof(long));
+    }
+    settled->node[settled->n++] = u;
+  }
+}
+
+/*******************************************************************************
+** Routine:     MatrixWorker
+**
+** Description: Thread routine: run the backward searches of the targets
+**              assigned to the thread, leaving their costs in bucket
+**              entries, or the forward searches of its sources, combining
+**              their costs with the buckets into rows of the matrix
+*******************************************************************************/
+static void *MatrixWorker (void *argument)
+{
+  matrix_job_struct       *job = (matrix_job_struct *) argument;
+  hierarchy_search_struct *search = CreateHierarchySearch (job->hierarchy);
+  settled_list_struct     settled;
+  bucket_entry_struct     *entry;
+  double *row, cost;
+  long   i, j, s, u, b;
+
+  settled.n = settled.size = 0;
+  settled.node = NULL;
+  for (i=job->thread; i<job->n_nodes; i+=job->n_threads) {
+    if (job->nodes[i] < 0)
+      continue;
+    if (job->phase == PHASE_BACKWARD) {
+      UpwardSearch (job->hierarchy, search, 1, job->nodes[i], &settled);
+      for (s=0; s<settled.n; s++) {
+        if (job->n_entries == job->size) {
+          job->size = job->size > 0 ? 2 * job->size : 4096;
+          job->entries = realloc (job->entries, job->size * sizeof(bucket_entry_struct));
+        }
+        entry = &job->entries[job->n_entries++];
+        entry->node = settled.node[s];
+        entry->target = i;
+        entry->cost = search->cost[1][settled.node[s]];
+      }
+    }
+    else {
+      UpwardSearch (job->hierarchy, search, 0, job->nodes[i], &settled);
+      row = job->matrix + i * job->n_targets;
+      for (s=0; s<settled.n; s++) {
+        u = settled.node[s];
+        for (b=job->bucket_first[u]; b<job->bucket_first[u+1]; b++) {
+          j = job->bucket_target[b];
+          cost = search->cost[0][u] + job->bucket_cost[b];
+          if (cost < row[j])
+            row[j] = cost;
+        }
+      }
+    }
+  }
+  free (settled.node);
+  FreeHierarchySearch (search);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     HierarchyDistanceMatrix
+**
+** Description: Costs of the paths of least cost from each source to each
+**              target (node numbers), with n_threads threads. matrix
+**              receives n_sources rows of n_targets costs, HUGE_VAL where
+**              there is no path or the node number is negative.
+*******************************************************************************/
+void HierarchyDistanceMatrix (
+  const contraction_hierarchy_struct *hierarchy,
+  const long                         *sources,
+  long                               n_sources,
+  const long                         *targets,
+  long                               n_targets,
+  int                                n_threads,
+  double                             *matrix)
+{
+  matrix_job_struct jobs[HIERARCHY_MAX_THREADS];
+  long   *bucket_first, *bucket_target, *fill;
+  double *bucket_cost;
+  long   n = (long) hierarchy->n_nodes, i, e, b;
+  int    t;
+
+  for (i=0; i<n_sources*n_targets; i++)
+    matrix[i] = HUGE_VAL;
+  if (n_sources <= 0 || n_targets <= 0 || n <= 0)
+    return;
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > HIERARCHY_MAX_THREADS)
+    n_threads = HIERARCHY_MAX_THREADS;
+
+  /* Backward searches from the targets */
+  for (t=0; t<n_threads; t++) {
+    memset (&jobs[t], 0, sizeof(matrix_job_struct));
+    jobs[t].hierarchy = hierarchy;
+    jobs[t].thread = t;
+    jobs[t].n_threads = n_threads;
+    jobs[t].phase = PHASE_BACKWARD;
+    jobs[t].nodes = targets;
+    jobs[t].n_nodes = n_targets;
+  }
+  RunJobs (MatrixWorker, jobs, sizeof(matrix_job_struct), n_threads);
+
+  /* Gather the entries into one bucket per node */
+  bucket_first = calloc (n + 1, sizeof(long));
+  for (t=0; t<n_threads; t++)
+    for (e=0; e<jobs[t].n_entries; e++)
+      bucket_first[jobs[t].entries[e].node + 1]++;
+  for (i=0; i<n; i++)
+    bucket_first[i+1] += bucket_first[i];
+  bucket_target = malloc ((bucket_first[n] > 0 ? bucket_first[n] : 1) * sizeof(long));
+  bucket_cost = malloc ((bucket_first[n] > 0 ? bucket_first[n] : 1) * sizeof(double));
+  fill = malloc (n * sizeof(long));
+  memcpy (fill, bucket_first, n * sizeof(long));
+  for (t=0; t<n_threads; t++) {
+    for (e=0; e<jobs[t].n_entries; e++) {
+      b = fill[jobs[t].entries[e].node]++;
+      bucket_target[b] = jobs[t].entries[e].target;
+      bucket_cost[b] = jobs[t].entries[e].cost;
+    }
+    free (jobs[t].entries);
+  }
+  free (fill);
+
+  /* Forward searches from the sources */
+  for (t=0; t<n_threads; t++) {
+    memset (&jobs[t], 0, sizeof(matrix_job_struct));
+    jobs[t].hierarchy = hierarchy;
+    jobs[t].thread = t;
+    jobs[t].n_threads = n_threads;
+    jobs[t].phase = PHASE_FORWARD;
+    jobs[t].nodes = sources;
+    jobs[t].n_nodes = n_sources;
+    jobs[t].n_targets = n_targets;
+    jobs[t].bucket_first = bucket_first;
+    jobs[t].bucket_target = bucket_target;
+    jobs[t].bucket_cost = bucket_cost;
+    jobs[t].matrix = matrix;
+  }
+  RunJobs (MatrixWorker, jobs, sizeof(matrix_job_struct), n_threads);
+
+  free (bucket_first);
+  free (bucket_target);
+  free (bucket_cost);
+}
@@ -0,0 +1,145 @@
+/* contraction_hierarchy.h
+
+   Contraction hierarchies: preprocessed road networks for fast shortest
+   path queries.
+
+   A contraction hierarchy is built once from a road network (see
+   road_network.h). The nodes are removed ("contracted") one after the
+   other, least important first. When a node is removed, a shortcut is
+   added between each pair of its neighbours whose shortest path went
+   through it, unless a witness path of no greater cost exists without it.
+   Each node then only keeps the arcs and shortcuts to the nodes contracted
+   after it, that is, the arcs that go up in the hierarchy.
+
+   A query searches up the hierarchy from both ends, and the searches meet
+   at the most important node of the path. They settle a few hundred nodes
+   instead of the hundreds of thousands of Dijkstra's algorithm on a
+   statewide network. The shortcuts of the path are then expanded back into
+   the links of the network.
+
+   The contraction runs in rounds: each round the nodes whose priority is
+   lower than that of all their neighbours are contracted in parallel. The
+   priority of a node is the number of shortcuts its contraction adds minus
+   the number of arcs it removes, plus the number of its neighbours already
+   contracted and its depth in the hierarchy, so that the contraction
+   proceeds evenly over the network.
+
+   HierarchyDistanceMatrix computes the costs between a set of sources and a
+   set of targets. The upward searches from the targets leave their costs in
+   buckets at each node they settle, and the upward search from each source
+   combines its costs with the buckets of the nodes it settles: the matrix
+   costs one search per source and per target instead of one per pair.
+
+   A hierarchy can be written to a file, and mapped back in memory by the
+   programs that query it: opening it then takes the same time whatever the
+   size of the network. All values are stored as 64-bit integers or doubles
+   in little-endian byte order.
+
+   File layout:
+
+     offset  size  content
+     0       8     magic string "SDOCH001"
+     8       4     format version (1)
+     12      4     flags (HIERARCHY_GEODETIC if the network is geodetic)
+     16      8     number of nodes (n)
+     24      8     number of upward arcs (n_up)
+     32      8     number of downward arcs (n_down)
+     40      8     number of shortcuts
+     48      16    (reserved)
+     64      8*15  offsets of the arrays, in the order of the structure below
+     184     72    (reserved)
+     256           arrays
+
+   Arcs and shortcuts are stored twice: with the node they leave (upward
+   arcs, used by forward searches) and with the node they enter (downward
+   arcs, used by backward searches), for the arcs whose other node is higher
+   in the hierarchy. The middle of a shortcut is the node it bypasses, and is
+   -1 for the arcs of the network.
+
+   A hierarchy can be searched by several threads at the same time, each
+   with its own hierarchy_search_struct.
+
+*/
+#ifndef CONTRACTION_HIERARCHY_H
+#define CONTRACTION_HIERARCHY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "road_network.h"
+
+#define HIERARCHY_MAGIC "SDOCH001"
+#define HIERARCHY_VERSION 1
+#define HIERARCHY_HEADER_SIZE 256
+#define HIERARCHY_GEODETIC 1
+#define HIERARCHY_MAX_THREADS 64
+
+/* A contraction hierarchy, built in memory or mapped from a file */
+struct contraction_hierarchy
+{
+    int64_t       n_nodes;
+    int64_t       n_up;
+    int64_t       n_down;
+    int64_t       n_shortcuts;
+    int           geodetic;
+    const int64_t *node_id;           /* Id of each node in the node table */
+    const double  *x;                 /* Location of each node */
+    const double  *y;
+    const int64_t *sorted_id;         /* Node ids in increasing order */
+    const int64_t *sorted_node;       /* Node number of each sorted id */
+    const int64_t *first_up;          /* First upward arc of each node (n + 1) */
+    const int64_t *up_head;           /* Node at the end of each upward arc */
+    const double  *up_cost;
+    const int64_t *up_middle;         /* Node bypassed by a shortcut, or -1 */
+    const int64_t *up_link;           /* Id of the link of an arc, or -1 */
+    const int64_t *first_down;        /* First downward arc of each node (n + 1) */
+    const int64_t *down_tail;         /* Node at the start of each downward arc */
+    const double  *down_cost;
+    const int64_t *down_middle;
+    const int64_t *down_link;
+    void          *base;              /* Start of the mapped file (NULL if built) */
+    size_t        size;               /* Size of the mapped file */
+};
+typedef struct contraction_hierarchy contraction_hierarchy_struct;
+
+/* Statistics of the contraction of a network */
+struct hierarchy_stats
+{
+    long n_rounds;                    /* Rounds of parallel contraction */
+    long n_shortcuts;
+    int  n_threads;
+};
+typedef struct hierarchy_stats hierarchy_stats_struct;
+
+/* Work space of queries, to be used by one thread at a time */
+struct hierarchy_search
+{
+    long               n_nodes;
+    unsigned int       round;
+    unsigned int       *stamp[2];     /* Forward and backward directions */
+    double             *cost[2];
+    long               *parent[2];    /* Previous (or next) node on the path */
+    long               *parent_arc[2];
+    route_queue_struct queue[2];
+    long               n_settled;     /* (out) Nodes settled by the last query */
+};
+typedef struct hierarchy_search hierarchy_search_struct;
+
+void BuildHierarchy (const road_network_struct *network, int n_threads,
+                     contraction_hierarchy_struct *hierarchy, hierarchy_stats_struct *stats);
+int  WriteHierarchy (const contraction_hierarchy_struct *hierarchy, const char *filename);
+int  OpenHierarchy (const char *filename, contraction_hierarchy_struct *hierarchy);
+void CloseHierarchy (contraction_hierarchy_struct *hierarchy);
+long FindHierarchyNode (const contraction_hierarchy_struct *hierarchy, long node_id);
+hierarchy_search_struct *CreateHierarchySearch (const contraction_hierarchy_struct *hierarchy);
+void FreeHierarchySearch (hierarchy_search_struct *search);
+double HierarchyDistance (const contraction_hierarchy_struct *hierarchy,
+                          hierarchy_search_struct *search, long start_node, long end_node);
+int  HierarchyRoute (const contraction_hierarchy_struct *hierarchy,
+                     hierarchy_search_struct *search, long start_node, long end_node,
+                     route_struct *route);
+void HierarchyDistanceMatrix (const contraction_hierarchy_struct *hierarchy,
+                              const long *sources, long n_sources,
+                              const long *targets, long n_targets,
+                              int n_threads, double *matrix);
+
+#endif
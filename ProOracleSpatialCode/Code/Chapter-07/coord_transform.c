@@ -0,0 +1,758 @@
+/* coord_transform.c
+
+   Transformation of coordinates between coordinate systems. See
+   coord_transform.h for the coordinate systems that are supported and for
+   the method.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "coord_transform.h"
+
+#define WGS84_A 6378137.0
+#define WGS84_F (1 / 298.257223563)
+#define GRS80_F (1 / 298.257222101)
+#define US_FOOT (1200.0 / 3937.0)
+#define MAX_LATITUDE 85.0511287798
+#define DEGREES (M_PI / 180)
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A Lambert conformal conic zone of the state plane coordinate systems
+   (NAD 83), in degrees and meters. Most states define a zone in meters and
+   the same zone in US survey feet */
+struct lambert_zone
+{
+    int    srid;                      /* In meters */
+    int    srid_feet;                 /* In US survey feet, 0 if none */
+    double lat1, lat2;                /* Standard parallels */
+    double lat0, lon0;                /* Origin */
+    double false_easting;
+    double false_northing;
+};
+typedef struct lambert_zone lambert_zone_struct;
+
+/* A control point: a longitude and latitude and what they become in a
+   coordinate system */
+struct control_point
+{
+    const char *name;
+    double     lon, lat;              /* Degrees */
+    double     x, y;                  /* In the units of the coordinate system */
+};
+typedef struct control_point control_point_struct;
+
+static const lambert_zone_struct lambert_zones[] = {
+  {26943, 2227, 38.4333333333, 37.0666666667, 36.5,          -120.5,         2000000, 500000},  /* California 3 */
+  {26945, 2229, 35.4666666667, 34.0333333333, 33.5,          -118.0,         2000000, 500000},  /* California 5 */
+  {26954, 2232, 39.75,         38.45,         37.8333333333, -105.5,  914401.8289, 304800.6096}, /* Colorado Central */
+  {26986, 2249, 42.6833333333, 41.7166666667, 41.0,          -71.5,           200000, 750000},  /* Massachusetts Mainland */
+  {32118, 2263, 41.0333333333, 40.6666666667, 40.1666666667, -74.0,           300000, 0},       /* New York Long Island */
+  {32139, 2278, 30.2833333333, 28.3833333333, 27.8333333333, -99.0,           600000, 4000000}, /* Texas South Central */
+  {32148, 2285, 48.7333333333, 47.5,          47.0,          -120.8333333333, 500000, 0},       /* Washington North */
+  {2154,  0,    49.0,          44.0,          46.5,          3.0,             700000, 6600000}, /* France, Lambert-93 */
+};
+
+/*******************************************************************************
+** Routine:     Now
+**
+** Description: Wall clock time, in seconds
+*******************************************************************************/
+static double Now (void)
+{
+#ifndef _WIN32
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#else
+  return (double) clock () / CLOCKS_PER_SEC;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitTransverseMercator
+**
+** Description: Set up a transverse Mercator projection: the coefficients of
+**              the series of Krueger, from the third flattening n, and the
+**              northing of the latitude of origin
+*******************************************************************************/
+static void InitTransverseMercator (
+  crs_struct *crs,
+  double     a,
+  double     f,
+  double     lat0,
+  double     lon0,
+  double     k0,
+  double     false_easting,
+  double     false_northing)
+{
+  double n = f / (2 - f), n2 = n * n, n3 = n2 * n, n4 = n3 * n, n5 = n4 * n, n6 = n5 * n;
+  double phi = lat0 * DEGREES, s, chi, xi;
+  int    j;
+
+  crs->kind = CRS_TRANSVERSE_MERCATOR;
+  crs->a = a;
+  crs->e = sqrt (f * (2 - f));
+  crs->lon0 = lon0 * DEGREES;
+  crs->k0 = k0;
+  crs->false_easting = false_easting;
+  crs->false_northing = false_northing;
+  crs->A = a / (1 + n) * (1 + n2 / 4 + n4 / 64 + n6 / 256);
+
+  crs->alpha[0] = n / 2 - 2 * n2 / 3 + 5 * n3 / 16 + 41 * n4 / 180 - 127 * n5 / 288 + 7891 * n6 / 37800;
+  crs->alpha[1] = 13 * n2 / 48 - 3 * n3 / 5 + 557 * n4 / 1440 + 281 * n5 / 630 - 1983433 * n6 / 1935360;
+  crs->alpha[2] = 61 * n3 / 240 - 103 * n4 / 140 + 15061 * n5 / 26880 + 167603 * n6 / 181440;
+  crs->alpha[3] = 49561 * n4 / 161280 - 179 * n5 / 168 + 6601661 * n6 / 7257600;
+  crs->alpha[4] = 34729 * n5 / 80640 - 3418889 * n6 / 1995840;
+  crs->alpha[5] = 212378941 * n6 / 319334400;
+
+  crs->beta[0] = n / 2 - 2 * n2 / 3 + 37 * n3 / 96 - n4 / 360 - 81 * n5 / 512 + 96199 * n6 / 604800;
+  crs->beta[1] = n2 / 48 + n3 / 15 - 437 * n4 / 1440 + 46 * n5 / 105 - 1118711 * n6 / 3870720;
+  crs->beta[2] = 17 * n3 / 480 - 37 * n4 / 840 - 209 * n5 / 4480 + 5569 * n6 / 90720;
+  crs->beta[3] = 4397 * n4 / 161280 - 11 * n5 / 504 - 830251 * n6 / 7257600;
+  crs->beta[4] = 4583 * n5 / 161280 - 108847 * n6 / 3991680;
+  crs->beta[5] = 20648693 * n6 / 638668800;
+
+  /* Northing of the origin: the series on the central meridian, at the
+     conformal latitude of the origin */
+  s = sin (phi);
+  chi = atan (sinh (atanh (s) - crs->e * atanh (crs->e * s)));
+  for (j=0, xi=chi; j<6; j++)
+    xi += crs->alpha[j] * sin (2 * (j + 1) * chi);
+  crs->M0 = crs->A * xi;
+}
+
+/*******************************************************************************
+** Routine:     InitLambert
+**
+** Description: Set up a Lambert conformal conic projection with two standard
+**              parallels
+*******************************************************************************/
+static double LambertT (double phi, double e)
+{
+  double s = sin (phi);
+  return tan (M_PI / 4 - phi / 2) / pow ((1 - e * s) / (1 + e * s), e / 2);
+}
+
+static void InitLambert (
+  crs_struct *crs,
+  double     a,
+  double     f,
+  double     lat1,
+  double     lat2,
+  double     lat0,
+  double     lon0,
+  double     false_easting,
+  double     false_northing)
+{
+  double e = sqrt (f * (2 - f));
+  double phi1 = lat1 * DEGREES, phi2 = lat2 * DEGREES;
+  double m1, m2, t1, t2;
+
+  crs->kind = CRS_LAMBERT;
+  crs->a = a;
+  crs->e = e;
+  crs->lon0 = lon0 * DEGREES;
+  crs->k0 = 1;
+  crs->false_easting = false_easting;
+  crs->false_northing = false_northing;
+  m1 = cos (phi1) / sqrt (1 - e * e * sin (phi1) * sin (phi1));
+  m2 = cos (phi2) / sqrt (1 - e * e * sin (phi2) * sin (phi2));
+  t1 = LambertT (phi1, e);
+  t2 = LambertT (phi2, e);
+  if (fabs (phi1 - phi2) > 1e-12)
+    crs->n = (log (m1) - log (m2)) / (log (t1) - log (t2));
+  else
+    crs->n = sin (phi1);
+  crs->aF = a * m1 / (crs->n * pow (t1, crs->n));
+  crs->rF = crs->aF * pow (LambertT (lat0 * DEGREES, e), crs->n);
+}
+
+/*******************************************************************************
+** Routine:     InitCrs
+**
+** Description: Set up a coordinate system from its SRID. Returns 0, or -1 if
+**              the SRID is not supported.
+*******************************************************************************/
+int InitCrs (crs_struct *crs, int srid)
+{
+  const lambert_zone_struct *z;
+  int zone, i;
+
+  memset (crs, 0, sizeof(crs_struct));
+  crs->srid = srid;
+  crs->unit = 1;
+  crs->k0 = 1;
+
+  if (srid == 8307 || srid == 4326 || srid == 8265 || srid == 4269) {
+    crs->kind = CRS_GEOGRAPHIC;
+    return 0;
+  }
+  if (srid == 3857 || srid == 3785 || srid == 900913) {
+    crs->kind = CRS_WEB_MERCATOR;
+    crs->a = WGS84_A;
+    return 0;
+  }
+
+  /* UTM zones */
+  if (srid >= 32601 && srid <= 32660) {
+    zone = srid - 32600;
+    InitTransverseMercator (crs, WGS84_A, WGS84_F, 0, zone * 6 - 183, 0.9996, 500000, 0);
+    return 0;
+  }
+  if (srid >= 32701 && srid <= 32760) {
+    zone = srid - 32700;
+    InitTransverseMercator (crs, WGS84_A, WGS84_F, 0, zone * 6 - 183, 0.9996, 500000, 10000000);
+    return 0;
+  }
+  if (srid >= 26901 && srid <= 26923) {
+    zone = srid - 26900;
+    InitTransverseMercator (crs, WGS84_A, GRS80_F, 0, zone * 6 - 183, 0.9996, 500000, 0);
+    return 0;
+  }
+
+  /* State plane (Lambert) zones */
+  for (i=0; i<(int)(sizeof(lambert_zones)/sizeof(lambert_zones[0])); i++) {
+    z = &lambert_zones[i];
+    if (srid == z->srid || (z->srid_feet != 0 && srid == z->srid_feet)) {
+      InitLambert (crs, WGS84_A, GRS80_F, z->lat1, z->lat2, z->lat0, z->lon0,
+        z->false_easting, z->false_northing);
+      if (srid == z->srid_feet)
+        crs->unit = US_FOOT;
+      return 0;
+    }
+  }
+
+  crs->kind = 0;
+  return -1;
+}
+
+/*******************************************************************************
+** Routine:     InitTransform
+**
+** Description: Set up a transformation between two SRIDs. Returns 0, or -1 if
+**              one of them is not supported.
+*******************************************************************************/
+int InitTransform (transform_struct *transform, int from_srid, int to_srid)
+{
+  if (InitCrs (&transform->source, from_srid) != 0 || InitCrs (&transform->target, to_srid) != 0)
+    return -1;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     Cosine
+**
+** Description: Cosine of x, as a shifted sine. When the loops take the sine
+**              and the cosine of the same angle, the compiler merges them into
+**              one call of sincos, which has no vector version: the loop is
+**              then not vectorized.
+*******************************************************************************/
+static inline double Cosine (double x)
+{
+  return sin (x + M_PI / 2);
+}
+
+/*******************************************************************************
+** Routine:     KruegerSeries
+**
+** Description: Add sign * sum of c[j] sin(2 (j+1) zeta) to the complex number
+**              zeta = xi + i eta. The sines of the multiples of zeta come
+**              from the recurrence S(j+1) = 2 cos(2 zeta) S(j) - S(j-1),
+**              which needs only one sine and cosine of each part of zeta.
+*******************************************************************************/
+static inline void KruegerSeries (const double *c, double sign, double *xi, double *eta)
+{
+  double s2 = sin (2 * *xi), c2 = Cosine (2 * *xi);
+  double sh2 = sinh (2 * *eta), ch2 = cosh (2 * *eta);
+  double w_re = 2 * c2 * ch2, w_im = -2 * s2 * sh2;    /* 2 cos(2 zeta) */
+  double s_re = s2 * ch2, s_im = c2 * sh2;              /* S(1) = sin(2 zeta) */
+  double p_re = 0, p_im = 0, n_re, n_im;                /* S(0) = 0 */
+  double sum_re = 0, sum_im = 0;
+  int    j;
+
+  for (j=0; j<6; j++) {
+    sum_re += c[j] * s_re;
+    sum_im += c[j] * s_im;
+    n_re = w_re * s_re - w_im * s_im - p_re;
+    n_im = w_re * s_im + w_im * s_re - p_im;
+    p_re = s_re; p_im = s_im;
+    s_re = n_re; s_im = n_im;
+  }
+  *xi += sign * sum_re;
+  *eta += sign * sum_im;
+}
+
+/*******************************************************************************
+** Routine:     LatitudeFromConformal
+**
+** Description: Tangent of the latitude from the tangent of the conformal
+**              latitude, with two Newton steps (enough for full precision,
+**              see Karney, "Transverse Mercator with an accuracy of a few
+**              nanometers", 2011)
+*******************************************************************************/
+static inline double LatitudeFromConformal (double tau_p, double e)
+{
+  double e2 = e * e, tau = tau_p, sigma, tau_i;
+  int    k;
+
+  for (k=0; k<2; k++) {
+    sigma = sinh (e * atanh (e * tau / sqrt (1 + tau * tau)));
+    tau_i = tau * sqrt (1 + sigma * sigma) - sigma * sqrt (1 + tau * tau);
+    tau += (tau_p - tau_i) / sqrt (1 + tau_i * tau_i)
+      * (1 + (1 - e2) * tau * tau) / ((1 - e2) * sqrt (1 + tau * tau));
+  }
+  return tau;
+}
+
+/*******************************************************************************
+** Routine:     ToGeographic
+**
+** Description: Convert a block of coordinates of a coordinate system to
+**              longitudes and latitudes, in radians
+*******************************************************************************/
+static void ToGeographic (const crs_struct *crs, double *x, double *y, int count)
+{
+  double e = crs->e, unit = crs->unit, a = crs->a, lon0 = crs->lon0;
+  double easting = crs->false_easting, northing = crs->false_northing;
+  double k0A = crs->k0 * crs->A, northing0 = northing - crs->k0 * crs->M0;
+  double n = crs->n, aF = crs->aF, rF = crs->rF;
+  double beta[6], xi, eta, tau_p, dx, dy, r, t, sign;
+  int    i;
+
+  /* The constants are copied, so that the compiler knows that the loops do
+     not change them */
+  memcpy (beta, crs->beta, sizeof(beta));
+
+  switch (crs->kind) {
+    case CRS_GEOGRAPHIC:
+      for (i=0; i<count; i++) {
+        x[i] *= DEGREES;
+        y[i] *= DEGREES;
+      }
+      break;
+
+    case CRS_WEB_MERCATOR:
+      for (i=0; i<count; i++) {
+        x[i] = x[i] * unit / a;
+        y[i] = M_PI / 2 - 2 * atan (exp (-y[i] * unit / a));
+      }
+      break;
+
+    case CRS_TRANSVERSE_MERCATOR:
+      for (i=0; i<count; i++) {
+        xi = (y[i] * unit - northing0) / k0A;
+        eta = (x[i] * unit - easting) / k0A;
+        KruegerSeries (beta, -1, &xi, &eta);
+        tau_p = sin (xi) / sqrt (sinh (eta) * sinh (eta) + Cosine (xi) * Cosine (xi));
+        x[i] = lon0 + atan2 (sinh (eta), Cosine (xi));
+        y[i] = atan (LatitudeFromConformal (tau_p, e));
+      }
+      break;
+
+    case CRS_LAMBERT:
+      sign = n > 0 ? 1 : -1;
+      for (i=0; i<count; i++) {
+        dx = x[i] * unit - easting;
+        dy = rF - (y[i] * unit - northing);
+        r = sign * sqrt (dx * dx + dy * dy);
+        t = pow (r / aF, 1 / n);
+        x[i] = lon0 + atan2 (sign * dx, sign * dy) / n;
+        /* t is tan(pi/4 - chi/2) for the conformal latitude chi, whose
+           tangent is then (1 - t^2) / (2 t) */
+        y[i] = atan (LatitudeFromConformal ((1 - t * t) / (2 * t), e));
+      }
+      break;
+  }
+}
+
+/*******************************************************************************
+** Routine:     FromGeographic
+**
+** Description: Convert a block of longitudes and latitudes, in radians, to a
+**              coordinate system
+*******************************************************************************/
+static void FromGeographic (const crs_struct *crs, double *x, double *y, int count)
+{
+  double e = crs->e, unit = crs->unit, a = crs->a, lon0 = crs->lon0;
+  double easting = crs->false_easting, northing = crs->false_northing;
+  double k0A = crs->k0 * crs->A, northing0 = northing - crs->k0 * crs->M0;
+  double n = crs->n, aF = crs->aF, rF = crs->rF, max_latitude = MAX_LATITUDE * DEGREES;
+  double alpha[6], lambda, phi, s, t, xi, eta, r, theta;
+  int    i;
+
+  memcpy (alpha, crs->alpha, sizeof(alpha));
+
+  switch (crs->kind) {
+    case CRS_GEOGRAPHIC:
+      for (i=0; i<count; i++) {
+        /* Longitudes between -180 and 180 */
+        lambda = x[i] - 2 * M_PI * floor ((x[i] + M_PI) / (2 * M_PI));
+        x[i] = lambda / DEGREES;
+        y[i] = y[i] / DEGREES;
+      }
+      break;
+
+    case CRS_WEB_MERCATOR:
+      for (i=0; i<count; i++) {
+        phi = fmin (fmax (y[i], -max_latitude), max_latitude);
+        x[i] = a * x[i] / unit;
+        y[i] = a * log (tan (M_PI / 4 + phi / 2)) / unit;
+      }
+      break;
+
+    case CRS_TRANSVERSE_MERCATOR:
+      for (i=0; i<count; i++) {
+        lambda = x[i] - lon0;
+        lambda -= 2 * M_PI * floor ((lambda + M_PI) / (2 * M_PI));
+        s = sin (y[i]);
+        t = sinh (atanh (s) - e * atanh (e * s));
+        xi = atan2 (t, Cosine (lambda));
+        eta = atanh (sin (lambda) / sqrt (1 + t * t));
+        KruegerSeries (alpha, 1, &xi, &eta);
+        x[i] = (easting + k0A * eta) / unit;
+        y[i] = (northing0 + k0A * xi) / unit;
+      }
+      break;
+
+    case CRS_LAMBERT:
+      for (i=0; i<count; i++) {
+        lambda = x[i] - lon0;
+        lambda -= 2 * M_PI * floor ((lambda + M_PI) / (2 * M_PI));
+        s = sin (y[i]);
+        t = tan (M_PI / 4 - y[i] / 2) / pow ((1 - e * s) / (1 + e * s), e / 2);
+        r = aF * pow (t, n);
+        theta = n * lambda;
+        x[i] = (easting + r * sin (theta)) / unit;
+        y[i] = (northing + rF - r * Cosine (theta)) / unit;
+      }
+      break;
+  }
+}
+
+/*******************************************************************************
+** Routine:     TransformBlock
+**
+** Description: Transform a block of X and Y
+*******************************************************************************/
+static void TransformBlock (const transform_struct *transform, double *x, double *y, int n)
+{
+  ToGeographic (&transform->source, x, y, n);
+  FromGeographic (&transform->target, x, y, n);
+}
+
+/*******************************************************************************
+** Routine:     TransformOrdinates
+**
+** Description: Transform the X and Y of n_points points of dim interleaved
+**              ordinates each. The other ordinates are not changed.
+*******************************************************************************/
+void TransformOrdinates (
+  const transform_struct *transform,
+  double                 *ordinates,
+  long                   n_points,
+  int                    dim)
+{
+  double x[TRANSFORM_BLOCK], y[TRANSFORM_BLOCK], *block;
+  long   first;
+  int    n, i;
+
+  if (transform->source.srid == transform->target.srid)
+    return;
+
+  for (first=0; first<n_points; first+=TRANSFORM_BLOCK) {
+    n = n_points - first < TRANSFORM_BLOCK ? (int) (n_points - first) : TRANSFORM_BLOCK;
+    block = ordinates + first * dim;
+
+    /* The copies have a constant stride for 2 and 3 dimensions */
+    if (dim == 2) {
+      for (i=0; i<n; i++) {
+        x[i] = block[2*i];
+        y[i] = block[2*i+1];
+      }
+      TransformBlock (transform, x, y, n);
+      for (i=0; i<n; i++) {
+        block[2*i] = x[i];
+        block[2*i+1] = y[i];
+      }
+    }
+    else if (dim == 3) {
+      for (i=0; i<n; i++) {
+        x[i] = block[3*i];
+        y[i] = block[3*i+1];
+      }
+      TransformBlock (transform, x, y, n);
+      for (i=0; i<n; i++) {
+        block[3*i] = x[i];
+        block[3*i+1] = y[i];
+      }
+    }
+    else {
+      for (i=0; i<n; i++) {
+        x[i] = block[dim*i];
+        y[i] = block[dim*i+1];
+      }
+      TransformBlock (transform, x, y, n);
+      for (i=0; i<n; i++) {
+        block[dim*i] = x[i];
+        block[dim*i+1] = y[i];
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     TransformElements
+**
+** Description: Transform the point and ordinates of a geometry of a given
+**              SRID (0 for the SRID of the options) to the SRID of the
+**              options. The point may be NULL. Returns the new SRID of the
+**              geometry, or its old one if it could not be transformed.
+*******************************************************************************/
+int TransformElements (
+  transform_options_struct *options,
+  int                      srid,
+  double                   *point_x,
+  double                   *point_y,
+  double                   *ordinates,
+  int                      n_ordinates,
+  int                      dim)
+{
+  double point[2], start_time;
+  long   n_points;
+
+  if (options->to_srid == 0)
+    return srid;
+  if (srid == 0)
+    srid = options->from_srid;
+  if (srid == 0) {
+    options->skipped++;
+    return srid;
+  }
+
+  /* The transformation is kept from one geometry to the next */
+  if (srid != options->current_srid) {
+    if (InitTransform (&options->transform, srid, options->to_srid) != 0) {
+      options->skipped++;
+      return srid;
+    }
+    options->current_srid = srid;
+  }
+
+  if (dim < 2)
+    dim = 2;
+  start_time = Now ();
+  n_points = 0;
+  if (point_x != NULL && point_y != NULL) {
+    point[0] = *point_x;
+    point[1] = *point_y;
+    TransformOrdinates (&options->transform, point, 1, 2);
+    *point_x = point[0];
+    *point_y = point[1];
+    n_points++;
+  }
+  if (ordinates != NULL && n_ordinates > 0) {
+    TransformOrdinates (&options->transform, ordinates, n_ordinates / dim, dim);
+    n_points += n_ordinates / dim;
+  }
+  options->seconds += Now () - start_time;
+  options->geometries++;
+  options->points += n_points;
+  return options->to_srid;
+}
+
+/*******************************************************************************
+** Routine:     ParseTransformOptions
+**
+** Description: Look for the --to-srid=<srid>, --from-srid=<srid> and
+**              --transform-check options on the command line, and remove them
+**              from it. --transform-check runs CheckTransforms and ends the
+**              program. Returns 1 if a transformation is requested.
+*******************************************************************************/
+int ParseTransformOptions (
+  int                      *argc,
+  char                     **argv,
+  transform_options_struct *options)
+{
+  crs_struct crs;
+  int i, n;
+
+  memset (options, 0, sizeof(transform_options_struct));
+
+  for (i=1, n=1; i<*argc; i++) {
+    if (strncmp (argv[i], "--to-srid=", 10) == 0) {
+      options->to_srid = atoi (argv[i] + 10);
+      if (InitCrs (&crs, options->to_srid) != 0) {
+        printf ("Unsupported target SRID: %s\n", argv[i] + 10);
+        exit (1);
+      }
+    }
+    else if (strncmp (argv[i], "--from-srid=", 12) == 0) {
+      options->from_srid = atoi (argv[i] + 12);
+      if (options->from_srid <= 0) {
+        printf ("Invalid source SRID: %s\n", argv[i] + 12);
+        exit (1);
+      }
+    }
+    else if (strcmp (argv[i], "--transform-check") == 0)
+      exit (CheckTransforms (1) == 0 ? 0 : 1);
+    else
+      argv[n++] = argv[i];
+  }
+  *argc = n;
+  argv[n] = NULL;
+
+  return options->to_srid != 0;
+}
+
+/*******************************************************************************
+** Routine:     PrintTransformStatistics
+**
+** Description: Print out the number of points transformed, and how fast
+*******************************************************************************/
+void PrintTransformStatistics (
+  transform_options_struct *options)
+{
+  if (options->to_srid == 0)
+    return;
+  printf ("Transformation to SRID %d: %ld geometries, %ld points in %.3f seconds",
+    options->to_srid, options->geometries, options->points, options->seconds);
+  if (options->seconds > 0)
+    printf (" (%.0f points/second)", options->points / options->seconds);
+  printf ("\n");
+  if (options->skipped > 0)
+    printf ("%ld geometries not transformed: SRID missing or not supported\n", options->skipped);
+}
+
+/*******************************************************************************
+** Routine:     CheckPoints
+**
+** Description: Convert control points from longitude and latitude to a
+**              coordinate system and back, and compare with the expected
+**              coordinates. Returns the number of points outside the
+**              tolerances.
+*******************************************************************************/
+static int CheckPoints (
+  const char                 *title,
+  const crs_struct           *crs,
+  const control_point_struct *points,
+  int                        n,
+  double                     tolerance,
+  int                        verbose)
+{
+  double x[1], y[1], error, back;
+  int    i, failures = 0;
+
+  for (i=0; i<n; i++) {
+    x[0] = points[i].lon * DEGREES;
+    y[0] = points[i].lat * DEGREES;
+    FromGeographic (crs, x, y, 1);
+    error = hypot (x[0] - points[i].x, y[0] - points[i].y);
+    ToGeographic (crs, x, y, 1);
+    back = hypot (x[0] / DEGREES - points[i].lon, y[0] / DEGREES - points[i].lat);
+    if (error > tolerance || back > 1e-9)
+      failures++;
+    if (verbose)
+      printf ("  %-6s %-34s error %10.2e (tolerance %.0e)  back %8.1e deg  %s\n",
+        title, points[i].name, error, tolerance, back,
+        error > tolerance || back > 1e-9 ? "FAILED" : "ok");
+  }
+  return failures;
+}
+
+/*******************************************************************************
+** Routine:     CheckTransforms
+**
+** Description: Check the formulas against the control points of the EPSG
+**              guidance note 7-2 and other known points, and check that the
+**              points of a grid covering each supported coordinate system
+**              convert back to the same longitude and latitude. Returns the
+**              number of failures.
+*******************************************************************************/
+int CheckTransforms (int verbose)
+{
+  /* EPSG guidance note 7-2: NAD27 / Texas South Central, in US feet, on
+     the Clarke 1866 ellipsoid */
+  static const control_point_struct texas[] = {
+    {"GN 7-2 Lambert 2SP (Texas)", -96.0, 28.5, 2963503.91, 254759.80}};
+  /* EPSG guidance note 7-2: OSGB 1936 / British National Grid, on the Airy
+     1830 ellipsoid, with the JHS (Krueger) formulas of the current edition */
+  static const control_point_struct britain[] = {
+    {"GN 7-2 TM (British Grid)", 0.5, 50.5, 577274.98, 69740.49}};
+  static const control_point_struct web_mercator[] = {
+    {"GN 7-2 Pseudo-Mercator", -(100 + 20.0 / 60), 24 + 22 / 60.0 + 54.433 / 3600,
+      -11169055.58, 2800000.00}};
+  static const control_point_struct utm31[] = {
+    {"UTM 31N central meridian", 3.0, 0.0, 500000.0, 0.0},
+    {"UTM 31N origin of longitudes", 0.0, 0.0, 166021.4431, 0.0}};
+  static const control_point_struct lambert93[] = {
+    {"Lambert-93 origin", 3.0, 46.5, 700000.0, 6600000.0}};
+  static const int srids[] = {32601, 32631, 32660, 32719, 26910, 26918,
+    26943, 2227, 26945, 2229, 26954, 2232, 26986, 2249, 32118, 2263, 32139, 2278,
+    32148, 2285, 2154, 3857};
+  crs_struct crs;
+  double x[TRANSFORM_BLOCK], y[TRANSFORM_BLOCK], lon, lat, error, max_error;
+  int    failures = 0, i, j, n;
+
+  if (verbose)
+    printf ("Control points\n");
+  memset (&crs, 0, sizeof(crs));
+  crs.unit = US_FOOT;
+  InitLambert (&crs, 6378206.4, 1 / 294.9786982, 28 + 23 / 60.0, 30 + 17 / 60.0,
+    27 + 50 / 60.0, -99, 2000000 * US_FOOT, 0);
+  failures += CheckPoints ("32040", &crs, texas, 1, 0.01, verbose);
+  memset (&crs, 0, sizeof(crs));
+  crs.unit = 1;
+  InitTransverseMercator (&crs, 6377563.396, 1 / 299.3249646, 49, -2, 0.9996012717, 400000, -100000);
+  failures += CheckPoints ("27700", &crs, britain, 1, 0.01, verbose);
+  InitCrs (&crs, 3857);
+  failures += CheckPoints ("3857", &crs, web_mercator, 1, 0.01, verbose);
+  InitCrs (&crs, 32631);
+  failures += CheckPoints ("32631", &crs, utm31, 2, 0.001, verbose);
+  InitCrs (&crs, 2154);
+  failures += CheckPoints ("2154", &crs, lambert93, 1, 0.001, verbose);
+
+  /* Round trips over the area of each coordinate system: 6 degrees on each
+     side of the central meridian, from 80S to 84N for UTM, 10 degrees around
+     the origin for Lambert */
+  if (verbose)
+    printf ("Round trips (largest error, in degrees)\n");
+  for (j=0; j<(int)(sizeof(srids)/sizeof(srids[0])); j++) {
+    InitCrs (&crs, srids[j]);
+    for (i=0, n=0; i<TRANSFORM_BLOCK; i++) {
+      lon = crs.lon0 / DEGREES + (i % 16 - 7.5) * (crs.kind == CRS_LAMBERT ? 1.25 : 0.75);
+      if (crs.kind == CRS_LAMBERT)
+        lat = (crs.n > 0 ? 1 : -1) * asin (fabs (crs.n)) / DEGREES + (i / 16 - 7.5) * 1.25;
+      else
+        lat = -80 + (i / 16) * 164.0 / 15;
+      x[n] = lon * DEGREES;
+      y[n++] = lat * DEGREES;
+    }
+    FromGeographic (&crs, x, y, n);
+    ToGeographic (&crs, x, y, n);
+    for (i=0, max_error=0; i<n; i++) {
+      lon = crs.lon0 / DEGREES + (i % 16 - 7.5) * (crs.kind == CRS_LAMBERT ? 1.25 : 0.75);
+      if (crs.kind == CRS_LAMBERT)
+        lat = (crs.n > 0 ? 1 : -1) * asin (fabs (crs.n)) / DEGREES + (i / 16 - 7.5) * 1.25;
+      else
+        lat = -80 + (i / 16) * 164.0 / 15;
+      if (crs.kind == CRS_WEB_MERCATOR && fabs (lat) > MAX_LATITUDE)
+        continue;
+      error = hypot (x[i] / DEGREES - lon, y[i] / DEGREES - lat);
+      max_error = error > max_error ? error : max_error;
+    }
+    if (max_error > 1e-9)
+      failures++;
+    if (verbose)
+      printf ("  %-6d %.1e  %s\n", srids[j], max_error, max_error > 1e-9 ? "FAILED" : "ok");
+  }
+
+  if (verbose)
+    printf ("%d failures\n", failures);
+  return failures;
+}
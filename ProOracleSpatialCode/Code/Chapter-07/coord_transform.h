@@ -0,0 +1,121 @@
+/* coord_transform.h
+
+   Client-side transformation of coordinates between coordinate systems.
+
+   This is a client-side counterpart of SDO_CS.TRANSFORM (see chapter 8)
+   for the most common cases, so that programs can reproject the geometries
+   they read or load without asking the database to do it:
+
+   - longitude / latitude: 8307 and 4326 (WGS 84), 8265 and 4269 (NAD 83)
+   - Web Mercator: 3857 (and its older numbers 3785 and 900913)
+   - UTM: 32601 to 32660 (WGS 84, north), 32701 to 32760 (WGS 84, south)
+     and 26901 to 26923 (NAD 83, north)
+   - Lambert conformal conic: the NAD 83 state plane zones of the table in
+     coord_transform.c, in meters or US survey feet, and Lambert-93
+     (2154) for France
+
+   A transformation goes through longitude and latitude: the coordinates
+   are converted from the source system to longitude and latitude, then
+   from longitude and latitude to the target system, with the formulas of
+   the EPSG guidance note 7-2:
+
+   - transverse Mercator (UTM) with the series of Krueger to the sixth
+     order, which are accurate to a few nanometers within 4000 km of the
+     central meridian
+   - Lambert conformal conic with two standard parallels
+   - Web Mercator on a sphere of the radius of the WGS 84 ellipsoid, with
+     latitudes limited to +/-85.0511 degrees
+
+   There is no change of datum: NAD 83 and WGS 84 are taken to be the same,
+   which they are to within two meters. Transformations that need a datum
+   shift (NAD 27 for instance) must still be done with SDO_CS.TRANSFORM.
+
+   Only the X and Y of each point are transformed: the third ordinate (Z
+   or measure) is kept as it is. Arcs, circles and optimized rectangles are
+   transformed point by point: they keep their definition, and are only
+   exact for their points.
+
+   The ordinates of a geometry are transformed in blocks of TRANSFORM_BLOCK
+   points. The X and Y of a block are first copied from the interleaved
+   ordinates into two arrays, with separate loops for 2 and 3 dimensions
+   (the strides are constants), then each step of the transformation is
+   one loop over these arrays, without branches, and the results are copied
+   back. When the program is compiled with -O3 -ffast-math and a target
+   with AVX2 (-march=x86-64-v3 or -march=native), the compiler turns these
+   loops into vector instructions, and calls the vector versions of sin,
+   exp, pow, atan2 and the like of the GNU math library (glibc 2.35 and
+   later), four points at a time. Without -march, the loops that bring the
+   longitudes back between -180 and 180 degrees stay scalar, as floor has
+   no vector instruction before SSE4.1.
+
+   CheckTransforms compares the results with the control points of the
+   EPSG guidance note, and checks that each supported coordinate system
+   converts back to the same longitude and latitude.
+
+*/
+#ifndef COORD_TRANSFORM_H
+#define COORD_TRANSFORM_H
+
+#define TRANSFORM_BLOCK 256
+
+/* Kinds of coordinate systems */
+#define CRS_GEOGRAPHIC 1
+#define CRS_WEB_MERCATOR 2
+#define CRS_TRANSVERSE_MERCATOR 3
+#define CRS_LAMBERT 4
+
+/* A coordinate system, with the constants of its formulas. Angles are in
+   radians, lengths in meters */
+struct crs
+{
+    int    srid;
+    int    kind;
+    double a;                         /* Semi-major axis of the ellipsoid */
+    double e;                         /* Eccentricity */
+    double lon0;                      /* Central meridian */
+    double false_easting;
+    double false_northing;
+    double unit;                      /* Meters per unit of the coordinates */
+    double k0;                        /* Scale factor on the central meridian */
+    double A;                         /* Transverse Mercator: rectifying radius */
+    double M0;                        /* Transverse Mercator: northing of the origin */
+    double alpha[6];                  /* Transverse Mercator: series of Krueger */
+    double beta[6];
+    double n;                         /* Lambert: cone constant */
+    double aF;                        /* Lambert: a * F */
+    double rF;                        /* Lambert: radius of the origin */
+};
+typedef struct crs crs_struct;
+
+/* A transformation from one coordinate system to another */
+struct transform
+{
+    crs_struct source;
+    crs_struct target;
+};
+typedef struct transform transform_struct;
+
+/* Transformation settings, as set from the command line */
+struct transform_options
+{
+    int              to_srid;         /* 0 if not requested */
+    int              from_srid;       /* For the geometries that have no SRID */
+    int              current_srid;    /* Source of the transformation below */
+    transform_struct transform;
+    long             geometries;      /* Geometries transformed */
+    long             points;
+    long             skipped;         /* Geometries left as they are */
+    double           seconds;
+};
+typedef struct transform_options transform_options_struct;
+
+int  InitCrs (crs_struct *crs, int srid);
+int  InitTransform (transform_struct *transform, int from_srid, int to_srid);
+void TransformOrdinates (const transform_struct *transform, double *ordinates, long n_points, int dim);
+int  TransformElements (transform_options_struct *options, int srid, double *point_x, double *point_y,
+                        double *ordinates, int n_ordinates, int dim);
+int  ParseTransformOptions (int *argc, char **argv, transform_options_struct *options);
+void PrintTransformStatistics (transform_options_struct *options);
+int  CheckTransforms (int verbose);
+
+#endif
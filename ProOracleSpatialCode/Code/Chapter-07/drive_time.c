@@ -0,0 +1,459 @@
+/* drive_time.c
+
+   This program computes the drive time polygons (service areas) of a set
+   of locations, such as stores, on an SDO_NET network (see chapter 10).
+
+   It is the client-side counterpart of the withinCost method of the SDO_NET
+   Java API, run for many sources at once. The network is loaded into memory
+   as in shortest_path.c, and each location is attached to the nearest node
+   of the network. The nodes that can be reached from each of them within a
+   cost are found with Dijkstra's algorithm, and turned into a polygon by
+   buffering the links reached (see isochrone.h). The sources are processed
+   by several threads.
+
+   The locations are read from a point dump written by read_points_array.c
+   (see point_dump.h), with their id column:
+
+     read_points_array scott tiger orcl stores location 10000 0 id --dump=stores.pts
+
+   The polygons are written in the input format of load_geom.c, so that
+   they are loaded into a table by the same path as other client-side
+   geometries:
+
+     drive_time scott tiger orcl roads stores.pts 600 50 areas.txt areas.csv
+     load_geom scott tiger orcl store_areas id geom areas.txt
+
+   It illustrates the following concepts:
+   - reading numeric columns with array fetches
+   - reading the metadata of a network
+
+   The program takes the following command line arguments:
+
+     drive_time username password database network sources max_cost buffer polygons stats
+       [threads] [array_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - network = name of the network
+   - sources = point dump of the locations to compute polygons for
+   - max_cost = cost to reach, in the unit of the link costs (for instance
+     seconds of drive time)
+   - buffer = distance around the links reached that is included in the
+     polygons, in the unit of the coordinates, or in meters if the network
+     is geodetic
+   - polygons = name of the file to write the polygons to, one line per
+     location: id 3 2 x1 y1 ... xn yn
+   - stats = name of the CSV file to write the work done for each location
+     to: source_id,node_id,snap_distance,nodes_reached,arcs,search_ms,
+     polygon_ms,vertices
+   - threads = number of threads (default is one per processor)
+   - array_size = number of rows to read per fetch (default is 1000 rows)
+
+   Notes:
+
+   The program must be linked with sdo_net.c, road_network.c, isochrone.c,
+   simplify.c, point_tree.c, point_dump.c and spatial_util.c. On Linux and
+   other POSIX systems it also needs the POSIX threads library.
+
+   The locations must be in the coordinate system of the network. The ids
+   written are those of the dump, or the position of the location in the
+   dump (from 1) if the dump has no ids. The snap distance is the distance
+   from the location to its node, in meters if the network is geodetic.
+
+   load_geom.c stores the polygons without SRID: set the SDO_SRID of the
+   loaded geometries to that of the network before indexing them.
+
+   The times in the stats file are those of each source in its thread.
+   With several threads, the throughput is the number of sources divided by
+   the total time.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <oci.h>
+#include "sdo_net.h"
+#include "isochrone.h"
+#include "point_dump.h"
+#include "point_tree.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle*/
+OCIError     *errhp;  /* Error handle */
+OCISvcCtx    *svchp;  /* Service Context handle*/
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_DEFAULT),              /* (in)  Mode: default */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&errhp,                /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ConnectDatabase
+**
+** Description: Connects to the oracle database
+*******************************************************************************/
+void ConnectDatabase(
+        char *username,
+        char *password,
+        char *database)
+{
+  int status;
+  char verbuf[512];
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      errhp,                         /* (in)  Error Handle */
+      &svchp,                        /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get database version */
+  OCIServerVersion(
+    svchp,                             /* (in)  Service Context Handle */
+    errhp,                             /* (in)  Error Handle */
+    verbuf,                            /* (out) Buffer to receive version message */
+    sizeof(verbuf),                    /* (in)  Size of message buffer */
+    OCI_HTYPE_SVCCTX);                 /* (in)  Type of handle (service context) */
+
+  printf("Connected to: %s\n", database);
+  printf("%s\n\n", verbuf);
+}
+
+/*******************************************************************************
+** Routine:     DisconnectDatabase
+**
+** Description: Disconnect from Oracle
+*******************************************************************************/
+void DisconnectDatabase(void)
+{
+  int status;
+
+  status = OCILogoff(svchp, errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)errhp,                  /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+/*******************************************************************************
+** Routine:     PointId
+**
+** Description: Id of a point of a dump: its id, or its position from 1
+*******************************************************************************/
+long PointId (point_dump_struct *dump, long i)
+{
+  return dump->id != NULL ? (long) dump->id[i] : i + 1;
+}
+
+/*******************************************************************************
+** Routine:     CompareDoubles
+**
+** Description: Comparison function for qsort
+*******************************************************************************/
+int CompareDoubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/*******************************************************************************
+** Routine:     WritePolygons
+**
+** Description: Write the polygon of each source in the input format of
+**              load_geom.c: id type dim x1 y1 ... xn yn
+*******************************************************************************/
+void WritePolygons (
+  char              *filename,
+  point_dump_struct *sources,
+  isochrone_struct  *isochrones)
+{
+  FILE *file;
+  long i;
+  int  j;
+
+  file = fopen (filename, "w");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    exit (1);
+  }
+  for (i=0; i<sources->count; i++) {
+    if (isochrones[i].n_ordinates == 0)
+      continue;
+    fprintf (file, "%ld 3 2", PointId (sources, i));
+    for (j=0; j<isochrones[i].n_ordinates; j++)
+      fprintf (file, " %.17g", isochrones[i].ordinates[j]);
+    fprintf (file, "\n");
+  }
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     WriteStats
+**
+** Description: Write the work done for each source to a CSV file, and print
+**              a summary of the time per source
+*******************************************************************************/
+void WriteStats (
+  char                *filename,
+  road_network_struct *network,
+  point_dump_struct   *sources,
+  long                *source_node,
+  double              *snap_distance,
+  isochrone_struct    *isochrones,
+  double              elapsed)
+{
+  FILE   *file;
+  double *latency, total = 0, reached = 0;
+  long   i, n = (long) sources->count;
+
+  file = fopen (filename, "w");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    exit (1);
+  }
+  latency = malloc (sizeof(double) * n);
+  fprintf (file, "source_id,node_id,snap_distance,nodes_reached,arcs,search_ms,polygon_ms,vertices\n");
+  for (i=0; i<n; i++) {
+    fprintf (file, "%ld,%ld,%.6f,%ld,%ld,%.3f,%.3f,%d\n", PointId (sources, i),
+      network->node_id[source_node[i]], snap_distance[i], isochrones[i].n_reached,
+      isochrones[i].n_arcs, isochrones[i].search_seconds * 1000,
+      isochrones[i].polygon_seconds * 1000, isochrones[i].n_ordinates / 2);
+    latency[i] = (isochrones[i].search_seconds + isochrones[i].polygon_seconds) * 1000;
+    total += latency[i];
+    reached += isochrones[i].n_reached;
+  }
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    exit (1);
+  }
+
+  qsort (latency, n, sizeof(double), CompareDoubles);
+  printf ("%ld sources in %.3f seconds (%.1f sources per second), %.0f nodes reached on average\n",
+    n, elapsed, n / (elapsed > 0 ? elapsed : 1e-9), reached / n);
+  printf ("Time per source: mean %.3f ms, median %.3f ms, P95 %.3f ms, max %.3f ms\n",
+    total / n, latency[n / 2], latency[(long) (n * 0.95)], latency[n - 1]);
+  free (latency);
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *username, *password, *database, *network_name;
+    char   *source_file, *polygon_file, *stats_file;
+    int    array_size, n_threads;
+    double max_cost, buffer, start_time, elapsed;
+    road_network_struct *network;
+    point_dump_struct   sources;
+    point_tree_struct   *tree;
+    isochrone_struct    *isochrones;
+    long   *source_node;
+    double *snap_distance;
+
+    if( argc < 10 || argc > 12) {
+      printf("USAGE: %s <username> <password> <database> <network> <sources> <max_cost> <buffer> <polygons> <stats> [<threads>] [<array_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      network_name = argv[4];
+      source_file = argv[5];
+      max_cost = atof(argv[6]);
+      if (max_cost <= 0) {
+        printf ("Invalid cost: must be positive\n");
+        exit( 1 );
+      }
+      buffer = atof(argv[7]);
+      if (buffer <= 0) {
+        printf ("Invalid buffer: must be positive\n");
+        exit( 1 );
+      }
+      polygon_file = argv[8];
+      stats_file = argv[9];
+      if (argc > 10)
+        n_threads = atoi(argv[10]);
+      else
+        n_threads = ProcessorThreads(ISOCHRONE_MAX_THREADS);
+      if (n_threads <= 0 || n_threads > ISOCHRONE_MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", ISOCHRONE_MAX_THREADS);
+        exit( 1 );
+      }
+      if (argc > 11)
+        array_size = atoi(argv[11]);
+      else
+        array_size = 1000;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+    }
+
+    /* Map the sources */
+    if (OpenPointDump (source_file, &sources) != 0)
+      exit( 1 );
+    if (sources.count == 0) {
+      printf ("No sources in %s\n", source_file);
+      exit( 1 );
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Connect to database */
+    ConnectDatabase(username, password, database);
+
+    /* Load the network */
+    start_time = ElapsedSeconds ();
+    network = LoadSdoNetwork (envhp, errhp, svchp, network_name, array_size);
+    if (network == NULL) {
+      printf ("The network has no nodes\n");
+      exit( 1 );
+    }
+    printf ("Network of %ld nodes and %ld arcs loaded in %.3f seconds\n",
+      network->n_nodes, network->n_arcs, ElapsedSeconds () - start_time);
+
+    /* disconnect from database */
+    DisconnectDatabase();
+
+    /* Attach each source to the nearest node */
+    source_node = malloc (sizeof(long) * sources.count);
+    snap_distance = malloc (sizeof(double) * sources.count);
+    tree = BuildPointTree (network->x, network->y, network->n_nodes, network->geodetic);
+    NearestPointsJoin (tree, sources.x, sources.y, (long) sources.count, 1,
+      n_threads > POINT_TREE_MAX_THREADS ? POINT_TREE_MAX_THREADS : n_threads,
+      source_node, snap_distance);
+    FreePointTree (tree);
+
+    /* Compute the polygons */
+    printf ("%ld sources, cost %g, buffer %g, %d threads\n\n",
+      (long) sources.count, max_cost, buffer, n_threads);
+    isochrones = malloc (sizeof(isochrone_struct) * sources.count);
+    start_time = ElapsedSeconds ();
+    ComputeIsochrones (network, source_node, (long) sources.count, max_cost, buffer,
+      n_threads, isochrones);
+    elapsed = ElapsedSeconds () - start_time;
+
+    WritePolygons (polygon_file, &sources, isochrones);
+    WriteStats (stats_file, network, &sources, source_node, snap_distance, isochrones, elapsed);
+    printf ("Polygons written to %s, statistics to %s\n", polygon_file, stats_file);
+
+    FreeIsochrones (isochrones, (long) sources.count);
+    free (isochrones);
+    free (source_node);
+    free (snap_distance);
+    FreeRoadNetwork (network);
+    ClosePointDump (&sources);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
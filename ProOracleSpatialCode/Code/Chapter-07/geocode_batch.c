@@ -0,0 +1,799 @@
+/* geocode_batch.c
+
+   This program geocodes a file of addresses, and writes the location and
+   match details of each address to a CSV file.
+
+   Chapter 6 geocodes addresses one at a time, with one call to
+   SDO_GCDR.GEOCODE per address (listings 6-2 and 6-19). This program sends
+   them in batches: the address lines of array_size addresses are bound as
+   arrays to an anonymous PL/SQL block, which is executed once per address
+   of the batch in a single round trip:
+
+     DECLARE
+       address SDO_GEO_ADDR;
+     BEGIN
+       IF :line2 IS NULL THEN
+         address := SDO_GCDR.GEOCODE (USER, SDO_KEYWORDARRAY (:line1), 'US', 'DEFAULT');
+       ELSE
+         address := SDO_GCDR.GEOCODE (USER, SDO_KEYWORDARRAY (:line1, :line2), 'US', 'DEFAULT');
+       END IF;
+       :longitude := address.longitude;
+       ...
+     END;
+
+   The fields of the SDO_GEO_ADDR result are returned in arrays of output
+   bind variables. Several threads read batches from the input file, each
+   with its own database session, so that the geocoder runs in several
+   server processes at the same time.
+
+   The results are kept in a cache file (see geocode_cache.h). The
+   addresses found in the cache, from a previous run or from earlier in the
+   same run, are not sent to the database.
+
+   It illustrates the following concepts:
+   - binding arrays of input and output variables
+   - executing a PL/SQL block once per element of the bound arrays
+   - using OCI from several threads, with one session per thread
+
+   The program takes the following command line arguments:
+
+     geocode_batch username password database input output country cache [sessions] [array_size] [match_mode]
+
+   where
+
+   - username = name of the user to connect as. The geocoding data (see
+     chapter 6) must be in the schema of that user.
+   - password = password for that user
+   - database = TNS service name for the database
+   - input = name of the file of addresses, one address per line:
+     id|line1|line2, for instance 1|1250 Clay Street|San Francisco, CA. The
+     second line can be left out.
+   - output = name of the CSV file to write the results to:
+     id,longitude,latitude,srid,match_code,error_message,cached
+   - country = country code of the addresses, as passed to SDO_GCDR.GEOCODE
+     (for instance US)
+   - cache = name of the cache file. It is created if it does not exist.
+   - sessions = number of threads and database sessions (default is 4)
+   - array_size = number of addresses per batch (default is 100)
+   - match_mode = match mode passed to SDO_GCDR.GEOCODE (default is DEFAULT)
+
+   Notes:
+
+   The program must be linked with geocode_cache.c. It uses POSIX threads.
+
+   The batches are written out as they complete: the order of the output
+   rows is not that of the input file. The match code is 0 for addresses that
+   are not found, and -1 for addresses that raised an error, in which case
+   the error message is that of the exception. Addresses that raised an
+   error are not kept in the cache.
+
+   The cache must be deleted when the geocoding data is reloaded, or when
+   another country or match mode is used with the same cache file and the
+   addresses may overlap.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <oci.h>
+#include "geocode_cache.h"
+
+#define MAX_THREADS 64
+#define GEOCODE_LINE_LENGTH 200       /* Maximum length of an address line */
+#define PROGRESS_INTERVAL 100000      /* Addresses between progress reports */
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle, shared by all threads */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* The input, output and cache, shared by all threads */
+struct geocode_batch
+{
+    FILE                 *input;
+    long                 line_number;
+    FILE                 *output;
+    geocode_cache_struct *cache;
+    char                 *country;
+    pthread_mutex_t      input_lock;  /* Protects the input */
+    pthread_mutex_t      output_lock; /* Protects the output and the counts */
+    pthread_mutex_t      cache_lock;
+    long                 n_addresses; /* Addresses written */
+    long                 n_cached;    /* Addresses found in the cache */
+    double               start_time;
+};
+typedef struct geocode_batch geocode_batch_struct;
+
+/* A database session, used by one thread only, with its bind arrays */
+struct session
+{
+    OCIError              *errhp;     /* Error handle */
+    OCISvcCtx             *svchp;     /* Service Context handle */
+    OCIStmt               *stmthp;    /* Geocoding block */
+    int                   array_size;
+    /* The addresses of a batch */
+    int                   n_addresses;
+    long                  *id;
+    uint64_t              *hash;
+    geocode_result_struct *result;
+    int                   *cached;
+    /* The addresses sent to the database (bind arrays) */
+    int                   n_sent;
+    int                   *position;  /* Position of each in the batch */
+    char                  *line1;
+    sb2                   *line1_ind;
+    char                  *line2;
+    sb2                   *line2_ind;
+    double                *longitude;
+    sb2                   *longitude_ind;
+    double                *latitude;
+    sb2                   *latitude_ind;
+    int                   *srid;
+    sb2                   *srid_ind;
+    int                   *match_code;
+    sb2                   *match_code_ind;
+    char                  *message;
+    sb2                   *message_ind;
+    /* Statistics */
+    long                  n_geocoded; /* Addresses sent to the database */
+    long                  n_batches;
+    double                database_seconds;
+};
+typedef struct session session_struct;
+
+/* A worker thread */
+struct worker
+{
+    int                  id;
+    geocode_batch_struct *batch;
+    session_struct       session;
+    pthread_t            thread;
+};
+typedef struct worker worker_struct;
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = -1;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                  /* (in)  Error handle */
+    (ub4)1,                          /* (in)  Number of error record */
+    (text *)NULL,                    /* (out) SQLSTATE (no longer used) */
+    &errcode,                        /* (out) Error code */
+    errbuf,                          /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),             /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "ERROR %d: %s\n", errcode, errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context. The environment is shared by all
+**              threads, so it is created in threaded mode.
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_THREADED),             /* (in)  Mode: threads */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     BindArray
+**
+** Description: Bind an array of array_size values to a placeholder
+*******************************************************************************/
+void BindArray(
+  session_struct *session,
+  char           *placeholder,
+  dvoid          *values,
+  sb4            value_size,
+  ub2            type,
+  sb2            *indicators)
+{
+  OCIBind *bind_hp = NULL;
+  sword   status;
+
+  status = OCIBindByName(
+    session->stmthp,                 /* (in)  Statement Handle */
+    &bind_hp,                        /* (out) Bind Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *) placeholder,            /* (in)  Placeholder */
+    strlen(placeholder),             /* (in)  Placeholder length */
+    values,                          /* (in)  Value Pointer (first element) */
+    value_size,                      /* (in)  Value Size (of one element) */
+    type,                            /* (in)  Data Type */
+    (dvoid *) indicators,            /* (in)  Indicator Pointer (first element) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     OpenSession
+**
+** Description: Connect to the database, prepare the geocoding block and bind
+**              its arrays
+*******************************************************************************/
+void OpenSession(
+  session_struct *session,
+  char           *username,
+  char           *password,
+  char           *database,
+  char           *country,
+  char           *match_mode,
+  int            array_size)
+{
+  char   geocode_block[2048];
+  sword  status;
+  int    n = array_size;
+
+  memset (session, 0, sizeof(session_struct));
+  session->array_size = array_size;
+  session->id = malloc (sizeof(long) * n);
+  session->hash = malloc (sizeof(uint64_t) * n);
+  session->result = malloc (sizeof(geocode_result_struct) * n);
+  session->cached = malloc (sizeof(int) * n);
+  session->position = malloc (sizeof(int) * n);
+  session->line1 = malloc ((GEOCODE_LINE_LENGTH+1) * n);
+  session->line1_ind = malloc (sizeof(sb2) * n);
+  session->line2 = malloc ((GEOCODE_LINE_LENGTH+1) * n);
+  session->line2_ind = malloc (sizeof(sb2) * n);
+  session->longitude = malloc (sizeof(double) * n);
+  session->longitude_ind = malloc (sizeof(sb2) * n);
+  session->latitude = malloc (sizeof(double) * n);
+  session->latitude_ind = malloc (sizeof(sb2) * n);
+  session->srid = malloc (sizeof(int) * n);
+  session->srid_ind = malloc (sizeof(sb2) * n);
+  session->match_code = malloc (sizeof(int) * n);
+  session->match_code_ind = malloc (sizeof(sb2) * n);
+  session->message = malloc ((GEOCODE_MESSAGE_LENGTH+1) * n);
+  session->message_ind = malloc (sizeof(sb2) * n);
+
+  /* The country and match mode are checked by the caller: they can go in
+     the text of the block */
+  sprintf (geocode_block,
+    "DECLARE "
+    "  address SDO_GEO_ADDR; "
+    "BEGIN "
+    "  IF :line2 IS NULL THEN "
+    "    address := SDO_GCDR.GEOCODE (USER, SDO_KEYWORDARRAY (:line1), '%s', '%s'); "
+    "  ELSE "
+    "    address := SDO_GCDR.GEOCODE (USER, SDO_KEYWORDARRAY (:line1, :line2), '%s', '%s'); "
+    "  END IF; "
+    "  :longitude := address.longitude; "
+    "  :latitude := address.latitude; "
+    "  :srid := address.srid; "
+    "  :match_code := NVL (address.matchcode, 0); "
+    "  :message := SUBSTR (address.errormessage, 1, %d); "
+    "EXCEPTION "
+    "  WHEN OTHERS THEN "
+    "    :longitude := NULL; "
+    "    :latitude := NULL; "
+    "    :srid := NULL; "
+    "    :match_code := -1; "
+    "    :message := SUBSTR (SQLERRM, 1, %d); "
+    "END;",
+    country, match_mode, country, match_mode, GEOCODE_MESSAGE_LENGTH, GEOCODE_MESSAGE_LENGTH);
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->errhp,       /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (session->errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      session->errhp,                /* (in)  Error Handle */
+      &session->svchp,               /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Prepare the geocoding block once: it is executed for each batch */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->stmthp,      /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    session->stmthp,                 /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)geocode_block,           /* (in)  SQL statement */
+    (ub4)strlen(geocode_block),      /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Bind the arrays: element i of each array goes to execution i */
+  BindArray (session, ":LINE1", session->line1, GEOCODE_LINE_LENGTH+1, SQLT_STR, session->line1_ind);
+  BindArray (session, ":LINE2", session->line2, GEOCODE_LINE_LENGTH+1, SQLT_STR, session->line2_ind);
+  BindArray (session, ":LONGITUDE", session->longitude, sizeof(double), SQLT_BDOUBLE, session->longitude_ind);
+  BindArray (session, ":LATITUDE", session->latitude, sizeof(double), SQLT_BDOUBLE, session->latitude_ind);
+  BindArray (session, ":SRID", session->srid, sizeof(int), SQLT_INT, session->srid_ind);
+  BindArray (session, ":MATCH_CODE", session->match_code, sizeof(int), SQLT_INT, session->match_code_ind);
+  BindArray (session, ":MESSAGE", session->message, GEOCODE_MESSAGE_LENGTH+1, SQLT_STR, session->message_ind);
+}
+
+/*******************************************************************************
+** Routine:     CloseSession
+**
+** Description: Disconnect from Oracle and release the session handles
+*******************************************************************************/
+void CloseSession(session_struct *session)
+{
+  sword status;
+
+  OCIHandleFree((dvoid *)session->stmthp, (ub4)OCI_HTYPE_STMT);
+
+  status = OCILogoff(session->svchp, session->errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)session->errhp,         /* (in)  Error Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  free (session->id);
+  free (session->hash);
+  free (session->result);
+  free (session->cached);
+  free (session->position);
+  free (session->line1);
+  free (session->line1_ind);
+  free (session->line2);
+  free (session->line2_ind);
+  free (session->longitude);
+  free (session->longitude_ind);
+  free (session->latitude);
+  free (session->latitude_ind);
+  free (session->srid);
+  free (session->srid_ind);
+  free (session->match_code);
+  free (session->match_code_ind);
+  free (session->message);
+  free (session->message_ind);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+/*******************************************************************************
+** Routine:     ReadBatch
+**
+** Description: Read the next batch of addresses into the arrays of a
+**              session. Returns the number of addresses read.
+*******************************************************************************/
+int ReadBatch (
+  geocode_batch_struct *batch,
+  session_struct       *session)
+{
+  char line[2 * GEOCODE_LINE_LENGTH + 64];
+  char *line1, *line2, *end;
+  int  n = 0;
+
+  pthread_mutex_lock (&batch->input_lock);
+  while (n < session->array_size && fgets (line, sizeof(line), batch->input) != NULL) {
+    batch->line_number++;
+    if (strchr (line, '\n') == NULL && !feof (batch->input)) {
+      printf ("Line %ld: too long\n", batch->line_number);
+      exit (1);
+    }
+    line[strcspn (line, "\r\n")] = '\0';
+    if (line[strspn (line, " \t")] == '\0')
+      continue;
+
+    /* id|line1|line2 */
+    session->id[n] = strtol (line, &end, 10);
+    if (end == line || *end != '|') {
+      printf ("Line %ld: invalid address record\n", batch->line_number);
+      exit (1);
+    }
+    line1 = end + 1;
+    line2 = strchr (line1, '|');
+    if (line2 != NULL)
+      *line2++ = '\0';
+    else
+      line2 = "";
+    if (strlen (line1) > GEOCODE_LINE_LENGTH || strlen (line2) > GEOCODE_LINE_LENGTH) {
+      printf ("Line %ld: address line longer than %d characters\n",
+        batch->line_number, GEOCODE_LINE_LENGTH);
+      exit (1);
+    }
+    strcpy (session->line1 + n * (GEOCODE_LINE_LENGTH+1), line1);
+    strcpy (session->line2 + n * (GEOCODE_LINE_LENGTH+1), line2);
+    n++;
+  }
+  pthread_mutex_unlock (&batch->input_lock);
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     LookupBatch
+**
+** Description: Look up the addresses of a batch in the cache. The addresses
+**              not found are packed at the start of the bind arrays.
+*******************************************************************************/
+void LookupBatch (
+  geocode_batch_struct *batch,
+  session_struct       *session)
+{
+  char *line1, *line2;
+  int  i;
+
+  session->n_sent = 0;
+  pthread_mutex_lock (&batch->cache_lock);
+  for (i=0; i<session->n_addresses; i++) {
+    line1 = session->line1 + i * (GEOCODE_LINE_LENGTH+1);
+    line2 = session->line2 + i * (GEOCODE_LINE_LENGTH+1);
+    session->hash[i] = AddressHash (line1, line2, batch->country);
+    session->cached[i] = LookupGeocodeCache (batch->cache, session->hash[i], &session->result[i]);
+    if (!session->cached[i]) {
+      if (session->n_sent != i) {
+        strcpy (session->line1 + session->n_sent * (GEOCODE_LINE_LENGTH+1), line1);
+        strcpy (session->line2 + session->n_sent * (GEOCODE_LINE_LENGTH+1), line2);
+      }
+      session->position[session->n_sent++] = i;
+    }
+  }
+  pthread_mutex_unlock (&batch->cache_lock);
+}
+
+/*******************************************************************************
+** Routine:     GeocodeBatch
+**
+** Description: Geocode the addresses of the bind arrays in one execution of
+**              the block, and add the results to the cache
+*******************************************************************************/
+void GeocodeBatch (
+  geocode_batch_struct *batch,
+  session_struct       *session)
+{
+  geocode_result_struct *result;
+  double start_time;
+  sword  status;
+  int    k;
+
+  if (session->n_sent == 0)
+    return;
+  for (k=0; k<session->n_sent; k++) {
+    session->line1_ind[k] = session->line1[k * (GEOCODE_LINE_LENGTH+1)] != '\0' ? 0 : -1;
+    session->line2_ind[k] = session->line2[k * (GEOCODE_LINE_LENGTH+1)] != '\0' ? 0 : -1;
+  }
+
+  /* Execute the block once per address */
+  start_time = ElapsedSeconds ();
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    session->stmthp,                 /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)session->n_sent,            /* (in)  Number of executions */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  session->database_seconds += ElapsedSeconds () - start_time;
+  session->n_geocoded += session->n_sent;
+  session->n_batches++;
+
+  /* Collect the results */
+  for (k=0; k<session->n_sent; k++) {
+    result = &session->result[session->position[k]];
+    result->longitude = session->longitude_ind[k] == 0 ? session->longitude[k] : NAN;
+    result->latitude = session->latitude_ind[k] == 0 ? session->latitude[k] : NAN;
+    result->srid = session->srid_ind[k] == 0 ? session->srid[k] : 0;
+    result->match_code = session->match_code_ind[k] == 0 ? session->match_code[k] : 0;
+    if (session->message_ind[k] == 0)
+      strcpy (result->error_message, session->message + k * (GEOCODE_MESSAGE_LENGTH+1));
+    else
+      result->error_message[0] = '\0';
+  }
+
+  /* Keep them for the next time, except for the errors */
+  pthread_mutex_lock (&batch->cache_lock);
+  for (k=0; k<session->n_sent; k++) {
+    result = &session->result[session->position[k]];
+    if (result->match_code >= 0 &&
+        AddGeocodeCache (batch->cache, session->hash[session->position[k]], result) != 0)
+      exit (1);
+  }
+  pthread_mutex_unlock (&batch->cache_lock);
+}
+
+/*******************************************************************************
+** Routine:     WriteQuoted
+**
+** Description: Write a string as a quoted CSV field
+*******************************************************************************/
+void WriteQuoted (FILE *file, char *s)
+{
+  putc ('"', file);
+  for (; *s != '\0'; s++) {
+    if (*s == '"')
+      putc ('"', file);
+    putc (*s, file);
+  }
+  putc ('"', file);
+}
+
+/*******************************************************************************
+** Routine:     WriteBatch
+**
+** Description: Write the results of a batch, and report progress
+*******************************************************************************/
+void WriteBatch (
+  geocode_batch_struct *batch,
+  session_struct       *session)
+{
+  geocode_result_struct *result;
+  double elapsed;
+  int    i;
+
+  pthread_mutex_lock (&batch->output_lock);
+  for (i=0; i<session->n_addresses; i++) {
+    result = &session->result[i];
+    fprintf (batch->output, "%ld,", session->id[i]);
+    if (!isnan (result->longitude) && !isnan (result->latitude))
+      fprintf (batch->output, "%.9f,%.9f,", result->longitude, result->latitude);
+    else
+      fprintf (batch->output, ",,");
+    if (result->srid != 0)
+      fprintf (batch->output, "%d", result->srid);
+    fprintf (batch->output, ",%d,", result->match_code);
+    WriteQuoted (batch->output, result->error_message);
+    fprintf (batch->output, ",%d\n", session->cached[i]);
+    if (session->cached[i])
+      batch->n_cached++;
+    batch->n_addresses++;
+    if (batch->n_addresses % PROGRESS_INTERVAL == 0) {
+      elapsed = ElapsedSeconds () - batch->start_time;
+      printf ("%ld addresses, %.0f per second, %.1f%% from the cache\n", batch->n_addresses,
+        batch->n_addresses / elapsed, 100.0 * batch->n_cached / batch->n_addresses);
+    }
+  }
+  pthread_mutex_unlock (&batch->output_lock);
+}
+
+/*******************************************************************************
+** Routine:     WorkerThread
+**
+** Description: Thread routine: geocode batches until the input is exhausted
+*******************************************************************************/
+void *WorkerThread (void *argument)
+{
+  worker_struct  *worker = (worker_struct *) argument;
+  session_struct *session = &worker->session;
+
+  for (;;) {
+    session->n_addresses = ReadBatch (worker->batch, session);
+    if (session->n_addresses == 0)
+      break;
+    LookupBatch (worker->batch, session);
+    GeocodeBatch (worker->batch, session);
+    WriteBatch (worker->batch, session);
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     ValidName
+**
+** Description: Check that a country code or match mode only holds letters
+**              and underscores, so that it can go in the text of the block
+*******************************************************************************/
+int ValidName (char *name)
+{
+  char *c;
+
+  if (*name == '\0' || strlen (name) > 30)
+    return 0;
+  for (c=name; *c != '\0'; c++)
+    if (!isalpha ((unsigned char) *c) && *c != '_')
+      return 0;
+  return 1;
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *username, *password, *database;
+    char   *input_file, *output_file, *cache_file, *country, *match_mode;
+    int    n_threads, array_size, t;
+    long   n_geocoded = 0, n_batches = 0;
+    double elapsed, database_seconds = 0;
+    geocode_batch_struct batch;
+    worker_struct        workers[MAX_THREADS];
+
+    if( argc < 8 || argc > 11) {
+      printf("USAGE: %s <username> <password> <database> <input> <output> <country> <cache> [<sessions>] [<array_size>] [<match_mode>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      input_file = argv[4];
+      output_file = argv[5];
+      country = argv[6];
+      cache_file = argv[7];
+      if (argc > 8)
+        n_threads = atoi(argv[8]);
+      else
+        n_threads = 4;
+      if (n_threads <= 0 || n_threads > MAX_THREADS) {
+        printf ("Invalid number of sessions: must be between 1 and %d\n", MAX_THREADS);
+        exit( 1 );
+      }
+      if (argc > 9)
+        array_size = atoi(argv[9]);
+      else
+        array_size = 100;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 10)
+        match_mode = argv[10];
+      else
+        match_mode = "DEFAULT";
+      if (!ValidName (country) || !ValidName (match_mode)) {
+        printf ("Invalid country or match mode\n");
+        exit( 1 );
+      }
+    }
+
+    memset (&batch, 0, sizeof(batch));
+    batch.country = country;
+    batch.input = fopen (input_file, "r");
+    if (batch.input == NULL) {
+      printf ("Could not open %s\n", input_file);
+      exit( 1 );
+    }
+    batch.output = fopen (output_file, "w");
+    if (batch.output == NULL) {
+      printf ("Could not create %s\n", output_file);
+      exit( 1 );
+    }
+    fprintf (batch.output, "id,longitude,latitude,srid,match_code,error_message,cached\n");
+    batch.cache = OpenGeocodeCache (cache_file);
+    if (batch.cache == NULL)
+      exit( 1 );
+    printf ("%ld addresses in the cache\n", batch.cache->n_loaded);
+    pthread_mutex_init (&batch.input_lock, NULL);
+    pthread_mutex_init (&batch.output_lock, NULL);
+    pthread_mutex_init (&batch.cache_lock, NULL);
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Open the sessions */
+    for (t=0; t<n_threads; t++) {
+      workers[t].id = t;
+      workers[t].batch = &batch;
+      OpenSession (&workers[t].session, username, password, database, country, match_mode, array_size);
+    }
+    printf ("Connected to: %s, %d sessions\n\n", database, n_threads);
+
+    /* Run the threads: the calling thread is worker 0 */
+    batch.start_time = ElapsedSeconds ();
+    for (t=1; t<n_threads; t++)
+      if (pthread_create (&workers[t].thread, NULL, WorkerThread, &workers[t]) != 0) {
+        printf ("Could not start thread %d\n", t);
+        exit (1);
+      }
+    WorkerThread (&workers[0]);
+    for (t=1; t<n_threads; t++)
+      pthread_join (workers[t].thread, NULL);
+    elapsed = ElapsedSeconds () - batch.start_time;
+
+    for (t=0; t<n_threads; t++) {
+      n_geocoded += workers[t].session.n_geocoded;
+      n_batches += workers[t].session.n_batches;
+      database_seconds += workers[t].session.database_seconds;
+      CloseSession (&workers[t].session);
+    }
+
+    if (fclose (batch.output) != 0) {
+      printf ("Could not write %s\n", output_file);
+      exit( 1 );
+    }
+    fclose (batch.input);
+    if (CloseGeocodeCache (batch.cache) != 0)
+      exit( 1 );
+
+    printf ("%ld addresses in %.3f seconds (%.0f per second)\n",
+      batch.n_addresses, elapsed, batch.n_addresses / (elapsed > 0 ? elapsed : 1e-9));
+    printf ("%ld found in the cache (%.1f%%), %ld geocoded in %ld batches\n",
+      batch.n_cached, batch.n_addresses > 0 ? 100.0 * batch.n_cached / batch.n_addresses : 0.0,
+      n_geocoded, n_batches);
+    if (n_geocoded > 0)
+      printf ("Geocoder: %.3f ms per address in each session\n",
+        database_seconds * 1000 / n_geocoded);
+    printf ("Results written to %s\n", output_file);
+
+    pthread_mutex_destroy (&batch.input_lock);
+    pthread_mutex_destroy (&batch.output_lock);
+    pthread_mutex_destroy (&batch.cache_lock);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
@@ -0,0 +1,331 @@
+/* geocode_cache.c
+
+   Cache of geocoding results, kept in a file between runs. See
+   geocode_cache.h.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+#include "geocode_cache.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+/*******************************************************************************
+** Routine:     NormalizeAddress
+**
+** Description: Normalize an address line: upper case letters, punctuation
+**              replaced by spaces, single spaces between words. Digits,
+**              letters, other bytes (such as UTF-8 accented letters) and
+**              the characters - / & are kept.
+*******************************************************************************/
+void NormalizeAddress (const char *address, char *normalized, size_t size)
+{
+  const unsigned char *c;
+  size_t n = 0;
+  int    space = 0;
+
+  if (size == 0)
+    return;
+  for (c=(const unsigned char *)address; *c != '\0'; c++) {
+    if (isalnum (*c) || *c >= 128 || *c == '-' || *c == '/' || *c == '&') {
+      if (space && n > 0 && n + 1 < size)
+        normalized[n++] = ' ';
+      space = 0;
+      if (n + 1 < size)
+        normalized[n++] = (char) toupper (*c);
+    }
+    else
+      space = 1;
+  }
+  normalized[n] = '\0';
+}
+
+/*******************************************************************************
+** Routine:     HashString
+**
+** Description: Continue an FNV-1a hash with a string and a separator
+*******************************************************************************/
+static uint64_t HashString (uint64_t hash, const char *s)
+{
+  const unsigned char *c;
+
+  for (c=(const unsigned char *)s; *c != '\0'; c++) {
+    hash ^= *c;
+    hash *= FNV_PRIME;
+  }
+  hash ^= '\n';
+  hash *= FNV_PRIME;
+  return hash;
+}
+
+/*******************************************************************************
+** Routine:     AddressHash
+**
+** Description: Hash of the normalized lines and country of an address. The
+**              hash is never 0.
+*******************************************************************************/
+uint64_t AddressHash (const char *line1, const char *line2, const char *country)
+{
+  char     normalized[1024];
+  uint64_t hash = FNV_OFFSET;
+
+  NormalizeAddress (line1, normalized, sizeof(normalized));
+  hash = HashString (hash, normalized);
+  NormalizeAddress (line2, normalized, sizeof(normalized));
+  hash = HashString (hash, normalized);
+  NormalizeAddress (country, normalized, sizeof(normalized));
+  hash = HashString (hash, normalized);
+  return hash != 0 ? hash : 1;
+}
+
+/*******************************************************************************
+** Routine:     FindSlot
+**
+** Description: Slot of a hash in the table: the slot that holds it, or the
+**              empty slot where it goes
+*******************************************************************************/
+static long FindSlot (const geocode_cache_struct *cache, uint64_t hash)
+{
+  long slot = (long) (hash & (uint64_t) (cache->size - 1));
+
+  while (cache->entries[slot].hash != 0 && cache->entries[slot].hash != hash)
+    slot = (slot + 1) & (cache->size - 1);
+  return slot;
+}
+
+/*******************************************************************************
+** Routine:     StoreEntry
+**
+** Description: Add or replace an entry of the table, growing it when it is
+**              half full
+*******************************************************************************/
+static void StoreEntry (geocode_cache_struct *cache, uint64_t hash, const geocode_result_struct *result)
+{
+  geocode_entry_struct *old_entries;
+  long old_size, i, slot;
+
+  if (2 * (cache->count + 1) > cache->size) {
+    old_entries = cache->entries;
+    old_size = cache->size;
+    cache->size = old_size > 0 ? 2 * old_size : 1024;
+    cache->entries = calloc (cache->size, sizeof(geocode_entry_struct));
+    for (i=0; i<old_size; i++)
+      if (old_entries[i].hash != 0)
+        cache->entries[FindSlot (cache, old_entries[i].hash)] = old_entries[i];
+    free (old_entries);
+  }
+  slot = FindSlot (cache, hash);
+  if (cache->entries[slot].hash == 0)
+    cache->count++;
+  cache->entries[slot].hash = hash;
+  cache->entries[slot].result = *result;
+}
+
+/*******************************************************************************
+** Routine:     ParseEntry
+**
+** Description: Read a line of the cache file. Returns 0 if the line is
+**              valid.
+*******************************************************************************/
+static int ParseEntry (char *line, uint64_t *hash, geocode_result_struct *result)
+{
+  char *end;
+  int  n;
+
+  line[strcspn (line, "\r\n")] = '\0';
+  *hash = strtoull (line, &end, 16);
+  if (end == line || *hash == 0)
+    return -1;
+  line = end;
+  result->longitude = strtod (line, &end);
+  if (end == line)
+    return -1;
+  line = end;
+  result->latitude = strtod (line, &end);
+  if (end == line)
+    return -1;
+  line = end;
+  if (sscanf (line, "%d %d%n", &result->srid, &result->match_code, &n) != 2)
+    return -1;
+  line += n;
+  while (*line == ' ')
+    line++;
+  strncpy (result->error_message, line, GEOCODE_MESSAGE_LENGTH);
+  result->error_message[GEOCODE_MESSAGE_LENGTH] = '\0';
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     TruncateFile
+**
+** Description: Cut a file to a given size. Returns 0 on success.
+*******************************************************************************/
+static int TruncateFile (const char *filename, long size)
+{
+#ifdef _WIN32
+  int fd, status;
+
+  fd = _open (filename, _O_RDWR | _O_BINARY);
+  if (fd < 0)
+    return -1;
+  status = _chsize (fd, size);
+  _close (fd);
+  return status;
+#else
+  return truncate (filename, (off_t) size);
+#endif
+}
+
+/*******************************************************************************
+** Routine:     OpenGeocodeCache
+**
+** Description: Load a cache file, and open it to add new results. The file
+**              is created if it does not exist. Returns NULL if it cannot
+**              be read or written, or if a line other than the last one is
+**              not valid.
+**
+**              A run that stops while it appends a result can leave the
+**              last line cut short. That line is dropped, and the file is
+**              truncated after the last complete line, so that the next
+**              result does not get appended to it.
+*******************************************************************************/
+geocode_cache_struct *OpenGeocodeCache (const char *filename)
+{
+  geocode_cache_struct  *cache;
+  geocode_result_struct result;
+  uint64_t hash;
+  char     line[1024];
+  long     line_number = 0;
+  long     valid_size = 0;            /* Size up to the last valid line */
+  int      complete, valid, c;
+  FILE     *file;
+
+  cache = calloc (1, sizeof(geocode_cache_struct));
+  cache->filename = strdup (filename);
+
+  /* Load the existing entries */
+  file = fopen (filename, "rb");
+  if (file != NULL) {
+    while (fgets (line, sizeof(line), file) != NULL) {
+      line_number++;
+      complete = strchr (line, '\n') != NULL;
+      /* A line too long for the buffer is not valid: skip the rest of it */
+      if (!complete && !feof (file))
+        while ((c = getc (file)) != EOF && c != '\n')
+          ;
+      valid = complete && ParseEntry (line, &hash, &result) == 0;
+      if (!valid) {
+        c = getc (file);
+        if (c != EOF) {
+          printf ("Line %ld of geocode cache %s is not valid\n", line_number, filename);
+          fclose (file);
+          CloseGeocodeCache (cache);
+          return NULL;
+        }
+        /* The last line is incomplete or not valid: drop it */
+        fclose (file);
+        file = NULL;
+        printf ("Line %ld of geocode cache %s is incomplete: it is removed\n",
+          line_number, filename);
+        if (TruncateFile (filename, valid_size) != 0) {
+          printf ("Could not truncate geocode cache %s\n", filename);
+          CloseGeocodeCache (cache);
+          return NULL;
+        }
+        break;
+      }
+      StoreEntry (cache, hash, &result);
+      cache->n_loaded++;
+      valid_size = ftell (file);
+    }
+    if (file != NULL)
+      fclose (file);
+  }
+
+  cache->file = fopen (filename, "a");
+  if (cache->file == NULL) {
+    printf ("Could not open geocode cache %s\n", filename);
+    CloseGeocodeCache (cache);
+    return NULL;
+  }
+  return cache;
+}
+
+/*******************************************************************************
+** Routine:     LookupGeocodeCache
+**
+** Description: Find the result of an address from its hash. Returns 1 if
+**              found, 0 if not.
+*******************************************************************************/
+int LookupGeocodeCache (
+  const geocode_cache_struct *cache,
+  uint64_t                   hash,
+  geocode_result_struct      *result)
+{
+  long slot;
+
+  if (cache->size == 0)
+    return 0;
+  slot = FindSlot (cache, hash);
+  if (cache->entries[slot].hash == 0)
+    return 0;
+  *result = cache->entries[slot].result;
+  return 1;
+}
+
+/*******************************************************************************
+** Routine:     AddGeocodeCache
+**
+** Description: Add the result of an address to the cache and to its file.
+**              Returns 0 on success, -1 if the file cannot be written.
+*******************************************************************************/
+int AddGeocodeCache (
+  geocode_cache_struct        *cache,
+  uint64_t                    hash,
+  const geocode_result_struct *result)
+{
+  char message[GEOCODE_MESSAGE_LENGTH+1];
+
+  StoreEntry (cache, hash, result);
+
+  /* Keep the message on one line */
+  strncpy (message, result->error_message, GEOCODE_MESSAGE_LENGTH);
+  message[GEOCODE_MESSAGE_LENGTH] = '\0';
+  message[strcspn (message, "\r\n")] = '\0';
+  if (fprintf (cache->file, "%016" PRIx64 " %.17g %.17g %d %d %s\n", hash,
+       result->longitude, result->latitude, result->srid, result->match_code, message) < 0) {
+    printf ("Could not write geocode cache %s\n", cache->filename);
+    return -1;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     CloseGeocodeCache
+**
+** Description: Close the file of a cache, and free the cache. Returns 0 on
+**              success, -1 if the file could not be written.
+*******************************************************************************/
+int CloseGeocodeCache (geocode_cache_struct *cache)
+{
+  int status = 0;
+
+  if (cache->file != NULL && fclose (cache->file) != 0) {
+    printf ("Could not write geocode cache %s\n", cache->filename);
+    status = -1;
+  }
+  free (cache->entries);
+  free (cache->filename);
+  free (cache);
+  return status;
+}
@@ -0,0 +1,86 @@
+/* geocode_cache.h
+
+   Cache of geocoding results, kept in a file between runs.
+
+   Geocoding the same address twice gives the same result, as long as the
+   reference data of the geocoder (see chapter 6) does not change. A batch
+   of addresses often holds many repeats (the same customer on several
+   orders, the same building for several tenants), and a nightly batch
+   mostly repeats the addresses of the previous nights: the cache lets a
+   batch geocoder skip the addresses it has already sent to the database.
+
+   The addresses are normalized before they are looked up: letters are
+   turned to upper case, punctuation to spaces, and runs of spaces to a
+   single space, so that "1250 Clay St." and "1250  CLAY ST" share the same
+   entry. The normalized address lines and the country are hashed with the
+   64-bit FNV-1a function, and only the hash is kept: the chance that two
+   of ten million addresses share a hash is about three in a million.
+
+   The cache file is a text file with one line per address:
+
+     hash longitude latitude srid match_code error_message
+
+   where hash is written as 16 hexadecimal digits, and the error message
+   (the match details of SDO_GEO_ADDR) runs to the end of the line. The
+   whole file is loaded in a hash table when the cache is opened, and new
+   results are appended to it as they are added. When the same hash appears
+   several times, the last line wins.
+
+   A run that stops while it appends a line can leave that line incomplete.
+   When the cache is opened, an incomplete or invalid last line is dropped,
+   and the file is truncated after the last complete line. An invalid line
+   anywhere else means the file is damaged: the cache is not opened.
+
+   The cache is not thread-safe: threads that share a cache must serialize
+   their calls.
+
+*/
+#ifndef GEOCODE_CACHE_H
+#define GEOCODE_CACHE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define GEOCODE_MESSAGE_LENGTH 80
+
+/* The result of geocoding an address */
+struct geocode_result
+{
+    double longitude;
+    double latitude;
+    int    srid;
+    int    match_code;                /* 0 if the address was not found */
+    char   error_message[GEOCODE_MESSAGE_LENGTH+1];
+};
+typedef struct geocode_result geocode_result_struct;
+
+/* A cache entry */
+struct geocode_entry
+{
+    uint64_t              hash;       /* 0 for an empty slot */
+    geocode_result_struct result;
+};
+typedef struct geocode_entry geocode_entry_struct;
+
+/* A cache, with the file it is kept in */
+struct geocode_cache
+{
+    char                 *filename;
+    FILE                 *file;       /* Open for appending */
+    long                 count;       /* Addresses in the cache */
+    long                 size;        /* Slots of the hash table (a power of 2) */
+    geocode_entry_struct *entries;
+    long                 n_loaded;    /* Addresses read from the file */
+};
+typedef struct geocode_cache geocode_cache_struct;
+
+void NormalizeAddress (const char *address, char *normalized, size_t size);
+uint64_t AddressHash (const char *line1, const char *line2, const char *country);
+geocode_cache_struct *OpenGeocodeCache (const char *filename);
+int  LookupGeocodeCache (const geocode_cache_struct *cache, uint64_t hash,
+                         geocode_result_struct *result);
+int  AddGeocodeCache (geocode_cache_struct *cache, uint64_t hash,
+                      const geocode_result_struct *result);
+int  CloseGeocodeCache (geocode_cache_struct *cache);
+
+#endif
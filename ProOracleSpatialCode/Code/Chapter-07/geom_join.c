@@ -0,0 +1,981 @@
+/* geom_join.c
+
+   Partitioned spatial join of two layers of geometries. See geom_join.h for
+   a description of the method.
+
+   Each thread keeps its own range of cells, protected by its own mutex, and
+   collects its pairs in its own buffer. The buffers are concatenated when
+   all threads are done. A thread only holds one mutex at a time.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "geom_join.h"
+#include "spatial_util.h"
+
+#define JOIN_CELL_GEOMETRIES 64       /* Geometries per cell for the default grid */
+#define JOIN_BRUTE_FORCE 64           /* Edge pairs tested without sorting */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* An MBR to sweep, with the geometry or the edge it bounds */
+struct join_box
+{
+    double min_x, min_y;
+    double max_x, max_y;
+    long   index;
+};
+typedef struct join_box join_box_struct;
+
+/* A cell to process, with its position along the Hilbert curve */
+struct join_task
+{
+    uint64_t key;
+    long     cell;
+};
+typedef struct join_task join_task_struct;
+
+/* The grid shared by all threads */
+struct join_grid
+{
+    const join_layer_struct *layer1;
+    const join_layer_struct *layer2;
+    int    grid_size;
+    double min_x, min_y;              /* Extent of both layers */
+    double cell_width, cell_height;
+    long   *cell_start1;              /* First geometry of each cell (n_cells + 1) */
+    long   *cell_items1;              /* Geometries of the first layer, by cell */
+    long   *cell_start2;
+    long   *cell_items2;
+    join_task_struct *tasks;          /* Cells with geometries of both layers */
+    long   n_tasks;
+    struct join_worker *workers;
+    int    n_threads;
+};
+typedef struct join_grid join_grid_struct;
+
+/* A thread, with its range of tasks and its results */
+struct join_worker
+{
+    join_grid_struct *grid;
+    int              thread;
+#ifndef _WIN32
+    pthread_mutex_t  lock;            /* Protects next and end */
+#endif
+    long             next, end;       /* Range of tasks left to this thread */
+    long             cell;            /* Cell being processed */
+    long             n_stolen;
+    long             n_candidates;
+    join_pair_struct *pairs;          /* (out) Pairs found */
+    long             n_pairs;
+    long             size_pairs;
+    join_box_struct  *boxes[2];       /* Work arrays for geometries and edges */
+    long             size_boxes[2];
+    join_box_struct  *edges[2];
+    long             size_edges[2];
+};
+typedef struct join_worker join_worker_struct;
+
+/* The two geometries whose edges are swept */
+struct edge_pair
+{
+    const join_geometry_struct *g1;
+    const join_geometry_struct *g2;
+};
+typedef struct edge_pair edge_pair_struct;
+
+/*******************************************************************************
+** Routine:     InitJoinLayer
+**
+** Description: Initialize an empty layer
+*******************************************************************************/
+void InitJoinLayer (join_layer_struct *layer)
+{
+  layer->n_geometries = 0;
+  layer->size = 0;
+  layer->geometries = NULL;
+}
+
+/*******************************************************************************
+** Routine:     AddCircle
+**
+** Description: Add the vertices of the polygon that approximates the circle
+**              through three points. Returns the number of vertices added,
+**              or 0 if the points are collinear.
+*******************************************************************************/
+static int AddCircle (
+  const double *p,                    /* x1 y1 x2 y2 x3 y3 */
+  double       *x,
+  double       *y)
+{
+  double ax = p[0], ay = p[1], bx = p[2], by = p[3], cx = p[4], cy = p[5];
+  double d, ux, uy, radius, angle;
+  int    i;
+
+  d = 2 * (ax * (by - cy) + bx * (cy - ay) + cx * (ay - by));
+  if (d == 0)
+    return 0;
+  ux = ((ax*ax + ay*ay) * (by - cy) + (bx*bx + by*by) * (cy - ay) + (cx*cx + cy*cy) * (ay - by)) / d;
+  uy = ((ax*ax + ay*ay) * (cx - bx) + (bx*bx + by*by) * (ax - cx) + (cx*cx + cy*cy) * (bx - ax)) / d;
+  radius = sqrt ((ax - ux) * (ax - ux) + (ay - uy) * (ay - uy));
+  for (i=0; i<JOIN_CIRCLE_SEGMENTS; i++) {
+    angle = 2 * M_PI * i / JOIN_CIRCLE_SEGMENTS;
+    x[i] = ux + radius * cos (angle);
+    y[i] = uy + radius * sin (angle);
+  }
+  x[JOIN_CIRCLE_SEGMENTS] = x[0];
+  y[JOIN_CIRCLE_SEGMENTS] = y[0];
+  return JOIN_CIRCLE_SEGMENTS + 1;
+}
+
+/*******************************************************************************
+** Routine:     AddJoinGeometry
+**
+** Description: Add a geometry to a layer, from the content of an SDO_GEOMETRY
+**              object. Returns 0 if the geometry was added, or -1 if it is
+**              empty or its element info array is not valid.
+*******************************************************************************/
+int AddJoinGeometry (
+  join_layer_struct *layer,
+  long              id,
+  int               gtype,
+  int               has_point,
+  double            point_x,
+  double            point_y,
+  const int         *elem_info,
+  int               n_elem_info,
+  const double      *ordinates,
+  int               n_ordinates)
+{
+  join_geometry_struct *g;
+  int    dim = gtype / 1000;
+  int    n_elements = n_elem_info / 3;
+  int    e, next, etype, interpretation, first, last, i, n, max_vertices;
+  char   kind;
+
+  if (dim < 2)
+    dim = 2;
+
+  if (layer->n_geometries == layer->size) {
+    layer->size = layer->size > 0 ? 2 * layer->size : 1024;
+    layer->geometries = realloc (layer->geometries,
+      layer->size * sizeof(join_geometry_struct));
+  }
+  g = &layer->geometries[layer->n_geometries];
+
+  /* Bound the number of vertices: rings may need closing, rectangles and
+     circles are expanded */
+  max_vertices = n_ordinates / dim + 1;
+  for (e=0; e<n_elements; e++)
+    if (elem_info[3*e+2] == 3)
+      max_vertices += 5;
+    else if (elem_info[3*e+2] == 4)
+      max_vertices += JOIN_CIRCLE_SEGMENTS + 1;
+    else
+      max_vertices += 1;
+  g->x = malloc (max_vertices * sizeof(double));
+  g->y = malloc (max_vertices * sizeof(double));
+  g->part_start = malloc ((n_elements + 2) * sizeof(int));
+  g->part_kind = malloc (n_elements + 1);
+  g->n_parts = 0;
+  g->n_vertices = 0;
+  g->id = id;
+
+  /* A point stored in SDO_POINT */
+  if (n_elements == 0 && has_point) {
+    g->part_start[0] = 0;
+    g->part_kind[0] = JOIN_POINTS;
+    g->x[0] = point_x;
+    g->y[0] = point_y;
+    g->n_parts = 1;
+    g->n_vertices = 1;
+  }
+
+  /* Convert each element into a part. A compound element is followed by its
+     sub-elements: all its points go into one part */
+  for (e=0; e<n_elements; e=next) {
+    etype = elem_info[3*e+1];
+    interpretation = elem_info[3*e+2];
+    next = e + 1;
+    if (etype == 4 || etype == 1005 || etype == 2005)
+      next += interpretation;
+    first = elem_info[3*e] - 1;
+    last = next < n_elements ? elem_info[3*next] - 1 : n_ordinates;
+    if (first < 0 || last > n_ordinates || first >= last || first % dim != 0)
+      break;
+    first /= dim;
+    last /= dim;
+
+    if (etype == 1 && interpretation > 0)
+      kind = JOIN_POINTS;
+    else if (etype == 2 || etype == 4)
+      kind = JOIN_LINE;
+    else if (etype == 1003 || etype == 2003 || etype == 1005 || etype == 2005)
+      kind = JOIN_RING;
+    else
+      continue;                       /* Orientation of a point, or unknown */
+
+    g->part_start[g->n_parts] = g->n_vertices;
+    g->part_kind[g->n_parts] = kind;
+    n = g->n_vertices;
+    if (kind == JOIN_RING && interpretation == 3 && (etype == 1003 || etype == 2003)) {
+      /* Rectangle: lower left and upper right corners */
+      if (last - first < 2)
+        break;
+      g->x[n] = ordinates[first*dim];       g->y[n++] = ordinates[first*dim+1];
+      g->x[n] = ordinates[(first+1)*dim];   g->y[n++] = ordinates[first*dim+1];
+      g->x[n] = ordinates[(first+1)*dim];   g->y[n++] = ordinates[(first+1)*dim+1];
+      g->x[n] = ordinates[first*dim];       g->y[n++] = ordinates[(first+1)*dim+1];
+      g->x[n] = ordinates[first*dim];       g->y[n++] = ordinates[first*dim+1];
+    }
+    else if (kind == JOIN_RING && interpretation == 4 && (etype == 1003 || etype == 2003)) {
+      /* Circle: three points on the circle */
+      double p[6];
+      if (last - first < 3)
+        break;
+      for (i=0; i<3; i++) {
+        p[2*i] = ordinates[(first+i)*dim];
+        p[2*i+1] = ordinates[(first+i)*dim+1];
+      }
+      n += AddCircle (p, g->x + n, g->y + n);
+    }
+    else {
+      for (i=first; i<last; i++) {
+        g->x[n] = ordinates[i*dim];
+        g->y[n++] = ordinates[i*dim+1];
+      }
+      if (kind == JOIN_RING &&
+          (g->x[n-1] != g->x[g->n_vertices] || g->y[n-1] != g->y[g->n_vertices])) {
+        g->x[n] = g->x[g->n_vertices];
+        g->y[n] = g->y[g->n_vertices];
+        n++;
+      }
+    }
+    if (n > g->n_vertices) {
+      g->n_vertices = n;
+      g->n_parts++;
+    }
+  }
+
+  if (e < n_elements || g->n_parts == 0) {
+    free (g->x);
+    free (g->y);
+    free (g->part_start);
+    free (g->part_kind);
+    return -1;
+  }
+  g->part_start[g->n_parts] = g->n_vertices;
+
+  /* Compute the MBR */
+  g->min_x = g->max_x = g->x[0];
+  g->min_y = g->max_y = g->y[0];
+  for (i=1; i<g->n_vertices; i++) {
+    g->min_x = g->x[i] < g->min_x ? g->x[i] : g->min_x;
+    g->max_x = g->x[i] > g->max_x ? g->x[i] : g->max_x;
+    g->min_y = g->y[i] < g->min_y ? g->y[i] : g->min_y;
+    g->max_y = g->y[i] > g->max_y ? g->y[i] : g->max_y;
+  }
+
+  layer->n_geometries++;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     FreeJoinLayer
+**
+** Description: Free the geometries of a layer
+*******************************************************************************/
+void FreeJoinLayer (join_layer_struct *layer)
+{
+  long i;
+
+  for (i=0; i<layer->n_geometries; i++) {
+    free (layer->geometries[i].x);
+    free (layer->geometries[i].y);
+    free (layer->geometries[i].part_start);
+    free (layer->geometries[i].part_kind);
+  }
+  free (layer->geometries);
+  InitJoinLayer (layer);
+}
+
+/*******************************************************************************
+** Routine:     CompareBoxes
+**
+** Description: Order boxes on their lower X bound (for qsort)
+*******************************************************************************/
+static int CompareBoxes (const void *a, const void *b)
+{
+  double xa = ((const join_box_struct *) a)->min_x;
+  double xb = ((const join_box_struct *) b)->min_x;
+  return xa < xb ? -1 : (xa > xb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     SweepBoxes
+**
+** Description: Find the pairs of overlapping boxes between two arrays sorted
+**              on their lower X bound, and call a routine for each pair. The
+**              sweep stops if the routine returns a non-zero value: it then
+**              returns 1, and 0 otherwise.
+*******************************************************************************/
+static int SweepBoxes (
+  const join_box_struct *boxes1,
+  long                  n1,
+  const join_box_struct *boxes2,
+  long                  n2,
+  int                   (*pair_routine) (void *, long, long),
+  void                  *context)
+{
+  long i = 0, j = 0, k;
+
+  while (i < n1 && j < n2) {
+    if (boxes1[i].min_x <= boxes2[j].min_x) {
+      /* Box i starts first: it overlaps in X the boxes of the second array
+         that start before it ends */
+      for (k=j; k<n2 && boxes2[k].min_x <= boxes1[i].max_x; k++)
+        if (boxes2[k].min_y <= boxes1[i].max_y && boxes2[k].max_y >= boxes1[i].min_y)
+          if (pair_routine (context, boxes1[i].index, boxes2[k].index))
+            return 1;
+      i++;
+    }
+    else {
+      for (k=i; k<n1 && boxes1[k].min_x <= boxes2[j].max_x; k++)
+        if (boxes1[k].min_y <= boxes2[j].max_y && boxes1[k].max_y >= boxes2[j].min_y)
+          if (pair_routine (context, boxes1[k].index, boxes2[j].index))
+            return 1;
+      j++;
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     Orientation
+**
+** Description: Sign of the turn from (ax,ay)-(bx,by) to (ax,ay)-(cx,cy):
+**              1 counterclockwise, -1 clockwise, 0 collinear
+*******************************************************************************/
+static int Orientation (double ax, double ay, double bx, double by, double cx, double cy)
+{
+  double d = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+  return d > 0 ? 1 : (d < 0 ? -1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     OnSegment
+**
+** Description: Check if a point that is collinear with a segment lies on it
+*******************************************************************************/
+static int OnSegment (double ax, double ay, double bx, double by, double px, double py)
+{
+  return (px >= (ax < bx ? ax : bx)) && (px <= (ax > bx ? ax : bx)) &&
+         (py >= (ay < by ? ay : by)) && (py <= (ay > by ? ay : by));
+}
+
+/*******************************************************************************
+** Routine:     SegmentsTouch
+**
+** Description: Check if two segments have at least one point in common
+*******************************************************************************/
+static int SegmentsTouch (
+  double ax, double ay, double bx, double by,
+  double cx, double cy, double dx, double dy)
+{
+  int o1 = Orientation (ax, ay, bx, by, cx, cy);
+  int o2 = Orientation (ax, ay, bx, by, dx, dy);
+  int o3 = Orientation (cx, cy, dx, dy, ax, ay);
+  int o4 = Orientation (cx, cy, dx, dy, bx, by);
+
+  if (o1 * o2 < 0 && o3 * o4 < 0)
+    return 1;
+  return (o1 == 0 && OnSegment (ax, ay, bx, by, cx, cy)) ||
+         (o2 == 0 && OnSegment (ax, ay, bx, by, dx, dy)) ||
+         (o3 == 0 && OnSegment (cx, cy, dx, dy, ax, ay)) ||
+         (o4 == 0 && OnSegment (cx, cy, dx, dy, bx, by));
+}
+
+/*******************************************************************************
+** Routine:     InsideRings
+**
+** Description: Check if a point is inside the rings of a geometry (even-odd
+**              rule, so that holes are excluded)
+*******************************************************************************/
+static int InsideRings (const join_geometry_struct *g, double px, double py)
+{
+  int p, i, inside = 0;
+
+  for (p=0; p<g->n_parts; p++) {
+    if (g->part_kind[p] != JOIN_RING)
+      continue;
+    for (i=g->part_start[p]; i<g->part_start[p+1]-1; i++)
+      if ((g->y[i] > py) != (g->y[i+1] > py) &&
+          px < g->x[i] + (py - g->y[i]) * (g->x[i+1] - g->x[i]) / (g->y[i+1] - g->y[i]))
+        inside = !inside;
+  }
+  return inside;
+}
+
+/*******************************************************************************
+** Routine:     PointTouches
+**
+** Description: Check if a point interacts with a geometry
+*******************************************************************************/
+static int PointTouches (const join_geometry_struct *g, double px, double py)
+{
+  int p, i;
+
+  if (px < g->min_x || px > g->max_x || py < g->min_y || py > g->max_y)
+    return 0;
+  for (p=0; p<g->n_parts; p++) {
+    if (g->part_kind[p] == JOIN_POINTS) {
+      for (i=g->part_start[p]; i<g->part_start[p+1]; i++)
+        if (g->x[i] == px && g->y[i] == py)
+          return 1;
+    }
+    else {
+      for (i=g->part_start[p]; i<g->part_start[p+1]-1; i++)
+        if (Orientation (g->x[i], g->y[i], g->x[i+1], g->y[i+1], px, py) == 0 &&
+            OnSegment (g->x[i], g->y[i], g->x[i+1], g->y[i+1], px, py))
+          return 1;
+    }
+  }
+  return InsideRings (g, px, py);
+}
+
+/*******************************************************************************
+** Routine:     PointsTouch
+**
+** Description: Check if a point of the first geometry that lies in a window
+**              interacts with the second geometry
+*******************************************************************************/
+static int PointsTouch (
+  const join_geometry_struct *g1,
+  const join_geometry_struct *g2,
+  const join_box_struct      *window)
+{
+  int p, i;
+
+  for (p=0; p<g1->n_parts; p++)
+    if (g1->part_kind[p] == JOIN_POINTS)
+      for (i=g1->part_start[p]; i<g1->part_start[p+1]; i++)
+        if (g1->x[i] >= window->min_x && g1->x[i] <= window->max_x &&
+            g1->y[i] >= window->min_y && g1->y[i] <= window->max_y &&
+            PointTouches (g2, g1->x[i], g1->y[i]))
+          return 1;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     CollectEdges
+**
+** Description: Collect the boxes of the edges of a geometry that overlap a
+**              window. The index of each box is the first vertex of its
+**              edge. Returns the number of edges.
+*******************************************************************************/
+static long CollectEdges (
+  const join_geometry_struct *g,
+  const join_box_struct      *window,
+  join_box_struct            **edges,
+  long                       *size_edges)
+{
+  join_box_struct *box;
+  long n = 0;
+  int  p, i;
+
+  for (p=0; p<g->n_parts; p++) {
+    if (g->part_kind[p] == JOIN_POINTS)
+      continue;
+    for (i=g->part_start[p]; i<g->part_start[p+1]-1; i++) {
+      if (n == *size_edges) {
+        *size_edges = *size_edges > 0 ? 2 * *size_edges : 256;
+        *edges = realloc (*edges, *size_edges * sizeof(join_box_struct));
+      }
+      box = &(*edges)[n];
+      box->min_x = g->x[i] < g->x[i+1] ? g->x[i] : g->x[i+1];
+      box->max_x = g->x[i] > g->x[i+1] ? g->x[i] : g->x[i+1];
+      box->min_y = g->y[i] < g->y[i+1] ? g->y[i] : g->y[i+1];
+      box->max_y = g->y[i] > g->y[i+1] ? g->y[i] : g->y[i+1];
+      box->index = i;
+      if (box->min_x <= window->max_x && box->max_x >= window->min_x &&
+          box->min_y <= window->max_y && box->max_y >= window->min_y)
+        n++;
+    }
+  }
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     EdgesTouch
+**
+** Description: Check if two edges touch (called by SweepBoxes)
+*******************************************************************************/
+static int EdgesTouch (void *context, long i, long j)
+{
+  edge_pair_struct *pair = (edge_pair_struct *) context;
+  const join_geometry_struct *g1 = pair->g1, *g2 = pair->g2;
+
+  return SegmentsTouch (g1->x[i], g1->y[i], g1->x[i+1], g1->y[i+1],
+                        g2->x[j], g2->y[j], g2->x[j+1], g2->y[j+1]);
+}
+
+/*******************************************************************************
+** Routine:     PartsInside
+**
+** Description: Check if a line or ring of the first geometry is inside a
+**              ring of the second. Only called when no edges touch: each
+**              part is then entirely inside or entirely outside, and it is
+**              enough to test its first vertex.
+*******************************************************************************/
+static int PartsInside (
+  const join_geometry_struct *g1,
+  const join_geometry_struct *g2)
+{
+  int p, i;
+
+  for (p=0; p<g1->n_parts; p++) {
+    if (g1->part_kind[p] == JOIN_POINTS)
+      continue;
+    i = g1->part_start[p];
+    if (g1->x[i] >= g2->min_x && g1->x[i] <= g2->max_x &&
+        g1->y[i] >= g2->min_y && g1->y[i] <= g2->max_y &&
+        InsideRings (g2, g1->x[i], g1->y[i]))
+      return 1;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     GeometriesInteract
+**
+** Description: Check if two geometries whose MBRs overlap interact
+*******************************************************************************/
+static int GeometriesInteract (
+  join_worker_struct         *worker,
+  const join_geometry_struct *g1,
+  const join_geometry_struct *g2)
+{
+  join_box_struct  window;
+  edge_pair_struct pair;
+  long n1, n2, i, j;
+
+  /* Only the parts of the geometries that overlap both MBRs can touch */
+  window.min_x = g1->min_x > g2->min_x ? g1->min_x : g2->min_x;
+  window.min_y = g1->min_y > g2->min_y ? g1->min_y : g2->min_y;
+  window.max_x = g1->max_x < g2->max_x ? g1->max_x : g2->max_x;
+  window.max_y = g1->max_y < g2->max_y ? g1->max_y : g2->max_y;
+
+  /* Points */
+  if (PointsTouch (g1, g2, &window) || PointsTouch (g2, g1, &window))
+    return 1;
+
+  /* Edges */
+  n1 = CollectEdges (g1, &window, &worker->edges[0], &worker->size_edges[0]);
+  n2 = CollectEdges (g2, &window, &worker->edges[1], &worker->size_edges[1]);
+  pair.g1 = g1;
+  pair.g2 = g2;
+  if (n1 * n2 <= JOIN_BRUTE_FORCE) {
+    for (i=0; i<n1; i++)
+      for (j=0; j<n2; j++)
+        if (EdgesTouch (&pair, worker->edges[0][i].index, worker->edges[1][j].index))
+          return 1;
+  }
+  else {
+    qsort (worker->edges[0], n1, sizeof(join_box_struct), CompareBoxes);
+    qsort (worker->edges[1], n2, sizeof(join_box_struct), CompareBoxes);
+    if (SweepBoxes (worker->edges[0], n1, worker->edges[1], n2, EdgesTouch, &pair))
+      return 1;
+  }
+
+  /* Containment */
+  return PartsInside (g1, g2) || PartsInside (g2, g1);
+}
+
+/*******************************************************************************
+** Routine:     CellOf
+**
+** Description: Cell that contains a point. Points on the edge of the extent
+**              go to the last row or column.
+*******************************************************************************/
+static long CellOf (const join_grid_struct *grid, double x, double y)
+{
+  long column = (long) ((x - grid->min_x) / grid->cell_width);
+  long row = (long) ((y - grid->min_y) / grid->cell_height);
+
+  column = column < 0 ? 0 : (column >= grid->grid_size ? grid->grid_size - 1 : column);
+  row = row < 0 ? 0 : (row >= grid->grid_size ? grid->grid_size - 1 : row);
+  return row * grid->grid_size + column;
+}
+
+/*******************************************************************************
+** Routine:     CandidatePair
+**
+** Description: Process a pair of geometries whose MBRs overlap in the
+**              current cell (called by SweepBoxes)
+*******************************************************************************/
+static int CandidatePair (void *context, long i, long j)
+{
+  join_worker_struct *worker = (join_worker_struct *) context;
+  const join_geometry_struct *g1 = &worker->grid->layer1->geometries[i];
+  const join_geometry_struct *g2 = &worker->grid->layer2->geometries[j];
+
+  /* Reference point: only keep the pair in the cell of the lower left
+     corner of the intersection of the MBRs */
+  if (CellOf (worker->grid, g1->min_x > g2->min_x ? g1->min_x : g2->min_x,
+                            g1->min_y > g2->min_y ? g1->min_y : g2->min_y) != worker->cell)
+    return 0;
+  worker->n_candidates++;
+
+  if (GeometriesInteract (worker, g1, g2)) {
+    if (worker->n_pairs == worker->size_pairs) {
+      worker->size_pairs = worker->size_pairs > 0 ? 2 * worker->size_pairs : 4096;
+      worker->pairs = realloc (worker->pairs, worker->size_pairs * sizeof(join_pair_struct));
+    }
+    worker->pairs[worker->n_pairs].id1 = g1->id;
+    worker->pairs[worker->n_pairs].id2 = g2->id;
+    worker->n_pairs++;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     CollectBoxes
+**
+** Description: Collect the MBRs of the geometries of a layer in a cell.
+**              Returns the number of geometries.
+*******************************************************************************/
+static long CollectBoxes (
+  const join_layer_struct *layer,
+  const long              *cell_start,
+  const long              *cell_items,
+  long                    cell,
+  join_box_struct         **boxes,
+  long                    *size_boxes)
+{
+  const join_geometry_struct *g;
+  long n = cell_start[cell+1] - cell_start[cell];
+  long i;
+
+  if (n > *size_boxes) {
+    *size_boxes = n;
+    *boxes = realloc (*boxes, n * sizeof(join_box_struct));
+  }
+  for (i=0; i<n; i++) {
+    g = &layer->geometries[cell_items[cell_start[cell] + i]];
+    (*boxes)[i].min_x = g->min_x;
+    (*boxes)[i].min_y = g->min_y;
+    (*boxes)[i].max_x = g->max_x;
+    (*boxes)[i].max_y = g->max_y;
+    (*boxes)[i].index = cell_items[cell_start[cell] + i];
+  }
+  qsort (*boxes, n, sizeof(join_box_struct), CompareBoxes);
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     NextTask
+**
+** Description: Take the next task of a thread. When its range is empty, take
+**              the upper half of the range of another thread. Returns -1
+**              when all ranges are empty.
+*******************************************************************************/
+static long NextTask (join_worker_struct *worker)
+{
+  join_grid_struct   *grid = worker->grid;
+  join_worker_struct *victim;
+  long task = -1, remaining, first = 0, last = 0;
+  int  t;
+
+#ifndef _WIN32
+  pthread_mutex_lock (&worker->lock);
+#endif
+  if (worker->next < worker->end)
+    task = worker->next++;
+#ifndef _WIN32
+  pthread_mutex_unlock (&worker->lock);
+#endif
+  if (task >= 0)
+    return task;
+
+  for (t=1; t<grid->n_threads; t++) {
+    victim = &grid->workers[(worker->thread + t) % grid->n_threads];
+#ifndef _WIN32
+    pthread_mutex_lock (&victim->lock);
+#endif
+    remaining = victim->end - victim->next;
+    if (remaining > 0) {
+      first = victim->next + remaining / 2;
+      last = victim->end;
+      victim->end = first;
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock (&victim->lock);
+#endif
+    if (remaining > 0) {
+#ifndef _WIN32
+      pthread_mutex_lock (&worker->lock);
+#endif
+      worker->next = first + 1;
+      worker->end = last;
+#ifndef _WIN32
+      pthread_mutex_unlock (&worker->lock);
+#endif
+      worker->n_stolen++;
+      return first;
+    }
+  }
+  return -1;
+}
+
+/*******************************************************************************
+** Routine:     JoinCells
+**
+** Description: Thread routine: join the geometries of each cell taken
+*******************************************************************************/
+static void *JoinCells (void *argument)
+{
+  join_worker_struct *worker = (join_worker_struct *) argument;
+  join_grid_struct   *grid = worker->grid;
+  long task, n1, n2;
+
+  while ((task = NextTask (worker)) >= 0) {
+    worker->cell = grid->tasks[task].cell;
+    n1 = CollectBoxes (grid->layer1, grid->cell_start1, grid->cell_items1, worker->cell,
+      &worker->boxes[0], &worker->size_boxes[0]);
+    n2 = CollectBoxes (grid->layer2, grid->cell_start2, grid->cell_items2, worker->cell,
+      &worker->boxes[1], &worker->size_boxes[1]);
+    SweepBoxes (worker->boxes[0], n1, worker->boxes[1], n2, CandidatePair, worker);
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     AssignCells
+**
+** Description: Assign the geometries of a layer to the cells that their MBR
+**              overlaps. Sets the first geometry of each cell and the list of
+**              geometries of all cells.
+*******************************************************************************/
+static void AssignCells (
+  const join_grid_struct  *grid,
+  const join_layer_struct *layer,
+  long                    **cell_start,
+  long                    **cell_items)
+{
+  const join_geometry_struct *g;
+  long n_cells = (long) grid->grid_size * grid->grid_size;
+  long *start, *items, *fill;
+  long i, lower, upper, row, column, first_column, last_column;
+
+  start = calloc (n_cells + 1, sizeof(long));
+  for (i=0; i<layer->n_geometries; i++) {
+    g = &layer->geometries[i];
+    lower = CellOf (grid, g->min_x, g->min_y);
+    upper = CellOf (grid, g->max_x, g->max_y);
+    first_column = lower % grid->grid_size;
+    last_column = upper % grid->grid_size;
+    for (row=lower/grid->grid_size; row<=upper/grid->grid_size; row++)
+      for (column=first_column; column<=last_column; column++)
+        start[row * grid->grid_size + column + 1]++;
+  }
+  for (i=0; i<n_cells; i++)
+    start[i+1] += start[i];
+
+  items = malloc ((start[n_cells] > 0 ? start[n_cells] : 1) * sizeof(long));
+  fill = malloc (n_cells * sizeof(long));
+  memcpy (fill, start, n_cells * sizeof(long));
+  for (i=0; i<layer->n_geometries; i++) {
+    g = &layer->geometries[i];
+    lower = CellOf (grid, g->min_x, g->min_y);
+    upper = CellOf (grid, g->max_x, g->max_y);
+    first_column = lower % grid->grid_size;
+    last_column = upper % grid->grid_size;
+    for (row=lower/grid->grid_size; row<=upper/grid->grid_size; row++)
+      for (column=first_column; column<=last_column; column++)
+        items[fill[row * grid->grid_size + column]++] = i;
+  }
+  free (fill);
+  *cell_start = start;
+  *cell_items = items;
+}
+
+/*******************************************************************************
+** Routine:     CompareTasks
+**
+** Description: Order tasks along the Hilbert curve (for qsort)
+*******************************************************************************/
+static int CompareTasks (const void *a, const void *b)
+{
+  uint64_t ka = ((const join_task_struct *) a)->key;
+  uint64_t kb = ((const join_task_struct *) b)->key;
+  return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     JoinLayers
+**
+** Description: Find all pairs of interacting geometries of two layers. If
+**              grid_size is 0, the size of the grid is chosen from the number
+**              of geometries. Returns 0, or -1 if the parameters are invalid.
+*******************************************************************************/
+int JoinLayers (
+  const join_layer_struct *layer1,
+  const join_layer_struct *layer2,
+  int                     grid_size,
+  int                     n_threads,
+  join_result_struct      *result)
+{
+  join_grid_struct   grid;
+  join_worker_struct *workers;
+  const join_geometry_struct *g;
+  double max_x, max_y;
+  long   n_cells, cell, order, i, n;
+  int    t, l;
+#ifndef _WIN32
+  pthread_t threads[JOIN_MAX_THREADS];
+  int       started[JOIN_MAX_THREADS];
+#endif
+
+  memset (result, 0, sizeof(join_result_struct));
+  if (grid_size < 0 || grid_size > JOIN_MAX_GRID_SIZE)
+    return -1;
+#ifdef _WIN32
+  n_threads = 1;
+#endif
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > JOIN_MAX_THREADS)
+    n_threads = JOIN_MAX_THREADS;
+  result->n_threads = n_threads;
+  if (layer1->n_geometries == 0 || layer2->n_geometries == 0)
+    return 0;
+
+  /* Size the grid */
+  if (grid_size == 0) {
+    grid_size = (int) sqrt ((double) (layer1->n_geometries + layer2->n_geometries)
+      / JOIN_CELL_GEOMETRIES);
+    if (grid_size < 1)
+      grid_size = 1;
+    if (grid_size > JOIN_MAX_GRID_SIZE)
+      grid_size = JOIN_MAX_GRID_SIZE;
+  }
+  result->grid_size = grid_size;
+
+  /* Compute the extent of both layers */
+  memset (&grid, 0, sizeof(grid));
+  grid.layer1 = layer1;
+  grid.layer2 = layer2;
+  grid.grid_size = grid_size;
+  grid.min_x = grid.min_y = HUGE_VAL;
+  max_x = max_y = -HUGE_VAL;
+  for (l=0; l<2; l++) {
+    const join_layer_struct *layer = l == 0 ? layer1 : layer2;
+    for (i=0; i<layer->n_geometries; i++) {
+      g = &layer->geometries[i];
+      grid.min_x = g->min_x < grid.min_x ? g->min_x : grid.min_x;
+      grid.min_y = g->min_y < grid.min_y ? g->min_y : grid.min_y;
+      max_x = g->max_x > max_x ? g->max_x : max_x;
+      max_y = g->max_y > max_y ? g->max_y : max_y;
+    }
+  }
+  grid.cell_width = (max_x - grid.min_x) / grid_size;
+  grid.cell_height = (max_y - grid.min_y) / grid_size;
+  if (grid.cell_width <= 0)
+    grid.cell_width = 1;
+  if (grid.cell_height <= 0)
+    grid.cell_height = 1;
+
+  /* Assign the geometries to the cells */
+  AssignCells (&grid, layer1, &grid.cell_start1, &grid.cell_items1);
+  AssignCells (&grid, layer2, &grid.cell_start2, &grid.cell_items2);
+
+  /* Keep the cells that have geometries of both layers, in Hilbert order */
+  n_cells = (long) grid_size * grid_size;
+  for (order=1; order<grid_size; order*=2)
+    ;
+  grid.tasks = malloc (n_cells * sizeof(join_task_struct));
+  for (cell=0; cell<n_cells; cell++)
+    if (grid.cell_start1[cell+1] > grid.cell_start1[cell] &&
+        grid.cell_start2[cell+1] > grid.cell_start2[cell]) {
+      grid.tasks[grid.n_tasks].cell = cell;
+      grid.tasks[grid.n_tasks].key = HilbertKey (order, cell % grid_size, cell / grid_size);
+      grid.n_tasks++;
+    }
+  qsort (grid.tasks, grid.n_tasks, sizeof(join_task_struct), CompareTasks);
+  result->n_cells = grid.n_tasks;
+
+  /* Give each thread an equal range of cells, and run them */
+  workers = calloc (n_threads, sizeof(join_worker_struct));
+  grid.workers = workers;
+  grid.n_threads = n_threads;
+  for (t=0; t<n_threads; t++) {
+    workers[t].grid = &grid;
+    workers[t].thread = t;
+    workers[t].next = grid.n_tasks * t / n_threads;
+    workers[t].end = grid.n_tasks * (t + 1) / n_threads;
+#ifndef _WIN32
+    pthread_mutex_init (&workers[t].lock, NULL);
+#endif
+  }
+#ifndef _WIN32
+  for (t=1; t<n_threads; t++)
+    started[t] = pthread_create (&threads[t], NULL, JoinCells, &workers[t]) == 0;
+  JoinCells (&workers[0]);
+  for (t=1; t<n_threads; t++)
+    if (started[t])
+      pthread_join (threads[t], NULL);
+#else
+  JoinCells (&workers[0]);
+#endif
+
+  /* Gather the results. The range of a thread that could not be started
+     has been taken by the others */
+  for (t=0; t<n_threads; t++) {
+    result->n_pairs += workers[t].n_pairs;
+    result->n_candidates += workers[t].n_candidates;
+    result->n_stolen += workers[t].n_stolen;
+  }
+  result->pairs = malloc ((result->n_pairs > 0 ? result->n_pairs : 1) * sizeof(join_pair_struct));
+  n = 0;
+  for (t=0; t<n_threads; t++) {
+    if (workers[t].n_pairs > 0)
+      memcpy (result->pairs + n, workers[t].pairs, workers[t].n_pairs * sizeof(join_pair_struct));
+    n += workers[t].n_pairs;
+    free (workers[t].pairs);
+    for (l=0; l<2; l++) {
+      free (workers[t].boxes[l]);
+      free (workers[t].edges[l]);
+    }
+#ifndef _WIN32
+    pthread_mutex_destroy (&workers[t].lock);
+#endif
+  }
+
+  free (workers);
+  free (grid.tasks);
+  free (grid.cell_start1);
+  free (grid.cell_items1);
+  free (grid.cell_start2);
+  free (grid.cell_items2);
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     FreeJoinResult
+**
+** Description: Free the pairs of a join result
+*******************************************************************************/
+void FreeJoinResult (join_result_struct *result)
+{
+  free (result->pairs);
+  result->pairs = NULL;
+  result->n_pairs = 0;
+}
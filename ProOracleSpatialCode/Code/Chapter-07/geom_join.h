@@ -0,0 +1,111 @@
+/* geom_join.h
+
+   Client-side spatial join of two layers of geometries.
+
+   This is the client-side counterpart of the SDO_JOIN table function (see
+   chapter 8): it finds all pairs of geometries, one from each layer, that
+   interact (the ANYINTERACT relationship). The geometries are held in
+   memory, in a simplified form: each one is a list of parts, which are
+   points, lines or rings, with the vertices of the first two dimensions.
+
+   The join runs in two steps, like a query that uses a spatial index:
+
+   - The extent of both layers is divided into a uniform grid of cells, and
+     each geometry is assigned to all the cells that its MBR overlaps. The
+     cells are then processed independently. Within a cell, the MBRs of the
+     two layers are sorted on their lower X bound and swept from left to
+     right to find the pairs of MBRs that overlap (primary filter).
+
+     A pair of geometries whose MBRs span several cells is found in each of
+     these cells. It is only kept in the cell that contains the lower left
+     corner of the intersection of the two MBRs (reference point), so that
+     each pair is reported once without any sorting of the results.
+
+   - Each candidate pair is then tested exactly (secondary filter): the
+     geometries interact if an edge or a point of one touches an edge or a
+     point of the other, or if one lies inside a ring of the other. The
+     edges are tested with the same sweep, limited to the edges that
+     overlap the intersection of the two MBRs.
+
+   The cells are processed by several threads. The cells to process are
+   ordered along a Hilbert curve, so that consecutive cells are close in
+   space and share many geometries, and each thread starts with an equal
+   range of them. A thread that runs out of cells takes half of the
+   remaining range of another thread (work stealing), so that all threads
+   stay busy even if the geometries are concentrated in a few cells.
+
+   Rectangles are expanded into rings and circles are approximated by
+   polygons of JOIN_CIRCLE_SEGMENTS sides. Arcs in lines and rings (compound
+   or not) are replaced by straight lines between their points: the result
+   may differ from the database for geometries that only touch along an arc.
+   Coordinates are compared exactly, without tolerance.
+
+*/
+#ifndef GEOM_JOIN_H
+#define GEOM_JOIN_H
+
+#define JOIN_MAX_THREADS 64
+#define JOIN_MAX_GRID_SIZE 2048
+#define JOIN_CIRCLE_SEGMENTS 64
+
+/* Kinds of parts of a geometry */
+#define JOIN_POINTS 1
+#define JOIN_LINE 2
+#define JOIN_RING 3
+
+/* A geometry, reduced to what the join needs */
+struct join_geometry
+{
+    long   id;
+    double min_x, min_y;              /* MBR */
+    double max_x, max_y;
+    int    n_parts;
+    int    *part_start;               /* First vertex of each part (n_parts + 1) */
+    char   *part_kind;                /* JOIN_POINTS, JOIN_LINE or JOIN_RING */
+    int    n_vertices;
+    double *x;                        /* Vertices of all parts. Rings are closed */
+    double *y;
+};
+typedef struct join_geometry join_geometry_struct;
+
+/* A layer of geometries */
+struct join_layer
+{
+    long                 n_geometries;
+    long                 size;        /* Allocated size of the array */
+    join_geometry_struct *geometries;
+};
+typedef struct join_layer join_layer_struct;
+
+/* A pair of interacting geometries */
+struct join_pair
+{
+    long id1;                         /* Id of the geometry of the first layer */
+    long id2;                         /* Id of the geometry of the second layer */
+};
+typedef struct join_pair join_pair_struct;
+
+/* The result of a join */
+struct join_result
+{
+    long             n_pairs;
+    join_pair_struct *pairs;          /* In no particular order */
+    long             n_candidates;    /* Pairs with overlapping MBRs */
+    int              grid_size;       /* Cells per side of the grid */
+    long             n_cells;         /* Cells with geometries of both layers */
+    long             n_stolen;        /* Ranges of cells taken by idle threads */
+    int              n_threads;
+};
+typedef struct join_result join_result_struct;
+
+void InitJoinLayer (join_layer_struct *layer);
+int  AddJoinGeometry (join_layer_struct *layer, long id, int gtype,
+                      int has_point, double point_x, double point_y,
+                      const int *elem_info, int n_elem_info,
+                      const double *ordinates, int n_ordinates);
+void FreeJoinLayer (join_layer_struct *layer);
+int  JoinLayers (const join_layer_struct *layer1, const join_layer_struct *layer2,
+                 int grid_size, int n_threads, join_result_struct *result);
+void FreeJoinResult (join_result_struct *result);
+
+#endif
@@ -0,0 +1,337 @@
+/* hierarchy_route.c
+
+   This program answers shortest path queries on a contraction hierarchy
+   written by build_hierarchy.c: the path between two nodes, the time taken
+   by random queries, or the matrix of the costs between two sets of nodes.
+
+   It does not connect to the database: the hierarchy file is mapped in
+   memory (see contraction_hierarchy.h), so that the program is ready to
+   answer queries as soon as it starts, whatever the size of the network.
+
+   It illustrates the following concepts:
+   - processing a network outside the database
+
+   The program takes the following command line arguments:
+
+     hierarchy_route hierarchy start_node end_node
+     hierarchy_route hierarchy RANDOM n_queries
+     hierarchy_route hierarchy MATRIX sources targets output [threads]
+
+   where
+
+   - hierarchy = name of the file written by build_hierarchy
+   - start_node, end_node = ids of the nodes to find the shortest path
+     between. The program writes the nodes and links of the path, its cost,
+     and the time taken by the query.
+   - RANDOM n_queries = find the cost of the shortest paths between
+     n_queries pairs of random nodes instead, and report the mean, median,
+     95th percentile and maximum time of the queries
+   - MATRIX = compute the costs from each node of a list to each node of
+     another list, with:
+     - sources, targets = names of text files holding the ids of the nodes,
+       one per line
+     - output = name of the CSV file to write the costs to:
+       source_id,target_id,cost
+     - threads = number of threads (default is one per processor)
+
+   Notes:
+
+   The program must be linked with contraction_hierarchy.c and
+   spatial_util.c. On Linux and other POSIX systems it also needs the POSIX
+   threads library.
+
+   Pairs of nodes that are not connected are not written to the matrix. Ids
+   of the node lists that are not in the network are reported and skipped.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "contraction_hierarchy.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     RandomNode
+**
+** Description: Draw a random node number, with a 64-bit linear congruential
+**              generator (rand() is too short for large networks on some
+**              platforms)
+*******************************************************************************/
+long RandomNode (unsigned long long *seed, long n_nodes)
+{
+  *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (long) ((*seed >> 33) % (unsigned long long) n_nodes);
+}
+
+/*******************************************************************************
+** Routine:     CompareDoubles
+**
+** Description: Comparison function for qsort
+*******************************************************************************/
+int CompareDoubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/*******************************************************************************
+** Routine:     ReadNodeList
+**
+** Description: Read a file of node ids, one per line, and find their node
+**              numbers (-1 for the ids that are not in the network)
+*******************************************************************************/
+long ReadNodeList (
+  contraction_hierarchy_struct *hierarchy,
+  char                         *filename,
+  long                         **node_id,
+  long                         **node)
+{
+  FILE *file;
+  long n = 0, size = 1024, id, i;
+
+  file = fopen (filename, "r");
+  if (file == NULL) {
+    printf ("Could not open %s\n", filename);
+    exit (1);
+  }
+  *node_id = malloc (size * sizeof(long));
+  while (fscanf (file, "%ld", &id) == 1) {
+    if (n == size) {
+      size *= 2;
+      *node_id = realloc (*node_id, size * sizeof(long));
+    }
+    (*node_id)[n++] = id;
+  }
+  fclose (file);
+
+  *node = malloc ((n > 0 ? n : 1) * sizeof(long));
+  for (i=0; i<n; i++) {
+    (*node)[i] = FindHierarchyNode (hierarchy, (*node_id)[i]);
+    if ((*node)[i] < 0)
+      printf ("Node %ld of %s is not in the network\n", (*node_id)[i], filename);
+  }
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     FindPath
+**
+** Description: Find the shortest path between two nodes and print it
+*******************************************************************************/
+void FindPath (
+  contraction_hierarchy_struct *hierarchy,
+  long                         start_id,
+  long                         end_id)
+{
+  hierarchy_search_struct *search;
+  route_struct            route;
+  long   start_node, end_node;
+  double start_time, elapsed;
+  int    i;
+
+  start_node = FindHierarchyNode (hierarchy, start_id);
+  end_node = FindHierarchyNode (hierarchy, end_id);
+  if (start_node < 0 || end_node < 0) {
+    printf ("Node %ld is not in the network\n", start_node < 0 ? start_id : end_id);
+    exit (1);
+  }
+
+  search = CreateHierarchySearch (hierarchy);
+  start_time = ElapsedSeconds ();
+  if (HierarchyRoute (hierarchy, search, start_node, end_node, &route) != 0) {
+    elapsed = ElapsedSeconds () - start_time;
+    printf ("No path from node %ld to node %ld\n", start_id, end_id);
+  }
+  else {
+    elapsed = ElapsedSeconds () - start_time;
+    printf ("Path from node %ld to node %ld: cost %.6f, %d nodes\n",
+      start_id, end_id, route.cost, route.n_nodes);
+    for (i=0; i<route.n_nodes; i++) {
+      printf ("  node %ld", route.node_id[i]);
+      if (i < route.n_nodes - 1)
+        printf ("  link %ld", route.link_id[i]);
+      printf ("\n");
+    }
+    FreeRoute (&route);
+  }
+  printf ("%ld nodes settled in %.3f ms\n", search->n_settled, elapsed * 1000);
+  FreeHierarchySearch (search);
+}
+
+/*******************************************************************************
+** Routine:     RandomPaths
+**
+** Description: Find the cost of the shortest paths between random pairs of
+**              nodes, and report the time taken
+*******************************************************************************/
+void RandomPaths (
+  contraction_hierarchy_struct *hierarchy,
+  long                         n_queries)
+{
+  hierarchy_search_struct *search;
+  unsigned long long      seed = 12345;
+  double *latency, total = 0, settled = 0, start_time;
+  long   q, start_node, end_node, n_found = 0;
+
+  latency = malloc (sizeof(double) * n_queries);
+  search = CreateHierarchySearch (hierarchy);
+  for (q=0; q<n_queries; q++) {
+    start_node = RandomNode (&seed, (long) hierarchy->n_nodes);
+    end_node = RandomNode (&seed, (long) hierarchy->n_nodes);
+    start_time = ElapsedSeconds ();
+    if (HierarchyDistance (hierarchy, search, start_node, end_node) < HUGE_VAL)
+      n_found++;
+    latency[q] = (ElapsedSeconds () - start_time) * 1000;
+    total += latency[q];
+    settled += search->n_settled;
+  }
+  qsort (latency, n_queries, sizeof(double), CompareDoubles);
+  printf ("%ld queries, %ld paths found\n", n_queries, n_found);
+  printf ("Mean %.4f ms, median %.4f ms, 95th percentile %.4f ms, max %.4f ms\n",
+    total / n_queries, latency[n_queries / 2], latency[(long) (n_queries * 0.95)],
+    latency[n_queries - 1]);
+  printf ("%.0f nodes settled per query\n", settled / n_queries);
+  FreeHierarchySearch (search);
+  free (latency);
+}
+
+/*******************************************************************************
+** Routine:     DistanceMatrix
+**
+** Description: Compute the costs between two lists of nodes and write them
+**              to a CSV file
+*******************************************************************************/
+void DistanceMatrix (
+  contraction_hierarchy_struct *hierarchy,
+  char                         *sources_file,
+  char                         *targets_file,
+  char                         *output,
+  int                          n_threads)
+{
+  long   *source_id, *source_node, *target_id, *target_node;
+  long   n_sources, n_targets, i, j, n_written = 0;
+  double *matrix, start_time, elapsed;
+  FILE   *file;
+
+  n_sources = ReadNodeList (hierarchy, sources_file, &source_id, &source_node);
+  n_targets = ReadNodeList (hierarchy, targets_file, &target_id, &target_node);
+  printf ("%ld sources, %ld targets, %d threads\n", n_sources, n_targets, n_threads);
+
+  matrix = malloc ((n_sources * n_targets > 0 ? n_sources * n_targets : 1) * sizeof(double));
+  start_time = ElapsedSeconds ();
+  HierarchyDistanceMatrix (hierarchy, source_node, n_sources, target_node, n_targets,
+    n_threads, matrix);
+  elapsed = ElapsedSeconds () - start_time;
+  printf ("Matrix computed in %.3f seconds", elapsed);
+  if (elapsed > 0)
+    printf (" (%.0f costs per second)", n_sources * n_targets / elapsed);
+  printf ("\n");
+
+  file = fopen (output, "w");
+  if (file == NULL) {
+    printf ("Could not create %s\n", output);
+    exit (1);
+  }
+  fprintf (file, "source_id,target_id,cost\n");
+  for (i=0; i<n_sources; i++)
+    for (j=0; j<n_targets; j++)
+      if (matrix[i*n_targets + j] < HUGE_VAL) {
+        fprintf (file, "%ld,%ld,%.6f\n", source_id[i], target_id[j], matrix[i*n_targets + j]);
+        n_written++;
+      }
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", output);
+    exit (1);
+  }
+  printf ("%ld costs written to %s\n", n_written, output);
+
+  free (matrix);
+  free (source_id);
+  free (source_node);
+  free (target_id);
+  free (target_node);
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    contraction_hierarchy_struct hierarchy;
+    double start_time;
+    long   n_queries;
+    int    n_threads;
+
+    if( argc < 4 || argc > 7) {
+      printf("USAGE: %s <hierarchy> <start_node> <end_node>\n", argv[0]);
+      printf("       %s <hierarchy> RANDOM <n_queries>\n", argv[0]);
+      printf("       %s <hierarchy> MATRIX <sources> <targets> <output> [<threads>]\n", argv[0]);
+      exit( 1 );
+    }
+
+    /* Map the hierarchy: it is ready to use */
+    start_time = ElapsedSeconds ();
+    if (OpenHierarchy (argv[1], &hierarchy) != 0)
+      exit( 1 );
+    printf ("Hierarchy of %ld nodes, %ld shortcuts opened in %.3f ms\n",
+      (long) hierarchy.n_nodes, (long) hierarchy.n_shortcuts, (ElapsedSeconds () - start_time) * 1000);
+    if (hierarchy.n_nodes == 0) {
+      printf ("The network has no nodes\n");
+      exit( 1 );
+    }
+
+    if (strcmp (argv[2], "RANDOM") == 0) {
+      n_queries = atol(argv[3]);
+      if (argc != 4 || n_queries <= 0) {
+        printf ("Invalid number of queries: must be positive\n");
+        exit( 1 );
+      }
+      RandomPaths (&hierarchy, n_queries);
+    }
+    else if (strcmp (argv[2], "MATRIX") == 0) {
+      if (argc < 6) {
+        printf ("MATRIX needs the sources, targets and output files\n");
+        exit( 1 );
+      }
+      if (argc > 6)
+        n_threads = atoi(argv[6]);
+      else
+        n_threads = ProcessorThreads(HIERARCHY_MAX_THREADS);
+      if (n_threads <= 0 || n_threads > HIERARCHY_MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", HIERARCHY_MAX_THREADS);
+        exit( 1 );
+      }
+      DistanceMatrix (&hierarchy, argv[3], argv[4], argv[5], n_threads);
+    }
+    else {
+      if (argc != 4) {
+        printf ("A path query takes a start node and an end node\n");
+        exit( 1 );
+      }
+      FindPath (&hierarchy, atol(argv[2]), atol(argv[3]));
+    }
+
+    CloseHierarchy (&hierarchy);
+    return 0;
+}
@@ -0,0 +1,507 @@
+/* isochrone.c
+
+   Drive time polygons on a road network. See isochrone.h for a description
+   of the method.
+
+   Each cell of the grid of a thread holds three flags: an arc goes through
+   it, it is within the buffer of such a cell, and it is connected to the
+   border of the grid without crossing the buffered area. The cells that
+   are not connected to the border make up the polygon: the border flag is
+   set with a flood fill through the four neighbours of each cell, so that
+   two parts of the polygon that only touch at a corner do not let the
+   outside through, and the outline is a simple ring.
+
+   simplify.c keeps its work arrays in static storage: the simplification
+   of the outlines is serialized by a mutex.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "isochrone.h"
+#include "spatial_util.h"
+#include "simplify.h"
+
+#define CELL_ARC 1                    /* An arc goes through the cell */
+#define CELL_BUFFER 2                 /* The cell is within the buffer of an arc */
+#define CELL_OUTSIDE 4                /* The cell is connected to the border */
+
+#define BUFFER_CELLS 2                /* Buffer radius in cells */
+
+#define METERS_PER_DEGREE (ROAD_NETWORK_EARTH_RADIUS * M_PI / 180)
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* The work of one thread */
+struct isochrone_job
+{
+    const road_network_struct *network;
+    const long          *source_node;
+    long                n_sources;
+    double              max_cost;
+    double              buffer;
+    int                 thread;
+    int                 n_threads;
+    isochrone_struct    *isochrones;
+    route_search_struct *search;
+    route_reach_struct  reach;
+    long                n_segments;   /* Arcs, or parts of arcs, reached */
+    long                max_segments;
+    double              *segments;    /* X1, Y1, X2, Y2 of each */
+    unsigned char       *cells;
+    size_t              max_cells;
+    long                *stack;       /* Flood fill */
+    size_t              max_stack;
+    int                 n_ring;       /* Outline (ordinates) */
+    int                 max_ring;
+    double              *ring;
+};
+typedef struct isochrone_job isochrone_job_struct;
+
+/* The grid of an isochrone */
+struct isochrone_grid
+{
+    double        origin_x;           /* Lower left corner */
+    double        origin_y;
+    double        cell_x;             /* Size of the cells */
+    double        cell_y;
+    long          nx;
+    long          ny;
+    unsigned char *cells;             /* Row by row, from the bottom */
+};
+typedef struct isochrone_grid isochrone_grid_struct;
+
+#ifndef _WIN32
+static pthread_mutex_t simplify_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+static double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     AddSegment
+**
+** Description: Add a segment to be drawn
+*******************************************************************************/
+static void AddSegment (isochrone_job_struct *job, double x1, double y1, double x2, double y2)
+{
+  double *segment;
+
+  if (job->n_segments == job->max_segments) {
+    job->max_segments = job->max_segments > 0 ? 2 * job->max_segments : 4096;
+    job->segments = realloc (job->segments, job->max_segments * 4 * sizeof(double));
+  }
+  segment = job->segments + 4 * job->n_segments++;
+  segment[0] = x1;
+  segment[1] = y1;
+  segment[2] = x2;
+  segment[3] = y2;
+}
+
+/*******************************************************************************
+** Routine:     ReachedSegments
+**
+** Description: List the arcs leaving the reached nodes, cut where the cost
+**              runs out. The source itself is added as a point, so that an
+**              isolated source still gets a polygon. Returns the number of
+**              arcs.
+*******************************************************************************/
+static long ReachedSegments (isochrone_job_struct *job, long source)
+{
+  const road_network_struct *network = job->network;
+  long   i, u, v, a, n_arcs = 0;
+  double cost, f;
+
+  job->n_segments = 0;
+  AddSegment (job, network->x[source], network->y[source], network->x[source], network->y[source]);
+  for (i=0; i<job->reach.n; i++) {
+    u = job->reach.node[i];
+    cost = job->reach.cost[i];
+    for (a=network->first_out[u]; a<network->first_out[u+1]; a++) {
+      v = network->out_head[a];
+      if (cost + network->out_cost[a] <= job->max_cost)
+        f = 1;
+      else
+        f = (job->max_cost - cost) / network->out_cost[a];
+      AddSegment (job, network->x[u], network->y[u],
+        network->x[u] + f * (network->x[v] - network->x[u]),
+        network->y[u] + f * (network->y[v] - network->y[u]));
+      n_arcs++;
+    }
+  }
+  return n_arcs;
+}
+
+/*******************************************************************************
+** Routine:     SetupGrid
+**
+** Description: Size a grid on the extent of the segments, with cells of half
+**              the buffer and a margin for the buffer. Returns the buffer
+**              radius in cells.
+*******************************************************************************/
+static double SetupGrid (isochrone_job_struct *job, long source, isochrone_grid_struct *grid)
+{
+  const road_network_struct *network = job->network;
+  const double *s;
+  double min_x, min_y, max_x, max_y, radius, scale;
+  long   i, margin;
+
+  min_x = max_x = job->segments[0];
+  min_y = max_y = job->segments[1];
+  for (i=0; i<job->n_segments; i++) {
+    s = job->segments + 4*i;
+    min_x = s[0] < min_x ? s[0] : min_x;
+    min_x = s[2] < min_x ? s[2] : min_x;
+    max_x = s[0] > max_x ? s[0] : max_x;
+    max_x = s[2] > max_x ? s[2] : max_x;
+    min_y = s[1] < min_y ? s[1] : min_y;
+    min_y = s[3] < min_y ? s[3] : min_y;
+    max_y = s[1] > max_y ? s[1] : max_y;
+    max_y = s[3] > max_y ? s[3] : max_y;
+  }
+
+  /* Cells of half the buffer, in degrees around the source if geodetic */
+  grid->cell_y = job->buffer / 2;
+  if (network->geodetic)
+    grid->cell_y /= METERS_PER_DEGREE;
+  grid->cell_x = grid->cell_y;
+  if (network->geodetic)
+    grid->cell_x /= fmax (cos (network->y[source] * M_PI / 180), 0.01);
+  radius = BUFFER_CELLS;
+
+  /* Coarser cells if the area is too large */
+  scale = fmax ((max_x - min_x) / grid->cell_x, (max_y - min_y) / grid->cell_y) / (ISOCHRONE_MAX_GRID - 16);
+  if (scale > 1) {
+    grid->cell_x *= scale;
+    grid->cell_y *= scale;
+    radius /= scale;
+  }
+
+  /* The margin keeps the border of the grid clear of the buffer */
+  margin = (long) ceil (radius) + 2;
+  grid->origin_x = min_x - margin * grid->cell_x;
+  grid->origin_y = min_y - margin * grid->cell_y;
+  grid->nx = (long) ceil ((max_x - min_x) / grid->cell_x) + 2 * margin + 1;
+  grid->ny = (long) ceil ((max_y - min_y) / grid->cell_y) + 2 * margin + 1;
+  if ((size_t) (grid->nx * grid->ny) > job->max_cells) {
+    job->max_cells = (size_t) (grid->nx * grid->ny);
+    job->cells = realloc (job->cells, job->max_cells);
+  }
+  grid->cells = job->cells;
+  memset (grid->cells, 0, (size_t) (grid->nx * grid->ny));
+  return radius;
+}
+
+/*******************************************************************************
+** Routine:     DrawSegments
+**
+** Description: Mark the cells the segments go through, and the cells within
+**              the buffer radius of those. The disc of the buffer is only
+**              stamped the first time a cell is marked.
+*******************************************************************************/
+static void DrawSegments (isochrone_job_struct *job, isochrone_grid_struct *grid, double radius)
+{
+  const double *s;
+  long   disc[(2 * BUFFER_CELLS + 1) * (2 * BUFFER_CELLS + 1)];
+  long   i, k, d, n_disc = 0, n_steps, c, dx, dy, r, nx = grid->nx;
+  double x, y, step_x, step_y, scale_x = 1 / grid->cell_x, scale_y = 1 / grid->cell_y;
+
+  /* Offsets of the cells of the disc */
+  if (radius < 1)
+    radius = 1;
+  r = (long) floor (radius);
+  for (dy=-r; dy<=r; dy++)
+    for (dx=-r; dx<=r; dx++)
+      if (dx * dx + dy * dy <= radius * radius)
+        disc[n_disc++] = dy * nx + dx;
+
+  /* Cell coordinates of the points of the segments, half a cell apart */
+  for (i=0; i<job->n_segments; i++) {
+    s = job->segments + 4*i;
+    x = (s[0] - grid->origin_x) * scale_x;
+    y = (s[1] - grid->origin_y) * scale_y;
+    step_x = (s[2] - s[0]) * scale_x;
+    step_y = (s[3] - s[1]) * scale_y;
+    n_steps = (long) ceil (2 * fmax (fabs (step_x), fabs (step_y)));
+    if (n_steps > 0) {
+      step_x /= n_steps;
+      step_y /= n_steps;
+    }
+    for (k=0; k<=n_steps; k++, x+=step_x, y+=step_y) {
+      c = (long) y * nx + (long) x;
+      if (!(grid->cells[c] & CELL_ARC)) {
+        grid->cells[c] |= CELL_ARC;
+        for (d=0; d<n_disc; d++)
+          grid->cells[c + disc[d]] |= CELL_BUFFER;
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     FillOutside
+**
+** Description: Flag the cells connected to the border of the grid without
+**              crossing the buffer, through their four neighbours
+*******************************************************************************/
+static void FillOutside (isochrone_job_struct *job, isochrone_grid_struct *grid)
+{
+  unsigned char *cells = grid->cells;
+  long   n_stack = 0, c, nx = grid->nx, n = grid->nx * grid->ny;
+  long   neighbours[4];
+  int    k;
+
+  if ((size_t) n > job->max_stack) {
+    job->max_stack = (size_t) n;
+    job->stack = realloc (job->stack, job->max_stack * sizeof(long));
+  }
+
+  /* The corner is always clear (see the margin in SetupGrid) */
+  cells[0] |= CELL_OUTSIDE;
+  job->stack[n_stack++] = 0;
+  while (n_stack > 0) {
+    c = job->stack[--n_stack];
+    neighbours[0] = c % nx < nx - 1 ? c + 1 : -1;
+    neighbours[1] = c % nx > 0 ? c - 1 : -1;
+    neighbours[2] = c + nx < n ? c + nx : -1;
+    neighbours[3] = c - nx >= 0 ? c - nx : -1;
+    for (k=0; k<4; k++)
+      if (neighbours[k] >= 0 && !(cells[neighbours[k]] & (CELL_BUFFER | CELL_OUTSIDE))) {
+        cells[neighbours[k]] |= CELL_OUTSIDE;
+        job->stack[n_stack++] = neighbours[k];
+      }
+  }
+}
+
+/*******************************************************************************
+** Routine:     Inside
+**
+** Description: Tell if a cell is part of the polygon
+*******************************************************************************/
+static int Inside (const isochrone_grid_struct *grid, long cx, long cy)
+{
+  if (cx < 0 || cy < 0 || cx >= grid->nx || cy >= grid->ny)
+    return 0;
+  return !(grid->cells[cy * grid->nx + cx] & CELL_OUTSIDE);
+}
+
+/*******************************************************************************
+** Routine:     AddVertex
+**
+** Description: Add a corner of the grid to the outline
+*******************************************************************************/
+static void AddVertex (isochrone_job_struct *job, const isochrone_grid_struct *grid, long vx, long vy)
+{
+  if (job->n_ring + 2 > job->max_ring) {
+    job->max_ring = job->max_ring > 0 ? 2 * job->max_ring : 4096;
+    job->ring = realloc (job->ring, job->max_ring * sizeof(double));
+  }
+  job->ring[job->n_ring++] = grid->origin_x + vx * grid->cell_x;
+  job->ring[job->n_ring++] = grid->origin_y + vy * grid->cell_y;
+}
+
+/*******************************************************************************
+** Routine:     TraceOutline
+**
+** Description: Follow the edges between the polygon and the outside, with
+**              the polygon on the left, from the lower left corner of its
+**              lowest cell. Only the corners where the outline turns are
+**              kept.
+*******************************************************************************/
+static void TraceOutline (isochrone_job_struct *job, const isochrone_grid_struct *grid)
+{
+  /* Directions: east, north, west, south */
+  static const int step_x[4] = { 1, 0, -1, 0 };
+  static const int step_y[4] = { 0, 1, 0, -1 };
+  /* Cells ahead on the left and on the right of a corner, for each direction,
+     as offsets from the cell whose lower left corner it is */
+  static const int left_x[4] = { 0, -1, -1, 0 };
+  static const int left_y[4] = { 0, 0, -1, -1 };
+  static const int right_x[4] = { 0, 0, -1, -1 };
+  static const int right_y[4] = { -1, 0, 0, -1 };
+  long   start_x = -1, start_y = -1, vx, vy, c;
+  int    d, next;
+
+  job->n_ring = 0;
+  for (c=0; c<grid->nx * grid->ny && start_x < 0; c++)
+    if (Inside (grid, c % grid->nx, c / grid->nx)) {
+      start_x = c % grid->nx;
+      start_y = c / grid->nx;
+    }
+  if (start_x < 0)
+    return;
+
+  vx = start_x;
+  vy = start_y;
+  d = 0;
+  AddVertex (job, grid, vx, vy);
+  for (;;) {
+    vx += step_x[d];
+    vy += step_y[d];
+    if (vx == start_x && vy == start_y) {
+      AddVertex (job, grid, vx, vy);
+      break;
+    }
+    if (!Inside (grid, vx + left_x[d], vy + left_y[d]))
+      next = (d + 1) % 4;
+    else if (Inside (grid, vx + right_x[d], vy + right_y[d]))
+      next = (d + 3) % 4;
+    else
+      next = d;
+    if (next != d) {
+      AddVertex (job, grid, vx, vy);
+      d = next;
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     MakePolygon
+**
+** Description: Turn the segments reached from a source into a simplified
+**              polygon
+*******************************************************************************/
+static void MakePolygon (isochrone_job_struct *job, long source, isochrone_struct *isochrone)
+{
+  isochrone_grid_struct   grid;
+  simplify_options_struct options;
+  int    elem_info[3] = { 1, 1003, 1 };
+  double radius;
+
+  radius = SetupGrid (job, source, &grid);
+  DrawSegments (job, &grid, radius);
+  FillOutside (job, &grid);
+  TraceOutline (job, &grid);
+
+  options.method = SIMPLIFY_DOUGLAS_PEUCKER;
+  options.tolerance = fmin (grid.cell_x, grid.cell_y);
+  options.points_in = options.points_out = 0;
+#ifndef _WIN32
+  pthread_mutex_lock (&simplify_mutex);
+#endif
+  job->n_ring = SimplifyElements (elem_info, 3, job->ring, job->n_ring, 2, &options);
+#ifndef _WIN32
+  pthread_mutex_unlock (&simplify_mutex);
+#endif
+
+  isochrone->n_ordinates = job->n_ring;
+  isochrone->ordinates = malloc (job->n_ring * sizeof(double));
+  memcpy (isochrone->ordinates, job->ring, job->n_ring * sizeof(double));
+}
+
+/*******************************************************************************
+** Routine:     IsochroneWorker
+**
+** Description: Thread routine: compute the isochrones of the sources
+**              assigned to the thread
+*******************************************************************************/
+static void *IsochroneWorker (void *argument)
+{
+  isochrone_job_struct *job = (isochrone_job_struct *) argument;
+  isochrone_struct     *isochrone;
+  double start_time, search_time;
+  long   i, source;
+
+  job->search = CreateRouteSearch (job->network);
+  for (i=job->thread; i<job->n_sources; i+=job->n_threads) {
+    isochrone = &job->isochrones[i];
+    source = job->source_node[i];
+    if (source < 0)
+      continue;
+    start_time = ElapsedSeconds ();
+    isochrone->n_reached = ReachableNodes (job->network, job->search, source, job->max_cost, &job->reach);
+    search_time = ElapsedSeconds ();
+    isochrone->n_arcs = ReachedSegments (job, source);
+    MakePolygon (job, source, isochrone);
+    isochrone->search_seconds = search_time - start_time;
+    isochrone->polygon_seconds = ElapsedSeconds () - search_time;
+  }
+  FreeRouteSearch (job->search);
+  FreeReach (&job->reach);
+  free (job->segments);
+  free (job->cells);
+  free (job->stack);
+  free (job->ring);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     ComputeIsochrones
+**
+** Description: Compute the isochrone of each source node (node numbers
+**              returned by FindRoadNode), with n_threads threads. Sources
+**              that are negative get no polygon.
+*******************************************************************************/
+void ComputeIsochrones (
+  const road_network_struct *network,
+  const long                *source_node,
+  long                      n_sources,
+  double                    max_cost,
+  double                    buffer,
+  int                       n_threads,
+  isochrone_struct          *isochrones)
+{
+  isochrone_job_struct jobs[ISOCHRONE_MAX_THREADS];
+  long i;
+  int  t;
+
+  for (i=0; i<n_sources; i++) {
+    memset (&isochrones[i], 0, sizeof(isochrone_struct));
+    isochrones[i].source_node = source_node[i];
+  }
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > ISOCHRONE_MAX_THREADS)
+    n_threads = ISOCHRONE_MAX_THREADS;
+  if (n_threads > n_sources)
+    n_threads = n_sources > 0 ? (int) n_sources : 1;
+
+  for (t=0; t<n_threads; t++) {
+    memset (&jobs[t], 0, sizeof(isochrone_job_struct));
+    jobs[t].network = network;
+    jobs[t].source_node = source_node;
+    jobs[t].n_sources = n_sources;
+    jobs[t].max_cost = max_cost;
+    jobs[t].buffer = buffer;
+    jobs[t].thread = t;
+    jobs[t].n_threads = n_threads;
+    jobs[t].isochrones = isochrones;
+  }
+  RunJobs (IsochroneWorker, jobs, sizeof(isochrone_job_struct), n_threads);
+}
+
+/*******************************************************************************
+** Routine:     FreeIsochrones
+**
+** Description: Free the polygons of a set of isochrones
+*******************************************************************************/
+void FreeIsochrones (isochrone_struct *isochrones, long n_sources)
+{
+  long i;
+
+  for (i=0; i<n_sources; i++) {
+    free (isochrones[i].ordinates);
+    isochrones[i].ordinates = NULL;
+    isochrones[i].n_ordinates = 0;
+  }
+}
@@ -0,0 +1,56 @@
+/* isochrone.h
+
+   Drive time polygons (isochrones) on a road network.
+
+   The isochrone of a source node is the area that can be reached from it
+   within a cost (a drive time, or a distance). ComputeIsochrones finds the
+   nodes reached from each source with ReachableNodes (see road_network.h),
+   and turns them into a polygon:
+
+   - every arc leaving a reached node is drawn, up to the point where the
+     cost runs out: in full if its end node is reached through it, in part
+     otherwise. Arcs are drawn as straight lines between their nodes.
+   - the arcs are drawn into a grid, and buffered by a distance, so that
+     the area around the roads is included.
+   - the holes of the buffered area are filled, and its outline traced
+     along the edges of the grid cells, giving a single exterior ring in
+     counterclockwise order.
+   - the staircase outline is simplified with the Douglas-Peucker method
+     (see simplify.h), with a tolerance of half the buffer.
+
+   The buffer distance is in the unit of the coordinates, or in meters for
+   geodetic networks. The cells of the grid are half the buffer wide, or
+   larger if the reached area is more than ISOCHRONE_MAX_GRID cells wide.
+
+   The sources are spread over several threads, each with its own search
+   work space and grid. The time taken by the search and by the polygon of
+   each source is recorded with it.
+
+*/
+#ifndef ISOCHRONE_H
+#define ISOCHRONE_H
+
+#include "road_network.h"
+
+#define ISOCHRONE_MAX_GRID 4096       /* Maximum number of cells per side */
+#define ISOCHRONE_MAX_THREADS 64
+
+/* The isochrone of a source */
+struct isochrone
+{
+    long   source_node;
+    long   n_reached;                 /* Nodes reached */
+    long   n_arcs;                    /* Arcs drawn, in full or in part */
+    int    n_ordinates;               /* Exterior ring (X and Y), closed */
+    double *ordinates;
+    double search_seconds;            /* Time taken by the search */
+    double polygon_seconds;           /* Time taken by the polygon */
+};
+typedef struct isochrone isochrone_struct;
+
+void ComputeIsochrones (const road_network_struct *network, const long *source_node,
+                        long n_sources, double max_cost, double buffer, int n_threads,
+                        isochrone_struct *isochrones);
+void FreeIsochrones (isochrone_struct *isochrones, long n_sources);
+
+#endif
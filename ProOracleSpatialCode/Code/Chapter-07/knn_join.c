@@ -0,0 +1,220 @@
+/* knn_join.c
+
+   This program finds, for each point of a layer (the outer layer), the k
+   nearest points of another layer (the inner layer), and writes the pairs
+   with their rank and distance to a CSV file.
+
+   It is the client-side counterpart of a correlated SDO_NN query (see
+   chapter 8 and listing 14-3), such as finding the nearest branch of each
+   customer:
+
+     SELECT c.id, b.id, SDO_NN_DISTANCE(1)
+       FROM customers c, branches b
+      WHERE SDO_NN(b.location, c.location, 'SDO_NUM_RES=1', 1) = 'TRUE'
+
+   which runs one nearest-neighbour search in the database per customer.
+   Instead, both layers are first extracted with read_points_array.c into
+   point dumps (see point_dump.h), with their id column:
+
+     read_points_array scott tiger orcl branches location 10000 0 id --dump=branches.pts
+     read_points_array scott tiger orcl customers location 10000 0 id --dump=customers.pts
+
+   The program then indexes the inner layer in a packed R-tree (see
+   point_tree.h), and reads the outer layer through in batches, searching
+   the nearest points of each batch with several threads.
+
+   It illustrates the following concepts:
+   - processing a point dump
+
+   The program takes the following command line arguments:
+
+     knn_join inner_dump outer_dump output k [threads] [GEODETIC|CARTESIAN]
+
+   where
+
+   - inner_dump = point dump of the layer to search (usually the smaller one,
+     the branches in the example)
+   - outer_dump = point dump of the layer to find neighbours for (the
+     customers)
+   - output = name of the CSV file to write the pairs to:
+     outer_id,inner_id,rank,distance
+   - k = number of neighbours to find for each outer point
+   - threads = number of search threads (default is one per processor)
+   - GEODETIC = coordinates are longitudes and latitudes: distances are
+     computed along the great circle, in meters
+   - CARTESIAN = distances are computed on the coordinates as they are, in
+     the unit of the coordinates.
+     The default is GEODETIC if the SRID of the dumps is 8307 or 4326, and
+     CARTESIAN otherwise.
+
+   Notes:
+
+   The program must be linked with point_tree.c, point_dump.c and
+   spatial_util.c. On Linux and other POSIX systems it also needs the POSIX
+   threads library. It does not connect to the database.
+
+   The ids written are those of the dumps, or the position of the point in
+   the dump (from 1) if the dump has no ids. Ranks start at 1. Outer points
+   get fewer than k rows if the inner layer has fewer than k points.
+
+   Geodetic distances are computed on a sphere, and may differ by up to 0.5%
+   from those returned by SDO_NN_DISTANCE (see point_tree.h).
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "point_dump.h"
+#include "point_tree.h"
+#include "spatial_util.h"
+
+#define KNN_BATCH_SIZE 100000         /* Outer points searched at a time */
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     IsGeodetic
+**
+** Description: Check if an SRID is one of the usual geodetic (longitude,
+**              latitude) systems
+*******************************************************************************/
+int IsGeodetic (int srid)
+{
+  return srid == 8307 || srid == 4326;
+}
+
+/*******************************************************************************
+** Routine:     PointId
+**
+** Description: Id of a point of a dump: its id, or its position from 1
+*******************************************************************************/
+long PointId (point_dump_struct *dump, long i)
+{
+  return dump->id != NULL ? (long) dump->id[i] : i + 1;
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *inner_file, *outer_file, *output;
+    point_dump_struct inner, outer;
+    point_tree_struct *tree;
+    FILE   *file;
+    long   *index;
+    double *distance;
+    long   first, n, i, n_pairs = 0;
+    int    k, j, n_threads, geodetic;
+    double start_time, search_time = 0, elapsed;
+
+    if( argc < 5 || argc > 7) {
+      printf("USAGE: %s <inner_dump> <outer_dump> <output> <k> [<threads>] [GEODETIC|CARTESIAN]\n", argv[0]);
+      exit( 1 );
+    }
+    inner_file = argv[1];
+    outer_file = argv[2];
+    output = argv[3];
+    k = atoi(argv[4]);
+    if (k <= 0) {
+      printf ("Invalid number of neighbours: must be positive\n");
+      exit( 1 );
+    }
+    if (argc > 5)
+      n_threads = atoi(argv[5]);
+    else
+      n_threads = ProcessorThreads(POINT_TREE_MAX_THREADS);
+    if (n_threads <= 0 || n_threads > POINT_TREE_MAX_THREADS) {
+      printf ("Invalid number of threads: must be between 1 and %d\n", POINT_TREE_MAX_THREADS);
+      exit( 1 );
+    }
+
+    /* Map the dumps: the arrays are ready to use */
+    if (OpenPointDump (inner_file, &inner) != 0)
+      exit( 1 );
+    if (OpenPointDump (outer_file, &outer) != 0)
+      exit( 1 );
+    if (inner.srid != 0 && outer.srid != 0 && inner.srid != outer.srid) {
+      printf ("The dumps use different coordinate systems (%d and %d)\n", inner.srid, outer.srid);
+      exit( 1 );
+    }
+    if (argc > 6) {
+      if (strcmp (argv[6], "GEODETIC") == 0)
+        geodetic = 1;
+      else if (strcmp (argv[6], "CARTESIAN") == 0)
+        geodetic = 0;
+      else {
+        printf ("Invalid distance type: must be GEODETIC or CARTESIAN\n");
+        exit( 1 );
+      }
+    }
+    else
+      geodetic = IsGeodetic (inner.srid != 0 ? inner.srid : outer.srid);
+    printf ("%ld inner points, %ld outer points, %d neighbours, %s distances, %d threads\n",
+      (long) inner.count, (long) outer.count, k, geodetic ? "geodetic" : "cartesian", n_threads);
+
+    file = fopen (output, "w");
+    if (file == NULL) {
+      printf ("Could not create %s\n", output);
+      exit( 1 );
+    }
+    fprintf (file, "outer_id,inner_id,rank,distance\n");
+
+    /* Index the inner points */
+    start_time = ElapsedSeconds ();
+    tree = BuildPointTree (inner.x, inner.y, (long) inner.count, geodetic);
+    printf ("Tree built in %.3f seconds\n", ElapsedSeconds () - start_time);
+
+    /* Search the neighbours of the outer points, one batch at a time */
+    if (tree != NULL) {
+      index = malloc ((size_t) KNN_BATCH_SIZE * k * sizeof(long));
+      distance = malloc ((size_t) KNN_BATCH_SIZE * k * sizeof(double));
+      for (first=0; first<outer.count; first+=n) {
+        n = outer.count - first < KNN_BATCH_SIZE ? (long) (outer.count - first) : KNN_BATCH_SIZE;
+        start_time = ElapsedSeconds ();
+        NearestPointsJoin (tree, outer.x + first, outer.y + first, n, k, n_threads,
+          index, distance);
+        search_time += ElapsedSeconds () - start_time;
+        for (i=0; i<n; i++)
+          for (j=0; j<k && index[i*k + j] >= 0; j++) {
+            fprintf (file, "%ld,%ld,%d,%.6f\n", PointId (&outer, first + i),
+              PointId (&inner, index[i*k + j]), j + 1, distance[i*k + j]);
+            n_pairs++;
+          }
+      }
+      free (index);
+      free (distance);
+      FreePointTree (tree);
+    }
+
+    if (fclose (file) != 0) {
+      printf ("Could not write %s\n", output);
+      exit( 1 );
+    }
+    elapsed = search_time > 0 ? search_time : 1e-9;
+    printf ("%ld pairs found in %.3f seconds (%.0f outer points per second)\n",
+      n_pairs, search_time, outer.count / elapsed);
+    printf ("Pairs written to %s\n", output);
+
+    ClosePointDump (&inner);
+    ClosePointDump (&outer);
+    return 0;
+}
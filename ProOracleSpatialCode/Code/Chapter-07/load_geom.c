@@ -20,10 +20,15 @@
 
    The program illustrates the following concepts:
    - encoding and writing geometry objects
+   - sizing transactions on the spatial index DML batch size
+   - restarting a failed load from a checkpoint
+   - validating geometries on the client before inserting them
+   - transforming coordinates on the client before inserting them
 
    The program takes the following command line arguments:
 
-     load_geom username password database table id_column geo_column filename
+     load_geom username password database table id_column geo_column filename [commit_batches]
+       [tolerance] [threads] [--from-srid=srid] [--to-srid=srid] [--transform-check]
 
    where
 
@@ -34,6 +39,45 @@
    - id_column = the id column
    - geo_column = the geometry column to load into
    - filename = the input file to process
+   - commit_batches = number of spatial index DML batches per commit (default is 1)
+   - tolerance = validate the geometries with this tolerance before inserting
+     them (default is 0: no validation)
+   - threads = number of validation threads (default is one per processor)
+   - --from-srid = coordinate system of the coordinates of the file, stored as
+     the SDO_SRID of the geometries (default is none: a NULL SDO_SRID)
+   - --to-srid = transform the geometries from the --from-srid coordinate
+     system to this one, and store them with this SDO_SRID
+   - --transform-check = check the transformations against the control
+     points of the EPSG guidance note 7-2, and stop
+
+   Notes:
+
+   Changes to a spatial index are buffered and applied at commit time, in batches
+   of SDO_DML_BATCH_SIZE rows (see listing 14-13). The program reads that parameter
+   from USER_SDO_INDEX_METADATA for the index on the geometry column and commits
+   every commit_batches * SDO_DML_BATCH_SIZE rows, so that each commit hands full
+   batches to the index. If the column is not indexed, the Oracle default of 1000
+   is used.
+
+   After each commit, the number of rows loaded and the position reached in the
+   input file are written to a checkpoint file called <filename>.ckpt. If the
+   program is started again on the same file and a checkpoint exists, the load
+   resumes after the last committed row. The checkpoint is removed when the load
+   completes. A failure between a commit and the writing of its checkpoint causes
+   the rows of that one transaction to be loaded again on restart.
+
+   The geometries are read from the file in batches of VALIDATE_BATCH_SIZE.
+   When a tolerance is given, each batch is validated by several threads with
+   the same checks as SDO_GEOM.VALIDATE_GEOMETRY_WITH_CONTEXT (see validate.c,
+   which must be linked with the program, as must spatial_util.c) before any
+   of its geometries are inserted. Invalid geometries are not inserted: their
+   id is printed out with the error number and context, as the database would
+   return them.
+
+   Each batch is transformed before it is validated, so that the tolerance
+   applies to the coordinates that are inserted (see coord_transform.c,
+   which must be linked with the program). Only the coordinate systems
+   listed in coord_transform.h are supported, without any change of datum.
 
 */
 #include <stdio.h>
@@ -41,8 +85,13 @@
 #include <string.h>
 #include <oci.h>
 #include "sdo_geometry.h"
+#include "validate.h"
+#include "coord_transform.h"
+#include "spatial_util.h"
 
 #define use_array_interface 0
+#define DEFAULT_DML_BATCH_SIZE 1000
+#define VALIDATE_BATCH_SIZE 1024
 
 /*******************************************************************************
 ** Global variables
@@ -54,6 +103,10 @@ OCIEnv       *envhp;  /* Environment handle*/
 OCIError     *errhp;  /* Error handle */
 OCISvcCtx    *svchp;  /* Service Context handle*/
 
+/* Transformation settings (--from-srid and --to-srid options) */
+
+transform_options_struct transform_options;
+
 /*******************************************************************************
 ** Types and structures
 *******************************************************************************/
@@ -228,20 +281,413 @@ void FreeGeometry (geometry_struct *geometry) {
 ** Description: Stores a geometry from a C memory structure.into an SDO_GEOMETRY
 **              object structure
 *******************************************************************************/
-SDO_GEOMETRY *StoreGeometry ()
+void StoreGeometry (
+  geometry_struct     *geometry,
+  SDO_GEOMETRY        *geometry_object,
+  SDO_GEOMETRY_ind    *geometry_object_ind
+)
 {
+  OCINumber oci_number;
+  sb4       size;
+  long      i;
+  int       dim;
+  sword     status;
+
+  dim = geometry->gtype / 1000;
+  geometry_object_ind->_atomic = OCI_IND_NOTNULL;
+
+  /* Set SDO_GTYPE */
+  OCINumberFromInt (
+    errhp,
+    (dvoid *) &geometry->gtype,
+    (uword) sizeof (int),
+    OCI_NUMBER_SIGNED,
+    &(geometry_object->SDO_GTYPE));
+  geometry_object_ind->SDO_GTYPE = OCI_IND_NOTNULL;
+
+  /* Set SDO_SRID (a zero SRID is stored as NULL) */
+  if (geometry->srid != 0) {
+    OCINumberFromInt (
+      errhp,
+      (dvoid *) &geometry->srid,
+      (uword) sizeof (int),
+      OCI_NUMBER_SIGNED,
+      &(geometry_object->SDO_SRID));
+    geometry_object_ind->SDO_SRID = OCI_IND_NOTNULL;
+  }
+  else
+    geometry_object_ind->SDO_SRID = OCI_IND_NULL;
+
+  /* Set SDO_POINT */
+  if (geometry->point != NULL) {
+    OCINumberFromReal(
+      errhp, (dvoid *)&geometry->point->x, (uword)sizeof(double), &(geometry_object->SDO_POINT.X));
+    OCINumberFromReal(
+      errhp, (dvoid *)&geometry->point->y, (uword)sizeof(double), &(geometry_object->SDO_POINT.Y));
+    geometry_object_ind->SDO_POINT._atomic = OCI_IND_NOTNULL;
+    geometry_object_ind->SDO_POINT.X = OCI_IND_NOTNULL;
+    geometry_object_ind->SDO_POINT.Y = OCI_IND_NOTNULL;
+    if (dim > 2) {
+      OCINumberFromReal(
+        errhp, (dvoid *)&geometry->point->z, (uword)sizeof(double), &(geometry_object->SDO_POINT.Z));
+      geometry_object_ind->SDO_POINT.Z = OCI_IND_NOTNULL;
+    }
+    else
+      geometry_object_ind->SDO_POINT.Z = OCI_IND_NULL;
+  }
+  else
+    geometry_object_ind->SDO_POINT._atomic = OCI_IND_NULL;
+
+  /* Set SDO_ELEM_INFO array */
+
+  /* Empty the array: the object is reused from one row to the next */
+  OCICollSize (envhp, errhp,
+    (OCIColl *)(geometry_object->SDO_ELEM_INFO), &size);
+  if (size > 0)
+    OCICollTrim (envhp, errhp, size, (OCIColl *)(geometry_object->SDO_ELEM_INFO));
+
+  /* Append the elements one by one */
+  for (i=0; i<geometry->n_elem_info; i++) {
+    OCINumberFromInt (errhp,
+      (dvoid *) &geometry->elem_info[i],
+      (uword) sizeof (int),
+      OCI_NUMBER_UNSIGNED,
+      &oci_number);
+    status = OCICollAppend (envhp, errhp,
+      (dvoid *) &oci_number,
+      (dvoid *) 0,
+      (OCIColl *) (geometry_object->SDO_ELEM_INFO));
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+  geometry_object_ind->SDO_ELEM_INFO =
+    geometry->n_elem_info > 0 ? OCI_IND_NOTNULL : OCI_IND_NULL;
+
+  /* Set SDO_ORDINATES array */
+
+  /* Empty the array */
+  OCICollSize (envhp, errhp,
+    (OCIColl *)(geometry_object->SDO_ORDINATES), &size);
+  if (size > 0)
+    OCICollTrim (envhp, errhp, size, (OCIColl *)(geometry_object->SDO_ORDINATES));
+
+  /* Append the ordinates one by one */
+  for (i=0; i<geometry->n_ordinates; i++) {
+    OCINumberFromReal (errhp,
+      (dvoid *) &geometry->ordinates[i],
+      (uword) sizeof (double),
+      &oci_number);
+    status = OCICollAppend (envhp, errhp,
+      (dvoid *) &oci_number,
+      (dvoid *) 0,
+      (OCIColl *) (geometry_object->SDO_ORDINATES));
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+  geometry_object_ind->SDO_ORDINATES =
+    geometry->n_ordinates > 0 ? OCI_IND_NOTNULL : OCI_IND_NULL;
+}
+
+/*******************************************************************************
+** Routine:     TransformGeometry
+**
+** Description: Give a geometry read from the file the SRID of the command
+**              line, and transform it to the target SRID if one is requested
+*******************************************************************************/
+void TransformGeometry (geometry_struct *geometry) {
+  geometry->srid = TransformElements (
+    &transform_options, transform_options.from_srid,
+    geometry->point != NULL ? &geometry->point->x : NULL,
+    geometry->point != NULL ? &geometry->point->y : NULL,
+    geometry->ordinates, geometry->n_ordinates,
+    geometry->gtype / 1000);
 }
 
 /*******************************************************************************
 ** Routine:     ReadGeometryFromFile
 **
-** Description: Reads and parses a geometry from the input file
+** Description: Reads and parses a geometry from the input file. Returns NULL
+**              at the end of the file.
 *******************************************************************************/
 geometry_struct* ReadGeometryFromFile (
-  FILE *input_file
+  FILE *input_file,
+  long *id
   )
 {
+  geometry_struct *geometry;
+  int    type, dim;
+  int    n_points;
+  int    max_ordinates;
+  int    c;
+  double value;
+
+  /* Read the record header */
+  if (fscanf (input_file, "%ld %d %d", id, &type, &dim) != 3)
+    return NULL;
+  if (type < 1 || type > 3 || dim < 2 || dim > 4) {
+    printf ("Geometry %ld: invalid type (%d) or dimension (%d)\n", *id, type, dim);
+    exit (1);
+  }
+
+  /* Allocate geometry structure */
+  geometry = malloc (sizeof(geometry_struct));
+  geometry->gtype = dim * 1000 + type;
+  geometry->srid = 0;
+  geometry->point = NULL;
+  geometry->n_elem_info = 0;
+  geometry->elem_info = NULL;
 
+  /* Read the ordinates up to the end of the line */
+  max_ordinates = 1024;
+  geometry->n_ordinates = 0;
+  geometry->ordinates = malloc (sizeof(double)*max_ordinates);
+  for (;;) {
+    c = getc (input_file);
+    while (c == ' ' || c == '\t' || c == '\r')
+      c = getc (input_file);
+    if (c == '\n' || c == EOF)
+      break;
+    ungetc (c, input_file);
+    if (fscanf (input_file, "%lf", &value) != 1) {
+      printf ("Geometry %ld: invalid ordinate\n", *id);
+      exit (1);
+    }
+    if (geometry->n_ordinates == max_ordinates) {
+      max_ordinates = max_ordinates * 2;
+      geometry->ordinates = realloc (geometry->ordinates, sizeof(double)*max_ordinates);
+    }
+    geometry->ordinates[geometry->n_ordinates++] = value;
+  }
+  n_points = geometry->n_ordinates / dim;
+  if (n_points == 0 || geometry->n_ordinates % dim != 0) {
+    printf ("Geometry %ld: %d ordinates do not form %d-dimensional points\n",
+      *id, geometry->n_ordinates, dim);
+    exit (1);
+  }
+
+  if (type == 1 && n_points == 1) {
+    /* A single point goes into SDO_POINT */
+    geometry->point = malloc (sizeof(point_struct));
+    geometry->point->x = geometry->ordinates[0];
+    geometry->point->y = geometry->ordinates[1];
+    geometry->point->z = dim > 2 ? geometry->ordinates[2] : 0;
+    free (geometry->ordinates);
+    geometry->ordinates = NULL;
+    geometry->n_ordinates = 0;
+  }
+  else {
+    /* All other shapes are made of one element */
+    geometry->n_elem_info = 3;
+    geometry->elem_info = malloc (sizeof(int)*3);
+    geometry->elem_info[0] = 1;
+    switch (type) {
+      case 1:
+        /* Several points: a multi-point with a point cluster element */
+        geometry->gtype = dim * 1000 + 5;
+        geometry->elem_info[1] = 1;
+        geometry->elem_info[2] = n_points;
+        break;
+      case 2:
+        geometry->elem_info[1] = 2;
+        geometry->elem_info[2] = 1;
+        break;
+      case 3:
+        geometry->elem_info[1] = 1003;
+        geometry->elem_info[2] = 1;
+        break;
+    }
+  }
+
+  return geometry;
+}
+
+/*******************************************************************************
+** Routine:     GetDmlBatchSize
+**
+** Description: Returns the SDO_DML_BATCH_SIZE of the spatial index on the
+**              geometry column, or the default batch size if there is none
+*******************************************************************************/
+int GetDmlBatchSize (
+  char *tablename,
+  char *geo_column)
+{
+  char      *select_sql =
+    "SELECT m.sdo_dml_batch_size "
+    "FROM user_sdo_index_info i, user_sdo_index_metadata m "
+    "WHERE i.index_name = m.sdo_index_name "
+    "AND i.table_name = UPPER(:table_name) "
+    "AND i.column_name = UPPER(:column_name)";
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  OCIBind   *table_name_hp = NULL;
+  OCIBind   *column_name_hp = NULL;
+  OCIDefine *batch_size_hp;
+  int       batch_size = 0;
+  sb2       batch_size_ind = OCI_IND_NULL;
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* TABLE_NAME (string) */
+  status = OCIBindByName(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &table_name_hp,                  /* (out) Bind Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *) ":TABLE_NAME",          /* (in)  Placeholder */
+    strlen(":TABLE_NAME"),           /* (in)  Placeholder length */
+    (ub1 *) tablename,               /* (in)  Value Pointer */
+    strlen(tablename)+1,             /* (in)  Value Size */
+    SQLT_STR,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* COLUMN_NAME (string) */
+  status = OCIBindByName(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &column_name_hp,                 /* (out) Bind Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *) ":COLUMN_NAME",         /* (in)  Placeholder */
+    strlen(":COLUMN_NAME"),          /* (in)  Placeholder length */
+    (ub1 *) geo_column,              /* (in)  Value Pointer */
+    strlen(geo_column)+1,            /* (in)  Value Size */
+    SQLT_STR,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 1 = SDO_DML_BATCH_SIZE (integer) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &batch_size_hp,                  /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Bind variable position */
+    (dvoid *) &batch_size,           /* (in)  Value Pointer */
+    sizeof(batch_size),              /* (in)  Value Size */
+    SQLT_INT,                        /* (in)  Data Type */
+    (dvoid *) &batch_size_ind,       /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch the only row */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Number of rows to fetch: 1 */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+
+  /* No spatial index, or no batch size set: use the default */
+  if (status == OCI_NO_DATA || batch_size_ind != OCI_IND_NOTNULL || batch_size <= 0)
+    batch_size = DEFAULT_DML_BATCH_SIZE;
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  return batch_size;
+}
+
+/*******************************************************************************
+** Routine:     ReadCheckpoint
+**
+** Description: Reads the checkpoint left by a previous run, if any. Returns
+**              the number of rows already loaded and sets the file offset to
+**              resume from.
+*******************************************************************************/
+long ReadCheckpoint (
+  char *checkpoint_filename,
+  long *offset)
+{
+  FILE *checkpoint_file;
+  long rows_loaded;
+
+  *offset = 0;
+  checkpoint_file = fopen (checkpoint_filename, "r");
+  if (checkpoint_file == NULL)
+    return 0;
+  if (fscanf (checkpoint_file, "%ld %ld", &rows_loaded, offset) != 2) {
+    printf ("Invalid checkpoint file %s\n", checkpoint_filename);
+    exit (1);
+  }
+  fclose (checkpoint_file);
+  return rows_loaded;
+}
+
+/*******************************************************************************
+** Routine:     WriteCheckpoint
+**
+** Description: Records the number of rows committed so far and the position
+**              reached in the input file
+*******************************************************************************/
+void WriteCheckpoint (
+  char *checkpoint_filename,
+  long rows_loaded,
+  long offset)
+{
+  FILE *checkpoint_file;
+  char temp_filename[1024];
+
+  /* Write a new checkpoint next to the old one, then replace the old one,
+     so that a crash never leaves a partially written checkpoint behind */
+  sprintf (temp_filename, "%s.tmp", checkpoint_filename);
+  checkpoint_file = fopen (temp_filename, "w");
+  if (checkpoint_file == NULL) {
+    printf ("Could not write checkpoint file %s\n", temp_filename);
+    exit (1);
+  }
+  fprintf (checkpoint_file, "%ld %ld\n", rows_loaded, offset);
+  fclose (checkpoint_file);
+  if (rename (temp_filename, checkpoint_filename) != 0) {
+    /* Some platforms do not let rename() replace an existing file */
+    remove (checkpoint_filename);
+    if (rename (temp_filename, checkpoint_filename) != 0) {
+      printf ("Could not write checkpoint file %s\n", checkpoint_filename);
+      exit (1);
+    }
+  }
 }
 
 /*******************************************************************************
@@ -253,10 +699,23 @@ void LoadGeometries (
   char *tablename,
   char *id_column,
   char *geo_column,
-  char *filename)
+  char *filename,
+  int  commit_batches,
+  double tolerance,
+  int  n_threads)
 {
-  int               rows_loaded = 0;         /* Row counter */
+  long              rows_loaded = 0;         /* Row counter */
+  long              rows_rejected = 0;       /* Invalid geometries not loaded */
+  long              vertices_validated = 0;  /* Number of points validated */
+  double            validation_time = 0;     /* Time spent validating, in seconds */
+  int               n_batch;                 /* Number of geometries in the batch */
+  int               i;
+  long              rows_in_transaction = 0; /* Rows inserted since last commit */
+  long              commit_interval;         /* Rows per transaction */
+  long              resume_offset;           /* File position to restart from */
+  int               dml_batch_size;          /* SDO_DML_BATCH_SIZE of the spatial index */
   char              insert_statement[1024];  /* Buffer to build INSERT statement */
+  char              checkpoint_filename[1024];
   OCIStmt           *insert_stmthp;          /* Statement handle */
   sword             status;                  /* OCI call return status */
   FILE              *input_file;
@@ -276,6 +735,13 @@ void LoadGeometries (
   /* Host variables */
   geometry_struct   *geometry;
 
+  /* Geometries read ahead and validated together, with their ids and the
+     position in the file after each of them */
+  geometry_struct     *batch[VALIDATE_BATCH_SIZE];
+  long                batch_ids[VALIDATE_BATCH_SIZE];
+  long                batch_offsets[VALIDATE_BATCH_SIZE];
+  validate_job_struct *jobs;
+
   /* Open input file */
   input_file = fopen (filename, "r");
   if (input_file == NULL) {
@@ -283,6 +749,26 @@ void LoadGeometries (
     exit (1);
   }
 
+  /* Resume from the checkpoint of a previous run, if any */
+  sprintf (checkpoint_filename, "%s.ckpt", filename);
+  rows_loaded = ReadCheckpoint (checkpoint_filename, &resume_offset);
+  if (rows_loaded > 0) {
+    printf ("Resuming after %ld rows loaded by a previous run\n", rows_loaded);
+    if (fseek (input_file, resume_offset, SEEK_SET) != 0) {
+      printf ("Could not position file %s at offset %ld\n", filename, resume_offset);
+      exit (1);
+    }
+  }
+
+  /* Size transactions on whole spatial index DML batches */
+  dml_batch_size = GetDmlBatchSize (tablename, geo_column);
+  commit_interval = (long) dml_batch_size * commit_batches;
+  printf ("SDO_DML_BATCH_SIZE: %d - committing every %ld rows\n", dml_batch_size, commit_interval);
+  if (tolerance > 0)
+    printf ("Validating with tolerance %g using %d threads\n", tolerance, n_threads);
+  printf ("\n");
+  jobs = malloc (sizeof(validate_job_struct) * VALIDATE_BATCH_SIZE);
+
   /* Construct the insert statement */
   sprintf (insert_statement, "insert into %s (%s, %s) values (:id, :geometry)", tablename, id_column, geo_column);
   printf ("Executing :\nSQL> %s\n\n", insert_statement);
@@ -322,6 +808,30 @@ void LoadGeometries (
     OCI_DURATION_SESSION,            /* (in)  Pin duration */
     OCI_TYPEGET_HEADER ,             /* (in)  Get option */
     &geometry_type_desc);            /* (out) Type descriptor */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Allocate the geometry object. It is reused for all rows */
+  status = OCIObjectNew(
+    envhp,                           /* (in)  Environment Handle */
+    errhp,                           /* (in)  Error Handle */
+    svchp,                           /* (in)  Service Context Handle */
+    OCI_TYPECODE_OBJECT,             /* (in)  Type code */
+    geometry_type_desc,              /* (in)  Type descriptor */
+    (dvoid *) 0,                     /* (in)  Table (NOT USED: transient object) */
+    OCI_DURATION_SESSION,            /* (in)  Duration */
+    TRUE,                            /* (in)  Allocate the embedded collections */
+    (dvoid **) &geometry_obj);       /* (out) Object */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  status = OCIObjectGetInd(
+    envhp,                           /* (in)  Environment Handle */
+    errhp,                           /* (in)  Error Handle */
+    (dvoid *) geometry_obj,          /* (in)  Object */
+    (dvoid **) &geometry_ind);       /* (out) Indicator structure */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
 
   /* Bind the input variables */
 
@@ -377,30 +887,105 @@ void LoadGeometries (
   if (status != OCI_SUCCESS)
     ReportError(errhp);
 
-  geometry = ReadGeometryFromFile(input_file);
-  while (geometry != NULL)
+  for (;;)
   {
-    rows_loaded++;
+    /* Read the next batch of geometries */
+    n_batch = 0;
+    while (n_batch < VALIDATE_BATCH_SIZE
+           && (geometry = ReadGeometryFromFile(input_file, &batch_ids[n_batch])) != NULL) {
+      batch[n_batch] = geometry;
+      batch_offsets[n_batch] = ftell (input_file);
+      n_batch++;
+    }
+    if (n_batch == 0)
+      break;
 
-    /* Store geometry from C structure into SDO_GEOMETRY OCI structure*/
-    StoreGeometry (geometry, geometry_obj, geometry_ind);
+    /* Change their coordinate system if requested */
+    for (i=0; i<n_batch; i++)
+      TransformGeometry (batch[i]);
 
-    /* Execute insert statement */
-    status = OCIStmtExecute(
-      svchp,                         /* (in)  Service Context Handle */
-      insert_stmthp,                 /* (in)  Statement Handle */
-      errhp,                         /* (in)  Error Handle */
-      (ub4)1,                        /* (in)  Number of rows to fetch: 1 */
-      (ub4)0,                        /* (in)  Row offset (NOT USED) */
-      (OCISnapshot *)NULL,           /* (in)  Snapshot in (NOT USED) */
-      (OCISnapshot *)NULL,           /* (in)  Snapshot out (NOT USED) */
-      (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
-    if (status != OCI_SUCCESS)
-      ReportError(errhp);
-    /* Read next geometry */
-    geometry = ReadGeometryFromFile(input_file);
+    /* Validate them all before inserting any */
+    if (tolerance > 0) {
+      for (i=0; i<n_batch; i++) {
+        jobs[i].gtype = batch[i]->gtype;
+        jobs[i].has_point = batch[i]->point != NULL;
+        jobs[i].n_elem_info = batch[i]->n_elem_info;
+        jobs[i].elem_info = batch[i]->elem_info;
+        jobs[i].n_ordinates = batch[i]->n_ordinates;
+        jobs[i].ordinates = batch[i]->ordinates;
+        vertices_validated += batch[i]->n_ordinates / (batch[i]->gtype / 1000);
+      }
+      validation_time += ValidateGeometries (jobs, n_batch, tolerance, n_threads);
+    }
+
+    for (i=0; i<n_batch; i++) {
+      geometry = batch[i];
+      id = batch_ids[i];
+
+      /* Skip invalid geometries */
+      if (tolerance > 0 && jobs[i].result != 0) {
+        printf ("Geometry %ld rejected: %s\n", id, jobs[i].context);
+        rows_rejected++;
+        FreeGeometry (geometry);
+        continue;
+      }
+
+      rows_loaded++;
+      rows_in_transaction++;
+
+      /* Store geometry from C structure into SDO_GEOMETRY OCI structure*/
+      StoreGeometry (geometry, geometry_obj, geometry_ind);
+
+      /* Execute insert statement */
+      status = OCIStmtExecute(
+        svchp,                         /* (in)  Service Context Handle */
+        insert_stmthp,                 /* (in)  Statement Handle */
+        errhp,                         /* (in)  Error Handle */
+        (ub4)1,                        /* (in)  Number of rows to fetch: 1 */
+        (ub4)0,                        /* (in)  Row offset (NOT USED) */
+        (OCISnapshot *)NULL,           /* (in)  Snapshot in (NOT USED) */
+        (OCISnapshot *)NULL,           /* (in)  Snapshot out (NOT USED) */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS)
+        ReportError(errhp);
+
+      /* Release memory used for the geometry structure */
+      FreeGeometry (geometry);
+
+      /* Commit when the transaction holds a full set of index batches,
+         then record how far the load got */
+      if (rows_in_transaction >= commit_interval) {
+        status = OCITransCommit(svchp, errhp, (ub4)OCI_DEFAULT);
+        if (status != OCI_SUCCESS)
+          ReportError(errhp);
+        WriteCheckpoint (checkpoint_filename, rows_loaded, batch_offsets[i]);
+        printf ("%ld rows committed\n", rows_loaded);
+        rows_in_transaction = 0;
+      }
+    }
   }
-  printf ("\n%d rows loaded\n", rows_loaded);
+
+  /* Commit the last (partial) transaction */
+  status = OCITransCommit(svchp, errhp, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+  fclose (input_file);
+
+  /* The load is complete: a new run must start from the beginning */
+  remove (checkpoint_filename);
+  printf ("\n%ld rows loaded\n", rows_loaded);
+  if (tolerance > 0) {
+    printf ("%ld geometries rejected\n", rows_rejected);
+    printf ("%ld points validated in %.3f seconds", vertices_validated, validation_time);
+    if (validation_time > 0)
+      printf (" (%.0f points/second)", vertices_validated / validation_time);
+    printf ("\n");
+  }
+  PrintTransformStatistics (&transform_options);
+  free (jobs);
+
+  /* Free the geometry object */
+  OCIObjectFree(envhp, errhp, (dvoid *) geometry_obj, (ub2)OCI_OBJECTFREE_FORCE);
 
   /* Free statement handle */
   status = OCIHandleFree(
@@ -419,9 +1004,28 @@ void LoadGeometries (
 int main(int argc, char **argv)
 {
     char *username, *password, *database, *tablename, *id_column, *geo_column, *filename;
+    int  commit_batches, n_threads;
+    double tolerance;
+
+    /* Take out the transformation options, wherever they are */
+    ParseTransformOptions (&argc, argv, &transform_options);
+    if (transform_options.to_srid != 0 && transform_options.from_srid == 0) {
+      printf ("--to-srid needs --from-srid: the input file has no coordinate system\n");
+      exit( 1 );
+    }
+    if (transform_options.to_srid != 0) {
+      if (InitCrs (&transform_options.transform.source, transform_options.from_srid) != 0) {
+        printf ("Unsupported source SRID: %d\n", transform_options.from_srid);
+        exit( 1 );
+      }
+      if (InitCrs (&transform_options.transform.target, transform_options.to_srid) != 0) {
+        printf ("Unsupported target SRID: %d\n", transform_options.to_srid);
+        exit( 1 );
+      }
+    }
 
-    if( argc != 8) {
-      printf("USAGE: %s <username> <password> <database> <tablename> <id_column> <geo_column> <filename>\n", argv[0]);
+    if( argc < 8 || argc > 11) {
+      printf("USAGE: %s <username> <password> <database> <tablename> <id_column> <geo_column> <filename> [<commit_batches>] [<tolerance>] [<threads>] [--from-srid=<srid>] [--to-srid=<srid>] [--transform-check]\n", argv[0]);
       exit( 1 );
     }
     else {
@@ -432,6 +1036,30 @@ int main(int argc, char **argv)
       id_column = argv[5];
       geo_column = argv[6];
       filename = argv[7];
+      if (argc > 8)
+        commit_batches = atoi(argv[8]);
+      else
+        commit_batches = 1;
+      if (commit_batches <= 0) {
+        printf ("Invalid number of batches per commit: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 9)
+        tolerance = atof(argv[9]);
+      else
+        tolerance = 0;
+      if (tolerance < 0) {
+        printf ("Invalid tolerance: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 10)
+        n_threads = atoi(argv[10]);
+      else
+        n_threads = ProcessorThreads(VALIDATE_MAX_THREADS);
+      if (n_threads <= 0) {
+        printf ("Invalid number of threads: must be positive\n");
+        exit( 1 );
+      }
     }
 
     /* Set up OCI environment */
@@ -441,7 +1069,7 @@ int main(int argc, char **argv)
     ConnectDatabase(username, password, database);
 
     /* Fetch and process the records */
-    LoadGeometries(tablename, id_column, geo_column, filename);
+    LoadGeometries(tablename, id_column, geo_column, filename, commit_batches, tolerance, n_threads);
 
     /* disconnect from database */
     DisconnectDatabase();
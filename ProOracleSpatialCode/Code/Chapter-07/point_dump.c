@@ -0,0 +1,398 @@
+/* point_dump.c
+
+   Writing and reading packed binary point dump files. See point_dump.h for
+   the format of the files.
+
+   A dump is written in a single pass over the points, without knowing their
+   number in advance: the X values go straight into the output file after the
+   space reserved for the header, the Y values and ids go to temporary files
+   that are appended to the output when the dump is finished. The header,
+   with the final count and extent, is written last.
+
+   Reading a dump maps the file in memory: opening it takes the same time
+   whatever the number of points.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "point_dump.h"
+
+#define CONVERT_BUFFER_SIZE 1024
+
+/*******************************************************************************
+** Routine:     HostIsLittleEndian
+**
+** Description: Tell if the host stores numbers in little-endian byte order
+*******************************************************************************/
+static int HostIsLittleEndian (void)
+{
+  unsigned int one = 1;
+  return *(unsigned char *)&one == 1;
+}
+
+/*******************************************************************************
+** Routine:     PutUInt64 / GetUInt64
+**
+** Description: Store and load a 64-bit value in little-endian byte order
+*******************************************************************************/
+static void PutUInt64 (unsigned char *p, uint64_t value)
+{
+  int i;
+  for (i=0; i<8; i++)
+    p[i] = (unsigned char) (value >> (8*i));
+}
+
+static uint64_t GetUInt64 (const unsigned char *p)
+{
+  uint64_t value = 0;
+  int i;
+  for (i=7; i>=0; i--)
+    value = (value << 8) | p[i];
+  return value;
+}
+
+static void PutUInt32 (unsigned char *p, uint32_t value)
+{
+  int i;
+  for (i=0; i<4; i++)
+    p[i] = (unsigned char) (value >> (8*i));
+}
+
+static uint32_t GetUInt32 (const unsigned char *p)
+{
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void PutDouble (unsigned char *p, double value)
+{
+  uint64_t bits;
+  memcpy (&bits, &value, 8);
+  PutUInt64 (p, bits);
+}
+
+static double GetDouble (const unsigned char *p)
+{
+  uint64_t bits = GetUInt64 (p);
+  double   value;
+  memcpy (&value, &bits, 8);
+  return value;
+}
+
+/*******************************************************************************
+** Routine:     WriteBytes
+**
+** Description: Write n items of a given size, and stop the program if they
+**              could not all be written (full disk for instance), so that a
+**              truncated dump is never left behind silently
+*******************************************************************************/
+static void WriteBytes (FILE *file, const void *data, size_t size, size_t n)
+{
+  if (n > 0 && fwrite (data, size, n, file) != n) {
+    printf ("Could not write point dump: %s\n", strerror (errno));
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     WriteValues
+**
+** Description: Write an array of 64-bit values in little-endian byte order
+*******************************************************************************/
+static void WriteValues (FILE *file, const void *values, int n_values)
+{
+  unsigned char buffer[CONVERT_BUFFER_SIZE * 8];
+  uint64_t      bits;
+  int           i, n;
+
+  if (HostIsLittleEndian ()) {
+    WriteBytes (file, values, 8, n_values);
+    return;
+  }
+  while (n_values > 0) {
+    n = n_values < CONVERT_BUFFER_SIZE ? n_values : CONVERT_BUFFER_SIZE;
+    for (i=0; i<n; i++) {
+      memcpy (&bits, (const unsigned char *)values + 8*i, 8);
+      PutUInt64 (buffer + 8*i, bits);
+    }
+    WriteBytes (file, buffer, 8, n);
+    values = (const unsigned char *)values + 8*n;
+    n_values -= n;
+  }
+}
+
+/*******************************************************************************
+** Routine:     AppendFile
+**
+** Description: Copy the content of a temporary file to the end of the output
+*******************************************************************************/
+static void AppendFile (FILE *output, FILE *input)
+{
+  char   buffer[65536];
+  size_t n;
+
+  rewind (input);
+  while ((n = fread (buffer, 1, sizeof(buffer), input)) > 0)
+    WriteBytes (output, buffer, 1, n);
+  if (ferror (input)) {
+    printf ("Could not read back a temporary file of the point dump\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     CreatePointDump
+**
+** Description: Create a point dump file and prepare it to receive points
+*******************************************************************************/
+point_dump_writer_struct *CreatePointDump (
+  const char *filename,
+  int        srid,
+  int        with_ids)
+{
+  point_dump_writer_struct *writer;
+  unsigned char header[POINT_DUMP_HEADER_SIZE];
+
+  writer = malloc (sizeof(point_dump_writer_struct));
+  writer->filename = strdup (filename);
+  writer->srid = srid;
+  writer->count = 0;
+  writer->min_x = writer->min_y = 1e308;
+  writer->max_x = writer->max_y = -1e308;
+
+  writer->file = fopen (filename, "wb");
+  writer->y_file = tmpfile ();
+  writer->id_file = with_ids ? tmpfile () : NULL;
+  if (writer->file == NULL || writer->y_file == NULL || (with_ids && writer->id_file == NULL)) {
+    printf ("Could not create point dump %s\n", filename);
+    exit (1);
+  }
+
+  /* Reserve space for the header: the X values follow it */
+  memset (header, 0, sizeof(header));
+  WriteBytes (writer->file, header, 1, sizeof(header));
+  return writer;
+}
+
+/*******************************************************************************
+** Routine:     WritePointDump
+**
+** Description: Add a batch of points to a point dump
+*******************************************************************************/
+void WritePointDump (
+  point_dump_writer_struct *writer,
+  const double *x,
+  const double *y,
+  const long   *id,
+  int          n_points)
+{
+  int64_t ids[CONVERT_BUFFER_SIZE];
+  int     i, j, n;
+
+  for (i=0; i<n_points; i++) {
+    writer->min_x = x[i] < writer->min_x ? x[i] : writer->min_x;
+    writer->max_x = x[i] > writer->max_x ? x[i] : writer->max_x;
+    writer->min_y = y[i] < writer->min_y ? y[i] : writer->min_y;
+    writer->max_y = y[i] > writer->max_y ? y[i] : writer->max_y;
+  }
+  WriteValues (writer->file, x, n_points);
+  WriteValues (writer->y_file, y, n_points);
+  if (writer->id_file != NULL) {
+    /* Widen the ids to 64 bits */
+    for (i=0; i<n_points; i=i+n) {
+      n = n_points - i < CONVERT_BUFFER_SIZE ? n_points - i : CONVERT_BUFFER_SIZE;
+      for (j=0; j<n; j++)
+        ids[j] = id[i+j];
+      WriteValues (writer->id_file, ids, n);
+    }
+  }
+  writer->count += n_points;
+}
+
+/*******************************************************************************
+** Routine:     FinishPointDump
+**
+** Description: Complete a point dump: append the Y values and ids, write the
+**              header and close the file
+*******************************************************************************/
+void FinishPointDump (
+  point_dump_writer_struct *writer)
+{
+  unsigned char header[POINT_DUMP_HEADER_SIZE];
+  uint64_t      x_offset, y_offset, id_offset;
+
+  AppendFile (writer->file, writer->y_file);
+  fclose (writer->y_file);
+  if (writer->id_file != NULL) {
+    AppendFile (writer->file, writer->id_file);
+    fclose (writer->id_file);
+  }
+
+  x_offset = POINT_DUMP_HEADER_SIZE;
+  y_offset = x_offset + 8 * (uint64_t)writer->count;
+  id_offset = writer->id_file != NULL ? y_offset + 8 * (uint64_t)writer->count : 0;
+
+  /* A dump without points has an empty extent, not the initial bounds */
+  if (writer->count == 0)
+    writer->min_x = writer->min_y = writer->max_x = writer->max_y = 0;
+
+  memset (header, 0, sizeof(header));
+  memcpy (header, POINT_DUMP_MAGIC, 8);
+  PutUInt32 (header + 8, POINT_DUMP_VERSION);
+  PutUInt32 (header + 12, writer->id_file != NULL ? POINT_DUMP_HAS_ID : 0);
+  PutUInt32 (header + 16, (uint32_t)writer->srid);
+  PutUInt64 (header + 24, (uint64_t)writer->count);
+  PutDouble (header + 32, writer->min_x);
+  PutDouble (header + 40, writer->min_y);
+  PutDouble (header + 48, writer->max_x);
+  PutDouble (header + 56, writer->max_y);
+  PutUInt64 (header + 64, x_offset);
+  PutUInt64 (header + 72, y_offset);
+  PutUInt64 (header + 80, id_offset);
+
+  if (fseek (writer->file, 0, SEEK_SET) != 0) {
+    printf ("Could not write point dump %s: %s\n", writer->filename, strerror (errno));
+    exit (1);
+  }
+  WriteBytes (writer->file, header, 1, sizeof(header));
+  if (fclose (writer->file) != 0) {
+    printf ("Could not write point dump %s\n", writer->filename);
+    exit (1);
+  }
+  printf ("%ld points written to %s\n", (long)writer->count, writer->filename);
+  free (writer->filename);
+  free (writer);
+}
+
+/*******************************************************************************
+** Routine:     OpenPointDump
+**
+** Description: Map a point dump in memory. Returns 0 on success, -1 if the file
+**              cannot be read or is not a valid point dump.
+*******************************************************************************/
+int OpenPointDump (
+  const char        *filename,
+  point_dump_struct *dump)
+{
+  unsigned char *header;
+  uint64_t      count, x_offset, y_offset, id_offset;
+  uint32_t      flags;
+
+  memset (dump, 0, sizeof(point_dump_struct));
+
+  /* The arrays are used in place: they must be in the host byte order */
+  if (!HostIsLittleEndian ()) {
+    printf ("Point dumps can only be mapped on little-endian hosts\n");
+    return -1;
+  }
+
+#ifdef _WIN32
+  {
+    /* No mmap: read the file into memory */
+    FILE *file = fopen (filename, "rb");
+    long size;
+    if (file == NULL) {
+      printf ("Could not open point dump %s\n", filename);
+      return -1;
+    }
+    fseek (file, 0, SEEK_END);
+    size = ftell (file);
+    rewind (file);
+    dump->size = (size_t) size;
+    dump->base = malloc (dump->size > 0 ? dump->size : 1);
+    if (fread (dump->base, 1, dump->size, file) != dump->size) {
+      printf ("Could not read point dump %s\n", filename);
+      fclose (file);
+      ClosePointDump (dump);
+      return -1;
+    }
+    fclose (file);
+  }
+#else
+  {
+    struct stat file_status;
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0 || fstat (fd, &file_status) != 0) {
+      printf ("Could not open point dump %s\n", filename);
+      if (fd >= 0)
+        close (fd);
+      return -1;
+    }
+    dump->size = (size_t) file_status.st_size;
+    if (dump->size < POINT_DUMP_HEADER_SIZE) {
+      printf ("%s is not a point dump\n", filename);
+      close (fd);
+      return -1;
+    }
+    dump->base = mmap (NULL, dump->size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+    if (dump->base == MAP_FAILED) {
+      printf ("Could not map point dump %s\n", filename);
+      dump->base = NULL;
+      return -1;
+    }
+  }
+#endif
+
+  /* Check and decode the header */
+  header = (unsigned char *) dump->base;
+  if (dump->size < POINT_DUMP_HEADER_SIZE
+      || memcmp (header, POINT_DUMP_MAGIC, 8) != 0
+      || GetUInt32 (header + 8) != POINT_DUMP_VERSION) {
+    printf ("%s is not a point dump\n", filename);
+    ClosePointDump (dump);
+    return -1;
+  }
+  flags = GetUInt32 (header + 12);
+  count = GetUInt64 (header + 24);
+  x_offset = GetUInt64 (header + 64);
+  y_offset = GetUInt64 (header + 72);
+  id_offset = GetUInt64 (header + 80);
+  if (count > dump->size / 8
+      || x_offset + 8 * count > dump->size
+      || y_offset + 8 * count > dump->size
+      || ((flags & POINT_DUMP_HAS_ID) && id_offset + 8 * count > dump->size)
+      || x_offset % 8 != 0 || y_offset % 8 != 0 || id_offset % 8 != 0) {
+    printf ("Point dump %s is truncated or damaged\n", filename);
+    ClosePointDump (dump);
+    return -1;
+  }
+
+  dump->srid = (int) GetUInt32 (header + 16);
+  dump->count = (int64_t) count;
+  dump->min_x = GetDouble (header + 32);
+  dump->min_y = GetDouble (header + 40);
+  dump->max_x = GetDouble (header + 48);
+  dump->max_y = GetDouble (header + 56);
+  dump->x = (const double *) (header + x_offset);
+  dump->y = (const double *) (header + y_offset);
+  dump->id = (flags & POINT_DUMP_HAS_ID) ? (const int64_t *) (header + id_offset) : NULL;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     ClosePointDump
+**
+** Description: Release a point dump opened with OpenPointDump
+*******************************************************************************/
+void ClosePointDump (
+  point_dump_struct *dump)
+{
+  if (dump->base != NULL) {
+#ifdef _WIN32
+    free (dump->base);
+#else
+    munmap (dump->base, dump->size);
+#endif
+  }
+  memset (dump, 0, sizeof(point_dump_struct));
+}
@@ -0,0 +1,81 @@
+/* point_dump.h
+
+   Packed binary point dump files.
+
+   A point dump holds the X and Y values of a set of points as two plain arrays
+   of doubles, so that a program can map the file in memory and use the arrays
+   directly, without parsing anything. An array of 64-bit identifiers can be
+   added. All values are stored in little-endian byte order.
+
+   File layout:
+
+     offset  size  content
+     0       8     magic string "SDOPTS01"
+     8       4     format version (1)
+     12      4     flags (POINT_DUMP_HAS_ID if the id array is present)
+     16      4     SRID (0 if unknown)
+     20      4     (reserved)
+     24      8     number of points (n)
+     32      32    extent: min X, min Y, max X, max Y (all 0 if n is 0)
+     64      8     offset of the X array
+     72      8     offset of the Y array
+     80      8     offset of the id array (0 if absent)
+     88      40    (reserved)
+     128     8*n   X array
+             8*n   Y array
+             8*n   id array (optional)
+
+   The writer (CreatePointDump, WritePointDump, FinishPointDump) is used by
+   read_points_array.c. The reader (OpenPointDump, ClosePointDump) is meant to
+   be compiled into the programs that consume the dumps.
+
+*/
+#ifndef POINT_DUMP_H
+#define POINT_DUMP_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define POINT_DUMP_MAGIC "SDOPTS01"
+#define POINT_DUMP_VERSION 1
+#define POINT_DUMP_HEADER_SIZE 128
+#define POINT_DUMP_HAS_ID 1
+
+/* A point dump open for reading */
+struct point_dump
+{
+    int           srid;
+    int64_t       count;
+    double        min_x, min_y;
+    double        max_x, max_y;
+    const double  *x;
+    const double  *y;
+    const int64_t *id;                /* NULL if the dump has no ids */
+    void          *base;              /* Start of the mapped file */
+    size_t        size;               /* Size of the mapped file */
+};
+typedef struct point_dump point_dump_struct;
+
+/* A point dump being written */
+struct point_dump_writer
+{
+    char          *filename;
+    FILE          *file;              /* Output file, receives the X values */
+    FILE          *y_file;            /* Temporary file for the Y values */
+    FILE          *id_file;           /* Temporary file for the ids (or NULL) */
+    int           srid;
+    int64_t       count;
+    double        min_x, min_y;
+    double        max_x, max_y;
+};
+typedef struct point_dump_writer point_dump_writer_struct;
+
+point_dump_writer_struct *CreatePointDump (const char *filename, int srid, int with_ids);
+void WritePointDump (point_dump_writer_struct *writer, const double *x, const double *y, const long *id, int n_points);
+void FinishPointDump (point_dump_writer_struct *writer);
+
+int  OpenPointDump (const char *filename, point_dump_struct *dump);
+void ClosePointDump (point_dump_struct *dump);
+
+#endif
@@ -0,0 +1,645 @@
+/* point_tree.c
+
+   Packed R-tree of points and k-nearest-neighbour searches. See point_tree.h
+   for a description of the method.
+
+   The tree is read-only once built: any number of threads can search it at
+   the same time, each with its own search work space.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "point_tree.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A point or node being packed, with the coordinates it is sorted on */
+struct str_entry
+{
+    double x;
+    double y;
+    long   item;
+};
+typedef struct str_entry str_entry_struct;
+
+/* The locations searched by one thread */
+struct nearest_job
+{
+    const point_tree_struct *tree;
+    const double            *x;
+    const double            *y;
+    long                    first, last;
+    int                     k;
+    long                    *index;   /* (out) k nearest points of each location */
+    double                  *distance;
+};
+typedef struct nearest_job nearest_job_struct;
+
+/*******************************************************************************
+** Routine:     ToVector
+**
+** Description: Convert a location to the coordinates stored in the tree: a
+**              unit vector if the tree is geodetic
+*******************************************************************************/
+static void ToVector (
+  int    geodetic,
+  double x,
+  double y,
+  double *vx,
+  double *vy,
+  double *vz)
+{
+  double longitude, latitude;
+
+  if (geodetic) {
+    longitude = x * M_PI / 180;
+    latitude = y * M_PI / 180;
+    *vx = cos (latitude) * cos (longitude);
+    *vy = cos (latitude) * sin (longitude);
+    *vz = sin (latitude);
+  }
+  else {
+    *vx = x;
+    *vy = y;
+    *vz = 0;
+  }
+}
+
+/*******************************************************************************
+** Routine:     CompareX, CompareY
+**
+** Description: Order entries on X or on Y (for qsort)
+*******************************************************************************/
+static int CompareX (const void *a, const void *b)
+{
+  double xa = ((const str_entry_struct *) a)->x;
+  double xb = ((const str_entry_struct *) b)->x;
+  return xa < xb ? -1 : (xa > xb ? 1 : 0);
+}
+
+static int CompareY (const void *a, const void *b)
+{
+  double ya = ((const str_entry_struct *) a)->y;
+  double yb = ((const str_entry_struct *) b)->y;
+  return ya < yb ? -1 : (ya > yb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     StrOrder
+**
+** Description: Sort entries in Sort-Tile-Recursive order: consecutive groups
+**              of POINT_TREE_NODE_SIZE entries form compact nodes
+*******************************************************************************/
+static void StrOrder (str_entry_struct *entries, long n)
+{
+  long n_nodes = (n + POINT_TREE_NODE_SIZE - 1) / POINT_TREE_NODE_SIZE;
+  long n_slices = (long) ceil (sqrt ((double) n_nodes));
+  long slice_size = n_slices * POINT_TREE_NODE_SIZE;
+  long s;
+
+  qsort (entries, n, sizeof(str_entry_struct), CompareX);
+  for (s=0; s<n; s+=slice_size)
+    qsort (entries + s, n - s < slice_size ? n - s : slice_size,
+      sizeof(str_entry_struct), CompareY);
+}
+
+/*******************************************************************************
+** Routine:     PermuteDoubles, PermuteLongs, PermuteInts
+**
+** Description: Reorder a range of an array: element i becomes the element
+**              at position first + entries[i].item
+*******************************************************************************/
+static void PermuteDoubles (double *values, long first, const str_entry_struct *entries,
+                            long n, double *work)
+{
+  long i;
+  for (i=0; i<n; i++)
+    work[i] = values[first + entries[i].item];
+  memcpy (values + first, work, n * sizeof(double));
+}
+
+static void PermuteLongs (long *values, long first, const str_entry_struct *entries,
+                          long n, long *work)
+{
+  long i;
+  for (i=0; i<n; i++)
+    work[i] = values[first + entries[i].item];
+  memcpy (values + first, work, n * sizeof(long));
+}
+
+static void PermuteInts (int *values, long first, const str_entry_struct *entries,
+                         long n, int *work)
+{
+  long i;
+  for (i=0; i<n; i++)
+    work[i] = values[first + entries[i].item];
+  memcpy (values + first, work, n * sizeof(int));
+}
+
+/*******************************************************************************
+** Routine:     BuildPointTree
+**
+** Description: Build a packed R-tree on a set of points. Returns NULL if
+**              there are no points.
+*******************************************************************************/
+point_tree_struct *BuildPointTree (
+  const double *x,
+  const double *y,
+  long         n_points,
+  int          geodetic)
+{
+  point_tree_struct *tree;
+  str_entry_struct  *entries;
+  double *center_x, *center_y, *work;
+  long   n_nodes, n_level, level_start, below_start, below_count, node, i, e;
+  int    c;
+
+  if (n_points <= 0)
+    return NULL;
+
+  /* Count the nodes of all levels */
+  n_nodes = 0;
+  n_level = n_points;
+  do {
+    n_level = (n_level + POINT_TREE_NODE_SIZE - 1) / POINT_TREE_NODE_SIZE;
+    n_nodes += n_level;
+  } while (n_level > 1);
+
+  tree = malloc (sizeof(point_tree_struct));
+  tree->geodetic = geodetic;
+  tree->n_points = n_points;
+  tree->x = malloc (n_points * sizeof(double));
+  tree->y = malloc (n_points * sizeof(double));
+  tree->z = malloc (n_points * sizeof(double));
+  tree->index = malloc (n_points * sizeof(long));
+  tree->n_nodes = n_nodes;
+  tree->n_leaves = (n_points + POINT_TREE_NODE_SIZE - 1) / POINT_TREE_NODE_SIZE;
+  tree->min_x = malloc (n_nodes * sizeof(double));
+  tree->min_y = malloc (n_nodes * sizeof(double));
+  tree->min_z = malloc (n_nodes * sizeof(double));
+  tree->max_x = malloc (n_nodes * sizeof(double));
+  tree->max_y = malloc (n_nodes * sizeof(double));
+  tree->max_z = malloc (n_nodes * sizeof(double));
+  tree->first = malloc (n_nodes * sizeof(long));
+  tree->count = malloc (n_nodes * sizeof(int));
+  center_x = malloc (n_nodes * sizeof(double));
+  center_y = malloc (n_nodes * sizeof(double));
+  entries = malloc (n_points * sizeof(str_entry_struct));
+  work = malloc (n_points * sizeof(double));
+
+  /* Order the points and cut them into leaves. The packing uses the
+     coordinates as given, even for geodetic trees */
+  for (i=0; i<n_points; i++) {
+    entries[i].x = x[i];
+    entries[i].y = y[i];
+    entries[i].item = i;
+  }
+  StrOrder (entries, n_points);
+  for (i=0; i<n_points; i++) {
+    tree->index[i] = entries[i].item;
+    ToVector (geodetic, x[entries[i].item], y[entries[i].item],
+      &tree->x[i], &tree->y[i], &tree->z[i]);
+  }
+  for (node=0; node<tree->n_leaves; node++) {
+    tree->first[node] = node * POINT_TREE_NODE_SIZE;
+    tree->count[node] = n_points - tree->first[node] < POINT_TREE_NODE_SIZE ?
+      (int) (n_points - tree->first[node]) : POINT_TREE_NODE_SIZE;
+    center_x[node] = center_y[node] = 0;
+    for (c=0; c<tree->count[node]; c++) {
+      center_x[node] += entries[tree->first[node] + c].x / tree->count[node];
+      center_y[node] += entries[tree->first[node] + c].y / tree->count[node];
+    }
+  }
+  for (node=0; node<tree->n_leaves; node++) {
+    e = tree->first[node];
+    tree->min_x[node] = tree->max_x[node] = tree->x[e];
+    tree->min_y[node] = tree->max_y[node] = tree->y[e];
+    tree->min_z[node] = tree->max_z[node] = tree->z[e];
+    for (e=tree->first[node]+1; e<tree->first[node]+tree->count[node]; e++) {
+      tree->min_x[node] = tree->x[e] < tree->min_x[node] ? tree->x[e] : tree->min_x[node];
+      tree->min_y[node] = tree->y[e] < tree->min_y[node] ? tree->y[e] : tree->min_y[node];
+      tree->min_z[node] = tree->z[e] < tree->min_z[node] ? tree->z[e] : tree->min_z[node];
+      tree->max_x[node] = tree->x[e] > tree->max_x[node] ? tree->x[e] : tree->max_x[node];
+      tree->max_y[node] = tree->y[e] > tree->max_y[node] ? tree->y[e] : tree->max_y[node];
+      tree->max_z[node] = tree->z[e] > tree->max_z[node] ? tree->z[e] : tree->max_z[node];
+    }
+  }
+
+  /* Build the upper levels: order the nodes of the level below on their
+     centers, then group them */
+  below_start = 0;
+  below_count = tree->n_leaves;
+  while (below_count > 1) {
+    for (i=0; i<below_count; i++) {
+      entries[i].x = center_x[below_start + i];
+      entries[i].y = center_y[below_start + i];
+      entries[i].item = i;
+    }
+    StrOrder (entries, below_count);
+    PermuteDoubles (tree->min_x, below_start, entries, below_count, work);
+    PermuteDoubles (tree->min_y, below_start, entries, below_count, work);
+    PermuteDoubles (tree->min_z, below_start, entries, below_count, work);
+    PermuteDoubles (tree->max_x, below_start, entries, below_count, work);
+    PermuteDoubles (tree->max_y, below_start, entries, below_count, work);
+    PermuteDoubles (tree->max_z, below_start, entries, below_count, work);
+    PermuteDoubles (center_x, below_start, entries, below_count, work);
+    PermuteDoubles (center_y, below_start, entries, below_count, work);
+    PermuteLongs (tree->first, below_start, entries, below_count, (long *) work);
+    PermuteInts (tree->count, below_start, entries, below_count, (int *) work);
+
+    level_start = below_start + below_count;
+    n_level = (below_count + POINT_TREE_NODE_SIZE - 1) / POINT_TREE_NODE_SIZE;
+    for (i=0; i<n_level; i++) {
+      node = level_start + i;
+      tree->first[node] = below_start + i * POINT_TREE_NODE_SIZE;
+      tree->count[node] = below_count - i * POINT_TREE_NODE_SIZE < POINT_TREE_NODE_SIZE ?
+        (int) (below_count - i * POINT_TREE_NODE_SIZE) : POINT_TREE_NODE_SIZE;
+      e = tree->first[node];
+      tree->min_x[node] = tree->min_x[e];
+      tree->min_y[node] = tree->min_y[e];
+      tree->min_z[node] = tree->min_z[e];
+      tree->max_x[node] = tree->max_x[e];
+      tree->max_y[node] = tree->max_y[e];
+      tree->max_z[node] = tree->max_z[e];
+      center_x[node] = center_y[node] = 0;
+      for (e=tree->first[node]; e<tree->first[node]+tree->count[node]; e++) {
+        tree->min_x[node] = tree->min_x[e] < tree->min_x[node] ? tree->min_x[e] : tree->min_x[node];
+        tree->min_y[node] = tree->min_y[e] < tree->min_y[node] ? tree->min_y[e] : tree->min_y[node];
+        tree->min_z[node] = tree->min_z[e] < tree->min_z[node] ? tree->min_z[e] : tree->min_z[node];
+        tree->max_x[node] = tree->max_x[e] > tree->max_x[node] ? tree->max_x[e] : tree->max_x[node];
+        tree->max_y[node] = tree->max_y[e] > tree->max_y[node] ? tree->max_y[e] : tree->max_y[node];
+        tree->max_z[node] = tree->max_z[e] > tree->max_z[node] ? tree->max_z[e] : tree->max_z[node];
+        center_x[node] += center_x[e] / tree->count[node];
+        center_y[node] += center_y[e] / tree->count[node];
+      }
+    }
+    below_start = level_start;
+    below_count = n_level;
+  }
+
+  free (center_x);
+  free (center_y);
+  free (entries);
+  free (work);
+  return tree;
+}
+
+/*******************************************************************************
+** Routine:     FreePointTree
+**
+** Description: Free a tree
+*******************************************************************************/
+void FreePointTree (point_tree_struct *tree)
+{
+  if (tree == NULL)
+    return;
+  free (tree->x);
+  free (tree->y);
+  free (tree->z);
+  free (tree->index);
+  free (tree->min_x);
+  free (tree->min_y);
+  free (tree->min_z);
+  free (tree->max_x);
+  free (tree->max_y);
+  free (tree->max_z);
+  free (tree->first);
+  free (tree->count);
+  free (tree);
+}
+
+/*******************************************************************************
+** Routine:     CreatePointTreeSearch
+**
+** Description: Allocate the work space of searches for k points
+*******************************************************************************/
+point_tree_search_struct *CreatePointTreeSearch (int k)
+{
+  point_tree_search_struct *search = malloc (sizeof(point_tree_search_struct));
+
+  search->k = k;
+  search->size_queue = 256;
+  search->n_queue = 0;
+  search->queue_distance = malloc (search->size_queue * sizeof(double));
+  search->queue_node = malloc (search->size_queue * sizeof(long));
+  search->n_found = 0;
+  search->found_distance = malloc (k * sizeof(double));
+  search->found_point = malloc (k * sizeof(long));
+  return search;
+}
+
+/*******************************************************************************
+** Routine:     FreePointTreeSearch
+**
+** Description: Free the work space of searches
+*******************************************************************************/
+void FreePointTreeSearch (point_tree_search_struct *search)
+{
+  free (search->queue_distance);
+  free (search->queue_node);
+  free (search->found_distance);
+  free (search->found_point);
+  free (search);
+}
+
+/*******************************************************************************
+** Routine:     PushNode
+**
+** Description: Add a node to the queue of nodes to visit
+*******************************************************************************/
+static void PushNode (point_tree_search_struct *search, long node, double distance)
+{
+  long i, parent;
+
+  if (search->n_queue == search->size_queue) {
+    search->size_queue *= 2;
+    search->queue_distance = realloc (search->queue_distance, search->size_queue * sizeof(double));
+    search->queue_node = realloc (search->queue_node, search->size_queue * sizeof(long));
+  }
+  for (i=search->n_queue++; i>0; i=parent) {
+    parent = (i - 1) / 2;
+    if (search->queue_distance[parent] <= distance)
+      break;
+    search->queue_distance[i] = search->queue_distance[parent];
+    search->queue_node[i] = search->queue_node[parent];
+  }
+  search->queue_distance[i] = distance;
+  search->queue_node[i] = node;
+}
+
+/*******************************************************************************
+** Routine:     PopNode
+**
+** Description: Remove the nearest node from the queue of nodes to visit
+*******************************************************************************/
+static long PopNode (point_tree_search_struct *search, double *distance)
+{
+  long   node = search->queue_node[0], i, child, n;
+  double last_distance;
+  long   last_node;
+
+  *distance = search->queue_distance[0];
+  n = --search->n_queue;
+  last_distance = search->queue_distance[n];
+  last_node = search->queue_node[n];
+  for (i=0; (child = 2*i + 1) < n; i=child) {
+    if (child + 1 < n && search->queue_distance[child+1] < search->queue_distance[child])
+      child++;
+    if (search->queue_distance[child] >= last_distance)
+      break;
+    search->queue_distance[i] = search->queue_distance[child];
+    search->queue_node[i] = search->queue_node[child];
+  }
+  search->queue_distance[i] = last_distance;
+  search->queue_node[i] = last_node;
+  return node;
+}
+
+/*******************************************************************************
+** Routine:     AddFound
+**
+** Description: Add a point to the nearest points found so far. When k points
+**              have been found, the point replaces the farthest one.
+*******************************************************************************/
+static void AddFound (point_tree_search_struct *search, long point, double distance)
+{
+  double *found_distance = search->found_distance;
+  long   *found_point = search->found_point;
+  int    i, child, parent, n;
+
+  if (search->n_found < search->k) {
+    /* Sift up */
+    for (i=search->n_found++; i>0; i=parent) {
+      parent = (i - 1) / 2;
+      if (found_distance[parent] >= distance)
+        break;
+      found_distance[i] = found_distance[parent];
+      found_point[i] = found_point[parent];
+    }
+  }
+  else {
+    /* Replace the farthest point and sift down */
+    n = search->n_found;
+    for (i=0; (child = 2*i + 1) < n; i=child) {
+      if (child + 1 < n && found_distance[child+1] > found_distance[child])
+        child++;
+      if (found_distance[child] <= distance)
+        break;
+      found_distance[i] = found_distance[child];
+      found_point[i] = found_point[child];
+    }
+  }
+  found_distance[i] = distance;
+  found_point[i] = point;
+}
+
+/*******************************************************************************
+** Routine:     PointDistances
+**
+** Description: Squared distances from a location to the points of a leaf
+*******************************************************************************/
+static void PointDistances (
+  const double *x,
+  const double *y,
+  const double *z,
+  int          n,
+  double       qx,
+  double       qy,
+  double       qz,
+  double       *distance)
+{
+  double dx, dy, dz;
+  int    i;
+
+  for (i=0; i<n; i++) {
+    dx = x[i] - qx;
+    dy = y[i] - qy;
+    dz = z[i] - qz;
+    distance[i] = dx*dx + dy*dy + dz*dz;
+  }
+}
+
+/*******************************************************************************
+** Routine:     BoxDistances
+**
+** Description: Squared distances from a location to the boxes of the
+**              entries of a node (0 for the boxes that contain it)
+*******************************************************************************/
+static void BoxDistances (
+  const double *min_x,
+  const double *min_y,
+  const double *min_z,
+  const double *max_x,
+  const double *max_y,
+  const double *max_z,
+  int          n,
+  double       qx,
+  double       qy,
+  double       qz,
+  double       *distance)
+{
+  double below, above, dx, dy, dz;
+  int    i;
+
+  for (i=0; i<n; i++) {
+    below = min_x[i] - qx;
+    above = qx - max_x[i];
+    dx = (below > 0 ? below : 0) + (above > 0 ? above : 0);
+    below = min_y[i] - qy;
+    above = qy - max_y[i];
+    dy = (below > 0 ? below : 0) + (above > 0 ? above : 0);
+    below = min_z[i] - qz;
+    above = qz - max_z[i];
+    dz = (below > 0 ? below : 0) + (above > 0 ? above : 0);
+    distance[i] = dx*dx + dy*dy + dz*dz;
+  }
+}
+
+/*******************************************************************************
+** Routine:     NearestPoints
+**
+** Description: Find the k points nearest to a location. Returns the number of
+**              points found (k, or fewer if the tree has fewer points), with
+**              their original numbers and distances, nearest first.
+*******************************************************************************/
+int NearestPoints (
+  const point_tree_struct  *tree,
+  double                   x,
+  double                   y,
+  point_tree_search_struct *search,
+  long                     *index,
+  double                   *distance)
+{
+  double qx, qy, qz, node_distance, chord, d;
+  long   node, first, point;
+  int    i, j, n, n_found;
+
+  ToVector (tree->geodetic, x, y, &qx, &qy, &qz);
+  search->n_found = 0;
+  search->n_queue = 0;
+  PushNode (search, tree->n_nodes - 1, 0);
+
+  while (search->n_queue > 0) {
+    node = PopNode (search, &node_distance);
+    if (search->n_found == search->k && node_distance >= search->found_distance[0])
+      break;
+    first = tree->first[node];
+    n = tree->count[node];
+    if (node < tree->n_leaves) {
+      PointDistances (tree->x + first, tree->y + first, tree->z + first, n,
+        qx, qy, qz, search->distance);
+      for (i=0; i<n; i++)
+        if (search->n_found < search->k || search->distance[i] < search->found_distance[0])
+          AddFound (search, first + i, search->distance[i]);
+    }
+    else {
+      BoxDistances (tree->min_x + first, tree->min_y + first, tree->min_z + first,
+        tree->max_x + first, tree->max_y + first, tree->max_z + first, n,
+        qx, qy, qz, search->distance);
+      for (i=0; i<n; i++)
+        if (search->n_found < search->k || search->distance[i] < search->found_distance[0])
+          PushNode (search, first + i, search->distance[i]);
+    }
+  }
+
+  /* Sort the points found, nearest first (k is small) */
+  n_found = search->n_found;
+  for (i=0; i<n_found; i++) {
+    d = search->found_distance[i];
+    point = search->found_point[i];
+    for (j=i; j>0 && distance[j-1] > d; j--) {
+      distance[j] = distance[j-1];
+      index[j] = index[j-1];
+    }
+    distance[j] = d;
+    index[j] = point;
+  }
+  for (i=0; i<n_found; i++)
+    index[i] = tree->index[index[i]];
+
+  /* Convert the squared distances */
+  for (i=0; i<n_found; i++) {
+    if (tree->geodetic) {
+      chord = sqrt (distance[i]) / 2;
+      distance[i] = 2 * POINT_TREE_EARTH_RADIUS * asin (chord < 1 ? chord : 1);
+    }
+    else
+      distance[i] = sqrt (distance[i]);
+  }
+  return n_found;
+}
+
+/*******************************************************************************
+** Routine:     SearchNearest
+**
+** Description: Thread routine: find the nearest points of a range of
+**              locations
+*******************************************************************************/
+static void *SearchNearest (void *argument)
+{
+  nearest_job_struct *job = (nearest_job_struct *) argument;
+  point_tree_search_struct *search = CreatePointTreeSearch (job->k);
+  long i;
+  int  j, n;
+
+  for (i=job->first; i<job->last; i++) {
+    n = NearestPoints (job->tree, job->x[i], job->y[i], search,
+      job->index + i * job->k, job->distance + i * job->k);
+    for (j=n; j<job->k; j++) {
+      job->index[i * job->k + j] = -1;
+      job->distance[i * job->k + j] = -1;
+    }
+  }
+  FreePointTreeSearch (search);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     NearestPointsJoin
+**
+** Description: Find the k points nearest to each location of an array, with
+**              several threads. The results of location i are at positions
+**              i*k to i*k + k-1 of the index and distance arrays. Missing
+**              points (when the tree has fewer than k points) have an index
+**              and a distance of -1.
+*******************************************************************************/
+void NearestPointsJoin (
+  const point_tree_struct *tree,
+  const double            *x,
+  const double            *y,
+  long                    n_points,
+  int                     k,
+  int                     n_threads,
+  long                    *index,
+  double                  *distance)
+{
+  nearest_job_struct jobs[POINT_TREE_MAX_THREADS];
+  int t;
+
+#ifdef _WIN32
+  n_threads = 1;
+#endif
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > POINT_TREE_MAX_THREADS)
+    n_threads = POINT_TREE_MAX_THREADS;
+  if (n_threads > n_points)
+    n_threads = n_points > 0 ? (int) n_points : 1;
+
+  for (t=0; t<n_threads; t++) {
+    jobs[t].tree = tree;
+    jobs[t].x = x;
+    jobs[t].y = y;
+    jobs[t].first = n_points * t / n_threads;
+    jobs[t].last = n_points * (t + 1) / n_threads;
+    jobs[t].k = k;
+    jobs[t].index = index;
+    jobs[t].distance = distance;
+  }
+  RunJobs (SearchNearest, jobs, sizeof(nearest_job_struct), n_threads);
+}
@@ -0,0 +1,92 @@
+/* point_tree.h
+
+   Packed R-tree of points, and k-nearest-neighbour searches.
+
+   This is the client-side counterpart of the SDO_NN operator (see chapter 8)
+   for layers of points held in memory, typically point dumps written by
+   read_points_array.c.
+
+   BuildPointTree indexes a set of points in an R-tree that is built in one
+   pass with the Sort-Tile-Recursive method: the points are sorted on X and
+   cut into vertical slices, each slice is sorted on Y and cut into leaves of
+   POINT_TREE_NODE_SIZE points, and the same is done with the centers of the
+   nodes of each level until a single root remains. The tree is stored in
+   flat arrays, with the bounds of the nodes and the coordinates of the
+   points in separate arrays, so that the distances to all the entries of a
+   node are computed in one loop that the compiler can vectorize.
+
+   NearestPoints finds the k points nearest to a location with a best-first
+   search: the nodes are visited in increasing order of their distance to
+   the location, and the search stops when the next node is farther than
+   the k-th point found so far.
+
+   NearestPointsJoin runs NearestPoints for a whole array of locations, with
+   several threads.
+
+   If the tree is geodetic, the coordinates are longitudes and latitudes in
+   degrees (as with SRID 8307). The points are then stored as unit vectors
+   in three dimensions, and the nodes as three-dimensional boxes: the
+   straight-line distance between two vectors grows with the great-circle
+   distance between the points, so that the search works the same way, and
+   longitudes wrap around the antimeridian. Distances are returned in
+   meters, along the great circle of a sphere of radius POINT_TREE_EARTH_RADIUS
+   (the mean radius of the WGS 84 ellipsoid). They differ from the
+   ellipsoidal distances computed by the database by up to 0.5%, which may
+   change the order of points at nearly equal distances.
+
+   Otherwise, distances are computed on the coordinates as they are.
+
+*/
+#ifndef POINT_TREE_H
+#define POINT_TREE_H
+
+#define POINT_TREE_NODE_SIZE 16
+#define POINT_TREE_MAX_THREADS 64
+#define POINT_TREE_EARTH_RADIUS 6371008.8
+
+/* A packed R-tree of points. The nodes of all levels are in the same arrays:
+   the leaves first, the root last. The entries of a node are consecutive
+   points (for a leaf) or consecutive nodes of the level below. */
+struct point_tree
+{
+    int    geodetic;
+    long   n_points;
+    double *x;                        /* Points in the order of the leaves. */
+    double *y;                        /* Unit vectors if geodetic, else (x, y, 0) */
+    double *z;
+    long   *index;                    /* Original number of each point */
+    long   n_nodes;
+    long   n_leaves;                  /* Nodes below n_leaves are leaves */
+    double *min_x, *min_y, *min_z;    /* Bounds of each node */
+    double *max_x, *max_y, *max_z;
+    long   *first;                    /* First entry of each node */
+    int    *count;                    /* Number of entries of each node */
+};
+typedef struct point_tree point_tree_struct;
+
+/* Work space of a search, to be used by one thread at a time */
+struct point_tree_search
+{
+    int    k;
+    long   size_queue;
+    long   n_queue;
+    double *queue_distance;           /* Nodes to visit (heap on distance) */
+    long   *queue_node;
+    int    n_found;
+    double *found_distance;           /* Nearest points so far (heap, farthest first) */
+    long   *found_point;
+    double distance[POINT_TREE_NODE_SIZE];
+};
+typedef struct point_tree_search point_tree_search_struct;
+
+point_tree_struct *BuildPointTree (const double *x, const double *y, long n_points,
+                                   int geodetic);
+void FreePointTree (point_tree_struct *tree);
+point_tree_search_struct *CreatePointTreeSearch (int k);
+void FreePointTreeSearch (point_tree_search_struct *search);
+int  NearestPoints (const point_tree_struct *tree, double x, double y,
+                    point_tree_search_struct *search, long *index, double *distance);
+void NearestPointsJoin (const point_tree_struct *tree, const double *x, const double *y,
+                        long n_points, int k, int n_threads, long *index, double *distance);
+
+#endif
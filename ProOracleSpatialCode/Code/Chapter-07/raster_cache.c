@@ -0,0 +1,381 @@
+/* raster_cache.c
+
+   Local cache of GeoRaster blocks, kept in a memory-mapped file. See
+   raster_cache.h.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "raster_cache.h"
+
+/*******************************************************************************
+** Routine:     KeyHash
+**
+** Description: Hash of a block key
+*******************************************************************************/
+static uint64_t KeyHash (const raster_block_key_struct *key)
+{
+  uint64_t hash = (uint64_t) key->raster_id * 0x9E3779B97F4A7C15ULL;
+
+  hash ^= (uint64_t) (uint32_t) key->pyramid_level * 0xC2B2AE3D27D4EB4FULL;
+  hash ^= (uint64_t) (uint32_t) key->band_block * 0x165667B19E3779F9ULL;
+  hash ^= (uint64_t) (uint32_t) key->row_block * 0x85EBCA77C2B2AE63ULL;
+  hash ^= (uint64_t) (uint32_t) key->column_block * 0x27D4EB2F165667C5ULL;
+  return hash ^ (hash >> 29);
+}
+
+/*******************************************************************************
+** Routine:     SameKey
+**
+** Description: Tell if two block keys are equal
+*******************************************************************************/
+static int SameKey (const raster_block_key_struct *a, const raster_block_key_struct *b)
+{
+  return a->raster_id == b->raster_id && a->pyramid_level == b->pyramid_level
+    && a->band_block == b->band_block && a->row_block == b->row_block
+    && a->column_block == b->column_block;
+}
+
+/*******************************************************************************
+** Routine:     Unlink, LinkNewest, LinkOldest
+**
+** Description: Remove a slot from the list in order of use, and put it
+**              back as the most recently used or least recently used
+*******************************************************************************/
+static void Unlink (raster_cache_struct *cache, long slot)
+{
+  if (cache->newer[slot] >= 0)
+    cache->older[cache->newer[slot]] = cache->older[slot];
+  else
+    cache->newest = cache->older[slot];
+  if (cache->older[slot] >= 0)
+    cache->newer[cache->older[slot]] = cache->newer[slot];
+  else
+    cache->oldest = cache->newer[slot];
+}
+
+static void LinkNewest (raster_cache_struct *cache, long slot)
+{
+  cache->newer[slot] = -1;
+  cache->older[slot] = cache->newest;
+  if (cache->newest >= 0)
+    cache->newer[cache->newest] = slot;
+  else
+    cache->oldest = slot;
+  cache->newest = slot;
+}
+
+static void LinkOldest (raster_cache_struct *cache, long slot)
+{
+  cache->older[slot] = -1;
+  cache->newer[slot] = cache->oldest;
+  if (cache->oldest >= 0)
+    cache->older[cache->oldest] = slot;
+  else
+    cache->newest = slot;
+  cache->oldest = slot;
+}
+
+/*******************************************************************************
+** Routine:     FindSlot
+**
+** Description: Slot that holds a block, or -1
+*******************************************************************************/
+static long FindSlot (const raster_cache_struct *cache, const raster_block_key_struct *key)
+{
+  long slot = cache->bucket[KeyHash (key) & (uint64_t) (cache->n_buckets - 1)];
+
+  while (slot >= 0 && !SameKey (&cache->slots[slot].key, key))
+    slot = cache->next_in_bucket[slot];
+  return slot;
+}
+
+/*******************************************************************************
+** Routine:     InsertSlot, RemoveSlot
+**
+** Description: Add a used slot to the hash table, or remove it
+*******************************************************************************/
+static void InsertSlot (raster_cache_struct *cache, long slot)
+{
+  long b = (long) (KeyHash (&cache->slots[slot].key) & (uint64_t) (cache->n_buckets - 1));
+
+  cache->next_in_bucket[slot] = cache->bucket[b];
+  cache->bucket[b] = slot;
+}
+
+static void RemoveSlot (raster_cache_struct *cache, long slot)
+{
+  long b = (long) (KeyHash (&cache->slots[slot].key) & (uint64_t) (cache->n_buckets - 1));
+  long *link = &cache->bucket[b];
+
+  while (*link != slot)
+    link = &cache->next_in_bucket[*link];
+  *link = cache->next_in_bucket[slot];
+}
+
+/* A used slot, with the time of its last use (for sorting) */
+struct slot_use
+{
+    uint64_t last_use;
+    long     slot;
+};
+typedef struct slot_use slot_use_struct;
+
+/*******************************************************************************
+** Routine:     CompareUse
+**
+** Description: Order slots from the least recently used (for qsort)
+*******************************************************************************/
+static int CompareUse (const void *a, const void *b)
+{
+  uint64_t use_a = ((const slot_use_struct *) a)->last_use;
+  uint64_t use_b = ((const slot_use_struct *) b)->last_use;
+  return use_a < use_b ? -1 : (use_a > use_b ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     MapCache
+**
+** Description: Map a cache file, creating it (or starting it again) if it
+**              does not have the expected layout. Returns 0 on success.
+*******************************************************************************/
+static int MapCache (raster_cache_struct *cache, const char *filename, size_t data_offset)
+{
+  unsigned char *header;
+  uint32_t      version;
+  uint64_t      slot_size, n_slots, offset;
+  int           valid;
+
+#ifdef _WIN32
+  (void) filename;
+  cache->base = calloc (1, cache->size);
+  if (cache->base == NULL) {
+    printf ("Could not allocate the raster cache\n");
+    return -1;
+  }
+  valid = 0;
+#else
+  struct stat file_status;
+  int fd = open (filename, O_RDWR | O_CREAT, 0644);
+
+  if (fd < 0 || fstat (fd, &file_status) != 0) {
+    printf ("Could not open raster cache %s\n", filename);
+    if (fd >= 0)
+      close (fd);
+    return -1;
+  }
+  valid = (size_t) file_status.st_size == cache->size;
+  if (!valid && ftruncate (fd, (off_t) cache->size) != 0) {
+    printf ("Could not create raster cache %s\n", filename);
+    close (fd);
+    return -1;
+  }
+  cache->base = mmap (NULL, cache->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+  if (cache->base == MAP_FAILED) {
+    printf ("Could not map raster cache %s\n", filename);
+    cache->base = NULL;
+    return -1;
+  }
+#endif
+
+  /* Keep the content if the file was written with the same layout */
+  header = (unsigned char *) cache->base;
+  if (valid) {
+    memcpy (&version, header + 8, 4);
+    memcpy (&slot_size, header + 16, 8);
+    memcpy (&n_slots, header + 24, 8);
+    memcpy (&offset, header + 32, 8);
+    valid = memcmp (header, RASTER_CACHE_MAGIC, 8) == 0 && version == RASTER_CACHE_VERSION
+      && slot_size == cache->slot_size && n_slots == (uint64_t) cache->n_slots
+      && offset == data_offset;
+  }
+  if (!valid) {
+    memset (header, 0, data_offset);
+    memcpy (header, RASTER_CACHE_MAGIC, 8);
+    version = RASTER_CACHE_VERSION;
+    slot_size = cache->slot_size;
+    n_slots = (uint64_t) cache->n_slots;
+    offset = data_offset;
+    memcpy (header + 8, &version, 4);
+    memcpy (header + 16, &slot_size, 8);
+    memcpy (header + 24, &n_slots, 8);
+    memcpy (header + 32, &offset, 8);
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     OpenRasterCache
+**
+** Description: Open a cache file of n_slots blocks of up to slot_size bytes.
+**              The blocks already in the file are kept if it was written
+**              with the same slot size and number of slots; otherwise the
+**              file is emptied. Returns NULL on failure.
+*******************************************************************************/
+raster_cache_struct *OpenRasterCache (
+  const char *filename,
+  size_t     slot_size,
+  long       n_slots)
+{
+  raster_cache_struct *cache;
+  slot_use_struct *order;
+  size_t data_offset;
+  long   slot, n_used;
+
+  if (slot_size == 0 || slot_size > UINT32_MAX || n_slots <= 0) {
+    printf ("Invalid raster cache size\n");
+    return NULL;
+  }
+
+  cache = calloc (1, sizeof(raster_cache_struct));
+  cache->slot_size = slot_size;
+  cache->n_slots = n_slots;
+  data_offset = RASTER_CACHE_HEADER_SIZE + n_slots * sizeof(raster_slot_struct);
+  data_offset = (data_offset + RASTER_CACHE_ALIGNMENT - 1) / RASTER_CACHE_ALIGNMENT
+    * RASTER_CACHE_ALIGNMENT;
+  cache->size = data_offset + n_slots * slot_size;
+  if (MapCache (cache, filename, data_offset) != 0) {
+    free (cache);
+    return NULL;
+  }
+  cache->slots = (raster_slot_struct *) ((unsigned char *) cache->base + RASTER_CACHE_HEADER_SIZE);
+  cache->data = (unsigned char *) cache->base + data_offset;
+
+  /* Build the hash table and the list in order of use */
+  for (cache->n_buckets=1; cache->n_buckets<2*n_slots; cache->n_buckets*=2)
+    ;
+  cache->bucket = malloc (cache->n_buckets * sizeof(long));
+  memset (cache->bucket, 0xFF, cache->n_buckets * sizeof(long));
+  cache->next_in_bucket = malloc (n_slots * sizeof(long));
+  cache->newer = malloc (n_slots * sizeof(long));
+  cache->older = malloc (n_slots * sizeof(long));
+  cache->newest = cache->oldest = -1;
+
+  order = malloc (n_slots * sizeof(slot_use_struct));
+  n_used = 0;
+  for (slot=0; slot<n_slots; slot++)
+    if (cache->slots[slot].used && cache->slots[slot].length <= slot_size) {
+      order[n_used].last_use = cache->slots[slot].last_use;
+      order[n_used].slot = slot;
+      n_used++;
+    }
+    else {
+      cache->slots[slot].used = 0;
+      LinkOldest (cache, slot);
+    }
+  qsort (order, n_used, sizeof(slot_use_struct), CompareUse);
+  for (slot=0; slot<n_used; slot++) {
+    InsertSlot (cache, order[slot].slot);
+    LinkNewest (cache, order[slot].slot);
+  }
+  if (n_used > 0)
+    cache->clock = order[n_used-1].last_use;
+  free (order);
+
+  cache->n_loaded = cache->n_used = n_used;
+  return cache;
+}
+
+/*******************************************************************************
+** Routine:     LookupRasterCache
+**
+** Description: Find a block in the cache, and mark it as the most recently
+**              used. If block is not NULL, the block is copied into it (it
+**              must hold slot_size bytes), and its length is returned in
+**              length. Returns 1 if found, 0 if not.
+*******************************************************************************/
+int LookupRasterCache (
+  raster_cache_struct           *cache,
+  const raster_block_key_struct *key,
+  void                          *block,
+  size_t                        *length)
+{
+  long slot = FindSlot (cache, key);
+
+  if (slot < 0) {
+    cache->n_misses++;
+    return 0;
+  }
+  cache->n_hits++;
+  cache->slots[slot].last_use = ++cache->clock;
+  Unlink (cache, slot);
+  LinkNewest (cache, slot);
+  if (block != NULL) {
+    memcpy (block, cache->data + slot * cache->slot_size, cache->slots[slot].length);
+    *length = cache->slots[slot].length;
+  }
+  return 1;
+}
+
+/*******************************************************************************
+** Routine:     AddRasterCache
+**
+** Description: Add a block to the cache, or replace it, evicting the least
+**              recently used block if the cache is full. Returns 0 on
+**              success, -1 if the block is larger than a slot.
+*******************************************************************************/
+int AddRasterCache (
+  raster_cache_struct           *cache,
+  const raster_block_key_struct *key,
+  const void                    *block,
+  size_t                        length)
+{
+  long slot;
+
+  if (length > cache->slot_size)
+    return -1;
+
+  slot = FindSlot (cache, key);
+  if (slot < 0) {
+    /* Take the least recently used slot, or a free one */
+    slot = cache->oldest;
+    if (cache->slots[slot].used) {
+      RemoveSlot (cache, slot);
+      cache->n_evicted++;
+    }
+    else
+      cache->n_used++;
+    cache->slots[slot].used = 0;
+    cache->slots[slot].key = *key;
+    InsertSlot (cache, slot);
+  }
+
+  /* The slot is marked as free while the block is written */
+  cache->slots[slot].used = 0;
+  memcpy (cache->data + slot * cache->slot_size, block, length);
+  cache->slots[slot].length = (uint32_t) length;
+  cache->slots[slot].last_use = ++cache->clock;
+  cache->slots[slot].used = 1;
+  Unlink (cache, slot);
+  LinkNewest (cache, slot);
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     CloseRasterCache
+**
+** Description: Unmap the cache file, and free the cache
+*******************************************************************************/
+void CloseRasterCache (raster_cache_struct *cache)
+{
+  if (cache->base != NULL) {
+#ifdef _WIN32
+    free (cache->base);
+#else
+    munmap (cache->base, cache->size);
+#endif
+  }
+  free (cache->bucket);
+  free (cache->next_in_bucket);
+  free (cache->newer);
+  free (cache->older);
+  free (cache);
+}
@@ -0,0 +1,112 @@
+/* raster_cache.h
+
+   Local cache of GeoRaster blocks, kept in a memory-mapped file.
+
+   A GeoRaster object (see appendix D) stores its cells in blocks: one row of
+   its raster data table per block, keyed by raster id, pyramid level, band
+   block, row block and column block, with the cells in a BLOB. A map that
+   is panned over the raster reads the same blocks again and again as the
+   window moves back and forth; the cache keeps the blocks already read on
+   the local disk, so that only the blocks that were never seen, or that
+   were evicted, are read from the database.
+
+   The cache file is made of a fixed number of slots of the same size (the
+   size of the largest block), preceded by a table that gives the key and
+   length of the block held in each slot:
+
+     offset       size             content
+     0            8                magic string "SDORBC01"
+     8            4                format version (1)
+     12           4                (reserved)
+     16           8                slot size
+     24           8                number of slots (n)
+     32           8                offset of the first slot
+     40           24               (reserved)
+     64           40*n             slot table
+     slot offset  slot size * n    slots (aligned on 4096 bytes)
+
+   The file is mapped in memory, so that the blocks are copied straight from
+   the page cache of the operating system, and the blocks of one run are
+   still there for the next run. The values are stored in the byte order of
+   the host: the file is only meant to be used on the machine that wrote it.
+
+   When all slots are used, the least recently used block is evicted. Each
+   slot of the table carries the time (a counter) of its last use, so that
+   the order of use survives from one run to the next.
+
+   On Windows the cache is kept in memory only, and is lost at the end of
+   the run.
+
+   The cache is not thread-safe: threads that share a cache must serialize
+   their calls.
+
+*/
+#ifndef RASTER_CACHE_H
+#define RASTER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RASTER_CACHE_MAGIC "SDORBC01"
+#define RASTER_CACHE_VERSION 1
+#define RASTER_CACHE_HEADER_SIZE 64
+#define RASTER_CACHE_ALIGNMENT 4096
+
+/* The key of a block in the raster data table */
+struct raster_block_key
+{
+    int64_t raster_id;
+    int32_t pyramid_level;
+    int32_t band_block;
+    int32_t row_block;
+    int32_t column_block;
+};
+typedef struct raster_block_key raster_block_key_struct;
+
+/* An entry of the slot table, as stored in the file */
+struct raster_slot
+{
+    raster_block_key_struct key;
+    uint32_t                length;   /* Bytes of the block */
+    uint32_t                used;     /* 0 if the slot is free */
+    uint64_t                last_use;
+};
+typedef struct raster_slot raster_slot_struct;
+
+/* A cache open for reading and writing */
+struct raster_cache
+{
+    size_t             slot_size;
+    long               n_slots;
+    raster_slot_struct *slots;        /* Slot table (in the mapped file) */
+    unsigned char      *data;         /* First slot (in the mapped file) */
+    void               *base;         /* Start of the mapped file */
+    size_t             size;          /* Size of the mapped file */
+    uint64_t           clock;         /* Time of the last use */
+    /* Hash table of the used slots, chained through next_in_bucket */
+    long               n_buckets;     /* A power of 2 */
+    long               *bucket;       /* First slot of each bucket, or -1 */
+    long               *next_in_bucket;
+    /* Slots from the most recently used to the least recently used (and
+       the free slots) */
+    long               *newer;
+    long               *older;
+    long               newest;
+    long               oldest;
+    /* Statistics */
+    long               n_loaded;      /* Blocks found in the file when opened */
+    long               n_used;        /* Blocks in the cache */
+    long               n_hits;
+    long               n_misses;
+    long               n_evicted;
+};
+typedef struct raster_cache raster_cache_struct;
+
+raster_cache_struct *OpenRasterCache (const char *filename, size_t slot_size, long n_slots);
+int  LookupRasterCache (raster_cache_struct *cache, const raster_block_key_struct *key,
+                        void *block, size_t *length);
+int  AddRasterCache (raster_cache_struct *cache, const raster_block_key_struct *key,
+                     const void *block, size_t length);
+void CloseRasterCache (raster_cache_struct *cache);
+
+#endif
@@ -0,0 +1,147 @@
+/* raster_pyramid.c
+
+   Reduction of GeoRaster blocks for pyramid levels. See raster_pyramid.h.
+
+*/
+#include <string.h>
+#include "raster_pyramid.h"
+
+/*******************************************************************************
+** Routine:     AverageRow, NearestRow
+**
+** Description: Reduce two rows of 2 * n cells into one row of n cells
+*******************************************************************************/
+static void AverageRow (
+  const unsigned char *row0,
+  const unsigned char *row1,
+  unsigned char       *out,
+  int                 n)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    out[i] = (unsigned char) ((row0[2*i] + row0[2*i+1] + row1[2*i] + row1[2*i+1] + 2) >> 2);
+}
+
+static void NearestRow (
+  const unsigned char *row0,
+  unsigned char       *out,
+  int                 n)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    out[i] = row0[2*i];
+}
+
+/*******************************************************************************
+** Routine:     AveragePixels, NearestPixels
+**
+** Description: Reduce two rows of 2 * n cells of interleaved bands into one
+**              row of n cells
+*******************************************************************************/
+static void AveragePixels (
+  const unsigned char *row0,
+  const unsigned char *row1,
+  unsigned char       *out,
+  int                 n,
+  int                 bands)
+{
+  int i, b;
+
+  /* Three bands (RGB) is the common case: a constant stride lets the
+     compiler vectorize the loop */
+  if (bands == 3) {
+    for (i=0; i<3*n; i+=3)
+      for (b=0; b<3; b++)
+        out[i + b] = (unsigned char) ((row0[2*i + b] + row0[2*i + 3 + b]
+          + row1[2*i + b] + row1[2*i + 3 + b] + 2) >> 2);
+    return;
+  }
+  for (i=0; i<n; i++)
+    for (b=0; b<bands; b++)
+      out[i*bands + b] = (unsigned char) ((row0[2*i*bands + b] + row0[(2*i+1)*bands + b]
+        + row1[2*i*bands + b] + row1[(2*i+1)*bands + b] + 2) >> 2);
+}
+
+static void NearestPixels (
+  const unsigned char *row0,
+  unsigned char       *out,
+  int                 n,
+  int                 bands)
+{
+  int i;
+
+  for (i=0; i<n; i++)
+    memcpy (out + i*bands, row0 + 2*i*bands, bands);
+}
+
+/*******************************************************************************
+** Routine:     RowOffset
+**
+** Description: Offset of the first cell of a row of a band in a block, and
+**              the number of bytes from one cell to the next (in step)
+*******************************************************************************/
+static long RowOffset (const raster_block_layout_struct *layout, int row, int band, int *step)
+{
+  *step = 1;
+  switch (layout->interleaving) {
+    case RASTER_BSQ:
+      return ((long) band * layout->rows + row) * layout->columns;
+    case RASTER_BIL:
+      return ((long) row * layout->bands + band) * layout->columns;
+    default:
+      *step = layout->bands;
+      return (long) row * layout->columns * layout->bands + band;
+  }
+}
+
+/*******************************************************************************
+** Routine:     ReduceBlock
+**
+** Description: Build a block of a pyramid level from its four children in
+**              the level below: top left, top right, bottom left, bottom
+**              right. A NULL child (past the edge of the raster) gives
+**              cells of 0.
+*******************************************************************************/
+void ReduceBlock (
+  const raster_block_layout_struct *layout,
+  const unsigned char              *children[4],
+  unsigned char                    *block,
+  int                              method)
+{
+  int  half_rows = layout->rows / 2, half_columns = layout->columns / 2;
+  int  q, band, row, step, n_bands;
+  long in0, in1, out;
+  const unsigned char *child;
+
+  /* For BIP, all the bands of a row are reduced at once */
+  n_bands = layout->interleaving == RASTER_BIP ? 1 : layout->bands;
+
+  for (q=0; q<4; q++) {
+    child = children[q];
+    for (band=0; band<n_bands; band++)
+      for (row=0; row<half_rows; row++) {
+        out = RowOffset (layout, (q / 2) * half_rows + row, band, &step)
+          + (long) (q % 2) * half_columns * step;
+        if (child == NULL) {
+          memset (block + out, 0, (size_t) half_columns * step);
+          continue;
+        }
+        in0 = RowOffset (layout, 2*row, band, &step);
+        in1 = RowOffset (layout, 2*row + 1, band, &step);
+        if (step == 1) {
+          if (method == RASTER_NEAREST)
+            NearestRow (child + in0, block + out, half_columns);
+          else
+            AverageRow (child + in0, child + in1, block + out, half_columns);
+        }
+        else {
+          if (method == RASTER_NEAREST)
+            NearestPixels (child + in0, block + out, half_columns, step);
+          else
+            AveragePixels (child + in0, child + in1, block + out, half_columns, step);
+        }
+      }
+  }
+}
@@ -0,0 +1,52 @@
+/* raster_pyramid.h
+
+   Reduction of GeoRaster blocks for pyramid levels.
+
+   Each pyramid level of a GeoRaster object (see listing D-8) halves the
+   number of rows and columns of the level below. When the blocks of all
+   levels have the same size, which is how GeoRaster stores pyramids, block
+   (r, c) of a level is made from the four blocks (2r, 2c), (2r, 2c+1),
+   (2r+1, 2c) and (2r+1, 2c+1) of the level below: each of them gives one
+   quarter of the block. ReduceBlock builds a block from its four children,
+   either with the average of each group of 2 x 2 cells (the AVERAGE4
+   resampling of SDO_GEOR.GENERATEPYRAMID) or with the cell at the top left
+   of each group (nearest neighbor).
+
+   The blocks hold unsigned 8-bit cells, uncompressed, in one of the three
+   interleavings of GeoRaster:
+
+   - BSQ: the cells of each band are stored one band after the other
+   - BIL: the rows of each band are stored one after the other, row by row
+   - BIP: the bands of each cell are stored together
+
+   The inner loops work on whole rows of cells with unit strides (or a
+   stride of the number of bands for BIP) and no branches, so that the
+   compiler turns them into vector instructions.
+
+   The number of rows and columns of the blocks must be even.
+
+*/
+#ifndef RASTER_PYRAMID_H
+#define RASTER_PYRAMID_H
+
+#define RASTER_BSQ 0
+#define RASTER_BIL 1
+#define RASTER_BIP 2
+
+#define RASTER_AVERAGE 0
+#define RASTER_NEAREST 1
+
+/* The layout of the cells in a block */
+struct raster_block_layout
+{
+    int rows;
+    int columns;
+    int bands;
+    int interleaving;                 /* RASTER_BSQ, RASTER_BIL or RASTER_BIP */
+};
+typedef struct raster_block_layout raster_block_layout_struct;
+
+void ReduceBlock (const raster_block_layout_struct *layout, const unsigned char *children[4],
+                  unsigned char *block, int method);
+
+#endif
@@ -0,0 +1,1192 @@
+/* raster_reader.c
+
+   This program reads the blocks of a GeoRaster object straight from its
+   raster data table, as a map viewer panning over the raster would, and
+   measures how many map windows it can serve per second.
+
+   Appendix D reads windows of a raster with SDO_GEOR.GETRASTERSUBSET
+   (listing D-9), one call per window: the database assembles the cells of
+   the window into a BLOB, and the calls of all windows go through a single
+   session. This program reads the blocks that make up the window instead,
+   with a query on the raster data table (listing D-3):
+
+     SELECT columnblocknumber, rasterblock
+       FROM rdt
+      WHERE rasterid = :raster_id AND pyramidlevel = :pyramid_level
+        AND bandblocknumber = :band_block AND rowblocknumber = :row_block
+        AND columnblocknumber BETWEEN :first_column AND :last_column
+
+   The blocks are kept in a local cache file (see raster_cache.h), so that a
+   block is only read from the database the first time it is needed, or
+   after it was evicted. The blocks that are not in the cache are read by
+   several threads, each with its own database session, and the BLOBs are
+   prefetched with the rows: a block comes in the same round trip as its
+   row. The blocks around the window are read at the same time as the
+   window itself, so that the next windows of the pan find them in the
+   cache.
+
+   The workload is a pan at one pyramid level: the window moves by an
+   eighth of its size at each step, turns at random from time to time, and
+   bounces on the edges of the raster. The same pan is made on every run,
+   so that a second run shows the effect of a warm cache.
+
+   It illustrates the following concepts:
+   - reading BLOBs with array fetches and LOB prefetching
+   - using OCI from several threads, with one session per thread
+   - reading the raster data table of a GeoRaster object
+
+   The program takes the following command line arguments:
+
+     raster_reader username password database rdt raster_id cache cache_size [sessions] [windows] [window_size] [level] [prefetch] [array_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - rdt = the raster data table (for instance BRANCHES_RDT)
+   - raster_id = the raster id of the GeoRaster object in that table
+   - cache = name of the cache file. It is created if it does not exist.
+   - cache_size = size of the cache, in megabytes
+   - sessions = number of threads and database sessions (default is 4)
+   - windows = number of windows of the pan (default is 1000)
+   - window_size = width and height of the windows, in cells (default is
+     512)
+   - level = pyramid level of the pan (default is 0)
+   - prefetch = number of blocks read around the window on each side
+     (default is 1)
+   - array_size = number of blocks to read per fetch (default is 16)
+
+   Notes:
+
+   The program must be linked with raster_cache.c. It uses POSIX threads.
+
+   The blocks are returned as they are stored: the program does not
+   decompress them, nor assemble their cells into an image. All the band
+   blocks of each window are read. The size of the blocks is taken from
+   the block (0, 0) of band block 0 at level 0, and the size of the cache
+   slots from the largest block of the raster: the cache file is emptied
+   when they change.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <oci.h>
+#include "raster_cache.h"
+
+#define MAX_THREADS 64
+#define MAX_LEVELS 32
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle, shared by all threads */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* The blocks of one pyramid level */
+struct raster_level
+{
+    int  n_band_blocks;
+    int  n_row_blocks;
+    int  n_column_blocks;
+    long max_block_size;              /* Bytes of the largest block */
+};
+typedef struct raster_level raster_level_struct;
+
+/* A run of consecutive blocks of a row, missing from the cache */
+struct fetch_job
+{
+    int band_block;
+    int row_block;
+    int first_column;
+    int last_column;
+};
+typedef struct fetch_job fetch_job_struct;
+
+/* The raster, the cache, and the blocks to fetch for the current window,
+   shared by all threads */
+struct reader
+{
+    long                raster_id;
+    int                 pyramid_level;
+    raster_cache_struct *cache;
+    pthread_mutex_t     cache_lock;
+    /* The jobs of the current window */
+    fetch_job_struct    *jobs;
+    int                 n_jobs;
+    int                 max_jobs;
+    int                 next_job;     /* Next job to take */
+    int                 round;        /* Number of the current window */
+    int                 n_finished;   /* Threads done with the current window */
+    int                 n_threads;
+    int                 done;         /* Set when there are no more windows */
+    pthread_mutex_t     lock;         /* Protects the jobs and counters */
+    pthread_cond_t      work_ready;
+    pthread_cond_t      work_done;
+};
+typedef struct reader reader_struct;
+
+/* A database session, used by one thread only, with its fetch arrays */
+struct session
+{
+    OCIError          *errhp;         /* Error handle */
+    OCISvcCtx         *svchp;         /* Service Context handle */
+    OCIStmt           *stmthp;        /* Block query */
+    int               array_size;
+    /* Bind variables */
+    long              raster_id;
+    int               pyramid_level;
+    int               band_block;
+    int               row_block;
+    int               first_column;
+    int               last_column;
+    /* Fetch arrays */
+    int               *column;
+    sb2               *column_ind;
+    OCILobLocator     **block_lob;
+    sb2               *block_ind;
+    unsigned char     *block;         /* Content of one block */
+    size_t            block_size;
+    /* Statistics */
+    long              n_blocks;       /* Blocks read */
+    double            n_bytes;
+    long              n_queries;
+    double            database_seconds;
+};
+typedef struct session session_struct;
+
+/* A worker thread */
+struct worker
+{
+    int            id;
+    reader_struct  *reader;
+    session_struct session;
+    pthread_t      thread;
+};
+typedef struct worker worker_struct;
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = -1;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                  /* (in)  Error handle */
+    (ub4)1,                          /* (in)  Number of error record */
+    (text *)NULL,                    /* (out) SQLSTATE (no longer used) */
+    &errcode,                        /* (out) Error code */
+    errbuf,                          /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),             /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "ERROR %d: %s\n", errcode, errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context. The environment is shared by all
+**              threads, so it is created in threaded mode.
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_THREADED),             /* (in)  Mode: threads */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     OpenSession
+**
+** Description: Connect to the database
+*******************************************************************************/
+void OpenSession(
+  session_struct *session,
+  char           *username,
+  char           *password,
+  char           *database)
+{
+  sword  status;
+
+  memset (session, 0, sizeof(session_struct));
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->errhp,       /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (session->errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      session->errhp,                /* (in)  Error Handle */
+      &session->svchp,               /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     BindInteger
+**
+** Description: Bind an integer variable to a placeholder
+*******************************************************************************/
+void BindInteger(
+  session_struct *session,
+  OCIStmt        *stmthp,
+  char           *placeholder,
+  dvoid          *value,
+  sb4            value_size)
+{
+  OCIBind *bind_hp = NULL;
+  sword   status;
+
+  status = OCIBindByName(
+    stmthp,                          /* (in)  Statement Handle */
+    &bind_hp,                        /* (out) Bind Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *) placeholder,            /* (in)  Placeholder */
+    strlen(placeholder),             /* (in)  Placeholder length */
+    value,                           /* (in)  Value Pointer */
+    value_size,                      /* (in)  Value Size */
+    SQLT_INT,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     DefineColumn
+**
+** Description: Define the array that receives a column
+*******************************************************************************/
+void DefineColumn(
+  session_struct *session,
+  OCIStmt        *stmthp,
+  int            position,
+  dvoid          *values,
+  sb4            value_size,
+  ub2            type,
+  sb2            *indicators)
+{
+  OCIDefine *define_hp = NULL;
+  sword     status;
+
+  status = OCIDefineByPos(
+    stmthp,                          /* (in)  Statement Handle */
+    &define_hp,                      /* (out) Define Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)position,                   /* (in)  Bind variable position */
+    values,                          /* (in)  Value Pointer (first element) */
+    value_size,                      /* (in)  Value Size (of one element) */
+    type,                            /* (in)  Data Type */
+    (dvoid *) indicators,            /* (in)  Indicator Pointer (first element) */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     SelectIntegers
+**
+** Description: Run a query on the raster data table that returns up to
+**              MAX_LEVELS rows of n_columns integers. Returns the number of
+**              rows.
+*******************************************************************************/
+int SelectIntegers(
+  session_struct *session,
+  char           *select_sql,
+  long           raster_id,
+  int            n_columns,
+  long           values[][MAX_LEVELS])
+{
+  OCIStmt *stmthp;
+  sb2     indicators[8][MAX_LEVELS];
+  int     rows_fetched = 0, c;
+  sword   status;
+
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&stmthp,               /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    stmthp,                          /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  BindInteger (session, stmthp, ":RASTER_ID", &raster_id, sizeof(long));
+  for (c=0; c<n_columns; c++)
+    DefineColumn (session, stmthp, c + 1, values[c], sizeof(long), SQLT_INT, indicators[c]);
+
+  /* All the rows come in the first fetch */
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    stmthp,                          /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)MAX_LEVELS,                 /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(session->errhp);
+
+  OCIAttrGet(
+    (dvoid *)stmthp,
+    (ub4)OCI_HTYPE_STMT,
+    (dvoid *)&rows_fetched,
+    (ub4 *)0,
+    (ub4)OCI_ATTR_ROWS_FETCHED,
+    session->errhp);
+
+  OCIHandleFree((dvoid *)stmthp, (ub4)OCI_HTYPE_STMT);
+  return rows_fetched;
+}
+
+/*******************************************************************************
+** Routine:     ReadRaster
+**
+** Description: Read the number of blocks and the size of the largest block
+**              of each pyramid level, and the size of the blocks in cells.
+**              Returns the number of levels.
+*******************************************************************************/
+int ReadRaster(
+  session_struct      *session,
+  char                *rdt,
+  long                raster_id,
+  raster_level_struct *levels,
+  int                 *block_rows,
+  int                 *block_columns)
+{
+  char select_sql[1024];
+  long values[5][MAX_LEVELS];
+  int  n_levels, n, i, level;
+
+  sprintf (select_sql,
+    "SELECT pyramidlevel, MAX(bandblocknumber) + 1, MAX(rowblocknumber) + 1, "
+    "MAX(columnblocknumber) + 1, MAX(DBMS_LOB.GETLENGTH(rasterblock)) "
+    "FROM %s WHERE rasterid = :raster_id GROUP BY pyramidlevel ORDER BY pyramidlevel", rdt);
+  printf ("Executing query:\nSQL> %s\n", select_sql);
+  n = SelectIntegers (session, select_sql, raster_id, 5, values);
+  memset (levels, 0, MAX_LEVELS * sizeof(raster_level_struct));
+  n_levels = 0;
+  for (i=0; i<n; i++) {
+    level = (int) values[0][i];
+    if (level < 0 || level >= MAX_LEVELS)
+      continue;
+    levels[level].n_band_blocks = (int) values[1][i];
+    levels[level].n_row_blocks = (int) values[2][i];
+    levels[level].n_column_blocks = (int) values[3][i];
+    levels[level].max_block_size = values[4][i];
+    if (level >= n_levels)
+      n_levels = level + 1;
+  }
+  if (n_levels == 0)
+    return 0;
+
+  /* The block MBR is in cell space: rows, then columns */
+  sprintf (select_sql,
+    "SELECT SDO_GEOM.SDO_MAX_MBR_ORDINATE(blockmbr, 1) - SDO_GEOM.SDO_MIN_MBR_ORDINATE(blockmbr, 1) + 1, "
+    "SDO_GEOM.SDO_MAX_MBR_ORDINATE(blockmbr, 2) - SDO_GEOM.SDO_MIN_MBR_ORDINATE(blockmbr, 2) + 1 "
+    "FROM %s WHERE rasterid = :raster_id AND pyramidlevel = 0 AND bandblocknumber = 0 "
+    "AND rowblocknumber = 0 AND columnblocknumber = 0", rdt);
+  printf ("SQL> %s\n\n", select_sql);
+  n = SelectIntegers (session, select_sql, raster_id, 2, values);
+  if (n == 0)
+    return 0;
+  *block_rows = (int) values[0][0];
+  *block_columns = (int) values[1][0];
+  return n_levels;
+}
+
+/*******************************************************************************
+** Routine:     PrepareBlockQuery
+**
+** Description: Prepare the block query of a session, bind its variables,
+**              define its fetch arrays, and have the BLOBs of up to
+**              block_size bytes prefetched with the rows
+*******************************************************************************/
+void PrepareBlockQuery(
+  session_struct *session,
+  char           *rdt,
+  size_t         block_size,
+  int            array_size)
+{
+  char     select_sql[1024];
+  OCISession *session_hp;
+  ub4      prefetch_size = (ub4) block_size;
+  ub4      prefetch_rows = (ub4) array_size;
+  sword    status;
+  int      i;
+
+  session->array_size = array_size;
+  session->block_size = block_size;
+  session->block = malloc (block_size);
+  session->column = malloc (sizeof(int) * array_size);
+  session->column_ind = malloc (sizeof(sb2) * array_size);
+  session->block_lob = malloc (sizeof(OCILobLocator *) * array_size);
+  session->block_ind = malloc (sizeof(sb2) * array_size);
+
+  sprintf (select_sql,
+    "SELECT columnblocknumber, rasterblock FROM %s "
+    "WHERE rasterid = :raster_id AND pyramidlevel = :pyramid_level "
+    "AND bandblocknumber = :band_block AND rowblocknumber = :row_block "
+    "AND columnblocknumber BETWEEN :first_column AND :last_column", rdt);
+
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&session->stmthp,      /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  status = OCIStmtPrepare(
+    session->stmthp,                 /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  BindInteger (session, session->stmthp, ":RASTER_ID", &session->raster_id, sizeof(long));
+  BindInteger (session, session->stmthp, ":PYRAMID_LEVEL", &session->pyramid_level, sizeof(int));
+  BindInteger (session, session->stmthp, ":BAND_BLOCK", &session->band_block, sizeof(int));
+  BindInteger (session, session->stmthp, ":ROW_BLOCK", &session->row_block, sizeof(int));
+  BindInteger (session, session->stmthp, ":FIRST_COLUMN", &session->first_column, sizeof(int));
+  BindInteger (session, session->stmthp, ":LAST_COLUMN", &session->last_column, sizeof(int));
+
+  /* Allocate the LOB locators that receive the blocks */
+  for (i=0; i<array_size; i++) {
+    status = OCIDescriptorAlloc(
+      (dvoid *)envhp,                /* (in)  Environment Handle */
+      (dvoid **)&session->block_lob[i], /* (out) LOB locator */
+      (ub4)OCI_DTYPE_LOB,            /* (in)  Descriptor type */
+      (size_t)0,                     /* (in)  Size of extra user memory (NOT USED) */
+      (dvoid **)0);                  /* (out) Pointer to user memory (NOT USED) */
+    if (status != OCI_SUCCESS)
+      ReportError(session->errhp);
+  }
+  DefineColumn (session, session->stmthp, 1, session->column, sizeof(int), SQLT_INT,
+    session->column_ind);
+  DefineColumn (session, session->stmthp, 2, session->block_lob, sizeof(OCILobLocator *),
+    SQLT_BLOB, session->block_ind);
+
+  /* Have the rows of a run come in one round trip, with their blocks */
+  status = OCIAttrSet(
+    (dvoid *)session->stmthp,        /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    (dvoid *)&prefetch_rows,         /* (in)  Number of rows to prefetch */
+    (ub4)0,                          /* (in)  Size (NOT USED) */
+    (ub4)OCI_ATTR_PREFETCH_ROWS,     /* (in)  Attribute: row prefetch */
+    session->errhp);                 /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  status = OCIAttrGet(
+    (dvoid *)session->svchp,         /* (in)  Service Context Handle */
+    (ub4)OCI_HTYPE_SVCCTX,           /* (in)  Handle type */
+    (dvoid *)&session_hp,            /* (out) Session Handle */
+    (ub4 *)0,                        /* (out) Size (NOT USED) */
+    (ub4)OCI_ATTR_SESSION,           /* (in)  Attribute: session */
+    session->errhp);                 /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  status = OCIAttrSet(
+    (dvoid *)session_hp,             /* (in)  Session Handle */
+    (ub4)OCI_HTYPE_SESSION,          /* (in)  Handle type */
+    (dvoid *)&prefetch_size,         /* (in)  Number of bytes to prefetch */
+    (ub4)0,                          /* (in)  Size (NOT USED) */
+    (ub4)OCI_ATTR_DEFAULT_LOBPREFETCH_SIZE, /* (in)  Attribute: LOB prefetch size */
+    session->errhp);                 /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+}
+
+/*******************************************************************************
+** Routine:     CloseSession
+**
+** Description: Disconnect from Oracle and release the session handles
+*******************************************************************************/
+void CloseSession(session_struct *session)
+{
+  sword status;
+  int   i;
+
+  if (session->stmthp != NULL)
+    OCIHandleFree((dvoid *)session->stmthp, (ub4)OCI_HTYPE_STMT);
+  for (i=0; i<session->array_size; i++)
+    OCIDescriptorFree((dvoid *)session->block_lob[i], (ub4)OCI_DTYPE_LOB);
+
+  status = OCILogoff(session->svchp, session->errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)session->errhp,         /* (in)  Error Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  free (session->block);
+  free (session->column);
+  free (session->column_ind);
+  free (session->block_lob);
+  free (session->block_ind);
+}
+
+/*******************************************************************************
+** Routine:     ReadBlockLob
+**
+** Description: Read a block into the buffer of a session. The block was
+**              prefetched with its row: this does not go to the database.
+**              Returns the number of bytes, or -1 if the block is larger
+**              than the buffer.
+*******************************************************************************/
+long ReadBlockLob(
+  session_struct *session,
+  OCILobLocator  *lob_locator)
+{
+  oraub8 lob_length;
+  oraub8 byte_amount;
+  sword  status;
+
+  status = OCILobGetLength2(session->svchp, session->errhp, lob_locator, &lob_length);
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  if (lob_length > session->block_size)
+    return -1;
+  if (lob_length == 0)
+    return 0;
+
+  byte_amount = lob_length;
+  status = OCILobRead2(
+    session->svchp,                  /* (in)  Service Context Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    lob_locator,                     /* (in)  LOB locator */
+    &byte_amount,                    /* (i/o) Number of bytes to read / read */
+    (oraub8 *)0,                     /* (i/o) Number of characters (NOT USED) */
+    (oraub8)1,                       /* (in)  Offset of first byte (1-based) */
+    (dvoid *)session->block,         /* (in)  Buffer */
+    lob_length,                      /* (in)  Buffer size */
+    OCI_ONE_PIECE,                   /* (in)  Piece: all in one go */
+    (dvoid *)0,                      /* (in)  Callback context (NOT USED) */
+    0,                               /* (in)  Callback function (NOT USED) */
+    (ub2)0,                          /* (in)  Character set (NOT USED) */
+    (ub1)SQLCS_IMPLICIT);            /* (in)  Character set form */
+  if (status != OCI_SUCCESS)
+    ReportError(session->errhp);
+  return (long)byte_amount;
+}
+
+/*******************************************************************************
+** Routine:     FetchBlocks
+**
+** Description: Read a run of blocks from the database, and add them to the
+**              cache
+*******************************************************************************/
+void FetchBlocks(
+  reader_struct    *reader,
+  session_struct   *session,
+  fetch_job_struct *job)
+{
+  raster_block_key_struct key;
+  boolean has_more_data;
+  int     rows_in_batch = 0, i;
+  long    length;
+  sword   status;
+  double  start_time = ElapsedSeconds ();
+
+  session->raster_id = reader->raster_id;
+  session->pyramid_level = reader->pyramid_level;
+  session->band_block = job->band_block;
+  session->row_block = job->row_block;
+  session->first_column = job->first_column;
+  session->last_column = job->last_column;
+
+  key.raster_id = reader->raster_id;
+  key.pyramid_level = reader->pyramid_level;
+  key.band_block = job->band_block;
+  key.row_block = job->row_block;
+
+  status = OCIStmtExecute(
+    session->svchp,                  /* (in)  Service Context Handle */
+    session->stmthp,                 /* (in)  Statement Handle */
+    session->errhp,                  /* (in)  Error Handle */
+    (ub4)session->array_size,        /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(session->errhp);
+  session->n_queries++;
+
+  has_more_data = TRUE;
+  do
+  {
+    /* The last batch comes with OCI_NO_DATA: it still needs to be processed */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)session->stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      session->errhp);
+
+    /* Copy the blocks just fetched into the cache */
+    for (i=0; i<rows_in_batch; i++) {
+      if (session->column_ind[i] == OCI_IND_NULL || session->block_ind[i] == OCI_IND_NULL)
+        continue;
+      length = ReadBlockLob (session, session->block_lob[i]);
+      if (length < 0)
+        continue;
+      key.column_block = session->column[i];
+      pthread_mutex_lock (&reader->cache_lock);
+      AddRasterCache (reader->cache, &key, session->block, (size_t) length);
+      pthread_mutex_unlock (&reader->cache_lock);
+      session->n_blocks++;
+      session->n_bytes += length;
+    }
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        session->stmthp,               /* (in)  Statement Handle */
+        session->errhp,                /* (in)  Error Handle */
+        (ub4)session->array_size,      /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(session->errhp);
+    }
+  }
+  while (has_more_data);
+
+  session->database_seconds += ElapsedSeconds () - start_time;
+}
+
+/*******************************************************************************
+** Routine:     RunJobs
+**
+** Description: Take the jobs of the current window until there are none
+**              left, and report when done
+*******************************************************************************/
+void RunJobs(worker_struct *worker)
+{
+  reader_struct *reader = worker->reader;
+  int job;
+
+  for (;;) {
+    pthread_mutex_lock (&reader->lock);
+    job = reader->next_job < reader->n_jobs ? reader->next_job++ : -1;
+    pthread_mutex_unlock (&reader->lock);
+    if (job < 0)
+      break;
+    FetchBlocks (reader, &worker->session, &reader->jobs[job]);
+  }
+
+  pthread_mutex_lock (&reader->lock);
+  reader->n_finished++;
+  if (reader->n_finished == reader->n_threads)
+    pthread_cond_signal (&reader->work_done);
+  pthread_mutex_unlock (&reader->lock);
+}
+
+/*******************************************************************************
+** Routine:     WorkerThread
+**
+** Description: Thread routine: fetch blocks for each window
+*******************************************************************************/
+void *WorkerThread (void *argument)
+{
+  worker_struct *worker = (worker_struct *) argument;
+  reader_struct *reader = worker->reader;
+  int           round = 0;
+
+  for (;;) {
+    pthread_mutex_lock (&reader->lock);
+    while (reader->round == round && !reader->done)
+      pthread_cond_wait (&reader->work_ready, &reader->lock);
+    round = reader->round;
+    if (reader->done) {
+      pthread_mutex_unlock (&reader->lock);
+      break;
+    }
+    pthread_mutex_unlock (&reader->lock);
+    RunJobs (worker);
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     FetchWindow
+**
+** Description: Have all threads fetch the jobs of a window. The calling
+**              thread is worker 0.
+*******************************************************************************/
+void FetchWindow(worker_struct *workers)
+{
+  reader_struct *reader = workers[0].reader;
+
+  pthread_mutex_lock (&reader->lock);
+  reader->next_job = 0;
+  reader->n_finished = 0;
+  reader->round++;
+  pthread_cond_broadcast (&reader->work_ready);
+  pthread_mutex_unlock (&reader->lock);
+
+  RunJobs (&workers[0]);
+
+  pthread_mutex_lock (&reader->lock);
+  while (reader->n_finished < reader->n_threads)
+    pthread_cond_wait (&reader->work_done, &reader->lock);
+  pthread_mutex_unlock (&reader->lock);
+}
+
+/*******************************************************************************
+** Routine:     AddJob
+**
+** Description: Add a run of missing blocks to the jobs of the window
+*******************************************************************************/
+void AddJob(
+  reader_struct *reader,
+  int           band_block,
+  int           row_block,
+  int           first_column,
+  int           last_column)
+{
+  if (reader->n_jobs == reader->max_jobs) {
+    reader->max_jobs = reader->max_jobs > 0 ? 2 * reader->max_jobs : 64;
+    reader->jobs = realloc (reader->jobs, reader->max_jobs * sizeof(fetch_job_struct));
+  }
+  reader->jobs[reader->n_jobs].band_block = band_block;
+  reader->jobs[reader->n_jobs].row_block = row_block;
+  reader->jobs[reader->n_jobs].first_column = first_column;
+  reader->jobs[reader->n_jobs].last_column = last_column;
+  reader->n_jobs++;
+}
+
+/*******************************************************************************
+** Routine:     PlanWindow
+**
+** Description: List the runs of blocks of a window, and of the blocks around
+**              it, that are not in the cache. Returns the number of blocks
+**              of the window itself that are in the cache.
+*******************************************************************************/
+long PlanWindow(
+  reader_struct       *reader,
+  raster_level_struct *level,
+  int                 first_row,
+  int                 last_row,
+  int                 first_column,
+  int                 last_column,
+  int                 prefetch)
+{
+  raster_block_key_struct key;
+  int  band, row, column, run_start, inside, hit;
+  int  r0, r1, c0, c1;
+  long n_hits = 0;
+
+  r0 = first_row - prefetch > 0 ? first_row - prefetch : 0;
+  r1 = last_row + prefetch < level->n_row_blocks ? last_row + prefetch : level->n_row_blocks - 1;
+  c0 = first_column - prefetch > 0 ? first_column - prefetch : 0;
+  c1 = last_column + prefetch < level->n_column_blocks ? last_column + prefetch : level->n_column_blocks - 1;
+
+  key.raster_id = reader->raster_id;
+  key.pyramid_level = reader->pyramid_level;
+  reader->n_jobs = 0;
+
+  /* The worker threads are idle: the cache does not need to be locked */
+  for (band=0; band<level->n_band_blocks; band++)
+    for (row=r0; row<=r1; row++) {
+      key.band_block = band;
+      key.row_block = row;
+      run_start = -1;
+      for (column=c0; column<=c1; column++) {
+        key.column_block = column;
+        hit = LookupRasterCache (reader->cache, &key, NULL, NULL);
+        inside = row >= first_row && row <= last_row && column >= first_column && column <= last_column;
+        if (hit && inside)
+          n_hits++;
+        if (!hit && run_start < 0)
+          run_start = column;
+        if (hit && run_start >= 0) {
+          AddJob (reader, band, row, run_start, column - 1);
+          run_start = -1;
+        }
+      }
+      if (run_start >= 0)
+        AddJob (reader, band, row, run_start, c1);
+    }
+  return n_hits;
+}
+
+/*******************************************************************************
+** Routine:     CopyWindow
+**
+** Description: Copy the blocks of a window from the cache, as a viewer
+**              would to draw it. Returns the number of blocks that are not
+**              in the raster.
+*******************************************************************************/
+long CopyWindow(
+  reader_struct       *reader,
+  raster_level_struct *level,
+  int                 first_row,
+  int                 last_row,
+  int                 first_column,
+  int                 last_column,
+  unsigned char       *window)
+{
+  raster_block_key_struct key;
+  size_t length;
+  long   n_missing = 0;
+  int    band, row, column;
+
+  key.raster_id = reader->raster_id;
+  key.pyramid_level = reader->pyramid_level;
+  for (band=0; band<level->n_band_blocks; band++)
+    for (row=first_row; row<=last_row; row++)
+      for (column=first_column; column<=last_column; column++) {
+        key.band_block = band;
+        key.row_block = row;
+        key.column_block = column;
+        if (LookupRasterCache (reader->cache, &key, window, &length))
+          window += reader->cache->slot_size;
+        else
+          n_missing++;
+      }
+  return n_missing;
+}
+
+/*******************************************************************************
+** Routine:     CompareDoubles
+**
+** Description: Comparison function for qsort
+*******************************************************************************/
+int CompareDoubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *username, *password, *database, *rdt, *cache_file;
+    long   raster_id, cache_size, n_windows, w, n_hits = 0, n_window_blocks = 0, n_missing = 0;
+    long   n_blocks = 0, n_queries = 0, n_slots, max_window_blocks, n_needed;
+    int    n_threads, window_size, pyramid_level, prefetch, array_size, t;
+    int    n_levels, block_rows, block_columns, height, width, step;
+    int    first_row, last_row, first_column, last_column;
+    double row, column, angle, start_time, window_start, elapsed, total, n_bytes = 0;
+    double database_seconds = 0;
+    double *latency;
+    size_t slot_size;
+    unsigned char       *window;
+    raster_level_struct levels[MAX_LEVELS], *level;
+    reader_struct       reader;
+    worker_struct       workers[MAX_THREADS];
+
+    if( argc < 8 || argc > 14) {
+      printf("USAGE: %s <username> <password> <database> <rdt> <raster_id> <cache> <cache_size> [<sessions>] [<windows>] [<window_size>] [<level>] [<prefetch>] [<array_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      rdt = argv[4];
+      raster_id = atol(argv[5]);
+      cache_file = argv[6];
+      cache_size = atol(argv[7]);
+      if (cache_size <= 0) {
+        printf ("Invalid cache size: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 8)
+        n_threads = atoi(argv[8]);
+      else
+        n_threads = 4;
+      if (n_threads <= 0 || n_threads > MAX_THREADS) {
+        printf ("Invalid number of sessions: must be between 1 and %d\n", MAX_THREADS);
+        exit( 1 );
+      }
+      if (argc > 9)
+        n_windows = atol(argv[9]);
+      else
+        n_windows = 1000;
+      if (n_windows <= 0) {
+        printf ("Invalid number of windows: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 10)
+        window_size = atoi(argv[10]);
+      else
+        window_size = 512;
+      if (window_size <= 0) {
+        printf ("Invalid window size: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 11)
+        pyramid_level = atoi(argv[11]);
+      else
+        pyramid_level = 0;
+      if (pyramid_level < 0 || pyramid_level >= MAX_LEVELS) {
+        printf ("Invalid pyramid level: must be between 0 and %d\n", MAX_LEVELS - 1);
+        exit( 1 );
+      }
+      if (argc > 12)
+        prefetch = atoi(argv[12]);
+      else
+        prefetch = 1;
+      if (prefetch < 0) {
+        printf ("Invalid prefetch: must be 0 or more\n");
+        exit( 1 );
+      }
+      if (argc > 13)
+        array_size = atoi(argv[13]);
+      else
+        array_size = 16;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Open the sessions */
+    for (t=0; t<n_threads; t++)
+      OpenSession (&workers[t].session, username, password, database);
+    printf ("Connected to: %s, %d sessions\n\n", database, n_threads);
+
+    /* Read the layout of the raster */
+    n_levels = ReadRaster (&workers[0].session, rdt, raster_id, levels, &block_rows, &block_columns);
+    if (n_levels == 0) {
+      printf ("Raster %ld not found in %s\n", raster_id, rdt);
+      exit (1);
+    }
+    if (pyramid_level >= n_levels || levels[pyramid_level].n_row_blocks == 0) {
+      printf ("Raster %ld has no pyramid level %d\n", raster_id, pyramid_level);
+      exit (1);
+    }
+    level = &levels[pyramid_level];
+    slot_size = 0;
+    for (t=0; t<n_levels; t++)
+      if ((size_t) levels[t].max_block_size > slot_size)
+        slot_size = (size_t) levels[t].max_block_size;
+    if (slot_size == 0)
+      slot_size = 1;
+    printf ("Raster %ld: %d levels, blocks of %d x %d cells, up to %ld bytes\n",
+      raster_id, n_levels, block_rows, block_columns, (long) slot_size);
+    printf ("Level %d: %d x %d blocks, %d band blocks\n\n", pyramid_level,
+      level->n_row_blocks, level->n_column_blocks, level->n_band_blocks);
+
+    /* Open the cache */
+    n_slots = (long) (cache_size * 1048576.0 / slot_size);
+    max_window_blocks = (long) (window_size / block_rows + 2) * (window_size / block_columns + 2)
+      * level->n_band_blocks;
+    n_needed = (long) (window_size / block_rows + 2 + 2 * prefetch)
+      * (window_size / block_columns + 2 + 2 * prefetch) * level->n_band_blocks;
+    if (n_slots < n_needed) {
+      printf ("The cache is too small: it must hold at least %ld blocks (%.1f MB)\n",
+        n_needed, n_needed * (double) slot_size / 1048576);
+      exit (1);
+    }
+    memset (&reader, 0, sizeof(reader));
+    reader.cache = OpenRasterCache (cache_file, slot_size, n_slots);
+    if (reader.cache == NULL)
+      exit (1);
+    printf ("Cache of %ld blocks, %ld blocks from earlier runs\n\n", n_slots, reader.cache->n_loaded);
+    reader.raster_id = raster_id;
+    reader.pyramid_level = pyramid_level;
+    reader.n_threads = n_threads;
+    pthread_mutex_init (&reader.cache_lock, NULL);
+    pthread_mutex_init (&reader.lock, NULL);
+    pthread_cond_init (&reader.work_ready, NULL);
+    pthread_cond_init (&reader.work_done, NULL);
+
+    /* Start the threads: the calling thread is worker 0 */
+    for (t=0; t<n_threads; t++) {
+      workers[t].id = t;
+      workers[t].reader = &reader;
+      PrepareBlockQuery (&workers[t].session, rdt, slot_size, array_size);
+    }
+    for (t=1; t<n_threads; t++)
+      if (pthread_create (&workers[t].thread, NULL, WorkerThread, &workers[t]) != 0) {
+        printf ("Could not start thread %d\n", t);
+        exit (1);
+      }
+
+    /* Pan over the level, from its center */
+    height = level->n_row_blocks * block_rows;
+    width = level->n_column_blocks * block_columns;
+    step = window_size / 8 > 0 ? window_size / 8 : 1;
+    row = (height - window_size) / 2.0;
+    column = (width - window_size) / 2.0;
+    srand (1);
+    angle = 2 * M_PI * rand () / RAND_MAX;
+    window = malloc (max_window_blocks * slot_size);
+    latency = malloc (n_windows * sizeof(double));
+    start_time = ElapsedSeconds ();
+    for (w=0; w<n_windows; w++) {
+      window_start = ElapsedSeconds ();
+
+      /* The blocks that hold the window */
+      first_row = row > 0 ? (int) row / block_rows : 0;
+      last_row = ((row > 0 ? (int) row : 0) + window_size - 1) / block_rows;
+      if (last_row >= level->n_row_blocks)
+        last_row = level->n_row_blocks - 1;
+      first_column = column > 0 ? (int) column / block_columns : 0;
+      last_column = ((column > 0 ? (int) column : 0) + window_size - 1) / block_columns;
+      if (last_column >= level->n_column_blocks)
+        last_column = level->n_column_blocks - 1;
+
+      /* Read what is not in the cache, then copy the window out */
+      n_hits += PlanWindow (&reader, level, first_row, last_row, first_column, last_column, prefetch);
+      if (reader.n_jobs > 0)
+        FetchWindow (workers);
+      n_missing += CopyWindow (&reader, level, first_row, last_row, first_column, last_column, window);
+      n_window_blocks += (long) (last_row - first_row + 1) * (last_column - first_column + 1)
+        * level->n_band_blocks;
+      latency[w] = (ElapsedSeconds () - window_start) * 1000;
+
+      /* Move to the next window, turning from time to time */
+      if (rand () % 16 == 0)
+        angle = 2 * M_PI * rand () / RAND_MAX;
+      row += step * sin (angle);
+      column += step * cos (angle);
+      if (row < 0 || row > height - window_size) {
+        angle = -angle;
+        row = row < 0 ? 0 : (height > window_size ? height - window_size : 0);
+      }
+      if (column < 0 || column > width - window_size) {
+        angle = M_PI - angle;
+        column = column < 0 ? 0 : (width > window_size ? width - window_size : 0);
+      }
+    }
+    elapsed = ElapsedSeconds () - start_time;
+
+    /* Stop the threads */
+    pthread_mutex_lock (&reader.lock);
+    reader.done = 1;
+    pthread_cond_broadcast (&reader.work_ready);
+    pthread_mutex_unlock (&reader.lock);
+    for (t=1; t<n_threads; t++)
+      pthread_join (workers[t].thread, NULL);
+
+    /* Report */
+    for (t=0; t<n_threads; t++) {
+      n_blocks += workers[t].session.n_blocks;
+      n_bytes += workers[t].session.n_bytes;
+      n_queries += workers[t].session.n_queries;
+      database_seconds += workers[t].session.database_seconds;
+      CloseSession (&workers[t].session);
+    }
+    total = 0;
+    for (w=0; w<n_windows; w++)
+      total += latency[w];
+    qsort (latency, n_windows, sizeof(double), CompareDoubles);
+    printf ("%ld windows of %d x %d cells in %.3f seconds (%.1f windows per second)\n",
+      n_windows, window_size, window_size, elapsed, n_windows / (elapsed > 0 ? elapsed : 1e-9));
+    printf ("Time per window: mean %.3f ms, median %.3f ms, P95 %.3f ms, max %.3f ms\n",
+      total / n_windows, latency[n_windows / 2], latency[(long) (n_windows * 0.95)],
+      latency[n_windows - 1]);
+    printf ("%ld window blocks, %.1f%% found in the cache, %ld not in the raster\n",
+      n_window_blocks, n_window_blocks > 0 ? 100.0 * n_hits / n_window_blocks : 0.0, n_missing);
+    printf ("%ld blocks (%.1f MB) read from the database in %ld queries, %ld blocks evicted\n",
+      n_blocks, n_bytes / 1048576, n_queries, reader.cache->n_evicted);
+    if (n_queries > 0)
+      printf ("Database: %.3f ms per query in each session\n", database_seconds * 1000 / n_queries);
+
+    free (window);
+    free (latency);
+    free (reader.jobs);
+    CloseRasterCache (reader.cache);
+    pthread_mutex_destroy (&reader.cache_lock);
+    pthread_mutex_destroy (&reader.lock);
+    pthread_cond_destroy (&reader.work_ready);
+    pthread_cond_destroy (&reader.work_done);
+
+    /* Teardown  OCI environment */
+    OCITerminate (OCI_DEFAULT);
+
+    return 0;
+}
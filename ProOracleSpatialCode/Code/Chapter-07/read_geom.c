@@ -11,10 +11,14 @@
    It illustrates the following concepts:
    - passing SQL statements from the command line
    - reading and decoding geometry objects
+   - simplifying geometries on the client
+   - transforming coordinates on the client
 
    The program takes the following command line arguments:
 
      read_geom username password database select_statement print_level
+       [--simplify=tolerance] [--simplify-method=DP|VW]
+       [--to-srid=srid] [--from-srid=srid] [--transform-check]
 
    where
 
@@ -25,6 +29,27 @@
      0 = do not print geometries
      1 = print summary (type, number of elements, number of points)
      2 = print details (all elements and point details)
+   - tolerance = simplify lines and polygons before printing them, removing
+     the details smaller than this distance (in the units of the coordinates)
+   - DP|VW = simplification method: Douglas-Peucker (default) or Visvalingam
+   - --to-srid = transform the geometries to this coordinate system before
+     simplifying and printing them
+   - --from-srid = coordinate system of the geometries that have no SDO_SRID
+   - --transform-check = check the transformations against the control
+     points of the EPSG guidance note 7-2, and stop
+
+   Notes:
+
+   The program must be linked with simplify.c. Simplification happens after
+   the geometries are fetched: it reduces what the program prints or exports,
+   not what is transferred from the database. To also reduce the transfer,
+   simplify on the server with SDO_UTIL.SIMPLIFY in the select statement.
+
+   The program must also be linked with coord_transform.c (and the math
+   library). Only the coordinate systems listed in coord_transform.h can be
+   transformed on the client, and without any change of datum: the other
+   geometries are printed as they are. Use SDO_CS.TRANSFORM in the select
+   statement for the others.
 
 */
 #include <stdio.h>
@@ -32,6 +57,8 @@
 #include <string.h>
 #include <oci.h>
 #include "sdo_geometry.h"
+#include "simplify.h"
+#include "coord_transform.h"
 
 #define use_array_interface 0
 
@@ -45,6 +72,14 @@ OCIEnv       *envhp;  /* Environment handle*/
 OCIError     *errhp;  /* Error handle */
 OCISvcCtx    *svchp;  /* Service Context handle*/
 
+/* Simplification settings (--simplify option) */
+
+simplify_options_struct simplify_options;
+
+/* Transformation settings (--to-srid option) */
+
+transform_options_struct transform_options;
+
 /*******************************************************************************
 ** Types and structures
 *******************************************************************************/
@@ -61,6 +96,7 @@ struct geometry
     int gtype;
     int srid;
     struct point *point;
+    struct point point_data;  /* Storage for the point: no separate allocation */
     int n_elem_info;
     int *elem_info;
     int n_ordinates;
@@ -248,8 +284,8 @@ geometry_struct *LoadGeometry (
   geometry->point = 0;
   if (geometry_object_ind->SDO_POINT._atomic == OCI_IND_NOTNULL) {
     x = y = z = 0;
-    /* Allocate space for point structure */
-    geometry->point = malloc (sizeof(point_struct));
+    /* The point structure is part of the geometry structure */
+    geometry->point = &geometry->point_data;
     /* Extract X */
     if (geometry_object_ind->SDO_POINT.X == OCI_IND_NOTNULL)
       OCINumberToReal(
@@ -268,6 +304,17 @@ geometry_struct *LoadGeometry (
     geometry->point->z = z;
   }
 
+  /* Point fast path: a point stored in SDO_POINT (as for gtypes 2001 and 3001)
+     has NULL arrays. The indicators say so: skip all collection calls */
+  if (geometry_object_ind->SDO_ELEM_INFO == OCI_IND_NULL &&
+      geometry_object_ind->SDO_ORDINATES == OCI_IND_NULL) {
+    geometry->n_elem_info = 0;
+    geometry->elem_info = NULL;
+    geometry->n_ordinates = 0;
+    geometry->ordinates = NULL;
+    return (geometry);
+  }
+
   /* Extract SDO_ELEM_INFO array */
 
   /* Get the size of the array */
@@ -377,9 +424,7 @@ geometry_struct *LoadGeometry (
 *******************************************************************************/
 void FreeGeometry (geometry_struct *geometry) {
   if (geometry != 0) {
-    /* Free memory used for the point structure */
-    if (geometry->point != NULL)
-      free (geometry->point);
+    /* The point structure is part of the geometry structure: nothing to free */
     /* Free memory used for the elem_info vector */
     if (geometry->elem_info != 0)
       free (geometry->elem_info);
@@ -391,6 +436,35 @@ void FreeGeometry (geometry_struct *geometry) {
   }
 }
 
+/*******************************************************************************
+** Routine:     SimplifyGeometry
+**
+** Description: Simplify the lines and polygons of a geometry, if requested
+**              on the command line
+*******************************************************************************/
+void SimplifyGeometry (geometry_struct *geometry) {
+  if (geometry->n_elem_info > 0)
+    geometry->n_ordinates = SimplifyElements (
+      geometry->elem_info, geometry->n_elem_info,
+      geometry->ordinates, geometry->n_ordinates,
+      geometry->gtype / 1000, &simplify_options);
+}
+
+/*******************************************************************************
+** Routine:     TransformGeometry
+**
+** Description: Transform the point and ordinates of a geometry to the SRID
+**              requested on the command line
+*******************************************************************************/
+void TransformGeometry (geometry_struct *geometry) {
+  geometry->srid = TransformElements (
+    &transform_options, geometry->srid,
+    geometry->point != NULL ? &geometry->point->x : NULL,
+    geometry->point != NULL ? &geometry->point->y : NULL,
+    geometry->ordinates, geometry->n_ordinates,
+    geometry->gtype / 1000);
+}
+
 /*******************************************************************************
 ** Routine:     PrintGeometry
 **
@@ -580,6 +654,12 @@ void ReadGeometries (
     /* Import geometry from SDO_GEOMETRY OCI structure into C structure */
     geometry = LoadGeometry (geometry_obj, geometry_ind);
 
+    /* Change the coordinate system if requested */
+    TransformGeometry (geometry);
+
+    /* Reduce the number of points if requested */
+    SimplifyGeometry (geometry);
+
     /* Print the geometry just imported */
     PrintGeometry (geometry, rows_fetched, print_level);
 
@@ -597,6 +677,8 @@ void ReadGeometries (
       ReportError(errhp);
   }
   printf ("\n%d rows fetched\n", rows_fetched);
+  PrintSimplifyStatistics (&simplify_options);
+  PrintTransformStatistics (&transform_options);
 
   /* Free statement handle */
   status = OCIHandleFree(
@@ -617,8 +699,12 @@ int main(int argc, char **argv)
     char *username, *password, *database, *select_statement;
     int  print_level;
 
+    /* Take out the simplification and transformation options, wherever they are */
+    ParseSimplifyOptions (&argc, argv, &simplify_options);
+    ParseTransformOptions (&argc, argv, &transform_options);
+
     if( argc != 6) {
-      printf("USAGE: %s <username> <password> <database> <select_statement> <print_level>\n", argv[0]);
+      printf("USAGE: %s <username> <password> <database> <select_statement> <print_level> [--simplify=<tolerance>] [--simplify-method=DP|VW] [--to-srid=<srid>] [--from-srid=<srid>] [--transform-check]\n", argv[0]);
       exit( 1 );
     }
     else {
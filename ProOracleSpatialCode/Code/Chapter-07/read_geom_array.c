@@ -15,10 +15,18 @@
    - passing SQL statements from the command line
    - reading and decoding geometry objects
    - using array fetches
+   - reading geometries as WKB (well-known binary) BLOBs
+   - simplifying geometries on the client
+   - transforming coordinates on the client
+   - building a pyramid of vector tiles from the geometries
 
    The program takes the following command line arguments:
 
-     read_geom username password database select_statement print_level [array_size]
+     read_geom username password database select_statement print_level [array_size] [fetch_mode]
+       [--simplify=tolerance] [--simplify-method=DP|VW]
+       [--mvt=tile_file] [--mvt-zoom=min-max] [--mvt-layer=name]
+       [--mvt-tolerance=units] [--mvt-threads=n]
+       [--to-srid=srid] [--from-srid=srid] [--transform-check]
 
    where
 
@@ -30,6 +38,56 @@
      1 = print summary (type, number of elements, number of points)
      2 = print details (all elements and point details)
    - array_size = number of rows to read per fetch (default is 10 rows)
+   - fetch_mode = how geometries are transferred to the client
+     OBJECT = as SDO_GEOMETRY objects, decoded through the object cache (default)
+     WKB = as BLOBs produced by SDO_UTIL.TO_WKBGEOMETRY, decoded by the program
+   - tolerance = simplify lines and polygons before printing them, removing
+     the details smaller than this distance (in the units of the coordinates)
+   - DP|VW = simplification method: Douglas-Peucker (default) or Visvalingam
+   - tile_file = also build vector tiles of the geometries into this file
+   - min-max = range of zooms of the vector tiles (default is 0-12)
+   - name = name of the layer in the vector tiles (default is geometries)
+   - units = generalization tolerance of the vector tiles, in units of the
+     4096 x 4096 grid of a tile (default is 1, 0 for none)
+   - n = number of threads that build the vector tiles (default is one per
+     processor)
+   - --to-srid = transform the geometries to this coordinate system before
+     simplifying, printing and tiling them
+   - --from-srid = coordinate system of the geometries that have no SDO_SRID
+   - --transform-check = check the transformations against the control
+     points of the EPSG guidance note 7-2, and stop
+
+   Notes:
+
+   In WKB mode the select statement is wrapped as
+
+     SELECT SDO_UTIL.TO_WKBGEOMETRY(q.<column>), q.<column>.SDO_SRID FROM (select_statement) q
+
+   BLOBs of up to WKB_PREFETCH_SIZE bytes are returned with the rows they belong
+   to (LOB prefetching). Larger ones are read in pieces of WKB_PIECE_SIZE bytes.
+   Run the same query in both modes and compare the elapsed times to choose the
+   best mode for a given layer.
+
+   Simplification (see simplify.c, which must be linked with the program)
+   happens after the geometries are fetched: it reduces what the program
+   prints or exports, not what is transferred from the database. To also
+   reduce the transfer, simplify on the server with SDO_UTIL.SIMPLIFY in the
+   select statement.
+
+   Vector tiles (see vector_tiles.c, tile_render.c and spatial_util.c, which
+   must be linked with the program) are built once all geometries are fetched: they are
+   kept in memory until then. The tiles are in the Web Mercator scheme when
+   the geometries are in longitude and latitude (SRID 8307 or 4326), and
+   cover the extent of the geometries otherwise. Each feature has the row
+   number of its geometry as id. The program reports the number and size
+   of the tiles of each zoom, and how fast they were built.
+
+   Transformations (see coord_transform.c, which must be linked with the
+   program) are done as the geometries are decoded, in both fetch modes.
+   With --to-srid=8307, geometries of a projected coordinate system get
+   vector tiles in the Web Mercator scheme. Only the coordinate systems
+   listed in coord_transform.h are supported, without any change of datum:
+   the other geometries are kept as they are, and counted in the statistics.
 
 */
 #include <stdio.h>
@@ -38,9 +96,14 @@
 #include <time.h>
 #include <oci.h>
 #include "sdo_geometry.h"
+#include "simplify.h"
+#include "vector_tiles.h"
+#include "coord_transform.h"
 
 #define use_array_interface 0
 #define TRACE() {printf ("TRACE: %d\n", __LINE__);}
+#define WKB_PREFETCH_SIZE 4096
+#define WKB_PIECE_SIZE 65536
 
 /*******************************************************************************
 ** Global variables
@@ -52,6 +115,20 @@ OCIEnv       *envhp;  /* Environment handle*/
 OCIError     *errhp;  /* Error handle */
 OCISvcCtx    *svchp;  /* Service Context handle*/
 
+/* Simplification settings (--simplify option) */
+
+simplify_options_struct simplify_options;
+
+/* Transformation settings (--to-srid option) */
+
+transform_options_struct transform_options;
+
+/* Vector tile settings (--mvt options), and the geometries kept for them */
+
+vector_tile_options_struct vector_tile_options;
+render_layer_struct        vector_tile_layer;
+int                        vector_tile_srid = 0;
+
 /*******************************************************************************
 ** Types and structures
 *******************************************************************************/
@@ -68,6 +145,7 @@ struct geometry
     int gtype;
     int srid;
     struct point *point;
+    struct point point_data;  /* Storage for the point: no separate allocation */
     int n_elem_info;
     int *elem_info;
     int n_ordinates;
@@ -75,6 +153,25 @@ struct geometry
 };
 typedef struct geometry geometry_struct;
 
+/* Position in a WKB byte string being decoded */
+struct wkb_reader
+{
+    unsigned char *data;
+    long length;
+    long position;
+    int  error;
+};
+typedef struct wkb_reader wkb_reader_struct;
+
+/* Geometry being built from WKB, with the allocated size of its arrays */
+struct wkb_builder
+{
+    geometry_struct *geometry;
+    int max_elem_info;
+    int max_ordinates;
+};
+typedef struct wkb_builder wkb_builder_struct;
+
 /*******************************************************************************
 ** Routine:     ReportError
 **
@@ -98,6 +195,22 @@ void ReportError(OCIError *errhp)
   exit (1);
 }
 
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
 /*******************************************************************************
 ** Routine:     InitializeOCI
 **
@@ -255,8 +368,8 @@ geometry_struct *LoadGeometry (
   geometry->point = 0;
   if (geometry_object_ind->SDO_POINT._atomic == OCI_IND_NOTNULL) {
     x = y = z = 0;
-    /* Allocate space for point structure */
-    geometry->point = malloc (sizeof(point_struct));
+    /* The point structure is part of the geometry structure */
+    geometry->point = &geometry->point_data;
     /* Extract X */
     if (geometry_object_ind->SDO_POINT.X == OCI_IND_NOTNULL)
       OCINumberToReal(
@@ -275,6 +388,17 @@ geometry_struct *LoadGeometry (
     geometry->point->z = z;
   }
 
+  /* Point fast path: a point stored in SDO_POINT (as for gtypes 2001 and 3001)
+     has NULL arrays. The indicators say so: skip all collection calls */
+  if (geometry_object_ind->SDO_ELEM_INFO == OCI_IND_NULL &&
+      geometry_object_ind->SDO_ORDINATES == OCI_IND_NULL) {
+    geometry->n_elem_info = 0;
+    geometry->elem_info = NULL;
+    geometry->n_ordinates = 0;
+    geometry->ordinates = NULL;
+    return (geometry);
+  }
+
   /* Extract SDO_ELEM_INFO array */
 
   /* Get the size of the array */
@@ -377,6 +501,343 @@ geometry_struct *LoadGeometry (
   return (geometry);
 }
 
+/*******************************************************************************
+** Routine:     WkbReadUInt
+**
+** Description: Read a 4-byte unsigned integer in the given byte order
+*******************************************************************************/
+unsigned int WkbReadUInt (
+  wkb_reader_struct *reader,
+  int little_endian
+)
+{
+  unsigned char *p;
+  unsigned int  value;
+
+  if (reader->position + 4 > reader->length) {
+    reader->error = 1;
+    return 0;
+  }
+  p = reader->data + reader->position;
+  reader->position += 4;
+  if (little_endian)
+    value = (unsigned int)p[0] | (unsigned int)p[1] << 8 | (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24;
+  else
+    value = (unsigned int)p[3] | (unsigned int)p[2] << 8 | (unsigned int)p[1] << 16 | (unsigned int)p[0] << 24;
+  return value;
+}
+
+/*******************************************************************************
+** Routine:     WkbReadDoubles
+**
+** Description: Read a sequence of 8-byte IEEE doubles in the given byte order
+**              and append them to the ordinates of the geometry being built
+*******************************************************************************/
+void WkbReadDoubles (
+  wkb_reader_struct  *reader,
+  int                little_endian,
+  long               count,
+  wkb_builder_struct *builder
+)
+{
+  geometry_struct *geometry = builder->geometry;
+  static int host_little_endian = -1;
+  unsigned char *p;
+  unsigned char bytes[8];
+  double *ordinate;
+  long i;
+  int  j;
+
+  if (host_little_endian < 0) {
+    unsigned int one = 1;
+    host_little_endian = *(unsigned char *)&one == 1;
+  }
+  if (count < 0 || reader->position + 8 * count > reader->length) {
+    reader->error = 1;
+    return;
+  }
+
+  /* Make room for the new ordinates */
+  if (geometry->n_ordinates + count > builder->max_ordinates) {
+    while (geometry->n_ordinates + count > builder->max_ordinates)
+      builder->max_ordinates = builder->max_ordinates * 2;
+    geometry->ordinates = realloc (geometry->ordinates, sizeof(double)*builder->max_ordinates);
+  }
+
+  p = reader->data + reader->position;
+  ordinate = geometry->ordinates + geometry->n_ordinates;
+  if (little_endian == host_little_endian)
+    memcpy (ordinate, p, 8 * count);
+  else {
+    for (i=0; i<count; i++) {
+      for (j=0; j<8; j++)
+        bytes[j] = p[8*i + 7 - j];
+      memcpy (&ordinate[i], bytes, 8);
+    }
+  }
+  reader->position += 8 * count;
+  geometry->n_ordinates += count;
+}
+
+/*******************************************************************************
+** Routine:     WkbAddElement
+**
+** Description: Append an element descriptor triplet to the geometry being built
+*******************************************************************************/
+void WkbAddElement (
+  wkb_builder_struct *builder,
+  int offset,
+  int etype,
+  int interpretation
+)
+{
+  geometry_struct *geometry = builder->geometry;
+
+  if (geometry->n_elem_info + 3 > builder->max_elem_info) {
+    builder->max_elem_info = builder->max_elem_info * 2;
+    geometry->elem_info = realloc (geometry->elem_info, sizeof(int)*builder->max_elem_info);
+  }
+  geometry->elem_info[geometry->n_elem_info++] = offset;
+  geometry->elem_info[geometry->n_elem_info++] = etype;
+  geometry->elem_info[geometry->n_elem_info++] = interpretation;
+}
+
+/*******************************************************************************
+** Routine:     WkbDecode
+**
+** Description: Decode one WKB geometry (and its parts, recursively) into the
+**              elem_info and ordinates of the geometry being built.
+**              Returns the WKB type (1 to 7) and the number of dimensions.
+*******************************************************************************/
+int WkbDecode (
+  wkb_reader_struct  *reader,
+  wkb_builder_struct *builder,
+  int                in_multipoint,
+  int                *dim
+)
+{
+  geometry_struct *geometry = builder->geometry;
+  int          little_endian;
+  unsigned int wkb_type;
+  int          base_type;
+  int          part_dim;
+  unsigned int n_parts, n_points;
+  unsigned int i;
+  int          offset;
+
+  if (reader->position >= reader->length) {
+    reader->error = 1;
+    return 0;
+  }
+  little_endian = reader->data[reader->position++] == 1;
+  wkb_type = WkbReadUInt (reader, little_endian);
+
+  /* Work out the number of dimensions: from the high flag bits (extended WKB)
+     or from the thousands (ISO WKB: 1000 = Z, 2000 = M, 3000 = ZM) */
+  *dim = 2;
+  if (wkb_type & 0x80000000)
+    (*dim)++;
+  if (wkb_type & 0x40000000)
+    (*dim)++;
+  wkb_type = wkb_type & 0x0FFFFFFF;
+  *dim = *dim + (wkb_type / 1000 == 3 ? 2 : wkb_type / 1000 > 0 ? 1 : 0);
+  base_type = wkb_type % 1000;
+
+  offset = geometry->n_ordinates + 1;
+  switch (base_type) {
+    case 1:
+      /* Point */
+      if (!in_multipoint)
+        WkbAddElement (builder, offset, 1, 1);
+      WkbReadDoubles (reader, little_endian, *dim, builder);
+      break;
+    case 2:
+      /* Line string */
+      n_points = WkbReadUInt (reader, little_endian);
+      WkbAddElement (builder, offset, 2, 1);
+      WkbReadDoubles (reader, little_endian, (long)n_points * *dim, builder);
+      break;
+    case 3:
+      /* Polygon: the first ring is the exterior ring, the others are holes */
+      n_parts = WkbReadUInt (reader, little_endian);
+      for (i=0; i<n_parts && !reader->error; i++) {
+        n_points = WkbReadUInt (reader, little_endian);
+        WkbAddElement (builder, geometry->n_ordinates + 1, i == 0 ? 1003 : 2003, 1);
+        WkbReadDoubles (reader, little_endian, (long)n_points * *dim, builder);
+      }
+      break;
+    case 4:
+      /* Multi-point: one point cluster element */
+      n_parts = WkbReadUInt (reader, little_endian);
+      WkbAddElement (builder, offset, 1, n_parts);
+      for (i=0; i<n_parts && !reader->error; i++)
+        WkbDecode (reader, builder, 1, &part_dim);
+      break;
+    case 5:
+    case 6:
+    case 7:
+      /* Multi-line string, multi-polygon, collection: one or more elements per part */
+      n_parts = WkbReadUInt (reader, little_endian);
+      for (i=0; i<n_parts && !reader->error; i++)
+        WkbDecode (reader, builder, 0, &part_dim);
+      break;
+    default:
+      reader->error = 1;
+  }
+  return base_type;
+}
+
+/*******************************************************************************
+** Routine:     LoadGeometryFromWkb
+**
+** Description: Load a geometry from its WKB representation into a C memory
+**              structure.
+*******************************************************************************/
+geometry_struct *LoadGeometryFromWkb (
+  unsigned char *wkb,
+  long          wkb_length,
+  int           srid
+)
+{
+  /* SDO_GTYPE type for each WKB type */
+  static int sdo_type[8] = {0, 1, 2, 3, 5, 6, 7, 4};
+  geometry_struct    *geometry;
+  wkb_reader_struct  reader;
+  wkb_builder_struct builder;
+  int                wkb_type;
+  int                dim;
+
+  reader.data = wkb;
+  reader.length = wkb_length;
+  reader.position = 0;
+  reader.error = 0;
+
+  /* Allocate geometry structure */
+  geometry = malloc (sizeof(geometry_struct));
+  geometry->srid = srid;
+  geometry->point = NULL;
+  geometry->n_elem_info = 0;
+  geometry->n_ordinates = 0;
+  builder.geometry = geometry;
+  builder.max_elem_info = 3;
+  builder.max_ordinates = 64;
+  geometry->elem_info = malloc (sizeof(int)*builder.max_elem_info);
+  geometry->ordinates = malloc (sizeof(double)*builder.max_ordinates);
+
+  wkb_type = WkbDecode (&reader, &builder, 0, &dim);
+  if (reader.error) {
+    printf ("Invalid WKB geometry (%ld bytes)\n", wkb_length);
+    exit (1);
+  }
+  geometry->gtype = dim * 1000 + sdo_type[wkb_type];
+
+  /* A single point goes into the point structure, as in SDO_POINT */
+  if (wkb_type == 1) {
+    geometry->point = &geometry->point_data;
+    geometry->point->x = geometry->ordinates[0];
+    geometry->point->y = geometry->ordinates[1];
+    geometry->point->z = dim > 2 ? geometry->ordinates[2] : 0;
+    geometry->n_elem_info = 0;
+    geometry->n_ordinates = 0;
+  }
+
+  /* Empty arrays are represented by NULL pointers */
+  if (geometry->n_elem_info == 0) {
+    free (geometry->elem_info);
+    geometry->elem_info = NULL;
+  }
+  if (geometry->n_ordinates == 0) {
+    free (geometry->ordinates);
+    geometry->ordinates = NULL;
+  }
+  return (geometry);
+}
+
+/*******************************************************************************
+** Routine:     ReadWkbLob
+**
+** Description: Read the content of a WKB BLOB into a buffer that grows as
+**              needed and is reused from one call to the next. Small BLOBs are
+**              served from the LOB prefetch cache in a single call; larger
+**              ones are streamed piece by piece. Returns the number of bytes.
+*******************************************************************************/
+long ReadWkbLob (
+  OCILobLocator *lob_locator,
+  unsigned char **buffer,
+  long          *buffer_size
+)
+{
+  oraub8 lob_length;
+  oraub8 byte_amount;
+  oraub8 bytes_read;
+  ub1    piece;
+  sword  status;
+
+  /* The length is prefetched with the locator: no round trip */
+  status = OCILobGetLength2(svchp, errhp, lob_locator, &lob_length);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Make sure the buffer can hold the whole BLOB */
+  if ((long)lob_length > *buffer_size) {
+    *buffer_size = (long)lob_length;
+    *buffer = realloc (*buffer, *buffer_size);
+  }
+  if (lob_length == 0)
+    return 0;
+
+  if (lob_length <= WKB_PREFETCH_SIZE) {
+    /* Read everything at once: the data came with the row */
+    byte_amount = lob_length;
+    status = OCILobRead2(
+      svchp,                         /* (in)  Service Context Handle */
+      errhp,                         /* (in)  Error Handle */
+      lob_locator,                   /* (in)  LOB locator */
+      &byte_amount,                  /* (i/o) Number of bytes to read / read */
+      (oraub8 *)0,                   /* (i/o) Number of characters (NOT USED) */
+      (oraub8)1,                     /* (in)  Offset of first byte (1-based) */
+      (dvoid *)*buffer,              /* (in)  Buffer */
+      lob_length,                    /* (in)  Buffer size */
+      OCI_ONE_PIECE,                 /* (in)  Piece: all in one go */
+      (dvoid *)0,                    /* (in)  Callback context (NOT USED) */
+      0,                             /* (in)  Callback function (NOT USED) */
+      (ub2)0,                        /* (in)  Character set (NOT USED) */
+      (ub1)SQLCS_IMPLICIT);          /* (in)  Character set form */
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+    return (long)byte_amount;
+  }
+
+  /* Stream the BLOB in pieces of WKB_PIECE_SIZE bytes (polling mode) */
+  bytes_read = 0;
+  piece = OCI_FIRST_PIECE;
+  do {
+    byte_amount = 0;                 /* 0 = read up to the end of the LOB */
+    status = OCILobRead2(
+      svchp,                         /* (in)  Service Context Handle */
+      errhp,                         /* (in)  Error Handle */
+      lob_locator,                   /* (in)  LOB locator */
+      &byte_amount,                  /* (i/o) Number of bytes to read / read */
+      (oraub8 *)0,                   /* (i/o) Number of characters (NOT USED) */
+      (oraub8)1,                     /* (in)  Offset of first byte (1-based) */
+      (dvoid *)(*buffer + bytes_read), /* (in)  Buffer for this piece */
+      (oraub8)(lob_length - bytes_read < WKB_PIECE_SIZE ?
+        lob_length - bytes_read : WKB_PIECE_SIZE), /* (in)  Piece size */
+      piece,                         /* (in)  Piece: first or next */
+      (dvoid *)0,                    /* (in)  Callback context (NOT USED) */
+      0,                             /* (in)  Callback function (NOT USED) */
+      (ub2)0,                        /* (in)  Character set (NOT USED) */
+      (ub1)SQLCS_IMPLICIT);          /* (in)  Character set form */
+    if (status != OCI_SUCCESS && status != OCI_NEED_DATA)
+      ReportError(errhp);
+    bytes_read += byte_amount;
+    piece = OCI_NEXT_PIECE;
+  }
+  while (status == OCI_NEED_DATA);
+
+  return (long)bytes_read;
+}
+
 /*******************************************************************************
 ** Routine:     FreeGeometry
 **
@@ -384,9 +845,7 @@ geometry_struct *LoadGeometry (
 *******************************************************************************/
 void FreeGeometry (geometry_struct *geometry) {
   if (geometry != 0) {
-    /* Free memory used for the point structure */
-    if (geometry->point != NULL)
-      free (geometry->point);
+    /* The point structure is part of the geometry structure: nothing to free */
     /* Free memory used for the elem_info vector */
     if (geometry->elem_info != 0)
       free (geometry->elem_info);
@@ -398,6 +857,74 @@ void FreeGeometry (geometry_struct *geometry) {
   }
 }
 
+/*******************************************************************************
+** Routine:     SimplifyGeometry
+**
+** Description: Simplify the lines and polygons of a geometry, if requested
+**              on the command line
+*******************************************************************************/
+void SimplifyGeometry (geometry_struct *geometry) {
+  if (geometry->n_elem_info > 0)
+    geometry->n_ordinates = SimplifyElements (
+      geometry->elem_info, geometry->n_elem_info,
+      geometry->ordinates, geometry->n_ordinates,
+      geometry->gtype / 1000, &simplify_options);
+}
+
+/*******************************************************************************
+** Routine:     TransformGeometry
+**
+** Description: Transform the point and ordinates of a geometry to the SRID
+**              requested on the command line
+*******************************************************************************/
+void TransformGeometry (geometry_struct *geometry) {
+  geometry->srid = TransformElements (
+    &transform_options, geometry->srid,
+    geometry->point != NULL ? &geometry->point->x : NULL,
+    geometry->point != NULL ? &geometry->point->y : NULL,
+    geometry->ordinates, geometry->n_ordinates,
+    geometry->gtype / 1000);
+}
+
+/*******************************************************************************
+** Routine:     KeepTileGeometry
+**
+** Description: Keep a copy of a geometry for the vector tiles, if requested
+**              on the command line
+*******************************************************************************/
+void KeepTileGeometry (geometry_struct *geometry, int row_number) {
+  if (vector_tile_options.filename == NULL)
+    return;
+  if (vector_tile_srid == 0)
+    vector_tile_srid = geometry->srid;
+  AddRenderGeometry (&vector_tile_layer, (double) row_number, geometry->gtype,
+    geometry->point != NULL,
+    geometry->point != NULL ? geometry->point->x : 0,
+    geometry->point != NULL ? geometry->point->y : 0,
+    geometry->elem_info, geometry->n_elem_info,
+    geometry->ordinates, geometry->n_ordinates);
+}
+
+/*******************************************************************************
+** Routine:     BuildTiles
+**
+** Description: Build the vector tiles of the geometries kept, if requested
+**              on the command line
+*******************************************************************************/
+void BuildTiles (void) {
+  vector_tile_result_struct result;
+
+  if (vector_tile_options.filename == NULL)
+    return;
+  ProjectRenderLayer (&vector_tile_layer,
+    vector_tile_srid == 8307 || vector_tile_srid == 4326 ? RENDER_MERCATOR : RENDER_EXTENT);
+  if (BuildVectorTiles (&vector_tile_layer, &vector_tile_options, &result) != 0)
+    printf ("Unable to write vector tiles to %s\n", vector_tile_options.filename);
+  else
+    PrintVectorTileStatistics (&vector_tile_options, &result);
+  FreeRenderLayer (&vector_tile_layer);
+}
+
 /*******************************************************************************
 ** Routine:     PrintGeometry
 **
@@ -489,6 +1016,8 @@ void ReadGeometries (
   OCIStmt   *select_stmthp;          /* Statement handle */
   sword     status;                  /* OCI call return status */
   int       i, j, k;
+  double    decode_start;
+  double    decode_time = 0;         /* Time spent decoding geometries */
 
   /* Define handles for host variables */
   OCIDefine         *geometry_hp;
@@ -501,6 +1030,7 @@ void ReadGeometries (
   SDO_GEOMETRY_ind  *geometry_ind[array_size];
 
   geometry_struct   *geometry;
+  geometry_struct   *geometries[array_size];
 
   /* Construct the select statement */
   printf ("Executing query:\nSQL> %s\n", select_statement);
@@ -613,16 +1143,31 @@ void ReadGeometries (
 
     nr_fetches++;
 
+    /* Import the geometries of the batch from SDO_GEOMETRY OCI structures into
+       C structures. The whole batch is timed at once, so that the clock is not
+       read for every row */
+    decode_start = ElapsedSeconds ();
+    for (i=0; i<rows_in_batch; i++)
+      geometries[i] = LoadGeometry (geometry_obj[i], geometry_ind[i]);
+    decode_time += ElapsedSeconds () - decode_start;
+
     /* Display results just fetched */
     for (i=0; i<rows_in_batch; i++) {
       rows_fetched++;
+      geometry = geometries[i];
 
-      /* Import geometry from SDO_GEOMETRY OCI structure into C structure */
-      geometry = LoadGeometry (geometry_obj[i], geometry_ind[i]);
+      /* Change the coordinate system if requested */
+      TransformGeometry (geometry);
+
+      /* Reduce the number of points if requested */
+      SimplifyGeometry (geometry);
 
       /* Print the geometry just imported */
       PrintGeometry (geometry, rows_fetched, print_level);
 
+      /* Keep it for the vector tiles */
+      KeepTileGeometry (geometry, rows_fetched);
+
       /* Release memory used for the geometry structure */
       FreeGeometry (geometry);
     }
@@ -642,6 +1187,285 @@ void ReadGeometries (
   while (has_more_data);
 
   printf ("\n%d rows fetched in %d fetches\n", rows_fetched, nr_fetches);
+  if (rows_fetched > 0)
+    printf ("Decoding time: %.3f seconds (%.3f microseconds per row)\n",
+      decode_time, decode_time * 1e6 / rows_fetched);
+  PrintSimplifyStatistics (&simplify_options);
+  PrintTransformStatistics (&transform_options);
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+}
+
+/*******************************************************************************
+** Routine:     ReadGeometriesAsWkb
+**
+** Description: Read all geometries returned by the select statement provided,
+**              transferring them as WKB BLOBs instead of SDO_GEOMETRY objects
+*******************************************************************************/
+void ReadGeometriesAsWkb (
+  char *select_statement,
+  int  print_level,
+  int  array_size)
+{
+  int       rows_fetched = 0;        /* Row counter */
+  int       nr_fetches = 0;          /* Number of batches fetched */
+  int       rows_in_batch = 0;       /* Number of rows in current batch */
+  long      wkb_bytes = 0;           /* Total size of WKB data read */
+  boolean   has_more_data;
+  char      *wkb_statement;          /* Wrapping SQL statement */
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  OCIParam  *column_param;           /* Description of the geometry column */
+  OCISession *session_hp;            /* Session handle */
+  text      *column_name;
+  ub4       column_name_length;
+  ub4       prefetch_size = WKB_PREFETCH_SIZE;
+  sword     status;                  /* OCI call return status */
+  int       i;
+
+  /* Define handles for host variables */
+  OCIDefine         *wkb_hp;
+  OCIDefine         *srid_hp;
+
+  /* Host variables */
+  OCILobLocator     *wkb_lob[array_size];
+  sb2               wkb_ind[array_size];
+  int               srid[array_size];
+  sb2               srid_ind[array_size];
+
+  /* Buffer receiving the content of one BLOB, reused for all rows */
+  unsigned char     *wkb_buffer = NULL;
+  long              wkb_buffer_size = 0;
+  long              wkb_length;
+
+  geometry_struct   *geometry;
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Describe the select statement to find the name of the geometry column */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_statement,        /* (in)  SQL statement */
+    (ub4)strlen(select_statement),   /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)0,                          /* (in)  Number of rows to fetch: none */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DESCRIBE_ONLY);         /* (in)  Operating mode: describe only */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+  status = OCIParamGet(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    errhp,                           /* (in)  Error Handle */
+    (dvoid **)&column_param,         /* (out) Column description */
+    (ub4)1);                         /* (in)  Column position */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+  status = OCIAttrGet(
+    (dvoid *)column_param,           /* (in)  Column description */
+    (ub4)OCI_DTYPE_PARAM,            /* (in)  Descriptor type */
+    (dvoid *)&column_name,           /* (out) Column name */
+    (ub4 *)&column_name_length,      /* (out) Column name length */
+    (ub4)OCI_ATTR_NAME,              /* (in)  Attribute: name */
+    errhp);                          /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Construct the wrapping select statement */
+  wkb_statement = malloc (strlen(select_statement) + 2 * column_name_length + 128);
+  sprintf (wkb_statement,
+    "SELECT SDO_UTIL.TO_WKBGEOMETRY(q.\"%.*s\"), q.\"%.*s\".SDO_SRID FROM (%s) q",
+    (int)column_name_length, column_name, (int)column_name_length, column_name, select_statement);
+  printf ("Executing query:\nSQL> %s\n", wkb_statement);
+  printf ("Array size: %d\n\n", array_size);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)wkb_statement,           /* (in)  SQL statement */
+    (ub4)strlen(wkb_statement),      /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Have small BLOBs returned with the rows, together with their length */
+  status = OCIAttrGet(
+    (dvoid *)svchp,                  /* (in)  Service Context Handle */
+    (ub4)OCI_HTYPE_SVCCTX,           /* (in)  Handle type */
+    (dvoid *)&session_hp,            /* (out) Session Handle */
+    (ub4 *)0,                        /* (out) Size (NOT USED) */
+    (ub4)OCI_ATTR_SESSION,           /* (in)  Attribute: session */
+    errhp);                          /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+  status = OCIAttrSet(
+    (dvoid *)session_hp,             /* (in)  Session Handle */
+    (ub4)OCI_HTYPE_SESSION,          /* (in)  Handle type */
+    (dvoid *)&prefetch_size,         /* (in)  Number of bytes to prefetch */
+    (ub4)0,                          /* (in)  Size (NOT USED) */
+    (ub4)OCI_ATTR_DEFAULT_LOBPREFETCH_SIZE, /* (in)  Attribute: LOB prefetch size */
+    errhp);                          /* (in)  Error Handle */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Allocate the LOB locators that receive the BLOBs */
+  for (i=0; i<array_size; i++) {
+    status = OCIDescriptorAlloc(
+      (dvoid *)envhp,                /* (in)  Environment Handle */
+      (dvoid **)&wkb_lob[i],         /* (out) LOB locator */
+      (ub4)OCI_DTYPE_LOB,            /* (in)  Descriptor type */
+      (size_t)0,                     /* (in)  Size of extra user memory (NOT USED) */
+      (dvoid **)0);                  /* (out) Pointer to user memory (NOT USED) */
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+
+  /* Define the variables to receive the selected columns */
+
+  /* Variable 1 = WKB (BLOB) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &wkb_hp,                         /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Bind variable position */
+    (dvoid *)wkb_lob,                /* (in)  Value Pointer */
+    sizeof(OCILobLocator *),         /* (in)  Value Size */
+    SQLT_BLOB,                       /* (in)  Data Type */
+    (dvoid *)wkb_ind,                /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 2 = SRID (integer) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &srid_hp,                        /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)2,                          /* (in)  Bind variable position */
+    (dvoid *)srid,                   /* (in)  Value Pointer */
+    sizeof(int),                     /* (in)  Value Size */
+    SQLT_INT,                        /* (in)  Data Type */
+    (dvoid *)srid_ind,               /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch first batch of rows of result set */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)array_size,                 /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+
+  has_more_data = TRUE;
+  do
+  {
+    /* Check if this is the last (or only) batch */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)select_stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      errhp);
+
+    nr_fetches++;
+
+    /* Display results just fetched */
+    for (i=0; i<rows_in_batch; i++) {
+      rows_fetched++;
+
+      /* Skip NULL geometries */
+      if (wkb_ind[i] != OCI_IND_NOTNULL)
+        continue;
+
+      /* Read the WKB and decode it into the C structure */
+      wkb_length = ReadWkbLob (wkb_lob[i], &wkb_buffer, &wkb_buffer_size);
+      wkb_bytes += wkb_length;
+      geometry = LoadGeometryFromWkb (wkb_buffer, wkb_length,
+        srid_ind[i] == OCI_IND_NOTNULL ? srid[i] : 0);
+
+      /* Change the coordinate system if requested */
+      TransformGeometry (geometry);
+
+      /* Reduce the number of points if requested */
+      SimplifyGeometry (geometry);
+
+      /* Print the geometry just imported */
+      PrintGeometry (geometry, rows_fetched, print_level);
+
+      /* Keep it for the vector tiles */
+      KeepTileGeometry (geometry, rows_fetched);
+
+      /* Release memory used for the geometry structure */
+      FreeGeometry (geometry);
+    }
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        select_stmthp,                 /* (in)  Statement Handle */
+        errhp,                         /* (in)  Error Handle */
+        (ub4)array_size,               /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(errhp);
+    }
+  }
+  while (has_more_data);
+
+  printf ("\n%d rows fetched in %d fetches\n", rows_fetched, nr_fetches);
+  PrintSimplifyStatistics (&simplify_options);
+  PrintTransformStatistics (&transform_options);
+  printf ("%ld bytes of WKB read\n", wkb_bytes);
+
+  /* Free LOB locators and buffers */
+  for (i=0; i<array_size; i++)
+    OCIDescriptorFree((dvoid *)wkb_lob[i], (ub4)OCI_DTYPE_LOB);
+  free (wkb_buffer);
+  free (wkb_statement);
 
   /* Free statement handle */
   status = OCIHandleFree(
@@ -659,12 +1483,19 @@ void ReadGeometries (
 *******************************************************************************/
 int main(int argc, char **argv)
 {
-    char *username, *password, *database, *select_statement;
+    char *username, *password, *database, *select_statement, *fetch_mode;
     int  print_level, array_size;
-    clock_t  start_time, end_time;
+    double   start_time, end_time;
 
-    if( argc < 6 || argc > 7) {
-      printf("USAGE: %s <username> <password> <database> <select_statement> <print_level> [<array_size>]\n", argv[0]);
+    /* Take out the simplification, vector tile and transformation options,
+       wherever they are */
+    ParseSimplifyOptions (&argc, argv, &simplify_options);
+    ParseTransformOptions (&argc, argv, &transform_options);
+    ParseVectorTileOptions (&argc, argv, &vector_tile_options);
+    InitRenderLayer (&vector_tile_layer);
+
+    if( argc < 6 || argc > 8) {
+      printf("USAGE: %s <username> <password> <database> <select_statement> <print_level> [<array_size>] [OBJECT|WKB] [--simplify=<tolerance>] [--simplify-method=DP|VW] [--mvt=<tile_file>] [--mvt-zoom=<min>-<max>] [--mvt-layer=<name>] [--mvt-tolerance=<units>] [--mvt-threads=<n>] [--to-srid=<srid>] [--from-srid=<srid>] [--transform-check]\n", argv[0]);
       exit( 1 );
     }
     else {
@@ -681,9 +1512,17 @@ int main(int argc, char **argv)
         printf ("Invalid array size: must be positive\n");
         exit( 1 );
       }
+      if (argc > 7)
+        fetch_mode = argv[7];
+      else
+        fetch_mode = "OBJECT";
+      if (strcmp (fetch_mode, "OBJECT") != 0 && strcmp (fetch_mode, "WKB") != 0) {
+        printf ("Invalid fetch mode: must be OBJECT or WKB\n");
+        exit( 1 );
+      }
     }
 
-    start_time = clock();
+    start_time = ElapsedSeconds();
 
     /* Set up OCI environment */
     InitializeOCI();
@@ -692,14 +1531,20 @@ int main(int argc, char **argv)
     ConnectDatabase(username, password, database);
 
     /* Fetch and process the records */
-    ReadGeometries(select_statement, print_level, array_size);
+    if (strcmp (fetch_mode, "WKB") == 0)
+      ReadGeometriesAsWkb(select_statement, print_level, array_size);
+    else
+      ReadGeometries(select_statement, print_level, array_size);
 
     /* disconnect from database */
     DisconnectDatabase();
 
+    /* Build the vector tiles of what was fetched */
+    BuildTiles();
+
     /* Teardown  OCI environment */
     ClearOCI();
 
-    end_time = clock();
-    printf("Elapsed time: %.3f seconds\n", (double) (end_time - start_time)/CLOCKS_PER_SEC);
+    end_time = ElapsedSeconds();
+    printf("Elapsed time: %.3f seconds\n", end_time - start_time);
 }
@@ -0,0 +1,68 @@
+/* read_point_dump.c
+
+   This program reads a point dump file written by read_points_array.c and
+   prints out its header and its first points.
+
+   It illustrates the following concepts:
+   - mapping a point dump in memory with the point_dump.c reader
+
+   The program takes the following command line arguments:
+
+     read_point_dump filename [n_points]
+
+   where
+
+   - filename = name of the point dump file
+   - n_points = number of points to print out (default is 10 points)
+
+   Notes:
+
+   The program must be linked with point_dump.c. It does not connect to the
+   database.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "point_dump.h"
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    point_dump_struct dump;
+    long n_points, i;
+
+    if( argc < 2 || argc > 3) {
+      printf("USAGE: %s <filename> [<n_points>]\n", argv[0]);
+      exit( 1 );
+    }
+    if (argc > 2)
+      n_points = atol(argv[2]);
+    else
+      n_points = 10;
+
+    /* Map the dump: the arrays are ready to use */
+    if (OpenPointDump (argv[1], &dump) != 0)
+      exit( 1 );
+
+    printf ("Points: %ld\n", (long)dump.count);
+    printf ("Spatial reference system: %d\n", dump.srid);
+    printf ("Extent: (%f, %f) (%f, %f)\n", dump.min_x, dump.min_y, dump.max_x, dump.max_y);
+    printf ("Identifiers: %s\n\n", dump.id != NULL ? "yes" : "no");
+
+    if (n_points > dump.count)
+      n_points = (long)dump.count;
+    for (i=0; i<n_points; i++) {
+      if (dump.id != NULL)
+        printf ("%ld: %ld (%f, %f)\n", i+1, (long)dump.id[i], dump.x[i], dump.y[i]);
+      else
+        printf ("%ld: (%f, %f)\n", i+1, dump.x[i], dump.y[i]);
+    }
+
+    ClosePointDump (&dump);
+    return 0;
+}
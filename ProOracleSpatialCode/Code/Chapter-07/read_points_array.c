@@ -5,20 +5,30 @@
    It reads the points without using object types, i.e by extracting
    the X and Y values of each point, using the following syntax:
 
-   SELECT C.geo_column.SDO_POINT.X, C.geo_column.SDO_POINT.Y
+   SELECT TO_BINARY_DOUBLE(C.geo_column.SDO_POINT.X),
+          TO_BINARY_DOUBLE(C.geo_column.SDO_POINT.Y)
      FROM tablename C
 
    It is identical to read_points.c except that it fetches multiple rows
-   at a time (array fetches).
+   at a time (array fetches), and that the coordinates are transferred as
+   binary doubles instead of Oracle NUMBERs, which saves their conversion.
+
+   Each batch of points is passed, as two arrays of X and Y values, to a
+   consumer routine. Depending on the arguments, the program uses a
+   consumer that prints out the points, one that only computes the extent of
+   the points (useful to measure the raw fetch speed), or one that writes the
+   points to a packed binary dump file (see point_dump.h).
 
    It illustrates the following concepts:
    - dynamically constructing SQL statements
    - reading point details without using objects
    - using array fetches
+   - fetching binary doubles
 
    The program takes the following command line arguments:
 
-     read_points username password database tablename geo_column [array_size]
+     read_points username password database tablename geo_column [array_size] [print_points] [id_column]
+       [--dump=filename]
 
    where
 
@@ -28,13 +38,59 @@
    - tablename = name of points table to select from
    - geo_column = name of the geometry column to read
    - array_size = number of rows to read per fetch (default is 10 rows)
+   - print_points = what to do with the points
+     1 = print them out (default)
+     0 = only count them and compute their extent
+   - id_column = name of a numeric column to print or dump with the points
+   - filename = write the points to this point dump file instead of printing
+     them or computing their extent
+
+   Notes:
+
+   The X and Y arrays are allocated on the heap, so that large array sizes
+   (100000 rows or more) can be used. On Linux they are backed by huge pages
+   when the system provides them, which reduces TLB misses on large arrays.
+
+   The program must be linked with point_dump.c. The SRID written to a dump is
+   the one registered for the column in USER_SDO_GEOM_METADATA.
 
 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <oci.h>
+#ifdef __linux__
+#include <errno.h>
+#include <sys/mman.h>
+#endif
+#include "point_dump.h"
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* Consumer of a batch of points: receives the X and Y values of n_points points,
+   and their identifiers if an id column is read (NULL otherwise) */
+typedef void (*point_consumer) (double *x, double *y, long *id, int n_points, void *context);
+
+/* Extent of the points seen by the extent consumer */
+struct point_extent
+{
+    long   n_points;
+    double min_x, min_y;
+    double max_x, max_y;
+};
+typedef struct point_extent point_extent_struct;
+
+/* An array of doubles allocated by AllocatePointArray */
+struct point_array
+{
+    double *values;
+    size_t mapped_size;               /* Length of the mapping, 0 if from malloc */
+};
+typedef struct point_array point_array_struct;
 
 /*******************************************************************************
 ** Global variables
@@ -69,6 +125,22 @@ void ReportError(OCIError *errhp)
   exit (1);
 }
 
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
 /*******************************************************************************
 ** Routine:     InitializeOCI
 **
@@ -170,35 +242,349 @@ void ClearOCI(void)
   OCITerminate (OCI_DEFAULT);
 }
 
+#ifdef __linux__
 /*******************************************************************************
-** Routine:     ReadPoints
+** Routine:     HugePageSize
 **
-** Description: Read all points
+** Description: Size of the default huge pages, from /proc/meminfo (2 MB if it
+**              is not given there)
 *******************************************************************************/
-void ReadPoints (
+size_t HugePageSize (void)
+{
+  FILE *meminfo;
+  char line[256];
+  unsigned long kilobytes = 2048;
+
+  meminfo = fopen ("/proc/meminfo", "r");
+  if (meminfo != NULL) {
+    while (fgets (line, sizeof(line), meminfo) != NULL)
+      if (sscanf (line, "Hugepagesize: %lu kB", &kilobytes) == 1)
+        break;
+    fclose (meminfo);
+  }
+  return (size_t) kilobytes * 1024;
+}
+#endif
+
+/*******************************************************************************
+** Routine:     AllocatePointArray
+**
+** Description: Allocate a large array of doubles, backed by huge pages where
+**              the system supports it. Returns the values of the array.
+*******************************************************************************/
+double *AllocatePointArray (
+  point_array_struct *array,
+  size_t             n_elements)
+{
+  size_t size = n_elements * sizeof(double);
+#ifdef __linux__
+  size_t huge_page_size;
+#endif
+
+  array->values = NULL;
+  array->mapped_size = 0;
+#ifdef __linux__
+#ifdef MAP_HUGETLB
+  /* Explicit huge pages, if some are reserved. The length is a whole
+     number of huge pages, as munmap needs the same length */
+  huge_page_size = HugePageSize ();
+  array->mapped_size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+  array->values = mmap (NULL, array->mapped_size, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (array->values == MAP_FAILED)
+    array->values = NULL;
+#endif
+  if (array->values == NULL) {
+    /* Regular pages, promoted to transparent huge pages when possible */
+    array->mapped_size = size;
+    array->values = mmap (NULL, size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (array->values == MAP_FAILED)
+      array->values = NULL;
+#ifdef MADV_HUGEPAGE
+    else
+      madvise (array->values, size, MADV_HUGEPAGE);
+#endif
+  }
+#else
+  array->values = malloc (size);
+#endif
+  if (array->values == NULL) {
+    printf ("Could not allocate %lu doubles\n", (unsigned long)n_elements);
+    exit (1);
+  }
+  return array->values;
+}
+
+/*******************************************************************************
+** Routine:     FreePointArray
+**
+** Description: Free an array allocated with AllocatePointArray
+*******************************************************************************/
+void FreePointArray (
+  point_array_struct *array)
+{
+#ifdef __linux__
+  if (munmap (array->values, array->mapped_size) != 0)
+    printf ("Could not unmap %lu bytes: %s\n", (unsigned long)array->mapped_size, strerror (errno));
+#else
+  free (array->values);
+#endif
+  array->values = NULL;
+}
+
+/*******************************************************************************
+** Routine:     PrintPoints
+**
+** Description: Point consumer that prints out each point
+*******************************************************************************/
+void PrintPoints (
+  double *x,
+  double *y,
+  long   *id,
+  int    n_points,
+  void   *context)
+{
+  long *rows_printed = (long *) context;
+  int  i;
+
+  for (i=0; i<n_points; i++) {
+    (*rows_printed)++;
+    if (id != NULL)
+      printf ("%ld: %ld (%f, %f)\n", *rows_printed, id[i], x[i], y[i]);
+    else
+      printf ("%ld: (%f, %f)\n", *rows_printed, x[i], y[i]);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ComputeExtent
+**
+** Description: Point consumer that computes the extent of the points
+*******************************************************************************/
+void ComputeExtent (
+  double *x,
+  double *y,
+  long   *id,
+  int    n_points,
+  void   *context)
+{
+  point_extent_struct *extent = (point_extent_struct *) context;
+  double min_x = extent->min_x, min_y = extent->min_y;
+  double max_x = extent->max_x, max_y = extent->max_y;
+  int    i;
+
+  (void) id;                          /* The ids play no part in the extent */
+
+  /* Simple loops over contiguous arrays: the compiler vectorizes them */
+  for (i=0; i<n_points; i++) {
+    min_x = x[i] < min_x ? x[i] : min_x;
+    max_x = x[i] > max_x ? x[i] : max_x;
+  }
+  for (i=0; i<n_points; i++) {
+    min_y = y[i] < min_y ? y[i] : min_y;
+    max_y = y[i] > max_y ? y[i] : max_y;
+  }
+  extent->min_x = min_x;
+  extent->min_y = min_y;
+  extent->max_x = max_x;
+  extent->max_y = max_y;
+  extent->n_points += n_points;
+}
+
+/*******************************************************************************
+** Routine:     DumpPoints
+**
+** Description: Point consumer that writes the points to a point dump file
+*******************************************************************************/
+void DumpPoints (
+  double *x,
+  double *y,
+  long   *id,
+  int    n_points,
+  void   *context)
+{
+  WritePointDump ((point_dump_writer_struct *) context, x, y, id, n_points);
+}
+
+/*******************************************************************************
+** Routine:     GetSrid
+**
+** Description: Get the SRID of a geometry column from USER_SDO_GEOM_METADATA
+**              (0 if the column is not registered or has no SRID)
+*******************************************************************************/
+int GetSrid (
   char *tablename,
-  char *geocolumn,
-  int  array_size)
+  char *geocolumn)
 {
-  int       rows_fetched = 0;        /* Row counter */
+  char      *select_sql =
+    "SELECT srid FROM user_sdo_geom_metadata "
+    "WHERE table_name = UPPER(:table_name) AND column_name = UPPER(:column_name)";
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  OCIBind   *table_name_hp = NULL;
+  OCIBind   *column_name_hp = NULL;
+  OCIDefine *srid_hp;
+  int       srid = 0;
+  sb2       srid_ind = OCI_IND_NULL;
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* TABLE_NAME (string) */
+  status = OCIBindByName(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &table_name_hp,                  /* (out) Bind Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *) ":TABLE_NAME",          /* (in)  Placeholder */
+    strlen(":TABLE_NAME"),           /* (in)  Placeholder length */
+    (ub1 *) tablename,               /* (in)  Value Pointer */
+    strlen(tablename)+1,             /* (in)  Value Size */
+    SQLT_STR,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* COLUMN_NAME (string) */
+  status = OCIBindByName(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &column_name_hp,                 /* (out) Bind Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *) ":COLUMN_NAME",         /* (in)  Placeholder */
+    strlen(":COLUMN_NAME"),          /* (in)  Placeholder length */
+    (ub1 *) geocolumn,               /* (in)  Value Pointer */
+    strlen(geocolumn)+1,             /* (in)  Value Size */
+    SQLT_STR,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 1 = SRID (integer) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &srid_hp,                        /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Bind variable position */
+    (dvoid *) &srid,                 /* (in)  Value Pointer */
+    sizeof(srid),                    /* (in)  Value Size */
+    SQLT_INT,                        /* (in)  Data Type */
+    (dvoid *) &srid_ind,             /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch the only row */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Number of rows to fetch: 1 */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+  if (status == OCI_NO_DATA || srid_ind != OCI_IND_NOTNULL)
+    srid = 0;
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  return srid;
+}
+
+/*******************************************************************************
+** Routine:     ScanPoints
+**
+** Description: Read all points and pass them to a consumer, one batch at a
+**              time. Points with a NULL X or Y are skipped. If an id column
+**              is given, the ids of the points are passed along.
+**              Returns the number of rows fetched.
+*******************************************************************************/
+long ScanPoints (
+  char           *tablename,
+  char           *geocolumn,
+  char           *idcolumn,
+  int            array_size,
+  point_consumer consumer,
+  void           *context)
+{
+  long      rows_fetched = 0;        /* Row counter */
   int       nr_fetches = 0;          /* Number of batches fetched */
   int       rows_in_batch = 0;       /* Number of rows in current batch */
+  int       n_points;                /* Number of non-null points in current batch */
   boolean   has_more_data;
   char      select_sql[1024];        /* SQL Statement */
   OCIStmt   *select_stmthp;          /* Statement handle */
   sword     status;                  /* OCI call return status */
-  int       i, j, k;
+  int       i;
 
   /* Define handles for host variables */
   OCIDefine *point_x_hp;
   OCIDefine *point_y_hp;
+  OCIDefine *point_id_hp;
 
   /* Host variables */
-  double    point_x[array_size];
-  double    point_y[array_size];
+  point_array_struct x_array, y_array;
+  double    *point_x;
+  double    *point_y;
+  long      *point_id = NULL;
+  sb2       *point_x_ind;
+  sb2       *point_y_ind;
+  sb2       *point_id_ind = NULL;
+
+  /* Allocate the arrays that receive the points */
+  point_x = AllocatePointArray (&x_array, array_size);
+  point_y = AllocatePointArray (&y_array, array_size);
+  point_x_ind = malloc (sizeof(sb2) * array_size);
+  point_y_ind = malloc (sizeof(sb2) * array_size);
+  if (idcolumn != NULL) {
+    point_id = malloc (sizeof(long) * array_size);
+    point_id_ind = malloc (sizeof(sb2) * array_size);
+  }
 
   /* Construct the select statement */
-  sprintf (select_sql, "SELECT C.%s.SDO_POINT.X, C.%s.SDO_POINT.Y FROM %s C", geocolumn, geocolumn, tablename);
+  sprintf (select_sql,
+    "SELECT TO_BINARY_DOUBLE(C.%s.SDO_POINT.X), TO_BINARY_DOUBLE(C.%s.SDO_POINT.Y)%s%s FROM %s C",
+    geocolumn, geocolumn, idcolumn != NULL ? ", C." : "", idcolumn != NULL ? idcolumn : "", tablename);
   printf ("Executing query:\nSQL> %s\n\n", select_sql);
 
   /* Initialize the statement handle */
@@ -224,33 +610,33 @@ void ReadPoints (
 
   /* Define the variables to receive the selected columns */
 
-  /* Variable 1 = POINT_X (float) */
+  /* Variable 1 = POINT_X (binary double) */
   status = OCIDefineByPos(
     select_stmthp,                   /* (in)  Statement Handle */
     &point_x_hp,                     /* (out) Define Handle */
     errhp,                           /* (in)  Error Handle */
     (ub4)1,                          /* (in)  Bind variable position */
-    (dvoid *) &point_x,              /* (in)  Value Pointer */
+    (dvoid *) point_x,               /* (in)  Value Pointer */
     sizeof(double),                  /* (in)  Value Size */
-    SQLT_FLT,                        /* (in)  Data Type */
-    (dvoid *)0,                      /* (in)  Indicator Pointer */
-    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED)*/
+    SQLT_BDOUBLE,                    /* (in)  Data Type */
+    (dvoid *) point_x_ind,           /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
     (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
     (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
   );
   if (status != OCI_SUCCESS)
     ReportError(errhp);
 
-  /* Variable 2 = POINT_Y (float) */
+  /* Variable 2 = POINT_Y (binary double) */
   status = OCIDefineByPos(
     select_stmthp,                   /* (in)  Statement Handle */
     &point_y_hp,                     /* (out) Define Handle */
     errhp,                           /* (in)  Error Handle */
     (ub4)2,                          /* (in)  Bind variable position */
-    (dvoid *) &point_y,              /* (in)  Value Pointer */
+    (dvoid *) point_y,               /* (in)  Value Pointer */
     sizeof(double),                  /* (in)  Value Size */
-    SQLT_FLT,                        /* (in)  Data Type */
-    (dvoid *)0,                      /* (in)  Indicator Pointer (NOT USED) */
+    SQLT_BDOUBLE,                    /* (in)  Data Type */
+    (dvoid *) point_y_ind,           /* (in)  Indicator Pointer */
     (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
     (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
     (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
@@ -258,6 +644,25 @@ void ReadPoints (
   if (status != OCI_SUCCESS)
     ReportError(errhp);
 
+  /* Variable 3 = ID (integer) */
+  if (idcolumn != NULL) {
+    status = OCIDefineByPos(
+      select_stmthp,                 /* (in)  Statement Handle */
+      &point_id_hp,                  /* (out) Define Handle */
+      errhp,                         /* (in)  Error Handle */
+      (ub4)3,                        /* (in)  Bind variable position */
+      (dvoid *) point_id,            /* (in)  Value Pointer */
+      sizeof(long),                  /* (in)  Value Size */
+      SQLT_INT,                      /* (in)  Data Type */
+      (dvoid *) point_id_ind,        /* (in)  Indicator Pointer */
+      (ub2 *)0,                      /* (out) Length of data fetched (NOT USED) */
+      (ub2 *)0,                      /* (out) Column return codes (NOT USED) */
+      (ub4)OCI_DEFAULT               /* (in)  Operating mode */
+    );
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+
   /* Execute query and fetch first batch of rows of result set */
   status = OCIStmtExecute(
     svchp,                           /* (in)  Service Context Handle */
@@ -291,19 +696,30 @@ void ReadPoints (
       errhp);
 
     nr_fetches++;
+    rows_fetched += rows_in_batch;
 
-    /* Display results just fetched */
+    /* Squeeze out the rows that have no point */
+    n_points = 0;
     for (i=0; i<rows_in_batch; i++) {
-      rows_fetched++;
-      printf ("%d: (%f, %f)\n", rows_fetched, point_x[i], point_y[i]);
+      if (point_x_ind[i] == OCI_IND_NOTNULL && point_y_ind[i] == OCI_IND_NOTNULL) {
+        point_x[n_points] = point_x[i];
+        point_y[n_points] = point_y[i];
+        if (point_id != NULL)
+          point_id[n_points] = point_id_ind[i] == OCI_IND_NOTNULL ? point_id[i] : 0;
+        n_points++;
+      }
     }
 
+    /* Pass the points just fetched to the consumer */
+    if (n_points > 0)
+      consumer (point_x, point_y, point_id, n_points, context);
+
     if (has_more_data) {
       /* Fetch next batch of rows of result set */
       status = OCIStmtFetch(
         select_stmthp,                 /* (in)  Statement Handle */
         errhp,                         /* (in)  Error Handle */
-        (ub4)array_size,                  /* (in)  Number of rows to fetch */
+        (ub4)array_size,               /* (in)  Number of rows to fetch */
         (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
         (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
       if (status != OCI_SUCCESS && status != OCI_NO_DATA)
@@ -312,7 +728,7 @@ void ReadPoints (
   }
   while (has_more_data);
 
-  printf ("\n%d rows fetched in %d fetches\n", rows_fetched, nr_fetches);
+  printf ("\n%ld rows fetched in %d fetches\n", rows_fetched, nr_fetches);
 
   /* Free statement handle */
   status = OCIHandleFree(
@@ -321,6 +737,63 @@ void ReadPoints (
   if (status != OCI_SUCCESS)
     ReportError(errhp);
 
+  /* Free host variables */
+  FreePointArray (&x_array);
+  FreePointArray (&y_array);
+  free (point_x_ind);
+  free (point_y_ind);
+  if (point_id != NULL) {
+    free (point_id);
+    free (point_id_ind);
+  }
+
+  return rows_fetched;
+}
+
+/*******************************************************************************
+** Routine:     ReadPoints
+**
+** Description: Read all points, and print them out, compute their extent or
+**              write them to a point dump file
+*******************************************************************************/
+void ReadPoints (
+  char *tablename,
+  char *geocolumn,
+  int  array_size,
+  int  print_points,
+  char *dump_filename,
+  char *idcolumn)
+{
+  long                rows_printed = 0;
+  point_extent_struct extent;
+  point_dump_writer_struct *dump;
+  long                rows_fetched;
+  double              start_time, elapsed;
+
+  start_time = ElapsedSeconds();
+  if (dump_filename != NULL) {
+    dump = CreatePointDump (dump_filename, GetSrid (tablename, geocolumn), idcolumn != NULL);
+    rows_fetched = ScanPoints (tablename, geocolumn, idcolumn, array_size, DumpPoints, dump);
+    FinishPointDump (dump);
+  }
+  else if (print_points)
+    rows_fetched = ScanPoints (tablename, geocolumn, idcolumn, array_size, PrintPoints, &rows_printed);
+  else {
+    extent.n_points = 0;
+    extent.min_x = extent.min_y = 1e308;
+    extent.max_x = extent.max_y = -1e308;
+    rows_fetched = ScanPoints (tablename, geocolumn, idcolumn, array_size, ComputeExtent, &extent);
+    if (extent.n_points > 0)
+      printf ("%ld points - extent: (%f, %f) (%f, %f)\n", extent.n_points,
+        extent.min_x, extent.min_y, extent.max_x, extent.max_y);
+    else
+      printf ("0 points - empty extent\n");
+  }
+  elapsed = ElapsedSeconds() - start_time;
+  printf ("Elapsed time: %.3f seconds", elapsed);
+  if (elapsed > 0)
+    printf (" (%.0f points/second)", rows_fetched / elapsed);
+  printf ("\n");
 }
 
 /*******************************************************************************
@@ -330,11 +803,26 @@ void ReadPoints (
 *******************************************************************************/
 int main(int argc, char **argv)
 {
-    char *username, *password, *database, *tablename, *geocolumn;
-    int array_size;
+    char *username, *password, *database, *tablename, *geocolumn, *idcolumn;
+    char *dump_filename = NULL;
+    int array_size, print_points;
+    int i, n;
+
+    /* Take out the --dump option, wherever it is */
+    for (i=1, n=1; i<argc; i++) {
+      if (strncmp (argv[i], "--dump=", 7) == 0)
+        dump_filename = argv[i] + 7;
+      else
+        argv[n++] = argv[i];
+    }
+    argc = n;
+    if (dump_filename != NULL && dump_filename[0] == '\0') {
+      printf ("Missing file name after --dump=\n");
+      exit( 1 );
+    }
 
-    if( argc < 6 || argc > 7) {
-      printf("USAGE: %s <username> <password> <database> <tablename> <geo_column> [<array_size>]\n", argv[0]);
+    if( argc < 6 || argc > 9) {
+      printf("USAGE: %s <username> <password> <database> <tablename> <geo_column> [<array_size>] [<print_points>] [<id_column>] [--dump=<filename>]\n", argv[0]);
       exit( 1 );
     }
     else {
@@ -351,6 +839,14 @@ int main(int argc, char **argv)
         printf ("Invalid array size: must be positive\n");
         exit( 1 );
       }
+      if (argc > 7)
+        print_points = atoi(argv[7]);
+      else
+        print_points = 1;
+      if (argc > 8)
+        idcolumn = argv[8];
+      else
+        idcolumn = NULL;
     }
 
     /* Set up OCI environment */
@@ -360,7 +856,7 @@ int main(int argc, char **argv)
     ConnectDatabase(username, password, database);
 
     /* Fetch and process the records */
-    ReadPoints(tablename, geocolumn, array_size);
+    ReadPoints(tablename, geocolumn, array_size, print_points, dump_filename, idcolumn);
 
     /* disconnect from database */
     DisconnectDatabase();
@@ -0,0 +1,608 @@
+/* render_tiles.c
+
+   This program renders a thematic map of a table of geometries as map
+   tiles, and writes them as PNG images to a directory (a disk cache of
+   tiles, in the z/x/y layout of web maps).
+
+   Maps normally go through MapViewer (see chapters 11 and 12), which reads
+   the geometries for each map request. This program reads the table once,
+   with array fetches of SDO_GEOMETRY objects as read_geom_array.c does,
+   and renders all the tiles of a range of zoom levels on the client, with
+   the rasterizer of tile_render.c and several threads. Polygons are filled
+   with a color that goes from light yellow to dark red with the value of a
+   column, and outlined; lines are drawn in dark gray, points as blue
+   squares.
+
+   The table is read with the following statement:
+
+     SELECT geo_column, value_column FROM tablename
+
+   It illustrates the following concepts:
+   - reading geometries with array fetches
+   - reading a number and an object column in the same fetch
+   - rendering geometries on the client
+
+   The program takes the following command line arguments:
+
+     render_tiles username password database tablename geo_column directory [min_zoom] [max_zoom] [value_column] [threads] [array_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - tablename, geo_column = the table and its geometry column
+     (for instance US_COUNTIES and GEOM)
+   - directory = where to write the tiles, as directory/zoom/column/row.png
+   - min_zoom, max_zoom = the zoom levels to render (default is 0 to 12)
+   - value_column = numeric column that sets the fill color of the
+     polygons, or NONE (the default) to fill them all in the same color
+   - threads = number of rendering threads (default is one per processor)
+   - array_size = number of rows to read per fetch (default is 1000 rows)
+
+   Notes:
+
+   The program must be linked with tile_render.c, sdo_elements.c and
+   spatial_util.c. On Linux and other POSIX systems it also needs the POSIX
+   threads library.
+
+   Geometries in longitudes and latitudes (SRID 8307 or 4326) are rendered
+   in the Web Mercator tiles of the common web maps, so that the tiles can
+   be shown over a base map. Other coordinate systems use tiles that cover
+   the extent of the layer (see tile_render.h).
+
+   Only the tiles that the MBR of a geometry overlaps are written. Tiles
+   that already exist are overwritten: delete the directory to clear the
+   cache. The tiles per second reported for each zoom include encoding and
+   writing the PNG files.
+
+   Rows with a NULL geometry, and geometries with an invalid element info
+   array, are skipped. A NULL value counts as 0.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <oci.h>
+#include "sdo_geometry.h"
+#include "sdo_elements.h"
+#include "tile_render.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle*/
+OCIError     *errhp;  /* Error handle */
+OCISvcCtx    *svchp;  /* Service Context handle*/
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_DEFAULT+OCI_OBJECT),   /* (in)  Mode: handles objects */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&errhp,                /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ConnectDatabase
+**
+** Description: Connects to the oracle database
+*******************************************************************************/
+void ConnectDatabase(
+        char *username,
+        char *password,
+        char *database)
+{
+  int status;
+  char verbuf[512];
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      errhp,                         /* (in)  Error Handle */
+      &svchp,                        /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get database version */
+  OCIServerVersion(
+    svchp,                             /* (in)  Service Context Handle */
+    errhp,                             /* (in)  Error Handle */
+    verbuf,                            /* (out) Buffer to receive version message */
+    sizeof(verbuf),                    /* (in)  Size of message buffer */
+    OCI_HTYPE_SVCCTX);                 /* (in)  Type of handle (service context) */
+
+  printf("Connected to: %s\n", database);
+  printf("%s\n\n", verbuf);
+}
+
+/*******************************************************************************
+** Routine:     DisconnectDatabase
+**
+** Description: Disconnect from Oracle
+*******************************************************************************/
+void DisconnectDatabase(void)
+{
+  int status;
+
+  status = OCILogoff(svchp, errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)errhp,                  /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+
+/*******************************************************************************
+** Routine:     AddGeometry
+**
+** Description: Add a geometry fetched from the database to a layer, and
+**              return its SRID (0 if NULL). Returns 0 if it was added, -1 if
+**              it was skipped.
+*******************************************************************************/
+int AddGeometry (
+  double                value,
+  SDO_GEOMETRY          *geometry_object,
+  SDO_GEOMETRY_ind      *geometry_object_ind,
+  element_buffer_struct *buffer,
+  render_layer_struct   *layer,
+  int                   *srid)
+{
+  int    gtype = 0, has_point = 0;
+  double x = 0, y = 0;
+
+  *srid = 0;
+  if (geometry_object_ind->_atomic == OCI_IND_NULL)
+    return -1;
+
+  /* Extract SDO_GTYPE and SDO_SRID */
+  if (geometry_object_ind->SDO_GTYPE == OCI_IND_NOTNULL)
+    OCINumberToInt (
+      errhp,
+      &(geometry_object->SDO_GTYPE),
+      (uword) sizeof (int),
+      OCI_NUMBER_SIGNED,
+      (dvoid *) &gtype);
+  if (geometry_object_ind->SDO_SRID == OCI_IND_NOTNULL)
+    OCINumberToInt (
+      errhp,
+      &(geometry_object->SDO_SRID),
+      (uword) sizeof (int),
+      OCI_NUMBER_SIGNED,
+      (dvoid *) srid);
+
+  /* Extract SDO_POINT */
+  if (geometry_object_ind->SDO_POINT._atomic == OCI_IND_NOTNULL &&
+      geometry_object_ind->SDO_POINT.X == OCI_IND_NOTNULL &&
+      geometry_object_ind->SDO_POINT.Y == OCI_IND_NOTNULL) {
+    has_point = 1;
+    OCINumberToReal(
+      errhp, &(geometry_object->SDO_POINT.X), (uword)sizeof(double), (dvoid *)&x);
+    OCINumberToReal(
+      errhp, &(geometry_object->SDO_POINT.Y), (uword)sizeof(double), (dvoid *)&y);
+  }
+
+  /* Extract the elements and ordinates */
+  ExtractElements (envhp, errhp, geometry_object, geometry_object_ind, buffer);
+
+  return AddRenderGeometry (layer, value, gtype, has_point, x, y,
+    buffer->elem_info, buffer->n_elem_info, buffer->ordinates, buffer->n_ordinates);
+}
+
+/*******************************************************************************
+** Routine:     ReadLayer
+**
+** Description: Read the geometries and values of a table into a layer.
+**              Returns the SRID of the first geometry that has one.
+*******************************************************************************/
+int ReadLayer (
+  char                *tablename,
+  char                *geocolumn,
+  char                *valuecolumn,
+  int                 array_size,
+  render_layer_struct *layer)
+{
+  long      rows_fetched = 0;        /* Row counter */
+  long      rows_skipped = 0;        /* Rows with a NULL or invalid geometry */
+  int       nr_fetches = 0;          /* Number of batches fetched */
+  int       rows_in_batch = 0;       /* Number of rows in current batch */
+  boolean   has_more_data;
+  char      select_sql[1024];        /* SQL Statement */
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  int       i, srid, layer_srid = 0;
+  double    start_time;
+
+  /* Define handles for host variables */
+  OCIDefine         *geometry_hp;
+  OCIDefine         *value_hp;
+
+  /* Type descriptor for geometry object type */
+  OCIType           *geometry_type_desc;
+
+  /* Host variables */
+  SDO_GEOMETRY      *geometry_obj[array_size];
+  SDO_GEOMETRY_ind  *geometry_ind[array_size];
+  double            value[array_size];
+  sb2               value_ind[array_size];
+
+  element_buffer_struct buffer;
+
+  /* Construct the select statement */
+  sprintf (select_sql, "SELECT %s, %s FROM %s", geocolumn,
+    valuecolumn != NULL ? valuecolumn : "0", tablename);
+  printf ("Executing query:\nSQL> %s\n", select_sql);
+  start_time = ElapsedSeconds ();
+
+  /* Initialize array of geometry pointers */
+  for (i=0; i<array_size; i++) {
+    geometry_obj[i] = NULL;
+    geometry_ind[i] = NULL;
+  }
+  memset (&buffer, 0, sizeof(buffer));
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get type descriptor for geometry object type */
+  status = OCITypeByName (
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    errhp,                           /* (in)  Error Handle */
+    svchp,                           /* (in)  Service Context Handle */
+    "MDSYS",                         /* (in)  Type owner name */
+    strlen("MDSYS"),                 /* (in)  (length) */
+    "SDO_GEOMETRY",                  /* (in)  Type name */
+    strlen("SDO_GEOMETRY"),          /* (in)  (length) */
+    0,                               /* (in)  Version name (NOT USED) */
+    0,                               /* (in)  (length) */
+    OCI_DURATION_SESSION,            /* (in)  Pin duration */
+    OCI_TYPEGET_HEADER ,             /* (in)  Get option */
+    &geometry_type_desc);            /* (out) Type descriptor */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Define the variables to receive the selected columns */
+
+  /* Variable 1 = geometry (ADT) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &geometry_hp,                    /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Bind variable position */
+    (dvoid *)0,                      /* (in)  Value Pointer (NOT USED) */
+    0,                               /* (in)  Value Size (NOT USED) */
+    SQLT_NTY,                        /* (in)  Data Type */
+    (dvoid *)0,                      /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  status = OCIDefineObject(
+    geometry_hp,                     /* (in)  Define handle */
+    errhp,                           /* (in)  Error handle */
+    geometry_type_desc,              /* (in)  Geometry type descriptor */
+    (dvoid **) &geometry_obj,        /* (in)  Value Pointer */
+    (ub4 *)0,                        /* (in)  Value Size (NOT USED) */
+    (dvoid **) &geometry_ind,        /* (in)  Indicator Pointer */
+    (ub4 *)0                         /* (in)  Indicator Size */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 2 = value (double) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &value_hp,                       /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)2,                          /* (in)  Bind variable position */
+    (dvoid *) value,                 /* (in)  Value Pointer */
+    sizeof(double),                  /* (in)  Value Size */
+    SQLT_FLT,                        /* (in)  Data Type */
+    (dvoid *) value_ind,             /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch first batch of rows of result set */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)array_size,                 /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+
+  has_more_data = TRUE;
+  do
+  {
+    /* The last batch comes with OCI_NO_DATA: it still needs to be processed */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)select_stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      errhp);
+
+    nr_fetches++;
+
+    /* Convert the geometries just fetched */
+    for (i=0; i<rows_in_batch; i++) {
+      rows_fetched++;
+      if (AddGeometry (value_ind[i] == OCI_IND_NULL ? 0 : value[i],
+            geometry_obj[i], geometry_ind[i], &buffer, layer, &srid) != 0)
+        rows_skipped++;
+      else if (layer_srid == 0)
+        layer_srid = srid;
+    }
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        select_stmthp,                 /* (in)  Statement Handle */
+        errhp,                         /* (in)  Error Handle */
+        (ub4)array_size,               /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(errhp);
+    }
+  }
+  while (has_more_data);
+
+  printf ("%ld rows fetched in %d fetches, %ld skipped, in %.3f seconds\n\n",
+    rows_fetched, nr_fetches, rows_skipped, ElapsedSeconds () - start_time);
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  free (buffer.elem_info);
+  free (buffer.ordinates);
+  return layer_srid;
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char *username, *password, *database, *tablename, *geocolumn, *directory;
+    char *valuecolumn = NULL;
+    int  min_zoom, max_zoom, n_threads, array_size, srid, zoom;
+    long n_tiles = 0, n_bytes = 0;
+    double seconds = 0;
+    render_layer_struct  layer;
+    render_result_struct result;
+    render_style_struct  style = {
+      {255, 255, 178, 224},              /* Fill of the lowest value: light yellow */
+      {189, 0, 38, 224},                 /* Fill of the highest value: dark red */
+      {64, 64, 64, 255},                 /* Lines and boundaries: dark gray */
+      {33, 102, 172, 255},               /* Points: blue */
+      1.0,                               /* Line width */
+      5.0                                /* Point size */
+    };
+
+    if( argc < 7 || argc > 12) {
+      printf("USAGE: %s <username> <password> <database> <tablename> <geo_column> <directory> [<min_zoom>] [<max_zoom>] [<value_column>] [<threads>] [<array_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      tablename = argv[4];
+      geocolumn = argv[5];
+      directory = argv[6];
+      if (argc > 7)
+        min_zoom = atoi(argv[7]);
+      else
+        min_zoom = 0;
+      if (argc > 8)
+        max_zoom = atoi(argv[8]);
+      else
+        max_zoom = 12;
+      if (min_zoom < 0 || max_zoom > RENDER_MAX_ZOOM || min_zoom > max_zoom) {
+        printf ("Invalid zoom levels: must be between 0 and %d\n", RENDER_MAX_ZOOM);
+        exit( 1 );
+      }
+      if (argc > 9 && strcmp (argv[9], "NONE") != 0)
+        valuecolumn = argv[9];
+      if (argc > 10)
+        n_threads = atoi(argv[10]);
+      else
+        n_threads = ProcessorThreads(RENDER_MAX_THREADS);
+      if (n_threads <= 0 || n_threads > RENDER_MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", RENDER_MAX_THREADS);
+        exit( 1 );
+      }
+      if (argc > 11)
+        array_size = atoi(argv[11]);
+      else
+        array_size = 1000;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Connect to database */
+    ConnectDatabase(username, password, database);
+
+    /* Read the layer */
+    InitRenderLayer (&layer);
+    srid = ReadLayer (tablename, geocolumn, valuecolumn, array_size, &layer);
+
+    /* disconnect from database */
+    DisconnectDatabase();
+
+    /* Project it to the tiles */
+    if (srid == 8307 || srid == 4326) {
+      ProjectRenderLayer (&layer, RENDER_MERCATOR);
+      printf ("SRID %d: Web Mercator tiles\n", srid);
+    }
+    else {
+      ProjectRenderLayer (&layer, RENDER_EXTENT);
+      printf ("SRID %d: tiles over the extent of the layer\n", srid);
+    }
+    if (valuecolumn != NULL)
+      printf ("Values of %s from %g to %g\n", valuecolumn, layer.min_value, layer.max_value);
+
+    /* Render the tiles */
+    if (RenderTiles (&layer, &style, min_zoom, max_zoom, directory, n_threads, &result) != 0) {
+      printf ("Could not write the tiles to %s\n", directory);
+      exit (1);
+    }
+    printf ("\n%ld geometries rendered with %d threads into %s\n\n",
+      layer.n_geometries, result.n_threads, directory);
+    printf ("zoom      tiles   geometries       bytes  bytes/tile  seconds  tiles/sec\n");
+    for (zoom=min_zoom; zoom<=max_zoom; zoom++) {
+      printf ("%4d %10ld %12ld %11ld %11.0f %8.3f %10.0f\n", zoom, result.n_tiles[zoom],
+        result.n_pieces[zoom], result.n_bytes[zoom],
+        result.n_tiles[zoom] > 0 ? (double) result.n_bytes[zoom] / result.n_tiles[zoom] : 0,
+        result.seconds[zoom],
+        result.seconds[zoom] > 0 ? result.n_tiles[zoom] / result.seconds[zoom] : 0);
+      n_tiles += result.n_tiles[zoom];
+      n_bytes += result.n_bytes[zoom];
+      seconds += result.seconds[zoom];
+    }
+    printf ("all  %10ld %12s %11ld %11.0f %8.3f %10.0f\n", n_tiles, "", n_bytes,
+      n_tiles > 0 ? (double) n_bytes / n_tiles : 0, seconds, seconds > 0 ? n_tiles / seconds : 0);
+
+    FreeRenderLayer (&layer);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
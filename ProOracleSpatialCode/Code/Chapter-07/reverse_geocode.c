@@ -0,0 +1,841 @@
+/* reverse_geocode.c
+
+   This program finds the nearest street, and the house number on it, for
+   each point of a point dump (such as a batch of GPS positions), and writes
+   the results to a CSV file.
+
+   It is the client-side counterpart of reverse geocoding against a street
+   layer with SDO_NN (see chapters 6 and 8), run once per point:
+
+     SELECT s.id, s.name, s.from_hn, s.to_hn
+       FROM streets s
+      WHERE SDO_NN (s.geom, :point, 'sdo_num_res=1') = 'TRUE'
+
+   Instead of running one query per point, it reads the whole street layer
+   once with array fetches, as spatial_join.c does, and indexes every
+   segment of every street in memory with street_index.c. The points are
+   then matched in batches, with several threads.
+
+   The street layer is read with the following statement:
+
+     SELECT id_column, name_column, from_column, to_column, geo_column FROM tablename
+
+   where from_column and to_column hold the house numbers at the start and at
+   the end of each street. The house number of a point is interpolated
+   between them, from the position of its nearest point along the street.
+
+   It illustrates the following concepts:
+   - reading geometries with array fetches
+   - reading numeric, character and object columns in the same fetch
+   - splitting line strings into their elements
+
+   The program takes the following command line arguments:
+
+     reverse_geocode username password database tablename id_column name_column from_column to_column geo_column points output [max_distance] [threads] [array_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - tablename = the street table
+   - id_column, name_column = the numeric id and the name of each street
+   - from_column, to_column = the house numbers at both ends of each street
+   - geo_column = the geometry column (line strings)
+   - points = the point dump to match (as written by read_points_array)
+   - output = name of the CSV file to write the results to
+   - max_distance = points farther than this from all streets get no street.
+     0 (the default) means no limit. In meters if the data is geodetic, in
+     the unit of the coordinates otherwise.
+   - threads = number of search threads (default is one per processor)
+   - array_size = number of rows to read per fetch (default is 1000 rows)
+
+   The output file has one line per point:
+
+     point_id,street_id,name,house_number,side,distance,x,y
+
+   where side is L or R (the side of the street the point is on, looking from
+   its start to its end), and x,y is the nearest point of the street. The
+   house number is empty if the range of the street is not known, and all
+   fields but the point id are empty for points without a street.
+
+   Notes:
+
+   The program must be linked with street_index.c, point_dump.c,
+   sdo_elements.c and spatial_util.c. On Linux and other POSIX systems it
+   also needs the POSIX threads library.
+
+   The streets and the points must use the same coordinate system. The data
+   is taken as geodetic when that system is 8307 or 4326 (see street_index.h
+   for how distances are computed). Arcs are replaced by straight lines
+   between their points.
+
+   Rows with a NULL id or geometry, and elements other than line strings,
+   are skipped. The lines of a multi-line street are measured one after the
+   other, in the order of the geometry.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <oci.h>
+#include "sdo_geometry.h"
+#include "sdo_elements.h"
+#include "street_index.h"
+#include "point_dump.h"
+#include "spatial_util.h"
+
+#define STREET_NAME_LENGTH 64
+#define POINTS_PER_BATCH 100000
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle*/
+OCIError     *errhp;  /* Error handle */
+OCISvcCtx    *svchp;  /* Service Context handle*/
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* The street layer, as read from the database */
+struct street_layer
+{
+    int    srid;                      /* SRID of the first geometry (0 if NULL) */
+    long   n_streets;
+    long   max_streets;
+    long   *id;
+    char   (*name)[STREET_NAME_LENGTH+1];
+    long   *from_number;              /* 0 if unknown */
+    long   *to_number;
+    long   n_lines;
+    long   max_lines;
+    long   *line_street;              /* Street of each line */
+    long   *first_point;              /* First point of each line (n_lines + 1) */
+    long   n_points;
+    long   max_points;
+    double *x;
+    double *y;
+};
+typedef struct street_layer street_layer_struct;
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_DEFAULT+OCI_OBJECT),   /* (in)  Mode: handles objects */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&errhp,                /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ConnectDatabase
+**
+** Description: Connects to the oracle database
+*******************************************************************************/
+void ConnectDatabase(
+        char *username,
+        char *password,
+        char *database)
+{
+  int status;
+  char verbuf[512];
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      errhp,                         /* (in)  Error Handle */
+      &svchp,                        /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get database version */
+  OCIServerVersion(
+    svchp,                             /* (in)  Service Context Handle */
+    errhp,                             /* (in)  Error Handle */
+    verbuf,                            /* (out) Buffer to receive version message */
+    sizeof(verbuf),                    /* (in)  Size of message buffer */
+    OCI_HTYPE_SVCCTX);                 /* (in)  Type of handle (service context) */
+
+  printf("Connected to: %s\n", database);
+  printf("%s\n\n", verbuf);
+}
+
+/*******************************************************************************
+** Routine:     DisconnectDatabase
+**
+** Description: Disconnect from Oracle
+*******************************************************************************/
+void DisconnectDatabase(void)
+{
+  int status;
+
+  status = OCILogoff(svchp, errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)errhp,                  /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+/*******************************************************************************
+** Routine:     AddLine
+**
+** Description: Add a line string to the street layer, from ordinate
+**              first to ordinate last - 1 of a buffer
+*******************************************************************************/
+void AddLine (
+  street_layer_struct   *layer,
+  element_buffer_struct *buffer,
+  int                   dim,
+  int                   first,
+  int                   last)
+{
+  int n = (last - first) / dim, i;
+
+  if (n < 2)
+    return;
+  if (layer->n_lines + 1 >= layer->max_lines) {
+    layer->max_lines = layer->max_lines > 0 ? 2 * layer->max_lines : 1024;
+    layer->line_street = realloc (layer->line_street, layer->max_lines * sizeof(long));
+    layer->first_point = realloc (layer->first_point, (layer->max_lines + 1) * sizeof(long));
+  }
+  if (layer->n_points + n > layer->max_points) {
+    while (layer->n_points + n > layer->max_points)
+      layer->max_points = layer->max_points > 0 ? 2 * layer->max_points : 16384;
+    layer->x = realloc (layer->x, layer->max_points * sizeof(double));
+    layer->y = realloc (layer->y, layer->max_points * sizeof(double));
+  }
+  layer->line_street[layer->n_lines] = layer->n_streets;
+  layer->first_point[layer->n_lines] = layer->n_points;
+  for (i=0; i<n; i++) {
+    layer->x[layer->n_points] = buffer->ordinates[first + i*dim];
+    layer->y[layer->n_points] = buffer->ordinates[first + i*dim + 1];
+    layer->n_points++;
+  }
+  layer->n_lines++;
+  layer->first_point[layer->n_lines] = layer->n_points;
+}
+
+/*******************************************************************************
+** Routine:     AddStreet
+**
+** Description: Add a street fetched from the database to the layer. Its
+**              line string elements (simple, or parts of compound line
+**              strings) become lines of the layer. Returns 0 if the street
+**              was added, -1 if it was skipped.
+*******************************************************************************/
+int AddStreet (
+  long                  id,
+  char                  *name,
+  long                  from_number,
+  long                  to_number,
+  SDO_GEOMETRY          *geometry_object,
+  SDO_GEOMETRY_ind      *geometry_object_ind,
+  element_buffer_struct *buffer,
+  street_layer_struct   *layer)
+{
+  int  gtype = 0, srid = 0, dim, e, first, last;
+  long n_lines = layer->n_lines;
+
+  if (geometry_object_ind->_atomic == OCI_IND_NULL)
+    return -1;
+
+  /* Extract SDO_GTYPE and SDO_SRID */
+  if (geometry_object_ind->SDO_GTYPE == OCI_IND_NOTNULL)
+    OCINumberToInt (
+      errhp,
+      &(geometry_object->SDO_GTYPE),
+      (uword) sizeof (int),
+      OCI_NUMBER_SIGNED,
+      (dvoid *) &gtype);
+  if (geometry_object_ind->SDO_SRID == OCI_IND_NOTNULL)
+    OCINumberToInt (
+      errhp,
+      &(geometry_object->SDO_SRID),
+      (uword) sizeof (int),
+      OCI_NUMBER_SIGNED,
+      (dvoid *) &srid);
+  dim = gtype / 1000;
+  if (dim < 2)
+    dim = 2;
+
+  /* Extract the elements and ordinates, and keep the line strings */
+  ExtractElements (envhp, errhp, geometry_object, geometry_object_ind, buffer);
+  for (e=0; e+2<buffer->n_elem_info; e+=3) {
+    if (buffer->elem_info[e+1] != 2)
+      continue;
+    first = buffer->elem_info[e] - 1;
+    last = e+3 < buffer->n_elem_info ? buffer->elem_info[e+3] - 1 : buffer->n_ordinates;
+    if (first < 0 || last > buffer->n_ordinates)
+      break;
+    AddLine (layer, buffer, dim, first, last);
+  }
+  if (layer->n_lines == n_lines)
+    return -1;
+
+  /* Keep the attributes of the street */
+  if (layer->n_streets == 0)
+    layer->srid = srid;
+  if (layer->n_streets == layer->max_streets) {
+    layer->max_streets = layer->max_streets > 0 ? 2 * layer->max_streets : 1024;
+    layer->id = realloc (layer->id, layer->max_streets * sizeof(long));
+    layer->name = realloc (layer->name, layer->max_streets * sizeof(*layer->name));
+    layer->from_number = realloc (layer->from_number, layer->max_streets * sizeof(long));
+    layer->to_number = realloc (layer->to_number, layer->max_streets * sizeof(long));
+  }
+  layer->id[layer->n_streets] = id;
+  strcpy (layer->name[layer->n_streets], name);
+  layer->from_number[layer->n_streets] = from_number;
+  layer->to_number[layer->n_streets] = to_number;
+  layer->n_streets++;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     DefineColumn
+**
+** Description: Define the array that receives a scalar column
+*******************************************************************************/
+void DefineColumn (
+  OCIStmt *stmthp,
+  int     position,
+  void    *values,
+  int     value_size,
+  ub2     type,
+  sb2     *indicators)
+{
+  OCIDefine *define_hp;
+  sword     status;
+
+  status = OCIDefineByPos(
+    stmthp,                          /* (in)  Statement Handle */
+    &define_hp,                      /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)position,                   /* (in)  Bind variable position */
+    (dvoid *) values,                /* (in)  Value Pointer */
+    value_size,                      /* (in)  Value Size */
+    type,                            /* (in)  Data Type */
+    (dvoid *) indicators,            /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ReadStreets
+**
+** Description: Read the streets of a table into a layer
+*******************************************************************************/
+void ReadStreets (
+  char                *tablename,
+  char                *idcolumn,
+  char                *namecolumn,
+  char                *fromcolumn,
+  char                *tocolumn,
+  char                *geocolumn,
+  int                 array_size,
+  street_layer_struct *layer)
+{
+  long      rows_fetched = 0;        /* Row counter */
+  long      rows_skipped = 0;        /* Rows with a NULL id or no line string */
+  int       nr_fetches = 0;          /* Number of batches fetched */
+  int       rows_in_batch = 0;       /* Number of rows in current batch */
+  boolean   has_more_data;
+  char      select_sql[1024];        /* SQL Statement */
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  int       i;
+  double    start_time;
+
+  /* Define handle for the geometry */
+  OCIDefine         *geometry_hp;
+
+  /* Type descriptor for geometry object type */
+  OCIType           *geometry_type_desc;
+
+  /* Host variables */
+  long              id[array_size];
+  sb2               id_ind[array_size];
+  char              name[array_size][STREET_NAME_LENGTH+1];
+  sb2               name_ind[array_size];
+  long              from_number[array_size];
+  sb2               from_ind[array_size];
+  long              to_number[array_size];
+  sb2               to_ind[array_size];
+  SDO_GEOMETRY      *geometry_obj[array_size];
+  SDO_GEOMETRY_ind  *geometry_ind[array_size];
+
+  element_buffer_struct buffer;
+
+  /* Construct the select statement */
+  sprintf (select_sql, "SELECT %s, %s, %s, %s, %s FROM %s",
+    idcolumn, namecolumn, fromcolumn, tocolumn, geocolumn, tablename);
+  printf ("Executing query:\nSQL> %s\n", select_sql);
+  start_time = ElapsedSeconds ();
+
+  /* Initialize array of geometry pointers */
+  for (i=0; i<array_size; i++) {
+    geometry_obj[i] = NULL;
+    geometry_ind[i] = NULL;
+  }
+  memset (&buffer, 0, sizeof(buffer));
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get type descriptor for geometry object type */
+  status = OCITypeByName (
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    errhp,                           /* (in)  Error Handle */
+    svchp,                           /* (in)  Service Context Handle */
+    "MDSYS",                         /* (in)  Type owner name */
+    strlen("MDSYS"),                 /* (in)  (length) */
+    "SDO_GEOMETRY",                  /* (in)  Type name */
+    strlen("SDO_GEOMETRY"),          /* (in)  (length) */
+    0,                               /* (in)  Version name (NOT USED) */
+    0,                               /* (in)  (length) */
+    OCI_DURATION_SESSION,            /* (in)  Pin duration */
+    OCI_TYPEGET_HEADER ,             /* (in)  Get option */
+    &geometry_type_desc);            /* (out) Type descriptor */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Define the variables to receive the selected columns: the id and house
+     numbers as integers, the name as a string (truncated if too long) */
+  DefineColumn (select_stmthp, 1, id, sizeof(long), SQLT_INT, id_ind);
+  DefineColumn (select_stmthp, 2, name, STREET_NAME_LENGTH+1, SQLT_STR, name_ind);
+  DefineColumn (select_stmthp, 3, from_number, sizeof(long), SQLT_INT, from_ind);
+  DefineColumn (select_stmthp, 4, to_number, sizeof(long), SQLT_INT, to_ind);
+
+  /* Variable 5 = geometry (ADT) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &geometry_hp,                    /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)5,                          /* (in)  Bind variable position */
+    (dvoid *)0,                      /* (in)  Value Pointer (NOT USED) */
+    0,                               /* (in)  Value Size (NOT USED) */
+    SQLT_NTY,                        /* (in)  Data Type */
+    (dvoid *)0,                      /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  status = OCIDefineObject(
+    geometry_hp,                     /* (in)  Define handle */
+    errhp,                           /* (in)  Error handle */
+    geometry_type_desc,              /* (in)  Geometry type descriptor */
+    (dvoid **) &geometry_obj,        /* (in)  Value Pointer */
+    (ub4 *)0,                        /* (in)  Value Size (NOT USED) */
+    (dvoid **) &geometry_ind,        /* (in)  Indicator Pointer */
+    (ub4 *)0                         /* (in)  Indicator Size */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch first batch of rows of result set. Names longer
+     than the buffer are truncated, which OCI reports as a warning. */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)array_size,                 /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_SUCCESS_WITH_INFO && status != OCI_NO_DATA)
+    ReportError(errhp);
+
+  has_more_data = TRUE;
+  do
+  {
+    /* The last batch comes with OCI_NO_DATA: it still needs to be processed */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)select_stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      errhp);
+
+    nr_fetches++;
+
+    /* Convert the streets just fetched */
+    for (i=0; i<rows_in_batch; i++) {
+      rows_fetched++;
+      if (name_ind[i] == OCI_IND_NULL)
+        name[i][0] = '\0';
+      if (id_ind[i] == OCI_IND_NULL ||
+          AddStreet (id[i], name[i],
+            from_ind[i] == OCI_IND_NULL ? 0 : from_number[i],
+            to_ind[i] == OCI_IND_NULL ? 0 : to_number[i],
+            geometry_obj[i], geometry_ind[i], &buffer, layer) != 0)
+        rows_skipped++;
+    }
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        select_stmthp,                 /* (in)  Statement Handle */
+        errhp,                         /* (in)  Error Handle */
+        (ub4)array_size,               /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_SUCCESS_WITH_INFO && status != OCI_NO_DATA)
+        ReportError(errhp);
+    }
+  }
+  while (has_more_data);
+
+  printf ("%ld rows fetched in %d fetches, %ld skipped, in %.3f seconds\n",
+    rows_fetched, nr_fetches, rows_skipped, ElapsedSeconds () - start_time);
+  printf ("%ld streets, %ld lines, %ld points\n\n",
+    layer->n_streets, layer->n_lines, layer->n_points);
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  free (buffer.elem_info);
+  free (buffer.ordinates);
+}
+
+/*******************************************************************************
+** Routine:     FreeStreets
+**
+** Description: Free the arrays of a street layer
+*******************************************************************************/
+void FreeStreets (street_layer_struct *layer)
+{
+  free (layer->id);
+  free (layer->name);
+  free (layer->from_number);
+  free (layer->to_number);
+  free (layer->line_street);
+  free (layer->first_point);
+  free (layer->x);
+  free (layer->y);
+}
+
+/*******************************************************************************
+** Routine:     PointId
+**
+** Description: Id of a point of a dump: its id, or its position from 1
+*******************************************************************************/
+long PointId (point_dump_struct *dump, long i)
+{
+  return dump->id != NULL ? (long) dump->id[i] : i + 1;
+}
+
+/*******************************************************************************
+** Routine:     WriteQuoted
+**
+** Description: Write a string as a quoted CSV field
+*******************************************************************************/
+void WriteQuoted (FILE *file, char *s)
+{
+  putc ('"', file);
+  for (; *s != '\0'; s++) {
+    if (*s == '"')
+      putc ('"', file);
+    putc (*s, file);
+  }
+  putc ('"', file);
+}
+
+/*******************************************************************************
+** Routine:     WriteMatches
+**
+** Description: Write the streets found for a batch of points
+*******************************************************************************/
+void WriteMatches (
+  FILE                *file,
+  point_dump_struct   *points,
+  long                first,
+  long                n,
+  street_layer_struct *layer,
+  street_match_struct *matches)
+{
+  street_match_struct *match;
+  long i, number;
+
+  for (i=0; i<n; i++) {
+    match = &matches[i];
+    fprintf (file, "%ld,", PointId (points, first + i));
+    if (match->street < 0) {
+      fprintf (file, ",,,,,,\n");
+      continue;
+    }
+    fprintf (file, "%ld,", layer->id[match->street]);
+    WriteQuoted (file, layer->name[match->street]);
+    putc (',', file);
+    number = HouseNumber (layer->from_number[match->street],
+      layer->to_number[match->street], match->fraction);
+    if (number > 0)
+      fprintf (file, "%ld", number);
+    fprintf (file, ",%c,%.3f,%.9g,%.9g\n", match->side > 0 ? 'L' : 'R',
+      match->distance, match->x, match->y);
+  }
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *username, *password, *database, *points_file, *output;
+    char   *tablename, *idcolumn, *namecolumn, *fromcolumn, *tocolumn, *geocolumn;
+    int    array_size, n_threads, srid, geodetic;
+    double max_distance, start_time, elapsed;
+    long   first, n, i, n_matched = 0;
+    street_layer_struct layer;
+    street_index_struct *index;
+    street_match_struct *matches;
+    point_dump_struct   points;
+    FILE   *file;
+
+    if( argc < 12 || argc > 15) {
+      printf("USAGE: %s <username> <password> <database> <tablename> <id_column> <name_column> <from_column> <to_column> <geo_column> <points> <output> [<max_distance>] [<threads>] [<array_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      tablename = argv[4];
+      idcolumn = argv[5];
+      namecolumn = argv[6];
+      fromcolumn = argv[7];
+      tocolumn = argv[8];
+      geocolumn = argv[9];
+      points_file = argv[10];
+      output = argv[11];
+      if (argc > 12)
+        max_distance = atof(argv[12]);
+      else
+        max_distance = 0;
+      if (max_distance < 0) {
+        printf ("Invalid maximum distance: must be 0 or more\n");
+        exit( 1 );
+      }
+      if (argc > 13)
+        n_threads = atoi(argv[13]);
+      else
+        n_threads = ProcessorThreads(STREET_INDEX_MAX_THREADS);
+      if (n_threads <= 0 || n_threads > STREET_INDEX_MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", STREET_INDEX_MAX_THREADS);
+        exit( 1 );
+      }
+      if (argc > 14)
+        array_size = atoi(argv[14]);
+      else
+        array_size = 1000;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+    }
+
+    /* Map the points */
+    if (OpenPointDump (points_file, &points) != 0)
+      exit (1);
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Connect to database */
+    ConnectDatabase(username, password, database);
+
+    /* Read the streets */
+    memset (&layer, 0, sizeof(layer));
+    ReadStreets (tablename, idcolumn, namecolumn, fromcolumn, tocolumn, geocolumn,
+      array_size, &layer);
+
+    /* disconnect from database */
+    DisconnectDatabase();
+
+    /* Check the coordinate systems */
+    srid = layer.srid != 0 ? layer.srid : points.srid;
+    if (layer.srid != 0 && points.srid != 0 && layer.srid != points.srid) {
+      printf ("The streets (SRID %d) and the points (SRID %d) use different coordinate systems\n",
+        layer.srid, points.srid);
+      exit (1);
+    }
+    geodetic = srid == 8307 || srid == 4326;
+
+    /* Index the segments */
+    start_time = ElapsedSeconds ();
+    index = BuildStreetIndex (layer.n_lines, layer.line_street, layer.first_point,
+      layer.x, layer.y, layer.n_streets, geodetic);
+    if (index == NULL) {
+      printf ("No street to match the points with\n");
+      exit (1);
+    }
+    printf ("Indexed %ld segments (%s) in %.3f seconds\n", index->n_segments,
+      geodetic ? "geodetic" : "projected", ElapsedSeconds () - start_time);
+
+    /* Match the points, one batch at a time */
+    file = fopen (output, "w");
+    if (file == NULL) {
+      printf ("Could not create %s\n", output);
+      exit (1);
+    }
+    fprintf (file, "point_id,street_id,name,house_number,side,distance,x,y\n");
+    matches = malloc (POINTS_PER_BATCH * sizeof(street_match_struct));
+    start_time = ElapsedSeconds ();
+    for (first=0; first<points.count; first+=n) {
+      n = points.count - first < POINTS_PER_BATCH ? (long) (points.count - first) : POINTS_PER_BATCH;
+      NearestStreetsJoin (index, points.x + first, points.y + first, n, max_distance,
+        n_threads, matches);
+      WriteMatches (file, &points, first, n, &layer, matches);
+      for (i=0; i<n; i++)
+        if (matches[i].street >= 0)
+          n_matched++;
+    }
+    elapsed = ElapsedSeconds () - start_time;
+    if (fclose (file) != 0) {
+      printf ("Could not write %s\n", output);
+      exit (1);
+    }
+
+    printf ("Matched %ld points with %d threads in %.3f seconds",
+      (long) points.count, n_threads, elapsed);
+    if (elapsed > 0)
+      printf (" (%.0f points per second)", points.count / elapsed);
+    printf ("\n");
+    printf ("%ld points within reach of a street\n", n_matched);
+    printf ("Results written to %s\n", output);
+
+    free (matches);
+    FreeStreetIndex (index);
+    FreeStreets (&layer);
+    ClosePointDump (&points);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
@@ -0,0 +1,665 @@
+/* road_network.c
+
+   In-memory road network in compressed sparse row form, and shortest path
+   searches. See road_network.h for a description of the methods.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include "road_network.h"
+#include "spatial_util.h"
+
+#define ROAD_HILBERT_ORDER 65536      /* Hilbert curve resolution (per side) */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A node or an id being sorted */
+struct node_key
+{
+    uint64_t key;
+    long     node;
+};
+typedef struct node_key node_key_struct;
+
+/*******************************************************************************
+** Routine:     CompareKeys
+**
+** Description: Order nodes on their key (for qsort)
+*******************************************************************************/
+static int CompareKeys (const void *a, const void *b)
+{
+  uint64_t ka = ((const node_key_struct *) a)->key;
+  uint64_t kb = ((const node_key_struct *) b)->key;
+  return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     CompareIds
+**
+** Description: Order signed ids stored in keys (for qsort)
+*******************************************************************************/
+static int CompareIds (const void *a, const void *b)
+{
+  long ka = (long) ((const node_key_struct *) a)->key;
+  long kb = (long) ((const node_key_struct *) b)->key;
+  return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     RoadDistance
+**
+** Description: Straight line distance between two nodes: along the great
+**              circle, in meters, if the network is geodetic
+*******************************************************************************/
+double RoadDistance (const road_network_struct *network, long node1, long node2)
+{
+  double lat1, lat2, dlat, dlon, h;
+
+  if (network->geodetic) {
+    lat1 = network->y[node1] * M_PI / 180;
+    lat2 = network->y[node2] * M_PI / 180;
+    dlat = sin ((lat2 - lat1) / 2);
+    dlon = sin ((network->x[node2] - network->x[node1]) * M_PI / 360);
+    h = dlat * dlat + cos (lat1) * cos (lat2) * dlon * dlon;
+    return 2 * ROAD_NETWORK_EARTH_RADIUS * asin (sqrt (h < 1 ? h : 1));
+  }
+  return hypot (network->x[node2] - network->x[node1], network->y[node2] - network->y[node1]);
+}
+
+/*******************************************************************************
+** Routine:     FindRoadNode
+**
+** Description: Node number of a node id, or -1 if there is no such node
+*******************************************************************************/
+long FindRoadNode (const road_network_struct *network, long node_id)
+{
+  long low = 0, high = network->n_nodes - 1, middle;
+
+  while (low <= high) {
+    middle = low + (high - low) / 2;
+    if (network->sorted_id[middle] < node_id)
+      low = middle + 1;
+    else if (network->sorted_id[middle] > node_id)
+      high = middle - 1;
+    else
+      return network->sorted_node[middle];
+  }
+  return -1;
+}
+
+/*******************************************************************************
+** Routine:     BuildRoadNetwork
+**
+** Description: Build a network from its nodes and links. Links whose nodes
+**              are not found, or whose cost is negative, are skipped and
+**              counted in n_skipped. Returns NULL if there are no nodes.
+*******************************************************************************/
+road_network_struct *BuildRoadNetwork (
+  long         n_nodes,
+  const long   *node_id,
+  const double *x,
+  const double *y,
+  long         n_links,
+  const long   *link_id,
+  const long   *start_node_id,
+  const long   *end_node_id,
+  const double *cost,
+  int          directed,
+  int          geodetic,
+  long         *n_skipped)
+{
+  road_network_struct *network;
+  node_key_struct *keys;
+  double min_x, min_y, max_x, max_y, scale, distance;
+  long   *start, *end, *fill_out, *fill_in;
+  long   i, a, n_arcs, node;
+
+  *n_skipped = 0;
+  if (n_nodes <= 0)
+    return NULL;
+
+  network = malloc (sizeof(road_network_struct));
+  network->n_nodes = n_nodes;
+  network->geodetic = geodetic;
+
+  /* Number the nodes along a Hilbert curve through their locations */
+  min_x = max_x = x[0];
+  min_y = max_y = y[0];
+  for (i=1; i<n_nodes; i++) {
+    min_x = x[i] < min_x ? x[i] : min_x;
+    max_x = x[i] > max_x ? x[i] : max_x;
+    min_y = y[i] < min_y ? y[i] : min_y;
+    max_y = y[i] > max_y ? y[i] : max_y;
+  }
+  scale = max_x - min_x > max_y - min_y ? max_x - min_x : max_y - min_y;
+  scale = scale > 0 ? (ROAD_HILBERT_ORDER - 1) / scale : 0;
+  keys = malloc (n_nodes * sizeof(node_key_struct));
+  for (i=0; i<n_nodes; i++) {
+    keys[i].key = HilbertKey (ROAD_HILBERT_ORDER,
+      (long) ((x[i] - min_x) * scale), (long) ((y[i] - min_y) * scale));
+    keys[i].node = i;
+  }
+  qsort (keys, n_nodes, sizeof(node_key_struct), CompareKeys);
+  network->node_id = malloc (n_nodes * sizeof(long));
+  network->x = malloc (n_nodes * sizeof(double));
+  network->y = malloc (n_nodes * sizeof(double));
+  for (i=0; i<n_nodes; i++) {
+    network->node_id[i] = node_id[keys[i].node];
+    network->x[i] = x[keys[i].node];
+    network->y[i] = y[keys[i].node];
+  }
+
+  /* Index the node ids */
+  for (i=0; i<n_nodes; i++) {
+    keys[i].key = (uint64_t) network->node_id[i];
+    keys[i].node = i;
+  }
+  qsort (keys, n_nodes, sizeof(node_key_struct), CompareIds);
+  network->sorted_id = malloc (n_nodes * sizeof(long));
+  network->sorted_node = malloc (n_nodes * sizeof(long));
+  for (i=0; i<n_nodes; i++) {
+    network->sorted_id[i] = (long) keys[i].key;
+    network->sorted_node[i] = keys[i].node;
+  }
+  free (keys);
+
+  /* Find the nodes of each link and count the arcs of each node */
+  start = malloc ((n_links > 0 ? n_links : 1) * sizeof(long));
+  end = malloc ((n_links > 0 ? n_links : 1) * sizeof(long));
+  network->first_out = calloc (n_nodes + 1, sizeof(long));
+  network->first_in = calloc (n_nodes + 1, sizeof(long));
+  n_arcs = 0;
+  for (i=0; i<n_links; i++) {
+    start[i] = FindRoadNode (network, start_node_id[i]);
+    end[i] = FindRoadNode (network, end_node_id[i]);
+    if (start[i] < 0 || end[i] < 0 || !(cost[i] >= 0)) {
+      start[i] = -1;
+      (*n_skipped)++;
+      continue;
+    }
+    network->first_out[start[i] + 1]++;
+    network->first_in[end[i] + 1]++;
+    n_arcs++;
+    if (!directed) {
+      network->first_out[end[i] + 1]++;
+      network->first_in[start[i] + 1]++;
+      n_arcs++;
+    }
+  }
+  for (i=0; i<n_nodes; i++) {
+    network->first_out[i+1] += network->first_out[i];
+    network->first_in[i+1] += network->first_in[i];
+  }
+
+  /* Fill the arcs */
+  network->n_arcs = n_arcs;
+  network->out_head = malloc ((n_arcs > 0 ? n_arcs : 1) * sizeof(long));
+  network->out_cost = malloc ((n_arcs > 0 ? n_arcs : 1) * sizeof(double));
+  network->out_link = malloc ((n_arcs > 0 ? n_arcs : 1) * sizeof(long));
+  network->in_tail = malloc ((n_arcs > 0 ? n_arcs : 1) * sizeof(long));
+  network->in_cost = malloc ((n_arcs > 0 ? n_arcs : 1) * sizeof(double));
+  network->in_link = malloc ((n_arcs > 0 ? n_arcs : 1) * sizeof(long));
+  fill_out = malloc (n_nodes * sizeof(long));
+  fill_in = malloc (n_nodes * sizeof(long));
+  memcpy (fill_out, network->first_out, n_nodes * sizeof(long));
+  memcpy (fill_in, network->first_in, n_nodes * sizeof(long));
+  for (i=0; i<n_links; i++) {
+    if (start[i] < 0)
+      continue;
+    a = fill_out[start[i]]++;
+    network->out_head[a] = end[i];
+    network->out_cost[a] = cost[i];
+    network->out_link[a] = link_id[i];
+    a = fill_in[end[i]]++;
+    network->in_tail[a] = start[i];
+    network->in_cost[a] = cost[i];
+    network->in_link[a] = link_id[i];
+    if (!directed) {
+      a = fill_out[end[i]]++;
+      network->out_head[a] = start[i];
+      network->out_cost[a] = cost[i];
+      network->out_link[a] = link_id[i];
+      a = fill_in[start[i]]++;
+      network->in_tail[a] = end[i];
+      network->in_cost[a] = cost[i];
+      network->in_link[a] = link_id[i];
+    }
+  }
+  free (fill_out);
+  free (fill_in);
+  free (start);
+  free (end);
+
+  /* Lowest cost per unit of distance, for the A* bound */
+  network->heuristic_factor = HUGE_VAL;
+  for (node=0; node<n_nodes; node++)
+    for (a=network->first_out[node]; a<network->first_out[node+1]; a++) {
+      distance = RoadDistance (network, node, network->out_head[a]);
+      if (distance > 0 && network->out_cost[a] / distance < network->heuristic_factor)
+        network->heuristic_factor = network->out_cost[a] / distance;
+    }
+  if (network->heuristic_factor == HUGE_VAL)
+    network->heuristic_factor = 0;
+
+  return network;
+}
+
+/*******************************************************************************
+** Routine:     FreeRoadNetwork
+**
+** Description: Free a network
+*******************************************************************************/
+void FreeRoadNetwork (road_network_struct *network)
+{
+  if (network == NULL)
+    return;
+  free (network->node_id);
+  free (network->x);
+  free (network->y);
+  free (network->first_out);
+  free (network->out_head);
+  free (network->out_cost);
+  free (network->out_link);
+  free (network->first_in);
+  free (network->in_tail);
+  free (network->in_cost);
+  free (network->in_link);
+  free (network->sorted_id);
+  free (network->sorted_node);
+  free (network);
+}
+
+/*******************************************************************************
+** Routine:     CreateRouteSearch
+**
+** Description: Allocate the work space of searches on a network
+*******************************************************************************/
+route_search_struct *CreateRouteSearch (const road_network_struct *network)
+{
+  route_search_struct *search = malloc (sizeof(route_search_struct));
+  int d;
+
+  search->n_nodes = network->n_nodes;
+  search->round = 0;
+  for (d=0; d<2; d++) {
+    search->stamp[d] = calloc (network->n_nodes, sizeof(unsigned int));
+    search->settled[d] = calloc (network->n_nodes, sizeof(unsigned int));
+    search->cost[d] = malloc (network->n_nodes * sizeof(double));
+    search->parent[d] = malloc (network->n_nodes * sizeof(long));
+    search->parent_link[d] = malloc (network->n_nodes * sizeof(long));
+    search->queue[d].n = 0;
+    search->queue[d].size = 1024;
+    search->queue[d].key = malloc (search->queue[d].size * sizeof(double));
+    search->queue[d].node = malloc (search->queue[d].size * sizeof(long));
+  }
+  search->n_settled = 0;
+  return search;
+}
+
+/*******************************************************************************
+** Routine:     FreeRouteSearch
+**
+** Description: Free the work space of searches
+*******************************************************************************/
+void FreeRouteSearch (route_search_struct *search)
+{
+  int d;
+
+  for (d=0; d<2; d++) {
+    free (search->stamp[d]);
+    free (search->settled[d]);
+    free (search->cost[d]);
+    free (search->parent[d]);
+    free (search->parent_link[d]);
+    free (search->queue[d].key);
+    free (search->queue[d].node);
+  }
+  free (search);
+}
+
+/*******************************************************************************
+** Routine:     QueuePush
+**
+** Description: Add a node to a queue. A node may be in the queue several
+**              times: the entries with an outdated key are skipped when they
+**              come out.
+*******************************************************************************/
+static void QueuePush (route_queue_struct *queue, double key, long node)
+{
+  long i, parent;
+
+  if (queue->n == queue->size) {
+    queue->size *= 2;
+    queue->key = realloc (queue->key, queue->size * sizeof(double));
+    queue->node = realloc (queue->node, queue->size * sizeof(long));
+  }
+  for (i=queue->n++; i>0; i=parent) {
+    parent = (i - 1) / 2;
+    if (queue->key[parent] <= key)
+      break;
+    queue->key[i] = queue->key[parent];
+    queue->node[i] = queue->node[parent];
+  }
+  queue->key[i] = key;
+  queue->node[i] = node;
+}
+
+/*******************************************************************************
+** Routine:     QueuePop
+**
+** Description: Remove the node with the lowest key from a queue
+*******************************************************************************/
+static long QueuePop (route_queue_struct *queue)
+{
+  long   node = queue->node[0], i, child, n, last_node;
+  double last_key;
+
+  n = --queue->n;
+  last_key = queue->key[n];
+  last_node = queue->node[n];
+  for (i=0; (child = 2*i + 1) < n; i=child) {
+    if (child + 1 < n && queue->key[child+1] < queue->key[child])
+      child++;
+    if (queue->key[child] >= last_key)
+      break;
+    queue->key[i] = queue->key[child];
+    queue->node[i] = queue->node[child];
+  }
+  queue->key[i] = last_key;
+  queue->node[i] = last_node;
+  return node;
+}
+
+/*******************************************************************************
+** Routine:     StartRound
+**
+** Description: Invalidate the labels of the previous search
+*******************************************************************************/
+static void StartRound (route_search_struct *search)
+{
+  int d;
+
+  if (++search->round == 0) {
+    for (d=0; d<2; d++) {
+      memset (search->stamp[d], 0, search->n_nodes * sizeof(unsigned int));
+      memset (search->settled[d], 0, search->n_nodes * sizeof(unsigned int));
+    }
+    search->round = 1;
+  }
+  search->queue[0].n = search->queue[1].n = 0;
+  search->n_settled = 0;
+}
+
+/*******************************************************************************
+** Routine:     Label
+**
+** Description: Cost of a node in one direction of the current search
+*******************************************************************************/
+static double Label (const route_search_struct *search, int d, long node)
+{
+  return search->stamp[d][node] == search->round ? search->cost[d][node] : HUGE_VAL;
+}
+
+/*******************************************************************************
+** Routine:     SetLabel
+**
+** Description: Set the cost of a node and the node it is reached from
+*******************************************************************************/
+static void SetLabel (route_search_struct *search, int d, long node, double cost,
+                      long parent, long parent_link)
+{
+  search->stamp[d][node] = search->round;
+  search->cost[d][node] = cost;
+  search->parent[d][node] = parent;
+  search->parent_link[d][node] = parent_link;
+}
+
+/*******************************************************************************
+** Routine:     ForwardSearch
+**
+** Description: Dijkstra's algorithm from the start node, guided towards the
+**              end node by the A* bound if factor is not 0. Returns 1 if the
+**              end node is reached.
+*******************************************************************************/
+static int ForwardSearch (
+  const road_network_struct *network,
+  route_search_struct       *search,
+  long                      start_node,
+  long                      end_node,
+  double                    factor)
+{
+  long   u, v, a;
+  double cost;
+
+  SetLabel (search, 0, start_node, 0, -1, -1);
+  QueuePush (&search->queue[0], 0, start_node);
+  while (search->queue[0].n > 0) {
+    u = QueuePop (&search->queue[0]);
+    if (search->settled[0][u] == search->round)
+      continue;
+    search->settled[0][u] = search->round;
+    search->n_settled++;
+    if (u == end_node)
+      return 1;
+    for (a=network->first_out[u]; a<network->first_out[u+1]; a++) {
+      v = network->out_head[a];
+      cost = search->cost[0][u] + network->out_cost[a];
+      if (cost < Label (search, 0, v)) {
+        SetLabel (search, 0, v, cost, u, network->out_link[a]);
+        QueuePush (&search->queue[0],
+          factor > 0 ? cost + factor * RoadDistance (network, v, end_node) : cost, v);
+      }
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     BidirectionalSearch
+**
+** Description: Dijkstra's algorithm from both ends. Returns the node where
+**              the best path found crosses from the forward search to the
+**              backward search, or -1 if the end node cannot be reached.
+*******************************************************************************/
+static long BidirectionalSearch (
+  const road_network_struct *network,
+  route_search_struct       *search,
+  long                      start_node,
+  long                      end_node)
+{
+  const long   *first, *other;
+  const double *arc_cost;
+  const long   *arc_link;
+  double best = HUGE_VAL, cost, total;
+  long   meet = -1, u, v, a;
+  int    d;
+
+  SetLabel (search, 0, start_node, 0, -1, -1);
+  SetLabel (search, 1, end_node, 0, -1, -1);
+  QueuePush (&search->queue[0], 0, start_node);
+  QueuePush (&search->queue[1], 0, end_node);
+
+  while (search->queue[0].n > 0 && search->queue[1].n > 0) {
+    /* No path through the unsettled nodes can beat the best one found */
+    if (search->queue[0].key[0] + search->queue[1].key[0] >= best)
+      break;
+
+    /* Advance the direction with the lowest cost */
+    d = search->queue[0].key[0] <= search->queue[1].key[0] ? 0 : 1;
+    u = QueuePop (&search->queue[d]);
+    if (search->settled[d][u] == search->round)
+      continue;
+    search->settled[d][u] = search->round;
+    search->n_settled++;
+
+    first = d == 0 ? network->first_out : network->first_in;
+    other = d == 0 ? network->out_head : network->in_tail;
+    arc_cost = d == 0 ? network->out_cost : network->in_cost;
+    arc_link = d == 0 ? network->out_link : network->in_link;
+    for (a=first[u]; a<first[u+1]; a++) {
+      v = other[a];
+      cost = search->cost[d][u] + arc_cost[a];
+      if (cost < Label (search, d, v)) {
+        SetLabel (search, d, v, cost, u, arc_link[a]);
+        QueuePush (&search->queue[d], cost, v);
+        total = cost + Label (search, 1 - d, v);
+        if (total < best) {
+          best = total;
+          meet = v;
+        }
+      }
+    }
+  }
+  return meet;
+}
+
+/*******************************************************************************
+** Routine:     ShortestRoute
+**
+** Description: Find the path of least cost between two nodes (numbers
+**              returned by FindRoadNode). Returns 0 and fills the route if a
+**              path is found, or -1 if the end node cannot be reached.
+*******************************************************************************/
+int ShortestRoute (
+  const road_network_struct *network,
+  route_search_struct       *search,
+  long                      start_node,
+  long                      end_node,
+  int                       method,
+  route_struct              *route)
+{
+  long meet, node;
+  int  n_forward, n_backward, i;
+
+  route->cost = 0;
+  route->n_nodes = 0;
+  route->node_id = NULL;
+  route->link_id = NULL;
+
+  StartRound (search);
+  if (start_node == end_node) {
+    SetLabel (search, 0, start_node, 0, -1, -1);
+    meet = start_node;
+  }
+  else if (method == ROUTE_BIDIRECTIONAL)
+    meet = BidirectionalSearch (network, search, start_node, end_node);
+  else
+    meet = ForwardSearch (network, search, start_node, end_node,
+      method == ROUTE_ASTAR ? network->heuristic_factor : 0) ? end_node : -1;
+  if (meet < 0)
+    return -1;
+
+  /* Count the nodes on both sides of the meeting node */
+  n_forward = 0;
+  for (node=meet; node!=start_node; node=search->parent[0][node])
+    n_forward++;
+  n_backward = 0;
+  if (method == ROUTE_BIDIRECTIONAL && start_node != end_node)
+    for (node=meet; node!=end_node; node=search->parent[1][node])
+      n_backward++;
+
+  route->n_nodes = n_forward + n_backward + 1;
+  route->node_id = malloc (route->n_nodes * sizeof(long));
+  route->link_id = malloc (route->n_nodes * sizeof(long));
+  route->cost = search->cost[0][meet] + (n_backward > 0 ? search->cost[1][meet] : 0);
+
+  /* Walk back to the start node, then on to the end node */
+  node = meet;
+  for (i=n_forward; i>0; i--) {
+    route->node_id[i] = network->node_id[node];
+    route->link_id[i-1] = search->parent_link[0][node];
+    node = search->parent[0][node];
+  }
+  route->node_id[0] = network->node_id[start_node];
+  node = meet;
+  for (i=n_forward+1; i<route->n_nodes; i++) {
+    route->link_id[i-1] = search->parent_link[1][node];
+    node = search->parent[1][node];
+    route->node_id[i] = network->node_id[node];
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     FreeRoute
+**
+** Description: Free the nodes and links of a route
+*******************************************************************************/
+void FreeRoute (route_struct *route)
+{
+  free (route->node_id);
+  free (route->link_id);
+  route->node_id = NULL;
+  route->link_id = NULL;
+  route->n_nodes = 0;
+}
+
+/*******************************************************************************
+** Routine:     ReachableNodes
+**
+** Description: Find the nodes that can be reached from a node within a
+**              cost. The reach must be zeroed before its first use, and can
+**              be reused from one search to the next. Returns the number of
+**              nodes reached, the start node included.
+*******************************************************************************/
+long ReachableNodes (
+  const road_network_struct *network,
+  route_search_struct       *search,
+  long                      start_node,
+  double                    max_cost,
+  route_reach_struct        *reach)
+{
+  long   u, v, a;
+  double key, cost;
+
+  reach->n = 0;
+  StartRound (search);
+  SetLabel (search, 0, start_node, 0, -1, -1);
+  QueuePush (&search->queue[0], 0, start_node);
+  while (search->queue[0].n > 0) {
+    key = search->queue[0].key[0];
+    if (key > max_cost)
+      break;
+    u = QueuePop (&search->queue[0]);
+    if (search->settled[0][u] == search->round)
+      continue;
+    search->settled[0][u] = search->round;
+    search->n_settled++;
+
+    if (reach->n == reach->size) {
+      reach->size = reach->size > 0 ? 2 * reach->size : 1024;
+      reach->node = realloc (reach->node, reach->size * sizeof(long));
+      reach->cost = realloc (reach->cost, reach->size * sizeof(double));
+    }
+    reach->node[reach->n] = u;
+    reach->cost[reach->n] = key;
+    reach->n++;
+
+    for (a=network->first_out[u]; a<network->first_out[u+1]; a++) {
+      v = network->out_head[a];
+      cost = key + network->out_cost[a];
+      if (cost <= max_cost && cost < Label (search, 0, v)) {
+        SetLabel (search, 0, v, cost, u, network->out_link[a]);
+        QueuePush (&search->queue[0], cost, v);
+      }
+    }
+  }
+  return reach->n;
+}
+
+/*******************************************************************************
+** Routine:     FreeReach
+**
+** Description: Free the nodes of a reach
+*******************************************************************************/
+void FreeReach (route_reach_struct *reach)
+{
+  free (reach->node);
+  free (reach->cost);
+  memset (reach, 0, sizeof(route_reach_struct));
+}
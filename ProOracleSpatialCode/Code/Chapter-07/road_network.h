@@ -0,0 +1,144 @@
+/* road_network.h
+
+   In-memory road network and shortest path searches.
+
+   This is the client-side counterpart of the network analysis functions of
+   the SDO_NET Java API (see chapter 10), for networks loaded from the node
+   and link tables of an SDO_NET network (see sdo_net.h).
+
+   The network is stored in compressed sparse row form: the links leaving
+   each node are consecutive in a single array of arcs, and a node only
+   holds the position of its first arc. A second set of arrays holds the
+   arcs entering each node, for backward searches. Undirected links give an
+   arc in each direction.
+
+   The nodes are numbered in the order of a Hilbert curve through their
+   locations, so that nodes that are close on the road are usually close in
+   memory: a search then touches fewer cache lines and pages than with the
+   order of the node ids. The ids of the node table are kept, and
+   FindRoadNode maps an id to a node number.
+
+   ShortestRoute finds the path of least cost between two nodes, with one of
+   three methods:
+
+   - ROUTE_DIJKSTRA: Dijkstra's algorithm from the start node (as
+     shortestPathDijkstra in the Java API)
+   - ROUTE_BIDIRECTIONAL: Dijkstra's algorithm from both ends at the same
+     time, stopping when the two searches meet. It settles about half as
+     many nodes.
+   - ROUTE_ASTAR: the A* algorithm (as shortestPath in the Java API). The
+     search is guided by a lower bound of the cost to the end node: the
+     straight line distance multiplied by the lowest cost per unit of
+     distance of all the links of the network. The bound is exact for costs
+     that are lengths, and weaker for travel times.
+
+   All methods return a path of least cost: they may return different paths
+   when several have the same cost.
+
+   ReachableNodes runs Dijkstra's algorithm from a node without an end
+   node, and returns all the nodes that can be reached within a cost, with
+   their cost (the drive time area of the node, as withinCost in the Java
+   API).
+
+   A network can be searched by several threads at the same time, each with
+   its own route_search_struct.
+
+*/
+#ifndef ROAD_NETWORK_H
+#define ROAD_NETWORK_H
+
+#define ROUTE_DIJKSTRA 1
+#define ROUTE_BIDIRECTIONAL 2
+#define ROUTE_ASTAR 3
+
+#define ROAD_NETWORK_EARTH_RADIUS 6371008.8
+
+/* A road network */
+struct road_network
+{
+    long   n_nodes;
+    long   n_arcs;
+    int    geodetic;                  /* Locations are longitudes and latitudes */
+    long   *node_id;                  /* Id of each node in the node table */
+    double *x;                        /* Location of each node */
+    double *y;
+    long   *first_out;                /* First arc leaving each node (n_nodes + 1) */
+    long   *out_head;                 /* Node at the end of each arc */
+    double *out_cost;
+    long   *out_link;                 /* Id of the link of each arc */
+    long   *first_in;                 /* First arc entering each node (n_nodes + 1) */
+    long   *in_tail;                  /* Node at the start of each arc */
+    double *in_cost;
+    long   *in_link;
+    long   *sorted_id;                /* Node ids in increasing order */
+    long   *sorted_node;              /* Node number of each sorted id */
+    double heuristic_factor;          /* Lowest cost per unit of distance */
+};
+typedef struct road_network road_network_struct;
+
+/* The queue of nodes of one direction of a search */
+struct route_queue
+{
+    long   n;
+    long   size;
+    double *key;
+    long   *node;
+};
+typedef struct route_queue route_queue_struct;
+
+/* Work space of shortest path searches, to be used by one thread at a time.
+   Labels are only valid for nodes whose stamp is the current round, so that
+   the arrays need not be cleared before each search. */
+struct route_search
+{
+    long               n_nodes;
+    unsigned int       round;
+    unsigned int       *stamp[2];     /* Forward and backward directions */
+    unsigned int       *settled[2];
+    double             *cost[2];      /* Cost from the start (or to the end) */
+    long               *parent[2];    /* Previous (or next) node on the path */
+    long               *parent_link[2];
+    route_queue_struct queue[2];
+    long               n_settled;     /* (out) Nodes settled by the last search */
+};
+typedef struct route_search route_search_struct;
+
+/* A path */
+struct route
+{
+    double cost;
+    int    n_nodes;
+    long   *node_id;                  /* Ids of the nodes of the path */
+    long   *link_id;                  /* Ids of the links (n_nodes - 1) */
+};
+typedef struct route route_struct;
+
+/* The nodes reached from a node */
+struct route_reach
+{
+    long   n;
+    long   size;
+    long   *node;                     /* Node numbers, by increasing cost */
+    double *cost;
+};
+typedef struct route_reach route_reach_struct;
+
+road_network_struct *BuildRoadNetwork (long n_nodes, const long *node_id,
+                                       const double *x, const double *y,
+                                       long n_links, const long *link_id,
+                                       const long *start_node_id, const long *end_node_id,
+                                       const double *cost, int directed, int geodetic,
+                                       long *n_skipped);
+void FreeRoadNetwork (road_network_struct *network);
+long FindRoadNode (const road_network_struct *network, long node_id);
+double RoadDistance (const road_network_struct *network, long node1, long node2);
+route_search_struct *CreateRouteSearch (const road_network_struct *network);
+void FreeRouteSearch (route_search_struct *search);
+int  ShortestRoute (const road_network_struct *network, route_search_struct *search,
+                    long start_node, long end_node, int method, route_struct *route);
+void FreeRoute (route_struct *route);
+long ReachableNodes (const road_network_struct *network, route_search_struct *search,
+                     long start_node, double max_cost, route_reach_struct *reach);
+void FreeReach (route_reach_struct *reach);
+
+#endif
@@ -0,0 +1,76 @@
+/* sdo_elements.c
+
+   Decoding of the element info and ordinate arrays of SDO_GEOMETRY objects.
+   See sdo_elements.h.
+
+*/
+#include <stdlib.h>
+#include <oci.h>
+#include "sdo_elements.h"
+
+/*******************************************************************************
+** Routine:     ExtractElements
+**
+** Description: Copy the element info and ordinate arrays of an SDO_GEOMETRY
+**              object into a buffer, growing it as needed
+*******************************************************************************/
+void ExtractElements (
+  OCIEnv                *envhp,
+  OCIError              *errhp,
+  SDO_GEOMETRY          *geometry_object,
+  SDO_GEOMETRY_ind      *geometry_object_ind,
+  element_buffer_struct *buffer)
+{
+  boolean   exists;
+  OCINumber *oci_number;
+  int       i;
+
+  buffer->n_elem_info = 0;
+  buffer->n_ordinates = 0;
+  if (geometry_object_ind->SDO_ELEM_INFO == OCI_IND_NULL ||
+      geometry_object_ind->SDO_ORDINATES == OCI_IND_NULL)
+    return;
+
+  /* Extract SDO_ELEM_INFO array */
+  OCICollSize (envhp, errhp,
+    (OCIColl *)(geometry_object->SDO_ELEM_INFO), &buffer->n_elem_info);
+  if (buffer->n_elem_info > buffer->max_elem_info) {
+    buffer->max_elem_info = buffer->n_elem_info;
+    buffer->elem_info = realloc (buffer->elem_info, sizeof(int) * buffer->max_elem_info);
+  }
+  for (i=0; i<buffer->n_elem_info; i++) {
+    OCICollGetElem(envhp, errhp,
+      (OCIColl *) (geometry_object->SDO_ELEM_INFO),
+      (sb4)       (i),
+      (boolean *) &exists,
+      (dvoid **)  &oci_number,
+      (dvoid **)  0
+    );
+    OCINumberToInt(errhp, oci_number,
+      (uword)sizeof(int),
+      OCI_NUMBER_SIGNED,
+      (dvoid *)&buffer->elem_info[i]
+    );
+  }
+
+  /* Extract SDO_ORDINATES array */
+  OCICollSize (envhp, errhp,
+    (OCIColl *)(geometry_object->SDO_ORDINATES), &buffer->n_ordinates);
+  if (buffer->n_ordinates > buffer->max_ordinates) {
+    buffer->max_ordinates = buffer->n_ordinates;
+    buffer->ordinates = realloc (buffer->ordinates, sizeof(double) * buffer->max_ordinates);
+  }
+  for (i=0; i<buffer->n_ordinates; i++) {
+    OCICollGetElem(envhp, errhp,
+      (OCIColl *) (geometry_object->SDO_ORDINATES),
+      (sb4)       (i),
+      (boolean *) &exists,
+      (dvoid **)  &oci_number,
+      (dvoid **)  0
+    );
+    OCINumberToReal(errhp, oci_number,
+      (uword)sizeof(double),
+      (dvoid *)&buffer->ordinates[i]
+    );
+  }
+}
@@ -0,0 +1,39 @@
+/* sdo_elements.h
+
+   Decoding of the element info and ordinate arrays of SDO_GEOMETRY objects
+   fetched with OCI, as mapped in sdo_geometry.h.
+
+   ExtractElements copies the SDO_ELEM_INFO and SDO_ORDINATES arrays of a
+   geometry into an element buffer, as ints and doubles. The buffer is meant
+   to be reused for all the rows of a fetch: it only grows, when a geometry
+   has more elements than any before it. A geometry with a NULL element info
+   or ordinate array leaves the buffer empty (n_elem_info and n_ordinates are
+   0), which is the case of point geometries stored in SDO_POINT.
+
+   A buffer starts zeroed, and its arrays are released with free(). The OCI
+   environment and error handles are those of the calling program.
+
+*/
+#ifndef SDO_ELEMENTS_H
+#define SDO_ELEMENTS_H
+
+#include <oci.h>
+#include "sdo_geometry.h"
+
+/* Arrays that receive the content of one geometry, reused for all rows */
+struct element_buffer
+{
+    int    n_elem_info;
+    int    max_elem_info;
+    int    *elem_info;
+    int    n_ordinates;
+    int    max_ordinates;
+    double *ordinates;
+};
+typedef struct element_buffer element_buffer_struct;
+
+void ExtractElements (OCIEnv *envhp, OCIError *errhp,
+                      SDO_GEOMETRY *geometry_object, SDO_GEOMETRY_ind *geometry_object_ind,
+                      element_buffer_struct *buffer);
+
+#endif
@@ -0,0 +1,468 @@
+/* sdo_net.c
+
+   Loading of an SDO_NET network into a road network. See sdo_net.h.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <oci.h>
+#include "sdo_net.h"
+
+#define SDO_NET_NAME_SIZE 128         /* Size of table and column names */
+#define SDO_NET_MAX_COLUMNS 4
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* The metadata of a network */
+struct network_metadata
+{
+    char node_table[SDO_NET_NAME_SIZE];
+    char node_geom_column[SDO_NET_NAME_SIZE];
+    char link_table[SDO_NET_NAME_SIZE];
+    char link_cost_column[SDO_NET_NAME_SIZE];
+    char link_direction[SDO_NET_NAME_SIZE];
+    int  srid;
+};
+typedef struct network_metadata network_metadata_struct;
+
+/* The columns fetched by a query: integers first, then doubles */
+struct fetched_columns
+{
+    int    n_longs;
+    int    n_doubles;
+    long   n_rows;
+    long   size;
+    long   *longs[SDO_NET_MAX_COLUMNS];
+    double *doubles[SDO_NET_MAX_COLUMNS];
+};
+typedef struct fetched_columns fetched_columns_struct;
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+static void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     GetNetworkMetadata
+**
+** Description: Read the tables and columns of a network from
+**              USER_SDO_NETWORK_METADATA, and the SRID of its nodes from
+**              USER_SDO_GEOM_METADATA
+*******************************************************************************/
+static void GetNetworkMetadata (
+  OCIEnv                  *envhp,
+  OCIError                *errhp,
+  OCISvcCtx               *svchp,
+  char                    *network,
+  network_metadata_struct *metadata)
+{
+  char      *select_sql =
+    "SELECT m.node_table_name, m.node_geom_column, m.link_table_name, "
+    "m.link_cost_column, m.link_direction, m.no_of_hierarchy_levels, "
+    "(SELECT g.srid FROM user_sdo_geom_metadata g "
+    "WHERE g.table_name = m.node_table_name AND g.column_name = m.node_geom_column) "
+    "FROM user_sdo_network_metadata m WHERE m.network = UPPER(:network)";
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  OCIBind   *network_hp = NULL;
+  OCIDefine *define_hp[7];
+  char      *names[5];
+  sb2       ind[7];
+  int       levels, i;
+
+  names[0] = metadata->node_table;
+  names[1] = metadata->node_geom_column;
+  names[2] = metadata->link_table;
+  names[3] = metadata->link_cost_column;
+  names[4] = metadata->link_direction;
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* NETWORK (string) */
+  status = OCIBindByName(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &network_hp,                     /* (out) Bind Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *) ":NETWORK",             /* (in)  Placeholder */
+    strlen(":NETWORK"),              /* (in)  Placeholder length */
+    (ub1 *) network,                 /* (in)  Value Pointer */
+    strlen(network)+1,               /* (in)  Value Size */
+    SQLT_STR,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variables 1 to 5 = table and column names (strings) */
+  for (i=0; i<5; i++) {
+    status = OCIDefineByPos(select_stmthp, &define_hp[i], errhp, (ub4)(i+1),
+      (dvoid *) names[i], SDO_NET_NAME_SIZE, SQLT_STR,
+      (dvoid *) &ind[i], (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+
+  /* Variable 6 = NO_OF_HIERARCHY_LEVELS (integer) */
+  status = OCIDefineByPos(select_stmthp, &define_hp[5], errhp, (ub4)6,
+    (dvoid *) &levels, sizeof(int), SQLT_INT,
+    (dvoid *) &ind[5], (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 7 = SRID (integer) */
+  status = OCIDefineByPos(select_stmthp, &define_hp[6], errhp, (ub4)7,
+    (dvoid *) &metadata->srid, sizeof(int), SQLT_INT,
+    (dvoid *) &ind[6], (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch the only row */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status == OCI_NO_DATA) {
+    printf ("Network %s is not defined in USER_SDO_NETWORK_METADATA\n", network);
+    exit (1);
+  }
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  for (i=0; i<5; i++)
+    if (ind[i] == OCI_IND_NULL)
+      names[i][0] = '\0';
+  if (ind[6] == OCI_IND_NULL)
+    metadata->srid = 0;
+  if (metadata->node_table[0] == '\0' || metadata->link_table[0] == '\0') {
+    printf ("Network %s has no node or link table\n", network);
+    exit (1);
+  }
+  if (ind[5] == OCI_IND_NOTNULL && levels > 1) {
+    printf ("Network %s has %d hierarchy levels: only one is supported\n", network, levels);
+    exit (1);
+  }
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     FetchColumns
+**
+** Description: Run a query and read all its rows into arrays, with array
+**              fetches. The first n_longs columns are read as integers, the
+**              others as binary doubles. Rows with a NULL integer are
+**              skipped. NULL doubles are read as NaN.
+*******************************************************************************/
+static void FetchColumns (
+  OCIEnv                 *envhp,
+  OCIError               *errhp,
+  OCISvcCtx              *svchp,
+  char                   *select_sql,
+  int                    array_size,
+  fetched_columns_struct *columns)
+{
+  int       nr_fetches = 0;          /* Number of batches fetched */
+  int       rows_in_batch = 0;       /* Number of rows in current batch */
+  boolean   has_more_data;
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  OCIDefine *define_hp;
+  int       n_columns = columns->n_longs + columns->n_doubles;
+  int       i, c, skip;
+  double    start_time = (double) clock() / CLOCKS_PER_SEC;
+
+  /* Host variables: one array per column */
+  long      *long_values[SDO_NET_MAX_COLUMNS];
+  double    *double_values[SDO_NET_MAX_COLUMNS];
+  sb2       *ind[2*SDO_NET_MAX_COLUMNS];
+
+  printf ("Executing query:\nSQL> %s\n", select_sql);
+
+  columns->n_rows = 0;
+  columns->size = 0;
+  for (c=0; c<n_columns; c++)
+    ind[c] = malloc (sizeof(sb2) * array_size);
+  for (c=0; c<columns->n_longs; c++) {
+    long_values[c] = malloc (sizeof(long) * array_size);
+    columns->longs[c] = NULL;
+  }
+  for (c=0; c<columns->n_doubles; c++) {
+    double_values[c] = malloc (sizeof(double) * array_size);
+    columns->doubles[c] = NULL;
+  }
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Define the variables to receive the selected columns */
+  for (c=0; c<n_columns; c++) {
+    if (c < columns->n_longs)
+      status = OCIDefineByPos(
+        select_stmthp,               /* (in)  Statement Handle */
+        &define_hp,                  /* (out) Define Handle */
+        errhp,                       /* (in)  Error Handle */
+        (ub4)(c+1),                  /* (in)  Bind variable position */
+        (dvoid *) long_values[c],    /* (in)  Value Pointer */
+        sizeof(long),                /* (in)  Value Size */
+        SQLT_INT,                    /* (in)  Data Type */
+        (dvoid *) ind[c],            /* (in)  Indicator Pointer */
+        (ub2 *)0,                    /* (out) Length of data fetched (NOT USED) */
+        (ub2 *)0,                    /* (out) Column return codes (NOT USED) */
+        (ub4)OCI_DEFAULT             /* (in)  Operating mode */
+      );
+    else
+      status = OCIDefineByPos(
+        select_stmthp,               /* (in)  Statement Handle */
+        &define_hp,                  /* (out) Define Handle */
+        errhp,                       /* (in)  Error Handle */
+        (ub4)(c+1),                  /* (in)  Bind variable position */
+        (dvoid *) double_values[c - columns->n_longs], /* (in)  Value Pointer */
+        sizeof(double),              /* (in)  Value Size */
+        SQLT_BDOUBLE,                /* (in)  Data Type */
+        (dvoid *) ind[c],            /* (in)  Indicator Pointer */
+        (ub2 *)0,                    /* (out) Length of data fetched (NOT USED) */
+        (ub2 *)0,                    /* (out) Column return codes (NOT USED) */
+        (ub4)OCI_DEFAULT             /* (in)  Operating mode */
+      );
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+
+  /* Execute query and fetch first batch of rows of result set */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)array_size,                 /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+
+  has_more_data = TRUE;
+  do
+  {
+    /* The last batch comes with OCI_NO_DATA: it still needs to be processed */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)select_stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      errhp);
+
+    nr_fetches++;
+
+    /* Grow the output arrays */
+    if (columns->n_rows + rows_in_batch > columns->size) {
+      while (columns->n_rows + rows_in_batch > columns->size)
+        columns->size = columns->size > 0 ? 2 * columns->size : 65536;
+      for (c=0; c<columns->n_longs; c++)
+        columns->longs[c] = realloc (columns->longs[c], sizeof(long) * columns->size);
+      for (c=0; c<columns->n_doubles; c++)
+        columns->doubles[c] = realloc (columns->doubles[c], sizeof(double) * columns->size);
+    }
+
+    /* Copy the rows just fetched */
+    for (i=0; i<rows_in_batch; i++) {
+      skip = 0;
+      for (c=0; c<columns->n_longs; c++)
+        skip |= ind[c][i] == OCI_IND_NULL;
+      if (skip)
+        continue;
+      for (c=0; c<columns->n_longs; c++)
+        columns->longs[c][columns->n_rows] = long_values[c][i];
+      for (c=0; c<columns->n_doubles; c++)
+        columns->doubles[c][columns->n_rows] =
+          ind[columns->n_longs + c][i] == OCI_IND_NULL ? NAN : double_values[c][i];
+      columns->n_rows++;
+    }
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        select_stmthp,                 /* (in)  Statement Handle */
+        errhp,                         /* (in)  Error Handle */
+        (ub4)array_size,               /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(errhp);
+    }
+  }
+  while (has_more_data);
+
+  printf ("%ld rows fetched in %d fetches (%.3f seconds of CPU)\n\n", columns->n_rows,
+    nr_fetches, (double) clock() / CLOCKS_PER_SEC - start_time);
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  for (c=0; c<n_columns; c++)
+    free (ind[c]);
+  for (c=0; c<columns->n_longs; c++)
+    free (long_values[c]);
+  for (c=0; c<columns->n_doubles; c++)
+    free (double_values[c]);
+}
+
+/*******************************************************************************
+** Routine:     FreeColumns
+**
+** Description: Free the arrays of fetched columns
+*******************************************************************************/
+static void FreeColumns (fetched_columns_struct *columns)
+{
+  int c;
+
+  for (c=0; c<columns->n_longs; c++)
+    free (columns->longs[c]);
+  for (c=0; c<columns->n_doubles; c++)
+    free (columns->doubles[c]);
+}
+
+/*******************************************************************************
+** Routine:     LoadSdoNetwork
+**
+** Description: Load the nodes and links of an SDO_NET network
+*******************************************************************************/
+road_network_struct *LoadSdoNetwork (
+  OCIEnv    *envhp,
+  OCIError  *errhp,
+  OCISvcCtx *svchp,
+  char      *network_name,
+  int       array_size)
+{
+  network_metadata_struct metadata;
+  fetched_columns_struct  nodes, links;
+  road_network_struct     *network;
+  char   select_sql[1024];
+  int    directed, geodetic;
+  long   n_skipped;
+
+  GetNetworkMetadata (envhp, errhp, svchp, network_name, &metadata);
+  directed = strcmp (metadata.link_direction, "UNDIRECTED") != 0;
+  geodetic = metadata.srid == 8307 || metadata.srid == 4326;
+  printf ("Network %s: nodes in %s, links in %s, %s, cost %s\n\n", network_name,
+    metadata.node_table, metadata.link_table, directed ? "directed" : "undirected",
+    metadata.link_cost_column[0] != '\0' ? metadata.link_cost_column : "1 per link");
+
+  /* Read the nodes */
+  if (metadata.node_geom_column[0] != '\0')
+    sprintf (select_sql,
+      "SELECT n.node_id, "
+      "NVL(TO_BINARY_DOUBLE(n.%s.SDO_POINT.X), 0), NVL(TO_BINARY_DOUBLE(n.%s.SDO_POINT.Y), 0) "
+      "FROM %s n",
+      metadata.node_geom_column, metadata.node_geom_column, metadata.node_table);
+  else
+    sprintf (select_sql, "SELECT node_id, TO_BINARY_DOUBLE(0), TO_BINARY_DOUBLE(0) FROM %s",
+      metadata.node_table);
+  nodes.n_longs = 1;
+  nodes.n_doubles = 2;
+  FetchColumns (envhp, errhp, svchp, select_sql, array_size, &nodes);
+
+  /* Read the active links */
+  sprintf (select_sql,
+    "SELECT link_id, start_node_id, end_node_id, TO_BINARY_DOUBLE(%s) "
+    "FROM %s WHERE NVL(active, 'Y') = 'Y'",
+    metadata.link_cost_column[0] != '\0' ? metadata.link_cost_column : "1",
+    metadata.link_table);
+  links.n_longs = 3;
+  links.n_doubles = 1;
+  FetchColumns (envhp, errhp, svchp, select_sql, array_size, &links);
+
+  network = BuildRoadNetwork (nodes.n_rows, nodes.longs[0], nodes.doubles[0], nodes.doubles[1],
+    links.n_rows, links.longs[0], links.longs[1], links.longs[2], links.doubles[0],
+    directed, geodetic, &n_skipped);
+  if (n_skipped > 0)
+    printf ("%ld links skipped: unknown node or NULL cost\n", n_skipped);
+
+  FreeColumns (&nodes);
+  FreeColumns (&links);
+  return network;
+}
@@ -0,0 +1,31 @@
+/* sdo_net.h
+
+   Loading of an SDO_NET network into a road network (see road_network.h).
+
+   LoadSdoNetwork reads the metadata of a network from
+   USER_SDO_NETWORK_METADATA (see chapter 10), then reads its node and link
+   tables with array fetches:
+
+     SELECT node_id, <X and Y of the node geometry> FROM node_table
+     SELECT link_id, start_node_id, end_node_id, <link cost>
+       FROM link_table WHERE NVL(active, 'Y') = 'Y'
+
+   The coordinates are those of the SDO_POINT of the node geometries, and
+   are 0 for logical networks. Links without a cost column get a cost of 1.
+   Links with a NULL cost are skipped. The network is geodetic if the SRID of
+   the node geometries is 8307 or 4326.
+
+   Only networks with a single hierarchy level are supported. NULL is
+   returned if the node table is empty.
+
+*/
+#ifndef SDO_NET_H
+#define SDO_NET_H
+
+#include <oci.h>
+#include "road_network.h"
+
+road_network_struct *LoadSdoNetwork (OCIEnv *envhp, OCIError *errhp, OCISvcCtx *svchp,
+                                     char *network, int array_size);
+
+#endif
@@ -0,0 +1,480 @@
+/* shortest_path.c
+
+   This program loads an SDO_NET network (see chapter 10) into memory, and
+   finds shortest paths between its nodes.
+
+   It is the client-side counterpart of the shortestPath and
+   shortestPathDijkstra methods of the SDO_NET Java API (see chapter 10).
+   The node and link tables are read with array fetches into a compressed
+   sparse row network (see sdo_net.h and road_network.h), which is then
+   searched in memory without going back to the database.
+
+   The network is read with the following statements:
+
+     SELECT node_table_name, node_geom_column, link_table_name, ...
+       FROM user_sdo_network_metadata WHERE network = UPPER(:network)
+     SELECT node_id, <X and Y of the node geometry> FROM node_table
+     SELECT link_id, start_node_id, end_node_id, <link cost>
+       FROM link_table WHERE NVL(active, 'Y') = 'Y'
+
+   It illustrates the following concepts:
+   - reading numeric columns with array fetches
+   - reading the metadata of a network
+
+   The program takes the following command line arguments:
+
+     shortest_path username password database network start_node end_node [method] [array_size]
+     shortest_path username password database network RANDOM n_queries [method|ALL] [array_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - network = name of the network
+   - start_node, end_node = ids of the nodes to find the shortest path
+     between. The program writes the nodes and links of the path, its cost,
+     and the time taken by the search.
+   - RANDOM n_queries = find the shortest paths between n_queries pairs of
+     random nodes instead, and report the mean, median, 95th percentile and
+     maximum time of the searches
+   - method = DIJKSTRA, BIDIRECTIONAL or ASTAR (default is BIDIRECTIONAL,
+     see road_network.h). With RANDOM, ALL runs the same pairs with each
+     method in turn, and checks that they find paths of the same cost.
+   - array_size = number of rows to read per fetch (default is 1000 rows)
+
+   Notes:
+
+   The program must be linked with sdo_net.c, road_network.c and
+   spatial_util.c.
+
+   The random pairs are drawn with a fixed seed, so that runs can be
+   compared. Pairs of nodes that are not connected are included in the
+   timings: the search then explores all the nodes reachable from the start.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <oci.h>
+#include "sdo_net.h"
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle*/
+OCIError     *errhp;  /* Error handle */
+OCISvcCtx    *svchp;  /* Service Context handle*/
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_DEFAULT),              /* (in)  Mode: default */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&errhp,                /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ConnectDatabase
+**
+** Description: Connects to the oracle database
+*******************************************************************************/
+void ConnectDatabase(
+        char *username,
+        char *password,
+        char *database)
+{
+  int status;
+  char verbuf[512];
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      errhp,                         /* (in)  Error Handle */
+      &svchp,                        /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get database version */
+  OCIServerVersion(
+    svchp,                             /* (in)  Service Context Handle */
+    errhp,                             /* (in)  Error Handle */
+    verbuf,                            /* (out) Buffer to receive version message */
+    sizeof(verbuf),                    /* (in)  Size of message buffer */
+    OCI_HTYPE_SVCCTX);                 /* (in)  Type of handle (service context) */
+
+  printf("Connected to: %s\n", database);
+  printf("%s\n\n", verbuf);
+}
+
+/*******************************************************************************
+** Routine:     DisconnectDatabase
+**
+** Description: Disconnect from Oracle
+*******************************************************************************/
+void DisconnectDatabase(void)
+{
+  int status;
+
+  status = OCILogoff(svchp, errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)errhp,                  /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+/*******************************************************************************
+** Routine:     ParseMethod
+**
+** Description: Convert the name of a search method. Returns 0 for ALL, -1
+**              if the name is not valid.
+*******************************************************************************/
+int ParseMethod (char *name)
+{
+  if (strcmp (name, "DIJKSTRA") == 0)
+    return ROUTE_DIJKSTRA;
+  if (strcmp (name, "BIDIRECTIONAL") == 0)
+    return ROUTE_BIDIRECTIONAL;
+  if (strcmp (name, "ASTAR") == 0)
+    return ROUTE_ASTAR;
+  if (strcmp (name, "ALL") == 0)
+    return 0;
+  return -1;
+}
+
+/*******************************************************************************
+** Routine:     MethodName
+**
+** Description: Name of a search method
+*******************************************************************************/
+char *MethodName (int method)
+{
+  switch (method) {
+    case ROUTE_DIJKSTRA:      return "DIJKSTRA";
+    case ROUTE_BIDIRECTIONAL: return "BIDIRECTIONAL";
+    default:                  return "ASTAR";
+  }
+}
+
+/*******************************************************************************
+** Routine:     RandomNode
+**
+** Description: Draw a random node number, with a 64-bit linear congruential
+**              generator (rand() is too short for large networks on some
+**              platforms)
+*******************************************************************************/
+long RandomNode (unsigned long long *seed, long n_nodes)
+{
+  *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (long) ((*seed >> 33) % (unsigned long long) n_nodes);
+}
+
+/*******************************************************************************
+** Routine:     CompareDoubles
+**
+** Description: Comparison function for qsort
+*******************************************************************************/
+int CompareDoubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return x < y ? -1 : x > y;
+}
+
+/*******************************************************************************
+** Routine:     FindPath
+**
+** Description: Find the shortest path between two nodes and print it
+*******************************************************************************/
+void FindPath (
+  road_network_struct *network,
+  long                start_id,
+  long                end_id,
+  int                 method)
+{
+  route_search_struct *search;
+  route_struct        route;
+  long   start_node, end_node;
+  double start_time, elapsed;
+  int    i;
+
+  start_node = FindRoadNode (network, start_id);
+  end_node = FindRoadNode (network, end_id);
+  if (start_node < 0 || end_node < 0) {
+    printf ("Node %ld is not in the network\n", start_node < 0 ? start_id : end_id);
+    exit (1);
+  }
+
+  search = CreateRouteSearch (network);
+  start_time = ElapsedSeconds ();
+  if (ShortestRoute (network, search, start_node, end_node, method, &route) != 0) {
+    elapsed = ElapsedSeconds () - start_time;
+    printf ("No path from node %ld to node %ld\n", start_id, end_id);
+  }
+  else {
+    elapsed = ElapsedSeconds () - start_time;
+    printf ("Path from node %ld to node %ld: cost %.6f, %d nodes\n",
+      start_id, end_id, route.cost, route.n_nodes);
+    for (i=0; i<route.n_nodes; i++) {
+      printf ("  node %ld", route.node_id[i]);
+      if (i < route.n_nodes - 1)
+        printf ("  link %ld", route.link_id[i]);
+      printf ("\n");
+    }
+    FreeRoute (&route);
+  }
+  printf ("%s search: %ld nodes settled in %.3f ms\n",
+    MethodName (method), search->n_settled, elapsed * 1000);
+  FreeRouteSearch (search);
+}
+
+/*******************************************************************************
+** Routine:     RandomPaths
+**
+** Description: Find the shortest paths between random pairs of nodes, with
+**              one or all methods, and report the time taken
+*******************************************************************************/
+void RandomPaths (
+  road_network_struct *network,
+  long                n_queries,
+  int                 method)
+{
+  route_search_struct *search;
+  route_struct        route;
+  unsigned long long  seed;
+  long   *start_node, *end_node;
+  double *cost, *latency, total, settled, c, start_time;
+  long   q, n_found, n_different = 0;
+  int    m, first_method, last_method;
+
+  start_node = malloc (sizeof(long) * n_queries);
+  end_node = malloc (sizeof(long) * n_queries);
+  cost = malloc (sizeof(double) * n_queries);
+  latency = malloc (sizeof(double) * n_queries);
+  seed = 12345;
+  for (q=0; q<n_queries; q++) {
+    start_node[q] = RandomNode (&seed, network->n_nodes);
+    end_node[q] = RandomNode (&seed, network->n_nodes);
+  }
+
+  first_method = method != 0 ? method : ROUTE_DIJKSTRA;
+  last_method = method != 0 ? method : ROUTE_ASTAR;
+  search = CreateRouteSearch (network);
+  printf ("%-14s %8s %10s %10s %10s %10s %12s\n", "Method", "Found",
+    "Mean ms", "Median ms", "P95 ms", "Max ms", "Settled");
+  for (m=first_method; m<=last_method; m++) {
+    total = 0;
+    settled = 0;
+    n_found = 0;
+    for (q=0; q<n_queries; q++) {
+      start_time = ElapsedSeconds ();
+      if (ShortestRoute (network, search, start_node[q], end_node[q], m, &route) == 0) {
+        c = route.cost;
+        n_found++;
+        FreeRoute (&route);
+      }
+      else
+        c = -1;
+      latency[q] = (ElapsedSeconds () - start_time) * 1000;
+      total += latency[q];
+      settled += search->n_settled;
+
+      /* Compare with the cost found by the first method */
+      if (m == first_method)
+        cost[q] = c;
+      else if ((c < 0) != (cost[q] < 0) || fabs (c - cost[q]) > 1e-9 * (1 + fabs (c)))
+        n_different++;
+    }
+    qsort (latency, n_queries, sizeof(double), CompareDoubles);
+    printf ("%-14s %8ld %10.3f %10.3f %10.3f %10.3f %12.0f\n", MethodName (m), n_found,
+      total / n_queries, latency[n_queries / 2], latency[(long) (n_queries * 0.95)],
+      latency[n_queries - 1], settled / n_queries);
+  }
+  if (first_method != last_method) {
+    if (n_different == 0)
+      printf ("All methods found paths of the same cost\n");
+    else
+      printf ("%ld paths differ in cost between methods\n", n_different);
+  }
+
+  FreeRouteSearch (search);
+  free (start_node);
+  free (end_node);
+  free (cost);
+  free (latency);
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char *username, *password, *database, *network_name;
+    int  array_size, method, random;
+    long start_id = 0, end_id = 0, n_queries = 0;
+    road_network_struct *network;
+    double start_time;
+
+    if( argc < 7 || argc > 9) {
+      printf("USAGE: %s <username> <password> <database> <network> <start_node> <end_node> [DIJKSTRA|BIDIRECTIONAL|ASTAR] [<array_size>]\n", argv[0]);
+      printf("       %s <username> <password> <database> <network> RANDOM <n_queries> [DIJKSTRA|BIDIRECTIONAL|ASTAR|ALL] [<array_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      network_name = argv[4];
+      random = strcmp (argv[5], "RANDOM") == 0;
+      if (random) {
+        n_queries = atol(argv[6]);
+        if (n_queries <= 0) {
+          printf ("Invalid number of queries: must be positive\n");
+          exit( 1 );
+        }
+      }
+      else {
+        start_id = atol(argv[5]);
+        end_id = atol(argv[6]);
+      }
+      if (argc > 7)
+        method = ParseMethod (argv[7]);
+      else
+        method = ROUTE_BIDIRECTIONAL;
+      if (method < 0 || (method == 0 && !random)) {
+        printf ("Invalid method: must be DIJKSTRA, BIDIRECTIONAL or ASTAR%s\n",
+          random ? " or ALL" : "");
+        exit( 1 );
+      }
+      if (argc > 8)
+        array_size = atoi(argv[8]);
+      else
+        array_size = 1000;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Connect to database */
+    ConnectDatabase(username, password, database);
+
+    /* Load the network */
+    start_time = ElapsedSeconds ();
+    network = LoadSdoNetwork (envhp, errhp, svchp, network_name, array_size);
+    if (network == NULL) {
+      printf ("The network has no nodes\n");
+      exit( 1 );
+    }
+    printf ("Network of %ld nodes and %ld arcs loaded in %.3f seconds\n\n",
+      network->n_nodes, network->n_arcs, ElapsedSeconds () - start_time);
+
+    /* disconnect from database */
+    DisconnectDatabase();
+
+    if (random)
+      RandomPaths (network, n_queries, method);
+    else
+      FindPath (network, start_id, end_id, method);
+
+    FreeRoadNetwork (network);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
@@ -0,0 +1,675 @@
+/* simplify.c
+
+   Client-side simplification of line and polygon geometries. See simplify.h
+   for a description of the methods.
+
+   The X and Y values of the points being simplified are first copied into
+   two separate arrays. The distance and area computations then run as plain
+   loops over those arrays, with no dependency between iterations, which
+   the compiler turns into vector instructions when optimizing (-O3 on gcc
+   and clang, /O2 on Visual C++).
+
+   The rings of a polygon (an exterior ring and the interior rings that
+   follow it) are simplified together: the validity checks look for
+   intersections between all their segments, so that an interior ring cannot
+   end up crossing the exterior ring.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "simplify.h"
+
+#define SIMPLIFY_MAX_RETRIES 4        /* Number of times the tolerance is halved */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* Work arrays, reused from one geometry to the next */
+struct simplify_work
+{
+    int    size;                      /* Allocated number of points */
+    double *x;                        /* X values of the points */
+    double *y;                        /* Y values of the points */
+    double *value;                    /* Distances or areas */
+    char   *keep;                     /* 1 for the points that are kept */
+    int    *stack;                    /* Douglas-Peucker ranges */
+    int    *prev, *next;              /* Visvalingam linked list */
+    int    *heap, *heap_pos;          /* Visvalingam priority queue */
+    double *sx, *sy;                  /* Simplified rings */
+    int    *segment;                  /* Segments sorted for the validity check */
+    int    *segment_ring;             /* Ring of each segment */
+    int    *segment_first;            /* First segment of that ring */
+    int    *segment_last;             /* Last segment of that ring */
+};
+typedef struct simplify_work simplify_work_struct;
+
+static simplify_work_struct work;
+
+/* Minimum X of the segments, used when sorting them */
+static double *sort_min_x;
+
+/*******************************************************************************
+** Routine:     ReserveWork
+**
+** Description: Make sure the work arrays can hold n_points points
+*******************************************************************************/
+static void ReserveWork (int n_points)
+{
+  if (n_points <= work.size)
+    return;
+  work.size = n_points + n_points / 2;
+  work.x = realloc (work.x, work.size * sizeof(double));
+  work.y = realloc (work.y, work.size * sizeof(double));
+  work.value = realloc (work.value, work.size * sizeof(double));
+  work.keep = realloc (work.keep, work.size);
+  work.stack = realloc (work.stack, 2 * work.size * sizeof(int));
+  work.prev = realloc (work.prev, work.size * sizeof(int));
+  work.next = realloc (work.next, work.size * sizeof(int));
+  work.heap = realloc (work.heap, work.size * sizeof(int));
+  work.heap_pos = realloc (work.heap_pos, work.size * sizeof(int));
+  work.sx = realloc (work.sx, work.size * sizeof(double));
+  work.sy = realloc (work.sy, work.size * sizeof(double));
+  work.segment = realloc (work.segment, work.size * sizeof(int));
+  work.segment_ring = realloc (work.segment_ring, work.size * sizeof(int));
+  work.segment_first = realloc (work.segment_first, work.size * sizeof(int));
+  work.segment_last = realloc (work.segment_last, work.size * sizeof(int));
+  if (work.x == NULL || work.y == NULL || work.value == NULL || work.keep == NULL
+      || work.stack == NULL || work.prev == NULL || work.next == NULL
+      || work.heap == NULL || work.heap_pos == NULL || work.sx == NULL
+      || work.sy == NULL || work.segment == NULL || work.segment_ring == NULL
+      || work.segment_first == NULL || work.segment_last == NULL) {
+    printf ("Not enough memory to simplify %d points\n", n_points);
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     SegmentDistances
+**
+** Description: Compute the squared distance of points first+1 to last-1 to the
+**              line through points first and last (or to point first if both
+**              points are the same)
+*******************************************************************************/
+static void SegmentDistances (
+  const double *x,
+  const double *y,
+  int          first,
+  int          last,
+  double       *distance)
+{
+  double ax = x[first];
+  double ay = y[first];
+  double dx = x[last] - ax;
+  double dy = y[last] - ay;
+  double length2 = dx*dx + dy*dy;
+  double px, py, cross, inverse;
+  int    i;
+
+  /* No branches and no dependency between iterations: these loops vectorize */
+  if (length2 > 0) {
+    inverse = 1.0 / length2;
+    for (i=first+1; i<last; i++) {
+      px = x[i] - ax;
+      py = y[i] - ay;
+      cross = px*dy - py*dx;
+      distance[i] = cross * cross * inverse;
+    }
+  }
+  else {
+    for (i=first+1; i<last; i++) {
+      px = x[i] - ax;
+      py = y[i] - ay;
+      distance[i] = px*px + py*py;
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     TriangleAreas
+**
+** Description: Compute the area of the triangles formed by points first+1 to
+**              last-1 with their neighbours
+*******************************************************************************/
+static void TriangleAreas (
+  const double *x,
+  const double *y,
+  int          first,
+  int          last,
+  double       *area)
+{
+  double a;
+  int    i;
+
+  for (i=first+1; i<last; i++) {
+    a = (x[i]-x[i-1]) * (y[i+1]-y[i-1]) - (x[i+1]-x[i-1]) * (y[i]-y[i-1]);
+    area[i] = (a < 0 ? -a : a) * 0.5;
+  }
+}
+
+/*******************************************************************************
+** Routine:     DouglasPeucker
+**
+** Description: Mark the points of a line or ring to keep, using the
+**              Douglas-Peucker method. Returns the number of points kept.
+*******************************************************************************/
+static int DouglasPeucker (
+  const double *x,
+  const double *y,
+  int          n_points,
+  double       tolerance,
+  int          is_ring,
+  char         *keep)
+{
+  double tolerance2 = tolerance * tolerance;
+  double max_distance;
+  int    n_stack = 0;
+  int    n_kept = 2;
+  int    first, last, farthest, i;
+
+  memset (keep, 0, n_points);
+  keep[0] = keep[n_points-1] = 1;
+
+  if (is_ring) {
+    /* The end points of a ring are the same: split it at the point farthest
+       from them */
+    SegmentDistances (x, y, 0, n_points-1, work.value);
+    farthest = 1;
+    for (i=2; i<n_points-1; i++)
+      if (work.value[i] > work.value[farthest])
+        farthest = i;
+    keep[farthest] = 1;
+    n_kept++;
+    work.stack[n_stack++] = 0;
+    work.stack[n_stack++] = farthest;
+    work.stack[n_stack++] = farthest;
+    work.stack[n_stack++] = n_points-1;
+  }
+  else {
+    work.stack[n_stack++] = 0;
+    work.stack[n_stack++] = n_points-1;
+  }
+
+  while (n_stack > 0) {
+    last = work.stack[--n_stack];
+    first = work.stack[--n_stack];
+    if (last - first < 2)
+      continue;
+
+    /* Find the point farthest from the segment */
+    SegmentDistances (x, y, first, last, work.value);
+    farthest = first + 1;
+    max_distance = work.value[farthest];
+    for (i=first+2; i<last; i++)
+      if (work.value[i] > max_distance) {
+        max_distance = work.value[i];
+        farthest = i;
+      }
+
+    /* Keep it if it is too far, and look at both sides */
+    if (max_distance > tolerance2) {
+      keep[farthest] = 1;
+      n_kept++;
+      work.stack[n_stack++] = first;
+      work.stack[n_stack++] = farthest;
+      work.stack[n_stack++] = farthest;
+      work.stack[n_stack++] = last;
+    }
+  }
+  return n_kept;
+}
+
+/*******************************************************************************
+** Routine:     HeapUp / HeapDown
+**
+** Description: Restore the order of the Visvalingam priority queue after the
+**              area of a point went down / up
+*******************************************************************************/
+static void HeapUp (int position)
+{
+  int point = work.heap[position];
+  int parent;
+
+  while (position > 0) {
+    parent = (position - 1) / 2;
+    if (work.value[work.heap[parent]] <= work.value[point])
+      break;
+    work.heap[position] = work.heap[parent];
+    work.heap_pos[work.heap[position]] = position;
+    position = parent;
+  }
+  work.heap[position] = point;
+  work.heap_pos[point] = position;
+}
+
+static void HeapDown (int position, int n_heap)
+{
+  int point = work.heap[position];
+  int child;
+
+  while ((child = 2 * position + 1) < n_heap) {
+    if (child + 1 < n_heap && work.value[work.heap[child+1]] < work.value[work.heap[child]])
+      child++;
+    if (work.value[point] <= work.value[work.heap[child]])
+      break;
+    work.heap[position] = work.heap[child];
+    work.heap_pos[work.heap[position]] = position;
+    position = child;
+  }
+  work.heap[position] = point;
+  work.heap_pos[point] = position;
+}
+
+/*******************************************************************************
+** Routine:     UpdateArea
+**
+** Description: Recompute the area of a point after one of its neighbours was
+**              removed. The area never goes below that of the removed point,
+**              so that points are removed in order of increasing area.
+*******************************************************************************/
+static void UpdateArea (
+  const double *x,
+  const double *y,
+  int          point,
+  double       min_area,
+  int          n_heap)
+{
+  int    p = work.prev[point];
+  int    q = work.next[point];
+  double old_area = work.value[point];
+  double a;
+
+  a = (x[point]-x[p]) * (y[q]-y[p]) - (x[q]-x[p]) * (y[point]-y[p]);
+  a = (a < 0 ? -a : a) * 0.5;
+  work.value[point] = a > min_area ? a : min_area;
+  if (work.value[point] < old_area)
+    HeapUp (work.heap_pos[point]);
+  else
+    HeapDown (work.heap_pos[point], n_heap);
+}
+
+/*******************************************************************************
+** Routine:     Visvalingam
+**
+** Description: Mark the points of a line or ring to keep, using the
+**              Visvalingam-Whyatt method. Returns the number of points kept.
+*******************************************************************************/
+static int Visvalingam (
+  const double *x,
+  const double *y,
+  int          n_points,
+  double       tolerance,
+  int          is_ring,
+  char         *keep)
+{
+  double min_area = tolerance * tolerance;
+  double area;
+  int    min_points = is_ring ? 4 : 2;
+  int    n_kept = n_points;
+  int    n_heap = 0;
+  int    point, i;
+
+  memset (keep, 1, n_points);
+  if (n_points <= min_points)
+    return n_kept;
+
+  TriangleAreas (x, y, 0, n_points-1, work.value);
+  for (i=0; i<n_points; i++) {
+    work.prev[i] = i - 1;
+    work.next[i] = i + 1;
+  }
+  for (i=1; i<n_points-1; i++) {
+    work.heap[n_heap] = i;
+    work.heap_pos[i] = n_heap;
+    n_heap++;
+  }
+  for (i=n_heap/2-1; i>=0; i--)
+    HeapDown (i, n_heap);
+
+  /* Remove the point with the smallest area until all areas are large enough */
+  while (n_heap > 0 && n_kept > min_points) {
+    point = work.heap[0];
+    area = work.value[point];
+    if (area >= min_area)
+      break;
+    work.heap[0] = work.heap[--n_heap];
+    work.heap_pos[work.heap[0]] = 0;
+    HeapDown (0, n_heap);
+    keep[point] = 0;
+    n_kept--;
+
+    work.next[work.prev[point]] = work.next[point];
+    work.prev[work.next[point]] = work.prev[point];
+    if (work.prev[point] > 0)
+      UpdateArea (x, y, work.prev[point], area, n_heap);
+    if (work.next[point] < n_points-1)
+      UpdateArea (x, y, work.next[point], area, n_heap);
+  }
+  return n_kept;
+}
+
+/*******************************************************************************
+** Routine:     SignedArea
+**
+** Description: Twice the signed area of a ring (positive if counterclockwise)
+*******************************************************************************/
+static double SignedArea (
+  const double *x,
+  const double *y,
+  int          n_points)
+{
+  double area = 0;
+  int    i;
+
+  for (i=0; i<n_points-1; i++)
+    area += x[i] * y[i+1] - x[i+1] * y[i];
+  return area;
+}
+
+/*******************************************************************************
+** Routine:     Orientation / SegmentsIntersect
+**
+** Description: Tell if two segments have a point in common
+*******************************************************************************/
+static int Orientation (double ax, double ay, double bx, double by, double cx, double cy)
+{
+  double o = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+  return o > 0 ? 1 : (o < 0 ? -1 : 0);
+}
+
+static int OnSegment (double ax, double ay, double bx, double by, double cx, double cy)
+{
+  return cx >= (ax < bx ? ax : bx) && cx <= (ax > bx ? ax : bx)
+      && cy >= (ay < by ? ay : by) && cy <= (ay > by ? ay : by);
+}
+
+static int SegmentsIntersect (const double *x, const double *y, int a, int b)
+{
+  int o1 = Orientation (x[a], y[a], x[a+1], y[a+1], x[b], y[b]);
+  int o2 = Orientation (x[a], y[a], x[a+1], y[a+1], x[b+1], y[b+1]);
+  int o3 = Orientation (x[b], y[b], x[b+1], y[b+1], x[a], y[a]);
+  int o4 = Orientation (x[b], y[b], x[b+1], y[b+1], x[a+1], y[a+1]);
+
+  if (o1 != o2 && o3 != o4)
+    return 1;
+  return (o1 == 0 && OnSegment (x[a], y[a], x[a+1], y[a+1], x[b], y[b]))
+      || (o2 == 0 && OnSegment (x[a], y[a], x[a+1], y[a+1], x[b+1], y[b+1]))
+      || (o3 == 0 && OnSegment (x[b], y[b], x[b+1], y[b+1], x[a], y[a]))
+      || (o4 == 0 && OnSegment (x[b], y[b], x[b+1], y[b+1], x[a+1], y[a+1]));
+}
+
+static int CompareSegments (const void *a, const void *b)
+{
+  double xa = sort_min_x[*(const int *)a];
+  double xb = sort_min_x[*(const int *)b];
+  return xa < xb ? -1 : (xa > xb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     ValidRings
+**
+** Description: Check that the simplified rings of a polygon are still valid:
+**              at least 4 points each, same orientation as before, and no
+**              intersection between segments other than consecutive ones.
+**              The segments are sorted on their minimum X, so that each one
+**              is only compared with the segments that overlap it along X.
+*******************************************************************************/
+static int ValidRings (
+  const int *ring_start,
+  const int *ring_points,
+  int       n_rings)
+{
+  int    n_segments = 0;
+  int    n_simplified = 0;
+  int    i, j, k, r, a, b, start, n;
+  double max_x, min_y, max_y;
+
+  for (r=0; r<n_rings; r++) {
+    start = ring_start[r];
+    n = 0;
+    for (i=0; i<ring_points[r]; i++)
+      if (work.keep[start+i]) {
+        work.sx[n_simplified+n] = work.x[start+i];
+        work.sy[n_simplified+n] = work.y[start+i];
+        n++;
+      }
+    if (n < 4)
+      return 0;
+    if (SignedArea (work.x+start, work.y+start, ring_points[r])
+        * SignedArea (work.sx+n_simplified, work.sy+n_simplified, n) <= 0)
+      return 0;
+    /* Segment k goes from simplified point k to point k+1 */
+    for (k=n_simplified; k<n_simplified+n-1; k++) {
+      work.value[k] = work.sx[k] < work.sx[k+1] ? work.sx[k] : work.sx[k+1];
+      work.segment[n_segments++] = k;
+      work.segment_ring[k] = r;
+      work.segment_first[k] = n_simplified;
+      work.segment_last[k] = n_simplified + n - 2;
+    }
+    n_simplified += n;
+  }
+
+  sort_min_x = work.value;
+  qsort (work.segment, n_segments, sizeof(int), CompareSegments);
+
+  for (i=0; i<n_segments; i++) {
+    a = work.segment[i];
+    max_x = work.sx[a] > work.sx[a+1] ? work.sx[a] : work.sx[a+1];
+    min_y = work.sy[a] < work.sy[a+1] ? work.sy[a] : work.sy[a+1];
+    max_y = work.sy[a] > work.sy[a+1] ? work.sy[a] : work.sy[a+1];
+    for (j=i+1; j<n_segments && work.value[work.segment[j]] <= max_x; j++) {
+      b = work.segment[j];
+      /* Consecutive segments of a ring share a point, and so do the first
+         and the last one */
+      if (work.segment_ring[a] == work.segment_ring[b]) {
+        if (a - b == 1 || b - a == 1)
+          continue;
+        if ((a < b ? a : b) == work.segment_first[a] && (a > b ? a : b) == work.segment_last[a])
+          continue;
+      }
+      if ((work.sy[b] < min_y && work.sy[b+1] < min_y)
+          || (work.sy[b] > max_y && work.sy[b+1] > max_y))
+        continue;
+      if (SegmentsIntersect (work.sx, work.sy, a, b))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+/*******************************************************************************
+** Routine:     SimplifyPoints
+**
+** Description: Mark the points of a line or ring to keep. Returns the number
+**              of points kept.
+*******************************************************************************/
+static int SimplifyPoints (
+  const double *x,
+  const double *y,
+  int          n_points,
+  double       tolerance,
+  int          method,
+  int          is_ring,
+  char         *keep)
+{
+  if (n_points <= (is_ring ? 4 : 2)) {
+    memset (keep, 1, n_points);
+    return n_points;
+  }
+  if (method == SIMPLIFY_VISVALINGAM)
+    return Visvalingam (x, y, n_points, tolerance, is_ring, keep);
+  return DouglasPeucker (x, y, n_points, tolerance, is_ring, keep);
+}
+
+/*******************************************************************************
+** Routine:     SimplifyElements
+**
+** Description: Simplify the elements of a geometry in place. Updates the
+**              offsets in elem_info, and returns the new number of ordinates.
+*******************************************************************************/
+int SimplifyElements (
+  int                     *elem_info,
+  int                     n_elem_info,
+  double                  *ordinates,
+  int                     n_ordinates,
+  int                     dim,
+  simplify_options_struct *options)
+{
+  int    n_elements = n_elem_info / 3;
+  int    n_out = 0;                   /* Number of ordinates written so far */
+  int    n_rings, n_points, n_skip;
+  int    first, last, start, end, etype, interpretation;
+  int    e, r, i, k, retry;
+  int    *ring_start;
+  int    *ring_points;
+  double tolerance;
+
+  if (dim < 2 || n_elements == 0 || options->method == SIMPLIFY_NONE)
+    return n_ordinates;
+  options->points_in += n_ordinates / dim;
+
+  ring_start = malloc (n_elements * sizeof(int));
+  ring_points = malloc (n_elements * sizeof(int));
+
+  n_skip = 0;
+  for (e=0; e<n_elements; e=last+1) {
+    etype = elem_info[e*3+1];
+    interpretation = elem_info[e*3+2];
+
+    /* Find the elements to process together: a line, or a polygon with all
+       its rings, or a single element to copy */
+    last = e;
+    if (n_skip == 0 && (etype == 1003 || etype == 2003) && interpretation == 1)
+      while (last+1 < n_elements && elem_info[(last+1)*3+1] == 2003 && elem_info[(last+1)*3+2] == 1)
+        last++;
+    first = e;
+
+    /* Ordinates of those elements */
+    start = elem_info[first*3] - 1;
+    end = last+1 < n_elements ? elem_info[(last+1)*3] - 1 : n_ordinates;
+
+    if (n_skip > 0 || !(interpretation == 1 && (etype == 2 || etype == 1003 || etype == 2003))) {
+      /* Copy the element unchanged. The subelements of a compound element
+         (etype 4, 1005 or 2005) are all copied */
+      if (n_skip > 0)
+        n_skip--;
+      else if (etype == 4 || etype == 1005 || etype == 2005)
+        n_skip = interpretation;
+      elem_info[e*3] = n_out + 1;
+      memmove (ordinates + n_out, ordinates + start, (end - start) * sizeof(double));
+      n_out += end - start;
+      continue;
+    }
+
+    /* Load the X and Y values of the points */
+    n_points = (end - start) / dim;
+    ReserveWork (n_points);
+    for (i=0; i<n_points; i++) {
+      work.x[i] = ordinates[start + i*dim];
+      work.y[i] = ordinates[start + i*dim + 1];
+    }
+    n_rings = last - first + 1;
+    for (r=0; r<n_rings; r++) {
+      ring_start[r] = (elem_info[(first+r)*3] - 1 - start) / dim;
+      ring_points[r] = (r+1 < n_rings ? (elem_info[(first+r+1)*3] - 1 - start) / dim : n_points)
+        - ring_start[r];
+    }
+
+    if (etype == 2) {
+      SimplifyPoints (work.x, work.y, n_points, options->tolerance, options->method, 0, work.keep);
+    }
+    else {
+      /* Simplify the rings, and make the tolerance smaller until they are valid */
+      tolerance = options->tolerance;
+      for (retry=0; retry<=SIMPLIFY_MAX_RETRIES; retry++) {
+        for (r=0; r<n_rings; r++)
+          SimplifyPoints (work.x + ring_start[r], work.y + ring_start[r], ring_points[r],
+            tolerance, options->method, 1, work.keep + ring_start[r]);
+        if (ValidRings (ring_start, ring_points, n_rings))
+          break;
+        tolerance = tolerance / 2;
+      }
+      if (retry > SIMPLIFY_MAX_RETRIES)
+        memset (work.keep, 1, n_points);
+    }
+
+    /* Write the points kept, with all their ordinates */
+    for (r=0; r<n_rings; r++) {
+      elem_info[(first+r)*3] = n_out + 1;
+      for (i=ring_start[r]; i<ring_start[r]+ring_points[r]; i++)
+        if (work.keep[i]) {
+          for (k=0; k<dim; k++)
+            ordinates[n_out+k] = ordinates[start + i*dim + k];
+          n_out += dim;
+        }
+    }
+  }
+
+  free (ring_start);
+  free (ring_points);
+  options->points_out += n_out / dim;
+  return n_out;
+}
+
+/*******************************************************************************
+** Routine:     ParseSimplifyOptions
+**
+** Description: Look for the --simplify=<tolerance> and --simplify-method=DP|VW
+**              options on the command line, and remove them from it. Returns
+**              1 if simplification is requested.
+*******************************************************************************/
+int ParseSimplifyOptions (
+  int                     *argc,
+  char                    **argv,
+  simplify_options_struct *options)
+{
+  int method = SIMPLIFY_DOUGLAS_PEUCKER;
+  int i, n;
+
+  memset (options, 0, sizeof(simplify_options_struct));
+  options->method = SIMPLIFY_NONE;
+
+  for (i=1, n=1; i<*argc; i++) {
+    if (strncmp (argv[i], "--simplify=", 11) == 0) {
+      options->tolerance = atof (argv[i] + 11);
+      if (options->tolerance <= 0) {
+        printf ("Invalid simplification tolerance: must be positive\n");
+        exit (1);
+      }
+    }
+    else if (strncmp (argv[i], "--simplify-method=", 18) == 0) {
+      if (strcmp (argv[i] + 18, "DP") == 0)
+        method = SIMPLIFY_DOUGLAS_PEUCKER;
+      else if (strcmp (argv[i] + 18, "VW") == 0)
+        method = SIMPLIFY_VISVALINGAM;
+      else {
+        printf ("Invalid simplification method: must be DP or VW\n");
+        exit (1);
+      }
+    }
+    else
+      argv[n++] = argv[i];
+  }
+  *argc = n;
+  argv[n] = NULL;
+
+  if (options->tolerance > 0)
+    options->method = method;
+  return options->method != SIMPLIFY_NONE;
+}
+
+/*******************************************************************************
+** Routine:     PrintSimplifyStatistics
+**
+** Description: Print out the number of points removed by simplification
+*******************************************************************************/
+void PrintSimplifyStatistics (
+  simplify_options_struct *options)
+{
+  if (options->method == SIMPLIFY_NONE)
+    return;
+  printf ("Simplification (%s, tolerance %g): %ld of %ld points kept\n",
+    options->method == SIMPLIFY_VISVALINGAM ? "Visvalingam" : "Douglas-Peucker",
+    options->tolerance, options->points_out, options->points_in);
+}
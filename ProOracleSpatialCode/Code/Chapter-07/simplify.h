@@ -0,0 +1,52 @@
+/* simplify.h
+
+   Client-side simplification of line and polygon geometries.
+
+   This is the client-side counterpart of SDO_UTIL.SIMPLIFY (and of
+   SDO_SAM.SIMPLIFY_GEOMETRY): it works directly on the SDO_ELEM_INFO and
+   SDO_ORDINATES arrays of a geometry that has been loaded into memory, so
+   that programs can reduce the size of what they print out or export.
+
+   Two methods are available:
+
+   - SIMPLIFY_DOUGLAS_PEUCKER removes the points whose distance to the
+     simplified line is less than the tolerance.
+   - SIMPLIFY_VISVALINGAM removes the points whose effective area (the area
+     of the triangle they form with their neighbours) is less than the
+     square of the tolerance, smallest first.
+
+   Only the X and Y ordinates are used to decide which points to remove. The
+   other ordinates (Z, measures) of the points that are kept are preserved.
+
+   Line strings (etype 2) and rings (etypes 1003 and 2003) made of straight
+   line segments are simplified. Point elements, arcs, rectangles, circles and
+   compound elements are copied unchanged. Line strings keep at least their
+   two end points. A ring is only replaced by its simplified version if that
+   version is still a valid ring: at least 4 points, the same orientation and
+   no self-intersection. If not, the ring is simplified again with a smaller
+   tolerance, and finally kept as it is.
+
+*/
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#define SIMPLIFY_NONE            0
+#define SIMPLIFY_DOUGLAS_PEUCKER 1
+#define SIMPLIFY_VISVALINGAM     2
+
+/* Simplification settings, as set from the command line */
+struct simplify_options
+{
+    int    method;                    /* SIMPLIFY_NONE if not requested */
+    double tolerance;
+    long   points_in;                 /* Number of points seen */
+    long   points_out;                /* Number of points kept */
+};
+typedef struct simplify_options simplify_options_struct;
+
+int  SimplifyElements (int *elem_info, int n_elem_info, double *ordinates, int n_ordinates,
+                       int dim, simplify_options_struct *options);
+int  ParseSimplifyOptions (int *argc, char **argv, simplify_options_struct *options);
+void PrintSimplifyStatistics (simplify_options_struct *options);
+
+#endif
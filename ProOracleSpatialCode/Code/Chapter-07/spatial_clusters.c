@@ -0,0 +1,274 @@
+/* spatial_clusters.c
+
+   This program groups the points of a point dump into clusters, and writes
+   out the cluster of each point and the convex hull of each cluster.
+
+   It is the client-side counterpart of SDO_SAM.SPATIAL_CLUSTERS (see
+   appendix A). The points are first extracted from the database with
+   read_points_array.c, which writes them to a point dump file (see
+   point_dump.h), preferably with an id column:
+
+     read_points_array scott tiger orcl customers location 10000 0 id --dump=customers.pts
+
+   The dump is mapped in memory and clustered with the k-means or DBSCAN
+   method of cluster.c, using several threads.
+
+   It illustrates the following concepts:
+   - processing a point dump
+   - writing geometries in the input format of load_geom.c
+
+   The program takes the following command line arguments:
+
+     spatial_clusters dump_file output KMEANS k [iterations] [mini_batch_size] [threads]
+     spatial_clusters dump_file output DBSCAN eps min_points [threads]
+
+   where
+
+   - dump_file = name of the point dump file to read
+   - output = prefix of the output files (see below)
+   - KMEANS = partition the points into k clusters
+     - k = number of clusters
+     - iterations = maximum number of iterations (default is 100)
+     - mini_batch_size = number of points sampled per iteration. If 0 (the
+       default), all points are used in each iteration
+   - DBSCAN = group the points that are close to each other
+     - eps = distance within which points are neighbours, in the unit of the
+       coordinates
+     - min_points = number of neighbours (including itself) that makes a
+       point a core point
+   - threads = number of threads (default is one per processor)
+
+   Two files are written:
+
+   - <output>.csv lists the id of each point and its cluster number. The ids
+     are those of the dump, or the position of the point in the dump (from 1)
+     if the dump has no ids. Cluster numbers start at 1. With DBSCAN, noise
+     points get cluster number 0.
+   - <output>_hulls.txt contains the convex hull of each cluster, in the
+     format read by load_geom.c, with the cluster number as id. Hulls are
+     polygons, or lines or points for clusters of collinear or identical
+     points. They can be loaded into a table with:
+
+     load_geom scott tiger orcl customer_clusters id geom customers_hulls.txt
+
+   Notes:
+
+   The program must be linked with cluster.c, point_dump.c and
+   spatial_util.c. On Linux and other POSIX systems it also needs the POSIX
+   threads library. It does not connect to the database.
+
+   The distances are computed on the coordinates as they are: for geodetic
+   data (longitude and latitude), eps is in degrees.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "point_dump.h"
+#include "cluster.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     WriteClusters
+**
+** Description: Write the id and cluster of each point to a CSV file
+*******************************************************************************/
+void WriteClusters (
+  char              *filename,
+  point_dump_struct *dump,
+  int               *cluster)
+{
+  FILE *file;
+  long i;
+
+  file = fopen (filename, "w");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    exit (1);
+  }
+  fprintf (file, "id,cluster\n");
+  for (i=0; i<dump->count; i++)
+    fprintf (file, "%ld,%d\n", dump->id != NULL ? (long) dump->id[i] : i+1, cluster[i]);
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     WriteHulls
+**
+** Description: Write the hull of each cluster in the input format of
+**              load_geom.c: id type dim x1 y1 ... xn yn
+*******************************************************************************/
+void WriteHulls (
+  char                *filename,
+  cluster_hull_struct *hulls,
+  int                 n_clusters)
+{
+  FILE *file;
+  int  c, i, type;
+
+  file = fopen (filename, "w");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    exit (1);
+  }
+  for (c=0; c<n_clusters; c++) {
+    if (hulls[c].n_points == 0)
+      continue;
+    type = hulls[c].n_points == 1 ? 1 : (hulls[c].n_points == 2 ? 2 : 3);
+    fprintf (file, "%d %d 2", hulls[c].cluster, type);
+    for (i=0; i<hulls[c].n_points; i++)
+      fprintf (file, " %.17g %.17g", hulls[c].x[i], hulls[c].y[i]);
+    fprintf (file, "\n");
+  }
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char   *dump_file, *output, *method;
+    char   filename[1024];
+    point_dump_struct   dump;
+    cluster_hull_struct *hulls;
+    int    *cluster;
+    double *center_x, *center_y;
+    int    k = 0, iterations = 100, mini_batch_size = 0, min_points = 0;
+    double eps = 0;
+    int    n_threads, n_clusters, n_iterations;
+    long   i, n_noise;
+    double start_time;
+
+    if (argc < 5) {
+      printf("USAGE: %s <dump_file> <output> KMEANS <k> [<iterations>] [<mini_batch_size>] [<threads>]\n", argv[0]);
+      printf("       %s <dump_file> <output> DBSCAN <eps> <min_points> [<threads>]\n", argv[0]);
+      exit( 1 );
+    }
+    dump_file = argv[1];
+    output = argv[2];
+    method = argv[3];
+    n_threads = ProcessorThreads(CLUSTER_MAX_THREADS);
+    if (strcmp (method, "KMEANS") == 0) {
+      if (argc > 8) {
+        printf ("Too many arguments for KMEANS\n");
+        exit( 1 );
+      }
+      k = atoi(argv[4]);
+      if (argc > 5)
+        iterations = atoi(argv[5]);
+      if (argc > 6)
+        mini_batch_size = atoi(argv[6]);
+      if (argc > 7)
+        n_threads = atoi(argv[7]);
+      if (k <= 0 || iterations <= 0 || mini_batch_size < 0) {
+        printf ("Invalid KMEANS parameters: k and iterations must be positive\n");
+        exit( 1 );
+      }
+    }
+    else if (strcmp (method, "DBSCAN") == 0) {
+      if (argc < 6 || argc > 7) {
+        printf ("DBSCAN needs <eps> and <min_points>\n");
+        exit( 1 );
+      }
+      eps = atof(argv[4]);
+      min_points = atoi(argv[5]);
+      if (argc > 6)
+        n_threads = atoi(argv[6]);
+      if (eps <= 0 || min_points <= 0) {
+        printf ("Invalid DBSCAN parameters: eps and min_points must be positive\n");
+        exit( 1 );
+      }
+    }
+    else {
+      printf ("Invalid method: must be KMEANS or DBSCAN\n");
+      exit( 1 );
+    }
+    if (n_threads <= 0 || n_threads > CLUSTER_MAX_THREADS) {
+      printf ("Invalid number of threads: must be between 1 and %d\n", CLUSTER_MAX_THREADS);
+      exit( 1 );
+    }
+    if (strlen (output) > sizeof(filename) - 16) {
+      printf ("Output prefix too long\n");
+      exit( 1 );
+    }
+
+    /* Map the dump: the arrays are ready to use */
+    if (OpenPointDump (dump_file, &dump) != 0)
+      exit( 1 );
+    printf ("%ld points, %d threads\n", (long) dump.count, n_threads);
+    if (dump.count == 0) {
+      ClosePointDump (&dump);
+      return 0;
+    }
+    cluster = malloc (dump.count * sizeof(int));
+
+    /* Cluster the points */
+    start_time = ElapsedSeconds ();
+    if (k > 0) {
+      center_x = malloc (k * sizeof(double));
+      center_y = malloc (k * sizeof(double));
+      n_iterations = KMeansClusters (dump.x, dump.y, (long) dump.count, k, iterations,
+        mini_batch_size, n_threads, cluster, center_x, center_y);
+      n_clusters = k;
+      printf ("k-means: %d clusters after %d iterations in %.3f seconds\n",
+        n_clusters, n_iterations, ElapsedSeconds () - start_time);
+      for (i=0; i<k; i++)
+        printf ("Cluster %ld: center (%f, %f)\n", i+1, center_x[i], center_y[i]);
+      free (center_x);
+      free (center_y);
+    }
+    else {
+      n_clusters = DbscanClusters (dump.x, dump.y, (long) dump.count, eps, min_points,
+        n_threads, cluster);
+      n_noise = 0;
+      for (i=0; i<dump.count; i++)
+        n_noise += cluster[i] == 0;
+      printf ("DBSCAN: %d clusters and %ld noise points in %.3f seconds\n",
+        n_clusters, n_noise, ElapsedSeconds () - start_time);
+    }
+
+    /* Compute the hulls */
+    start_time = ElapsedSeconds ();
+    hulls = ClusterHulls (dump.x, dump.y, (long) dump.count, cluster, n_clusters, n_threads);
+    printf ("Hulls computed in %.3f seconds\n", ElapsedSeconds () - start_time);
+
+    /* Write the results */
+    sprintf (filename, "%s.csv", output);
+    WriteClusters (filename, &dump, cluster);
+    printf ("Clusters written to %s\n", filename);
+    sprintf (filename, "%s_hulls.txt", output);
+    WriteHulls (filename, hulls, n_clusters);
+    printf ("Hulls written to %s\n", filename);
+
+    FreeClusterHulls (hulls, n_clusters);
+    free (cluster);
+    ClosePointDump (&dump);
+    return 0;
+}
@@ -0,0 +1,597 @@
+/* spatial_join.c
+
+   This program finds all pairs of interacting geometries between two
+   tables, and writes the ids of each pair to a CSV file.
+
+   It is the client-side counterpart of the SDO_JOIN table function with the
+   ANYINTERACT mask (see chapter 8):
+
+     SELECT a.id1, b.id2
+       FROM TABLE(SDO_JOIN('table1', 'geo_column1', 'table2', 'geo_column2',
+                           'mask=ANYINTERACT')) j,
+            table1 a, table2 b
+      WHERE j.rowid1 = a.rowid AND j.rowid2 = b.rowid
+
+   Instead of running the join in the database, it reads both tables with
+   array fetches of SDO_GEOMETRY objects, as read_geom_array.c does, and
+   joins them in memory with the partitioned join of geom_join.c, using
+   several threads. The tables do not need a spatial index.
+
+   Each table is read with the following statement:
+
+     SELECT id_column, geo_column FROM tablename
+
+   It illustrates the following concepts:
+   - reading geometries with array fetches
+   - reading a numeric column and an object column in the same fetch
+   - converting the elements of a geometry
+
+   The program takes the following command line arguments:
+
+     spatial_join username password database table1 id_column1 geo_column1 table2 id_column2 geo_column2 output [array_size] [threads] [grid_size]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - table1, id_column1, geo_column1 = the first table, its numeric id column
+     and its geometry column
+   - table2, id_column2, geo_column2 = the same for the second table
+   - output = name of the CSV file to write the pairs to (id1,id2)
+   - array_size = number of rows to read per fetch (default is 1000 rows)
+   - threads = number of join threads (default is one per processor)
+   - grid_size = number of cells per side of the grid that partitions the
+     data. If 0 (the default), it is chosen so that each cell holds about 64
+     geometries
+
+   Notes:
+
+   The program must be linked with geom_join.c, sdo_elements.c and
+   spatial_util.c. On Linux and other POSIX systems it also needs the POSIX
+   threads library.
+
+   Both tables must use the same coordinate system. The coordinates are
+   compared as they are, without tolerance, and arcs are replaced by straight
+   lines (see geom_join.h): the result may differ slightly from SDO_JOIN for
+   geometries that only touch, or for geodetic data.
+
+   Rows with a NULL id or geometry, and geometries with an invalid element
+   info array, are skipped.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <oci.h>
+#include "sdo_geometry.h"
+#include "sdo_elements.h"
+#include "geom_join.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle*/
+OCIError     *errhp;  /* Error handle */
+OCISvcCtx    *svchp;  /* Service Context handle*/
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_DEFAULT+OCI_OBJECT),   /* (in)  Mode: handles objects */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&errhp,                /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ConnectDatabase
+**
+** Description: Connects to the oracle database
+*******************************************************************************/
+void ConnectDatabase(
+        char *username,
+        char *password,
+        char *database)
+{
+  int status;
+  char verbuf[512];
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      errhp,                         /* (in)  Error Handle */
+      &svchp,                        /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get database version */
+  OCIServerVersion(
+    svchp,                             /* (in)  Service Context Handle */
+    errhp,                             /* (in)  Error Handle */
+    verbuf,                            /* (out) Buffer to receive version message */
+    sizeof(verbuf),                    /* (in)  Size of message buffer */
+    OCI_HTYPE_SVCCTX);                 /* (in)  Type of handle (service context) */
+
+  printf("Connected to: %s\n", database);
+  printf("%s\n\n", verbuf);
+}
+
+/*******************************************************************************
+** Routine:     DisconnectDatabase
+**
+** Description: Disconnect from Oracle
+*******************************************************************************/
+void DisconnectDatabase(void)
+{
+  int status;
+
+  status = OCILogoff(svchp, errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)errhp,                  /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+/*******************************************************************************
+** Routine:     AddGeometry
+**
+** Description: Add a geometry fetched from the database to a layer.
+**              Returns 0 if it was added, -1 if it was skipped.
+*******************************************************************************/
+int AddGeometry (
+  long                  id,
+  SDO_GEOMETRY          *geometry_object,
+  SDO_GEOMETRY_ind      *geometry_object_ind,
+  element_buffer_struct *buffer,
+  join_layer_struct     *layer)
+{
+  int    gtype = 0, has_point = 0;
+  double x = 0, y = 0;
+
+  if (geometry_object_ind->_atomic == OCI_IND_NULL)
+    return -1;
+
+  /* Extract SDO_GTYPE */
+  if (geometry_object_ind->SDO_GTYPE == OCI_IND_NOTNULL)
+    OCINumberToInt (
+      errhp,
+      &(geometry_object->SDO_GTYPE),
+      (uword) sizeof (int),
+      OCI_NUMBER_SIGNED,
+      (dvoid *) &gtype);
+
+  /* Extract SDO_POINT */
+  if (geometry_object_ind->SDO_POINT._atomic == OCI_IND_NOTNULL &&
+      geometry_object_ind->SDO_POINT.X == OCI_IND_NOTNULL &&
+      geometry_object_ind->SDO_POINT.Y == OCI_IND_NOTNULL) {
+    has_point = 1;
+    OCINumberToReal(
+      errhp, &(geometry_object->SDO_POINT.X), (uword)sizeof(double), (dvoid *)&x);
+    OCINumberToReal(
+      errhp, &(geometry_object->SDO_POINT.Y), (uword)sizeof(double), (dvoid *)&y);
+  }
+
+  /* Extract the elements and ordinates */
+  ExtractElements (envhp, errhp, geometry_object, geometry_object_ind, buffer);
+
+  return AddJoinGeometry (layer, id, gtype, has_point, x, y,
+    buffer->elem_info, buffer->n_elem_info, buffer->ordinates, buffer->n_ordinates);
+}
+
+/*******************************************************************************
+** Routine:     ReadLayer
+**
+** Description: Read the ids and geometries of a table into a layer
+*******************************************************************************/
+void ReadLayer (
+  char              *tablename,
+  char              *idcolumn,
+  char              *geocolumn,
+  int               array_size,
+  join_layer_struct *layer)
+{
+  long      rows_fetched = 0;        /* Row counter */
+  long      rows_skipped = 0;        /* Rows with a NULL or invalid geometry */
+  int       nr_fetches = 0;          /* Number of batches fetched */
+  int       rows_in_batch = 0;       /* Number of rows in current batch */
+  boolean   has_more_data;
+  char      select_sql[1024];        /* SQL Statement */
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  int       i;
+  double    start_time;
+
+  /* Define handles for host variables */
+  OCIDefine         *id_hp;
+  OCIDefine         *geometry_hp;
+
+  /* Type descriptor for geometry object type */
+  OCIType           *geometry_type_desc;
+
+  /* Host variables */
+  long              id[array_size];
+  sb2               id_ind[array_size];
+  SDO_GEOMETRY      *geometry_obj[array_size];
+  SDO_GEOMETRY_ind  *geometry_ind[array_size];
+
+  element_buffer_struct buffer;
+
+  /* Construct the select statement */
+  sprintf (select_sql, "SELECT %s, %s FROM %s", idcolumn, geocolumn, tablename);
+  printf ("Executing query:\nSQL> %s\n", select_sql);
+  start_time = ElapsedSeconds ();
+
+  /* Initialize array of geometry pointers */
+  for (i=0; i<array_size; i++) {
+    geometry_obj[i] = NULL;
+    geometry_ind[i] = NULL;
+  }
+  memset (&buffer, 0, sizeof(buffer));
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get type descriptor for geometry object type */
+  status = OCITypeByName (
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    errhp,                           /* (in)  Error Handle */
+    svchp,                           /* (in)  Service Context Handle */
+    "MDSYS",                         /* (in)  Type owner name */
+    strlen("MDSYS"),                 /* (in)  (length) */
+    "SDO_GEOMETRY",                  /* (in)  Type name */
+    strlen("SDO_GEOMETRY"),          /* (in)  (length) */
+    0,                               /* (in)  Version name (NOT USED) */
+    0,                               /* (in)  (length) */
+    OCI_DURATION_SESSION,            /* (in)  Pin duration */
+    OCI_TYPEGET_HEADER ,             /* (in)  Get option */
+    &geometry_type_desc);            /* (out) Type descriptor */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Define the variables to receive the selected columns */
+
+  /* Variable 1 = id (integer) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &id_hp,                          /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Bind variable position */
+    (dvoid *) id,                    /* (in)  Value Pointer */
+    sizeof(long),                    /* (in)  Value Size */
+    SQLT_INT,                        /* (in)  Data Type */
+    (dvoid *) id_ind,                /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 2 = geometry (ADT) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &geometry_hp,                    /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)2,                          /* (in)  Bind variable position */
+    (dvoid *)0,                      /* (in)  Value Pointer (NOT USED) */
+    0,                               /* (in)  Value Size (NOT USED) */
+    SQLT_NTY,                        /* (in)  Data Type */
+    (dvoid *)0,                      /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  status = OCIDefineObject(
+    geometry_hp,                     /* (in)  Define handle */
+    errhp,                           /* (in)  Error handle */
+    geometry_type_desc,              /* (in)  Geometry type descriptor */
+    (dvoid **) &geometry_obj,        /* (in)  Value Pointer */
+    (ub4 *)0,                        /* (in)  Value Size (NOT USED) */
+    (dvoid **) &geometry_ind,        /* (in)  Indicator Pointer */
+    (ub4 *)0                         /* (in)  Indicator Size */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch first batch of rows of result set */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)array_size,                 /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+
+  has_more_data = TRUE;
+  do
+  {
+    /* The last batch comes with OCI_NO_DATA: it still needs to be processed */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)select_stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      errhp);
+
+    nr_fetches++;
+
+    /* Convert the geometries just fetched */
+    for (i=0; i<rows_in_batch; i++) {
+      rows_fetched++;
+      if (id_ind[i] == OCI_IND_NULL ||
+          AddGeometry (id[i], geometry_obj[i], geometry_ind[i], &buffer, layer) != 0)
+        rows_skipped++;
+    }
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        select_stmthp,                 /* (in)  Statement Handle */
+        errhp,                         /* (in)  Error Handle */
+        (ub4)array_size,               /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(errhp);
+    }
+  }
+  while (has_more_data);
+
+  printf ("%ld rows fetched in %d fetches, %ld skipped, in %.3f seconds\n\n",
+    rows_fetched, nr_fetches, rows_skipped, ElapsedSeconds () - start_time);
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  free (buffer.elem_info);
+  free (buffer.ordinates);
+}
+
+/*******************************************************************************
+** Routine:     WritePairs
+**
+** Description: Write the ids of the pairs to a CSV file
+*******************************************************************************/
+void WritePairs (
+  char               *filename,
+  join_result_struct *result)
+{
+  FILE *file;
+  long i;
+
+  file = fopen (filename, "w");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    exit (1);
+  }
+  fprintf (file, "id1,id2\n");
+  for (i=0; i<result->n_pairs; i++)
+    fprintf (file, "%ld,%ld\n", result->pairs[i].id1, result->pairs[i].id2);
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char *username, *password, *database, *output;
+    char *tablename1, *idcolumn1, *geocolumn1;
+    char *tablename2, *idcolumn2, *geocolumn2;
+    int  array_size, n_threads, grid_size;
+    join_layer_struct  layer1, layer2;
+    join_result_struct result;
+    double start_time, elapsed;
+
+    if( argc < 11 || argc > 14) {
+      printf("USAGE: %s <username> <password> <database> <table1> <id_column1> <geo_column1> <table2> <id_column2> <geo_column2> <output> [<array_size>] [<threads>] [<grid_size>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      tablename1 = argv[4];
+      idcolumn1 = argv[5];
+      geocolumn1 = argv[6];
+      tablename2 = argv[7];
+      idcolumn2 = argv[8];
+      geocolumn2 = argv[9];
+      output = argv[10];
+      if (argc > 11)
+        array_size = atoi(argv[11]);
+      else
+        array_size = 1000;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 12)
+        n_threads = atoi(argv[12]);
+      else
+        n_threads = ProcessorThreads(JOIN_MAX_THREADS);
+      if (n_threads <= 0 || n_threads > JOIN_MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", JOIN_MAX_THREADS);
+        exit( 1 );
+      }
+      if (argc > 13)
+        grid_size = atoi(argv[13]);
+      else
+        grid_size = 0;
+      if (grid_size < 0 || grid_size > JOIN_MAX_GRID_SIZE) {
+        printf ("Invalid grid size: must be between 0 and %d\n", JOIN_MAX_GRID_SIZE);
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Connect to database */
+    ConnectDatabase(username, password, database);
+
+    /* Read both layers */
+    InitJoinLayer (&layer1);
+    InitJoinLayer (&layer2);
+    ReadLayer (tablename1, idcolumn1, geocolumn1, array_size, &layer1);
+    ReadLayer (tablename2, idcolumn2, geocolumn2, array_size, &layer2);
+
+    /* disconnect from database */
+    DisconnectDatabase();
+
+    /* Join them */
+    start_time = ElapsedSeconds ();
+    JoinLayers (&layer1, &layer2, grid_size, n_threads, &result);
+    elapsed = ElapsedSeconds () - start_time;
+    printf ("Joined %ld and %ld geometries with %d threads\n",
+      layer1.n_geometries, layer2.n_geometries, result.n_threads);
+    printf ("Grid of %d x %d cells, %ld cells joined, %ld ranges stolen\n",
+      result.grid_size, result.grid_size, result.n_cells, result.n_stolen);
+    printf ("%ld candidate pairs, %ld interacting pairs in %.3f seconds",
+      result.n_candidates, result.n_pairs, elapsed);
+    if (elapsed > 0)
+      printf (" (%.0f pairs per second)", result.n_pairs / elapsed);
+    printf ("\n");
+
+    /* Write the pairs */
+    WritePairs (output, &result);
+    printf ("Pairs written to %s\n", output);
+
+    FreeJoinResult (&result);
+    FreeJoinLayer (&layer1);
+    FreeJoinLayer (&layer2);
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* spatial_util.c
+
+   Small routines shared by the modules of this chapter. See spatial_util.h.
+
+*/
+#include <stddef.h>
+#include <stdint.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <pthread.h>
+#endif
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Routine:     HilbertKey
+**
+** Description: Position of a cell along a Hilbert curve that covers a square
+**              of side order (a power of 2)
+*******************************************************************************/
+uint64_t HilbertKey (long order, long x, long y)
+{
+  uint64_t key = 0;
+  long     s, rx, ry, swap;
+
+  for (s=order/2; s>0; s/=2) {
+    rx = (x & s) > 0;
+    ry = (y & s) > 0;
+    key += (uint64_t) s * s * ((3 * rx) ^ ry);
+    if (ry == 0) {
+      if (rx == 1) {
+        x = order - 1 - x;
+        y = order - 1 - y;
+      }
+      swap = x;
+      x = y;
+      y = swap;
+    }
+  }
+  return key;
+}
+
+/*******************************************************************************
+** Routine:     ProcessorThreads
+**
+** Description: Default number of threads: one per processor, up to
+**              max_threads
+*******************************************************************************/
+int ProcessorThreads (int max_threads)
+{
+#ifndef _WIN32
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+  if (n > max_threads)
+    n = max_threads;
+  return n > 0 ? (int) n : 1;
+#else
+  (void) max_threads;
+  return 1;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     RunJobs
+**
+** Description: Run a routine on each of n_jobs jobs, one thread per job. The
+**              calling thread runs the first job, and the jobs past
+**              SPATIAL_MAX_THREADS.
+*******************************************************************************/
+void RunJobs (
+  void   *(*routine) (void *),
+  void   *jobs,
+  size_t job_size,
+  int    n_jobs)
+{
+  int       t;
+#ifndef _WIN32
+  pthread_t threads[SPATIAL_MAX_THREADS];
+  int       started[SPATIAL_MAX_THREADS];
+
+  for (t=1; t<n_jobs && t<SPATIAL_MAX_THREADS; t++)
+    started[t] = pthread_create (&threads[t], NULL, routine, (char *)jobs + t*job_size) == 0;
+  routine (jobs);
+  for (t=1; t<n_jobs; t++)
+    if (t < SPATIAL_MAX_THREADS && started[t])
+      pthread_join (threads[t], NULL);
+    else
+      routine ((char *)jobs + t*job_size);
+#else
+  for (t=0; t<n_jobs; t++)
+    routine ((char *)jobs + t*job_size);
+#endif
+}
@@ -0,0 +1,42 @@
+/* spatial_util.h
+
+   Small routines shared by the modules of this chapter.
+
+   HilbertKey gives the position of a cell along a Hilbert curve. Sorting
+   cells, rows or nodes on that key places the ones that are close in space
+   close to each other in memory or in the order of processing. It is used to
+   order the cells of a join grid (geom_join.c), the nodes of a road network
+   (road_network.c) and the groups of a cascaded union (aggr_union.c).
+
+   ProcessorThreads gives the default number of threads of the multithreaded
+   modules: one per processor, up to the limit of the module. On Windows,
+   where the modules run single-threaded, it returns 1.
+
+   RunJobs runs a routine on an array of jobs, one thread per job, and waits
+   for all of them. The calling thread runs the first job, and a job whose
+   thread cannot be started runs in the calling thread once the others are
+   done, so the jobs always complete. At most SPATIAL_MAX_THREADS threads
+   are started; further jobs also run in the calling thread. It is used by
+   the k-means and DBSCAN clustering (cluster.c), the nearest point search
+   (point_tree.c), the contraction of a road network
+   (contraction_hierarchy.c), the drive time polygons (isochrone.c) and the
+   street search (street_index.c). On Windows all jobs run in the calling
+   thread.
+
+   Any program that is linked with one of those modules must also be linked
+   with spatial_util.c.
+
+*/
+#ifndef SPATIAL_UTIL_H
+#define SPATIAL_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SPATIAL_MAX_THREADS 64        /* Most threads started by RunJobs */
+
+uint64_t HilbertKey (long order, long x, long y);
+int      ProcessorThreads (int max_threads);
+void     RunJobs (void *(*routine) (void *), void *jobs, size_t job_size, int n_jobs);
+
+#endif
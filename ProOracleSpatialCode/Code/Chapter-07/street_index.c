@@ -0,0 +1,632 @@
+/* street_index.c
+
+   Packed R-tree of street segments and reverse geocoding. See
+   street_index.h for a description of the method.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "street_index.h"
+#include "spatial_util.h"
+
+#define METERS_PER_DEGREE (STREET_INDEX_EARTH_RADIUS * M_PI / 180)
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A segment or node being packed, with the coordinates it is sorted on */
+struct str_entry
+{
+    double x;
+    double y;
+    long   item;
+};
+typedef struct str_entry str_entry_struct;
+
+/* The locations searched by one thread */
+struct street_job
+{
+    const street_index_struct *index;
+    const double              *x;
+    const double              *y;
+    long                      first, last;
+    double                    max_distance;
+    street_match_struct       *matches;
+};
+typedef struct street_job street_job_struct;
+
+/*******************************************************************************
+** Routine:     CompareX, CompareY
+**
+** Description: Order entries on X or on Y (for qsort)
+*******************************************************************************/
+static int CompareX (const void *a, const void *b)
+{
+  double xa = ((const str_entry_struct *) a)->x;
+  double xb = ((const str_entry_struct *) b)->x;
+  return xa < xb ? -1 : (xa > xb ? 1 : 0);
+}
+
+static int CompareY (const void *a, const void *b)
+{
+  double ya = ((const str_entry_struct *) a)->y;
+  double yb = ((const str_entry_struct *) b)->y;
+  return ya < yb ? -1 : (ya > yb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     StrOrder
+**
+** Description: Sort entries in Sort-Tile-Recursive order: consecutive groups
+**              of STREET_INDEX_NODE_SIZE entries form compact nodes
+*******************************************************************************/
+static void StrOrder (str_entry_struct *entries, long n)
+{
+  long n_nodes = (n + STREET_INDEX_NODE_SIZE - 1) / STREET_INDEX_NODE_SIZE;
+  long n_slices = (long) ceil (sqrt ((double) n_nodes));
+  long slice_size = n_slices * STREET_INDEX_NODE_SIZE;
+  long s;
+
+  qsort (entries, n, sizeof(str_entry_struct), CompareX);
+  for (s=0; s<n; s+=slice_size)
+    qsort (entries + s, n - s < slice_size ? n - s : slice_size,
+      sizeof(str_entry_struct), CompareY);
+}
+
+/*******************************************************************************
+** Routine:     PermuteDoubles, PermuteLongs, PermuteInts
+**
+** Description: Reorder a range of an array: element i becomes the element
+**              at position first + entries[i].item
+*******************************************************************************/
+static void PermuteDoubles (double *values, long first, const str_entry_struct *entries,
+                            long n, double *work)
+{
+  long i;
+  for (i=0; i<n; i++)
+    work[i] = values[first + entries[i].item];
+  memcpy (values + first, work, n * sizeof(double));
+}
+
+static void PermuteLongs (long *values, long first, const str_entry_struct *entries,
+                          long n, long *work)
+{
+  long i;
+  for (i=0; i<n; i++)
+    work[i] = values[first + entries[i].item];
+  memcpy (values + first, work, n * sizeof(long));
+}
+
+static void PermuteInts (int *values, long first, const str_entry_struct *entries,
+                         long n, int *work)
+{
+  long i;
+  for (i=0; i<n; i++)
+    work[i] = values[first + entries[i].item];
+  memcpy (values + first, work, n * sizeof(int));
+}
+
+/*******************************************************************************
+** Routine:     SegmentLength
+**
+** Description: Length of a segment, in meters if geodetic
+*******************************************************************************/
+static double SegmentLength (int geodetic, double x1, double y1, double x2, double y2)
+{
+  if (geodetic)
+    return hypot ((x2 - x1) * cos ((y1 + y2) / 2 * M_PI / 180), y2 - y1) * METERS_PER_DEGREE;
+  return hypot (x2 - x1, y2 - y1);
+}
+
+/*******************************************************************************
+** Routine:     BuildStreetIndex
+**
+** Description: Build a packed R-tree on the segments of a set of streets.
+**              Line l is made of the points first_point[l] to
+**              first_point[l+1] - 1 of the x and y arrays, and belongs to
+**              street line_street[l] (from 0 to n_streets - 1). The lines
+**              of a street are taken in order when measuring positions
+**              along it. Returns NULL if there are no segments.
+*******************************************************************************/
+street_index_struct *BuildStreetIndex (
+  long         n_lines,
+  const long   *line_street,
+  const long   *first_point,
+  const double *x,
+  const double *y,
+  long         n_streets,
+  int          geodetic)
+{
+  street_index_struct *index;
+  str_entry_struct    *entries;
+  double *x1, *y1, *x2, *y2, *measure, *center_x, *center_y, *work;
+  long   *street;
+  long   n_segments, n_nodes, n_level, level_start, below_start, below_count;
+  long   l, p, s, i, e, node;
+  int    c;
+
+  n_segments = 0;
+  for (l=0; l<n_lines; l++)
+    if (first_point[l+1] - first_point[l] > 1)
+      n_segments += first_point[l+1] - first_point[l] - 1;
+  if (n_segments == 0)
+    return NULL;
+
+  /* Count the nodes of all levels */
+  n_nodes = 0;
+  n_level = n_segments;
+  do {
+    n_level = (n_level + STREET_INDEX_NODE_SIZE - 1) / STREET_INDEX_NODE_SIZE;
+    n_nodes += n_level;
+  } while (n_level > 1);
+
+  index = malloc (sizeof(street_index_struct));
+  index->geodetic = geodetic;
+  index->n_streets = n_streets;
+  index->street_length = calloc (n_streets, sizeof(double));
+  index->n_segments = n_segments;
+  index->x1 = malloc (n_segments * sizeof(double));
+  index->y1 = malloc (n_segments * sizeof(double));
+  index->x2 = malloc (n_segments * sizeof(double));
+  index->y2 = malloc (n_segments * sizeof(double));
+  index->street = malloc (n_segments * sizeof(long));
+  index->measure = malloc (n_segments * sizeof(double));
+  index->n_nodes = n_nodes;
+  index->n_leaves = (n_segments + STREET_INDEX_NODE_SIZE - 1) / STREET_INDEX_NODE_SIZE;
+  index->min_x = malloc (n_nodes * sizeof(double));
+  index->min_y = malloc (n_nodes * sizeof(double));
+  index->max_x = malloc (n_nodes * sizeof(double));
+  index->max_y = malloc (n_nodes * sizeof(double));
+  index->first = malloc (n_nodes * sizeof(long));
+  index->count = malloc (n_nodes * sizeof(int));
+
+  /* Cut the lines into segments, measuring the streets as they go */
+  x1 = malloc (n_segments * sizeof(double));
+  y1 = malloc (n_segments * sizeof(double));
+  x2 = malloc (n_segments * sizeof(double));
+  y2 = malloc (n_segments * sizeof(double));
+  street = malloc (n_segments * sizeof(long));
+  measure = malloc (n_segments * sizeof(double));
+  entries = malloc (n_segments * sizeof(str_entry_struct));
+  s = 0;
+  for (l=0; l<n_lines; l++)
+    for (p=first_point[l]; p+1<first_point[l+1]; p++) {
+      x1[s] = x[p];
+      y1[s] = y[p];
+      x2[s] = x[p+1];
+      y2[s] = y[p+1];
+      street[s] = line_street[l];
+      measure[s] = index->street_length[line_street[l]];
+      index->street_length[line_street[l]] += SegmentLength (geodetic, x[p], y[p], x[p+1], y[p+1]);
+      entries[s].x = (x[p] + x[p+1]) / 2;
+      entries[s].y = (y[p] + y[p+1]) / 2;
+      entries[s].item = s;
+      s++;
+    }
+
+  /* Order the segments and cut them into leaves */
+  StrOrder (entries, n_segments);
+  for (i=0; i<n_segments; i++) {
+    s = entries[i].item;
+    index->x1[i] = x1[s];
+    index->y1[i] = y1[s];
+    index->x2[i] = x2[s];
+    index->y2[i] = y2[s];
+    index->street[i] = street[s];
+    index->measure[i] = measure[s];
+  }
+  free (x1);
+  free (y1);
+  free (x2);
+  free (y2);
+  free (street);
+  free (measure);
+
+  center_x = malloc (n_nodes * sizeof(double));
+  center_y = malloc (n_nodes * sizeof(double));
+  work = malloc (n_segments * sizeof(double));
+  for (node=0; node<index->n_leaves; node++) {
+    index->first[node] = node * STREET_INDEX_NODE_SIZE;
+    index->count[node] = n_segments - index->first[node] < STREET_INDEX_NODE_SIZE ?
+      (int) (n_segments - index->first[node]) : STREET_INDEX_NODE_SIZE;
+    center_x[node] = center_y[node] = 0;
+    for (c=0; c<index->count[node]; c++) {
+      center_x[node] += entries[index->first[node] + c].x / index->count[node];
+      center_y[node] += entries[index->first[node] + c].y / index->count[node];
+    }
+    e = index->first[node];
+    index->min_x[node] = fmin (index->x1[e], index->x2[e]);
+    index->min_y[node] = fmin (index->y1[e], index->y2[e]);
+    index->max_x[node] = fmax (index->x1[e], index->x2[e]);
+    index->max_y[node] = fmax (index->y1[e], index->y2[e]);
+    for (e=index->first[node]+1; e<index->first[node]+index->count[node]; e++) {
+      index->min_x[node] = fmin (index->min_x[node], fmin (index->x1[e], index->x2[e]));
+      index->min_y[node] = fmin (index->min_y[node], fmin (index->y1[e], index->y2[e]));
+      index->max_x[node] = fmax (index->max_x[node], fmax (index->x1[e], index->x2[e]));
+      index->max_y[node] = fmax (index->max_y[node], fmax (index->y1[e], index->y2[e]));
+    }
+  }
+
+  /* Build the upper levels: order the nodes of the level below on their
+     centers, then group them */
+  below_start = 0;
+  below_count = index->n_leaves;
+  while (below_count > 1) {
+    for (i=0; i<below_count; i++) {
+      entries[i].x = center_x[below_start + i];
+      entries[i].y = center_y[below_start + i];
+      entries[i].item = i;
+    }
+    StrOrder (entries, below_count);
+    PermuteDoubles (index->min_x, below_start, entries, below_count, work);
+    PermuteDoubles (index->min_y, below_start, entries, below_count, work);
+    PermuteDoubles (index->max_x, below_start, entries, below_count, work);
+    PermuteDoubles (index->max_y, below_start, entries, below_count, work);
+    PermuteDoubles (center_x, below_start, entries, below_count, work);
+    PermuteDoubles (center_y, below_start, entries, below_count, work);
+    PermuteLongs (index->first, below_start, entries, below_count, (long *) work);
+    PermuteInts (index->count, below_start, entries, below_count, (int *) work);
+
+    level_start = below_start + below_count;
+    n_level = (below_count + STREET_INDEX_NODE_SIZE - 1) / STREET_INDEX_NODE_SIZE;
+    for (i=0; i<n_level; i++) {
+      node = level_start + i;
+      index->first[node] = below_start + i * STREET_INDEX_NODE_SIZE;
+      index->count[node] = below_count - i * STREET_INDEX_NODE_SIZE < STREET_INDEX_NODE_SIZE ?
+        (int) (below_count - i * STREET_INDEX_NODE_SIZE) : STREET_INDEX_NODE_SIZE;
+      e = index->first[node];
+      index->min_x[node] = index->min_x[e];
+      index->min_y[node] = index->min_y[e];
+      index->max_x[node] = index->max_x[e];
+      index->max_y[node] = index->max_y[e];
+      center_x[node] = center_y[node] = 0;
+      for (e=index->first[node]; e<index->first[node]+index->count[node]; e++) {
+        index->min_x[node] = fmin (index->min_x[node], index->min_x[e]);
+        index->min_y[node] = fmin (index->min_y[node], index->min_y[e]);
+        index->max_x[node] = fmax (index->max_x[node], index->max_x[e]);
+        index->max_y[node] = fmax (index->max_y[node], index->max_y[e]);
+        center_x[node] += center_x[e] / index->count[node];
+        center_y[node] += center_y[e] / index->count[node];
+      }
+    }
+    below_start = level_start;
+    below_count = n_level;
+  }
+
+  free (center_x);
+  free (center_y);
+  free (entries);
+  free (work);
+  return index;
+}
+
+/*******************************************************************************
+** Routine:     FreeStreetIndex
+**
+** Description: Free an index
+*******************************************************************************/
+void FreeStreetIndex (street_index_struct *index)
+{
+  if (index == NULL)
+    return;
+  free (index->street_length);
+  free (index->x1);
+  free (index->y1);
+  free (index->x2);
+  free (index->y2);
+  free (index->street);
+  free (index->measure);
+  free (index->min_x);
+  free (index->min_y);
+  free (index->max_x);
+  free (index->max_y);
+  free (index->first);
+  free (index->count);
+  free (index);
+}
+
+/*******************************************************************************
+** Routine:     CreateStreetSearch
+**
+** Description: Allocate the work space of searches
+*******************************************************************************/
+street_search_struct *CreateStreetSearch (void)
+{
+  street_search_struct *search = malloc (sizeof(street_search_struct));
+
+  search->size_queue = 256;
+  search->n_queue = 0;
+  search->queue_distance = malloc (search->size_queue * sizeof(double));
+  search->queue_node = malloc (search->size_queue * sizeof(long));
+  return search;
+}
+
+/*******************************************************************************
+** Routine:     FreeStreetSearch
+**
+** Description: Free the work space of searches
+*******************************************************************************/
+void FreeStreetSearch (street_search_struct *search)
+{
+  free (search->queue_distance);
+  free (search->queue_node);
+  free (search);
+}
+
+/*******************************************************************************
+** Routine:     PushNode
+**
+** Description: Add a node to the queue of nodes to visit
+*******************************************************************************/
+static void PushNode (street_search_struct *search, long node, double distance)
+{
+  long i, parent;
+
+  if (search->n_queue == search->size_queue) {
+    search->size_queue *= 2;
+    search->queue_distance = realloc (search->queue_distance, search->size_queue * sizeof(double));
+    search->queue_node = realloc (search->queue_node, search->size_queue * sizeof(long));
+  }
+  for (i=search->n_queue++; i>0; i=parent) {
+    parent = (i - 1) / 2;
+    if (search->queue_distance[parent] <= distance)
+      break;
+    search->queue_distance[i] = search->queue_distance[parent];
+    search->queue_node[i] = search->queue_node[parent];
+  }
+  search->queue_distance[i] = distance;
+  search->queue_node[i] = node;
+}
+
+/*******************************************************************************
+** Routine:     PopNode
+**
+** Description: Remove the nearest node from the queue of nodes to visit
+*******************************************************************************/
+static long PopNode (street_search_struct *search, double *distance)
+{
+  long   node = search->queue_node[0], i, child, n;
+  double last_distance;
+  long   last_node;
+
+  *distance = search->queue_distance[0];
+  n = --search->n_queue;
+  last_distance = search->queue_distance[n];
+  last_node = search->queue_node[n];
+  for (i=0; (child = 2*i + 1) < n; i=child) {
+    if (child + 1 < n && search->queue_distance[child+1] < search->queue_distance[child])
+      child++;
+    if (search->queue_distance[child] >= last_distance)
+      break;
+    search->queue_distance[i] = search->queue_distance[child];
+    search->queue_node[i] = search->queue_node[child];
+  }
+  search->queue_distance[i] = last_distance;
+  search->queue_node[i] = last_node;
+  return node;
+}
+
+/*******************************************************************************
+** Routine:     SegmentDistances
+**
+** Description: Squared distances from a location to the segments of a leaf.
+**              X differences are multiplied by scale_x.
+*******************************************************************************/
+static void SegmentDistances (
+  const double *x1,
+  const double *y1,
+  const double *x2,
+  const double *y2,
+  int          n,
+  double       qx,
+  double       qy,
+  double       scale_x,
+  double       *distance)
+{
+  double ax, ay, bx, by, length, t;
+  int    i;
+
+  for (i=0; i<n; i++) {
+    ax = (qx - x1[i]) * scale_x;
+    ay = qy - y1[i];
+    bx = (x2[i] - x1[i]) * scale_x;
+    by = y2[i] - y1[i];
+    length = bx*bx + by*by;
+    t = length > 0 ? (ax*bx + ay*by) / length : 0;
+    t = t < 0 ? 0 : (t > 1 ? 1 : t);
+    ax -= t * bx;
+    ay -= t * by;
+    distance[i] = ax*ax + ay*ay;
+  }
+}
+
+/*******************************************************************************
+** Routine:     BoxDistances
+**
+** Description: Squared distances from a location to the boxes of the
+**              entries of a node (0 for the boxes that contain it)
+*******************************************************************************/
+static void BoxDistances (
+  const double *min_x,
+  const double *min_y,
+  const double *max_x,
+  const double *max_y,
+  int          n,
+  double       qx,
+  double       qy,
+  double       scale_x,
+  double       *distance)
+{
+  double below, above, dx, dy;
+  int    i;
+
+  for (i=0; i<n; i++) {
+    below = min_x[i] - qx;
+    above = qx - max_x[i];
+    dx = ((below > 0 ? below : 0) + (above > 0 ? above : 0)) * scale_x;
+    below = min_y[i] - qy;
+    above = qy - max_y[i];
+    dy = (below > 0 ? below : 0) + (above > 0 ? above : 0);
+    distance[i] = dx*dx + dy*dy;
+  }
+}
+
+/*******************************************************************************
+** Routine:     NearestStreet
+**
+** Description: Find the street nearest to a location, within max_distance
+**              if it is positive. Returns 0 if a street was found, -1 if
+**              not (the street of the match is then -1).
+*******************************************************************************/
+int NearestStreet (
+  const street_index_struct *index,
+  double                    x,
+  double                    y,
+  double                    max_distance,
+  street_search_struct      *search,
+  street_match_struct       *match)
+{
+  double scale_x, best, node_distance, ax, ay, bx, by, length, t, position;
+  long   node, first, segment = -1;
+  int    i, n;
+
+  /* Distances in degrees of latitude if geodetic */
+  scale_x = index->geodetic ? cos (y * M_PI / 180) : 1;
+  best = HUGE_VAL;
+  if (max_distance > 0) {
+    best = index->geodetic ? max_distance / METERS_PER_DEGREE : max_distance;
+    best = best * best;
+  }
+
+  match->street = -1;
+  search->n_queue = 0;
+  PushNode (search, index->n_nodes - 1, 0);
+  while (search->n_queue > 0) {
+    node = PopNode (search, &node_distance);
+    if (node_distance > best)
+      break;
+    first = index->first[node];
+    n = index->count[node];
+    if (node < index->n_leaves) {
+      SegmentDistances (index->x1 + first, index->y1 + first, index->x2 + first,
+        index->y2 + first, n, x, y, scale_x, search->distance);
+      for (i=0; i<n; i++)
+        if (search->distance[i] <= best) {
+          best = search->distance[i];
+          segment = first + i;
+        }
+    }
+    else {
+      BoxDistances (index->min_x + first, index->min_y + first, index->max_x + first,
+        index->max_y + first, n, x, y, scale_x, search->distance);
+      for (i=0; i<n; i++)
+        if (search->distance[i] <= best)
+          PushNode (search, first + i, search->distance[i]);
+    }
+  }
+  if (segment < 0)
+    return -1;
+
+  /* Nearest point of the segment, and its position along the street */
+  ax = (x - index->x1[segment]) * scale_x;
+  ay = y - index->y1[segment];
+  bx = (index->x2[segment] - index->x1[segment]) * scale_x;
+  by = index->y2[segment] - index->y1[segment];
+  length = bx*bx + by*by;
+  t = length > 0 ? (ax*bx + ay*by) / length : 0;
+  t = t < 0 ? 0 : (t > 1 ? 1 : t);
+  match->street = index->street[segment];
+  match->x = index->x1[segment] + t * (index->x2[segment] - index->x1[segment]);
+  match->y = index->y1[segment] + t * (index->y2[segment] - index->y1[segment]);
+  match->distance = index->geodetic ? sqrt (best) * METERS_PER_DEGREE : sqrt (best);
+  match->side = bx * ay - by * ax >= 0 ? 1 : -1;
+  position = index->measure[segment] + t * SegmentLength (index->geodetic,
+    index->x1[segment], index->y1[segment], index->x2[segment], index->y2[segment]);
+  match->fraction = index->street_length[match->street] > 0 ?
+    position / index->street_length[match->street] : 0;
+  if (match->fraction > 1)
+    match->fraction = 1;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     HouseNumber
+**
+** Description: Interpolate a house number along a street. When both ends of
+**              the range are even, or both odd, the number has the same
+**              parity. Returns 0 if the range is not known (an end is 0 or
+**              less).
+*******************************************************************************/
+long HouseNumber (long from_number, long to_number, double fraction)
+{
+  double number = from_number + fraction * (to_number - from_number);
+
+  if (from_number <= 0 || to_number <= 0)
+    return 0;
+  if ((from_number - to_number) % 2 == 0)
+    return from_number + 2 * (long) floor ((number - from_number) / 2 + 0.5);
+  return (long) floor (number + 0.5);
+}
+
+/*******************************************************************************
+** Routine:     SearchStreets
+**
+** Description: Thread routine: find the nearest streets of a range of
+**              locations
+*******************************************************************************/
+static void *SearchStreets (void *argument)
+{
+  street_job_struct    *job = (street_job_struct *) argument;
+  street_search_struct *search = CreateStreetSearch ();
+  long i;
+
+  for (i=job->first; i<job->last; i++)
+    NearestStreet (job->index, job->x[i], job->y[i], job->max_distance, search,
+      &job->matches[i]);
+  FreeStreetSearch (search);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     NearestStreetsJoin
+**
+** Description: Find the street nearest to each location of an array, with
+**              several threads. Locations without a street within
+**              max_distance get a street of -1.
+*******************************************************************************/
+void NearestStreetsJoin (
+  const street_index_struct *index,
+  const double              *x,
+  const double              *y,
+  long                      n_points,
+  double                    max_distance,
+  int                       n_threads,
+  street_match_struct       *matches)
+{
+  street_job_struct jobs[STREET_INDEX_MAX_THREADS];
+  int t;
+
+#ifdef _WIN32
+  n_threads = 1;
+#endif
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > STREET_INDEX_MAX_THREADS)
+    n_threads = STREET_INDEX_MAX_THREADS;
+  if (n_threads > n_points)
+    n_threads = n_points > 0 ? (int) n_points : 1;
+
+  for (t=0; t<n_threads; t++) {
+    jobs[t].index = index;
+    jobs[t].x = x;
+    jobs[t].y = y;
+    jobs[t].first = n_points * t / n_threads;
+    jobs[t].last = n_points * (t + 1) / n_threads;
+    jobs[t].max_distance = max_distance;
+    jobs[t].matches = matches;
+  }
+  RunJobs (SearchStreets, jobs, sizeof(street_job_struct), n_threads);
+}
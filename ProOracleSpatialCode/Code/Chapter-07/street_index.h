@@ -0,0 +1,106 @@
+/* street_index.h
+
+   Packed R-tree of street segments, and reverse geocoding.
+
+   This is the client-side counterpart of reverse geocoding with SDO_NN
+   against a street layer (see chapters 6 and 8): finding the street nearest
+   to a location, and the house number at that point of the street, for
+   large numbers of locations such as GPS traces.
+
+   The streets are given as line strings (several for streets made of
+   disconnected parts). BuildStreetIndex cuts them into their segments, and
+   indexes each segment on its own, as the packed R-tree of point_tree.h
+   indexes points: the segments are sorted on their centers with the
+   Sort-Tile-Recursive method and cut into leaves of STREET_INDEX_NODE_SIZE
+   segments. A leaf then covers a few hundred meters of street at most,
+   where the bounding box of a whole street could cover a town, and a
+   search only measures the distance to the segments near the location.
+
+   NearestStreet finds the segment nearest to a location with a best-first
+   search, and returns the nearest point of its street, the distance to it,
+   the side of the street the location is on, and the position of the point
+   along the street as a fraction of its length. HouseNumber interpolates a
+   house number at that position from the range of numbers of the street.
+
+   NearestStreetsJoin runs NearestStreet for a whole array of locations,
+   with several threads.
+
+   If the index is geodetic, the coordinates are longitudes and latitudes in
+   degrees (as with SRID 8307). Distances are then computed in an
+   equirectangular projection centered on each location, and returned in
+   meters on a sphere of radius STREET_INDEX_EARTH_RADIUS: at street scale
+   they differ from the geodetic distances of the database by much less
+   than the accuracy of a GPS position. Streets that cross the antimeridian
+   are not supported. Otherwise, distances are computed on the coordinates
+   as they are.
+
+   The index is read-only once built: any number of threads can search it
+   at the same time, each with its own search work space.
+
+*/
+#ifndef STREET_INDEX_H
+#define STREET_INDEX_H
+
+#define STREET_INDEX_NODE_SIZE 16
+#define STREET_INDEX_MAX_THREADS 64
+#define STREET_INDEX_EARTH_RADIUS 6371008.8
+
+/* A packed R-tree of segments. The nodes of all levels are in the same
+   arrays: the leaves first, the root last. The entries of a node are
+   consecutive segments (for a leaf) or consecutive nodes of the level
+   below. */
+struct street_index
+{
+    int    geodetic;
+    long   n_streets;
+    double *street_length;            /* Length of each street */
+    long   n_segments;
+    double *x1, *y1;                  /* Segments, in the order of the leaves */
+    double *x2, *y2;
+    long   *street;                   /* Street of each segment */
+    double *measure;                  /* Position of its start along the street */
+    long   n_nodes;
+    long   n_leaves;                  /* Nodes below n_leaves are leaves */
+    double *min_x, *min_y;            /* Bounds of each node */
+    double *max_x, *max_y;
+    long   *first;                    /* First entry of each node */
+    int    *count;                    /* Number of entries of each node */
+};
+typedef struct street_index street_index_struct;
+
+/* Work space of a search, to be used by one thread at a time */
+struct street_search
+{
+    long   size_queue;
+    long   n_queue;
+    double *queue_distance;           /* Nodes to visit (heap on distance) */
+    long   *queue_node;
+    double distance[STREET_INDEX_NODE_SIZE];
+};
+typedef struct street_search street_search_struct;
+
+/* The street nearest to a location */
+struct street_match
+{
+    long   street;                    /* Number of the street, or -1 if none */
+    double distance;
+    double x, y;                      /* Nearest point of the street */
+    double fraction;                  /* Position of that point along the street (0 to 1) */
+    int    side;                      /* 1 if the location is on the left, -1 on the right */
+};
+typedef struct street_match street_match_struct;
+
+street_index_struct *BuildStreetIndex (long n_lines, const long *line_street,
+                                       const long *first_point, const double *x,
+                                       const double *y, long n_streets, int geodetic);
+void FreeStreetIndex (street_index_struct *index);
+street_search_struct *CreateStreetSearch (void);
+void FreeStreetSearch (street_search_struct *search);
+int  NearestStreet (const street_index_struct *index, double x, double y, double max_distance,
+                    street_search_struct *search, street_match_struct *match);
+void NearestStreetsJoin (const street_index_struct *index, const double *x, const double *y,
+                         long n_points, double max_distance, int n_threads,
+                         street_match_struct *matches);
+long HouseNumber (long from_number, long to_number, double fraction);
+
+#endif
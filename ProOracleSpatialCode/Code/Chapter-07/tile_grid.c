@@ -0,0 +1,540 @@
+/* tile_grid.c
+
+   Tiled binning and aggregation of points. See tile_grid.h for a
+   description of the grid and of the binary grid file format.
+
+   The points added are buffered, and the buffer is binned when it is full
+   or when the grid is finished. Binning is done in two passes over each
+   share of the buffer: the first computes the tile of each point, in a loop
+   without branches that the compiler vectorizes, and the second adds the
+   points to the counts of their tiles.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "tile_grid.h"
+
+/* Buffers smaller than this (per thread) are binned by fewer threads */
+#define TILE_GRID_MIN_POINTS_PER_THREAD 4096
+
+#define CONVERT_BUFFER_SIZE 1024
+
+/* The share of a batch binned by one thread */
+struct tile_job
+{
+    tile_grid_struct *grid;
+    int              thread;
+    const double     *x;
+    const double     *y;
+    const double     *value;
+    int              *tile_index;
+    int              n_points;
+    int64_t          n_outside;
+};
+typedef struct tile_job tile_job_struct;
+
+/*******************************************************************************
+** Routine:     CreateTileGrid
+**
+** Description: Create an empty grid over an extent, with levels 0 to max_level
+*******************************************************************************/
+tile_grid_struct *CreateTileGrid (
+  double min_x,
+  double min_y,
+  double max_x,
+  double max_y,
+  int    srid,
+  int    max_level,
+  int    with_values,
+  int    n_threads)
+{
+  tile_grid_struct *grid;
+
+  if (max_level < 0 || max_level > TILE_GRID_MAX_LEVEL) {
+    printf ("Invalid tiling level: must be between 0 and %d\n", TILE_GRID_MAX_LEVEL);
+    exit (1);
+  }
+  if (!(max_x > min_x) || !(max_y > min_y)) {
+    printf ("Invalid extent: (%f, %f) (%f, %f)\n", min_x, min_y, max_x, max_y);
+    exit (1);
+  }
+#ifdef _WIN32
+  n_threads = 1;
+#endif
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > TILE_GRID_MAX_THREADS)
+    n_threads = TILE_GRID_MAX_THREADS;
+
+  grid = calloc (1, sizeof(tile_grid_struct));
+  grid->srid = srid;
+  grid->max_level = max_level;
+  grid->with_values = with_values;
+  grid->n_threads = n_threads;
+  grid->min_x = min_x;
+  grid->min_y = min_y;
+  grid->max_x = max_x;
+  grid->max_y = max_y;
+
+  /* The copies of the finest level are allocated when the threads are used */
+  grid->buffer_size = n_threads * TILE_GRID_BUFFER_POINTS;
+  grid->buffer_x = malloc (sizeof(double) * grid->buffer_size);
+  grid->buffer_y = malloc (sizeof(double) * grid->buffer_size);
+  grid->buffer_value = with_values ? malloc (sizeof(double) * grid->buffer_size) : NULL;
+  grid->tile_index = malloc (sizeof(int) * grid->buffer_size);
+  if (grid->buffer_x == NULL || grid->buffer_y == NULL || grid->tile_index == NULL
+      || (with_values && grid->buffer_value == NULL)) {
+    printf ("Could not allocate a buffer of %d points\n", grid->buffer_size);
+    exit (1);
+  }
+  return grid;
+}
+
+/*******************************************************************************
+** Routine:     AllocateThreadCopy
+**
+** Description: Allocate the copy of the finest level of a thread, if it does
+**              not have one yet
+*******************************************************************************/
+static void AllocateThreadCopy (
+  tile_grid_struct *grid,
+  int              thread)
+{
+  size_t n_tiles = (size_t)1 << (2*grid->max_level);
+
+  if (grid->thread_counts[thread] != NULL)
+    return;
+  grid->thread_counts[thread] = calloc (n_tiles, sizeof(double));
+  if (grid->with_values) {
+    grid->thread_sums[thread] = calloc (n_tiles, sizeof(double));
+    grid->thread_value_counts[thread] = calloc (n_tiles, sizeof(double));
+  }
+  if (grid->thread_counts[thread] == NULL
+      || (grid->with_values
+          && (grid->thread_sums[thread] == NULL || grid->thread_value_counts[thread] == NULL))) {
+    printf ("Could not allocate %lu tiles for thread %d\n", (unsigned long)n_tiles, thread);
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ComputeTileIndexes
+**
+** Description: Compute the tile of each point at the finest level, or -1 for
+**              the points outside the extent. The loop has no branches, so
+**              that the compiler can vectorize it.
+*******************************************************************************/
+static void ComputeTileIndexes (
+  tile_grid_struct *grid,
+  const double     *x,
+  const double     *y,
+  int              *tile_index,
+  int              n_points)
+{
+  int    side = 1 << grid->max_level;
+  double scale_x = side / (grid->max_x - grid->min_x);
+  double scale_y = side / (grid->max_y - grid->min_y);
+  double min_x = grid->min_x, min_y = grid->min_y;
+  double last = side - 1;
+  double fx, fy;
+  int    outside;
+  int    i;
+
+  for (i=0; i<n_points; i++) {
+    fx = (x[i] - min_x) * scale_x;
+    fy = (y[i] - min_y) * scale_y;
+    /* NaN fails all comparisons: test for inside, not outside. The tests
+       are combined with & rather than &&, which would add branches */
+    outside = !((fx >= 0) & (fx <= side) & (fy >= 0) & (fy <= side));
+    /* Clamp before converting, so that the conversion is always defined */
+    fx = fx >= 0 ? fx : 0;
+    fy = fy >= 0 ? fy : 0;
+    fx = fx <= last ? fx : last;
+    fy = fy <= last ? fy : last;
+    tile_index[i] = outside ? -1 : (int)fy * side + (int)fx;
+  }
+}
+
+/*******************************************************************************
+** Routine:     BinPoints
+**
+** Description: Bin the points of a job into the copy of the grid of its thread
+*******************************************************************************/
+static void *BinPoints (void *argument)
+{
+  tile_job_struct *job = (tile_job_struct *) argument;
+  double          *counts = job->grid->thread_counts[job->thread];
+  double          *sums = job->grid->thread_sums[job->thread];
+  double          *value_counts = job->grid->thread_value_counts[job->thread];
+  int64_t         n_outside = 0;
+  int             i, tile, not_null;
+
+  ComputeTileIndexes (job->grid, job->x, job->y, job->tile_index, job->n_points);
+
+  for (i=0; i<job->n_points; i++) {
+    tile = job->tile_index[i];
+    if (tile < 0)
+      n_outside++;
+    else {
+      counts[tile] += 1;
+      if (sums != NULL) {
+        /* A NULL value is passed as NaN: count the point, not the value */
+        not_null = job->value[i] == job->value[i];
+        sums[tile] += not_null ? job->value[i] : 0;
+        value_counts[tile] += not_null;
+      }
+    }
+  }
+  job->n_outside = n_outside;
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     BinBuffer
+**
+** Description: Bin the points of the buffer, and empty it
+*******************************************************************************/
+static void BinBuffer (tile_grid_struct *grid)
+{
+  tile_job_struct jobs[TILE_GRID_MAX_THREADS];
+  int             n_points = grid->n_buffered;
+  int             n_jobs, first, last, t;
+#ifndef _WIN32
+  pthread_t       threads[TILE_GRID_MAX_THREADS];
+  int             started[TILE_GRID_MAX_THREADS];
+#endif
+
+  if (n_points <= 0)
+    return;
+
+  /* Split the buffer into one contiguous share per thread */
+  n_jobs = n_points / TILE_GRID_MIN_POINTS_PER_THREAD;
+  if (n_jobs > grid->n_threads)
+    n_jobs = grid->n_threads;
+  if (n_jobs < 1)
+    n_jobs = 1;
+  for (t=0; t<n_jobs; t++) {
+    first = (int) ((long) n_points * t / n_jobs);
+    last = (int) ((long) n_points * (t+1) / n_jobs);
+    AllocateThreadCopy (grid, t);
+    jobs[t].grid = grid;
+    jobs[t].thread = t;
+    jobs[t].x = grid->buffer_x + first;
+    jobs[t].y = grid->buffer_y + first;
+    jobs[t].value = grid->with_values ? grid->buffer_value + first : NULL;
+    jobs[t].tile_index = grid->tile_index + first;
+    jobs[t].n_points = last - first;
+    jobs[t].n_outside = 0;
+  }
+
+#ifndef _WIN32
+  /* The calling thread bins the first share */
+  for (t=1; t<n_jobs; t++)
+    started[t] = pthread_create (&threads[t], NULL, BinPoints, &jobs[t]) == 0;
+  BinPoints (&jobs[0]);
+  for (t=1; t<n_jobs; t++)
+    if (started[t])
+      pthread_join (threads[t], NULL);
+    else
+      BinPoints (&jobs[t]);
+#else
+  for (t=0; t<n_jobs; t++)
+    BinPoints (&jobs[t]);
+#endif
+
+  for (t=0; t<n_jobs; t++) {
+    grid->n_points += jobs[t].n_points - jobs[t].n_outside;
+    grid->n_outside += jobs[t].n_outside;
+  }
+  grid->n_buffered = 0;
+}
+
+/*******************************************************************************
+** Routine:     AddPointsToTileGrid
+**
+** Description: Add a batch of points to the grid. The values are summed per
+**              tile if the grid was created with values, and ignored otherwise.
+**              The points are copied: they are binned when the buffer of the
+**              grid is full, or when the grid is finished.
+*******************************************************************************/
+void AddPointsToTileGrid (
+  tile_grid_struct *grid,
+  const double     *x,
+  const double     *y,
+  const double     *value,
+  int              n_points)
+{
+  int n;
+
+  while (n_points > 0) {
+    n = grid->buffer_size - grid->n_buffered;
+    if (n > n_points)
+      n = n_points;
+    memcpy (grid->buffer_x + grid->n_buffered, x, sizeof(double) * n);
+    memcpy (grid->buffer_y + grid->n_buffered, y, sizeof(double) * n);
+    if (grid->with_values) {
+      memcpy (grid->buffer_value + grid->n_buffered, value, sizeof(double) * n);
+      value += n;
+    }
+    grid->n_buffered += n;
+    x += n;
+    y += n;
+    n_points -= n;
+    if (grid->n_buffered == grid->buffer_size)
+      BinBuffer (grid);
+  }
+}
+
+/*******************************************************************************
+** Routine:     FinishTileGrid
+**
+** Description: Merge the copies of the threads into the finest level, and
+**              compute the coarser levels
+*******************************************************************************/
+void FinishTileGrid (tile_grid_struct *grid)
+{
+  size_t n_tiles = (size_t)1 << (2*grid->max_level);
+  double *counts, *sums, *value_counts;
+  double *child_counts, *child_sums, *child_value_counts;
+  size_t i;
+  int    side, level, row, column, t, c;
+
+  BinBuffer (grid);
+
+  /* The copy of the first thread becomes the finest level. It is allocated
+     here if no point was added */
+  AllocateThreadCopy (grid, 0);
+  counts = grid->counts[grid->max_level] = grid->thread_counts[0];
+  sums = grid->sums[grid->max_level] = grid->thread_sums[0];
+  value_counts = grid->value_counts[grid->max_level] = grid->thread_value_counts[0];
+  grid->thread_counts[0] = grid->thread_sums[0] = grid->thread_value_counts[0] = NULL;
+  for (t=1; t<grid->n_threads; t++) {
+    if (grid->thread_counts[t] == NULL)
+      continue;
+    for (i=0; i<n_tiles; i++)
+      counts[i] += grid->thread_counts[t][i];
+    free (grid->thread_counts[t]);
+    grid->thread_counts[t] = NULL;
+    if (sums != NULL) {
+      for (i=0; i<n_tiles; i++) {
+        sums[i] += grid->thread_sums[t][i];
+        value_counts[i] += grid->thread_value_counts[t][i];
+      }
+      free (grid->thread_sums[t]);
+      free (grid->thread_value_counts[t]);
+      grid->thread_sums[t] = grid->thread_value_counts[t] = NULL;
+    }
+  }
+
+  /* Each tile of a level covers four tiles of the level below */
+  for (level=grid->max_level-1; level>=0; level--) {
+    side = 1 << level;
+    child_counts = grid->counts[level+1];
+    child_sums = grid->sums[level+1];
+    child_value_counts = grid->value_counts[level+1];
+    grid->counts[level] = calloc ((size_t)side * side, sizeof(double));
+    grid->sums[level] = sums != NULL ? calloc ((size_t)side * side, sizeof(double)) : NULL;
+    grid->value_counts[level] = sums != NULL ? calloc ((size_t)side * side, sizeof(double)) : NULL;
+    for (row=0; row<side; row++)
+      for (column=0; column<side; column++) {
+        c = (2*row) * (2*side) + 2*column;
+        grid->counts[level][row*side + column] =
+          child_counts[c] + child_counts[c+1] + child_counts[c+2*side] + child_counts[c+2*side+1];
+        if (sums != NULL) {
+          grid->sums[level][row*side + column] =
+            child_sums[c] + child_sums[c+1] + child_sums[c+2*side] + child_sums[c+2*side+1];
+          grid->value_counts[level][row*side + column] =
+            child_value_counts[c] + child_value_counts[c+1]
+            + child_value_counts[c+2*side] + child_value_counts[c+2*side+1];
+        }
+      }
+  }
+
+  free (grid->buffer_x);
+  free (grid->buffer_y);
+  free (grid->buffer_value);
+  free (grid->tile_index);
+  grid->buffer_x = grid->buffer_y = grid->buffer_value = NULL;
+  grid->tile_index = NULL;
+  grid->buffer_size = 0;
+}
+
+/*******************************************************************************
+** Routine:     WriteTileGridCsv
+**
+** Description: Write the non-empty tiles of all levels to a CSV file.
+**              Returns 0 if successful.
+*******************************************************************************/
+int WriteTileGridCsv (
+  tile_grid_struct *grid,
+  const char       *filename)
+{
+  FILE   *file;
+  double tile_width, tile_height, count, value_count;
+  int    side, level, row, column, i;
+
+  file = fopen (filename, "w");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    return 1;
+  }
+
+  fprintf (file, "level,column,row,min_x,min_y,max_x,max_y,count%s\n",
+    grid->with_values ? ",value_count,sum,avg" : "");
+  for (level=0; level<=grid->max_level; level++) {
+    side = 1 << level;
+    tile_width = (grid->max_x - grid->min_x) / side;
+    tile_height = (grid->max_y - grid->min_y) / side;
+    for (row=0; row<side; row++)
+      for (column=0; column<side; column++) {
+        i = row*side + column;
+        count = grid->counts[level][i];
+        if (count == 0)
+          continue;
+        fprintf (file, "%d,%d,%d,%.17g,%.17g,%.17g,%.17g,%.0f",
+          level, column, row,
+          grid->min_x + column * tile_width, grid->min_y + row * tile_height,
+          grid->min_x + (column+1) * tile_width, grid->min_y + (row+1) * tile_height,
+          count);
+        if (grid->with_values) {
+          value_count = grid->value_counts[level][i];
+          fprintf (file, ",%.0f,%.17g,", value_count, grid->sums[level][i]);
+          /* The average of a tile that has only NULL values is NULL (empty) */
+          if (value_count > 0)
+            fprintf (file, "%.17g", grid->sums[level][i] / value_count);
+        }
+        fprintf (file, "\n");
+      }
+  }
+
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    return 1;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     PutUInt32 / PutUInt64 / PutDouble
+**
+** Description: Store a value in little-endian byte order
+*******************************************************************************/
+static void PutUInt32 (unsigned char *p, uint32_t value)
+{
+  int i;
+  for (i=0; i<4; i++)
+    p[i] = (unsigned char) (value >> (8*i));
+}
+
+static void PutUInt64 (unsigned char *p, uint64_t value)
+{
+  int i;
+  for (i=0; i<8; i++)
+    p[i] = (unsigned char) (value >> (8*i));
+}
+
+static void PutDouble (unsigned char *p, double value)
+{
+  uint64_t bits;
+  memcpy (&bits, &value, 8);
+  PutUInt64 (p, bits);
+}
+
+/*******************************************************************************
+** Routine:     WriteDoubles
+**
+** Description: Write an array of doubles in little-endian byte order
+*******************************************************************************/
+static void WriteDoubles (FILE *file, const double *values, size_t n_values)
+{
+  unsigned char buffer[CONVERT_BUFFER_SIZE * 8];
+  size_t        i, n;
+
+  while (n_values > 0) {
+    n = n_values < CONVERT_BUFFER_SIZE ? n_values : CONVERT_BUFFER_SIZE;
+    for (i=0; i<n; i++)
+      PutDouble (buffer + 8*i, values[i]);
+    fwrite (buffer, 8, n, file);
+    values += n;
+    n_values -= n;
+  }
+}
+
+/*******************************************************************************
+** Routine:     WriteTileGridBinary
+**
+** Description: Write all levels to a binary grid file. Returns 0 if successful.
+*******************************************************************************/
+int WriteTileGridBinary (
+  tile_grid_struct *grid,
+  const char       *filename)
+{
+  unsigned char header[TILE_GRID_HEADER_SIZE];
+  FILE   *file;
+  size_t n_tiles;
+  int    level;
+
+  file = fopen (filename, "wb");
+  if (file == NULL) {
+    printf ("Could not create %s\n", filename);
+    return 1;
+  }
+
+  memset (header, 0, sizeof(header));
+  memcpy (header, TILE_GRID_MAGIC, 8);
+  PutUInt32 (header + 8, TILE_GRID_VERSION);
+  PutUInt32 (header + 12, grid->with_values ? TILE_GRID_HAS_VALUES : 0);
+  PutUInt32 (header + 16, (uint32_t) grid->srid);
+  PutUInt32 (header + 20, (uint32_t) grid->max_level + 1);
+  PutUInt64 (header + 24, (uint64_t) grid->n_points);
+  PutDouble (header + 32, grid->min_x);
+  PutDouble (header + 40, grid->min_y);
+  PutDouble (header + 48, grid->max_x);
+  PutDouble (header + 56, grid->max_y);
+  fwrite (header, 1, sizeof(header), file);
+
+  for (level=0; level<=grid->max_level; level++) {
+    n_tiles = (size_t)1 << (2*level);
+    WriteDoubles (file, grid->counts[level], n_tiles);
+    if (grid->with_values) {
+      WriteDoubles (file, grid->sums[level], n_tiles);
+      WriteDoubles (file, grid->value_counts[level], n_tiles);
+    }
+  }
+
+  if (fclose (file) != 0) {
+    printf ("Could not write %s\n", filename);
+    return 1;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     FreeTileGrid
+**
+** Description: Free a grid, finished or not
+*******************************************************************************/
+void FreeTileGrid (tile_grid_struct *grid)
+{
+  int i;
+
+  for (i=0; i<=TILE_GRID_MAX_LEVEL; i++) {
+    free (grid->counts[i]);
+    free (grid->sums[i]);
+    free (grid->value_counts[i]);
+  }
+  for (i=0; i<TILE_GRID_MAX_THREADS; i++) {
+    free (grid->thread_counts[i]);
+    free (grid->thread_sums[i]);
+    free (grid->thread_value_counts[i]);
+  }
+  free (grid->buffer_x);
+  free (grid->buffer_y);
+  free (grid->buffer_value);
+  free (grid->tile_index);
+  free (grid);
+}
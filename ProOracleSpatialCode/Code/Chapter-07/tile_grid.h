@@ -0,0 +1,97 @@
+/* tile_grid.h
+
+   Client-side tiled binning and aggregation of points.
+
+   This is the client-side counterpart of SDO_SAM.TILED_BINS and
+   SDO_SAM.TILED_AGGREGATES (see appendix A). The extent of the data is
+   divided into tiles at several levels: level 0 is a single tile covering
+   the whole extent, and each level divides the tiles of the level above in
+   four, so that level l has 2^l by 2^l tiles, as with the tiling_level
+   parameter of TILED_BINS.
+
+   Points are added in batches of any size. They are copied into a buffer of
+   TILE_GRID_BUFFER_POINTS points per thread, and binned when the buffer is
+   full, so that small fetch batches do not each start threads of their own.
+   A full buffer is split between the threads. Each thread counts its points
+   (and sums their values) into its own copy of the finest level, so that no
+   locking is needed. A copy is only allocated for a thread that is used:
+   a small table binned in one share needs a single copy. The copies are
+   merged, and the coarser levels computed from the finest one, when the grid
+   is finished.
+
+   A value that is NaN stands for a NULL value: the point is counted, but
+   not its value. Each tile has its own count of values, and the average of
+   a tile is its sum divided by that count, as with AVG in SQL.
+
+   Tiles are numbered by column and row from the lower left corner of the
+   extent. Points on the upper or right edge of the extent go into the last
+   tile; points outside the extent are ignored.
+
+   A finished grid can be written as a CSV file, with one line per non-empty
+   tile giving its count of points and, if values were given, the count, sum
+   and average of their values. It can also be written as a binary grid file with
+   the following layout (all values in little-endian byte order):
+
+     offset  size  content
+     0       8     magic string "SDOTIL01"
+     8       4     format version (1)
+     12      4     flags (TILE_GRID_HAS_VALUES if the sums are present)
+     16      4     SRID (0 if unknown)
+     20      4     number of levels (finest level + 1)
+     24      8     number of points binned
+     32      32    extent: min X, min Y, max X, max Y
+     64      64    (reserved)
+     128           for each level l, from 0 to the finest level:
+                     4^l doubles: count of points in each tile, row by row
+                     4^l doubles: sum of the values in each tile (if present)
+                     4^l doubles: count of the values in each tile (if present)
+
+*/
+#ifndef TILE_GRID_H
+#define TILE_GRID_H
+
+#include <stdint.h>
+
+#define TILE_GRID_MAGIC "SDOTIL01"
+#define TILE_GRID_VERSION 1
+#define TILE_GRID_HEADER_SIZE 128
+#define TILE_GRID_HAS_VALUES 1
+#define TILE_GRID_MAX_LEVEL 12
+#define TILE_GRID_MAX_THREADS 64
+#define TILE_GRID_BUFFER_POINTS 65536 /* Points buffered per thread */
+
+struct tile_grid
+{
+    int     srid;
+    int     max_level;                /* Finest level */
+    int     with_values;              /* 1 if values are summed */
+    int     n_threads;
+    double  min_x, min_y;
+    double  max_x, max_y;
+    int64_t n_points;                 /* Points binned (inside the extent) */
+    int64_t n_outside;                /* Points ignored (outside the extent) */
+    double  *counts[TILE_GRID_MAX_LEVEL+1];  /* Per level, set when finished */
+    double  *sums[TILE_GRID_MAX_LEVEL+1];    /* Per level, if with_values */
+    double  *value_counts[TILE_GRID_MAX_LEVEL+1]; /* Values that are not NaN */
+    double  *thread_counts[TILE_GRID_MAX_THREADS]; /* Finest level, per thread */
+    double  *thread_sums[TILE_GRID_MAX_THREADS];   /* (allocated when used) */
+    double  *thread_value_counts[TILE_GRID_MAX_THREADS];
+    double  *buffer_x;                /* Points added but not binned yet */
+    double  *buffer_y;
+    double  *buffer_value;
+    int     n_buffered;
+    int     buffer_size;
+    int     *tile_index;              /* Work array: tile of each point */
+};
+typedef struct tile_grid tile_grid_struct;
+
+tile_grid_struct *CreateTileGrid (double min_x, double min_y, double max_x, double max_y,
+                                  int srid, int max_level, int with_values, int n_threads);
+void AddPointsToTileGrid (tile_grid_struct *grid, const double *x, const double *y,
+                          const double *value, int n_points);
+void FinishTileGrid (tile_grid_struct *grid);
+int  WriteTileGridCsv (tile_grid_struct *grid, const char *filename);
+int  WriteTileGridBinary (tile_grid_struct *grid, const char *filename);
+void FreeTileGrid (tile_grid_struct *grid);
+
+#endif
@@ -0,0 +1,1310 @@
+/* tile_render.c
+
+   Rendering of map tiles from a layer of geometries. See tile_render.h for
+   a description of the method.
+
+   The PNG files are compressed with a small deflate encoder of their own:
+   each row of pixels is stored as the difference with the pixel on its
+   left (PNG filter "Sub"), so that areas of one color become runs of
+   zeros, and the runs are coded as repeats of the previous byte with the
+   fixed Huffman codes of deflate. Map tiles are mostly made of such areas,
+   and this keeps the program free of any compression library.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <pthread.h>
+#include <unistd.h>
+#else
+#include <direct.h>
+#endif
+#include "tile_render.h"
+
+#define RENDER_STRIDE (RENDER_TILE_SIZE + 2)   /* Row of the accumulation buffer */
+#define MAX_LATITUDE 85.0511287798
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A geometry to draw in a tile */
+struct render_piece
+{
+    uint64_t tile;                    /* row * 2^zoom + column */
+    long     geometry;
+};
+typedef struct render_piece render_piece_struct;
+
+/* The drawing buffers of a thread */
+struct render_canvas
+{
+    float         *cells;             /* Accumulation buffer, RENDER_STRIDE per row */
+    float         *coverage;          /* Coverage of the pixels of one row */
+    float         *red;               /* Image, premultiplied by alpha */
+    float         *green;
+    float         *blue;
+    float         *alpha;
+    int           min_row, max_row;   /* Cells touched since the last composite */
+    int           min_column, max_column;
+    unsigned char *rgba;              /* One row of pixels */
+    unsigned char *raw;               /* Filtered rows, as compressed in the PNG */
+    unsigned char *png;               /* The PNG file */
+    long          png_size;
+};
+typedef struct render_canvas render_canvas_struct;
+
+/* Bits being written to a deflate stream */
+struct bit_writer
+{
+    unsigned char *data;
+    long          size;
+    uint32_t      bits;
+    int           n_bits;
+};
+typedef struct bit_writer bit_writer_struct;
+
+/* The tiles of one zoom, shared by all threads */
+struct render_queue
+{
+    const render_layer_struct *layer;
+    const render_style_struct *style;
+    const char          *directory;
+    int                 zoom;
+    render_piece_struct *pieces;      /* Sorted by tile */
+    long                *task_start;  /* First piece of each tile (n_tasks + 1) */
+    long                n_tasks;
+    long                next_task;
+#ifndef _WIN32
+    pthread_mutex_t     lock;         /* Protects next_task and error */
+#endif
+    int                 error;        /* Set if a tile could not be written */
+};
+typedef struct render_queue render_queue_struct;
+
+/* A thread, with its buffers */
+struct render_worker
+{
+    render_queue_struct  *queue;
+    render_canvas_struct canvas;
+    long                 n_tiles;
+    long                 n_bytes;
+};
+typedef struct render_worker render_worker_struct;
+
+static uint32_t crc_table[256];
+static uint32_t symbol_code[288];      /* Fixed Huffman codes, bits reversed */
+static int      symbol_length[288];
+
+/*******************************************************************************
+** Routine:     InitRenderLayer
+**
+** Description: Initialize an empty layer
+*******************************************************************************/
+void InitRenderLayer (render_layer_struct *layer)
+{
+  layer->n_geometries = 0;
+  layer->size = 0;
+  layer->geometries = NULL;
+  layer->scheme = 0;
+  layer->min_value = 0;
+  layer->max_value = 0;
+}
+
+/*******************************************************************************
+** Routine:     AddCircle
+**
+** Description: Add the vertices of the polygon that approximates the circle
+**              through three points. Returns the number of vertices added,
+**              or 0 if the points are collinear.
+*******************************************************************************/
+static int AddCircle (
+  const double *p,                    /* x1 y1 x2 y2 x3 y3 */
+  double       *x,
+  double       *y)
+{
+  double ax = p[0], ay = p[1], bx = p[2], by = p[3], cx = p[4], cy = p[5];
+  double d, ux, uy, radius, angle;
+  int    i;
+
+  d = 2 * (ax * (by - cy) + bx * (cy - ay) + cx * (ay - by));
+  if (d == 0)
+    return 0;
+  ux = ((ax*ax + ay*ay) * (by - cy) + (bx*bx + by*by) * (cy - ay) + (cx*cx + cy*cy) * (ay - by)) / d;
+  uy = ((ax*ax + ay*ay) * (cx - bx) + (bx*bx + by*by) * (ax - cx) + (cx*cx + cy*cy) * (bx - ax)) / d;
+  radius = sqrt ((ax - ux) * (ax - ux) + (ay - uy) * (ay - uy));
+  for (i=0; i<RENDER_CIRCLE_SEGMENTS; i++) {
+    angle = 2 * M_PI * i / RENDER_CIRCLE_SEGMENTS;
+    x[i] = ux + radius * cos (angle);
+    y[i] = uy + radius * sin (angle);
+  }
+  x[RENDER_CIRCLE_SEGMENTS] = x[0];
+  y[RENDER_CIRCLE_SEGMENTS] = y[0];
+  return RENDER_CIRCLE_SEGMENTS + 1;
+}
+
+/*******************************************************************************
+** Routine:     ReverseVertices
+**
+** Description: Reverse the order of a list of vertices
+*******************************************************************************/
+static void ReverseVertices (double *x, double *y, int n)
+{
+  double swap;
+  int    i;
+
+  for (i=0; i<n/2; i++) {
+    swap = x[i]; x[i] = x[n-1-i]; x[n-1-i] = swap;
+    swap = y[i]; y[i] = y[n-1-i]; y[n-1-i] = swap;
+  }
+}
+
+/*******************************************************************************
+** Routine:     AddRenderGeometry
+**
+** Description: Add a geometry to a layer, from the content of an SDO_GEOMETRY
+**              object. Returns 0 if the geometry was added, or -1 if it is
+**              empty or its element info array is not valid.
+*******************************************************************************/
+int AddRenderGeometry (
+  render_layer_struct *layer,
+  double              value,
+  int                 gtype,
+  int                 has_point,
+  double              point_x,
+  double              point_y,
+  const int           *elem_info,
+  int                 n_elem_info,
+  const double        *ordinates,
+  int                 n_ordinates)
+{
+  render_geometry_struct *g;
+  int    dim = gtype / 1000;
+  int    n_elements = n_elem_info / 3;
+  int    e, next, etype, interpretation, first, last, i, n, max_vertices;
+  char   kind;
+
+  if (dim < 2)
+    dim = 2;
+
+  if (layer->n_geometries == layer->size) {
+    layer->size = layer->size > 0 ? 2 * layer->size : 1024;
+    layer->geometries = realloc (layer->geometries,
+      layer->size * sizeof(render_geometry_struct));
+  }
+  g = &layer->geometries[layer->n_geometries];
+
+  /* Bound the number of vertices: rings may need closing, rectangles and
+     circles are expanded */
+  max_vertices = n_ordinates / dim + 1;
+  for (e=0; e<n_elements; e++)
+    if (elem_info[3*e+2] == 3)
+      max_vertices += 5;
+    else if (elem_info[3*e+2] == 4)
+      max_vertices += RENDER_CIRCLE_SEGMENTS + 1;
+    else
+      max_vertices += 1;
+  g->x = malloc (max_vertices * sizeof(double));
+  g->y = malloc (max_vertices * sizeof(double));
+  g->part_start = malloc ((n_elements + 2) * sizeof(int));
+  g->part_kind = malloc (n_elements + 1);
+  g->part_box = NULL;
+  g->n_parts = 0;
+  g->n_vertices = 0;
+  g->value = value;
+
+  /* A point stored in SDO_POINT */
+  if (n_elements == 0 && has_point) {
+    g->part_start[0] = 0;
+    g->part_kind[0] = RENDER_POINTS;
+    g->x[0] = point_x;
+    g->y[0] = point_y;
+    g->n_parts = 1;
+    g->n_vertices = 1;
+  }
+
+  /* Convert each element into a part. A compound element is followed by its
+     sub-elements: all its points go into one part */
+  for (e=0; e<n_elements; e=next) {
+    etype = elem_info[3*e+1];
+    interpretation = elem_info[3*e+2];
+    next = e + 1;
+    if (etype == 4 || etype == 1005 || etype == 2005)
+      next += interpretation;
+    first = elem_info[3*e] - 1;
+    last = next < n_elements ? elem_info[3*next] - 1 : n_ordinates;
+    if (first < 0 || last > n_ordinates || first >= last || first % dim != 0)
+      break;
+    first /= dim;
+    last /= dim;
+
+    if (etype == 1 && interpretation > 0)
+      kind = RENDER_POINTS;
+    else if (etype == 2 || etype == 4)
+      kind = RENDER_LINE;
+    else if (etype == 1003 || etype == 2003 || etype == 1005 || etype == 2005)
+      kind = RENDER_RING;
+    else
+      continue;                       /* Orientation of a point, or unknown */
+
+    g->part_start[g->n_parts] = g->n_vertices;
+    g->part_kind[g->n_parts] = kind;
+    n = g->n_vertices;
+    if (kind == RENDER_RING && interpretation == 3 && (etype == 1003 || etype == 2003)) {
+      /* Rectangle: lower left and upper right corners. The corners go
+         round in the direction of the ring, so that holes stay holes */
+      double x0, y0, x1, y1;
+      if (last - first < 2)
+        break;
+      x0 = ordinates[first*dim];     y0 = ordinates[first*dim+1];
+      x1 = ordinates[(first+1)*dim]; y1 = ordinates[(first+1)*dim+1];
+      if (etype == 2003) {
+        double swap = x0; x0 = x1; x1 = swap;
+      }
+      g->x[n] = x0; g->y[n++] = y0;
+      g->x[n] = x1; g->y[n++] = y0;
+      g->x[n] = x1; g->y[n++] = y1;
+      g->x[n] = x0; g->y[n++] = y1;
+      g->x[n] = x0; g->y[n++] = y0;
+    }
+    else if (kind == RENDER_RING && interpretation == 4 && (etype == 1003 || etype == 2003)) {
+      /* Circle: three points on the circle. Holes turn clockwise */
+      double p[6];
+      if (last - first < 3)
+        break;
+      for (i=0; i<3; i++) {
+        p[2*i] = ordinates[(first+i)*dim];
+        p[2*i+1] = ordinates[(first+i)*dim+1];
+      }
+      i = AddCircle (p, g->x + n, g->y + n);
+      if (etype == 2003)
+        ReverseVertices (g->x + n, g->y + n, i);
+      n += i;
+    }
+    else {
+      for (i=first; i<last; i++) {
+        g->x[n] = ordinates[i*dim];
+        g->y[n++] = ordinates[i*dim+1];
+      }
+      if (kind == RENDER_RING &&
+          (g->x[n-1] != g->x[g->n_vertices] || g->y[n-1] != g->y[g->n_vertices])) {
+        g->x[n] = g->x[g->n_vertices];
+        g->y[n] = g->y[g->n_vertices];
+        n++;
+      }
+    }
+    if (n > g->n_vertices) {
+      g->n_vertices = n;
+      g->n_parts++;
+    }
+  }
+
+  if (e < n_elements || g->n_parts == 0) {
+    free (g->x);
+    free (g->y);
+    free (g->part_start);
+    free (g->part_kind);
+    return -1;
+  }
+  g->part_start[g->n_parts] = g->n_vertices;
+  g->part_box = malloc (4 * g->n_parts * sizeof(double));
+
+  layer->n_geometries++;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     ProjectRenderLayer
+**
+** Description: Convert the vertices of all geometries to world coordinates,
+**              and compute the MBRs of the geometries and of their parts, and
+**              the range of the values
+*******************************************************************************/
+void ProjectRenderLayer (render_layer_struct *layer, int scheme)
+{
+  render_geometry_struct *g;
+  double min_x = HUGE_VAL, min_y = HUGE_VAL, max_x = -HUGE_VAL, max_y = -HUGE_VAL;
+  double size, latitude, *box;
+  long   i;
+  int    p, v;
+
+  layer->scheme = scheme;
+  if (layer->n_geometries == 0)
+    return;
+
+  /* The extent of the layer, for RENDER_EXTENT */
+  for (i=0; i<layer->n_geometries; i++) {
+    g = &layer->geometries[i];
+    for (v=0; v<g->n_vertices; v++) {
+      min_x = g->x[v] < min_x ? g->x[v] : min_x;
+      max_x = g->x[v] > max_x ? g->x[v] : max_x;
+      min_y = g->y[v] < min_y ? g->y[v] : min_y;
+      max_y = g->y[v] > max_y ? g->y[v] : max_y;
+    }
+  }
+  size = max_x - min_x > max_y - min_y ? max_x - min_x : max_y - min_y;
+  if (size <= 0)
+    size = 1;
+
+  layer->min_value = layer->max_value = layer->geometries[0].value;
+  for (i=0; i<layer->n_geometries; i++) {
+    g = &layer->geometries[i];
+    layer->min_value = g->value < layer->min_value ? g->value : layer->min_value;
+    layer->max_value = g->value > layer->max_value ? g->value : layer->max_value;
+
+    for (v=0; v<g->n_vertices; v++)
+      if (scheme == RENDER_MERCATOR) {
+        latitude = g->y[v];
+        if (latitude > MAX_LATITUDE)
+          latitude = MAX_LATITUDE;
+        if (latitude < -MAX_LATITUDE)
+          latitude = -MAX_LATITUDE;
+        g->x[v] = (g->x[v] + 180) / 360;
+        g->y[v] = 0.5 - log (tan (M_PI / 4 + latitude * M_PI / 360)) / (2 * M_PI);
+      }
+      else {
+        g->x[v] = (g->x[v] - min_x) / size;
+        g->y[v] = (max_y - g->y[v]) / size;
+      }
+
+    for (p=0; p<g->n_parts; p++) {
+      box = g->part_box + 4 * p;
+      box[0] = box[2] = g->x[g->part_start[p]];
+      box[1] = box[3] = g->y[g->part_start[p]];
+      for (v=g->part_start[p]+1; v<g->part_start[p+1]; v++) {
+        box[0] = g->x[v] < box[0] ? g->x[v] : box[0];
+        box[1] = g->y[v] < box[1] ? g->y[v] : box[1];
+        box[2] = g->x[v] > box[2] ? g->x[v] : box[2];
+        box[3] = g->y[v] > box[3] ? g->y[v] : box[3];
+      }
+      if (p == 0) {
+        g->min_x = box[0]; g->min_y = box[1];
+        g->max_x = box[2]; g->max_y = box[3];
+      }
+      else {
+        g->min_x = box[0] < g->min_x ? box[0] : g->min_x;
+        g->min_y = box[1] < g->min_y ? box[1] : g->min_y;
+        g->max_x = box[2] > g->max_x ? box[2] : g->max_x;
+        g->max_y = box[3] > g->max_y ? box[3] : g->max_y;
+      }
+    }
+  }
+}
+
+/*******************************************************************************
+** Routine:     FreeRenderLayer
+**
+** Description: Free the geometries of a layer
+*******************************************************************************/
+void FreeRenderLayer (render_layer_struct *layer)
+{
+  long i;
+
+  for (i=0; i<layer->n_geometries; i++) {
+    free (layer->geometries[i].x);
+    free (layer->geometries[i].y);
+    free (layer->geometries[i].part_start);
+    free (layer->geometries[i].part_kind);
+    free (layer->geometries[i].part_box);
+  }
+  free (layer->geometries);
+  InitRenderLayer (layer);
+}
+
+/*******************************************************************************
+** Routine:     AccumulateEdge
+**
+** Description: Add the signed area covered by an edge to the cells of each
+**              row it crosses. The edge must lie inside the tile.
+*******************************************************************************/
+static void AccumulateEdge (
+  render_canvas_struct *canvas,
+  float x0, float y0, float x1, float y1)
+{
+  float *cells;
+  float dir, dxdy, x, xnext, dy, d, left, right, s, left_fraction, right_fraction;
+  float a0, a1, a2, am, middle;
+  int   row, last_row, left_cell, right_cell, c;
+
+  if (y0 == y1)
+    return;
+  if (y0 < y1)
+    dir = 1;
+  else {
+    dir = -1;
+    x = x0; x0 = x1; x1 = x;
+    x = y0; y0 = y1; y1 = x;
+  }
+  dxdy = (x1 - x0) / (y1 - y0);
+  x = x0;
+  last_row = (int) ceilf (y1);
+  if (last_row > RENDER_TILE_SIZE)
+    last_row = RENDER_TILE_SIZE;
+
+  for (row=(int) y0; row<last_row; row++) {
+    cells = canvas->cells + row * RENDER_STRIDE;
+    dy = ((row + 1) < y1 ? (row + 1) : y1) - (row > y0 ? row : y0);
+    xnext = x + dxdy * dy;
+    d = dy * dir;
+    left = x < xnext ? x : xnext;
+    right = x < xnext ? xnext : x;
+    left_cell = (int) floorf (left);
+    right_cell = (int) ceilf (right);
+    if (right_cell <= left_cell + 1) {
+      /* Within one cell: split the area between it and the next one */
+      middle = 0.5f * (x + xnext) - left_cell;
+      cells[left_cell] += d - d * middle;
+      cells[left_cell + 1] += d * middle;
+    }
+    else {
+      s = 1 / (right - left);
+      left_fraction = left - left_cell;
+      a0 = 0.5f * s * (1 - left_fraction) * (1 - left_fraction);
+      right_fraction = right - right_cell + 1;
+      am = 0.5f * s * right_fraction * right_fraction;
+      cells[left_cell] += d * a0;
+      if (right_cell == left_cell + 2)
+        cells[left_cell + 1] += d * (1 - a0 - am);
+      else {
+        a1 = s * (1.5f - left_fraction);
+        cells[left_cell + 1] += d * (a1 - a0);
+        for (c=left_cell+2; c<right_cell-1; c++)
+          cells[c] += d * s;
+        a2 = a1 + (right_cell - left_cell - 3) * s;
+        cells[right_cell - 1] += d * (1 - a2 - am);
+      }
+      cells[right_cell] += d * am;
+    }
+    x = xnext;
+  }
+}
+
+/*******************************************************************************
+** Routine:     AddEdge
+**
+** Description: Clip an edge (in pixels) to the tile and accumulate it. The
+**              parts above or below the tile are dropped, the parts to the
+**              left or right are moved onto the sides of the tile.
+*******************************************************************************/
+static void AddEdge (
+  render_canvas_struct *canvas,
+  double x0, double y0, double x1, double y1)
+{
+  const double size = RENDER_TILE_SIZE;
+  double t[4], xs[4], ys[4], swap;
+  int    n = 1, i, first, last;
+
+  if (y0 == y1 || (y0 <= 0 && y1 <= 0) || (y0 >= size && y1 >= size))
+    return;
+
+  /* An edge to the right of the tile adds nothing to its pixels, but the
+     pixels up to the right side may be covered */
+  if (x0 >= size && x1 >= size) {
+    canvas->max_column = RENDER_TILE_SIZE;
+    return;
+  }
+
+  /* Clip to the rows of the tile */
+  if (y0 < 0) {
+    x0 += (x1 - x0) * (0 - y0) / (y1 - y0);
+    y0 = 0;
+  }
+  else if (y0 > size) {
+    x0 += (x1 - x0) * (size - y0) / (y1 - y0);
+    y0 = size;
+  }
+  if (y1 < 0) {
+    x1 += (x0 - x1) * (0 - y1) / (y0 - y1);
+    y1 = 0;
+  }
+  else if (y1 > size) {
+    x1 += (x0 - x1) * (size - y1) / (y0 - y1);
+    y1 = size;
+  }
+
+  /* Split where the edge crosses the sides, and clamp the pieces */
+  t[0] = 0;
+  if ((x0 < 0) != (x1 < 0))
+    t[n++] = (0 - x0) / (x1 - x0);
+  if ((x0 > size) != (x1 > size))
+    t[n++] = (size - x0) / (x1 - x0);
+  if (n == 3 && t[2] < t[1]) {
+    swap = t[1]; t[1] = t[2]; t[2] = swap;
+  }
+  t[n++] = 1;
+  for (i=0; i<n; i++) {
+    xs[i] = x0 + (x1 - x0) * t[i];
+    ys[i] = y0 + (y1 - y0) * t[i];
+    xs[i] = xs[i] < 0 ? 0 : (xs[i] > size ? size : xs[i]);
+  }
+
+  for (i=0; i<n-1; i++)
+    AccumulateEdge (canvas, (float) xs[i], (float) ys[i], (float) xs[i+1], (float) ys[i+1]);
+
+  /* Cells touched, for the composite */
+  first = (int) (y0 < y1 ? y0 : y1);
+  last = (int) ceil (y0 < y1 ? y1 : y0) - 1;
+  canvas->min_row = first < canvas->min_row ? first : canvas->min_row;
+  canvas->max_row = last > canvas->max_row ? last : canvas->max_row;
+  for (i=0; i<n; i++) {
+    first = (int) xs[i];
+    canvas->min_column = first < canvas->min_column ? first : canvas->min_column;
+    canvas->max_column = first > canvas->max_column ? first : canvas->max_column;
+  }
+}
+
+/*******************************************************************************
+** Routine:     AddQuad
+**
+** Description: Accumulate a closed quadrilateral, in pixels
+*******************************************************************************/
+static void AddQuad (render_canvas_struct *canvas, const double *x, const double *y)
+{
+  int i;
+
+  for (i=0; i<4; i++)
+    AddEdge (canvas, x[i], y[i], x[(i+1)%4], y[(i+1)%4]);
+}
+
+/*******************************************************************************
+** Routine:     AddStroke
+**
+** Description: Accumulate the outline of a segment of a line, in pixels,
+**              extended by half its width at both ends so that consecutive
+**              segments join
+*******************************************************************************/
+static void AddStroke (
+  render_canvas_struct *canvas,
+  double x0, double y0, double x1, double y1,
+  double half_width)
+{
+  double qx[4], qy[4], length, ux, uy;
+
+  length = sqrt ((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0));
+  if (length == 0)
+    return;
+  ux = (x1 - x0) / length * half_width;
+  uy = (y1 - y0) / length * half_width;
+  x0 -= ux; y0 -= uy;
+  x1 += ux; y1 += uy;
+  qx[0] = x0 - uy; qy[0] = y0 + ux;
+  qx[1] = x1 - uy; qy[1] = y1 + ux;
+  qx[2] = x1 + uy; qy[2] = y1 - ux;
+  qx[3] = x0 + uy; qy[3] = y0 - ux;
+  AddQuad (canvas, qx, qy);
+}
+
+/*******************************************************************************
+** Routine:     BlendSpan
+**
+** Description: Blend a color into a span of pixels, with the coverage of
+**              each pixel (premultiplied "over")
+*******************************************************************************/
+static void BlendSpan (
+  const float *coverage,
+  float       *red,
+  float       *green,
+  float       *blue,
+  float       *alpha,
+  int         n,
+  const float *color)                 /* Red, green, blue, opacity */
+{
+  float k;
+  int   i;
+
+  for (i=0; i<n; i++) {
+    k = coverage[i] * color[3];
+    red[i] += (color[0] - red[i]) * k;
+    green[i] += (color[1] - green[i]) * k;
+    blue[i] += (color[2] - blue[i]) * k;
+    alpha[i] += (1 - alpha[i]) * k;
+  }
+}
+
+/*******************************************************************************
+** Routine:     Composite
+**
+** Description: Turn the accumulated areas into the coverage of each pixel,
+**              row by row, blend the color into the image, and clear the
+**              accumulation buffer
+*******************************************************************************/
+static void Composite (render_canvas_struct *canvas, const float *color)
+{
+  float *cells, *coverage = canvas->coverage, sum, c;
+  int   row, column, first, last, offset;
+
+  if (canvas->max_row < canvas->min_row)
+    return;
+  first = canvas->min_column;
+  last = canvas->max_column + 2;
+  if (last > RENDER_STRIDE)
+    last = RENDER_STRIDE;
+
+  for (row=canvas->min_row; row<=canvas->max_row; row++) {
+    cells = canvas->cells + row * RENDER_STRIDE;
+    sum = 0;
+    for (column=first; column<last; column++) {
+      sum += cells[column];
+      cells[column] = 0;
+      c = fabsf (sum);
+      coverage[column] = c < 1 ? c : 1;
+    }
+    offset = row * RENDER_TILE_SIZE + first;
+    BlendSpan (coverage + first, canvas->red + offset, canvas->green + offset,
+      canvas->blue + offset, canvas->alpha + offset,
+      (last < RENDER_TILE_SIZE ? last : RENDER_TILE_SIZE) - first, color);
+  }
+
+  canvas->min_row = canvas->min_column = RENDER_TILE_SIZE;
+  canvas->max_row = canvas->max_column = -1;
+}
+
+/*******************************************************************************
+** Routine:     SetColor
+**
+** Description: Convert an RGBA color to the floats used to blend it
+*******************************************************************************/
+static void SetColor (const unsigned char *rgba, float *color)
+{
+  int i;
+
+  for (i=0; i<4; i++)
+    color[i] = rgba[i] / 255.0f;
+}
+
+/*******************************************************************************
+** Routine:     DrawGeometry
+**
+** Description: Draw a geometry into a tile: fill its rings, then stroke its
+**              lines and rings, then draw its points
+*******************************************************************************/
+static void DrawGeometry (
+  render_canvas_struct         *canvas,
+  const render_layer_struct    *layer,
+  const render_style_struct    *style,
+  const render_geometry_struct *g,
+  int                          zoom,
+  long                         column,
+  long                         row)
+{
+  double scale = (double) RENDER_TILE_SIZE * (1L << zoom);
+  double origin_x = (double) column * RENDER_TILE_SIZE, origin_y = (double) row * RENDER_TILE_SIZE;
+  double tile[4], margin, half_width, half_size, x0, y0, x1, y1, t, qx[4], qy[4];
+  const double *box;
+  float  color[4];
+  int    p, v, kind, drawn;
+
+  tile[0] = origin_x / scale;
+  tile[1] = origin_y / scale;
+  tile[2] = (origin_x + RENDER_TILE_SIZE) / scale;
+  tile[3] = (origin_y + RENDER_TILE_SIZE) / scale;
+  half_width = style->line_width / 2;
+  half_size = style->point_size / 2;
+
+  /* Fill the rings. A ring that misses the tile adds nothing to it */
+  drawn = 0;
+  for (p=0; p<g->n_parts; p++) {
+    box = g->part_box + 4 * p;
+    if (g->part_kind[p] != RENDER_RING ||
+        box[0] > tile[2] || box[2] < tile[0] || box[1] > tile[3] || box[3] < tile[1])
+      continue;
+    for (v=g->part_start[p]; v<g->part_start[p+1]-1; v++)
+      AddEdge (canvas,
+        g->x[v] * scale - origin_x, g->y[v] * scale - origin_y,
+        g->x[v+1] * scale - origin_x, g->y[v+1] * scale - origin_y);
+    drawn = 1;
+  }
+  if (drawn) {
+    t = layer->max_value > layer->min_value ?
+      (g->value - layer->min_value) / (layer->max_value - layer->min_value) : 0;
+    for (v=0; v<4; v++)
+      color[v] = (float) ((style->fill_low[v] + (style->fill_high[v] - style->fill_low[v]) * t) / 255);
+    Composite (canvas, color);
+  }
+
+  /* Stroke the lines and the boundaries of the rings */
+  if (half_width > 0) {
+    margin = (half_width + 1) / scale;
+    for (p=0; p<g->n_parts; p++) {
+      box = g->part_box + 4 * p;
+      kind = g->part_kind[p];
+      if (kind == RENDER_POINTS || box[0] > tile[2] + margin || box[2] < tile[0] - margin
+          || box[1] > tile[3] + margin || box[3] < tile[1] - margin)
+        continue;
+      for (v=g->part_start[p]; v<g->part_start[p+1]-1; v++) {
+        x0 = g->x[v] * scale - origin_x;
+        y0 = g->y[v] * scale - origin_y;
+        x1 = g->x[v+1] * scale - origin_x;
+        y1 = g->y[v+1] * scale - origin_y;
+        if ((x0 < -half_width - 1 && x1 < -half_width - 1) || (y0 < -half_width - 1 && y1 < -half_width - 1)
+            || (x0 > RENDER_TILE_SIZE + half_width + 1 && x1 > RENDER_TILE_SIZE + half_width + 1)
+            || (y0 > RENDER_TILE_SIZE + half_width + 1 && y1 > RENDER_TILE_SIZE + half_width + 1))
+          continue;
+        AddStroke (canvas, x0, y0, x1, y1, half_width);
+      }
+    }
+    SetColor (style->line, color);
+    Composite (canvas, color);
+  }
+
+  /* Draw the points as squares */
+  if (half_size > 0) {
+    for (p=0; p<g->n_parts; p++) {
+      if (g->part_kind[p] != RENDER_POINTS)
+        continue;
+      for (v=g->part_start[p]; v<g->part_start[p+1]; v++) {
+        x0 = g->x[v] * scale - origin_x;
+        y0 = g->y[v] * scale - origin_y;
+        if (x0 < -half_size || y0 < -half_size
+            || x0 > RENDER_TILE_SIZE + half_size || y0 > RENDER_TILE_SIZE + half_size)
+          continue;
+        qx[0] = qx[3] = x0 - half_size;
+        qx[1] = qx[2] = x0 + half_size;
+        qy[0] = qy[1] = y0 - half_size;
+        qy[2] = qy[3] = y0 + half_size;
+        AddQuad (canvas, qx, qy);
+      }
+    }
+    SetColor (style->point, color);
+    Composite (canvas, color);
+  }
+}
+
+/*******************************************************************************
+** Routine:     InitTables
+**
+** Description: Compute the table of the CRC of PNG chunks, and the fixed
+**              Huffman codes of deflate for the literal bytes, the end of
+**              block (256) and the length codes (257 to 285). Deflate
+**              writes Huffman codes from their most significant bit, so
+**              their bits are reversed here once and for all.
+*******************************************************************************/
+static void InitTables (void)
+{
+  uint32_t c, code;
+  int      n, k, length;
+
+  for (n=0; n<256; n++) {
+    c = (uint32_t) n;
+    for (k=0; k<8; k++)
+      c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    crc_table[n] = c;
+  }
+
+  for (n=0; n<288; n++) {
+    if (n < 144) {
+      code = 0x30 + n;
+      length = 8;
+    }
+    else if (n < 256) {
+      code = 0x190 + n - 144;
+      length = 9;
+    }
+    else if (n < 280) {
+      code = n - 256;
+      length = 7;
+    }
+    else {
+      code = 0xC0 + n - 280;
+      length = 8;
+    }
+    symbol_code[n] = 0;
+    for (k=0; k<length; k++)
+      symbol_code[n] |= ((code >> k) & 1) << (length - 1 - k);
+    symbol_length[n] = length;
+  }
+}
+
+/*******************************************************************************
+** Routine:     PutBits, PutSymbol, PutRun
+**
+** Description: Write bits to a deflate stream, packed from the least
+**              significant one
+*******************************************************************************/
+static void PutBits (bit_writer_struct *writer, uint32_t value, int n_bits)
+{
+  writer->bits |= value << writer->n_bits;
+  writer->n_bits += n_bits;
+  while (writer->n_bits >= 8) {
+    writer->data[writer->size++] = (unsigned char) (writer->bits & 0xFF);
+    writer->bits >>= 8;
+    writer->n_bits -= 8;
+  }
+}
+
+/* A literal byte, the end of block or a length code */
+static void PutSymbol (bit_writer_struct *writer, int symbol)
+{
+  PutBits (writer, symbol_code[symbol], symbol_length[symbol]);
+}
+
+/* A repeat of the previous byte, 3 to 258 times (a match at distance 1) */
+static void PutRun (bit_writer_struct *writer, int length)
+{
+  static const int base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+  static const int extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+  int code = 28;
+
+  while (base[code] > length)
+    code--;
+  PutSymbol (writer, 257 + code);
+  PutBits (writer, (uint32_t) (length - base[code]), extra[code]);
+  PutBits (writer, 0, 5);             /* Distance code 0: distance 1 */
+}
+
+/*******************************************************************************
+** Routine:     PutChunk
+**
+** Description: Write a PNG chunk whose data is already in place after its
+**              length and type. Returns the position after the chunk.
+*******************************************************************************/
+static long PutChunk (unsigned char *png, long position, const char *type, long length)
+{
+  unsigned char *chunk = png + position;
+  uint32_t crc = 0xFFFFFFFFu;
+  long     i;
+
+  chunk[0] = (unsigned char) (length >> 24);
+  chunk[1] = (unsigned char) (length >> 16);
+  chunk[2] = (unsigned char) (length >> 8);
+  chunk[3] = (unsigned char) length;
+  memcpy (chunk + 4, type, 4);
+  for (i=4; i<8+length; i++)
+    crc = crc_table[(crc ^ chunk[i]) & 0xFF] ^ (crc >> 8);
+  crc ^= 0xFFFFFFFFu;
+  chunk[8+length] = (unsigned char) (crc >> 24);
+  chunk[9+length] = (unsigned char) (crc >> 16);
+  chunk[10+length] = (unsigned char) (crc >> 8);
+  chunk[11+length] = (unsigned char) crc;
+  return position + 12 + length;
+}
+
+/*******************************************************************************
+** Routine:     EncodePng
+**
+** Description: Encode the image of a canvas as a PNG file (8-bit RGBA)
+*******************************************************************************/
+static void EncodePng (render_canvas_struct *canvas)
+{
+  static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  const long   row_size = 4 * RENDER_TILE_SIZE + 1;
+  const long   raw_size = row_size * RENDER_TILE_SIZE;
+  unsigned char *rgba = canvas->rgba, *raw, *header;
+  bit_writer_struct writer;
+  uint32_t     a = 1, b = 0;
+  float        inverse;
+  long         i, run, position, offset;
+  int          row, x;
+
+  /* Convert the image to 8-bit RGBA, each row filtered with "Sub" */
+  for (row=0; row<RENDER_TILE_SIZE; row++) {
+    offset = (long) row * RENDER_TILE_SIZE;
+    for (x=0; x<RENDER_TILE_SIZE; x++) {
+      inverse = canvas->alpha[offset + x] > 0 ? 255 / canvas->alpha[offset + x] : 0;
+      rgba[4*x] = (unsigned char) (canvas->red[offset + x] * inverse + 0.5f);
+      rgba[4*x+1] = (unsigned char) (canvas->green[offset + x] * inverse + 0.5f);
+      rgba[4*x+2] = (unsigned char) (canvas->blue[offset + x] * inverse + 0.5f);
+      rgba[4*x+3] = (unsigned char) (canvas->alpha[offset + x] * 255 + 0.5f);
+    }
+    raw = canvas->raw + row * row_size;
+    raw[0] = 1;
+    for (i=0; i<4; i++)
+      raw[1+i] = rgba[i];
+    for (i=4; i<4*RENDER_TILE_SIZE; i++)
+      raw[1+i] = (unsigned char) (rgba[i] - rgba[i-4]);
+  }
+  raw = canvas->raw;
+
+  /* Signature and header */
+  memcpy (canvas->png, signature, 8);
+  header = canvas->png + 16;
+  header[0] = header[1] = 0;
+  header[2] = (unsigned char) (RENDER_TILE_SIZE >> 8);
+  header[3] = (unsigned char) RENDER_TILE_SIZE;
+  memcpy (header + 4, header, 4);
+  header[8] = 8;                      /* Bit depth */
+  header[9] = 6;                      /* RGBA */
+  header[10] = header[11] = header[12] = 0;
+  position = PutChunk (canvas->png, 8, "IHDR", 13);
+
+  /* Image data: a zlib stream with a single block of fixed Huffman codes */
+  writer.data = canvas->png + position + 8;
+  writer.size = 0;
+  writer.bits = 0;
+  writer.n_bits = 0;
+  writer.data[writer.size++] = 0x78;
+  writer.data[writer.size++] = 0x01;
+  PutBits (&writer, 1, 1);            /* Last block */
+  PutBits (&writer, 1, 2);            /* Fixed Huffman codes */
+  for (i=0; i<raw_size; ) {
+    run = 0;
+    if (i > 0)
+      while (i + run < raw_size && run < 258 && raw[i + run] == raw[i - 1])
+        run++;
+    if (run >= 3) {
+      PutRun (&writer, (int) run);
+      i += run;
+    }
+    else
+      PutSymbol (&writer, raw[i++]);
+  }
+  PutSymbol (&writer, 256);
+  if (writer.n_bits > 0)
+    PutBits (&writer, 0, 8 - writer.n_bits);
+  /* Adler-32, reduced every 5552 bytes, before b can overflow */
+  for (i=0; i<raw_size; i+=run) {
+    run = raw_size - i < 5552 ? raw_size - i : 5552;
+    for (offset=i; offset<i+run; offset++) {
+      a += raw[offset];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+  }
+  a |= b << 16;
+  writer.data[writer.size++] = (unsigned char) (a >> 24);
+  writer.data[writer.size++] = (unsigned char) (a >> 16);
+  writer.data[writer.size++] = (unsigned char) (a >> 8);
+  writer.data[writer.size++] = (unsigned char) a;
+  position = PutChunk (canvas->png, position, "IDAT", writer.size);
+  canvas->png_size = PutChunk (canvas->png, position, "IEND", 0);
+}
+
+/*******************************************************************************
+** Routine:     MakeDirectory
+**
+** Description: Create a directory. Returns 0 if it was created or already
+**              exists, -1 if not.
+*******************************************************************************/
+static int MakeDirectory (const char *path)
+{
+#ifndef _WIN32
+  if (mkdir (path, 0777) == 0 || errno == EEXIST)
+#else
+  if (_mkdir (path) == 0 || errno == EEXIST)
+#endif
+    return 0;
+  return -1;
+}
+
+/*******************************************************************************
+** Routine:     WriteTile
+**
+** Description: Write the PNG file of a tile, creating its column directory
+**              if needed. Returns 0, or -1 if the file could not be written.
+*******************************************************************************/
+static int WriteTile (
+  const char           *directory,
+  int                  zoom,
+  long                 column,
+  long                 row,
+  render_canvas_struct *canvas)
+{
+  char path[1024];
+  FILE *file;
+
+  sprintf (path, "%s/%d/%ld/%ld.png", directory, zoom, column, row);
+  file = fopen (path, "wb");
+  if (file == NULL) {
+    sprintf (path, "%s/%d/%ld", directory, zoom, column);
+    if (MakeDirectory (path) != 0)
+      return -1;
+    sprintf (path, "%s/%d/%ld/%ld.png", directory, zoom, column, row);
+    file = fopen (path, "wb");
+    if (file == NULL)
+      return -1;
+  }
+  if (fwrite (canvas->png, 1, canvas->png_size, file) != (size_t) canvas->png_size) {
+    fclose (file);
+    return -1;
+  }
+  return fclose (file) == 0 ? 0 : -1;
+}
+
+/*******************************************************************************
+** Routine:     NextTile
+**
+** Description: Take the next tile from the queue. Returns -1 when there are
+**              none left.
+*******************************************************************************/
+static long NextTile (render_queue_struct *queue)
+{
+  long task = -1;
+
+#ifndef _WIN32
+  pthread_mutex_lock (&queue->lock);
+#endif
+  if (queue->next_task < queue->n_tasks && !queue->error)
+    task = queue->next_task++;
+#ifndef _WIN32
+  pthread_mutex_unlock (&queue->lock);
+#endif
+  return task;
+}
+
+/*******************************************************************************
+** Routine:     RenderQueue
+**
+** Description: Thread routine: render and write each tile taken
+*******************************************************************************/
+static void *RenderQueue (void *argument)
+{
+  render_worker_struct *worker = (render_worker_struct *) argument;
+  render_queue_struct  *queue = worker->queue;
+  render_canvas_struct *canvas = &worker->canvas;
+  size_t pixels = (size_t) RENDER_TILE_SIZE * RENDER_TILE_SIZE * sizeof(float);
+  long   task, piece, column, row;
+
+  while ((task = NextTile (queue)) >= 0) {
+    memset (canvas->red, 0, pixels);
+    memset (canvas->green, 0, pixels);
+    memset (canvas->blue, 0, pixels);
+    memset (canvas->alpha, 0, pixels);
+    row = (long) (queue->pieces[queue->task_start[task]].tile >> queue->zoom);
+    column = (long) (queue->pieces[queue->task_start[task]].tile & ((1UL << queue->zoom) - 1));
+    for (piece=queue->task_start[task]; piece<queue->task_start[task+1]; piece++)
+      DrawGeometry (canvas, queue->layer, queue->style,
+        &queue->layer->geometries[queue->pieces[piece].geometry], queue->zoom, column, row);
+    EncodePng (canvas);
+    if (WriteTile (queue->directory, queue->zoom, column, row, canvas) != 0) {
+#ifndef _WIN32
+      pthread_mutex_lock (&queue->lock);
+#endif
+      queue->error = 1;
+#ifndef _WIN32
+      pthread_mutex_unlock (&queue->lock);
+#endif
+      break;
+    }
+    worker->n_tiles++;
+    worker->n_bytes += canvas->png_size;
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     ComparePieces
+**
+** Description: Order pieces by tile, then in the order of the layer (for
+**              qsort)
+*******************************************************************************/
+static int ComparePieces (const void *a, const void *b)
+{
+  const render_piece_struct *pa = (const render_piece_struct *) a;
+  const render_piece_struct *pb = (const render_piece_struct *) b;
+
+  if (pa->tile != pb->tile)
+    return pa->tile < pb->tile ? -1 : 1;
+  return pa->geometry < pb->geometry ? -1 : (pa->geometry > pb->geometry ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     TileOf
+**
+** Description: Column or row of the tile that holds a world coordinate
+*******************************************************************************/
+static long TileOf (double coordinate, long n_tiles)
+{
+  long tile;
+
+  if (coordinate < 0)
+    return 0;
+  tile = (long) (coordinate * n_tiles);
+  return tile < n_tiles ? tile : n_tiles - 1;
+}
+
+/*******************************************************************************
+** Routine:     ListPieces
+**
+** Description: List the tiles of a zoom that the MBR of each geometry
+**              overlaps, with a margin for the lines and points, sorted by
+**              tile. Returns the number of pieces.
+*******************************************************************************/
+static long ListPieces (
+  const render_layer_struct *layer,
+  const render_style_struct *style,
+  int                       zoom,
+  render_piece_struct       **pieces)
+{
+  const render_geometry_struct *g;
+  render_piece_struct *list = NULL;
+  long   n_tiles = 1L << zoom, n = 0, size = 0, i, row, column;
+  long   first_column, last_column, first_row, last_row;
+  double margin;
+
+  margin = (style->line_width > style->point_size ? style->line_width : style->point_size) / 2 + 1;
+  margin /= (double) RENDER_TILE_SIZE * n_tiles;
+  for (i=0; i<layer->n_geometries; i++) {
+    g = &layer->geometries[i];
+    if (g->max_x + margin < 0 || g->min_x - margin > 1 || g->max_y + margin < 0 || g->min_y - margin > 1)
+      continue;
+    first_column = TileOf (g->min_x - margin, n_tiles);
+    last_column = TileOf (g->max_x + margin, n_tiles);
+    first_row = TileOf (g->min_y - margin, n_tiles);
+    last_row = TileOf (g->max_y + margin, n_tiles);
+    for (row=first_row; row<=last_row; row++)
+      for (column=first_column; column<=last_column; column++) {
+        if (n == size) {
+          size = size > 0 ? 2 * size : 4096;
+          list = realloc (list, size * sizeof(render_piece_struct));
+        }
+        list[n].tile = ((uint64_t) row << zoom) | (uint64_t) column;
+        list[n].geometry = i;
+        n++;
+      }
+  }
+  if (n > 0)
+    qsort (list, n, sizeof(render_piece_struct), ComparePieces);
+  *pieces = list;
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     RenderTiles
+**
+** Description: Render the tiles of a layer from min_zoom to max_zoom into a
+**              directory. The layer must have been projected. Returns 0, or
+**              -1 if the parameters are invalid or a tile could not be
+**              written.
+*******************************************************************************/
+int RenderTiles (
+  const render_layer_struct *layer,
+  const render_style_struct *style,
+  int                       min_zoom,
+  int                       max_zoom,
+  const char                *directory,
+  int                       n_threads,
+  render_result_struct      *result)
+{
+  render_queue_struct  queue;
+  render_worker_struct *workers;
+  render_canvas_struct *canvas;
+  size_t pixels = (size_t) RENDER_TILE_SIZE * RENDER_TILE_SIZE;
+  char   path[1024];
+  long   n_pieces, i;
+  int    zoom, t, status = 0;
+  double start_time;
+#ifndef _WIN32
+  struct timespec now;
+  pthread_t threads[RENDER_MAX_THREADS];
+  int       started[RENDER_MAX_THREADS];
+#endif
+
+  memset (result, 0, sizeof(render_result_struct));
+  if (min_zoom < 0 || max_zoom > RENDER_MAX_ZOOM || min_zoom > max_zoom
+      || layer->scheme == 0 || strlen (directory) > sizeof(path) - 64)
+    return -1;
+#ifdef _WIN32
+  n_threads = 1;
+#endif
+  if (n_threads < 1)
+    n_threads = 1;
+  if (n_threads > RENDER_MAX_THREADS)
+    n_threads = RENDER_MAX_THREADS;
+  result->n_threads = n_threads;
+  InitTables ();
+  if (MakeDirectory (directory) != 0)
+    return -1;
+
+  /* The buffers of each thread. The PNG buffer holds the worst case: 9
+     bits per byte */
+  workers = calloc (n_threads, sizeof(render_worker_struct));
+  for (t=0; t<n_threads; t++) {
+    workers[t].queue = &queue;
+    canvas = &workers[t].canvas;
+    canvas->cells = calloc (RENDER_STRIDE * RENDER_TILE_SIZE, sizeof(float));
+    canvas->coverage = malloc (RENDER_STRIDE * sizeof(float));
+    canvas->red = malloc (pixels * sizeof(float));
+    canvas->green = malloc (pixels * sizeof(float));
+    canvas->blue = malloc (pixels * sizeof(float));
+    canvas->alpha = malloc (pixels * sizeof(float));
+    canvas->rgba = malloc (4 * RENDER_TILE_SIZE);
+    canvas->raw = malloc ((4 * RENDER_TILE_SIZE + 1) * RENDER_TILE_SIZE);
+    canvas->png = malloc ((4 * RENDER_TILE_SIZE + 1) * RENDER_TILE_SIZE * 9 / 8 + 1024);
+    canvas->min_row = canvas->min_column = RENDER_TILE_SIZE;
+    canvas->max_row = canvas->max_column = -1;
+  }
+
+  for (zoom=min_zoom; zoom<=max_zoom && status == 0; zoom++) {
+#ifndef _WIN32
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    start_time = now.tv_sec + now.tv_nsec * 1e-9;
+#else
+    start_time = (double) clock () / CLOCKS_PER_SEC;
+#endif
+    sprintf (path, "%s/%d", directory, zoom);
+    if (MakeDirectory (path) != 0) {
+      status = -1;
+      break;
+    }
+
+    /* One task per tile, in the order of the rows */
+    memset (&queue, 0, sizeof(queue));
+    queue.layer = layer;
+    queue.style = style;
+    queue.directory = directory;
+    queue.zoom = zoom;
+    n_pieces = ListPieces (layer, style, zoom, &queue.pieces);
+    queue.task_start = malloc ((n_pieces + 1) * sizeof(long));
+    for (i=0; i<n_pieces; i++)
+      if (i == 0 || queue.pieces[i].tile != queue.pieces[i-1].tile)
+        queue.task_start[queue.n_tasks++] = i;
+    queue.task_start[queue.n_tasks] = n_pieces;
+    result->n_pieces[zoom] = n_pieces;
+
+    for (t=0; t<n_threads; t++) {
+      workers[t].n_tiles = 0;
+      workers[t].n_bytes = 0;
+    }
+#ifndef _WIN32
+    pthread_mutex_init (&queue.lock, NULL);
+    for (t=1; t<n_threads; t++)
+      started[t] = pthread_create (&threads[t], NULL, RenderQueue, &workers[t]) == 0;
+    RenderQueue (&workers[0]);
+    for (t=1; t<n_threads; t++)
+      if (started[t])
+        pthread_join (threads[t], NULL);
+    pthread_mutex_destroy (&queue.lock);
+#else
+    RenderQueue (&workers[0]);
+#endif
+
+    for (t=0; t<n_threads; t++) {
+      result->n_tiles[zoom] += workers[t].n_tiles;
+      result->n_bytes[zoom] += workers[t].n_bytes;
+    }
+    if (queue.error)
+      status = -1;
+    free (queue.pieces);
+    free (queue.task_start);
+#ifndef _WIN32
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    result->seconds[zoom] = now.tv_sec + now.tv_nsec * 1e-9 - start_time;
+#else
+    result->seconds[zoom] = (double) clock () / CLOCKS_PER_SEC - start_time;
+#endif
+  }
+
+  for (t=0; t<n_threads; t++) {
+    canvas = &workers[t].canvas;
+    free (canvas->cells);
+    free (canvas->coverage);
+    free (canvas->red);
+    free (canvas->green);
+    free (canvas->blue);
+    free (canvas->alpha);
+    free (canvas->rgba);
+    free (canvas->raw);
+    free (canvas->png);
+  }
+  free (workers);
+  return status;
+}
@@ -0,0 +1,126 @@
+/* tile_render.h
+
+   Client-side rendering of map tiles from a layer of geometries.
+
+   This is a small client-side counterpart of the map tiles of MapViewer
+   (see chapters 11 and 12): it draws a thematic map of one layer, with the
+   polygons filled in a color that depends on a value (from a low color to
+   a high color), their boundaries and the lines stroked in a line color,
+   and the points drawn as small squares. The tiles are written as PNG
+   images of RENDER_TILE_SIZE x RENDER_TILE_SIZE pixels to a directory, in
+   the usual z/x/y layout: directory/zoom/column/row.png.
+
+   The geometries are held in memory, as lists of parts (points, lines or
+   rings) like in geom_join.h, and are projected once to world coordinates
+   between 0 and 1, with y growing downwards. At zoom z the world is cut
+   into 2^z x 2^z tiles, numbered from the upper left corner. Two tile
+   schemes are available:
+
+   - RENDER_MERCATOR: the coordinates are longitudes and latitudes (SRID
+     8307 or 4326), projected to Web Mercator. The tiles are those of the
+     common web maps. Latitudes are limited to +/-85.0511 degrees.
+   - RENDER_EXTENT: zoom 0 is the square around the extent of the layer,
+     for projected coordinate systems.
+
+   The tiles to render at each zoom are those that the MBR of a geometry
+   overlaps. Each tile is a job: the threads take the next job from a
+   shared queue, and each thread has its own drawing buffers.
+
+   The rasterizer works on one tile at a time. Each edge (of a ring, or of
+   the outline of a stroked segment or point) is clipped to the tile: the
+   parts above and below the tile are dropped, and the parts to the left
+   or right are moved onto the edge of the tile, which keeps the coverage
+   of the pixels inside. The edges then add the area they cover in each
+   pixel to an accumulation buffer, and a running sum along each row gives
+   the exact coverage of each pixel by the shape (anti-aliasing without
+   supersampling). Holes are drawn correctly as long as they turn the other
+   way from their exterior ring, as SDO_GEOMETRY requires.
+
+   The coverage is blended into the image one row (span) at a time. The
+   blending loops have no branches, so that the compiler turns them into
+   vector instructions.
+
+   Arcs are replaced by straight lines between their points, and circles by
+   polygons of RENDER_CIRCLE_SEGMENTS sides.
+
+*/
+#ifndef TILE_RENDER_H
+#define TILE_RENDER_H
+
+#define RENDER_TILE_SIZE 256
+#define RENDER_MAX_ZOOM 20
+#define RENDER_MAX_THREADS 64
+#define RENDER_CIRCLE_SEGMENTS 64
+
+/* Kinds of parts of a geometry */
+#define RENDER_POINTS 1
+#define RENDER_LINE 2
+#define RENDER_RING 3
+
+/* Tile schemes */
+#define RENDER_MERCATOR 1
+#define RENDER_EXTENT 2
+
+/* A geometry, reduced to what the rasterizer needs */
+struct render_geometry
+{
+    double value;                     /* Selects the fill color */
+    double min_x, min_y;              /* MBR, in world coordinates once projected */
+    double max_x, max_y;
+    int    n_parts;
+    int    *part_start;               /* First vertex of each part (n_parts + 1) */
+    char   *part_kind;                /* RENDER_POINTS, RENDER_LINE or RENDER_RING */
+    double *part_box;                 /* MBR of each part: min x, min y, max x, max y */
+    int    n_vertices;
+    double *x;                        /* Vertices of all parts. Rings are closed */
+    double *y;
+};
+typedef struct render_geometry render_geometry_struct;
+
+/* A layer of geometries */
+struct render_layer
+{
+    long                   n_geometries;
+    long                   size;      /* Allocated size of the array */
+    render_geometry_struct *geometries;
+    int                    scheme;    /* Set by ProjectRenderLayer */
+    double                 min_value; /* Range of the values */
+    double                 max_value;
+};
+typedef struct render_layer render_layer_struct;
+
+/* Colors are RGBA, with an alpha of 255 for opaque */
+struct render_style
+{
+    unsigned char fill_low[4];        /* Fill color of the lowest value */
+    unsigned char fill_high[4];       /* Fill color of the highest value */
+    unsigned char line[4];            /* Lines and polygon boundaries */
+    unsigned char point[4];
+    double        line_width;         /* In pixels, 0 for no boundaries */
+    double        point_size;         /* Side of the squares, in pixels */
+};
+typedef struct render_style render_style_struct;
+
+/* What was rendered at each zoom */
+struct render_result
+{
+    int    n_threads;
+    long   n_tiles[RENDER_MAX_ZOOM+1];
+    long   n_bytes[RENDER_MAX_ZOOM+1];     /* Size of the PNG files */
+    long   n_pieces[RENDER_MAX_ZOOM+1];    /* Geometries drawn, summed over the tiles */
+    double seconds[RENDER_MAX_ZOOM+1];
+};
+typedef struct render_result render_result_struct;
+
+void InitRenderLayer (render_layer_struct *layer);
+int  AddRenderGeometry (render_layer_struct *layer, double value, int gtype,
+                        int has_point, double point_x, double point_y,
+                        const int *elem_info, int n_elem_info,
+                        const double *ordinates, int n_ordinates);
+void ProjectRenderLayer (render_layer_struct *layer, int scheme);
+void FreeRenderLayer (render_layer_struct *layer);
+int  RenderTiles (const render_layer_struct *layer, const render_style_struct *style,
+                  int min_zoom, int max_zoom, const char *directory, int n_threads,
+                  render_result_struct *result);
+
+#endif
@@ -0,0 +1,714 @@
+/* tiled_bins.c
+
+   This program counts the points of a table per tile, at several tiling
+   levels, and optionally sums and averages the values of a numeric column
+   per tile.
+
+   It is the client-side counterpart of SDO_SAM.TILED_BINS and
+   SDO_SAM.TILED_AGGREGATES (see appendix A): instead of computing the tiles
+   and aggregates in the database, it reads the points with array fetches,
+   as read_points_array.c does, and bins them in memory with the tile grid
+   engine of tile_grid.c, using several threads.
+
+   The points are read with the following statement:
+
+   SELECT TO_BINARY_DOUBLE(COALESCE(C.geo_column.SDO_POINT.X, <center of MBR>)),
+          TO_BINARY_DOUBLE(COALESCE(C.geo_column.SDO_POINT.Y, <center of MBR>)),
+          TO_BINARY_DOUBLE(C.value_column)
+     FROM tablename C
+
+   so that points are binned by their coordinates, and other geometries by
+   the center of their MBR.
+
+   The extent that is divided into tiles is the one registered for the column
+   in USER_SDO_GEOM_METADATA (the bounds of the first two dimensions).
+
+   It illustrates the following concepts:
+   - dynamically constructing SQL statements
+   - reading point details without using objects
+   - using array fetches
+   - fetching binary doubles
+   - reading the dimensions of a layer from USER_SDO_GEOM_METADATA
+
+   The program takes the following command line arguments:
+
+     tiled_bins username password database tablename geo_column tiling_level output [value_column] [array_size] [threads]
+
+   where
+
+   - username = name of the user to connect as
+   - password = password for that user
+   - database = TNS service name for the database
+   - tablename = name of the table to select from
+   - geo_column = name of the geometry column to read
+   - tiling_level = finest tiling level: the extent is divided into
+     2^tiling_level by 2^tiling_level tiles at that level (up to 12)
+   - output = name of the file to write the tiles to. If the name ends with
+     .csv, the non-empty tiles of all levels are written as CSV. Otherwise all
+     tiles are written as a binary grid (see tile_grid.h)
+   - value_column = name of a numeric column to sum and average per tile
+   - array_size = number of rows to read per fetch (default is 1000 rows)
+   - threads = number of binning threads (default is one per processor)
+
+   Notes:
+
+   The program must be linked with tile_grid.c and spatial_util.c. On Linux
+   and other POSIX systems it also needs the POSIX threads library.
+
+   Rows with a NULL geometry are skipped. Rows with a NULL value are counted
+   as points, but their value is not: the average of a tile is the sum of
+   its values divided by the number of values that are not NULL, as with AVG.
+   Points outside the extent of the layer are ignored.
+
+   The points fetched are buffered by tile_grid.c, and binned in large
+   blocks by all threads, so that the array size does not limit the
+   parallelism of the binning.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <oci.h>
+#include "tile_grid.h"
+#include "spatial_util.h"
+
+/*******************************************************************************
+** Global variables
+*******************************************************************************/
+
+/* OCI handles */
+
+OCIEnv       *envhp;  /* Environment handle*/
+OCIError     *errhp;  /* Error handle */
+OCISvcCtx    *svchp;  /* Service Context handle*/
+
+/*******************************************************************************
+** Routine:     ReportError
+**
+** Description: Error message routine
+*******************************************************************************/
+void ReportError(OCIError *errhp)
+{
+  char errbuf[512];
+  sb4 errcode = 0;
+
+  OCIErrorGet(
+    (dvoid *)errhp,                    /* (in)  Error handle */
+    (ub4)1,                            /* (in)  Number of error record */
+    (text *)NULL,                      /* (out) SQLSTATE (no longer used) */
+    &errcode,                          /* (out) Error code */
+    errbuf,                            /* (out) Buffer to receive error message */
+    (ub4)sizeof(errbuf),               /* (in)  Size of error buffer */
+    OCI_HTYPE_ERROR);                  /* (in)  Type of handle (error) */
+
+  fprintf(stderr, "%s\n", errbuf);
+  exit (1);
+}
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     InitializeOCI
+**
+** Description: Initialize the OCI context
+*******************************************************************************/
+void InitializeOCI(void)
+{
+  /* Create and initialize OCI environment handle */
+  OCIEnvCreate(
+    &envhp,                          /* (out) Environment Handle */
+    (ub4)(OCI_DEFAULT),              /* (in)  Mode: default */
+    (dvoid *)0,                      /* (in)  User defined context (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined MALLOC routine (NOT USED) */
+    (dvoid *(*)())0,                 /* (in)  User-defined REALLOC routine (NOT USED) */
+    (void (*)())0,                   /* (in)  User-defined FREE routine (NOT USED) */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (envhp == NULL) {
+    printf ("OCIEnvCreate: failed to create environment handle\n");
+    exit (1);
+  }
+
+  /* Allocate and initialize error report handle */
+  OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&errhp,                /* (out) Error Handle */
+    (ub4)OCI_HTYPE_ERROR,            /* (in)  Handle type (ERROR)*/
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (errhp == NULL) {
+    printf ("OCIHandleAlloc: failed to create error handle\n");
+    exit (1);
+  }
+}
+
+/*******************************************************************************
+** Routine:     ConnectDatabase
+**
+** Description: Connects to the oracle database
+*******************************************************************************/
+void ConnectDatabase(
+        char *username,
+        char *password,
+        char *database)
+{
+  int status;
+  char verbuf[512];
+
+  /* Connect to database */
+  status = OCILogon (
+      envhp,                         /* (in)  Environment Handle */
+      errhp,                         /* (in)  Error Handle */
+      &svchp,                        /* (out) Service Context Handle */
+      username, strlen(username),    /* (in)  Username */
+      password, strlen(password),    /* (in)  Password */
+      database, strlen(database));   /* (in)  Database (TNS service name) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Get database version */
+  OCIServerVersion(
+    svchp,                             /* (in)  Service Context Handle */
+    errhp,                             /* (in)  Error Handle */
+    verbuf,                            /* (out) Buffer to receive version message */
+    sizeof(verbuf),                    /* (in)  Size of message buffer */
+    OCI_HTYPE_SVCCTX);                 /* (in)  Type of handle (service context) */
+
+  printf("Connected to: %s\n", database);
+  printf("%s\n\n", verbuf);
+}
+
+/*******************************************************************************
+** Routine:     DisconnectDatabase
+**
+** Description: Disconnect from Oracle
+*******************************************************************************/
+void DisconnectDatabase(void)
+{
+  int status;
+
+  status = OCILogoff(svchp, errhp);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ClearOCI
+**
+** Description: Release the OCI context
+*******************************************************************************/
+void ClearOCI(void)
+{
+
+  /* Free error handle */
+  OCIHandleFree(
+    (dvoid *)errhp,                  /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_ERROR);           /* (in)  Handle type */
+
+  /* Terminate OCI context */
+  OCITerminate (OCI_DEFAULT);
+}
+
+/*******************************************************************************
+** Routine:     GetLayerExtent
+**
+** Description: Get the bounds of the first two dimensions and the SRID of a
+**              geometry column from USER_SDO_GEOM_METADATA
+*******************************************************************************/
+void GetLayerExtent (
+  char   *tablename,
+  char   *geocolumn,
+  double *min_x,
+  double *min_y,
+  double *max_x,
+  double *max_y,
+  int    *srid)
+{
+  char      *select_sql =
+    "SELECT TO_BINARY_DOUBLE(d.sdo_lb), TO_BINARY_DOUBLE(d.sdo_ub), m.srid "
+    "FROM user_sdo_geom_metadata m, TABLE(m.diminfo) d "
+    "WHERE m.table_name = UPPER(:table_name) AND m.column_name = UPPER(:column_name)";
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  OCIBind   *table_name_hp = NULL;
+  OCIBind   *column_name_hp = NULL;
+  OCIDefine *lb_hp, *ub_hp, *srid_hp;
+  int       rows_fetched = 0;
+
+  /* Host variables: one row per dimension, only the first two are used */
+  double    lb[4], ub[4];
+  int       srids[4];
+  sb2       srid_ind[4];
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* TABLE_NAME (string) */
+  status = OCIBindByName(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &table_name_hp,                  /* (out) Bind Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *) ":TABLE_NAME",          /* (in)  Placeholder */
+    strlen(":TABLE_NAME"),           /* (in)  Placeholder length */
+    (ub1 *) tablename,               /* (in)  Value Pointer */
+    strlen(tablename)+1,             /* (in)  Value Size */
+    SQLT_STR,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* COLUMN_NAME (string) */
+  status = OCIBindByName(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &column_name_hp,                 /* (out) Bind Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *) ":COLUMN_NAME",         /* (in)  Placeholder */
+    strlen(":COLUMN_NAME"),          /* (in)  Placeholder length */
+    (ub1 *) geocolumn,               /* (in)  Value Pointer */
+    strlen(geocolumn)+1,             /* (in)  Value Size */
+    SQLT_STR,                        /* (in)  Data Type */
+    (dvoid *) 0,                     /* (in)  Indicator Pointer (NOT USED) */
+    (ub2 *) 0,                       /* (out) Actual length (NOT USED) */
+    (ub2) 0,                         /* (out) Column return codes (NOT USED) */
+    (ub4) 0,                         /* (in)  (NOT USED) */
+    (ub4 *) 0,                       /* (in)  (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 1 = SDO_LB (binary double) */
+  status = OCIDefineByPos(select_stmthp, &lb_hp, errhp, (ub4)1,
+    (dvoid *) lb, sizeof(double), SQLT_BDOUBLE,
+    (dvoid *) 0, (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 2 = SDO_UB (binary double) */
+  status = OCIDefineByPos(select_stmthp, &ub_hp, errhp, (ub4)2,
+    (dvoid *) ub, sizeof(double), SQLT_BDOUBLE,
+    (dvoid *) 0, (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 3 = SRID (integer) */
+  status = OCIDefineByPos(select_stmthp, &srid_hp, errhp, (ub4)3,
+    (dvoid *) srids, sizeof(int), SQLT_INT,
+    (dvoid *) srid_ind, (ub2 *)0, (ub2 *)0, (ub4)OCI_DEFAULT);
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Execute query and fetch all dimensions at once */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)4,                          /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+  OCIAttrGet((dvoid *)select_stmthp, (ub4)OCI_HTYPE_STMT, (dvoid *)&rows_fetched, (ub4 *)0,
+    (ub4)OCI_ATTR_ROWS_FETCHED, errhp);
+  if (rows_fetched < 2) {
+    printf ("%s.%s is not registered in USER_SDO_GEOM_METADATA\n", tablename, geocolumn);
+    exit (1);
+  }
+
+  *min_x = lb[0];
+  *max_x = ub[0];
+  *min_y = lb[1];
+  *max_y = ub[1];
+  *srid = srid_ind[0] == OCI_IND_NOTNULL ? srids[0] : 0;
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+}
+
+/*******************************************************************************
+** Routine:     ScanPoints
+**
+** Description: Read all points, with their values if a value column is
+**              given, and add them to the grid one batch at a time.
+**              Returns the number of rows fetched.
+*******************************************************************************/
+long ScanPoints (
+  char             *tablename,
+  char             *geocolumn,
+  char             *valuecolumn,
+  int              array_size,
+  tile_grid_struct *grid)
+{
+  long      rows_fetched = 0;        /* Row counter */
+  int       nr_fetches = 0;          /* Number of batches fetched */
+  int       rows_in_batch = 0;       /* Number of rows in current batch */
+  int       n_points;                /* Number of non-null points in current batch */
+  boolean   has_more_data;
+  char      select_sql[2048];        /* SQL Statement */
+  OCIStmt   *select_stmthp;          /* Statement handle */
+  sword     status;                  /* OCI call return status */
+  int       i;
+
+  /* Define handles for host variables */
+  OCIDefine *point_x_hp;
+  OCIDefine *point_y_hp;
+  OCIDefine *value_hp;
+
+  /* Host variables */
+  double    *point_x;
+  double    *point_y;
+  double    *value = NULL;
+  sb2       *point_x_ind;
+  sb2       *point_y_ind;
+  sb2       *value_ind = NULL;
+
+  /* Allocate the arrays that receive the points */
+  point_x = malloc (sizeof(double) * array_size);
+  point_y = malloc (sizeof(double) * array_size);
+  point_x_ind = malloc (sizeof(sb2) * array_size);
+  point_y_ind = malloc (sizeof(sb2) * array_size);
+  if (valuecolumn != NULL) {
+    value = malloc (sizeof(double) * array_size);
+    value_ind = malloc (sizeof(sb2) * array_size);
+  }
+
+  /* Construct the select statement: geometries other than points are
+     represented by the center of their MBR */
+  sprintf (select_sql,
+    "SELECT "
+    "TO_BINARY_DOUBLE(COALESCE(C.%s.SDO_POINT.X, "
+    "(SDO_GEOM.SDO_MIN_MBR_ORDINATE(C.%s,1) + SDO_GEOM.SDO_MAX_MBR_ORDINATE(C.%s,1)) / 2)), "
+    "TO_BINARY_DOUBLE(COALESCE(C.%s.SDO_POINT.Y, "
+    "(SDO_GEOM.SDO_MIN_MBR_ORDINATE(C.%s,2) + SDO_GEOM.SDO_MAX_MBR_ORDINATE(C.%s,2)) / 2))"
+    "%s%s%s FROM %s C",
+    geocolumn, geocolumn, geocolumn, geocolumn, geocolumn, geocolumn,
+    valuecolumn != NULL ? ", TO_BINARY_DOUBLE(C." : "",
+    valuecolumn != NULL ? valuecolumn : "",
+    valuecolumn != NULL ? ")" : "",
+    tablename);
+  printf ("Executing query:\nSQL> %s\n\n", select_sql);
+
+  /* Initialize the statement handle */
+  status = OCIHandleAlloc(
+    (dvoid *)envhp,                  /* (in)  Environment Handle */
+    (dvoid **)&select_stmthp,        /* (out) Statement Handle */
+    (ub4)OCI_HTYPE_STMT,             /* (in)  Handle type */
+    (size_t)0,                       /* (in)  Size of extra user memory (NOT USED) */
+    (dvoid **)0);                    /* (out) Pointer to user memory (NOT USED) */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Prepare the SQL statement  */
+  status = OCIStmtPrepare(
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (text *)select_sql,              /* (in)  SQL statement */
+    (ub4)strlen(select_sql),         /* (in)  Statement length */
+    (ub4)OCI_NTV_SYNTAX,             /* (in)  Native SQL syntax */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Define the variables to receive the selected columns */
+
+  /* Variable 1 = POINT_X (binary double) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &point_x_hp,                     /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)1,                          /* (in)  Bind variable position */
+    (dvoid *) point_x,               /* (in)  Value Pointer */
+    sizeof(double),                  /* (in)  Value Size */
+    SQLT_BDOUBLE,                    /* (in)  Data Type */
+    (dvoid *) point_x_ind,           /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 2 = POINT_Y (binary double) */
+  status = OCIDefineByPos(
+    select_stmthp,                   /* (in)  Statement Handle */
+    &point_y_hp,                     /* (out) Define Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)2,                          /* (in)  Bind variable position */
+    (dvoid *) point_y,               /* (in)  Value Pointer */
+    sizeof(double),                  /* (in)  Value Size */
+    SQLT_BDOUBLE,                    /* (in)  Data Type */
+    (dvoid *) point_y_ind,           /* (in)  Indicator Pointer */
+    (ub2 *)0,                        /* (out) Length of data fetched (NOT USED) */
+    (ub2 *)0,                        /* (out) Column return codes (NOT USED) */
+    (ub4)OCI_DEFAULT                 /* (in)  Operating mode */
+  );
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Variable 3 = VALUE (binary double) */
+  if (valuecolumn != NULL) {
+    status = OCIDefineByPos(
+      select_stmthp,                 /* (in)  Statement Handle */
+      &value_hp,                     /* (out) Define Handle */
+      errhp,                         /* (in)  Error Handle */
+      (ub4)3,                        /* (in)  Bind variable position */
+      (dvoid *) value,               /* (in)  Value Pointer */
+      sizeof(double),                /* (in)  Value Size */
+      SQLT_BDOUBLE,                  /* (in)  Data Type */
+      (dvoid *) value_ind,           /* (in)  Indicator Pointer */
+      (ub2 *)0,                      /* (out) Length of data fetched (NOT USED) */
+      (ub2 *)0,                      /* (out) Column return codes (NOT USED) */
+      (ub4)OCI_DEFAULT               /* (in)  Operating mode */
+    );
+    if (status != OCI_SUCCESS)
+      ReportError(errhp);
+  }
+
+  /* Execute query and fetch first batch of rows of result set */
+  status = OCIStmtExecute(
+    svchp,                           /* (in)  Service Context Handle */
+    select_stmthp,                   /* (in)  Statement Handle */
+    errhp,                           /* (in)  Error Handle */
+    (ub4)array_size,                 /* (in)  Number of rows to fetch */
+    (ub4)0,                          /* (in)  Row offset (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot in (NOT USED) */
+    (OCISnapshot *)NULL,             /* (in)  Snapshot out (NOT USED) */
+    (ub4)OCI_DEFAULT);               /* (in)  Operating mode */
+  if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+    ReportError(errhp);
+
+  has_more_data = TRUE;
+  do
+  {
+    /* Check if this is the last (or only) batch */
+    if (status == OCI_NO_DATA)
+      has_more_data = FALSE;
+
+    /* Get the number of rows returned in current batch */
+    OCIAttrGet(
+      (dvoid *)select_stmthp,
+      (ub4)OCI_HTYPE_STMT,
+      (dvoid *)&rows_in_batch,
+      (ub4 *)0,
+      (ub4)OCI_ATTR_ROWS_FETCHED,
+      errhp);
+
+    nr_fetches++;
+    rows_fetched += rows_in_batch;
+
+    /* Squeeze out the rows that have no geometry */
+    n_points = 0;
+    for (i=0; i<rows_in_batch; i++) {
+      if (point_x_ind[i] == OCI_IND_NOTNULL && point_y_ind[i] == OCI_IND_NOTNULL) {
+        point_x[n_points] = point_x[i];
+        point_y[n_points] = point_y[i];
+        if (value != NULL)
+          value[n_points] = value_ind[i] == OCI_IND_NOTNULL ? value[i] : NAN;
+        n_points++;
+      }
+    }
+
+    /* Add the points just fetched: they are binned when the buffer is full */
+    AddPointsToTileGrid (grid, point_x, point_y, value, n_points);
+
+    if (has_more_data) {
+      /* Fetch next batch of rows of result set */
+      status = OCIStmtFetch(
+        select_stmthp,                 /* (in)  Statement Handle */
+        errhp,                         /* (in)  Error Handle */
+        (ub4)array_size,               /* (in)  Number of rows to fetch */
+        (ub2)OCI_FETCH_NEXT,           /* (in)  Fetch direction */
+        (ub4)OCI_DEFAULT);             /* (in)  Operating mode */
+      if (status != OCI_SUCCESS && status != OCI_NO_DATA)
+        ReportError(errhp);
+    }
+  }
+  while (has_more_data);
+
+  printf ("%ld rows fetched in %d fetches\n", rows_fetched, nr_fetches);
+
+  /* Free statement handle */
+  status = OCIHandleFree(
+    (dvoid *)select_stmthp,          /* (in)  Statement Handle */
+    (ub4)OCI_HTYPE_STMT);            /* (in)  Handle type */
+  if (status != OCI_SUCCESS)
+    ReportError(errhp);
+
+  /* Free host variables */
+  free (point_x);
+  free (point_y);
+  free (point_x_ind);
+  free (point_y_ind);
+  if (value != NULL) {
+    free (value);
+    free (value_ind);
+  }
+
+  return rows_fetched;
+}
+
+/*******************************************************************************
+** Routine:     BinPoints
+**
+** Description: Read all points into a tile grid, and write out the tiles
+*******************************************************************************/
+void BinPoints (
+  char *tablename,
+  char *geocolumn,
+  int  tiling_level,
+  char *output,
+  char *valuecolumn,
+  int  array_size,
+  int  n_threads)
+{
+  tile_grid_struct *grid;
+  double min_x, min_y, max_x, max_y;
+  int    srid;
+  long   rows_fetched;
+  double start_time, elapsed;
+  size_t length = strlen (output);
+  int    status;
+
+  GetLayerExtent (tablename, geocolumn, &min_x, &min_y, &max_x, &max_y, &srid);
+  printf ("Extent: (%f, %f) (%f, %f) - SRID %d\n", min_x, min_y, max_x, max_y, srid);
+  printf ("Tiling level %d: %d x %d tiles, %d threads\n\n",
+    tiling_level, 1 << tiling_level, 1 << tiling_level, n_threads);
+
+  grid = CreateTileGrid (min_x, min_y, max_x, max_y, srid, tiling_level,
+    valuecolumn != NULL, n_threads);
+
+  start_time = ElapsedSeconds ();
+  rows_fetched = ScanPoints (tablename, geocolumn, valuecolumn, array_size, grid);
+  FinishTileGrid (grid);
+  elapsed = ElapsedSeconds () - start_time;
+
+  printf ("%ld points binned, %ld outside the extent\n",
+    (long) grid->n_points, (long) grid->n_outside);
+  printf ("Elapsed time: %.3f seconds", elapsed);
+  if (elapsed > 0)
+    printf (" (%.0f points/second)", rows_fetched / elapsed);
+  printf ("\n");
+
+  /* Write out the tiles */
+  if (length > 4 && strcmp (output + length - 4, ".csv") == 0)
+    status = WriteTileGridCsv (grid, output);
+  else
+    status = WriteTileGridBinary (grid, output);
+  if (status == 0)
+    printf ("Tiles written to %s\n", output);
+
+  FreeTileGrid (grid);
+}
+
+/*******************************************************************************
+** Routine:     Main
+**
+** Description: Program main
+*******************************************************************************/
+int main(int argc, char **argv)
+{
+    char *username, *password, *database, *tablename, *geocolumn, *output, *valuecolumn;
+    int tiling_level, array_size, n_threads;
+
+    if( argc < 8 || argc > 11) {
+      printf("USAGE: %s <username> <password> <database> <tablename> <geo_column> <tiling_level> <output> [<value_column>] [<array_size>] [<threads>]\n", argv[0]);
+      exit( 1 );
+    }
+    else {
+      username = argv[1];
+      password = argv[2];
+      database = argv[3];
+      tablename = argv[4];
+      geocolumn = argv[5];
+      tiling_level = atoi(argv[6]);
+      if (tiling_level < 0 || tiling_level > TILE_GRID_MAX_LEVEL) {
+        printf ("Invalid tiling level: must be between 0 and %d\n", TILE_GRID_MAX_LEVEL);
+        exit( 1 );
+      }
+      output = argv[7];
+      if (argc > 8 && strlen(argv[8]) > 0)
+        valuecolumn = argv[8];
+      else
+        valuecolumn = NULL;
+      if (argc > 9)
+        array_size = atoi(argv[9]);
+      else
+        array_size = 1000;
+      if (array_size <= 0) {
+        printf ("Invalid array size: must be positive\n");
+        exit( 1 );
+      }
+      if (argc > 10)
+        n_threads = atoi(argv[10]);
+      else
+        n_threads = ProcessorThreads(TILE_GRID_MAX_THREADS);
+      if (n_threads <= 0 || n_threads > TILE_GRID_MAX_THREADS) {
+        printf ("Invalid number of threads: must be between 1 and %d\n", TILE_GRID_MAX_THREADS);
+        exit( 1 );
+      }
+    }
+
+    /* Set up OCI environment */
+    InitializeOCI();
+
+    /* Connect to database */
+    ConnectDatabase(username, password, database);
+
+    /* Fetch and bin the points */
+    BinPoints(tablename, geocolumn, tiling_level, output, valuecolumn, array_size, n_threads);
+
+    /* disconnect from database */
+    DisconnectDatabase();
+
+    /* Teardown  OCI environment */
+    ClearOCI();
+
+    return 0;
+}
@@ -0,0 +1,814 @@
+/* validate.c
+
+   Client-side geometry validation. See validate.h for the list of checks and
+   the error numbers returned.
+
+   Self-intersections are found with a sweep along the X axis: the segments
+   of all rings are sorted on their minimum X, then each segment is only
+   compared with the following segments that start before it ends. This
+   keeps the cost close to O(n log n) for the rings found in practice.
+
+   ValidateGeometries shares a set of geometries among several threads. Each
+   thread takes small chunks of geometries from a common counter until all
+   are done, so that a few large geometries do not hold up the others. On
+   Windows the geometries are validated by the calling thread.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "validate.h"
+
+#define VALIDATE_CHUNK_SIZE 16        /* Geometries taken at a time by a thread */
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A ring made of straight line segments, kept for the intersection checks */
+struct ring_info
+{
+    int first;                        /* Index of its first point in the work arrays */
+    int n_points;
+    int element;                      /* Element number, as reported in the context */
+    int ring;                         /* Ring number within the element (1 = exterior) */
+    double min_x, min_y;              /* Bounding box */
+    double max_x, max_y;
+};
+typedef struct ring_info ring_info_struct;
+
+/* A segment, sorted on its minimum X */
+struct segment_key
+{
+    double min_x;
+    int    segment;                   /* Index of its first point */
+};
+typedef struct segment_key segment_key_struct;
+
+/* Work arrays of a thread, reused from one geometry to the next */
+struct validate_work
+{
+    int                size_points;
+    double             *x;
+    double             *y;
+    int                *point_ring;   /* Ring of the segment that starts at each point */
+    segment_key_struct *keys;
+    int                size_rings;
+    ring_info_struct   *rings;
+    int                n_points;
+    int                n_rings;
+};
+typedef struct validate_work validate_work_struct;
+
+/* Geometries shared among the validation threads */
+struct validate_pool
+{
+    validate_job_struct *jobs;
+    int                 n_jobs;
+    int                 next_job;     /* First geometry not yet taken by a thread */
+    double              tolerance;
+#ifndef _WIN32
+    pthread_mutex_t     lock;
+#endif
+};
+typedef struct validate_pool validate_pool_struct;
+
+/*******************************************************************************
+** Routine:     ElapsedSeconds
+**
+** Description: Wall clock time in seconds, from an arbitrary origin
+*******************************************************************************/
+static double ElapsedSeconds (void)
+{
+#ifdef _WIN32
+  return (double) clock() / CLOCKS_PER_SEC;
+#else
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     AddRing
+**
+** Description: Copy the X and Y of a ring into the work arrays
+*******************************************************************************/
+static void AddRing (
+  validate_work_struct *work,
+  const double         *ordinates,
+  int                  dim,
+  int                  n_points,
+  int                  element,
+  int                  ring)
+{
+  ring_info_struct *info;
+  int i;
+
+  if (work->n_points + n_points > work->size_points) {
+    work->size_points = (work->n_points + n_points) * 2;
+    work->x = realloc (work->x, work->size_points * sizeof(double));
+    work->y = realloc (work->y, work->size_points * sizeof(double));
+    work->point_ring = realloc (work->point_ring, work->size_points * sizeof(int));
+    work->keys = realloc (work->keys, work->size_points * sizeof(segment_key_struct));
+  }
+  if (work->n_rings == work->size_rings) {
+    work->size_rings = work->size_rings * 2 + 16;
+    work->rings = realloc (work->rings, work->size_rings * sizeof(ring_info_struct));
+  }
+  if (work->x == NULL || work->y == NULL || work->point_ring == NULL
+      || work->keys == NULL || work->rings == NULL) {
+    printf ("Not enough memory to validate %d points\n", work->n_points + n_points);
+    exit (1);
+  }
+
+  info = &work->rings[work->n_rings++];
+  info->first = work->n_points;
+  info->n_points = n_points;
+  info->element = element;
+  info->ring = ring;
+  info->min_x = info->max_x = ordinates[0];
+  info->min_y = info->max_y = ordinates[1];
+  for (i=0; i<n_points; i++) {
+    work->x[work->n_points + i] = ordinates[i*dim];
+    work->y[work->n_points + i] = ordinates[i*dim + 1];
+    info->min_x = ordinates[i*dim] < info->min_x ? ordinates[i*dim] : info->min_x;
+    info->max_x = ordinates[i*dim] > info->max_x ? ordinates[i*dim] : info->max_x;
+    info->min_y = ordinates[i*dim+1] < info->min_y ? ordinates[i*dim+1] : info->min_y;
+    info->max_y = ordinates[i*dim+1] > info->max_y ? ordinates[i*dim+1] : info->max_y;
+  }
+  work->n_points += n_points;
+}
+
+/*******************************************************************************
+** Routine:     FreeWork
+**
+** Description: Release the work arrays of a thread
+*******************************************************************************/
+static void FreeWork (validate_work_struct *work)
+{
+  free (work->x);
+  free (work->y);
+  free (work->point_ring);
+  free (work->keys);
+  free (work->rings);
+  memset (work, 0, sizeof(validate_work_struct));
+}
+
+/*******************************************************************************
+** Routine:     Collinear
+**
+** Description: Tell if three points (given by their ordinates) are on a line
+*******************************************************************************/
+static int Collinear (const double *p, const double *q, const double *r)
+{
+  return (q[0] - p[0]) * (r[1] - p[1]) - (q[1] - p[1]) * (r[0] - p[0]) == 0;
+}
+
+/*******************************************************************************
+** Routine:     FindDuplicate
+**
+** Description: Look for consecutive points closer than the tolerance. Returns
+**              the number (starting at 1) of the second point, or 0.
+*******************************************************************************/
+static int FindDuplicate (
+  const double *ordinates,
+  int          dim,
+  int          n_points,
+  double       tolerance)
+{
+  double tolerance2 = tolerance * tolerance;
+  double dx, dy, d2;
+  int    i;
+
+  for (i=1; i<n_points; i++) {
+    dx = ordinates[i*dim] - ordinates[(i-1)*dim];
+    dy = ordinates[i*dim + 1] - ordinates[(i-1)*dim + 1];
+    d2 = dx*dx + dy*dy;
+    if (tolerance > 0 ? d2 < tolerance2 : d2 == 0)
+      return i + 1;
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     SignedArea
+**
+** Description: Twice the signed area of a ring (positive if counterclockwise)
+*******************************************************************************/
+static double SignedArea (
+  const double *ordinates,
+  int          dim,
+  int          n_points)
+{
+  double area = 0;
+  int    i;
+
+  for (i=0; i<n_points-1; i++)
+    area += ordinates[i*dim] * ordinates[(i+1)*dim + 1]
+          - ordinates[(i+1)*dim] * ordinates[i*dim + 1];
+  return area;
+}
+
+/*******************************************************************************
+** Routine:     CheckArcs
+**
+** Description: Check the points of a string of arcs. Returns the number of the
+**              first arc made of collinear points, or 0.
+*******************************************************************************/
+static int CheckArcs (
+  const double *ordinates,
+  int          dim,
+  int          n_points)
+{
+  int i;
+
+  for (i=0; i+2<n_points; i=i+2)
+    if (Collinear (ordinates + i*dim, ordinates + (i+1)*dim, ordinates + (i+2)*dim))
+      return i/2 + 1;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     Orientation / Intersection
+**
+** Description: Classify how two segments meet: 0 = not at all, 1 = they cross
+**              or overlap along a line, 2 = they touch at a single point
+*******************************************************************************/
+static int Orientation (double ax, double ay, double bx, double by, double cx, double cy)
+{
+  double o = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+  return o > 0 ? 1 : (o < 0 ? -1 : 0);
+}
+
+static int Between (double a, double b, double c)
+{
+  return c >= (a < b ? a : b) && c <= (a > b ? a : b);
+}
+
+static int Intersection (const double *x, const double *y, int a, int b)
+{
+  int    o1 = Orientation (x[a], y[a], x[a+1], y[a+1], x[b], y[b]);
+  int    o2 = Orientation (x[a], y[a], x[a+1], y[a+1], x[b+1], y[b+1]);
+  int    o3 = Orientation (x[b], y[b], x[b+1], y[b+1], x[a], y[a]);
+  int    o4 = Orientation (x[b], y[b], x[b+1], y[b+1], x[a+1], y[a+1]);
+  const double *v;
+  double low_a, high_a, low_b, high_b, overlap;
+
+  if (o1 * o2 < 0 && o3 * o4 < 0)
+    return 1;
+  if (o1 == 0 && o2 == 0) {
+    /* Collinear segments: measure their overlap along the longest axis */
+    v = (x[a+1] - x[a]) * (x[a+1] - x[a]) >= (y[a+1] - y[a]) * (y[a+1] - y[a]) ? x : y;
+    low_a = v[a] < v[a+1] ? v[a] : v[a+1];
+    high_a = v[a] > v[a+1] ? v[a] : v[a+1];
+    low_b = v[b] < v[b+1] ? v[b] : v[b+1];
+    high_b = v[b] > v[b+1] ? v[b] : v[b+1];
+    overlap = (high_a < high_b ? high_a : high_b) - (low_a > low_b ? low_a : low_b);
+    return overlap > 0 ? 1 : (overlap == 0 ? 2 : 0);
+  }
+  if ((o1 == 0 && Between (x[a], x[a+1], x[b]) && Between (y[a], y[a+1], y[b]))
+      || (o2 == 0 && Between (x[a], x[a+1], x[b+1]) && Between (y[a], y[a+1], y[b+1]))
+      || (o3 == 0 && Between (x[b], x[b+1], x[a]) && Between (y[b], y[b+1], y[a]))
+      || (o4 == 0 && Between (x[b], x[b+1], x[a+1]) && Between (y[b], y[b+1], y[a+1])))
+    return 2;
+  return 0;
+}
+
+static int CompareKeys (const void *a, const void *b)
+{
+  double xa = ((const segment_key_struct *)a)->min_x;
+  double xb = ((const segment_key_struct *)b)->min_x;
+  return xa < xb ? -1 : (xa > xb ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     CheckIntersections
+**
+** Description: Look for intersections between the segments of the rings
+**              collected in the work arrays
+*******************************************************************************/
+static int CheckIntersections (
+  validate_work_struct *work,
+  char                 *context)
+{
+  const double     *x = work->x;
+  const double     *y = work->y;
+  ring_info_struct *ra, *rb, *swap;
+  int    n_keys = 0;
+  int    i, j, r, s, a, b, low, high, meet;
+  double max_x, min_y, max_y;
+
+  for (r=0; r<work->n_rings; r++)
+    for (s=work->rings[r].first; s<work->rings[r].first + work->rings[r].n_points - 1; s++) {
+      work->keys[n_keys].min_x = x[s] < x[s+1] ? x[s] : x[s+1];
+      work->keys[n_keys].segment = s;
+      work->point_ring[s] = r;
+      n_keys++;
+    }
+  if (n_keys == 0)
+    return 0;
+  qsort (work->keys, n_keys, sizeof(segment_key_struct), CompareKeys);
+
+  for (i=0; i<n_keys; i++) {
+    a = work->keys[i].segment;
+    max_x = x[a] > x[a+1] ? x[a] : x[a+1];
+    min_y = y[a] < y[a+1] ? y[a] : y[a+1];
+    max_y = y[a] > y[a+1] ? y[a] : y[a+1];
+    for (j=i+1; j<n_keys && work->keys[j].min_x <= max_x; j++) {
+      b = work->keys[j].segment;
+      if ((y[b] < min_y && y[b+1] < min_y) || (y[b] > max_y && y[b+1] > max_y))
+        continue;
+      meet = Intersection (x, y, a, b);
+      if (meet == 0)
+        continue;
+      ra = &work->rings[work->point_ring[a]];
+      rb = &work->rings[work->point_ring[b]];
+      low = a < b ? a : b;
+      high = a < b ? b : a;
+
+      if (ra == rb) {
+        /* Consecutive segments, and the first and last ones, share a point */
+        if (meet == 2 && (high - low == 1
+            || (low == ra->first && high == ra->first + ra->n_points - 2)))
+          continue;
+        sprintf (context, "13349 [Element <%d>] [Ring <%d>][Edge <%d>][Edge <%d>]",
+          ra->element, ra->ring, low - ra->first + 1, high - ra->first + 1);
+        return 13349;
+      }
+
+      /* Different rings may touch at a point */
+      if (meet == 2)
+        continue;
+      if (a > b) {
+        swap = ra; ra = rb; rb = swap;
+      }
+      if (ra->element == rb->element) {
+        sprintf (context, "13351 [Element <%d>] [Rings <%d>, <%d>][Edge <%d> in ring <%d>][Edge <%d> in ring <%d>]",
+          ra->element, ra->ring, rb->ring, low - ra->first + 1, ra->ring, high - rb->first + 1, rb->ring);
+        return 13351;
+      }
+      sprintf (context, "13349 [Element <%d>] [Ring <%d>][Edge <%d>] [Element <%d>] [Ring <%d>][Edge <%d>]",
+        ra->element, ra->ring, low - ra->first + 1, rb->element, rb->ring, high - rb->first + 1);
+      return 13349;
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     PointInRing
+**
+** Description: Tell if a point is inside (1), outside (-1) or on (0) a ring
+*******************************************************************************/
+static int PointInRing (
+  validate_work_struct *work,
+  ring_info_struct     *ring,
+  double               px,
+  double               py)
+{
+  const double *x = work->x + ring->first;
+  const double *y = work->y + ring->first;
+  int inside = 0;
+  int i;
+
+  for (i=0; i<ring->n_points-1; i++) {
+    if (Orientation (x[i], y[i], x[i+1], y[i+1], px, py) == 0
+        && Between (x[i], x[i+1], px) && Between (y[i], y[i+1], py))
+      return 0;
+    if ((y[i] > py) != (y[i+1] > py)
+        && px < x[i] + (py - y[i]) * (x[i+1] - x[i]) / (y[i+1] - y[i]))
+      inside = !inside;
+  }
+  return inside ? 1 : -1;
+}
+
+/*******************************************************************************
+** Routine:     CheckInteriorRings
+**
+** Description: Check that the interior rings are inside their exterior ring.
+**              Rings that do not cross can only be inside or outside of each
+**              other: one point of the interior ring not on the exterior ring
+**              tells which.
+*******************************************************************************/
+static int CheckInteriorRings (
+  validate_work_struct *work,
+  char                 *context)
+{
+  ring_info_struct *exterior = NULL;
+  ring_info_struct *ring;
+  int r, i, where;
+
+  for (r=0; r<work->n_rings; r++) {
+    ring = &work->rings[r];
+    if (ring->ring == 1) {
+      exterior = ring;
+      continue;
+    }
+    if (exterior == NULL || exterior->element != ring->element)
+      continue;
+    where = 0;
+    for (i=0; i<ring->n_points-1 && where == 0; i++)
+      where = PointInRing (work, exterior, work->x[ring->first + i], work->y[ring->first + i]);
+    if (where < 0) {
+      sprintf (context, "13351 [Element <%d>] [Rings <1>, <%d>]", ring->element, ring->ring);
+      return 13351;
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     RingSide
+**
+** Description: Tell if a ring is inside (1) or outside (-1) another ring that
+**              it does not cross, from its first point that is not on the
+**              other ring. Returns 0 if all its points are on the other ring.
+*******************************************************************************/
+static int RingSide (
+  validate_work_struct *work,
+  ring_info_struct     *ring,
+  ring_info_struct     *other)
+{
+  int i, where = 0;
+
+  for (i=0; i<ring->n_points-1 && where == 0; i++)
+    where = PointInRing (work, other, work->x[ring->first + i], work->y[ring->first + i]);
+  return where;
+}
+
+/*******************************************************************************
+** Routine:     CheckExteriorRings
+**
+** Description: Check that no polygon of a multi-polygon lies inside another
+**              one, unless it lies in one of its holes (an island in a lake).
+**              As for the interior rings, the rings are known not to cross.
+*******************************************************************************/
+static int CheckExteriorRings (
+  validate_work_struct *work,
+  char                 *context)
+{
+  ring_info_struct *outer, *inner, *hole;
+  int a, b, h, in_hole;
+
+  for (a=0; a<work->n_rings; a++) {
+    outer = &work->rings[a];
+    if (outer->ring != 1)
+      continue;
+    for (b=0; b<work->n_rings; b++) {
+      inner = &work->rings[b];
+      if (b == a || inner->ring != 1
+          || inner->min_x < outer->min_x || inner->max_x > outer->max_x
+          || inner->min_y < outer->min_y || inner->max_y > outer->max_y)
+        continue;
+      if (RingSide (work, inner, outer) <= 0)
+        continue;
+      in_hole = 0;
+      for (h=a+1; h<work->n_rings && work->rings[h].element == outer->element && !in_hole; h++) {
+        hole = &work->rings[h];
+        in_hole = RingSide (work, inner, hole) > 0;
+      }
+      if (!in_hole) {
+        sprintf (context, "13351 [Element <%d>] [Element <%d>]", outer->element, inner->element);
+        return 13351;
+      }
+    }
+  }
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     CheckElements
+**
+** Description: Validate a geometry, using the work arrays of the calling
+**              thread. Returns the Oracle error number, or 0.
+*******************************************************************************/
+static int CheckElements (
+  validate_work_struct *work,
+  validate_job_struct  *job,
+  double               tolerance)
+{
+  char   *context = job->context;
+  int    *elem_info = job->elem_info;
+  double *ordinates = job->ordinates;
+  int    dim = job->gtype / 1000;
+  int    type = job->gtype % 100;
+  int    n_elements = job->n_elem_info / 3;
+  int    element = 0;                 /* Element number, as reported in the context */
+  int    ring = 0;                    /* Ring number within the current polygon */
+  int    n_exteriors = 0;
+  int    previous_etype = 0;          /* Type of the previous top level element */
+  int    e, j, n_sub, etype, interpretation, start, end, n_points, sub_end, result;
+
+  work->n_points = 0;
+  work->n_rings = 0;
+
+  if (dim < 2 || dim > 4 || type < 1 || type > 7) {
+    sprintf (context, "13028 [Gtype <%d>]", job->gtype);
+    return 13028;
+  }
+  if (job->n_elem_info == 0) {
+    if (type == 1 && job->has_point)
+      return 0;
+    if (type == 1) {
+      strcpy (context, "13031");
+      return 13031;
+    }
+    strcpy (context, "13033");
+    return 13033;
+  }
+  if (job->n_elem_info % 3 != 0) {
+    strcpy (context, "13033");
+    return 13033;
+  }
+  if (job->n_ordinates % dim != 0) {
+    strcpy (context, "13034");
+    return 13034;
+  }
+
+  /* Offsets must point to the start of a point and follow each other. The
+     first subelement of a compound element starts with the element */
+  for (e=0; e<n_elements; e++)
+    if (elem_info[e*3] < 1 || elem_info[e*3] > job->n_ordinates
+        || (elem_info[e*3] - 1) % dim != 0
+        || (e > 0 && elem_info[e*3] < elem_info[(e-1)*3])
+        || (e > 0 && elem_info[e*3] == elem_info[(e-1)*3] && elem_info[(e-1)*3+1] != 4
+            && elem_info[(e-1)*3+1] != 1005 && elem_info[(e-1)*3+1] != 2005)) {
+      sprintf (context, "13033 [Offset <%d>]", elem_info[e*3]);
+      return 13033;
+    }
+
+  for (e=0; e<n_elements; e=e+1+n_sub) {
+    etype = elem_info[e*3+1];
+    interpretation = elem_info[e*3+2];
+    n_sub = (etype == 4 || etype == 1005 || etype == 2005) ? interpretation : 0;
+    if (n_sub < 0 || e + n_sub >= n_elements) {
+      sprintf (context, "13033 [Element <%d>]", element + 1);
+      return 13033;
+    }
+    start = elem_info[e*3] - 1;
+    end = e+1+n_sub < n_elements ? elem_info[(e+1+n_sub)*3] - 1 : job->n_ordinates;
+    n_points = (end - start) / dim;
+
+    /* An interior ring follows the exterior ring or another interior ring
+       of the same polygon */
+    if (etype == 2003 || etype == 2005) {
+      if (previous_etype != 1003 && previous_etype != 1005
+          && previous_etype != 2003 && previous_etype != 2005) {
+        sprintf (context, "13366 [Element <%d>]", element + 1);
+        return 13366;
+      }
+      ring++;
+    }
+    else {
+      element++;
+      ring = 1;
+    }
+    previous_etype = etype;
+
+    /* Elements must match the geometry type. A polygon has one exterior ring */
+    if (etype == 1003 || etype == 1005)
+      n_exteriors++;
+    if ((etype == 1 && type != 1 && type != 5 && type != 4)
+        || ((etype == 2 || etype == 4) && type != 2 && type != 6 && type != 4)
+        || ((etype == 1003 || etype == 1005 || etype == 2003 || etype == 2005)
+            && type != 3 && type != 7 && type != 4)
+        || (type == 3 && n_exteriors > 1)) {
+      sprintf (context, "13028 [Element <%d>]", element);
+      return 13028;
+    }
+
+    switch (etype) {
+
+      case 1:
+        /* Points: a point cluster holds exactly interpretation points */
+        if (interpretation > 1 && n_points != interpretation) {
+          sprintf (context, "13033 [Element <%d>]", element);
+          return 13033;
+        }
+        break;
+
+      case 2:
+        /* Line string: straight segments (1) or arcs (2) */
+        if (interpretation != 1 && interpretation != 2) {
+          sprintf (context, "13033 [Element <%d>]", element);
+          return 13033;
+        }
+        if (n_points < 2) {
+          sprintf (context, "13341 [Element <%d>]", element);
+          return 13341;
+        }
+        if ((j = FindDuplicate (ordinates + start, dim, n_points, tolerance)) > 0) {
+          sprintf (context, "13356 [Element <%d>] [Coordinate <%d>]", element, j);
+          return 13356;
+        }
+        if (interpretation == 2 && (n_points % 2 == 0 || (j = CheckArcs (ordinates + start, dim, n_points)) > 0)) {
+          sprintf (context, "13346 [Element <%d>] [Arc <%d>]", element, j);
+          return 13346;
+        }
+        break;
+
+      case 4:
+      case 1005:
+      case 2005:
+        /* Compound element: each subelement is a line string, and shares its
+           last point with the next one */
+        for (j=e+1; j<=e+n_sub; j++) {
+          if (elem_info[j*3+1] != 2 || (elem_info[j*3+2] != 1 && elem_info[j*3+2] != 2)) {
+            sprintf (context, "13033 [Element <%d>] [Subelement <%d>]", element, j-e);
+            return 13033;
+          }
+          sub_end = j < e+n_sub ? elem_info[(j+1)*3] - 1 + dim : end;
+          n_points = (sub_end - (elem_info[j*3] - 1)) / dim;
+          if (n_points < 2) {
+            sprintf (context, "13341 [Element <%d>] [Subelement <%d>]", element, j-e);
+            return 13341;
+          }
+          if (elem_info[j*3+2] == 2
+              && (n_points % 2 == 0 || CheckArcs (ordinates + elem_info[j*3] - 1, dim, n_points) > 0)) {
+            sprintf (context, "13346 [Element <%d>] [Subelement <%d>]", element, j-e);
+            return 13346;
+          }
+        }
+        n_points = (end - start) / dim;
+        if (etype != 4 && (ordinates[start] != ordinates[end-dim]
+            || ordinates[start+1] != ordinates[end-dim+1])) {
+          sprintf (context, "13348 [Element <%d>] [Ring <%d>]", element, ring);
+          return 13348;
+        }
+        break;
+
+      case 1003:
+      case 2003:
+        if (interpretation == 3 || interpretation == 4) {
+          /* Rectangle (2 points) or circle (3 points) */
+          if (n_points != interpretation - 1) {
+            sprintf (context, "13033 [Element <%d>] [Ring <%d>]", element, ring);
+            return 13033;
+          }
+          if (interpretation == 4 && Collinear (ordinates + start, ordinates + start + dim, ordinates + start + 2*dim)) {
+            sprintf (context, "13346 [Element <%d>] [Ring <%d>]", element, ring);
+            return 13346;
+          }
+          break;
+        }
+        if (interpretation != 1 && interpretation != 2) {
+          sprintf (context, "13033 [Element <%d>] [Ring <%d>]", element, ring);
+          return 13033;
+        }
+        if (n_points < (interpretation == 1 ? 4 : 3)) {
+          sprintf (context, "13343 [Element <%d>] [Ring <%d>]", element, ring);
+          return 13343;
+        }
+        if (ordinates[start] != ordinates[end-dim] || ordinates[start+1] != ordinates[end-dim+1]) {
+          sprintf (context, "13348 [Element <%d>] [Ring <%d>]", element, ring);
+          return 13348;
+        }
+        if ((j = FindDuplicate (ordinates + start, dim, n_points, tolerance)) > 0) {
+          sprintf (context, "13356 [Element <%d>] [Coordinate <%d>][Ring <%d>]", element, j, ring);
+          return 13356;
+        }
+        if (interpretation == 2) {
+          if (n_points % 2 == 0 || (j = CheckArcs (ordinates + start, dim, n_points)) > 0) {
+            sprintf (context, "13346 [Element <%d>] [Ring <%d>]", element, ring);
+            return 13346;
+          }
+          break;
+        }
+        /* Exterior rings go counterclockwise, interior rings clockwise. A ring
+           with no area is left to the intersection check */
+        if ((etype == 1003 && SignedArea (ordinates + start, dim, n_points) < 0)
+            || (etype == 2003 && SignedArea (ordinates + start, dim, n_points) > 0)) {
+          sprintf (context, "13367 [Element <%d>] [Ring <%d>]", element, ring);
+          return 13367;
+        }
+        AddRing (work, ordinates + start, dim, n_points, element, ring);
+        break;
+
+      default:
+        sprintf (context, "13033 [Element <%d>]", element);
+        return 13033;
+    }
+  }
+
+  if ((result = CheckIntersections (work, context)) != 0)
+    return result;
+  if ((result = CheckInteriorRings (work, context)) != 0)
+    return result;
+  return CheckExteriorRings (work, context);
+}
+
+/*******************************************************************************
+** Routine:     ValidateWithWork
+**
+** Description: Validate a geometry and fill in its result
+*******************************************************************************/
+static int ValidateWithWork (
+  validate_work_struct *work,
+  validate_job_struct  *job,
+  double               tolerance)
+{
+  job->result = CheckElements (work, job, tolerance);
+  if (job->result == 0)
+    strcpy (job->context, "TRUE");
+  return job->result;
+}
+
+/*******************************************************************************
+** Routine:     ValidateGeometry
+**
+** Description: Validate one geometry. Returns the Oracle error number, or 0
+**              if the geometry is valid. The context is set in the job.
+*******************************************************************************/
+int ValidateGeometry (
+  validate_job_struct *job,
+  double              tolerance)
+{
+  validate_work_struct work;
+
+  memset (&work, 0, sizeof(validate_work_struct));
+  ValidateWithWork (&work, job, tolerance);
+  FreeWork (&work);
+  return job->result;
+}
+
+/*******************************************************************************
+** Routine:     ValidateThread
+**
+** Description: Validation thread: take chunks of geometries until all are done
+*******************************************************************************/
+static void *ValidateThread (void *argument)
+{
+  validate_pool_struct *pool = (validate_pool_struct *) argument;
+  validate_work_struct work;
+  int first, i;
+
+  memset (&work, 0, sizeof(validate_work_struct));
+  for (;;) {
+#ifndef _WIN32
+    pthread_mutex_lock (&pool->lock);
+#endif
+    first = pool->next_job;
+    pool->next_job += VALIDATE_CHUNK_SIZE;
+#ifndef _WIN32
+    pthread_mutex_unlock (&pool->lock);
+#endif
+    if (first >= pool->n_jobs)
+      break;
+    for (i=first; i<first+VALIDATE_CHUNK_SIZE && i<pool->n_jobs; i++)
+      ValidateWithWork (&work, &pool->jobs[i], pool->tolerance);
+  }
+  FreeWork (&work);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     ValidateGeometries
+**
+** Description: Validate a set of geometries using several threads. Returns
+**              the elapsed time in seconds.
+*******************************************************************************/
+double ValidateGeometries (
+  validate_job_struct *jobs,
+  int                 n_jobs,
+  double              tolerance,
+  int                 n_threads)
+{
+  validate_pool_struct pool;
+  double start_time = ElapsedSeconds ();
+#ifndef _WIN32
+  pthread_t threads[VALIDATE_MAX_THREADS];
+  int       n_started = 0;
+  int       i;
+#endif
+
+  pool.jobs = jobs;
+  pool.n_jobs = n_jobs;
+  pool.next_job = 0;
+  pool.tolerance = tolerance;
+
+#ifndef _WIN32
+  if (n_threads > VALIDATE_MAX_THREADS)
+    n_threads = VALIDATE_MAX_THREADS;
+  /* No point in starting more threads than there are chunks */
+  if (n_threads > (n_jobs + VALIDATE_CHUNK_SIZE - 1) / VALIDATE_CHUNK_SIZE)
+    n_threads = (n_jobs + VALIDATE_CHUNK_SIZE - 1) / VALIDATE_CHUNK_SIZE;
+  pthread_mutex_init (&pool.lock, NULL);
+  /* The calling thread does its share of the work */
+  for (i=1; i<n_threads; i++)
+    if (pthread_create (&threads[n_started], NULL, ValidateThread, &pool) == 0)
+      n_started++;
+  ValidateThread (&pool);
+  for (i=0; i<n_started; i++)
+    pthread_join (threads[i], NULL);
+  pthread_mutex_destroy (&pool.lock);
+#else
+  ValidateThread (&pool);
+#endif
+
+  return ElapsedSeconds () - start_time;
+}
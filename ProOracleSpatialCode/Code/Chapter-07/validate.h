@@ -0,0 +1,72 @@
+/* validate.h
+
+   Client-side geometry validation.
+
+   This is the client-side counterpart of SDO_GEOM.VALIDATE_GEOMETRY_WITH_CONTEXT
+   (see chapter 5). It checks a geometry held in memory, as its SDO_GTYPE,
+   SDO_ELEM_INFO and SDO_ORDINATES, and returns the Oracle error number of the
+   first problem found, or 0 if the geometry is valid. The context string is
+   formatted like the one returned by the database, for example
+
+     TRUE
+     13348 [Element <1>] [Ring <2>]
+     13349 [Element <1>] [Ring <1>][Edge <3>][Edge <6>]
+
+   The following checks are made:
+
+   - 13028: invalid SDO_GTYPE, or element types that do not match it
+   - 13031: point geometry with neither SDO_POINT nor elements
+   - 13033: inconsistent SDO_ELEM_INFO (offsets, element types,
+            interpretations, compound elements)
+   - 13034: number of ordinates is not a multiple of the dimension
+   - 13341: line with fewer than 2 points
+   - 13343: polygon ring with fewer than 4 points
+   - 13346: arc defined by collinear points
+   - 13348: polygon ring not closed
+   - 13349: polygon ring that crosses or touches itself, or polygons of a
+            multi-polygon that cross each other
+   - 13351: rings of a polygon that cross or overlap each other, interior
+            ring outside its exterior ring, or polygon of a multi-polygon
+            inside another one (other than in one of its holes)
+   - 13356: consecutive points closer than the tolerance
+   - 13366: interior ring that does not follow an exterior ring
+   - 13367: exterior ring not counterclockwise, or interior ring not clockwise
+
+   Intersections are only looked for between straight line segments: rings
+   that contain arcs are checked for closure, but not for intersections.
+
+   The tolerance is only used for the distance between consecutive points
+   (13356). The tests for crossing, touching and containment are exact, on
+   the coordinates as they are, while the database applies the tolerance to
+   them too: rings that pass within the tolerance of each other without
+   touching are accepted here, and rejected by the database. Results can
+   therefore differ from SDO_GEOM.VALIDATE_GEOMETRY_WITH_CONTEXT for
+   geometries whose rings come closer than the tolerance.
+
+   ValidateGeometries checks a set of geometries with several threads.
+
+*/
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#define VALIDATE_CONTEXT_SIZE 128
+#define VALIDATE_MAX_THREADS 64
+
+/* A geometry to validate, and the result of the validation */
+struct validate_job
+{
+    int    gtype;
+    int    has_point;                 /* 1 if SDO_POINT is set */
+    int    n_elem_info;
+    int    *elem_info;
+    int    n_ordinates;
+    double *ordinates;
+    int    result;                    /* 0 if valid, else Oracle error number */
+    char   context[VALIDATE_CONTEXT_SIZE];
+};
+typedef struct validate_job validate_job_struct;
+
+int    ValidateGeometry (validate_job_struct *job, double tolerance);
+double ValidateGeometries (validate_job_struct *jobs, int n_jobs, double tolerance, int n_threads);
+
+#endif
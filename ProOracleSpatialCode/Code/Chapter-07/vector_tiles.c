@@ -0,0 +1,1411 @@
+/* vector_tiles.c
+
+   Generation of vector tiles from a layer of geometries. See vector_tiles.h
+   for a description of the method and of the file format.
+
+   The Protocol Buffers messages are written directly, without a library:
+   a tile only needs varints (integers written 7 bits per byte, lowest
+   first) and length-delimited fields, whose length is computed before
+   they are written.
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+#include "vector_tiles.h"
+#include "spatial_util.h"
+
+#define SHAPE_HOLE 4                  /* Kind of the interior rings of a shape */
+#define GENERALIZE_GROUP 256          /* Geometries generalized per task */
+
+/* Geometry commands */
+#define COMMAND_MOVE_TO 1
+#define COMMAND_LINE_TO 2
+#define COMMAND_CLOSE_PATH 7
+
+/* Geometry types of the features */
+#define FEATURE_POINT 1
+#define FEATURE_LINESTRING 2
+#define FEATURE_POLYGON 3
+
+/*******************************************************************************
+** Types and structures
+*******************************************************************************/
+
+/* A geometry generalized for one zoom, in the tile grid of that zoom: the
+   coordinates are whole numbers, VECTOR_TILE_EXTENT per tile */
+struct tile_shape
+{
+    int    n_parts;
+    int    *part_start;               /* First vertex of each part (n_parts + 1) */
+    char   *part_kind;                /* RENDER_POINTS, RENDER_LINE, RENDER_RING or SHAPE_HOLE */
+    double *part_box;                 /* MBR of each part: min x, min y, max x, max y */
+    double min_x, min_y;
+    double max_x, max_y;
+    double *x;                        /* Rings are closed */
+    double *y;
+};
+typedef struct tile_shape tile_shape_struct;
+
+/* A shape to encode in a tile */
+struct tile_piece
+{
+    uint64_t tile;                    /* row * 2^zoom + column */
+    long     shape;
+};
+typedef struct tile_piece tile_piece_struct;
+
+/* A tile stored in the file */
+struct tile_entry
+{
+    int  zoom;
+    long column;
+    long row;
+    long length;
+    long offset;
+};
+typedef struct tile_entry tile_entry_struct;
+
+/* Bytes of a message being written */
+struct byte_buffer
+{
+    unsigned char *data;
+    long          length;
+    long          size;
+};
+typedef struct byte_buffer byte_buffer_struct;
+
+/* The commands of the geometry of a feature */
+struct command_list
+{
+    uint32_t *data;
+    long     length;
+    long     size;
+    int      x, y;                    /* Cursor: the last point written */
+    long     count_slot;              /* Position of the MoveTo of the points, or -1 */
+    int      n_points;
+};
+typedef struct command_list command_list_struct;
+
+/* The work of one zoom, shared by all threads */
+struct tile_queue
+{
+    const render_layer_struct        *layer;
+    const vector_tile_options_struct *options;
+    int                 zoom;
+    tile_shape_struct   *shapes;      /* One per geometry of the layer */
+    tile_piece_struct   *pieces;      /* Sorted by tile */
+    long                *task_start;  /* First piece of each tile (n_tasks + 1) */
+    long                n_tasks;
+    long                next_task;
+    FILE                *file;
+    long                offset;       /* End of the file */
+    tile_entry_struct   *entries;
+    long                n_entries;
+    long                entries_size;
+#ifndef _WIN32
+    pthread_mutex_t     lock;         /* Protects next_task, the file, the entries and error */
+#endif
+    int                 error;        /* Set if a tile could not be written */
+};
+typedef struct tile_queue tile_queue_struct;
+
+/* A thread, with its buffers */
+struct tile_worker
+{
+    tile_queue_struct   *queue;
+    double              *x[2];        /* Vertices being generalized or clipped */
+    double              *y[2];
+    char                *keep;
+    int                 *stack;
+    int                 *line_start;
+    long                size;         /* Allocated size of the arrays above */
+    command_list_struct commands[3];  /* Points, lines and polygons */
+    byte_buffer_struct  features;
+    byte_buffer_struct  tile;
+    long                n_tiles;
+    long                n_features;
+    long                n_bytes;
+    long                max_bytes;
+    long                points_in;
+    long                points_out;
+};
+typedef struct tile_worker tile_worker_struct;
+
+/*******************************************************************************
+** Routine:     Now
+**
+** Description: Wall clock time, in seconds
+*******************************************************************************/
+static double Now (void)
+{
+#ifndef _WIN32
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+#else
+  return (double) clock () / CLOCKS_PER_SEC;
+#endif
+}
+
+/*******************************************************************************
+** Routine:     ParseVectorTileOptions
+**
+** Description: Look for the --mvt=<file>, --mvt-zoom=<min>-<max>,
+**              --mvt-layer=<name>, --mvt-tolerance=<units> and
+**              --mvt-threads=<n> options on the command line, and remove
+**              them from it. Returns 1 if vector tiles are requested.
+*******************************************************************************/
+int ParseVectorTileOptions (
+  int                        *argc,
+  char                       **argv,
+  vector_tile_options_struct *options)
+{
+  int i, n;
+
+  options->filename = NULL;
+  options->layer_name = "geometries";
+  options->min_zoom = 0;
+  options->max_zoom = 12;
+  options->tolerance = 1;
+  options->n_threads = 0;
+
+  for (i=1, n=1; i<*argc; i++) {
+    if (strncmp (argv[i], "--mvt=", 6) == 0) {
+      options->filename = argv[i] + 6;
+      if (*options->filename == '\0') {
+        printf ("Invalid vector tile file name\n");
+        exit (1);
+      }
+    }
+    else if (strncmp (argv[i], "--mvt-zoom=", 11) == 0) {
+      if (sscanf (argv[i] + 11, "%d-%d", &options->min_zoom, &options->max_zoom) == 1)
+        options->max_zoom = options->min_zoom;
+      if (options->min_zoom < 0 || options->max_zoom > RENDER_MAX_ZOOM
+          || options->min_zoom > options->max_zoom) {
+        printf ("Invalid zoom range: must be within 0-%d\n", RENDER_MAX_ZOOM);
+        exit (1);
+      }
+    }
+    else if (strncmp (argv[i], "--mvt-layer=", 12) == 0) {
+      options->layer_name = argv[i] + 12;
+      if (*options->layer_name == '\0' || strlen (options->layer_name) > VECTOR_TILE_MAX_NAME) {
+        printf ("Invalid layer name: must have 1 to %d characters\n", VECTOR_TILE_MAX_NAME);
+        exit (1);
+      }
+    }
+    else if (strncmp (argv[i], "--mvt-tolerance=", 16) == 0) {
+      options->tolerance = atof (argv[i] + 16);
+      if (options->tolerance < 0) {
+        printf ("Invalid generalization tolerance: must not be negative\n");
+        exit (1);
+      }
+    }
+    else if (strncmp (argv[i], "--mvt-threads=", 14) == 0) {
+      options->n_threads = atoi (argv[i] + 14);
+      if (options->n_threads <= 0) {
+        printf ("Invalid number of threads: must be positive\n");
+        exit (1);
+      }
+    }
+    else
+      argv[n++] = argv[i];
+  }
+  *argc = n;
+  argv[n] = NULL;
+
+  return options->filename != NULL;
+}
+
+/*******************************************************************************
+** Routine:     GrowWorker
+**
+** Description: Make the vertex arrays of a thread hold at least n vertices,
+**              keeping their content
+*******************************************************************************/
+static void GrowWorker (tile_worker_struct *worker, long n)
+{
+  int i;
+
+  if (n <= worker->size)
+    return;
+  while (worker->size < n)
+    worker->size = worker->size > 0 ? 2 * worker->size : 1024;
+  for (i=0; i<2; i++) {
+    worker->x[i] = realloc (worker->x[i], worker->size * sizeof(double));
+    worker->y[i] = realloc (worker->y[i], worker->size * sizeof(double));
+  }
+  worker->keep = realloc (worker->keep, worker->size);
+  worker->stack = realloc (worker->stack, 2 * (worker->size + 1) * sizeof(int));
+  worker->line_start = realloc (worker->line_start, (worker->size + 1) * sizeof(int));
+}
+
+/*******************************************************************************
+** Routine:     RingArea
+**
+** Description: Twice the signed area of a ring (surveyor's formula). It is
+**              positive for clockwise rings when y grows downwards. The
+**              ring may be closed or not.
+*******************************************************************************/
+static double RingArea (const double *x, const double *y, int n)
+{
+  double area = 0;
+  int    i;
+
+  for (i=0; i<n; i++)
+    area += x[i] * y[(i+1) % n] - x[(i+1) % n] * y[i];
+  return area;
+}
+
+/*******************************************************************************
+** Routine:     DouglasPeucker
+**
+** Description: Simplify a line (or a closed ring) in place. The first and
+**              last vertices are kept. Returns the new number of vertices.
+*******************************************************************************/
+static int DouglasPeucker (
+  double *x,
+  double *y,
+  int    n,
+  double tolerance,
+  char   *keep,
+  int    *stack)
+{
+  int    top = 0, first, last, farthest, i, m;
+  double dx, dy, d, max_d, length2;
+
+  if (n <= 2 || tolerance <= 0)
+    return n;
+  memset (keep, 0, n);
+  keep[0] = keep[n-1] = 1;
+  stack[top++] = 0;
+  stack[top++] = n - 1;
+  while (top > 0) {
+    last = stack[--top];
+    first = stack[--top];
+    dx = x[last] - x[first];
+    dy = y[last] - y[first];
+    length2 = dx * dx + dy * dy;
+    max_d = 0;
+    farthest = -1;
+    for (i=first+1; i<last; i++) {
+      /* Distance to the segment, or to its first point for the segment of
+         a closed ring, whose ends are the same */
+      if (length2 > 0) {
+        d = (x[i] - x[first]) * dy - (y[i] - y[first]) * dx;
+        d = d * d / length2;
+      }
+      else
+        d = (x[i] - x[first]) * (x[i] - x[first]) + (y[i] - y[first]) * (y[i] - y[first]);
+      if (d > max_d) {
+        max_d = d;
+        farthest = i;
+      }
+    }
+    if (farthest > 0 && max_d > tolerance * tolerance) {
+      keep[farthest] = 1;
+      stack[top++] = first;
+      stack[top++] = farthest;
+      stack[top++] = farthest;
+      stack[top++] = last;
+    }
+  }
+
+  for (i=0, m=0; i<n; i++)
+    if (keep[i]) {
+      x[m] = x[i];
+      y[m++] = y[i];
+    }
+  return m;
+}
+
+/*******************************************************************************
+** Routine:     GeneralizeGeometry
+**
+** Description: Build the shape of a geometry at a zoom: snap its vertices to
+**              the tile grid, simplify its lines and rings, and drop those
+**              that collapse
+*******************************************************************************/
+static void GeneralizeGeometry (
+  tile_worker_struct           *worker,
+  const render_geometry_struct *g,
+  int                          zoom,
+  double                       tolerance,
+  tile_shape_struct            *shape)
+{
+  double scale = (double) VECTOR_TILE_EXTENT * (double) (1L << zoom);
+  double *x, *y, area, original, *box;
+  int    p, v, n, kind, exterior_kept = 0;
+
+  shape->n_parts = 0;
+  shape->part_start = malloc ((g->n_parts + 1) * sizeof(int));
+  shape->part_kind = malloc (g->n_parts);
+  shape->part_box = malloc (4 * g->n_parts * sizeof(double));
+  shape->x = malloc (g->n_vertices * sizeof(double));
+  shape->y = malloc (g->n_vertices * sizeof(double));
+  shape->part_start[0] = 0;
+  GrowWorker (worker, g->n_vertices);
+  x = worker->x[0];
+  y = worker->y[0];
+  worker->points_in += g->n_vertices;
+
+  for (p=0; p<g->n_parts; p++) {
+    kind = g->part_kind[p];
+
+    /* Snap to the grid, without repeated vertices (except for points) */
+    for (v=g->part_start[p], n=0; v<g->part_start[p+1]; v++) {
+      x[n] = floor (g->x[v] * scale + 0.5);
+      y[n] = floor (g->y[v] * scale + 0.5);
+      if (kind == RENDER_POINTS || n == 0 || x[n] != x[n-1] || y[n] != y[n-1])
+        n++;
+    }
+
+    if (kind == RENDER_LINE) {
+      n = DouglasPeucker (x, y, n, tolerance, worker->keep, worker->stack);
+      if (n < 2)
+        continue;
+    }
+    else if (kind == RENDER_RING) {
+      /* A ring of SDO_GEOMETRY turns counter-clockwise if it is an exterior
+         ring, which becomes a negative area once y grows downwards. A ring
+         that collapses or turns over is dropped, and a hole is dropped
+         with its exterior ring */
+      v = g->part_start[p];
+      original = RingArea (g->x + v, g->y + v, g->part_start[p+1] - v);
+      if (n >= 4)
+        n = DouglasPeucker (x, y, n, tolerance, worker->keep, worker->stack);
+      area = n >= 4 ? RingArea (x, y, n) : 0;
+      if (original < 0) {
+        exterior_kept = area < 0;
+        if (!exterior_kept)
+          continue;
+      }
+      else {
+        if (!exterior_kept || area <= 0)
+          continue;
+        kind = SHAPE_HOLE;
+      }
+    }
+
+    box = shape->part_box + 4 * shape->n_parts;
+    box[0] = box[2] = x[0];
+    box[1] = box[3] = y[0];
+    for (v=0; v<n; v++) {
+      shape->x[shape->part_start[shape->n_parts] + v] = x[v];
+      shape->y[shape->part_start[shape->n_parts] + v] = y[v];
+      box[0] = x[v] < box[0] ? x[v] : box[0];
+      box[1] = y[v] < box[1] ? y[v] : box[1];
+      box[2] = x[v] > box[2] ? x[v] : box[2];
+      box[3] = y[v] > box[3] ? y[v] : box[3];
+    }
+    if (shape->n_parts == 0) {
+      shape->min_x = box[0]; shape->min_y = box[1];
+      shape->max_x = box[2]; shape->max_y = box[3];
+    }
+    else {
+      shape->min_x = box[0] < shape->min_x ? box[0] : shape->min_x;
+      shape->min_y = box[1] < shape->min_y ? box[1] : shape->min_y;
+      shape->max_x = box[2] > shape->max_x ? box[2] : shape->max_x;
+      shape->max_y = box[3] > shape->max_y ? box[3] : shape->max_y;
+    }
+    shape->part_kind[shape->n_parts] = (char) kind;
+    shape->part_start[shape->n_parts+1] = shape->part_start[shape->n_parts] + n;
+    shape->n_parts++;
+  }
+  worker->points_out += shape->part_start[shape->n_parts];
+}
+
+/*******************************************************************************
+** Routine:     FreeShapes
+**
+** Description: Free the shapes of a zoom
+*******************************************************************************/
+static void FreeShapes (tile_shape_struct *shapes, long n)
+{
+  long i;
+
+  for (i=0; i<n; i++) {
+    free (shapes[i].part_start);
+    free (shapes[i].part_kind);
+    free (shapes[i].part_box);
+    free (shapes[i].x);
+    free (shapes[i].y);
+  }
+  free (shapes);
+}
+
+/*******************************************************************************
+** Routine:     ClipRing
+**
+** Description: Clip a ring (not closed) to one side of a line x = bound (axis
+**              0) or y = bound (axis 1), keeping what is above the bound if
+**              above is set, below it if not (one step of Sutherland-Hodgman).
+**              The output may have up to twice as many vertices as the input.
+**              Returns the number of vertices of the output.
+*******************************************************************************/
+static int ClipRing (
+  const double *x,
+  const double *y,
+  int          n,
+  int          axis,
+  double       bound,
+  int          above,
+  double       *out_x,
+  double       *out_y)
+{
+  const double *c = axis == 0 ? x : y;
+  int    i, previous, m = 0, inside, previous_inside;
+  double t;
+
+  if (n == 0)
+    return 0;
+  previous = n - 1;
+  previous_inside = above ? c[previous] >= bound : c[previous] <= bound;
+  for (i=0; i<n; i++) {
+    inside = above ? c[i] >= bound : c[i] <= bound;
+    if (inside != previous_inside) {
+      /* The edge crosses the line: add the crossing point */
+      t = (bound - c[previous]) / (c[i] - c[previous]);
+      out_x[m] = axis == 0 ? bound : x[previous] + t * (x[i] - x[previous]);
+      out_y[m] = axis == 1 ? bound : y[previous] + t * (y[i] - y[previous]);
+      m++;
+    }
+    if (inside) {
+      out_x[m] = x[i];
+      out_y[m++] = y[i];
+    }
+    previous = i;
+    previous_inside = inside;
+  }
+  return m;
+}
+
+/*******************************************************************************
+** Routine:     ClipLine
+**
+** Description: Clip a line to a square from low to high in x and y (Liang-
+**              Barsky). The pieces inside go one after the other to out_x
+**              and out_y, with the first vertex of each in line_start.
+**              Returns the number of pieces.
+*******************************************************************************/
+static int ClipLine (
+  const double *x,
+  const double *y,
+  int          n,
+  double       low,
+  double       high,
+  double       *out_x,
+  double       *out_y,
+  int          *line_start)
+{
+  double t0, t1, dx, dy, p[4], q[4], r;
+  int    i, k, m = 0, n_lines = 0, open = 0;
+
+  for (i=0; i+1<n; i++) {
+    dx = x[i+1] - x[i];
+    dy = y[i+1] - y[i];
+    p[0] = -dx; q[0] = x[i] - low;
+    p[1] = dx;  q[1] = high - x[i];
+    p[2] = -dy; q[2] = y[i] - low;
+    p[3] = dy;  q[3] = high - y[i];
+    t0 = 0;
+    t1 = 1;
+    for (k=0; k<4 && t0<=t1; k++) {
+      if (p[k] == 0) {
+        if (q[k] < 0)
+          t1 = -1;                    /* Parallel to the side, and outside */
+        continue;
+      }
+      r = q[k] / p[k];
+      if (p[k] < 0 && r > t0)
+        t0 = r;
+      else if (p[k] > 0 && r < t1)
+        t1 = r;
+    }
+    if (t0 > t1) {
+      open = 0;
+      continue;
+    }
+    /* A new piece starts where the line enters the square */
+    if (!open || t0 > 0) {
+      line_start[n_lines++] = m;
+      out_x[m] = x[i] + t0 * dx;
+      out_y[m++] = y[i] + t0 * dy;
+    }
+    out_x[m] = x[i] + t1 * dx;
+    out_y[m++] = y[i] + t1 * dy;
+    open = t1 == 1;
+  }
+  line_start[n_lines] = m;
+  return n_lines;
+}
+
+/*******************************************************************************
+** Routine:     RoundPath
+**
+** Description: Round the vertices of a clipped path to whole numbers and
+**              remove the repeated ones, including the last vertex of a ring
+**              that is the same as the first. Returns the new number of
+**              vertices.
+*******************************************************************************/
+static int RoundPath (double *x, double *y, int n, int ring)
+{
+  int i, m = 0;
+
+  for (i=0; i<n; i++) {
+    x[m] = floor (x[i] + 0.5);
+    y[m] = floor (y[i] + 0.5);
+    if (m == 0 || x[m] != x[m-1] || y[m] != y[m-1])
+      m++;
+  }
+  while (ring && m > 1 && x[m-1] == x[0] && y[m-1] == y[0])
+    m--;
+  return m;
+}
+
+/*******************************************************************************
+** Routine:     PushCommand, PushPoint
+**
+** Description: Add an integer, or the zig-zag coded move from the cursor to
+**              a point, to the commands of a feature
+*******************************************************************************/
+static void PushCommand (command_list_struct *list, uint32_t value)
+{
+  if (list->length == list->size) {
+    list->size = list->size > 0 ? 2 * list->size : 1024;
+    list->data = realloc (list->data, list->size * sizeof(uint32_t));
+  }
+  list->data[list->length++] = value;
+}
+
+static void PushPoint (command_list_struct *list, double x, double y)
+{
+  int32_t dx = (int32_t) x - list->x, dy = (int32_t) y - list->y;
+
+  PushCommand (list, ((uint32_t) dx << 1) ^ (uint32_t) (dx >> 31));
+  PushCommand (list, ((uint32_t) dy << 1) ^ (uint32_t) (dy >> 31));
+  list->x = (int32_t) x;
+  list->y = (int32_t) y;
+}
+
+#define COMMAND(id, count) ((uint32_t) (id) | ((uint32_t) (count) << 3))
+
+/*******************************************************************************
+** Routine:     AddPath
+**
+** Description: Add the commands of a path of a tile to the feature of its
+**              kind. The points of a geometry share one MoveTo. Rings are
+**              written backwards, to turn the way the specification wants.
+*******************************************************************************/
+static void AddPath (
+  command_list_struct *list,
+  const double        *x,
+  const double        *y,
+  int                 n,
+  int                 kind)
+{
+  int i;
+
+  if (kind == RENDER_POINTS) {
+    if (list->count_slot < 0) {
+      list->count_slot = list->length;
+      PushCommand (list, 0);
+    }
+    for (i=0; i<n; i++)
+      PushPoint (list, x[i], y[i]);
+    list->n_points += n;
+    list->data[list->count_slot] = COMMAND (COMMAND_MOVE_TO, list->n_points);
+  }
+  else if (kind == RENDER_LINE) {
+    PushCommand (list, COMMAND (COMMAND_MOVE_TO, 1));
+    PushPoint (list, x[0], y[0]);
+    PushCommand (list, COMMAND (COMMAND_LINE_TO, n - 1));
+    for (i=1; i<n; i++)
+      PushPoint (list, x[i], y[i]);
+  }
+  else {
+    PushCommand (list, COMMAND (COMMAND_MOVE_TO, 1));
+    PushPoint (list, x[n-1], y[n-1]);
+    PushCommand (list, COMMAND (COMMAND_LINE_TO, n - 1));
+    for (i=n-2; i>=0; i--)
+      PushPoint (list, x[i], y[i]);
+    PushCommand (list, COMMAND (COMMAND_CLOSE_PATH, 1));
+  }
+}
+
+/*******************************************************************************
+** Routine:     ClipPart
+**
+** Description: Clip a part of a shape to a tile with its buffer, and add what
+**              is left to the features of the tile. Returns 1 if something
+**              was added.
+*******************************************************************************/
+static int ClipPart (
+  tile_worker_struct      *worker,
+  const tile_shape_struct *shape,
+  int                     part,
+  double                  origin_x,
+  double                  origin_y)
+{
+  const double *box = shape->part_box + 4 * part;
+  double low = -VECTOR_TILE_BUFFER, high = VECTOR_TILE_EXTENT + VECTOR_TILE_BUFFER;
+  double *x, *y;
+  int    first = shape->part_start[part], n = shape->part_start[part+1] - first;
+  int    kind = shape->part_kind[part], inside, i, k, m, n_lines, side;
+  command_list_struct *list;
+
+  if (box[2] - origin_x < low || box[0] - origin_x > high
+      || box[3] - origin_y < low || box[1] - origin_y > high)
+    return 0;
+  inside = box[0] - origin_x >= low && box[2] - origin_x <= high
+    && box[1] - origin_y >= low && box[3] - origin_y <= high;
+  list = &worker->commands[kind == RENDER_POINTS ? 0 : (kind == RENDER_LINE ? 1 : 2)];
+
+  /* Move to the coordinates of the tile. Rings lose their closing vertex */
+  if (kind == RENDER_RING || kind == SHAPE_HOLE)
+    n--;
+  GrowWorker (worker, 2 * (long) n + 8);
+  x = worker->x[0];
+  y = worker->y[0];
+  for (i=0; i<n; i++) {
+    x[i] = shape->x[first + i] - origin_x;
+    y[i] = shape->y[first + i] - origin_y;
+  }
+
+  if (kind == RENDER_POINTS) {
+    for (i=0, m=0; i<n; i++)
+      if (x[i] >= low && x[i] <= high && y[i] >= low && y[i] <= high) {
+        x[m] = x[i];
+        y[m++] = y[i];
+      }
+    if (m > 0)
+      AddPath (list, x, y, m, kind);
+    return m > 0;
+  }
+
+  if (kind == RENDER_LINE) {
+    if (inside) {
+      AddPath (list, x, y, n, kind);
+      return 1;
+    }
+    n_lines = ClipLine (x, y, n, low, high, worker->x[1], worker->y[1], worker->line_start);
+    for (k=0, m=0; k<n_lines; k++) {
+      i = worker->line_start[k];
+      n = RoundPath (worker->x[1] + i, worker->y[1] + i, worker->line_start[k+1] - i, 0);
+      if (n >= 2) {
+        AddPath (list, worker->x[1] + i, worker->y[1] + i, n, kind);
+        m++;
+      }
+    }
+    return m > 0;
+  }
+
+  /* Rings: clip to each side in turn, keeping what is inside. Each step
+     may double the number of vertices at most */
+  if (!inside)
+    for (side=0; side<4 && n>0; side++) {
+      GrowWorker (worker, 2 * (long) n + 8);
+      n = ClipRing (worker->x[side % 2], worker->y[side % 2], n, side / 2,
+        side % 2 == 0 ? low : high, side % 2 == 0,
+        worker->x[(side + 1) % 2], worker->y[(side + 1) % 2]);
+    }
+  x = worker->x[0];
+  y = worker->y[0];
+  n = RoundPath (x, y, n, 1);
+  if (n < 3 || RingArea (x, y, n) == 0)
+    return 0;
+  AddPath (list, x, y, n, kind);
+  return 1;
+}
+
+/*******************************************************************************
+** Routine:     PutByte, PutVarint, VarintSize
+**
+** Description: Write a byte or a varint to a message, and the number of
+**              bytes of a varint
+*******************************************************************************/
+static void PutByte (byte_buffer_struct *buffer, int value)
+{
+  if (buffer->length == buffer->size) {
+    buffer->size = buffer->size > 0 ? 2 * buffer->size : 65536;
+    buffer->data = realloc (buffer->data, buffer->size);
+  }
+  buffer->data[buffer->length++] = (unsigned char) value;
+}
+
+static void PutVarint (byte_buffer_struct *buffer, uint64_t value)
+{
+  while (value >= 0x80) {
+    PutByte (buffer, (int) (value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  PutByte (buffer, (int) value);
+}
+
+static int VarintSize (uint64_t value)
+{
+  int n = 1;
+
+  while (value >= 0x80) {
+    value >>= 7;
+    n++;
+  }
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     PutFeature
+**
+** Description: Write a feature (field 2 of the layer) with the commands of
+**              its geometry, and empty the commands. An id of 0 is not
+**              written.
+*******************************************************************************/
+static void PutFeature (
+  byte_buffer_struct  *buffer,
+  command_list_struct *list,
+  uint64_t            id,
+  int                 type)
+{
+  long geometry_length = 0, feature_length, i;
+
+  for (i=0; i<list->length; i++)
+    geometry_length += VarintSize (list->data[i]);
+  feature_length = 2 + 1 + VarintSize (geometry_length) + geometry_length;
+  if (id > 0)
+    feature_length += 1 + VarintSize (id);
+
+  PutByte (buffer, 0x12);             /* Layer.features */
+  PutVarint (buffer, feature_length);
+  if (id > 0) {
+    PutByte (buffer, 0x08);           /* Feature.id */
+    PutVarint (buffer, id);
+  }
+  PutByte (buffer, 0x18);             /* Feature.type */
+  PutByte (buffer, type);
+  PutByte (buffer, 0x22);             /* Feature.geometry, packed */
+  PutVarint (buffer, geometry_length);
+  for (i=0; i<list->length; i++)
+    PutVarint (buffer, list->data[i]);
+
+  list->length = 0;
+  list->x = list->y = 0;
+  list->count_slot = -1;
+  list->n_points = 0;
+}
+
+/*******************************************************************************
+** Routine:     PutTile
+**
+** Description: Wrap the features of a tile into a layer (field 3 of the
+**              tile), with its version, name and extent
+*******************************************************************************/
+static void PutTile (
+  byte_buffer_struct       *tile,
+  const byte_buffer_struct *features,
+  const char               *name)
+{
+  long name_length = (long) strlen (name), layer_length;
+
+  layer_length = 2 + 1 + VarintSize (name_length) + name_length
+    + features->length + 1 + VarintSize (VECTOR_TILE_EXTENT);
+  tile->length = 0;
+  PutByte (tile, 0x1A);               /* Tile.layers */
+  PutVarint (tile, layer_length);
+  PutByte (tile, 0x78);               /* Layer.version */
+  PutByte (tile, 2);
+  PutByte (tile, 0x0A);               /* Layer.name */
+  PutVarint (tile, name_length);
+  while (tile->size < tile->length + name_length + features->length + 8) {
+    tile->size = 2 * tile->size;
+    tile->data = realloc (tile->data, tile->size);
+  }
+  memcpy (tile->data + tile->length, name, name_length);
+  tile->length += name_length;
+  memcpy (tile->data + tile->length, features->data, features->length);
+  tile->length += features->length;
+  PutByte (tile, 0x28);               /* Layer.extent */
+  PutVarint (tile, VECTOR_TILE_EXTENT);
+}
+
+/*******************************************************************************
+** Routine:     NextTask
+**
+** Description: Take the next task from the queue. Returns -1 when there are
+**              none left.
+*******************************************************************************/
+static long NextTask (tile_queue_struct *queue)
+{
+  long task = -1;
+
+#ifndef _WIN32
+  pthread_mutex_lock (&queue->lock);
+#endif
+  if (queue->next_task < queue->n_tasks && !queue->error)
+    task = queue->next_task++;
+#ifndef _WIN32
+  pthread_mutex_unlock (&queue->lock);
+#endif
+  return task;
+}
+
+/*******************************************************************************
+** Routine:     GeneralizeQueue
+**
+** Description: Thread routine: generalize each group of geometries taken
+*******************************************************************************/
+static void *GeneralizeQueue (void *argument)
+{
+  tile_worker_struct *worker = (tile_worker_struct *) argument;
+  tile_queue_struct  *queue = worker->queue;
+  long task, i;
+
+  while ((task = NextTask (queue)) >= 0)
+    for (i=task*GENERALIZE_GROUP; i<(task+1)*GENERALIZE_GROUP && i<queue->layer->n_geometries; i++)
+      GeneralizeGeometry (worker, &queue->layer->geometries[i], queue->zoom,
+        queue->options->tolerance, &queue->shapes[i]);
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     StoreTile
+**
+** Description: Append a tile to the file and to the index. Returns 0, or -1
+**              if it could not be written.
+*******************************************************************************/
+static int StoreTile (
+  tile_queue_struct        *queue,
+  long                     column,
+  long                     row,
+  const byte_buffer_struct *tile)
+{
+  tile_entry_struct *entry;
+  int status = 0;
+
+#ifndef _WIN32
+  pthread_mutex_lock (&queue->lock);
+#endif
+  if (fwrite (tile->data, 1, tile->length, queue->file) != (size_t) tile->length) {
+    queue->error = 1;
+    status = -1;
+  }
+  else {
+    if (queue->n_entries == queue->entries_size) {
+      queue->entries_size = queue->entries_size > 0 ? 2 * queue->entries_size : 4096;
+      queue->entries = realloc (queue->entries, queue->entries_size * sizeof(tile_entry_struct));
+    }
+    entry = &queue->entries[queue->n_entries++];
+    entry->zoom = queue->zoom;
+    entry->column = column;
+    entry->row = row;
+    entry->length = tile->length;
+    entry->offset = queue->offset;
+    queue->offset += tile->length;
+  }
+#ifndef _WIN32
+  pthread_mutex_unlock (&queue->lock);
+#endif
+  return status;
+}
+
+/*******************************************************************************
+** Routine:     EncodeQueue
+**
+** Description: Thread routine: encode and store each tile taken
+*******************************************************************************/
+static void *EncodeQueue (void *argument)
+{
+  static const int feature_type[3] = {FEATURE_POINT, FEATURE_LINESTRING, FEATURE_POLYGON};
+  tile_worker_struct *worker = (tile_worker_struct *) argument;
+  tile_queue_struct  *queue = worker->queue;
+  const tile_shape_struct *shape;
+  const render_geometry_struct *g;
+  double   origin_x, origin_y;
+  uint64_t id;
+  long     task, piece, column, row;
+  int      p, k, kept;
+
+  while ((task = NextTask (queue)) >= 0) {
+    row = (long) (queue->pieces[queue->task_start[task]].tile >> queue->zoom);
+    column = (long) (queue->pieces[queue->task_start[task]].tile & ((1UL << queue->zoom) - 1));
+    origin_x = (double) column * VECTOR_TILE_EXTENT;
+    origin_y = (double) row * VECTOR_TILE_EXTENT;
+    worker->features.length = 0;
+
+    for (piece=queue->task_start[task]; piece<queue->task_start[task+1]; piece++) {
+      shape = &queue->shapes[queue->pieces[piece].shape];
+      g = &queue->layer->geometries[queue->pieces[piece].shape];
+      id = g->value >= 1 && g->value < 9007199254740992.0 && g->value == floor (g->value)
+        ? (uint64_t) g->value : 0;
+
+      /* A hole is only written after its exterior ring */
+      for (p=0, kept=0; p<shape->n_parts; p++)
+        if (shape->part_kind[p] == SHAPE_HOLE) {
+          if (kept)
+            ClipPart (worker, shape, p, origin_x, origin_y);
+        }
+        else
+          kept = ClipPart (worker, shape, p, origin_x, origin_y);
+
+      for (k=0; k<3; k++)
+        if (worker->commands[k].length > 0) {
+          PutFeature (&worker->features, &worker->commands[k], id, feature_type[k]);
+          worker->n_features++;
+        }
+    }
+
+    if (worker->features.length == 0)
+      continue;
+    PutTile (&worker->tile, &worker->features, queue->options->layer_name);
+    if (StoreTile (queue, column, row, &worker->tile) != 0)
+      break;
+    worker->n_tiles++;
+    worker->n_bytes += worker->tile.length;
+    if (worker->tile.length > worker->max_bytes)
+      worker->max_bytes = worker->tile.length;
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+** Routine:     RunWorkers
+**
+** Description: Run a thread routine on all the workers, and wait for them
+*******************************************************************************/
+static void RunWorkers (
+  void               *(*routine) (void *),
+  tile_worker_struct *workers,
+  int                n_threads)
+{
+#ifndef _WIN32
+  pthread_t threads[RENDER_MAX_THREADS];
+  int       started[RENDER_MAX_THREADS];
+  int       t;
+
+  for (t=1; t<n_threads; t++)
+    started[t] = pthread_create (&threads[t], NULL, routine, &workers[t]) == 0;
+  routine (&workers[0]);
+  for (t=1; t<n_threads; t++)
+    if (started[t])
+      pthread_join (threads[t], NULL);
+#else
+  routine (&workers[0]);
+#endif
+}
+
+/*******************************************************************************
+** Routine:     ComparePieces
+**
+** Description: Order pieces by tile, then in the order of the layer (for
+**              qsort)
+*******************************************************************************/
+static int ComparePieces (const void *a, const void *b)
+{
+  const tile_piece_struct *pa = (const tile_piece_struct *) a;
+  const tile_piece_struct *pb = (const tile_piece_struct *) b;
+
+  if (pa->tile != pb->tile)
+    return pa->tile < pb->tile ? -1 : 1;
+  return pa->shape < pb->shape ? -1 : (pa->shape > pb->shape ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     TileOf
+**
+** Description: Column or row of the tile that holds a coordinate of the
+**              tile grid
+*******************************************************************************/
+static long TileOf (double coordinate, long n_tiles)
+{
+  long tile;
+
+  if (coordinate < 0)
+    return 0;
+  tile = (long) (coordinate / VECTOR_TILE_EXTENT);
+  return tile < n_tiles ? tile : n_tiles - 1;
+}
+
+/*******************************************************************************
+** Routine:     ListPieces
+**
+** Description: List the tiles of a zoom that the MBR of each shape overlaps,
+**              with the buffer, sorted by tile. Returns the number of pieces.
+*******************************************************************************/
+static long ListPieces (
+  const tile_shape_struct *shapes,
+  long                    n_shapes,
+  int                     zoom,
+  tile_piece_struct       **pieces)
+{
+  const tile_shape_struct *s;
+  tile_piece_struct *list = NULL;
+  long   n_tiles = 1L << zoom, n = 0, size = 0, i, row, column;
+  long   first_column, last_column, first_row, last_row;
+  double margin = VECTOR_TILE_BUFFER, world = (double) VECTOR_TILE_EXTENT * n_tiles;
+
+  for (i=0; i<n_shapes; i++) {
+    s = &shapes[i];
+    if (s->n_parts == 0 || s->max_x + margin < 0 || s->min_x - margin > world
+        || s->max_y + margin < 0 || s->min_y - margin > world)
+      continue;
+    first_column = TileOf (s->min_x - margin, n_tiles);
+    last_column = TileOf (s->max_x + margin, n_tiles);
+    first_row = TileOf (s->min_y - margin, n_tiles);
+    last_row = TileOf (s->max_y + margin, n_tiles);
+    for (row=first_row; row<=last_row; row++)
+      for (column=first_column; column<=last_column; column++) {
+        if (n == size) {
+          size = size > 0 ? 2 * size : 4096;
+          list = realloc (list, size * sizeof(tile_piece_struct));
+        }
+        list[n].tile = ((uint64_t) row << zoom) | (uint64_t) column;
+        list[n].shape = i;
+        n++;
+      }
+  }
+  if (n > 0)
+    qsort (list, n, sizeof(tile_piece_struct), ComparePieces);
+  *pieces = list;
+  return n;
+}
+
+/*******************************************************************************
+** Routine:     PutUint32, PutUint64, GetUint32, GetUint64
+**
+** Description: Little-endian numbers of the header and of the index
+*******************************************************************************/
+static void PutUint32 (unsigned char *data, uint32_t value)
+{
+  int i;
+
+  for (i=0; i<4; i++)
+    data[i] = (unsigned char) (value >> (8 * i));
+}
+
+static void PutUint64 (unsigned char *data, uint64_t value)
+{
+  PutUint32 (data, (uint32_t) value);
+  PutUint32 (data + 4, (uint32_t) (value >> 32));
+}
+
+static uint32_t GetUint32 (const unsigned char *data)
+{
+  return (uint32_t) data[0] | ((uint32_t) data[1] << 8)
+    | ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24);
+}
+
+static uint64_t GetUint64 (const unsigned char *data)
+{
+  return (uint64_t) GetUint32 (data) | ((uint64_t) GetUint32 (data + 4) << 32);
+}
+
+/*******************************************************************************
+** Routine:     CompareEntries
+**
+** Description: Order the tiles by zoom, column and row (for qsort)
+*******************************************************************************/
+static int CompareEntries (const void *a, const void *b)
+{
+  const tile_entry_struct *ea = (const tile_entry_struct *) a;
+  const tile_entry_struct *eb = (const tile_entry_struct *) b;
+
+  if (ea->zoom != eb->zoom)
+    return ea->zoom < eb->zoom ? -1 : 1;
+  if (ea->column != eb->column)
+    return ea->column < eb->column ? -1 : 1;
+  return ea->row < eb->row ? -1 : (ea->row > eb->row ? 1 : 0);
+}
+
+/*******************************************************************************
+** Routine:     WriteHeader
+**
+** Description: Write the header of the file
+*******************************************************************************/
+static int WriteHeader (
+  FILE                             *file,
+  const vector_tile_options_struct *options,
+  long                             n_tiles,
+  long                             index_offset)
+{
+  unsigned char header[VECTOR_TILE_HEADER_SIZE];
+
+  memset (header, 0, sizeof(header));
+  memcpy (header, "SDOVTILE", 8);
+  PutUint32 (header + 8, 1);
+  PutUint32 (header + 12, options->min_zoom);
+  PutUint32 (header + 16, options->max_zoom);
+  PutUint32 (header + 20, VECTOR_TILE_EXTENT);
+  PutUint64 (header + 24, n_tiles);
+  PutUint64 (header + 32, index_offset);
+  strncpy ((char *) header + 40, options->layer_name, VECTOR_TILE_MAX_NAME);
+  if (fseek (file, 0, SEEK_SET) != 0
+      || fwrite (header, 1, sizeof(header), file) != sizeof(header))
+    return -1;
+  return 0;
+}
+
+/*******************************************************************************
+** Routine:     WriteIndex
+**
+** Description: Sort the index and write it at the end of the file, then
+**              complete the header. Returns 0, or -1 if the file could not
+**              be written.
+*******************************************************************************/
+static int WriteIndex (
+  tile_queue_struct                *queue,
+  const vector_tile_options_struct *options)
+{
+  unsigned char entry[VECTOR_TILE_ENTRY_SIZE];
+  tile_entry_struct *e;
+  long i;
+
+  if (queue->n_entries > 0)
+    qsort (queue->entries, queue->n_entries, sizeof(tile_entry_struct), CompareEntries);
+  for (i=0; i<queue->n_entries; i++) {
+    e = &queue->entries[i];
+    PutUint32 (entry, e->zoom);
+    PutUint32 (entry + 4, (uint32_t) e->column);
+    PutUint32 (entry + 8, (uint32_t) e->row);
+    PutUint32 (entry + 12, (uint32_t) e->length);
+    PutUint64 (entry + 16, e->offset);
+    if (fwrite (entry, 1, sizeof(entry), queue->file) != sizeof(entry))
+      return -1;
+  }
+  return WriteHeader (queue->file, options, queue->n_entries, queue->offset);
+}
+
+/*******************************************************************************
+** Routine:     BuildVectorTiles
+**
+** Description: Build the vector tiles of a layer from the minimum to the
+**              maximum zoom of the options, into the file of the options.
+**              The layer must have been projected. Returns 0, or -1 if the
+**              parameters are invalid or the file could not be written.
+*******************************************************************************/
+int BuildVectorTiles (
+  const render_layer_struct        *layer,
+  const vector_tile_options_struct *options,
+  vector_tile_result_struct        *result)
+{
+  tile_queue_struct  queue;
+  tile_worker_struct *workers;
+  long   n_pieces, i;
+  int    n_threads, zoom, t, k, status = 0;
+  double start_time;
+
+  memset (result, 0, sizeof(vector_tile_result_struct));
+  if (options->min_zoom < 0 || options->max_zoom > RENDER_MAX_ZOOM
+      || options->min_zoom > options->max_zoom || layer->scheme == 0)
+    return -1;
+  n_threads = options->n_threads > 0 ? options->n_threads : ProcessorThreads (RENDER_MAX_THREADS);
+#ifdef _WIN32
+  n_threads = 1;
+#endif
+  if (n_threads > RENDER_MAX_THREADS)
+    n_threads = RENDER_MAX_THREADS;
+  result->n_threads = n_threads;
+
+  memset (&queue, 0, sizeof(queue));
+  queue.layer = layer;
+  queue.options = options;
+  queue.file = fopen (options->filename, "wb");
+  if (queue.file == NULL)
+    return -1;
+  /* The header is completed once the index is written */
+  if (WriteHeader (queue.file, options, 0, 0) != 0) {
+    fclose (queue.file);
+    return -1;
+  }
+  queue.offset = VECTOR_TILE_HEADER_SIZE;
+#ifndef _WIN32
+  pthread_mutex_init (&queue.lock, NULL);
+#endif
+
+  workers = calloc (n_threads, sizeof(tile_worker_struct));
+  for (t=0; t<n_threads; t++) {
+    workers[t].queue = &queue;
+    for (k=0; k<3; k++)
+      workers[t].commands[k].count_slot = -1;
+  }
+
+  for (zoom=options->min_zoom; zoom<=options->max_zoom && status == 0; zoom++) {
+    start_time = Now ();
+    for (t=0; t<n_threads; t++) {
+      workers[t].n_tiles = workers[t].n_features = 0;
+      workers[t].n_bytes = workers[t].max_bytes = 0;
+      workers[t].points_in = workers[t].points_out = 0;
+    }
+
+    /* Generalize the layer for this zoom, by groups of geometries */
+    queue.zoom = zoom;
+    queue.shapes = calloc (layer->n_geometries + 1, sizeof(tile_shape_struct));
+    queue.n_tasks = (layer->n_geometries + GENERALIZE_GROUP - 1) / GENERALIZE_GROUP;
+    queue.next_task = 0;
+    RunWorkers (GeneralizeQueue, workers, n_threads);
+
+    /* Then encode the tiles, one task per tile, in the order of the rows */
+    n_pieces = ListPieces (queue.shapes, layer->n_geometries, zoom, &queue.pieces);
+    queue.task_start = malloc ((n_pieces + 1) * sizeof(long));
+    queue.n_tasks = 0;
+    for (i=0; i<n_pieces; i++)
+      if (i == 0 || queue.pieces[i].tile != queue.pieces[i-1].tile)
+        queue.task_start[queue.n_tasks++] = i;
+    queue.task_start[queue.n_tasks] = n_pieces;
+    queue.next_task = 0;
+    RunWorkers (EncodeQueue, workers, n_threads);
+
+    for (t=0; t<n_threads; t++) {
+      result->n_tiles[zoom] += workers[t].n_tiles;
+      result->n_features[zoom] += workers[t].n_features;
+      result->n_bytes[zoom] += workers[t].n_bytes;
+      if (workers[t].max_bytes > result->max_bytes[zoom])
+        result->max_bytes[zoom] = workers[t].max_bytes;
+      result->points_in[zoom] += workers[t].points_in;
+      result->points_out[zoom] += workers[t].points_out;
+    }
+    if (queue.error)
+      status = -1;
+    FreeShapes (queue.shapes, layer->n_geometries);
+    free (queue.pieces);
+    free (queue.task_start);
+    result->seconds[zoom] = Now () - start_time;
+  }
+
+  if (status == 0 && WriteIndex (&queue, options) != 0)
+    status = -1;
+  result->file_size = queue.offset + queue.n_entries * VECTOR_TILE_ENTRY_SIZE;
+  if (fclose (queue.file) != 0)
+    status = -1;
+#ifndef _WIN32
+  pthread_mutex_destroy (&queue.lock);
+#endif
+
+  for (t=0; t<n_threads; t++) {
+    for (k=0; k<2; k++) {
+      free (workers[t].x[k]);
+      free (workers[t].y[k]);
+    }
+    free (workers[t].keep);
+    free (workers[t].stack);
+    free (workers[t].line_start);
+    for (k=0; k<3; k++)
+      free (workers[t].commands[k].data);
+    free (workers[t].features.data);
+    free (workers[t].tile.data);
+  }
+  free (workers);
+  free (queue.entries);
+  return status;
+}
+
+/*******************************************************************************
+** Routine:     PrintVectorTileStatistics
+**
+** Description: Print out what was built at each zoom
+*******************************************************************************/
+void PrintVectorTileStatistics (
+  const vector_tile_options_struct *options,
+  const vector_tile_result_struct  *result)
+{
+  long   tiles = 0, bytes = 0, max_bytes = 0;
+  double seconds = 0;
+  int    zoom;
+
+  printf ("\nVector tiles of layer '%s' in %s (%d threads, tolerance %g)\n",
+    options->layer_name, options->filename, result->n_threads, options->tolerance);
+  printf ("Zoom      Tiles   Features   Points kept      Bytes  Avg bytes  Max bytes  Seconds  Tiles/sec\n");
+  for (zoom=options->min_zoom; zoom<=options->max_zoom; zoom++) {
+    printf ("%4d %10ld %10ld %12.1f%% %10ld %10.0f %10ld %8.3f %10.0f\n", zoom,
+      result->n_tiles[zoom], result->n_features[zoom],
+      result->points_in[zoom] > 0 ? 100.0 * result->points_out[zoom] / result->points_in[zoom] : 0.0,
+      result->n_bytes[zoom],
+      result->n_tiles[zoom] > 0 ? (double) result->n_bytes[zoom] / result->n_tiles[zoom] : 0.0,
+      result->max_bytes[zoom], result->seconds[zoom],
+      result->seconds[zoom] > 0 ? result->n_tiles[zoom] / result->seconds[zoom] : 0.0);
+    tiles += result->n_tiles[zoom];
+    bytes += result->n_bytes[zoom];
+    seconds += result->seconds[zoom];
+    if (result->max_bytes[zoom] > max_bytes)
+      max_bytes = result->max_bytes[zoom];
+  }
+  printf ("All  %10ld %10s %13s %10ld %10.0f %10ld %8.3f %10.0f\n", tiles, "", "", bytes,
+    tiles > 0 ? (double) bytes / tiles : 0.0, max_bytes, seconds,
+    seconds > 0 ? tiles / seconds : 0.0);
+  printf ("File size: %ld bytes (%.1f MB/sec)\n", result->file_size,
+    seconds > 0 ? result->file_size / seconds / 1e6 : 0.0);
+}
+
+/*******************************************************************************
+** Routine:     ReadVectorTile
+**
+** Description: Read a tile from a file built by BuildVectorTiles, looking it
+**              up in the index with a binary search. The tile is returned in
+**              memory allocated with malloc. Returns its length, 0 if the
+**              file has no such tile (it is empty), or -1 if the file could
+**              not be read.
+*******************************************************************************/
+long ReadVectorTile (
+  const char    *filename,
+  int           zoom,
+  long          column,
+  long          row,
+  unsigned char **tile)
+{
+  unsigned char header[VECTOR_TILE_HEADER_SIZE], entry[VECTOR_TILE_ENTRY_SIZE];
+  tile_entry_struct key, found;
+  long  low, high, middle, n_tiles, index_offset, length = 0;
+  int   order;
+  FILE  *file;
+
+  *tile = NULL;
+  file = fopen (filename, "rb");
+  if (file == NULL)
+    return -1;
+  if (fread (header, 1, sizeof(header), file) != sizeof(header)
+      || memcmp (header, "SDOVTILE", 8) != 0 || GetUint32 (header + 8) != 1) {
+    fclose (file);
+    return -1;
+  }
+  n_tiles = (long) GetUint64 (header + 24);
+  index_offset = (long) GetUint64 (header + 32);
+
+  key.zoom = zoom;
+  key.column = column;
+  key.row = row;
+  low = 0;
+  high = n_tiles - 1;
+  while (low <= high) {
+    middle = (low + high) / 2;
+    if (fseek (file, index_offset + middle * VECTOR_TILE_ENTRY_SIZE, SEEK_SET) != 0
+        || fread (entry, 1, sizeof(entry), file) != sizeof(entry)) {
+      length = -1;
+      break;
+    }
+    found.zoom = (int) GetUint32 (entry);
+    found.column = (long) GetUint32 (entry + 4);
+    found.row = (long) GetUint32 (entry + 8);
+    order = CompareEntries (&key, &found);
+    if (order < 0)
+      high = middle - 1;
+    else if (order > 0)
+      low = middle + 1;
+    else {
+      length = (long) GetUint32 (entry + 12);
+      *tile = malloc (length);
+      if (fseek (file, (long) GetUint64 (entry + 16), SEEK_SET) != 0
+          || fread (*tile, 1, length, file) != (size_t) length) {
+        free (*tile);
+        *tile = NULL;
+        length = -1;
+      }
+      break;
+    }
+  }
+  fclose (file);
+  return length;
+}
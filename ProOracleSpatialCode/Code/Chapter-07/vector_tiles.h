@@ -0,0 +1,108 @@
+/* vector_tiles.h
+
+   Client-side generation of vector tiles from a layer of geometries.
+
+   Vector tiles carry the geometries themselves instead of an image of them
+   (see tile_render.h): the client draws them, in any style, at any size.
+   They follow version 2 of the Mapbox Vector Tile specification, the format
+   of most web and mobile map libraries. Each tile is a Protocol Buffers
+   message with one layer, whose features are the pieces of the geometries
+   that fall in the tile. The coordinates of a tile are integers from 0 to
+   VECTOR_TILE_EXTENT, with y growing downwards, and the geometry of each
+   feature is a list of commands (move to, line to, close path) followed by
+   the differences from the previous point, coded as zig-zag integers so
+   that small negative values take one byte.
+
+   The tiles of all zooms are built in one batch, and stored in a single
+   file with an index, like an MBTiles file:
+
+   - a header of VECTOR_TILE_HEADER_SIZE bytes: the magic string
+     "SDOVTILE", the version of the format, the range of zooms, the extent,
+     the number of tiles, the offset of the index and the name of the layer
+   - the tiles, one after the other
+   - the index: one entry of VECTOR_TILE_ENTRY_SIZE bytes per tile (zoom,
+     column, row, length and offset of the tile), sorted by zoom, column
+     and row, so that ReadVectorTile finds a tile with a binary search
+
+   All numbers are stored little-endian. The rows are numbered from the
+   top, like the z/x/y tiles of tile_render.c (MBTiles numbers them from
+   the bottom). The tiles are not compressed, and tiles with nothing in
+   them are not stored.
+
+   The layer is the one of tile_render.h: the geometries are first
+   projected to world coordinates. At each zoom, they are generalized once
+   for all the tiles of that zoom (a pre-generalized level of detail):
+
+   - the vertices are snapped to the grid of the tile coordinates of that
+     zoom, and repeated vertices are removed
+   - lines and rings are simplified with the Douglas-Peucker algorithm, with
+     a tolerance in units of the tile grid
+   - lines and rings that collapse (less than two points for lines, less
+     than three points or no area for rings) are dropped: small features
+     disappear at the zooms where they would be smaller than one unit
+
+   Each tile then takes the pieces of the generalized geometries that fall
+   in the tile plus a buffer of VECTOR_TILE_BUFFER units on each side, so
+   that lines and polygon boundaries do not stop at the edges of the tiles
+   when they are drawn. Rings are clipped with the Sutherland-Hodgman
+   algorithm, lines with the Liang-Barsky algorithm. A geometry gives one
+   feature per kind of part (points, lines, polygons). Exterior rings are
+   written clockwise (a positive area in tile coordinates) and holes
+   counter-clockwise, as the specification requires: SDO_GEOMETRY has them
+   the other way round, as y grows upwards.
+
+   The value of each geometry becomes the id of its features, when it is a
+   positive integer: read_geom_array.c uses the row number, so that clients
+   can tell which features of adjacent tiles belong to the same geometry.
+
+   Both the generalization and the tiles are shared out between threads:
+   the generalization by groups of geometries, the tiles one at a time. The
+   tiles are appended to the file as soon as they are encoded, under a lock.
+
+*/
+#ifndef VECTOR_TILES_H
+#define VECTOR_TILES_H
+
+#include "tile_render.h"
+
+#define VECTOR_TILE_EXTENT 4096
+#define VECTOR_TILE_BUFFER 64
+#define VECTOR_TILE_HEADER_SIZE 64
+#define VECTOR_TILE_ENTRY_SIZE 24
+#define VECTOR_TILE_MAX_NAME 23
+
+/* Settings, as set from the command line */
+struct vector_tile_options
+{
+    char   *filename;                 /* NULL if no tiles are requested */
+    char   *layer_name;
+    int    min_zoom;
+    int    max_zoom;
+    double tolerance;                 /* In units of the tile grid, 0 for none */
+    int    n_threads;                 /* 0 for one per processor */
+};
+typedef struct vector_tile_options vector_tile_options_struct;
+
+/* What was built at each zoom */
+struct vector_tile_result
+{
+    int    n_threads;
+    long   n_tiles[RENDER_MAX_ZOOM+1];     /* Tiles stored */
+    long   n_features[RENDER_MAX_ZOOM+1];
+    long   n_bytes[RENDER_MAX_ZOOM+1];
+    long   max_bytes[RENDER_MAX_ZOOM+1];   /* Largest tile */
+    long   points_in[RENDER_MAX_ZOOM+1];   /* Vertices before generalization */
+    long   points_out[RENDER_MAX_ZOOM+1];  /* Vertices after generalization */
+    double seconds[RENDER_MAX_ZOOM+1];
+    long   file_size;
+};
+typedef struct vector_tile_result vector_tile_result_struct;
+
+int  ParseVectorTileOptions (int *argc, char **argv, vector_tile_options_struct *options);
+int  BuildVectorTiles (const render_layer_struct *layer, const vector_tile_options_struct *options,
+                       vector_tile_result_struct *result);
+void PrintVectorTileStatistics (const vector_tile_options_struct *options,
+                                const vector_tile_result_struct *result);
+long ReadVectorTile (const char *filename, int zoom, long column, long row, unsigned char **tile);
+
+#endif